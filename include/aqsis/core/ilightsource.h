@@ -46,6 +46,14 @@ struct IqLightsource
 	 * \param pPs the point being lit.
 	 */
 	virtual	void	Evaluate( IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface ) = 0;
+	/** Initialise the environment for a grid and evaluate the shader there.
+	 *
+	 * This is the same as Initialise() followed by Evaluate(), except that
+	 * the results of the last evaluation are kept when the shader would give
+	 * the same again, as given by IqShader::lightReuse().
+	 */
+	virtual	void	EvaluateCached( TqInt uGridRes, TqInt vGridRes, TqInt microPolygonCount, TqInt shadingPointCount, bool hasValidDerivatives,
+			IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface ) = 0;
 	/** Get a pointer to the attributes associated with this lightsource.
 	 * \return a CqAttributes pointer.
 	 */
@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+/**
+ *	@file	iraytrace.h
+ *	@author	Paul Gregory
+ *	@brief	Declare the interface class for common raytracer access.
+ *
+ *	Last change by:		$Author$
+ *	Last change date:	$Date$
+ */
+//------------------------------------------------------------------------------
+
+
+#ifndef	___iraytrace_Loaded___
+#define	___iraytrace_Loaded___
+
+#include	<aqsis/aqsis.h>
+#include	<aqsis/math/vector3d.h>
+#include	<boost/shared_ptr.hpp>
+
+namespace Aqsis {
+
+struct IqSurface;
+
+//----------------------------------------------------------------------
+/** \struct SqRay
+ * A ray segment in camera space, covering origin + t*direction for t in
+ * [tMin, tMax].  The direction need not be normalised, t is measured in
+ * units of its length.
+ */
+struct SqRay
+{
+	CqVector3D	origin;
+	CqVector3D	direction;
+	TqFloat		tMin;
+	TqFloat		tMax;
+};
+
+struct IqRaytrace
+{
+	virtual ~IqRaytrace()
+	{}
+
+
+	/** Initialise the raytracing subsystem.
+	 */
+	virtual	void	Initialise()=0;
+
+	/** Add a primitive to the raytracing space subdivision structure.
+	 */
+	virtual	void	AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface)=0;
+
+	/** Prepare the structure for raytrace queries.
+	 */
+	virtual void	Finalise()=0;
+
+	/** Find the nearest intersection of a ray with the raytracing database.
+	 * \param ray The ray to trace.
+	 * \param tHit Receives the ray parameter of the nearest hit.
+	 * \return true if the ray hit anything.
+	 */
+	virtual bool	Intersect(const SqRay& ray, TqFloat& tHit) const = 0;
+
+	/** Determine which of a set of rays are blocked by the raytracing database.
+	 *
+	 * This is the query to use for shadow rays.  Rays which are next to each
+	 * other in the array are traced together, so they should be coherent
+	 * where possible, such as rays from neighbouring shading points.
+	 *
+	 * \param rays The rays to test.
+	 * \param count The number of rays.
+	 * \param occluded Receives true for each ray which hits anything.
+	 */
+	virtual void	Occluded(const SqRay* rays, TqInt count, bool* occluded) const = 0;
+};
+
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
+
+#endif	//	___iraytrace_Loaded___
@@ -25,6 +25,7 @@ namespace Aqsis {
 
 struct IqTextureMapOld;
 struct IqTextureCache;
+struct IqRaytrace;
 
 struct IqRenderer
 {
@@ -77,6 +78,9 @@ struct IqRenderer
 	virtual	IqTextureMapOld* GetLatLongMap( const CqString& fileName ) = 0;
 	//@}
 
+	/// Get the raytracing subsystem, used for ray queries from the shading system.
+	virtual	IqRaytrace*	pRaytracer() const = 0;
+
 	virtual	bool	GetBasisMatrix( CqMatrix& matBasis, const CqString& name ) = 0;
 
 	virtual TqInt	RegisterOutputData( const char* name ) = 0;
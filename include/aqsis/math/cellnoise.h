@@ -57,7 +57,36 @@ class AQSIS_MATH_SHARE CqCellNoise
 		CqVector3D	PCellNoise3( const CqVector3D& P );
 		CqVector3D	PCellNoise4( const CqVector3D& P, TqFloat v );
 
+		/** Array versions of the above, evaluating n points.
+		 *
+		 * The arguments of point i are u[i], P[i], ..., and the noise is
+		 * placed in result[i].  With SIMD instructions the cell indices are
+		 * computed for four points at a time.
+		 */
+		void	FCellNoise1( const TqFloat* u, TqFloat* result, TqInt n );
+		void	FCellNoise2( const TqFloat* u, const TqFloat* v, TqFloat* result, TqInt n );
+		void	FCellNoise3( const CqVector3D* P, TqFloat* result, TqInt n );
+		void	FCellNoise4( const CqVector3D* P, const TqFloat* v, TqFloat* result, TqInt n );
+
+		void	PCellNoise1( const TqFloat* u, CqVector3D* result, TqInt n );
+		void	PCellNoise2( const TqFloat* u, const TqFloat* v, CqVector3D* result, TqInt n );
+		void	PCellNoise3( const CqVector3D* P, CqVector3D* result, TqInt n );
+		void	PCellNoise4( const CqVector3D* P, const TqFloat* v, CqVector3D* result, TqInt n );
+
 	private:
+		/** Hash the cells of points begin to end-1 into entries of the
+		 * permutation table, placing them in hash[0] onwards.  Coordinate a
+		 * of point i is coords[a][i*strides[a]].
+		 */
+		static void	hashCells( const TqFloat* const* coords, const TqInt* strides,
+		                       TqInt numCoords, TqInt begin, TqInt end, TqInt* hash );
+		/// Float cell noise of n points, with coordinates as for hashCells().
+		static void	cellNoise( const TqFloat* const* coords, const TqInt* strides,
+		                       TqInt numCoords, TqFloat* result, TqInt n );
+		/// Point cell noise of n points, with coordinates as for hashCells().
+		static void	cellNoise( const TqFloat* const* coords, const TqInt* strides,
+		                       TqInt numCoords, CqVector3D* result, TqInt n );
+
 		static TqInt	m_PermuteTable[ 2*2048 ];		///< static permutation table.
 		static TqFloat	m_RandomTable[ 2048 ];		///< static random table.
 }
@@ -78,6 +78,28 @@ class AQSIS_MATH_SHARE CqNoise
 		static	CqColor	CGNoise4( const CqVector3D& v, TqFloat t );
 		static	CqColor	CGPNoise4( const CqVector3D& v, TqFloat t, const CqVector3D& pv, TqFloat pt );
 
+		// Array versions of the float and point functions, evaluating n
+		// points at once with the array functions in CqNoise1234.  The
+		// arguments of point i are element i of each array, and the noise is
+		// placed in result[i].  The results are identical to those above.
+
+		static	void	FGNoise1( const TqFloat* x, TqFloat* result, TqInt n );
+		static	void	FGPNoise1( const TqFloat* x, const TqFloat* px, TqFloat* result, TqInt n );
+		static	void	FGNoise2( const TqFloat* x, const TqFloat* y, TqFloat* result, TqInt n );
+		static	void	FGPNoise2( const TqFloat* x, const TqFloat* y, const TqFloat* px, const TqFloat* py, TqFloat* result, TqInt n );
+		static	void	FGNoise3( const CqVector3D* v, TqFloat* result, TqInt n );
+		static	void	FGPNoise3( const CqVector3D* v, const CqVector3D* pv, TqFloat* result, TqInt n );
+		static	void	FGNoise4( const CqVector3D* v, const TqFloat* t, TqFloat* result, TqInt n );
+		static	void	FGPNoise4( const CqVector3D* v, const TqFloat* t, const CqVector3D* pv, const TqFloat* pt, TqFloat* result, TqInt n );
+		static	void	PGNoise1( const TqFloat* x, CqVector3D* result, TqInt n );
+		static	void	PGPNoise1( const TqFloat* x, const TqFloat* px, CqVector3D* result, TqInt n );
+		static	void	PGNoise2( const TqFloat* x, const TqFloat* y, CqVector3D* result, TqInt n );
+		static	void	PGPNoise2( const TqFloat* x, const TqFloat* y, const TqFloat* px, const TqFloat* py, CqVector3D* result, TqInt n );
+		static	void	PGNoise3( const CqVector3D* v, CqVector3D* result, TqInt n );
+		static	void	PGPNoise3( const CqVector3D* v, const CqVector3D* pv, CqVector3D* result, TqInt n );
+		static	void	PGNoise4( const CqVector3D* v, const TqFloat* t, CqVector3D* result, TqInt n );
+		static	void	PGPNoise4( const CqVector3D* v, const TqFloat* t, const CqVector3D* pv, const TqFloat* pt, CqVector3D* result, TqInt n );
+
 };
 
 //-----------------------------------------------------------------------
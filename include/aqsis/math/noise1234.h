@@ -64,6 +64,30 @@ class AQSIS_MATH_SHARE CqNoise1234
 		static TqFloat pnoise( TqFloat x, TqFloat y, TqFloat z, TqFloat w,
 		                                    TqInt px, TqInt py, TqInt pz, TqInt pw );
 
+		/** Array versions of noise() and pnoise(), evaluating n points.
+		 *
+		 * The coordinates and periods of point i are x[i], y[i], ...,
+		 * px[i], py[i], ..., and the noise is placed in result[i].  The
+		 * results are identical to those of the functions above, but four
+		 * points are evaluated at a time with SIMD instructions where these
+		 * are available.
+		 */
+		static void noise( const TqFloat* x, TqFloat* result, TqInt n );
+		static void noise( const TqFloat* x, const TqFloat* y, TqFloat* result, TqInt n );
+		static void noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                   TqFloat* result, TqInt n );
+		static void noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                   const TqFloat* w, TqFloat* result, TqInt n );
+		static void pnoise( const TqFloat* x, const TqInt* px, TqFloat* result, TqInt n );
+		static void pnoise( const TqFloat* x, const TqFloat* y, const TqInt* px,
+		                    const TqInt* py, TqFloat* result, TqInt n );
+		static void pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                    const TqInt* px, const TqInt* py, const TqInt* pz,
+		                    TqFloat* result, TqInt n );
+		static void pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                    const TqFloat* w, const TqInt* px, const TqInt* py,
+		                    const TqInt* pz, const TqInt* pw, TqFloat* result, TqInt n );
+
 	private:
 		static unsigned char perm[];
 		static TqFloat  grad( TqInt hash, TqFloat x );
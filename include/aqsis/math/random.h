@@ -117,6 +117,23 @@ class AQSIS_MATH_SHARE CqRandom
 		void NextState();
 };
 
+//-----------------------------------------------------------------------
+/** \brief Scramble an integer into a well distributed hash value.
+ *
+ * Unlike CqRandom this keeps no state, so it gives the same value for the
+ * same input no matter which thread asks, or in which order.  Use it to pick
+ * pseudo random values from a position or other key.
+ */
+inline TqUint hashRandom(TqUint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
@@ -0,0 +1,70 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Factoring of 2D filter kernels into horizontal and vertical parts.
+ */
+
+#ifndef SEPARABLE_H_INCLUDED
+#define SEPARABLE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+namespace Aqsis {
+
+/** \brief Split a 2D kernel into a product of horizontal and vertical weights.
+ *
+ * A kernel is separable if the weight at (x,y) is the product of a weight
+ * depending only on x and one depending only on y.  The kernel is factored
+ * about its largest weight: the row through that weight gives the horizontal
+ * weights, and the column through it, divided by the largest weight, gives
+ * the vertical weights.  The factors are accepted if their product is within
+ * 1e-4 of the largest weight plus absTolerance of every kernel weight.
+ *
+ * \param kernel - width*height weights, stored by rows.
+ * \param width - number of weights in each row
+ * \param height - number of rows
+ * \param xWeights - set to the width horizontal weights.
+ * \param yWeights - set to the height vertical weights.
+ * \param absTolerance - extra tolerance, for kernels where small weights
+ *                       have been rounded to zero.
+ * \return true if the kernel is separable; the weights are only set in this
+ *         case.  A kernel of zeros is not separable.
+ */
+AQSIS_MATH_SHARE bool separateKernel(const TqFloat* kernel, TqInt width,
+		TqInt height, std::vector<TqFloat>& xWeights,
+		std::vector<TqFloat>& yWeights, TqFloat absTolerance = 0);
+
+} // namespace Aqsis
+
+#endif // SEPARABLE_H_INCLUDED
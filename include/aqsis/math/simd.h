@@ -0,0 +1,40 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Detect the SIMD instruction sets which the compiler targets.
+ *
+ * AQSIS_SIMD_SSE2 is defined, and the SSE2 intrinsics are included, when the
+ * code is being compiled for a processor with SSE2.  Vectorised code should
+ * test for it, and keep a scalar fallback giving the same results for other
+ * targets.
+ */
+
+#ifndef AQSIS_SIMD_H_INCLUDED
+#define AQSIS_SIMD_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define	AQSIS_SIMD_SSE2 1
+#	include	<emmintrin.h>
+#endif
+
+#endif // AQSIS_SIMD_H_INCLUDED
@@ -40,6 +40,9 @@
 #include <aqsis/config.h>
 
 #include <iosfwd>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
 
 namespace Aqsis
 {
@@ -72,6 +75,17 @@ class AQSIS_RIUTIL_SHARE RibParser
         virtual ~RibParser() {}
 };
 
+/// Open a RIB file for parsing.
+///
+/// Regular files are memory mapped where possible, in which case the parser
+/// reads the RIB in place rather than copying it through the stream buffer.
+/// Other files, such as pipes, are opened as an ordinary std::ifstream.
+///
+/// \param fileName - name of the file to open
+/// \return The opened stream, or null if the file couldn't be opened.
+AQSIS_RIUTIL_SHARE
+boost::shared_ptr<std::istream> openRibFile(const std::string& fileName);
+
 } // namespace Aqsis
 
 #endif // AQSIS_RIBPARSER_H_INCLUDED
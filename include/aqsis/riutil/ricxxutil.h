@@ -240,9 +240,15 @@ typedef boost::function<bool(const char*)> IfElseTestCallback;
 /// string, and return a bool indicating whether the condition evaluated to
 /// true or false.
 ///
+/// If cacheObjects is false, ObjectBegin, ObjectEnd and ObjectInstance are
+/// passed through to the next filter rather than being expanded, for
+/// renderers which retain objects themselves.  Objects inside inline archives
+/// are still cached along with the rest of the archive.
+///
 AQSIS_RIUTIL_SHARE
 Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback =
-                                   IfElseTestCallback());
+                                   IfElseTestCallback(),
+                                   bool cacheObjects = true);
 
 //------------------------------------------------------------------------------
 /// Empty implementation of Ri::Renderer
@@ -44,6 +44,18 @@ enum EqShaderType
     Type_Imager,   			///< Image shader.
 };
 
+//----------------------------------------------------------------------
+/** \enum EqLightReuse
+ * How the results of a lightsource shader may be reused.
+ */
+
+enum EqLightReuse
+{
+    LightReuse_None,   		///< The shader must be run every time.
+    LightReuse_Points,   	///< The results depend only on Ps, Ns and the surface being lit.
+    LightReuse_Uniform,   	///< The results are the same at every point lit.
+};
+
 #define	USES(a,b)	((a)&(0x00000001<<(b))?true:false)
 #define	isDONE(a,b)	((a)&(0x00000001<<(b))?true:false)
 #define	DONE(a,b)	((a)=(a)|(0x00000001<<(b)))
@@ -121,6 +133,10 @@ struct AQSIS_SHADERVM_SHARE IqShader
 	 * i.e. A lightsource shader with no Illuminate or Solar constructs.
 	 */
 	virtual	bool	fAmbient() const = 0;
+	/** Determine how the results of this shader may be reused when it is
+	 * run as a lightsource.
+	 */
+	virtual	EqLightReuse	lightReuse() const = 0;
 	/** Duplicate this shader.
 	 * \return A pointer to a new shader.
 	 */
@@ -174,6 +190,19 @@ AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* rend
 AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
 										   std::istream& programFile,
 										   const std::string& dsoPath);
+
+/** \brief Create a CqShaderVM from a compiled shader file.
+ *
+ * The most recently used programs are cached, keyed on the path of the file
+ * and checked against a hash of its contents, so a shader used by several
+ * renders is only parsed once.
+ *
+ * \param programPath - path to the compiled shader, in text or binary form.
+ * \throw XqBadShader if the file can't be read or the program is invalid.
+ */
+AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
+										   const std::string& programPath,
+										   const std::string& dsoPath);
 //@}
 
 /** \brief Reset ShaderVM static variables
@@ -443,6 +443,7 @@ struct AQSIS_SHADERVM_SHARE IqShaderExecEnv
 	virtual STD_SO	SO_specular( NORMALVAL N, VECTORVAL V, FLOATVAL roughness, DEFPARAM ) = 0;
 	virtual STD_SO	SO_phong( NORMALVAL N, VECTORVAL V, FLOATVAL size, DEFPARAM ) = 0;
 	virtual STD_SO	SO_trace( POINTVAL P, VECTORVAL R, DEFPARAM ) = 0;
+	virtual STD_SO	SO_transmission( POINTVAL Psrc, POINTVAL Pdst, DEFPARAMVAR ) = 0;
 	virtual STD_SO	SO_ftexture1( STRINGVAL name, DEFPARAMVAR ) = 0;
 	virtual STD_SO	SO_ftexture2( STRINGVAL name, FLOATVAL s, FLOATVAL t, DEFPARAMVAR ) = 0;
 	virtual STD_SO	SO_ftexture3( STRINGVAL name, FLOATVAL s1, FLOATVAL t1, FLOATVAL s2, FLOATVAL t2, FLOATVAL s3, FLOATVAL t3, FLOATVAL s4, FLOATVAL t4, DEFPARAMVAR ) = 0;
@@ -57,7 +57,15 @@ class IqCodeGen
 class AQSIS_SLCOMP_SHARE CqCodeGenVM : public IqCodeGen
 {
 	public:
+		/** \brief Construct the code generator.
+		 *
+		 * \param binary - if true, write compiled shaders in the binary form
+		 *                 described in slxbinary.h, which loads faster.
+		 */
+		CqCodeGenVM( bool binary = false ) : m_binary( binary ) {}
 		virtual void OutputTree( IqParseNode* pNode, std::string strOutName );
+	private:
+		bool m_binary;
 };
 
 
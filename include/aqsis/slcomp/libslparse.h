@@ -36,9 +36,12 @@ namespace Aqsis {
 struct IqParseNode;
 
 /// Parses an input stream, using the supplied callback object and sending
-/// error data to the supplied output stream
+/// error data to the supplied output stream.  Unless optimise is false, the
+/// code is optimised: constants are propagated and folded, unused code is
+/// removed, variables which are always uniform are made uniform, and
+/// repeated and loop invariant expressions are computed once.
 AQSIS_SLCOMP_SHARE bool Parse(std::istream& InputStream, const std::string& StreamName,
-		   std::ostream& ErrorStream );
+		   std::ostream& ErrorStream, bool optimise = true );
 
 /// Resets the state of the parser, clearing any symbol tables, etc.
 AQSIS_SLCOMP_SHARE void ResetParser();
@@ -0,0 +1,78 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+ *
+ * \brief Declares the binary form of compiled shaders.
+ *
+ * A binary slx file holds the tokens of the text form, lexed ahead of time so
+ * that the shader VM can load it without scanning characters or parsing
+ * numbers.  Each distinct word is stored once, so it only needs to be hashed
+ * once when the program is loaded.  Quoted strings are stored as they appear
+ * in the text, quotes included.
+ *
+ * Only decimal numbers are stored as numbers, parsed exactly as the VM parses
+ * them in the text form, so a program loads the same values from either form.
+ * Anything else, hexadecimal included, is stored as a word.
+ *
+ * The layout, in the byte order of the machine which wrote the file, is:
+ *
+ * \verbatim
+ *   char[8]   slxBinaryMagic
+ *   uint32    slxBinaryByteOrder
+ *   uint32    AQSIS_SLX_VERSION
+ *   uint32    number of strings, each followed by
+ *               uint32 length and the characters, without a terminator
+ *   uint32    number of tokens, each one a uint32 holding either
+ *               the index of a string,
+ *               slxBinaryInteger followed by the value as an int32, or
+ *               slxBinaryNumber followed by the value as a float
+ * \endverbatim
+ */
+
+#ifndef SLXBINARY_H_INCLUDED
+#define SLXBINARY_H_INCLUDED
+
+#include	<aqsis/aqsis.h>
+
+#include	<iosfwd>
+
+namespace Aqsis {
+
+/// Characters at the start of a binary slx file.
+const char slxBinaryMagic[8] = { 'A', 'Q', 'S', 'L', 'X', 'B', 'I', 'N' };
+/// Byte order mark, which reads differently on machines of the other endianness.
+const TqUint32 slxBinaryByteOrder = 0x01020304;
+/// Token value marking a number.
+const TqUint32 slxBinaryNumber = 0xFFFFFFFF;
+/// Token value marking an integer, which is also a number.
+const TqUint32 slxBinaryInteger = 0xFFFFFFFE;
+
+/** \brief Convert a compiled shader from the text form to the binary form.
+ *
+ * \param slxText - stream holding the text form of the program.
+ * \param out - stream to write the binary form to.  This should be opened in
+ *              binary mode.
+ */
+AQSIS_SLCOMP_SHARE void slxTextToBinary( std::istream& slxText, std::ostream& out );
+
+} // namespace Aqsis
+
+#endif	// SLXBINARY_H_INCLUDED
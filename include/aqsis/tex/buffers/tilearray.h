@@ -43,16 +43,15 @@
 
 #include <vector>
 
-#include <boost/intrusive_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
-#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 
 //#include <aqsis/util/memorysentry.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include <aqsis/tex/buffers/texturebuffer.h>
+#include <aqsis/tex/buffers/tilecache.h>
 #include "randomtable.h"
-#include <aqsis/util/smartptr.h>
 
 namespace Aqsis {
 
@@ -83,6 +82,11 @@ class CqTextureTile;
  * iterator mechanism for traversing all pixels within a given region.  This
  * allows for efficient filtering to be performed over the texture, without
  * worrying about the underlying tiled structure.
+ *
+ * Tiles are read from file on demand and held in the global CqTileCache, so
+ * they may be discarded again when texture memory runs short.  Iterators
+ * keep the tile they're traversing alive, so several threads may iterate
+ * over the same array at once.
  */
 template<typename T>
 class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
@@ -92,6 +96,7 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 	public:
 		class CqIterator;
 		class CqStochasticIterator;
+		class CqPixel;
 
 		typedef CqIterator TqIterator;
 		typedef CqStochasticIterator TqStochasticIterator;
@@ -105,6 +110,8 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		 */
 		CqTileArray(const boost::shared_ptr<IqTiledTexInputFile>& inFile,
 				TqInt subImageIdx);
+		/// Discard the tiles of the array from the tile cache.
+		~CqTileArray();
 
 		//--------------------------------------------------
 		/// \name Access to buffer dimensions & metadata
@@ -115,6 +122,10 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqInt height() const;
 		/// Get the number of samples per pixel
 		TqInt numChannels() const;
+		/// Get the width of the tiles making up the array
+		TqInt tileWidth() const;
+		/// Get the height of the tiles making up the array
+		TqInt tileHeight() const;
 		//@}
 
 		//--------------------------------------------------
@@ -127,13 +138,15 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		 *
 		 * Note that this function is not be very efficient, since the correct
 		 * tile has to be deduced for each invocation, which involves two
-		 * integer divisions.
+		 * integer divisions and a tile cache lookup.  The returned pixel pins
+		 * the tile holding it, so the tile can't be evicted from the tile
+		 * cache while the pixel is held.
 		 *
 		 * \param x - pixel index in width direction (column index)
 		 * \param y - pixel index in height direction (row index)
-		 * \return a lightweight vector holding a reference to the channels data
+		 * \return a pixel holding a reference to the channels data
 		 */
-		const TqSampleVector operator()(const TqInt x, const TqInt y) const;
+		const CqPixel operator()(const TqInt x, const TqInt y) const;
 		/** \brief Access to pixels through a pixel iterator
 		 *
 		 * The pixel iterator will iterate through all the pixels the provided
@@ -156,10 +169,12 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		//@}
 	private:
 		/** \brief Access to the underlying tiles
+		 *
+		 * The tile is read from file if it isn't in the tile cache.
 		 *
 		 * \return The tile holding the underlying data at the given indices.
 		 */
-		boost::intrusive_ptr<TqTile> getTile(const TqInt x, const TqInt y) const;
+		boost::shared_ptr<TqTile> getTile(const TqInt x, const TqInt y) const;
 
 		/// Underlying texture file.
 		boost::shared_ptr<IqTiledTexInputFile> m_inFile;
@@ -179,8 +194,37 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqInt m_widthInTiles;
 		/// Height of the array
 		TqInt m_heightInTiles;
-		/// "2D" array of tiles.  Tiles may be founnd in O(1) time using this array.
-		boost::scoped_array<boost::intrusive_ptr<TqTile> > m_tiles;
+		/// Id identifying the tiles of this array in the tile cache.
+		TqUlong m_cacheId;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief A pixel of a CqTileArray which keeps its tile alive.
+ *
+ * This presents the pixel channels as floating point values in the same way
+ * as TqSampleVector, while holding the tile so that it isn't evicted from the
+ * tile cache and freed underneath the caller.
+ */
+template<typename T>
+class CqTileArray<T>::CqPixel
+{
+	public:
+		/// Get the value of a channel of the pixel.
+		TqFloat operator[](TqInt index) const;
+		/// Get the channels of the pixel.  Only valid while *this is held.
+		const TqSampleVector& samples() const;
+
+	private:
+		/// Construct a pixel holding the given tile.
+		CqPixel(const boost::shared_ptr<TqTile>& tile, TqInt x, TqInt y);
+
+		/// Tile holding the pixel.
+		boost::shared_ptr<TqTile> m_tile;
+		/// Channels of the pixel.
+		TqSampleVector m_samples;
+
+		friend class CqTileArray<T>;
 };
 
 
@@ -243,6 +287,8 @@ class CqTileArray<T>::CqIterator
 		/// Current tile y-coordinate
 		TqInt m_tileY;
 
+		/// Current tile, held so that it can't be evicted while in use.
+		boost::shared_ptr<TqTile> m_tile;
 		/// Current position in the underlying tiles.
 		TqBaseIter m_currPos;
 
@@ -300,9 +346,6 @@ class CqTileArray<T>::CqStochasticIterator
 		/// Iterator type for the underlying tiles
 		typedef typename TqTile::TqStochasticIterator TqBaseIter;
 
-		/// Random number stream for partitioning samples into tiles (see nextTile)
-		static CqRandom m_random;
-
 		/// Support region to iterate over.
 		SqFilterSupport m_support;
 		/// Parent array to obtain tiles from.
@@ -321,6 +364,12 @@ class CqTileArray<T>::CqStochasticIterator
 		TqFloat m_remainingArea;
 		/// Number of samples remaining for tiles yet to be filtered over.
 		TqInt m_remainingSamples;
+		/// Key for the pseudo random choices partitioning samples into tiles
+		/// (see nextTile).  It depends only on the support, so results are
+		/// independent of thread and lookup order.
+		TqUint m_randomKey;
+		/// Current tile, held so that it can't be evicted while in use.
+		boost::shared_ptr<TqTile> m_tile;
 		/// Current position in the underlying tiles.
 		TqBaseIter m_currPos;
 
@@ -337,14 +386,10 @@ class CqTileArray<T>::CqStochasticIterator
  * the actual pixels.  ArrayT should be a model of FilterableArrayConcept to
  * provide pixel iterators to iterate over the contained pixels.
  *
- * The wrapper adds two things to the underlying array:
- *   - Adjust the origin of the array to some point (x0, y0)
- *   - Facilities to enable being held by a tiled array (intrusive reference
- *     counting, and support for determining recent usage for tile cache
- *     rejection (FIXME coming soon) )
+ * The wrapper adjusts the origin of the array to some point (x0, y0).
  */
 template<typename ArrayT>
-class CqTextureTile : public CqIntrusivePtrCounted
+class CqTextureTile : boost::noncopyable
 {
 	private:
 		/// Underlying array of pixels
@@ -487,9 +532,15 @@ CqTileArray<T>::CqTileArray(const boost::shared_ptr<IqTiledTexInputFile>& inFile
 	m_tileHeight(inFile->tileInfo().height),
 	m_widthInTiles((m_width-1)/m_tileWidth + 1), // "ceil(m_width/m_tileWidth)"
 	m_heightInTiles((m_height-1)/m_tileHeight + 1),
-	m_tiles(new boost::intrusive_ptr<TqTile>[m_widthInTiles*m_heightInTiles])
+	m_cacheId(CqTileCache::globalCache().newArrayId())
 { }
 
+template<typename T>
+CqTileArray<T>::~CqTileArray()
+{
+	CqTileCache::globalCache().erase(m_cacheId);
+}
+
 template<typename T>
 inline TqInt CqTileArray<T>::width() const
 {
@@ -509,10 +560,22 @@ inline TqInt CqTileArray<T>::numChannels() const
 }
 
 template<typename T>
-const typename CqTileArray<T>::TqSampleVector
+inline TqInt CqTileArray<T>::tileWidth() const
+{
+	return m_tileWidth;
+}
+
+template<typename T>
+inline TqInt CqTileArray<T>::tileHeight() const
+{
+	return m_tileHeight;
+}
+
+template<typename T>
+const typename CqTileArray<T>::CqPixel
 CqTileArray<T>::operator()(const TqInt x, const TqInt y) const
 {
-	return (*getTile(x/m_tileWidth, y/m_tileHeight))(x,y);
+	return CqPixel(getTile(x/m_tileWidth, y/m_tileHeight), x, y);
 }
 
 template<typename T>
@@ -532,19 +595,49 @@ inline typename CqTileArray<T>::TqStochasticIterator CqTileArray<T>::beginStocha
 }
 
 template<typename T>
-boost::intrusive_ptr<typename CqTileArray<T>::TqTile> CqTileArray<T>::getTile(
+boost::shared_ptr<typename CqTileArray<T>::TqTile> CqTileArray<T>::getTile(
 		const TqInt x, const TqInt y) const
 {
 	assert(x < m_widthInTiles);
 	assert(y < m_heightInTiles);
-	boost::intrusive_ptr<TqTile>& tilePtr = m_tiles[y*m_widthInTiles + x];
-	if(!tilePtr)
+	CqTileCache& cache = CqTileCache::globalCache();
+	TqInt index = y*m_widthInTiles + x;
+	CqTileCache::TqTilePtr cached = cache.find(m_cacheId, index);
+	if(!cached)
 	{
-		tilePtr = boost::intrusive_ptr<TqTile>(
-				new TqTile(x*m_tileWidth, y*m_tileHeight));
-		m_inFile->readTile(tilePtr->pixels(), x, y, m_subImageIdx);
+		boost::shared_ptr<TqTile> tile(new TqTile(x*m_tileWidth, y*m_tileHeight));
+		{
+			CqTileCache::CqFileLock lock(cache, m_inFile.get());
+			m_inFile->readTile(tile->pixels(), x, y, m_subImageIdx);
+		}
+		const CqTextureBuffer<T>& pixels = tile->pixels();
+		cached = cache.insert(m_cacheId, index, tile, sizeof(TqTile)
+				+ sizeof(T)*pixels.width()*pixels.height()*pixels.numChannels());
 	}
-	return tilePtr;
+	return boost::static_pointer_cast<TqTile>(cached);
+}
+
+
+//------------------------------------------------------------------------------
+// CqTileArray::CqPixel implementation
+template<typename T>
+inline CqTileArray<T>::CqPixel::CqPixel(const boost::shared_ptr<TqTile>& tile,
+		TqInt x, TqInt y)
+	: m_tile(tile),
+	m_samples((*tile)(x,y))
+{ }
+
+template<typename T>
+inline TqFloat CqTileArray<T>::CqPixel::operator[](TqInt index) const
+{
+	return m_samples[index];
+}
+
+template<typename T>
+inline const typename CqTileArray<T>::TqSampleVector&
+CqTileArray<T>::CqPixel::samples() const
+{
+	return m_samples;
 }
 
 
@@ -578,7 +671,8 @@ void CqTileArray<T>::CqIterator::nextTile()
 	{
 		// Grab the next tile as long as we're within the overall
 		// filter support.
-		m_currPos = m_tileArray->getTile(m_tileX,m_tileY)->begin(m_support);
+		m_tile = m_tileArray->getTile(m_tileX,m_tileY);
+		m_currPos = m_tile->begin(m_support);
 	}
 }
 
@@ -619,8 +713,9 @@ CqTileArray<T>::CqIterator::CqIterator(const CqTileArray<T>& tileArray,
 	m_tileY(support.sy.start/tileArray.m_tileHeight),
 	// Check support.sx.empty() etc in order to make sure the tile
 	// index is still valid when the support is outside the buffer
-	m_currPos(m_tileArray->getTile(support.sx.isEmpty() ? 0 : m_tileX,
-				support.sy.isEmpty() ? 0 : m_tileY)->begin(m_support))
+	m_tile(m_tileArray->getTile(support.sx.isEmpty() ? 0 : m_tileX,
+				support.sy.isEmpty() ? 0 : m_tileY)),
+	m_currPos(m_tile->begin(m_support))
 {
 	// Make sure that inSupport() works correctly when the support is empty.
 	if(support.isEmpty())
@@ -630,9 +725,6 @@ CqTileArray<T>::CqIterator::CqIterator(const CqTileArray<T>& tileArray,
 
 //------------------------------------------------------------------------------
 // CqTileArray<T>::CqStochasticIterator implementation
-template<typename T>
-CqRandom CqTileArray<T>::CqStochasticIterator::m_random;
-
 template<typename T>
 inline typename CqTileArray<T>::CqStochasticIterator&
 CqTileArray<T>::CqStochasticIterator::operator++()
@@ -681,16 +773,17 @@ void CqTileArray<T>::CqStochasticIterator::nextTile()
 		// 2) For any fractional part of the desired samples which remains, we
 		//    accept an extra sample with probability proportional to the
 		//    fractional part.
-		// TODO: Investigate the performance impact of using RandomFloat() here.
-		numSamples += m_random.RandomFloat() < desiredSamples-numSamples;
+		numSamples += Cq2dQuasiRandomTable::offset(m_randomKey
+				^ (TqUint(m_tileX)*73856093U ^ TqUint(m_tileY)*19349663U))
+			< desiredSamples-numSamples;
 		// Note that this scheme is actually biased toward tiles which are
 		// found later in the support in the case that a very small number of
 		// samples is used.  This may not matter in practise...
 		m_remainingArea -= area;
 	}
 	// Grab the underlying iterator for the next tile
-	m_currPos = m_tileArray->getTile(m_tileX,m_tileY)->beginStochastic(m_support,
-			numSamples);
+	m_tile = m_tileArray->getTile(m_tileX,m_tileY);
+	m_currPos = m_tile->beginStochastic(m_support, numSamples);
 	m_remainingSamples -= numSamples;
 }
 
@@ -731,6 +824,9 @@ CqTileArray<T>::CqStochasticIterator::CqStochasticIterator(const CqTileArray<T>&
 	m_tileY(support.sy.start/tileArray.m_tileHeight),
 	m_remainingArea(support.area()),
 	m_remainingSamples(numSamps),
+	m_randomKey(TqUint(support.sx.start)*83492791U ^ TqUint(support.sy.start)*2654435761U
+			^ TqUint(numSamps)),
+	m_tile(),
 	m_currPos()
 {
 	// Make sure that inSupport() works correctly when the support region is
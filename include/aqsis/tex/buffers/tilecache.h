@@ -0,0 +1,172 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief A memory-bounded cache of texture tiles.
+ */
+
+#ifndef TILECACHE_H_INCLUDED
+#define TILECACHE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace Aqsis {
+
+/// Counters describing the behaviour of a CqTileCache.
+struct SqTileCacheStats
+{
+	/// Number of tile lookups which found the tile in the cache.
+	TqUlong hits;
+	/// Number of tile lookups which had to read the tile from file.
+	TqUlong misses;
+	/// Number of tiles discarded to stay within the memory limit.
+	TqUlong evictions;
+	/// Memory currently held by cached tiles, in bytes.
+	std::size_t bytes;
+
+	SqTileCacheStats();
+};
+
+/** \brief A cache of texture tiles with a bound on total memory.
+ *
+ * Tiles are owned by the cache and identified by the id of the tile array
+ * they belong to, together with their index in that array.  When the memory
+ * held by cached tiles exceeds the limit, the least recently used tiles are
+ * discarded; a discarded tile stays alive for as long as someone else holds a
+ * pointer to it, and is read from file again the next time it's needed.
+ *
+ * The cache is split into a number of stripes, each with its own lock and
+ * least-recently-used list.  Tiles are spread over the stripes by hashing
+ * their keys, so that rendering threads reading different tiles rarely
+ * contend for the same lock.  The memory limit is shared by all stripes: a
+ * stripe may grow beyond an even share of the limit while the cache as a
+ * whole fits, and when it doesn't, tiles are evicted from the stripes which
+ * hold more than their share.
+ *
+ * All texture samplers share the cache returned by globalCache().
+ */
+class AQSIS_TEX_SHARE CqTileCache : boost::noncopyable
+{
+	public:
+		/// Type-erased pointer to a cached tile.
+		typedef boost::shared_ptr<void> TqTilePtr;
+
+		/// Memory limit used when none is set explicitly (256 MB).
+		static const std::size_t defaultMaxBytes = 256*1024*1024;
+
+		/// Construct an empty cache with the given memory limit.
+		explicit CqTileCache(std::size_t maxBytes = defaultMaxBytes);
+		~CqTileCache();
+
+		/// Get the cache shared by all texture samplers.
+		static CqTileCache& globalCache();
+
+		/// Get a new id, unique over the lifetime of the cache, for a tile array.
+		TqUlong newArrayId();
+
+		/** \brief Look up a tile.
+		 *
+		 * \param arrayId - id of the tile array the tile belongs to.
+		 * \param index - index of the tile in the tile array.
+		 * \return the tile, or a null pointer if it's not in the cache.
+		 */
+		TqTilePtr find(TqUlong arrayId, TqInt index);
+		/** \brief Insert a tile which was not found in the cache.
+		 *
+		 * If another thread has inserted the same tile in the mean time, the
+		 * tile already in the cache is kept and returned instead.  Inserting
+		 * may evict other tiles to stay within the memory limit.
+		 *
+		 * \param arrayId - id of the tile array the tile belongs to.
+		 * \param index - index of the tile in the tile array.
+		 * \param tile - tile to insert.
+		 * \param bytes - memory held by the tile.
+		 * \return the tile held by the cache.
+		 */
+		TqTilePtr insert(TqUlong arrayId, TqInt index, const TqTilePtr& tile,
+				std::size_t bytes);
+		/// Discard all tiles belonging to the given tile array.
+		void erase(TqUlong arrayId);
+		/// Discard all tiles and reset the statistics.
+		void clear();
+
+		/// Set the limit on the memory held by cached tiles.
+		void setMaxBytes(std::size_t maxBytes);
+		/// Get the limit on the memory held by cached tiles.
+		std::size_t maxBytes() const;
+
+		/// Get the statistics accumulated since the last clear().
+		SqTileCacheStats stats() const;
+
+		/** \brief Lock serialising tile reads from a file.
+		 *
+		 * Texture files can't be read from several threads at once, so tile
+		 * arrays hold one of these while reading a tile.  Locks are striped
+		 * by file in the same way as the cache itself.
+		 */
+		class AQSIS_TEX_SHARE CqFileLock : boost::noncopyable
+		{
+			public:
+				CqFileLock(CqTileCache& cache, const void* file);
+				~CqFileLock();
+			private:
+				CqTileCache& m_cache;
+				TqInt m_stripe;
+		};
+
+	private:
+		class CqBudget;
+		class CqStripe;
+
+		/// Get the stripe holding the given tile.
+		CqStripe& stripe(TqUlong arrayId, TqInt index);
+		/// Evict tiles from stripes holding more than their share of memory
+		/// until the cache fits within the memory limit.
+		void shrink();
+
+		/// Memory held by all stripes together, and the limit on it.
+		boost::scoped_ptr<CqBudget> m_budget;
+		/// Next id to hand out from newArrayId().
+		TqUlong m_nextArrayId;
+		/// Stripes of the cache, each holding part of the tiles.
+		boost::scoped_array<CqStripe> m_stripes;
+};
+
+} // namespace Aqsis
+
+#endif // TILECACHE_H_INCLUDED
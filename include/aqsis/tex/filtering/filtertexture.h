@@ -169,8 +169,11 @@ void filterWrappedBuffer(SampleAccumT& sampleAccum, const ArrayT& buffer,
 			TqInt xClamp = clamp(tlX, 0, buffer.width()-1);
 			TqInt yClamp = clamp(tlY, 0, buffer.height()-1);
 			// sampVec is the samples for the corner pixel to be accumulated.
-			typename ArrayT::TqSampleVector sampVec = *buffer.begin(SqFilterSupport(
+			// The iterator is held so that the tile holding the pixel stays
+			// alive while sampVec is used.
+			typename ArrayT::TqIterator corner = buffer.begin(SqFilterSupport(
 						xClamp, xClamp+1, yClamp, yClamp+1));
+			typename ArrayT::TqSampleVector sampVec = *corner;
 			for(TqInt ix = tileSupport.sx.start; ix < tileSupport.sx.end; ++ix)
 				for(TqInt iy = tileSupport.sy.start; iy < tileSupport.sy.end; ++iy)
 					sampleAccum.accumulate(ix, iy, sampVec);
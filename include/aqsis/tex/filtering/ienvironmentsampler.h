@@ -47,6 +47,7 @@
 
 namespace Aqsis {
 
+class CqBitVector;
 class IqTiledTexInputFile;
 
 //------------------------------------------------------------------------------
@@ -84,6 +85,30 @@ class AQSIS_TEX_SHARE IqEnvironmentSampler
 		virtual void sample(const Sq3DSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const = 0;
 
+		/** \brief Filter the texture over the regions of a grid of points.
+		 *
+		 * This gives the same results as calling sample() for each running
+		 * point, but lets the sampler share the setup between the points, and
+		 * order the lookups so that nearby ones are done together.  The
+		 * default implementation calls sample() for each running point.
+		 *
+		 * \param sampleQuads - array of numPoints regions to filter over
+		 * \param numPoints - number of points in the grid
+		 * \param runningState - mask of the points to sample, or null to
+		 *                       sample all points.
+		 * \param sampleOpts - options to the sampler, for all points.
+		 * \param outSamps - results for point i will be placed at
+		 *                   outSamps + i*sampleOpts.numChannels().  Results
+		 *                   for points which aren't running are untouched.
+		 */
+		virtual void sampleGrid(const Sq3DSampleQuad* sampleQuads,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		/// Filter the texture over a grid of parallelogram regions.
+		virtual void sampleGrid(const Sq3DSamplePllgram* samplePllgrams,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		/** \brief Get the default sample options for this texture.
 		 *
 		 * The default implementation returns texture sample options
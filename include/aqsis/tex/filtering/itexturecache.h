@@ -40,9 +40,13 @@
 
 #include <aqsis/aqsis.h>
 
+#include <cstddef>
+
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <aqsis/tex/buffers/tilecache.h>
+
 namespace Aqsis {
 
 class IqTextureSampler;
@@ -92,6 +96,17 @@ struct AQSIS_TEX_SHARE IqTextureCache
 	/// Delete all textures from the cache
 	virtual void flush() = 0;
 
+	/** \brief Set the limit on memory used by texture tiles.
+	 *
+	 * Tiles are shared between all samplers, and the least recently used
+	 * tiles are discarded once the limit is reached.
+	 *
+	 * \param maxBytes - memory limit in bytes.
+	 */
+	virtual void setTileMemoryLimit(std::size_t maxBytes) = 0;
+	/// Get statistics for texture tile accesses since the last flush().
+	virtual SqTileCacheStats tileCacheStats() const = 0;
+
 	/** \brief Return the texture file attributes for the named file.
 	 *
 	 * If the file is not found or is otherwise invalid, return 0.
@@ -121,6 +121,14 @@ class AQSIS_UTIL_SHARE CqBitVector
 			assert( elem < m_cLength );
 			return ( ( m_aBits[ elem / CHAR_BIT ] & ( 1 << ( elem % CHAR_BIT ) ) ) ? true : false );
 		}
+		/** Get four consecutive bits in the low bits of an integer.
+		 * \param elem the index of the first bit, which must be a multiple of four.
+		 */
+		TqInt Value4( TqInt elem ) const
+		{
+			assert( elem % 4 == 0 && elem + 4 <= m_cLength );
+			return ( ( m_aBits[ elem / CHAR_BIT ] >> ( elem % CHAR_BIT ) ) & 0xf );
+		}
 		/** Toggle the state of the indexed bit.
 		 * \param elem the index of the bit to modify.
 		 */
@@ -29,6 +29,10 @@
 
 #include	<aqsis/aqsis.h>
 
+#ifdef ENABLE_THREADING
+#include	<boost/thread/mutex.hpp>
+#endif
+
 namespace Aqsis {
 
 template <class T, TqInt CS=8>
@@ -48,6 +52,10 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 
 		const unsigned int m_esize;
 		SqLink* m_head;
+#ifdef ENABLE_THREADING
+		/// Objects may be allocated and freed from any rendering thread.
+		boost::mutex m_mutex;
+#endif
 
 		void grow()	// Allocate new 'chunk', organize it as a linked list of elements of size 'm_esize'
 		{
@@ -107,6 +115,9 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 #		endif
 		void* alloc()
 		{
+#ifdef ENABLE_THREADING
+			boost::mutex::scoped_lock lock(m_mutex);
+#endif
 			if (m_head==0)
 				grow();
 			SqLink* p = m_head;
@@ -116,6 +127,9 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 
 		void free(void* b)
 		{
+#ifdef ENABLE_THREADING
+			boost::mutex::scoped_lock lock(m_mutex);
+#endif
 			SqLink* p = static_cast<SqLink*>(b);
 			p->m_next = m_head;
 			m_head = p;
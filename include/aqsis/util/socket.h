@@ -75,6 +75,25 @@ class AQSIS_UTIL_SHARE CqSocket : boost::noncopyable
 		bool	connect(const std::string hostname, int port);
 		int		sendData(const std::string& data) const;
 		int		recvData(std::stringstream& buffer) const;
+		/** Send raw data gathered from several buffers, without the
+		 * terminator which sendData() appends.
+		 *
+		 * The buffers are handed to the system in one go, so that data can
+		 * be sent straight from where it lives without first being copied
+		 * together with its header.
+		 *
+		 * \param buffers - pointers to the data to send.
+		 * \param lengths - number of bytes in each buffer.
+		 * \param count - number of buffers.
+		 * \return The number of bytes sent, or -1 on error.
+		 */
+		int		sendBuffers(const void* const* buffers, const size_t* lengths, int count) const;
+		/** Receive exactly the given number of bytes of raw data.
+		 *
+		 * \return The number of bytes received, which is less than length
+		 * if the connection was closed or an error occurred.
+		 */
+		int		recvBytes(void* data, size_t length) const;
 		/** Get the current port.
 		 */
 		int port() const
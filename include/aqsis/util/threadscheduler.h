@@ -0,0 +1,146 @@
+/* Aqsis - threadscheduler.h
+ *
+ * Copyright (C) 2007 Manuel A. Fernadez Montecelo <mafm@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+/** \file
+ *
+ * \brief File in which the thread scheduler is implemented.
+ *
+ * \author Manuel A. Fernadez Montecelo <mafm@users.sourceforge.net>
+ */
+
+#ifndef THREADSCHEDULER_H_INCLUDED
+#define THREADSCHEDULER_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<deque>
+#include	<vector>
+
+#include	<boost/exception_ptr.hpp>
+#include	<boost/function.hpp>
+#include	<boost/shared_ptr.hpp>
+
+#ifdef	ENABLE_THREADING
+#include	<boost/thread/thread.hpp>
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/condition.hpp>
+#endif
+
+namespace Aqsis { 
+
+
+/**
+ * \brief Persistent pool of worker threads processing work units.
+ *
+ * The worker threads are created once when the scheduler is constructed and
+ * live until it is destroyed, so work units don't pay the cost of thread
+ * creation.  Each worker owns a deque of pending work units: new units are
+ * distributed round-robin over the deques, a worker takes work from the front
+ * of its own deque and, when that runs dry, steals from the back of the
+ * deques belonging to the other workers.  This keeps every worker busy for as
+ * long as there is any work left anywhere in the pool.
+ *
+ * A work unit which throws doesn't stop its worker.  The first exception
+ * thrown is kept, the remaining work is still run, and the exception is
+ * rethrown by the next call to joinAll().
+ *
+ * When threading is disabled at compile time, work units are simply run
+ * synchronously inside addWorkUnit(), and exceptions propagate from there.
+ */
+class AQSIS_UTIL_SHARE CqThreadScheduler
+{
+public:
+	/** \brief Construct the pool and start the worker threads.
+	 *
+	 * \param numThreads - number of worker threads.  A value <= 0 means to
+	 *                     use one thread per hardware thread.
+	 */
+	CqThreadScheduler(TqInt numThreads);
+	/** Destructor: waits for all pending work and stops the workers */
+	~CqThreadScheduler();
+
+	/** Add a work unit to be processed */
+	void addWorkUnit(const boost::function0<void>& unit);
+	/** Wait until all the work units added so far have been processed.
+	 *
+	 * Unlike the old thread-per-unit scheduler, the worker threads keep
+	 * running afterwards and can be given more work.
+	 *
+	 * If any of the units threw, the first exception is rethrown here once
+	 * all the units have finished.
+	 */
+	void joinAll();
+
+	/** Get the number of worker threads in the pool */
+	TqInt numThreads() const;
+	/** Get the number of threads the hardware can run concurrently */
+	static TqInt hardwareThreads();
+
+private:
+	typedef boost::function0<void> TqWorkUnit;
+
+	/// Queue of work units owned by a single worker thread.
+	struct SqWorkQueue
+	{
+		std::deque<TqWorkUnit> units;
+#ifdef	ENABLE_THREADING
+		boost::mutex mutex;
+#endif
+	};
+
+	/** Take a unit from the front of the queue for worker \a index, or steal
+	 * one from the back of another worker's queue.
+	 *
+	 * \return true if a unit was found.
+	 */
+	bool takeWorkUnit(TqInt index, TqWorkUnit& unit);
+	/// Main loop run by each worker thread.
+	void workerLoop(TqInt index);
+
+	/// Number of worker threads
+	TqInt m_numThreads;
+	/// Per-worker queues of pending work
+	std::vector<boost::shared_ptr<SqWorkQueue> > m_queues;
+	/// Queue which will receive the next work unit
+	TqInt m_nextQueue;
+	/// Number of units sitting in the queues which no worker has reserved
+	TqInt m_queuedUnits;
+	/// Number of units which have been added but not yet finished
+	TqInt m_pendingUnits;
+	/// Set when the workers should exit
+	bool m_shutdown;
+	/// First exception thrown by a work unit since the last joinAll()
+	boost::exception_ptr m_error;
+#ifdef	ENABLE_THREADING
+	/// The worker threads
+	boost::thread_group m_threadGroup;
+	/// Mutex protecting the unit counts and m_shutdown
+	boost::mutex m_stateMutex;
+	/// Signalled when new work is available or on shutdown
+	boost::condition m_workAvailable;
+	/// Signalled when m_pendingUnits drops to zero
+	boost::condition m_allDone;
+#endif
+};
+
+
+} // namespace Aqsis
+
+#endif
@@ -65,6 +65,8 @@ class CqTimer
 		void start();
 		/// Stop the timer; accumulate time since start() was called into the total
 		void stop();
+		/// Accumulate time measured elsewhere, over the given number of samples.
+		void add(double time, long numSamples);
 		/// Return total time counted by this timer between start() and stop() calls.
 		double totalTime() const;
 		/// Return average time between start() and stop() calls.
@@ -169,6 +171,12 @@ inline void CqTimer::stop()
 	++m_numSamples;
 }
 
+inline void CqTimer::add(double time, long numSamples)
+{
+	m_totalTime += time;
+	m_numSamples += numSamples;
+}
+
 inline double CqTimer::totalTime() const
 {
 	return m_totalTime;
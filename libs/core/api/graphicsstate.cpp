@@ -236,8 +236,12 @@ CqSolidModeBlock::~CqSolidModeBlock()
 CqObjectModeBlock::CqObjectModeBlock( const boost::shared_ptr<CqModeBlock>& pconParent ) : CqModeBlock( pconParent, Object )
 {
 	// Create new Attributes as they must be pushed/popped by the state change.
-	m_pattrCurrent.reset(new CqAttributes());
+	m_pattrCurrent.reset(new CqAttributes(*pconParent->m_pattrCurrent));
+	// The object is defined in its own coordinate system, which instances
+	// then place with the transformation current at RiObjectInstance().
 	m_ptransCurrent.reset( new CqTransform(*pconParent->m_ptransCurrent.get() ) );
+	m_ptransCurrent->ResetTransform( CqMatrix(),
+			pconParent->m_ptransCurrent->GetHandedness( 0 ) );
 	m_poptCurrent.reset( new CqOptions(*pconParent->m_poptCurrent.get() ) );
 }
 
@@ -309,6 +313,22 @@ void CqMotionModeBlock::EndMotionModeBlock()
 	{
 		QGetRenderContext()->StorePrimitive( m_pDeformingSurface );
 		STATS_INC( GPR_created );
+
+		// Rays are traced against a static scene, so add the keyframe
+		// nearest the shutter open time to the raytracer database, unless
+		// the primitive is part of an object definition.
+		if( QGetRenderContext()->pRaytracer() && !QGetRenderContext()->pObjectDefinition() )
+		{
+			TqFloat shutterOpen = QGetRenderContext()->poptCurrent()->GetFloatOption( "System", "Shutter" ) [ 0 ];
+			TqInt key = 0;
+			for( TqInt i = 1; i < m_pDeformingSurface->cTimes(); ++i )
+			{
+				if( fabs( m_pDeformingSurface->Time( i ) - shutterOpen )
+					< fabs( m_pDeformingSurface->Time( key ) - shutterOpen ) )
+					key = i;
+			}
+			QGetRenderContext()->pRaytracer()->AddPrimitive( m_pDeformingSurface->GetMotionObject( key ) );
+		}
 	}
 }
 
@@ -32,14 +32,13 @@
 #include	<stdio.h>
 #include    <stdlib.h>
 
-#include	<boost/filesystem/fstream.hpp>
-
 #include	"imagebuffer.h"
 #include	"lights.h"
 #include	"renderer.h"
 #include	"patch.h"
 #include	"polygon.h"
 #include	"nurbs.h"
+#include	"objectinstance.h"
 #include	"quadrics.h"
 #include	"teapot.h"
 #include	"bunny.h"
@@ -577,6 +576,19 @@ RtVoid RiCxxCore::WorldBegin()
 	// Start the frame timer (just in case there was no FrameBegin block. If there
 	// was, nothing happens)
 	//QGetRenderContext() ->Stats().StartFrameTimer();
+#ifdef USE_TIMERS
+	// Record the spans of the frame for a trace or the time per shader and
+	// object if requested.
+	{
+		const CqString* traceFile = QGetRenderContext()->poptCurrent()
+			->GetStringOption("statistics", "tracefile");
+		const TqInt* profile = QGetRenderContext()->poptCurrent()
+			->GetIntegerOption("statistics", "profile");
+		bool record = (traceFile && !traceFile[0].empty())
+			|| (profile && profile[0] != 0);
+		CqProfiler::beginFrame(record);
+	}
+#endif
 	AQSIS_TIMER_START(Frame);
 	AQSIS_TIMER_START(Parse);
 
@@ -655,6 +667,15 @@ RtVoid RiCxxCore::WorldBegin()
 	QGetRenderContext()->initialiseCropWindow();
 	QGetRenderContext()->pImage()->SetImage();
 
+	// Start a fresh raytracing database for the primitives of this world.
+	if(QGetRenderContext()->pRaytracer())
+		QGetRenderContext()->pRaytracer()->Initialise();
+
+	// Bound the memory held by texture tiles; the option is in kilobytes.
+	const TqInt* textureMemory = QGetRenderContext()->poptCurrent()->GetIntegerOption("limits", "texturememory");
+	QGetRenderContext()->textureCache().setTileMemoryLimit(textureMemory && textureMemory[0] > 0
+			? static_cast<std::size_t>(textureMemory[0])*1024 : CqTileCache::defaultMaxBytes);
+
 	CqRandom().Reseed('a'+'q'+'s'+'i'+'s');
 }
 
@@ -694,7 +715,12 @@ RtVoid RiCxxCore::WorldEnd()
 		fFailed = true;
 	}
 
-	// Remove all cached textures.
+	// Record the texture tile statistics, then remove all cached textures.
+	SqTileCacheStats tileStats = QGetRenderContext()->textureCache().tileCacheStats();
+	STATS_SETI( TEX_tile_hits, tileStats.hits );
+	STATS_SETI( TEX_tile_misses, tileStats.misses );
+	STATS_SETI( TEX_tile_evictions, tileStats.evictions );
+	STATS_SETI( TEX_tile_memory, tileStats.bytes/1024 );
 	QGetRenderContext()->textureCache().flush();
 
 	// Clear out point cloud caches, etc.
@@ -706,6 +732,21 @@ RtVoid RiCxxCore::WorldEnd()
 	// Stop the frame timer
 	AQSIS_TIMER_STOP(Frame);
 
+#ifdef USE_TIMERS
+	// Write out the spans recorded during the frame.
+	const CqString* traceFile = QGetRenderContext()->poptCurrent()
+		->GetStringOption("statistics", "tracefile");
+	if ( traceFile && !traceFile[0].empty() )
+	{
+		std::ofstream traceStream( traceFile[0].c_str() );
+		if ( traceStream )
+			CqProfiler::writeTrace( traceStream );
+		else
+			Aqsis::log() << error << "Could not open trace file \""
+				<< traceFile[0] << "\"" << std::endl;
+	}
+#endif
+
 	if ( !fFailed )
 	{
 		// Get the verbosity level from the options..
@@ -1032,6 +1073,30 @@ RtVoid RiCxxCore::Hider(RtConstToken name, const ParamList& pList)
 			GetIntegerOptionWrite("Hider", "jitter")[0] =
 				pList[jitterIdx].intData()[0];
 	}
+	int gridOcclusionIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Integer),
+									  "gridocclusion");
+	if(gridOcclusionIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetIntegerOptionWrite("Hider", "gridocclusion")[0] =
+				pList[gridOcclusionIdx].intData()[0];
+	}
+	int gridSamplingIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Integer),
+									 "gridsampling");
+	if(gridSamplingIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetIntegerOptionWrite("Hider", "gridsampling")[0] =
+				pList[gridSamplingIdx].intData()[0];
+	}
+	int separableFilterIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Integer),
+										"separablefilter");
+	if(separableFilterIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetIntegerOptionWrite("Hider", "separablefilter")[0] =
+				pList[separableFilterIdx].intData()[0];
+	}
 }
 
 
@@ -3127,18 +3192,30 @@ RtVoid RiCxxCore::SolidEnd()
 
 //----------------------------------------------------------------------
 // Object retention and instancing.
+//
+// The primitives of an object are kept once as a CqObjectMaster, and each
+// instance refers to them through a CqObjectInstance.
 RtVoid RiCxxCore::ObjectBegin(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug, "ObjectBegin should be handled by a filter");
+	if(QGetRenderContext()->pObjectDefinition())
+	{
+		errorHandler().error(EqE_Nesting, "Object definitions may not be nested");
+		return;
+	}
+	QGetRenderContext()->BeginObjectModeBlock();
+	QGetRenderContext()->BeginObjectDefinition(name);
 }
 RtVoid RiCxxCore::ObjectEnd()
 {
-	errorHandler().error(EqE_Bug, "ObjectEnd should be handled by a filter");
+	QGetRenderContext()->EndObjectDefinition();
+	QGetRenderContext()->EndObjectModeBlock();
 }
 RtVoid RiCxxCore::ObjectInstance(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug,
-						 "ObjectInstance should be handled by a filter");
+	boost::shared_ptr<CqObjectInstance> pInstance(
+			new CqObjectInstance(QGetRenderContext()->findObject(name)));
+	STATS_INC( GEO_ins_created );
+	CreateGPrim(pInstance);
 }
 
 
@@ -3423,13 +3500,18 @@ RtVoid RiCxxCore::SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices
 RtVoid RiCxxCore::ReadArchive(RtConstToken name, RtArchiveCallback callback, const ParamList& pList)
 {
 	// Open the archive file
-	boost::filesystem::ifstream archiveFile(
-			QGetRenderContext()->poptCurrent()->findRiFile(name, "archive"),
-			std::ios::binary);
+	std::string fileName = native(
+			QGetRenderContext()->poptCurrent()->findRiFile(name, "archive"));
+	boost::shared_ptr<std::istream> archiveFile = openRibFile(fileName);
+	if(!archiveFile)
+	{
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_NoFile,
+				"Could not open archive file \"" << fileName << "\"");
+	}
 	// Parse the archive
 	RtArchiveCallback savedCallback = m_archiveCallback;
 	m_archiveCallback = callback;
-	m_apiServices.parseRib(archiveFile, name);
+	m_apiServices.parseRib(*archiveFile, name);
 	m_archiveCallback = savedCallback;
 }
 
@@ -3827,8 +3909,9 @@ RtVoid	CreateGPrim( const boost::shared_ptr<CqSurface>& pSurface )
 		QGetRenderContext()->StorePrimitive( pSurface );
 		STATS_INC( GPR_created );
 
-		// Add to the raytracer database also
-		if(QGetRenderContext()->pRaytracer())
+		// Add to the raytracer database also, unless the primitive is part
+		// of an object definition.
+		if(QGetRenderContext()->pRaytracer() && !QGetRenderContext()->pObjectDefinition())
 			QGetRenderContext()->pRaytracer()->AddPrimitive(pSurface);
 	}
 }
@@ -3850,7 +3933,9 @@ class CoreRendererServices : public Ri::RendererServices
 			// Add renderer utility filter.  We do this here rather than in
 			// addFilter() because this is a special filter which should only
 			// be added once.
-			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition);
+			// Objects are retained by the core rather than being expanded
+			// by the filter.
+			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition, false);
 			utilFilter->setNextFilter(*m_api);
 			utilFilter->setRendererServices(*this);
 			m_filterChain.push_back(boost::shared_ptr<Ri::Renderer>(utilFilter));
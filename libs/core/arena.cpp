@@ -0,0 +1,246 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Implements the page arena which micropolygons and grids live in.
+ */
+
+#include "arena.h"
+#include "atomic.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef AQSIS_SYSTEM_WIN32
+#	include <malloc.h>
+#endif
+
+#ifdef ENABLE_THREADING
+#	include <boost/thread/mutex.hpp>
+#	include <boost/thread/tss.hpp>
+#endif
+
+namespace Aqsis {
+
+namespace {
+
+/// Round size up to the alignment of arena blocks.
+inline std::size_t alignedSize(std::size_t size)
+{
+	return (size + 15) & ~std::size_t(15);
+}
+
+/** \brief Header at the start of each page.
+ *
+ * The thread which owns a page counts its allocations privately in
+ * numAllocs, while freed counts the frees from any thread.  When the owner
+ * moves on to another page it subtracts numAllocs from freed, so that freed
+ * then reaches zero exactly when the last object in the page is freed.
+ * Before that it can't be zero, since it only counts up.
+ */
+struct SqPage
+{
+	TqInt freed;
+	TqInt numAllocs;
+	char* top;
+	char* end;
+};
+
+/// Offset of the first block in a page, leaving the header its own cache line.
+const std::size_t pageHeaderSize = 64;
+
+/// Pages shared between threads.
+class CqPageStore
+{
+	public:
+		CqPageStore() : m_spare(), m_pagesInUse(0) {}
+		~CqPageStore()
+		{
+			for(std::vector<SqPage*>::iterator i = m_spare.begin();
+					i != m_spare.end(); ++i)
+				freePage(*i);
+		}
+
+		/// Get an empty page.
+		SqPage* newPage()
+		{
+			SqPage* page = 0;
+			{
+#				ifdef ENABLE_THREADING
+				boost::mutex::scoped_lock lock(m_mutex);
+#				endif
+				if(!m_spare.empty())
+				{
+					page = m_spare.back();
+					m_spare.pop_back();
+				}
+				else
+					++m_pagesInUse;
+			}
+			if(!page)
+				page = allocPage();
+			page->freed = 0;
+			page->numAllocs = 0;
+			page->top = reinterpret_cast<char*>(page) + pageHeaderSize;
+			page->end = reinterpret_cast<char*>(page) + CqArena::pageSize;
+			return page;
+		}
+
+		/// Return a page once all the objects in it are freed.
+		void releasePage(SqPage* page)
+		{
+			{
+#				ifdef ENABLE_THREADING
+				boost::mutex::scoped_lock lock(m_mutex);
+#				endif
+				if(static_cast<TqInt>(m_spare.size()) < CqArena::maxSparePages)
+				{
+					m_spare.push_back(page);
+					return;
+				}
+				--m_pagesInUse;
+			}
+			freePage(page);
+		}
+
+		TqInt pagesInUse() const
+		{
+			return m_pagesInUse;
+		}
+
+	private:
+		static SqPage* allocPage()
+		{
+			void* mem = 0;
+#			ifdef AQSIS_SYSTEM_WIN32
+			mem = _aligned_malloc(CqArena::pageSize, CqArena::pageSize);
+#			else
+			if(posix_memalign(&mem, CqArena::pageSize, CqArena::pageSize) != 0)
+				mem = 0;
+#			endif
+			if(!mem)
+				throw std::bad_alloc();
+			return static_cast<SqPage*>(mem);
+		}
+		static void freePage(SqPage* page)
+		{
+#			ifdef AQSIS_SYSTEM_WIN32
+			_aligned_free(page);
+#			else
+			std::free(page);
+#			endif
+		}
+
+		std::vector<SqPage*> m_spare;
+		TqInt m_pagesInUse;
+#		ifdef ENABLE_THREADING
+		boost::mutex m_mutex;
+#		endif
+};
+
+// The store must outlive the thread pages below, which release into it.
+CqPageStore g_pageStore;
+
+/// Give up ownership of a page, releasing it if all its objects are gone.
+void retirePage(SqPage* page)
+{
+	if(atomicAddAndFetch(page->freed, -page->numAllocs) == 0)
+		g_pageStore.releasePage(page);
+}
+
+/// The page each thread is currently allocating from.
+struct SqThreadPage
+{
+	SqPage* page;
+
+	SqThreadPage() : page(0) {}
+	~SqThreadPage()
+	{
+		if(page)
+			retirePage(page);
+	}
+};
+
+#ifdef ENABLE_THREADING
+boost::thread_specific_ptr<SqThreadPage> g_threadPage;
+
+inline SqThreadPage& threadPage()
+{
+	SqThreadPage* threadPage = g_threadPage.get();
+	if(!threadPage)
+	{
+		threadPage = new SqThreadPage();
+		g_threadPage.reset(threadPage);
+	}
+	return *threadPage;
+}
+#else
+SqThreadPage g_threadPage;
+
+inline SqThreadPage& threadPage()
+{
+	return g_threadPage;
+}
+#endif
+
+} // unnamed namespace
+
+
+void* CqArena::alloc(std::size_t size)
+{
+	if(size > maxBlockSize)
+		return ::operator new(size);
+	size = alignedSize(size);
+	SqThreadPage& current = threadPage();
+	SqPage* page = current.page;
+	if(!page || static_cast<std::size_t>(page->end - page->top) < size)
+	{
+		if(page)
+			retirePage(page);
+		page = current.page = g_pageStore.newPage();
+	}
+	void* p = page->top;
+	page->top += size;
+	++page->numAllocs;
+	return p;
+}
+
+void CqArena::free(void* p, std::size_t size)
+{
+	if(!p)
+		return;
+	if(size > maxBlockSize)
+	{
+		::operator delete(p);
+		return;
+	}
+	SqPage* page = reinterpret_cast<SqPage*>(
+			reinterpret_cast<std::size_t>(p) & ~(pageSize - 1));
+	if(atomicAddAndFetch(page->freed, 1) == 0)
+		g_pageStore.releasePage(page);
+}
+
+TqInt CqArena::pagesInUse()
+{
+	return g_pageStore.pagesInUse();
+}
+
+} // namespace Aqsis
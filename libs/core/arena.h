@@ -0,0 +1,72 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Declares the page arena which micropolygons and grids live in.
+ */
+
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+
+namespace Aqsis {
+
+/** \brief Page based allocation for short lived render objects.
+ *
+ * Micropolygons and grids are created in large numbers while a bucket is
+ * diced, and die together once the buckets they touch have been sampled.  The
+ * arena hands them out by bumping a pointer through a page owned by the
+ * calling thread, so allocation takes no lock and touches no shared data.
+ *
+ * Pages are aligned to their size, so freeing an object finds its page with a
+ * mask.  Each page counts the objects still alive in it and goes back to a
+ * shared list of spare pages as soon as the last one is freed, which happens
+ * when the buckets using them finish.  Objects may be freed by any thread.
+ * Spare pages beyond maxSparePages are returned to the system.
+ *
+ * Objects larger than maxBlockSize come from the global heap instead.  The
+ * size passed to free() must be the size passed to alloc(), as it is for a
+ * class specific operator delete taking a size.
+ */
+class CqArena
+{
+	public:
+		/// Size and alignment of a page.
+		static const std::size_t pageSize = 64*1024;
+		/// Largest object allocated from a page.
+		static const std::size_t maxBlockSize = 4096;
+		/// Number of empty pages kept for reuse.
+		static const TqInt maxSparePages = 256;
+
+		/// Allocate size bytes, aligned to 16 bytes.
+		static void* alloc(std::size_t size);
+		/// Free memory from alloc() with the same size.
+		static void free(void* p, std::size_t size);
+
+		/// Number of pages currently allocated from the system.
+		static TqInt pagesInUse();
+};
+
+} // namespace Aqsis
+
+#endif // ARENA_H_INCLUDED
@@ -0,0 +1,80 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the micropolygon arena
+ */
+
+#include "arena.h"
+
+#include <cstring>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_CASE(CqArena_alloc_test)
+{
+	std::vector<char*> blocks;
+	for(int i = 0; i < 1000; ++i)
+	{
+		std::size_t size = 1 + i % 200;
+		char* p = static_cast<char*>(CqArena::alloc(size));
+		BOOST_CHECK_EQUAL(reinterpret_cast<std::size_t>(p) % 16, 0U);
+		std::memset(p, i & 0xFF, size);
+		blocks.push_back(p);
+	}
+	// Blocks don't overlap.
+	for(int i = 0; i < 1000; ++i)
+	{
+		std::size_t size = 1 + i % 200;
+		BOOST_CHECK_EQUAL(blocks[i][0], char(i & 0xFF));
+		BOOST_CHECK_EQUAL(blocks[i][size-1], char(i & 0xFF));
+	}
+	for(int i = 0; i < 1000; ++i)
+		CqArena::free(blocks[i], 1 + i % 200);
+
+	// Large blocks come from the heap.
+	void* large = CqArena::alloc(CqArena::maxBlockSize + 1);
+	std::memset(large, 0, CqArena::maxBlockSize + 1);
+	CqArena::free(large, CqArena::maxBlockSize + 1);
+}
+
+BOOST_AUTO_TEST_CASE(CqArena_recycle_test)
+{
+	// Allocate and free several pages worth of blocks repeatedly; once the
+	// first round has run, the freed pages should be reused.
+	const int numBlocks = 10*CqArena::pageSize/128;
+	std::vector<void*> blocks(numBlocks);
+	TqInt pagesAfterFirst = 0;
+	for(int round = 0; round < 5; ++round)
+	{
+		for(int i = 0; i < numBlocks; ++i)
+			blocks[i] = CqArena::alloc(128);
+		for(int i = 0; i < numBlocks; ++i)
+			CqArena::free(blocks[i], 128);
+		if(round == 0)
+			pagesAfterFirst = CqArena::pagesInUse();
+	}
+	BOOST_CHECK_EQUAL(CqArena::pagesInUse(), pagesAfterFirst);
+	BOOST_CHECK(pagesAfterFirst <= 12);
+}
@@ -0,0 +1,56 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Atomic counter updates for objects shared between render threads.
+ */
+
+#ifndef ATOMIC_H_INCLUDED
+#define ATOMIC_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#if defined(ENABLE_THREADING) && !defined(AQSIS_COMPILER_GCC)
+#	include <intrin.h>
+#endif
+
+namespace Aqsis {
+
+/** \brief Add delta to value, atomically when threading is enabled.
+ *
+ * \return The new value.
+ */
+inline TqInt atomicAddAndFetch(TqInt& value, TqInt delta)
+{
+#ifdef ENABLE_THREADING
+#	ifdef AQSIS_COMPILER_GCC
+	return __sync_add_and_fetch(&value, delta);
+#	else
+	return _InterlockedExchangeAdd(reinterpret_cast<volatile long*>(&value),
+			delta) + delta;
+#	endif
+#else
+	return value += delta;
+#endif
+}
+
+} // namespace Aqsis
+
+#endif // ATOMIC_H_INCLUDED
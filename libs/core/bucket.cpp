@@ -51,10 +51,18 @@
 
 namespace Aqsis {
 
+#ifdef ENABLE_THREADING
+#	define AQSIS_LOCK_BUCKET boost::mutex::scoped_lock lock(m_mutex.mutex)
+#else
+#	define AQSIS_LOCK_BUCKET
+#endif
+
 
 //----------------------------------------------------------------------
 CqBucket::CqBucket()
 	: m_bProcessed(false),
+	m_bInProgress(false),
+	m_renderIndex(0),
 	m_col(0),
 	m_row(0),
 	m_xPosition(0),
@@ -62,7 +70,13 @@ CqBucket::CqBucket()
 	m_xSize(0),
 	m_ySize(0),
 	m_micropolygons(),
-	m_gPrims()
+	m_rasterGrids(),
+	m_numGridQuads(0),
+	m_gPrims(),
+	m_activeSurface(),
+	m_splitGPrims(0),
+	m_surfaceReach(),
+	m_loadChanged(false)
 { }
 
 //----------------------------------------------------------------------
@@ -95,6 +109,7 @@ void CqBucket::setRow(TqInt value)
 void CqBucket::SetProcessed( bool bProc )
 {
 	assert( !bProc || (bProc && !hasPendingSurfaces()) );
+	AQSIS_LOCK_BUCKET;
 	m_bProcessed = bProc;
 	if(bProc)
 	{
@@ -102,8 +117,53 @@ void CqBucket::SetProcessed( bool bProc )
 		// anything else, this seems to help avoid persistent small pieces of
 		// memory which fragment the heap.
 		TqPolyStorage().swap(m_micropolygons);
+		TqGridStorage().swap(m_rasterGrids);
+		m_numGridQuads = 0;
 		TqSurfaceQueue().swap(m_gPrims);
+		m_activeSurface.reset();
+		m_splitGPrims = 0;
 	}
+	m_surfaceReach = CqRegion();
+	m_loadChanged = false;
+}
+
+//----------------------------------------------------------------------
+/** Mark this bucket as being rendered (or not) by a bucket processor.
+ */
+void CqBucket::SetInProgress( bool bInProgress, TqInt renderIndex )
+{
+	AQSIS_LOCK_BUCKET;
+	m_bInProgress = bInProgress;
+	if(bInProgress)
+		m_renderIndex = renderIndex;
+}
+
+//----------------------------------------------------------------------
+bool CqBucket::IsInProgress() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_bInProgress;
+}
+
+//----------------------------------------------------------------------
+TqInt CqBucket::renderIndex() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_renderIndex;
+}
+
+//----------------------------------------------------------------------
+void CqBucket::setRenderIndex( TqInt renderIndex )
+{
+	AQSIS_LOCK_BUCKET;
+	m_renderIndex = renderIndex;
+}
+
+//----------------------------------------------------------------------
+bool CqBucket::IsProcessed() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_bProcessed;
 }
 
 //----------------------------------------------------------------------
@@ -111,18 +171,134 @@ void CqBucket::SetProcessed( bool bProc )
  */
 bool CqBucket::hasPendingSurfaces() const
 {
+	AQSIS_LOCK_BUCKET;
 	return ! m_gPrims.empty();
 }
 
+//----------------------------------------------------------------------
+/** Get a count of deferred GPrims.
+ */
+TqInt CqBucket::cGPrims() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_gPrims.size();
+}
+
+//----------------------------------------------------------------------
+/** Add a GPRim to the stack of deferred GPrims.
+ */
+void CqBucket::AddGPrim( const boost::shared_ptr<CqSurface>& pGPrim,
+		const CqRegion& touched )
+{
+	AQSIS_LOCK_BUCKET;
+	m_gPrims.push_back(pGPrim);
+	std::push_heap(m_gPrims.begin(), m_gPrims.end(), closest_surface());
+	if ( pGPrim->SplitCount() > 0 )
+		++m_splitGPrims;
+	if ( m_surfaceReach.area() == 0 )
+		m_surfaceReach = touched;
+	else
+		m_surfaceReach = CqRegion(
+				std::min(m_surfaceReach.xMin(), touched.xMin()),
+				std::min(m_surfaceReach.yMin(), touched.yMin()),
+				std::max(m_surfaceReach.xMax(), touched.xMax()),
+				std::max(m_surfaceReach.yMax(), touched.yMax()) );
+}
+
+//----------------------------------------------------------------------
+CqRegion CqBucket::surfaceReach() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_surfaceReach;
+}
+
+//----------------------------------------------------------------------
+bool CqBucket::setLoadChanged()
+{
+	AQSIS_LOCK_BUCKET;
+	const bool wasChanged = m_loadChanged;
+	m_loadChanged = true;
+	return !wasChanged;
+}
+
+//----------------------------------------------------------------------
+SqBucketLoad CqBucket::takeLoad()
+{
+	AQSIS_LOCK_BUCKET;
+	m_loadChanged = false;
+	return SqBucketLoad( m_micropolygons.size() + m_numGridQuads, m_splitGPrims );
+}
+
+//----------------------------------------------------------------------
+/** Remove and return the top GPrim in the stack of deferred GPrims.
+ */
+boost::shared_ptr<CqSurface> CqBucket::popTopSurface()
+{
+	AQSIS_LOCK_BUCKET;
+	boost::shared_ptr<CqSurface> surface;
+	if (!m_gPrims.empty())
+	{
+		surface = m_gPrims.front();
+		std::pop_heap(m_gPrims.begin(), m_gPrims.end(), closest_surface());
+		m_gPrims.pop_back();
+		if ( surface->SplitCount() > 0 )
+			--m_splitGPrims;
+	}
+	m_activeSurface = surface;
+	return surface;
+}
+
 
 //----------------------------------------------------------------------
 /** Add an MP to the list of deferred MPs.
  */
-void CqBucket::AddMP( boost::shared_ptr<CqMicroPolygon>& pMP )
+void CqBucket::AddMP( CqMicroPolygonPtr& pMP )
 {
+	AQSIS_LOCK_BUCKET;
 	m_micropolygons.push_back( pMP );
 }
 
+//----------------------------------------------------------------------
+/** Add a grid to the list of deferred grids which are sampled intact.
+ */
+void CqBucket::AddRasterGrid( CqRasterGridPtr& grid )
+{
+	AQSIS_LOCK_BUCKET;
+	m_rasterGrids.push_back( grid );
+	m_numGridQuads += grid->numQuads();
+}
+
+//----------------------------------------------------------------------
+bool CqBucket::hasPendingMPs() const
+{
+	AQSIS_LOCK_BUCKET;
+	return ! m_micropolygons.empty() || ! m_rasterGrids.empty();
+}
+
+//----------------------------------------------------------------------
+TqInt CqBucket::cMPs() const
+{
+	AQSIS_LOCK_BUCKET;
+	return m_micropolygons.size() + m_numGridQuads;
+}
+
+//----------------------------------------------------------------------
+void CqBucket::takeMPs( std::vector<CqMicroPolygonPtr>& mps )
+{
+	assert(mps.empty());
+	AQSIS_LOCK_BUCKET;
+	m_micropolygons.swap(mps);
+}
+
+//----------------------------------------------------------------------
+void CqBucket::takeRasterGrids( std::vector<CqRasterGridPtr>& grids )
+{
+	assert(grids.empty());
+	AQSIS_LOCK_BUCKET;
+	m_rasterGrids.swap(grids);
+	m_numGridQuads = 0;
+}
+
 
 } // namespace Aqsis
 
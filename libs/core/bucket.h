@@ -35,12 +35,16 @@
 #include	<deque>
 #include	<boost/shared_ptr.hpp>
 #include	<boost/array.hpp>
+#ifdef ENABLE_THREADING
+#include	<boost/thread/mutex.hpp>
+#endif
 
 #include	"surface.h"
 #include	<aqsis/math/color.h>
 #include	"imagepixel.h"
 #include	"iddmanager.h"
 #include	<aqsis/math/region.h>
+#include	"bucketorder.h"
 
 namespace Aqsis {
 
@@ -68,6 +72,10 @@ struct SqBucketCacheSegment
 
 //-----------------------------------------------------------------------
 /** Class holding data about a particular bucket.
+ *
+ * When threading is enabled, surfaces and micropolygons may be added to a
+ * bucket by any rendering thread, so the deferred surface and micropolygon
+ * storage along with the processing state flags are protected by a mutex.
  */
 
 class CqBucket
@@ -78,55 +86,82 @@ class CqBucket
 		CqBucket();
 
 		/** Add a GPRim to the stack of deferred GPrims.
-		* \param The Gprim to be added.
+		 * \param pGPrim - the Gprim to be added.
+		 * \param touched - the region of buckets touched by the GPrim, which
+		 *                  is added to surfaceReach().
 		 */
-		void	AddGPrim( const boost::shared_ptr<CqSurface>& pGPrim )
-		{
-			m_gPrims.push_back(pGPrim);
-			std::push_heap(m_gPrims.begin(), m_gPrims.end(),
-						   closest_surface());
-		}
-
-		/** Get a pointer to the top GPrim in the stack of deferred GPrims.
+		void	AddGPrim( const boost::shared_ptr<CqSurface>& pGPrim,
+				const CqRegion& touched );
+
+		/** Remove and return the top GPrim in the stack of deferred GPrims.
+		 *
+		 * The returned surface is counted by anySurface() until the next
+		 * call, since the caller is expected to render it in the meantime.
+		 *
+		 * \return The closest deferred GPrim, or a null pointer if there are
+		 * none left.
 		 */
-		boost::shared_ptr<CqSurface> pTopSurface()
-		{
-			if (!m_gPrims.empty())
-			{
-				return m_gPrims.front();
-			}
-			else
-			{
-				return boost::shared_ptr<CqSurface>();
-			}
-		}
-		/** Pop the top GPrim in the stack of deferred GPrims.
-		 */
-		void popSurface()
-		{
-			if (!m_gPrims.empty())
-			{
-				std::pop_heap(m_gPrims.begin(), m_gPrims.end(),
-							  closest_surface());
-				m_gPrims.pop_back();
-			}
-		}
+		boost::shared_ptr<CqSurface> popTopSurface();
 		/** Get a count of deferred GPrims.
 		 */
-		TqInt cGPrims() const
-		{
-			return ( m_gPrims.size() );
-		}
+		TqInt cGPrims() const;
 		bool hasPendingSurfaces() const;
+		/** Remove the deferred GPrims for which the given predicate holds.
+		 *
+		 * \param pred - predicate taking a surface.
+		 * \param surfaces - container to append the removed GPrims to.
+		 */
+		template<typename PredT>
+		void takeSurfacesIf( PredT pred,
+				std::vector<boost::shared_ptr<CqSurface> >& surfaces );
+		/** Check whether the predicate holds for any of the deferred GPrims,
+		 * or for the GPrim most recently returned by popTopSurface().
+		 */
+		template<typename PredT>
+		bool anySurface( PredT pred ) const;
+		/** Get the region of buckets touched by the GPrims added to this
+		 * bucket.
+		 *
+		 * The region only grows while the bucket is waiting, so it may
+		 * include buckets which none of the remaining GPrims touch.  It's
+		 * empty if no GPrims have been added.
+		 */
+		CqRegion surfaceReach() const;
+		/** Flag that the work waiting in the bucket has changed.
+		 *
+		 * \return True if the flag wasn't already set since the last call
+		 * to takeLoad().
+		 */
+		bool setLoadChanged();
+		/** Get the work waiting in the bucket, and clear the flag set by
+		 * setLoadChanged().
+		 */
+		SqBucketLoad takeLoad();
 		/** Get the flag that indicates if the bucket has been processed yet.
 		 */
-		bool IsProcessed() const
-		{
-			return( m_bProcessed );
-		}
+		bool IsProcessed() const;
 		/** Mark this bucket as processed
 		 */
 		void SetProcessed( bool bProc =  true);
+		/** Get the flag that indicates if the bucket is currently being
+		 * rendered by a bucket processor.
+		 */
+		bool IsInProgress() const;
+		/** Mark this bucket as being rendered (or not) by a bucket processor.
+		 *
+		 * \param renderIndex - position of the bucket in the order in which
+		 * buckets are handed out for rendering.  Only used when marking the
+		 * bucket as in progress.
+		 */
+		void SetInProgress( bool bInProgress = true, TqInt renderIndex = 0 );
+		/** Get the position of the bucket in the rendering order, as passed
+		 * to SetInProgress(), or as planned by setRenderIndex() for a bucket
+		 * which hasn't been started yet.
+		 */
+		TqInt renderIndex() const;
+		/** Set the planned position of the bucket in the rendering order.
+		 */
+		void setRenderIndex( TqInt renderIndex );
 
 		/** Get the column of the bucket in the image */
 		TqInt getCol() const;
@@ -151,9 +186,24 @@ class CqBucket
 
 		/** Add an MP to the list of deferred MPs.
 		 */
-		void	AddMP( boost::shared_ptr<CqMicroPolygon>& pMP );
-
-		std::vector<boost::shared_ptr<CqMicroPolygon> >& micropolygons();
+		void	AddMP( CqMicroPolygonPtr& pMP );
+		/** Add a grid which is sampled intact to the list of deferred grids.
+		 */
+		void	AddRasterGrid( CqRasterGridPtr& grid );
+		/** Check if there are any deferred MPs or grids waiting to be rendered. */
+		bool hasPendingMPs() const;
+		/** Get a count of deferred MPs, including the quads of deferred grids. */
+		TqInt cMPs() const;
+		/** Take the deferred MPs from the bucket.
+		 *
+		 * The waiting MPs are swapped into the given (empty) container,
+		 * leaving the bucket ready to collect more.
+		 */
+		void takeMPs( std::vector<CqMicroPolygonPtr>& mps );
+		/** Take the deferred grids from the bucket, in the same way as
+		 * takeMPs().
+		 */
+		void takeRasterGrids( std::vector<CqRasterGridPtr>& grids );
 
 		const TqCache& cacheSegments() const;
 		void setCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg);
@@ -177,6 +227,10 @@ class CqBucket
 
 		/// Flag indicating if this bucket has been processed yet.
 		bool	m_bProcessed;
+		/// Flag indicating if this bucket is currently being rendered.
+		bool	m_bInProgress;
+		/// Position of this bucket in the rendering order.
+		TqInt	m_renderIndex;
 
 		/// Bucket column in the image
 		TqInt m_col;
@@ -192,8 +246,13 @@ class CqBucket
 		TqInt m_ySize;
 
 		/// Vector of vectors of waiting micropolygons in this bucket
-		typedef std::vector<boost::shared_ptr<CqMicroPolygon> > TqPolyStorage;
+		typedef std::vector<CqMicroPolygonPtr> TqPolyStorage;
 		TqPolyStorage m_micropolygons;
+		/// Waiting grids which are sampled without being busted.
+		typedef std::vector<CqRasterGridPtr> TqGridStorage;
+		TqGridStorage m_rasterGrids;
+		/// Number of quads to be sampled in m_rasterGrids.
+		TqInt m_numGridQuads;
 
 		/// A sorted list of primitives for this bucket
 		///
@@ -203,8 +262,29 @@ class CqBucket
 		/// completely deallocated when the bucket is done.
 		typedef std::vector<boost::shared_ptr<CqSurface> > TqSurfaceQueue;
 		TqSurfaceQueue m_gPrims;
+		/// The GPrim last taken by popTopSurface(), which is being rendered.
+		boost::shared_ptr<CqSurface> m_activeSurface;
+		/// Number of GPrims in m_gPrims which were split from larger ones.
+		TqInt m_splitGPrims;
+		/// Region of buckets touched by the GPrims added to the bucket.
+		CqRegion m_surfaceReach;
+		/// Flag set when the waiting work changes, see setLoadChanged().
+		bool m_loadChanged;
 
 		TqCache m_cacheSegments;
+
+#ifdef ENABLE_THREADING
+		/// Mutex which doesn't prevent the bucket being copied.
+		struct SqBucketMutex
+		{
+			boost::mutex mutex;
+			SqBucketMutex() {}
+			SqBucketMutex(const SqBucketMutex&) {}
+			SqBucketMutex& operator=(const SqBucketMutex&) { return *this; }
+		};
+		/// Mutex protecting the deferred GPrims, MPs and processing state.
+		mutable SqBucketMutex m_mutex;
+#endif
 };
 
 
@@ -212,11 +292,6 @@ class CqBucket
 // Implementation details
 //------------------------------------------------------------
 
-inline std::vector<boost::shared_ptr<CqMicroPolygon> >& CqBucket::micropolygons()
-{
-	return m_micropolygons;
-}
-
 inline void CqBucket::setCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg)
 {
 	// Check there isn't already a cache segment for the position.
@@ -261,6 +336,48 @@ inline void CqBucket::setSize(TqInt xsize, TqInt ysize)
 	m_ySize = ysize;
 }
 
+template<typename PredT>
+void CqBucket::takeSurfacesIf( PredT pred,
+		std::vector<boost::shared_ptr<CqSurface> >& surfaces )
+{
+#ifdef ENABLE_THREADING
+	boost::mutex::scoped_lock lock(m_mutex.mutex);
+#endif
+	TqSurfaceQueue::iterator kept = m_gPrims.begin();
+	for(TqSurfaceQueue::iterator i = m_gPrims.begin(); i != m_gPrims.end(); ++i)
+	{
+		if(pred(*i))
+		{
+			surfaces.push_back(*i);
+			if((*i)->SplitCount() > 0)
+				--m_splitGPrims;
+		}
+		else
+			*kept++ = *i;
+	}
+	if(kept != m_gPrims.end())
+	{
+		m_gPrims.erase(kept, m_gPrims.end());
+		std::make_heap(m_gPrims.begin(), m_gPrims.end(), closest_surface());
+	}
+}
+
+template<typename PredT>
+bool CqBucket::anySurface( PredT pred ) const
+{
+#ifdef ENABLE_THREADING
+	boost::mutex::scoped_lock lock(m_mutex.mutex);
+#endif
+	if(m_activeSurface && pred(m_activeSurface))
+		return true;
+	for(TqSurfaceQueue::const_iterator i = m_gPrims.begin(); i != m_gPrims.end(); ++i)
+	{
+		if(pred(*i))
+			return true;
+	}
+	return false;
+}
+
 inline void CqBucket::clearCache()
 {
 
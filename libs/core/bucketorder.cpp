@@ -0,0 +1,243 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Implements the orders in which buckets may be rendered.
+ */
+
+#include "bucketorder.h"
+
+#include <algorithm>
+
+#include <aqsis/math/random.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Left to right along each row, from the top row down.
+class CqHorizontalOrder : public CqBucketOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			for(TqInt row = region.yMin(); row < region.yMax(); ++row)
+				for(TqInt col = region.xMin(); col < region.xMax(); ++col)
+					plan.push_back(SqBucketPos(col, row));
+		}
+};
+
+/// Top to bottom down each column, from the left column across.
+class CqVerticalOrder : public CqBucketOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			for(TqInt col = region.xMin(); col < region.xMax(); ++col)
+				for(TqInt row = region.yMin(); row < region.yMax(); ++row)
+					plan.push_back(SqBucketPos(col, row));
+		}
+};
+
+/// Rows from the top down, alternately left to right and right to left.
+class CqZigZagOrder : public CqBucketOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			for(TqInt row = region.yMin(); row < region.yMax(); ++row)
+			{
+				if((row - region.yMin()) % 2 == 0)
+				{
+					for(TqInt col = region.xMin(); col < region.xMax(); ++col)
+						plan.push_back(SqBucketPos(col, row));
+				}
+				else
+				{
+					for(TqInt col = region.xMax() - 1; col >= region.xMin(); --col)
+						plan.push_back(SqBucketPos(col, row));
+				}
+			}
+		}
+};
+
+/** Outward from the centre of the region in a square spiral.
+ *
+ * The spiral is walked over the square enclosing the region, and the steps
+ * which fall outside the region are skipped.
+ */
+class CqSpiralOrder : public CqBucketOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			const TqInt total = region.area();
+			if(total <= 0)
+				return;
+			// Directions right, down, left and up.
+			const TqInt dx[] = {1, 0, -1, 0};
+			const TqInt dy[] = {0, 1, 0, -1};
+			TqInt col = region.xMin() + (region.width() - 1)/2;
+			TqInt row = region.yMin() + (region.height() - 1)/2;
+			plan.push_back(SqBucketPos(col, row));
+			TqInt found = 1;
+			// Each leg of the spiral is walked twice before its length grows
+			// by one.
+			for(TqInt leg = 0; found < total; ++leg)
+			{
+				const TqInt dir = leg % 4;
+				const TqInt length = leg/2 + 1;
+				for(TqInt i = 0; i < length; ++i)
+				{
+					col += dx[dir];
+					row += dy[dir];
+					if(col >= region.xMin() && col < region.xMax()
+						&& row >= region.yMin() && row < region.yMax())
+					{
+						plan.push_back(SqBucketPos(col, row));
+						++found;
+					}
+				}
+			}
+		}
+};
+
+/** Along a Hilbert curve.
+ *
+ * The curve keeps consecutive buckets close together in both directions,
+ * so the surfaces and micropolygons shared between neighbouring buckets
+ * are waiting for a shorter time than in a raster order.  The curve covers
+ * the smallest power of two square enclosing the region, and the parts of it
+ * outside the region are skipped.
+ */
+class CqHilbertOrder : public CqBucketOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			TqInt size = 1;
+			while(size < region.width() || size < region.height())
+				size *= 2;
+			for(TqInt d = 0, end = size*size; d < end; ++d)
+			{
+				TqInt x = 0;
+				TqInt y = 0;
+				hilbertPosition(size, d, x, y);
+				if(x < region.width() && y < region.height())
+					plan.push_back(SqBucketPos(region.xMin() + x, region.yMin() + y));
+			}
+		}
+
+	private:
+		/** Find the position of distance d along the Hilbert curve filling
+		 * a square of side size, which must be a power of two.
+		 */
+		static void hilbertPosition(TqInt size, TqInt d, TqInt& x, TqInt& y)
+		{
+			x = y = 0;
+			for(TqInt s = 1; s < size; s *= 2)
+			{
+				const TqInt rx = 1 & (d/2);
+				const TqInt ry = 1 & (d ^ rx);
+				// Rotate the quadrant.
+				if(ry == 0)
+				{
+					if(rx == 1)
+					{
+						x = s-1 - x;
+						y = s-1 - y;
+					}
+					std::swap(x, y);
+				}
+				x += s*rx;
+				y += s*ry;
+				d /= 4;
+			}
+		}
+};
+
+/** A shuffled order.
+ *
+ * The shuffle uses a fixed seed so that rendering the same scene twice
+ * visits the buckets the same way.
+ */
+class CqRandomOrder : public CqHorizontalOrder
+{
+	public:
+		virtual void plan(const CqRegion& region, std::vector<SqBucketPos>& plan) const
+		{
+			const TqInt start = plan.size();
+			CqHorizontalOrder::plan(region, plan);
+			CqRandom random(42);
+			for(TqInt i = plan.size() - 1; i > start; --i)
+				std::swap(plan[i], plan[start + random.RandomInt(i - start + 1)]);
+		}
+};
+
+/** An order which keeps the deferred work small.
+ *
+ * The next bucket is the one holding the most micropolygons, since their
+ * surfaces have already been split and diced on behalf of a neighbouring
+ * bucket and they will otherwise be held in memory until the bucket is
+ * rendered.  Buckets holding the most surfaces which have already been split
+ * come next for the same reason, while surfaces straight from the scene
+ * description cost nothing extra to leave waiting.  When there's nothing to
+ * choose between buckets they are taken along a Hilbert curve, which keeps
+ * new work close to what has already been rendered.
+ */
+class CqMemoryOrder : public CqHilbertOrder
+{
+	public:
+		virtual bool isDynamic() const
+		{
+			return true;
+		}
+		virtual bool before(const SqBucketLoad& a, const SqBucketLoad& b) const
+		{
+			if(a.micropolygons != b.micropolygons)
+				return a.micropolygons > b.micropolygons;
+			return a.splitSurfaces > b.splitSurfaces;
+		}
+};
+
+} // unnamed namespace
+
+
+boost::shared_ptr<CqBucketOrder> CqBucketOrder::create(const std::string& name)
+{
+	boost::shared_ptr<CqBucketOrder> order;
+	if(name == "horizontal")
+		order.reset(new CqHorizontalOrder());
+	else if(name == "vertical")
+		order.reset(new CqVerticalOrder());
+	else if(name == "zigzag")
+		order.reset(new CqZigZagOrder());
+	else if(name == "spiral" || name == "circle")
+		order.reset(new CqSpiralOrder());
+	else if(name == "hilbert")
+		order.reset(new CqHilbertOrder());
+	else if(name == "random")
+		order.reset(new CqRandomOrder());
+	else if(name == "memory")
+		order.reset(new CqMemoryOrder());
+	return order;
+}
+
+} // namespace Aqsis
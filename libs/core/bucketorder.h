@@ -0,0 +1,119 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Declares the orders in which buckets may be rendered.
+ */
+
+#ifndef BUCKETORDER_H_INCLUDED
+#define BUCKETORDER_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/math/region.h>
+
+namespace Aqsis {
+
+/// Position of a bucket in the grid of buckets.
+struct SqBucketPos
+{
+	TqInt col;
+	TqInt row;
+
+	SqBucketPos(TqInt col = 0, TqInt row = 0) : col(col), row(row) {}
+};
+
+/// The amount of deferred work waiting in a bucket.
+struct SqBucketLoad
+{
+	/// Number of micropolygons waiting to be sampled.
+	TqInt micropolygons;
+	/// Number of waiting surfaces which have already been split from a
+	/// larger one.
+	TqInt splitSurfaces;
+
+	SqBucketLoad(TqInt micropolygons = 0, TqInt splitSurfaces = 0)
+		: micropolygons(micropolygons), splitSurfaces(splitSurfaces) {}
+};
+
+/** \brief An order in which the buckets of an image are rendered.
+ *
+ * A surface is held by one bucket only, so the image buffer needs to know the
+ * order in which buckets will be rendered to post each surface into the
+ * first one which it touches.  Most orders are fixed in advance and only
+ * have to give this plan.
+ *
+ * Dynamic orders choose each bucket as rendering proceeds, based on the
+ * work which is waiting in the remaining buckets.  The image buffer keeps the
+ * waiting buckets sorted by their load as work is added to them, and starts
+ * the first.  The plan only serves to break ties, and the image buffer
+ * gathers the surfaces touching a bucket into it when the bucket is chosen.
+ */
+class CqBucketOrder
+{
+	public:
+		virtual ~CqBucketOrder() {}
+
+		/** \brief Create a bucket order from its name.
+		 *
+		 * Valid names are "horizontal", "vertical", "zigzag", "spiral"
+		 * (or "circle"), "hilbert", "random" and "memory".
+		 *
+		 * \return The new order, or a null pointer if the name is unknown.
+		 */
+		static boost::shared_ptr<CqBucketOrder> create(const std::string& name);
+
+		/** \brief Plan the order of the buckets in the given region.
+		 *
+		 * \param region - region of buckets to be rendered.
+		 * \param plan - filled with each bucket of the region exactly once,
+		 *               in the order they are to be rendered.
+		 */
+		virtual void plan(const CqRegion& region,
+				std::vector<SqBucketPos>& plan) const = 0;
+
+		/// Determine whether the order is chosen as rendering proceeds.
+		virtual bool isDynamic() const
+		{
+			return false;
+		}
+
+		/** \brief Compare the work waiting in two buckets, for dynamic orders.
+		 *
+		 * This must be a strict weak ordering.  Buckets whose loads are
+		 * equivalent are started in planned order.
+		 *
+		 * \return True if a bucket with load a is to be started before one
+		 * with load b.
+		 */
+		virtual bool before(const SqBucketLoad& /*a*/, const SqBucketLoad& /*b*/) const
+		{
+			return false;
+		}
+};
+
+} // namespace Aqsis
+
+#endif // BUCKETORDER_H_INCLUDED
@@ -0,0 +1,248 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for bucket orders
+ */
+
+#include "bucketorder.h"
+
+#include <cstdlib>
+#include <set>
+#include <utility>
+
+#include <aqsis/ri/ri.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "imagebuffer.h"
+#include "quadrics.h"
+#include "renderer.h"
+
+using namespace Aqsis;
+
+namespace {
+
+const char* orderNames[] = {"horizontal", "vertical", "zigzag", "spiral",
+	"hilbert", "random", "memory"};
+
+// Check that the plan visits each bucket of the region exactly once.
+void checkCoversRegion(const std::string& name, const CqRegion& region)
+{
+	boost::shared_ptr<CqBucketOrder> order = CqBucketOrder::create(name);
+	BOOST_REQUIRE(order);
+	std::vector<SqBucketPos> plan;
+	order->plan(region, plan);
+	BOOST_CHECK_EQUAL(static_cast<TqInt>(plan.size()), region.area());
+	std::set<std::pair<TqInt,TqInt> > visited;
+	for(TqInt i = 0, end = plan.size(); i < end; ++i)
+	{
+		BOOST_CHECK(plan[i].col >= region.xMin() && plan[i].col < region.xMax());
+		BOOST_CHECK(plan[i].row >= region.yMin() && plan[i].row < region.yMax());
+		visited.insert(std::make_pair(plan[i].col, plan[i].row));
+	}
+	BOOST_CHECK_EQUAL(static_cast<TqInt>(visited.size()), region.area());
+}
+
+// Check that each bucket in the plan is next to the previous one.
+void checkContinuous(const std::string& name, const CqRegion& region)
+{
+	std::vector<SqBucketPos> plan;
+	CqBucketOrder::create(name)->plan(region, plan);
+	for(TqInt i = 1, end = plan.size(); i < end; ++i)
+	{
+		BOOST_CHECK_EQUAL(std::abs(plan[i].col - plan[i-1].col)
+				+ std::abs(plan[i].row - plan[i-1].row), 1);
+	}
+}
+
+// Start a world for a 64x64 image in 4x4 buckets, with raster coordinates
+// (x,y) at (x/32 - 1, 1 - y/32) in world space.
+void beginWorld(const char* orderName)
+{
+	RiBegin(RI_NULL);
+	RiFormat(64, 64, 1);
+	RiProjection(const_cast<char*>("orthographic"), RI_NULL);
+	RiScreenWindow(-1, 1, -1, 1);
+	RiPixelFilter(RiBoxFilter, 1, 1);
+	RtInt bucketSize[] = {16, 16};
+	RiOption(const_cast<char*>("limits"), "bucketsize", bucketSize, RI_NULL);
+	RtString order = const_cast<char*>(orderName);
+	RiOption(const_cast<char*>("render"), "bucketorder", &order, RI_NULL);
+	RiWorldBegin();
+}
+
+void endWorld()
+{
+	RiWorldEnd();
+	RiEnd();
+}
+
+// Post a sphere centred at the given raster position into the image buffer.
+boost::shared_ptr<CqSurface> postSphere(TqFloat x, TqFloat y, TqFloat radius)
+{
+	RiTransformBegin();
+	RiTranslate(x/32 - 1, 1 - y/32, 5);
+	boost::shared_ptr<CqSphere> sphere(new CqSphere(radius/32, -radius/32,
+				radius/32, 0, 360));
+	RiTransformEnd();
+	sphere->SetDefaultPrimitiveVariables();
+	CqMatrix matOtoC, matNOtoC, matVOtoC;
+	QGetRenderContext()->matSpaceToSpace("object", "camera", NULL,
+			sphere->pTransform().get(), 0, matOtoC);
+	QGetRenderContext()->matNSpaceToSpace("object", "camera", NULL,
+			sphere->pTransform().get(), 0, matNOtoC);
+	QGetRenderContext()->matVSpaceToSpace("object", "camera", NULL,
+			sphere->pTransform().get(), 0, matVOtoC);
+	sphere->Transform(matOtoC, matNOtoC, matVOtoC);
+	QGetRenderContext()->pImage()->PostSurface(sphere);
+	return sphere;
+}
+
+// Check that only the buckets at col,row and col2,row2 hold a surface, and
+// that they hold one each.
+void checkHeldBy(TqInt col, TqInt row, TqInt col2 = -1, TqInt row2 = -1)
+{
+	const CqImageBuffer& image = *QGetRenderContext()->pImage();
+	for(TqInt r = 0; r < 4; ++r)
+	{
+		for(TqInt c = 0; c < 4; ++c)
+		{
+			TqInt expected = (c == col && r == row) || (c == col2 && r == row2);
+			BOOST_CHECK_MESSAGE(image.Bucket(c, r).cGPrims() == expected,
+					"bucket " << c << "," << r << " holds "
+					<< image.Bucket(c, r).cGPrims() << " surfaces");
+		}
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(bucketorder_tests)
+
+BOOST_AUTO_TEST_CASE(bucketorder_covers_region_test)
+{
+	for(TqInt i = 0; i < 7; ++i)
+	{
+		checkCoversRegion(orderNames[i], CqRegion(0, 0, 1, 1));
+		checkCoversRegion(orderNames[i], CqRegion(0, 0, 8, 8));
+		checkCoversRegion(orderNames[i], CqRegion(0, 0, 13, 5));
+		checkCoversRegion(orderNames[i], CqRegion(3, 2, 7, 11));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_unknown_test)
+{
+	BOOST_CHECK(!CqBucketOrder::create("diagonal"));
+	BOOST_CHECK(CqBucketOrder::create("circle"));
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_horizontal_test)
+{
+	std::vector<SqBucketPos> plan;
+	CqBucketOrder::create("horizontal")->plan(CqRegion(1, 1, 3, 3), plan);
+	BOOST_REQUIRE_EQUAL(plan.size(), 4U);
+	BOOST_CHECK_EQUAL(plan[0].col, 1); BOOST_CHECK_EQUAL(plan[0].row, 1);
+	BOOST_CHECK_EQUAL(plan[1].col, 2); BOOST_CHECK_EQUAL(plan[1].row, 1);
+	BOOST_CHECK_EQUAL(plan[2].col, 1); BOOST_CHECK_EQUAL(plan[2].row, 2);
+	BOOST_CHECK_EQUAL(plan[3].col, 2); BOOST_CHECK_EQUAL(plan[3].row, 2);
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_continuous_test)
+{
+	checkContinuous("zigzag", CqRegion(0, 0, 13, 5));
+	checkContinuous("spiral", CqRegion(0, 0, 7, 7));
+	checkContinuous("hilbert", CqRegion(0, 0, 16, 16));
+	checkContinuous("hilbert", CqRegion(2, 5, 6, 9));
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_spiral_centre_test)
+{
+	std::vector<SqBucketPos> plan;
+	CqBucketOrder::create("spiral")->plan(CqRegion(0, 0, 5, 3), plan);
+	BOOST_CHECK_EQUAL(plan[0].col, 2);
+	BOOST_CHECK_EQUAL(plan[0].row, 1);
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_memory_before_test)
+{
+	boost::shared_ptr<CqBucketOrder> order = CqBucketOrder::create("memory");
+	BOOST_CHECK(order->isDynamic());
+	BOOST_CHECK(!CqBucketOrder::create("hilbert")->isDynamic());
+
+	// Most micropolygons first, then most split surfaces.
+	BOOST_CHECK(order->before(SqBucketLoad(10, 1), SqBucketLoad(0, 5)));
+	BOOST_CHECK(!order->before(SqBucketLoad(0, 5), SqBucketLoad(10, 1)));
+	BOOST_CHECK(order->before(SqBucketLoad(10, 3), SqBucketLoad(10, 1)));
+	// Equal loads are left to the plan.
+	BOOST_CHECK(!order->before(SqBucketLoad(10, 3), SqBucketLoad(10, 3)));
+	// Static orders don't compare loads at all.
+	boost::shared_ptr<CqBucketOrder> hilbert = CqBucketOrder::create("hilbert");
+	BOOST_CHECK(!hilbert->before(SqBucketLoad(10, 3), SqBucketLoad(0, 0)));
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_post_surface_test)
+{
+	// A surface is held by the bucket it touches which comes first in the
+	// plan.  This sphere touches buckets 1,1 and 2,1, which zigzag takes
+	// right to left.
+	for(TqInt i = 0; i < 7; ++i)
+	{
+		BOOST_TEST_CHECKPOINT(orderNames[i]);
+		std::vector<SqBucketPos> plan;
+		CqBucketOrder::create(orderNames[i])->plan(CqRegion(0, 0, 4, 4), plan);
+		TqInt first = 0;
+		while(plan[first].row != 1 || (plan[first].col != 1 && plan[first].col != 2))
+			++first;
+		beginWorld(orderNames[i]);
+		postSphere(32, 24, 3);
+		checkHeldBy(plan[first].col, plan[first].row);
+		endWorld();
+	}
+	beginWorld("zigzag");
+	postSphere(32, 24, 3);
+	checkHeldBy(2, 1);
+	endWorld();
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_repost_surface_test)
+{
+	// A reposted surface moves on to the next bucket it touches in the
+	// plan, passing over the one it came from.
+	const char* names[] = {"horizontal", "vertical", "memory"};
+	const TqInt nextCol[] = {2, 1, 1};
+	const TqInt nextRow[] = {1, 2, 2};
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		BOOST_TEST_CHECKPOINT(names[i]);
+		beginWorld(names[i]);
+		// Touches buckets 1,1 to 2,2.
+		boost::shared_ptr<CqSurface> sphere = postSphere(32, 32, 3);
+		checkHeldBy(1, 1);
+		CqImageBuffer& image = *QGetRenderContext()->pImage();
+		const CqImageBuffer& constImage = image;
+		image.RepostSurface(constImage.Bucket(1, 1), sphere);
+		checkHeldBy(1, 1, nextCol[i], nextRow[i]);
+		endWorld();
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
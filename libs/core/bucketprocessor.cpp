@@ -18,9 +18,8 @@
 
 #include	"bucketprocessor.h"
 
-#include	<valarray>
-
 #include	<aqsis/math/math.h>
+#include	<aqsis/math/separable.h>
 #include	"bucket.h"
 #include	"imagebuffer.h"
 #include	<aqsis/util/timer.h>
@@ -28,6 +27,57 @@
 
 namespace Aqsis {
 
+namespace {
+
+/** Determine whether a neighbouring bucket can be given cached samples.
+ *
+ * Buckets which are finished have no use for the cache, while buckets which
+ * are currently being rendered by another processor have already chosen
+ * their sample region and must not be touched.
+ */
+bool acceptsCacheSegments(const CqBucket* bucket)
+{
+	return bucket && !bucket->IsProcessed() && !bucket->IsInProgress();
+}
+
+/// Add the sample data scaled by weight to the sum, over count channels.
+inline void accumulateSample(TqFloat* sum, const TqFloat* data, TqFloat weight,
+		TqInt count)
+{
+	for(TqInt k = 0; k < count; ++k)
+		sum[k] += weight*data[k];
+}
+
+/// Multiply the sample data by scale, over count channels.
+inline void scaleSample(TqFloat* data, TqFloat scale, TqInt count)
+{
+	for(TqInt k = 0; k < count; ++k)
+		data[k] *= scale;
+}
+
+/** Narrow the cached raster bound of a surface to the bound of a grid diced
+ * from it.
+ *
+ * The grid bound is expanded for the filter in the same way as the bound
+ * cached by CqImageBuffer::CullSurface(), and the result is kept inside the
+ * old bound.
+ */
+void tightenRasterBound(CqSurface& surface, const CqBound& gridBound,
+		const SqOptionCache& optCache)
+{
+	const CqBound oldBound = surface.GetCachedRasterBound();
+	CqBound bound(
+		max(gridBound.vecMin().x() - optCache.xFiltSize / 2.0f, oldBound.vecMin().x()),
+		max(gridBound.vecMin().y() - optCache.yFiltSize / 2.0f, oldBound.vecMin().y()),
+		max(gridBound.vecMin().z(), oldBound.vecMin().z()),
+		min(gridBound.vecMax().x() + optCache.xFiltSize / 2.0f, oldBound.vecMax().x()),
+		min(gridBound.vecMax().y() + optCache.yFiltSize / 2.0f, oldBound.vecMax().y()),
+		min(gridBound.vecMax().z(), oldBound.vecMax().z()) );
+	surface.CacheRasterBound(bound);
+}
+
+} // unnamed namespace
+
 CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
                                      const SqOptionCache& optCache)
 	: m_bucket(0),
@@ -40,13 +90,24 @@ CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
 	m_aieImage(),
 	m_pixelPool(optCache.xSamps, optCache.ySamps),
 	m_aFilterValues(),
+	m_filterTaps(),
+	m_filterCutsSubpixels(false),
+	m_filterSeparable(false),
+	m_filterXTaps(),
+	m_filterYTaps(),
+	m_filteredSamples(),
+	m_filteredCounts(),
+	m_filterRows(),
+	m_filterRowCounts(),
 	m_CurrentMpgSampleInfo(),
 	m_OcclusionTree(),
 	m_DataRegion(),
 	m_SampleRegion(),
 	m_DisplayRegion(),
 	m_hasValidSamples(false),
-	m_channelBuffer()
+	m_channelBuffer(),
+	m_waitingMPs(),
+	m_waitingGrids()
 {
 	setupCacheInformation();
 }
@@ -68,11 +129,12 @@ void CqBucketProcessor::setupCacheInformation()
 	m_cacheRegions[SqBucketCacheSegment::bottom_right] = CqRegion(width-overlapx, height-overlapy, width, height);
 }
 
-void CqBucketProcessor::setBucket(CqBucket* bucket)
+void CqBucketProcessor::setBucket(CqBucket* bucket, TqInt renderIndex)
 {
 	assert(m_bucket == 0);
 
 	m_bucket = bucket;
+	m_bucket->SetInProgress(true, renderIndex);
 	m_hasValidSamples = false;
 }
 
@@ -88,6 +150,7 @@ void CqBucketProcessor::reset()
 
 	assert(m_bucket && m_bucket->IsProcessed());
 
+	m_bucket->SetInProgress(false);
 	m_bucket = 0;
 	m_hasValidSamples = false;
 }
@@ -139,8 +202,6 @@ void CqBucketProcessor::preProcess(IqSampler* sampler)
 		// Allocate the image element storage if this is the first bucket
 		if(m_aieImage.empty())
 		{
-			SqImageSample::sampleSize = QGetRenderContext() ->GetOutputDataTotalSize();
-
 			m_aieImage.resize( DataRegion().area() );
 			CalculateDofBounds();
 
@@ -218,18 +279,12 @@ void CqBucketProcessor::process()
 	// Render any waiting subsurfaces.
 	// \todo Need to refine the exit condition, to ensure that all previous buckets have been
 	// duly processed.
-	while ( m_bucket->hasPendingSurfaces() )
+	while ( boost::shared_ptr<CqSurface> surface = m_bucket->popTopSurface() )
 	{
-		boost::shared_ptr<CqSurface> surface = m_bucket->pTopSurface();
-		if (surface)
+		RenderSurface( surface );
 		{
-			// Advance to next surface
-			m_bucket->popSurface();
-			RenderSurface( surface );
-			{
-				AQSIS_TIME_SCOPE(Render_MPGs);
-				RenderWaitingMPs();
-			}
+			AQSIS_TIME_SCOPE(Render_MPGs);
+			RenderWaitingMPs();
 		}
 	}
 	{
@@ -256,11 +311,15 @@ void CqBucketProcessor::postProcess()
 		ExposeBucket();
 	}
 
+	// Other buckets may be filtered, or started, at the same time.
+#ifdef ENABLE_THREADING
+	boost::mutex::scoped_lock cacheLock(m_imageBuf.cacheSegmentMutex());
+#endif
 	boost::shared_ptr<SqBucketCacheSegment> top_left, top_right, bottom_left, bottom_right;
 
 	std::vector<CqBucket*> neighbours;
 	m_imageBuf.axialNeighbours(*m_bucket, neighbours);
-	if(neighbours[CqImageBuffer::left] && !neighbours[CqImageBuffer::left]->IsProcessed())
+	if(acceptsCacheSegments(neighbours[CqImageBuffer::left]))
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::left, cacheSegment);
@@ -279,7 +338,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::left]->setCacheSegment(SqBucketCacheSegment::bottom_right, bottom_left);
 		}
 	}
-	if(neighbours[CqImageBuffer::right] && !neighbours[CqImageBuffer::right]->IsProcessed())
+	if(acceptsCacheSegments(neighbours[CqImageBuffer::right]))
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::right, cacheSegment);
@@ -297,7 +356,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::right]->setCacheSegment(SqBucketCacheSegment::bottom_left, bottom_right);
 		}
 	}
-	if(neighbours[CqImageBuffer::above] && !neighbours[CqImageBuffer::above]->IsProcessed())
+	if(acceptsCacheSegments(neighbours[CqImageBuffer::above]))
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::top, cacheSegment);
@@ -321,7 +380,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::above]->setCacheSegment(SqBucketCacheSegment::bottom_right, top_right);
 		}
 	}
-	if(neighbours[CqImageBuffer::below] && !neighbours[CqImageBuffer::below]->IsProcessed())
+	if(acceptsCacheSegments(neighbours[CqImageBuffer::below]))
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::bottom, cacheSegment);
@@ -380,8 +439,6 @@ void CqBucketProcessor::CombineElements()
 
 void CqBucketProcessor::FilterBucket()
 {
-	CqImagePixelPtr * pie;
-
 	std::map<TqInt, CqRenderer::SqOutputDataEntry> channelMap;
 	// Setup the channel buffer ready to accept the output data.
 	// First fill in the default display value r, g, b, a, and z.
@@ -407,259 +464,57 @@ void CqBucketProcessor::FilterBucket()
 	std::vector<TqFloat>	aCoverages;
 	aCoverages.resize( DisplayRegion().area() );
 
-	TqInt xmax = m_DiscreteShiftX;
-	TqInt ymax = m_DiscreteShiftY;
-	TqFloat xfwo2 = std::ceil(m_optCache.xFiltSize) * 0.5f;
-	TqFloat yfwo2 = std::ceil(m_optCache.yFiltSize) * 0.5f;
 	TqInt numSubPixels = ( m_optCache.xSamps * m_optCache.ySamps );
 
-	TqInt	xlen = DataRegion().width();
-
-	TqInt SampleCount = 0;
-
 	TqInt x, y;
 	TqInt i = 0;
 
-	TqInt endy = DisplayRegion().yMax();
-	TqInt endx = DisplayRegion().xMax();
-
-	bool useSeperable = true;
+	TqInt endy = DisplayRegion().height();
+	TqInt endx = DisplayRegion().width();
 
 	if(m_hasValidSamples)
 	{
-		// non-seperable is faster for very small filter widths.
-		if(m_optCache.xFiltSize <= 16.0 || m_optCache.yFiltSize <= 16.0)
-			useSeperable = false;
-
-		// FIXME: Separable filters currently crash!  Additionally,
-		// * Some filter types are inherently unseparable (eg, disk, catmull-rom)
-		// * Separable filters are a lot faster where applicable.  The comment
-		//   & heuristic above appears to be incorrect.
-		useSeperable = false;
+		// Filter the samples into m_filteredSamples, normalised by the
+		// total filter weight, and count the samples hit in each pixel.
+		m_filteredSamples.assign(DisplayRegion().area()*datasize, 0.0f);
+		m_filteredCounts.assign(DisplayRegion().area(), 0);
+		if(m_filterSeparable)
+			FilterSeparable(datasize);
+		else
+			FilterNonSeparable(datasize);
 
-		if(useSeperable)
+		for ( y = 0; y < endy; y++ )
 		{
-			// seperable filter. filtering by fx,fy is equivalent to filtering
-			// by fx,1 followed by 1,fy.
-
-			TqInt size = DisplayRegion().width() * DisplayRegion().height() * m_optCache.ySamps;
-			std::valarray<TqFloat> intermediateSamples( 0.0f, size * datasize);
-			std::valarray<TqInt> sampleCounts(0, size);
-			for ( y = DisplayRegion().yMin() - ymax; y < endy + ymax ; y++ )
+			for ( x = 0; x < endx; x++ )
 			{
-				TqFloat ycent = y + 0.5f;
-				TqInt pixelRow = (y-(DisplayRegion().yMin()-ymax)) * m_optCache.ySamps;
-				for ( x = DisplayRegion().xMin(); x < endx ; x++ )
+				TqInt sampleCount = m_filteredCounts[i];
+				const TqFloat* samples = &m_filteredSamples[i*datasize];
+				if ( sampleCount == 0 )
 				{
-					TqFloat xcent = x + 0.5f;
-
-					// Get the element at the left side of the filter area.
-					ImageElement( x - xmax, y, pie );
-
-					TqInt pixelIndex = pixelRow*DisplayRegion().width() + x-DisplayRegion().xMin();
-
-					// filter just in x first
-					for ( TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
+					for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
 					{
-						TqFloat gTot = 0.0;
-						SampleCount = 0;
-						std::valarray<TqFloat> samples( 0.0f, datasize);
-
-						CqImagePixelPtr* pie2 = pie;
-						for ( TqInt fx = -xmax; fx <= xmax; fx++ )
-						{
-							TqInt index = (ymax*(2*xmax + 1) + fx + xmax) * numSubPixels;
-							// Now go over each subsample within the pixel
-							TqInt sampleIndex = sy * m_optCache.xSamps;
-
-							for ( TqInt sx = 0; sx < m_optCache.xSamps; sx++ )
-							{
-								SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
-								CqVector2D vecS = sampleData.position;
-								vecS -= CqVector2D( xcent, ycent );
-								if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
-								{
-									TqFloat g = m_aFilterValues[index + sampleIndex];
-									gTot += g;
-									SqImageSample& opv = (*pie2)->occludingHit(sampleIndex);
-									if ( opv.flags & SqImageSample::Flag_Valid )
-									{
-										TqFloat* data = (*pie2)->sampleHitData(opv);
-										for ( TqInt k = 0; k < datasize; ++k )
-											samples[k] += data[k] * g;
-										sampleCounts[pixelIndex]++;
-									}
-								}
-								sampleIndex++;
-							}
-							pie2++;
-						}
-
-						// store the intermediate result
-						for ( TqInt k = 0; k < datasize; k ++)
-							intermediateSamples[pixelIndex*datasize + k] = samples[k] / gTot;
-
-						pixelIndex += DisplayRegion().width();
+						for(TqInt k = 0; k < channel_i->second.m_NumSamples; ++k)
+							m_channelBuffer(x, y, channel_i->first)[k] = 0.0f;
 					}
+					// Set the depth to infinity.
+					m_channelBuffer(x, y, depthIndex)[0] = FLT_MAX;
+					aCoverages[i] = 0.0;
 				}
-			}
-
-			// now filter in y.
-			for ( y = DisplayRegion().yMin(); y < endy ; y++ )
-			{
-				TqFloat ycent = y + 0.5f;
-				for ( x = DisplayRegion().xMin(); x < endx ; x++ )
+				else
 				{
-					TqFloat xcent = x + 0.5f;
-					TqFloat gTot = 0.0;
-					SampleCount = 0;
-					std::valarray<TqFloat> samples( 0.0f, datasize);
-
-					TqInt fy;
-					// Get the element at the top of the filter area.
-					ImageElement( x, y - ymax, pie );
-					for ( fy = -ymax; fy <= ymax; fy++ )
+					// Copy the filtered sample data into the channel buffer.
+					for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
 					{
-						CqImagePixelPtr* pie2 = pie;
-
-						TqInt index = ((fy + ymax)*(2*xmax + 1) + xmax) * numSubPixels;
-						// Now go over each y subsample within the pixel
-						TqInt sx = m_optCache.xSamps / 2; // use the samples in the centre of the pixel.
-						TqInt sy = 0;
-						TqInt sampleIndex = sx;
-						TqInt pixelRow = (y + fy - (DisplayRegion().yMin()-ymax)) * m_optCache.ySamps;
-						TqInt pixelIndex = pixelRow*DisplayRegion().width() + x-DisplayRegion().xMin();
-
-						for ( sy = 0; sy < m_optCache.ySamps; sy++ )
-						{
-							SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
-							CqVector2D vecS = sampleData.position;
-							vecS -= CqVector2D( xcent, ycent );
-							if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
-							{
-								TqFloat g = m_aFilterValues[index + sampleIndex];
-								gTot += g;
-								if(sampleCounts[pixelIndex] > 0)
-								{
-									SampleCount += sampleCounts[pixelIndex];
-									for ( TqInt k = 0; k < datasize; k++)
-										samples[k] += intermediateSamples[pixelIndex * datasize + k] * g;
-								}
-							}
-							sampleIndex += m_optCache.xSamps;
-							pixelIndex += DisplayRegion().width();
-						}
-
-						pie += xlen;
+						for(TqInt k = 0; k < channel_i->second.m_NumSamples; ++k)
+							m_channelBuffer(x, y, channel_i->first)[k] = samples[channel_i->second.m_Offset + k];
 					}
 
-					// Set depth to infinity if no samples.
-					if ( SampleCount == 0 )
-					{
-						aCoverages[i] = 0.0;
-					}
+					if ( sampleCount >= numSubPixels)
+						aCoverages[ i ] = 1.0;
 					else
-					{
-						float oneOverGTot = 1.0 / gTot;
-
-						// Copy the filtered sample data into the channel buffer.
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x, y, channel_i->first)[i] = samples[channel_i->second.m_Offset + i] * oneOverGTot;
-						}
-
-						if ( SampleCount >= numSubPixels)
-							aCoverages[ i ] = 1.0;
-						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
-					}
-
-					i++;
-				}
-			}
-		}
-		else
-		{
-			// non-seperable filter
-			for ( y = DisplayRegion().yMin(); y < endy ; y++ )
-			{
-				TqFloat ycent = y + 0.5f;
-				for ( x = DisplayRegion().xMin(); x < endx ; x++ )
-				{
-					TqFloat xcent = x + 0.5f;
-					TqFloat gTot = 0.0;
-					SampleCount = 0;
-					std::valarray<TqFloat> samples( 0.0f, datasize);
-
-					// Get the element at the upper left corner of the filter area.
-					ImageElement( x - xmax, y - ymax, pie );
-					for (TqInt fy = -ymax; fy <= ymax; fy++, pie += xlen )
-					{
-						CqImagePixelPtr* pie2 = pie;
-						for (TqInt fx = -xmax; fx <= xmax; fx++, ++pie2 )
-						{
-							TqInt index = ((fy + ymax)*(2*xmax+1) + fx + xmax) * numSubPixels;
-							// Now go over each subsample within the pixel
-							TqInt sampleIndex = 0;
-							for (TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
-							{
-								for (TqInt sx = 0; sx < m_optCache.xSamps; sx++ )
-								{
-									SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
-									CqVector2D vecS = sampleData.position;
-									vecS -= CqVector2D( xcent, ycent );
-									if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
-									{
-										TqFloat g = m_aFilterValues[index+sampleIndex];
-										gTot += g;
-										SqImageSample& opv = (*pie2)->occludingHit(sampleIndex);
-										if ( opv.flags & SqImageSample::Flag_Valid )
-										{
-											TqFloat* data = (*pie2)->sampleHitData(opv);
-											for ( TqInt k = 0; k < datasize; ++k )
-												samples[k] += data[k] * g;
-											SampleCount++;
-										}
-									}
-									sampleIndex++;
-								}
-							}
-						}
-					}
-
-
-					// Set depth to infinity if no samples.
-					if ( SampleCount == 0 )
-					{
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), channel_i->first)[i] = 0.0f;
-						}
-						// Set the depth to infinity.
-						m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), depthIndex)[0] = FLT_MAX;
-						aCoverages[i] = 0.0;
-					}
-					else
-					{
-						float oneOverGTot = 1.0 / gTot;
-						
-						// Copy the filtered sample data into the channel buffer.
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), channel_i->first)[i] = samples[channel_i->second.m_Offset + i] * oneOverGTot;
-						}
-
-						if ( SampleCount >= numSubPixels)
-							aCoverages[ i ] = 1.0;
-						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
-					}
-
-					i++;
+						aCoverages[ i ] = ( TqFloat ) sampleCount / ( TqFloat ) (numSubPixels );
 				}
+				i++;
 			}
 		}
 	}
@@ -740,6 +595,141 @@ void CqBucketProcessor::FilterBucket()
 	}
 }
 
+//----------------------------------------------------------------------
+/** Filter the samples with the full two dimensional filter.
+ *
+ * Each pixel sums the samples in the subpixels covered by the filter,
+ * weighted by the precomputed filter taps.
+ */
+void CqBucketProcessor::FilterNonSeparable(TqInt datasize)
+{
+	TqInt xmax = m_DiscreteShiftX;
+	TqInt ymax = m_DiscreteShiftY;
+	TqFloat xfwo2 = std::ceil(m_optCache.xFiltSize) * 0.5f;
+	TqFloat yfwo2 = std::ceil(m_optCache.yFiltSize) * 0.5f;
+	TqInt xlen = DataRegion().width();
+
+	TqInt i = 0;
+	for ( TqInt y = DisplayRegion().yMin(), endy = DisplayRegion().yMax(); y < endy; y++ )
+	{
+		TqFloat ycent = y + 0.5f;
+		for ( TqInt x = DisplayRegion().xMin(), endx = DisplayRegion().xMax(); x < endx; x++, i++ )
+		{
+			TqFloat xcent = x + 0.5f;
+			TqFloat* samples = &m_filteredSamples[i*datasize];
+			TqFloat gTot = 0;
+			TqInt sampleCount = 0;
+
+			// Get the element at the upper left corner of the filter area.
+			CqImagePixelPtr* pie;
+			ImageElement( x - xmax, y - ymax, pie );
+			for ( std::vector<SqFilterTap>::const_iterator tap = m_filterTaps.begin(),
+					end = m_filterTaps.end(); tap != end; ++tap )
+			{
+				CqImagePixel& pixel = *pie[tap->pixelY*xlen + tap->pixelX];
+				if ( m_filterCutsSubpixels )
+				{
+					// The sample may lie on either side of the filter edge.
+					CqVector2D vecS = pixel.SampleData( tap->sampleIndex ).position;
+					vecS -= CqVector2D( xcent, ycent );
+					if ( !( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 ) )
+						continue;
+				}
+				gTot += tap->weight;
+				if ( pixel.occludingFlags( tap->sampleIndex ) & SqImageSample::Flag_Valid )
+				{
+					accumulateSample( samples, pixel.occludingHitData( tap->sampleIndex ), tap->weight, datasize );
+					sampleCount++;
+				}
+			}
+
+			m_filteredCounts[i] = sampleCount;
+			if ( sampleCount > 0 )
+				scaleSample( samples, 1.0f / gTot, datasize );
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/** Filter the samples with a separable filter.
+ *
+ * Filtering with the weights fx(x)*fy(y) is done by filtering each row of
+ * samples along x with fx into m_filterRows, and then filtering the columns
+ * of that along y with fy.
+ */
+void CqBucketProcessor::FilterSeparable(TqInt datasize)
+{
+	TqInt xmax = m_DiscreteShiftX;
+	TqInt ymax = m_DiscreteShiftY;
+	TqInt width = DisplayRegion().width();
+	TqInt height = DisplayRegion().height();
+	TqInt ySamps = m_optCache.ySamps;
+	TqInt xSamps = m_optCache.xSamps;
+
+	// Filter along x, for every row of samples covered by the filter.
+	TqInt numRows = (height + 2*ymax)*ySamps;
+	m_filterRows.assign(numRows*width*datasize, 0.0f);
+	m_filterRowCounts.assign(numRows*width, 0);
+	for ( TqInt row = 0; row < numRows; ++row )
+	{
+		TqInt y = DisplayRegion().yMin() - ymax + row / ySamps;
+		TqInt rowStart = (row % ySamps) * xSamps;
+		for ( TqInt x = 0; x < width; ++x )
+		{
+			TqInt index = row*width + x;
+			TqFloat* samples = &m_filterRows[index*datasize];
+			CqImagePixelPtr* pie;
+			ImageElement( DisplayRegion().xMin() + x - xmax, y, pie );
+			for ( std::vector<SqFilterTap>::const_iterator tap = m_filterXTaps.begin(),
+					end = m_filterXTaps.end(); tap != end; ++tap )
+			{
+				CqImagePixel& pixel = *pie[tap->pixelX];
+				TqInt sampleIndex = rowStart + tap->sampleIndex;
+				if ( pixel.occludingFlags( sampleIndex ) & SqImageSample::Flag_Valid )
+				{
+					accumulateSample( samples, pixel.occludingHitData( sampleIndex ), tap->weight, datasize );
+					m_filterRowCounts[index]++;
+				}
+			}
+		}
+	}
+
+	// Filter along y.
+	TqFloat gTot = 0;
+	for ( std::vector<SqFilterTap>::const_iterator tap = m_filterXTaps.begin(),
+			end = m_filterXTaps.end(); tap != end; ++tap )
+		gTot += tap->weight;
+	TqFloat yTot = 0;
+	for ( std::vector<SqFilterTap>::const_iterator tap = m_filterYTaps.begin(),
+			end = m_filterYTaps.end(); tap != end; ++tap )
+		yTot += tap->weight;
+	gTot *= yTot;
+
+	TqInt i = 0;
+	for ( TqInt y = 0; y < height; ++y )
+	{
+		for ( TqInt x = 0; x < width; ++x, ++i )
+		{
+			TqFloat* samples = &m_filteredSamples[i*datasize];
+			TqInt sampleCount = 0;
+			for ( std::vector<SqFilterTap>::const_iterator tap = m_filterYTaps.begin(),
+					end = m_filterYTaps.end(); tap != end; ++tap )
+			{
+				TqInt index = ((y + tap->pixelY)*ySamps + tap->sampleIndex)*width + x;
+				if ( m_filterRowCounts[index] > 0 )
+				{
+					accumulateSample( samples, &m_filterRows[index*datasize], tap->weight, datasize );
+					sampleCount += m_filterRowCounts[index];
+				}
+			}
+
+			m_filteredCounts[i] = sampleCount;
+			if ( sampleCount > 0 )
+				scaleSample( samples, 1.0f / gTot, datasize );
+		}
+	}
+}
+
 void CqBucketProcessor::ImageElement( TqInt iXPos, TqInt iYPos, CqImagePixelPtr*& pie )
 {
 	iXPos -= DisplayRegion().xMin();
@@ -849,6 +839,88 @@ void CqBucketProcessor::InitialiseFilterValues()
 			}
 		}
 	}
+
+	// Make a list of the subpixels which the filter extent covers, indexing
+	// subpixels by their column and row across the whole filter area.  When
+	// the edge of the filter cuts through subpixels, the samples in those
+	// have to be tested against it by position.
+	TqInt xSamps = m_optCache.xSamps;
+	TqInt ySamps = m_optCache.ySamps;
+	TqInt numColumns = (2*xmax + 1)*xSamps;
+	TqInt numRows = (2*ymax + 1)*ySamps;
+	const TqFloat eps = 1e-4f;
+	m_filterCutsSubpixels = false;
+	std::vector<TqInt> columns;
+	for(TqInt col = 0; col < numColumns; ++col)
+	{
+		TqFloat cellMin = TqFloat(col)/xSamps - xmax - 0.5f;
+		TqFloat cellMax = TqFloat(col + 1)/xSamps - xmax - 0.5f;
+		if(cellMin < xfwo2 - eps && cellMax > -xfwo2 + eps)
+		{
+			columns.push_back(col);
+			if(cellMin < -xfwo2 - eps || cellMax > xfwo2 + eps)
+				m_filterCutsSubpixels = true;
+		}
+	}
+	std::vector<TqInt> rows;
+	for(TqInt row = 0; row < numRows; ++row)
+	{
+		TqFloat cellMin = TqFloat(row)/ySamps - ymax - 0.5f;
+		TqFloat cellMax = TqFloat(row + 1)/ySamps - ymax - 0.5f;
+		if(cellMin < yfwo2 - eps && cellMax > -yfwo2 + eps)
+		{
+			rows.push_back(row);
+			if(cellMin < -yfwo2 - eps || cellMax > yfwo2 + eps)
+				m_filterCutsSubpixels = true;
+		}
+	}
+
+	m_filterTaps.clear();
+	std::vector<TqFloat> weights;
+	for(std::vector<TqInt>::const_iterator row = rows.begin(); row != rows.end(); ++row)
+	{
+		for(std::vector<TqInt>::const_iterator col = columns.begin(); col != columns.end(); ++col)
+		{
+			SqFilterTap tap;
+			tap.pixelX = *col / xSamps;
+			tap.pixelY = *row / ySamps;
+			tap.sampleIndex = (*row % ySamps)*xSamps + *col % xSamps;
+			tap.weight = m_aFilterValues[(tap.pixelY*(2*xmax + 1) + tap.pixelX)*numSubPixels
+				+ tap.sampleIndex];
+			m_filterTaps.push_back(tap);
+			weights.push_back(tap.weight);
+		}
+	}
+
+	// Samples in subpixels cut by the filter edge need the full filter.
+	m_filterSeparable = false;
+	m_filterXTaps.clear();
+	m_filterYTaps.clear();
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	if(!m_optCache.separableFilter || m_filterCutsSubpixels || weights.empty()
+		|| !separateKernel(&weights[0], columns.size(), rows.size(),
+			xWeights, yWeights))
+		return;
+	for(TqInt col = 0, numColTaps = columns.size(); col < numColTaps; ++col)
+	{
+		SqFilterTap tap;
+		tap.pixelX = columns[col] / xSamps;
+		tap.pixelY = 0;
+		tap.sampleIndex = columns[col] % xSamps;
+		tap.weight = xWeights[col];
+		m_filterXTaps.push_back(tap);
+	}
+	for(TqInt row = 0, numRowTaps = rows.size(); row < numRowTaps; ++row)
+	{
+		SqFilterTap tap;
+		tap.pixelX = 0;
+		tap.pixelY = rows[row] / ySamps;
+		tap.sampleIndex = rows[row] % ySamps;
+		tap.weight = yWeights[row];
+		m_filterYTaps.push_back(tap);
+	}
+	m_filterSeparable = true;
 }
 
 void CqBucketProcessor::CalculateDofBounds()
@@ -919,33 +991,137 @@ void CqBucketProcessor::CalculateDofBounds()
 
 void CqBucketProcessor::RenderWaitingMPs()
 {
-	for ( std::vector<boost::shared_ptr<CqMicroPolygon> >::iterator itMP = m_bucket->micropolygons().begin();
-			itMP != m_bucket->micropolygons().end();
-			itMP++ )
+	// Take the waiting MPs and grids out of the bucket first, so that other
+	// threads may keep adding to it while we render.
+	m_waitingMPs.clear();
+	m_bucket->takeMPs(m_waitingMPs);
+	m_waitingGrids.clear();
+	m_bucket->takeRasterGrids(m_waitingGrids);
+#ifdef USE_TIMERS
+	if ( CqProfiler::recording() )
+	{
+		// Attribute the sampling time to the objects, timing each run of
+		// micropolygons which come from the same grid.
+		std::vector<CqMicroPolygonPtr>::iterator itMP = m_waitingMPs.begin();
+		while ( itMP != m_waitingMPs.end() )
+		{
+			const CqMicroPolyGridBase* grid = (*itMP)->pGrid();
+			double begin = CqProfiler::now();
+			for ( ; itMP != m_waitingMPs.end() && (*itMP)->pGrid() == grid; ++itMP )
+				RenderMicroPoly( (*itMP).get() );
+			CqProfiler::addSpan( EqTimerStats::Sample_grid, begin, CqProfiler::now(),
+					0, grid->pSurface()->strName().c_str() );
+		}
+	}
+	else
+#endif
+	{
+		for ( std::vector<CqMicroPolygonPtr>::iterator itMP = m_waitingMPs.begin();
+				itMP != m_waitingMPs.end();
+				itMP++ )
+		{
+			CqMicroPolygon* mp = (*itMP).get();
+			RenderMicroPoly( mp );
+		}
+	}
+	m_waitingMPs.clear();
+
+	for ( std::vector<CqRasterGridPtr>::iterator itGrid = m_waitingGrids.begin();
+			itGrid != m_waitingGrids.end();
+			itGrid++ )
 	{
-		CqMicroPolygon* mp = (*itMP).get();
-		RenderMicroPoly( mp );
+#ifdef USE_TIMERS
+		if ( CqProfiler::recording() )
+		{
+			double begin = CqProfiler::now();
+			RenderRasterGrid( **itGrid );
+			CqProfiler::addSpan( EqTimerStats::Sample_grid, begin, CqProfiler::now(),
+					0, (*itGrid)->pGrid()->pSurface()->strName().c_str() );
+			continue;
+		}
+#endif
+		RenderRasterGrid( **itGrid );
 	}
-	m_bucket->micropolygons().clear();
+	m_waitingGrids.clear();
 
 	m_OcclusionTree.updateTree();
 }
 
 
+//----------------------------------------------------------------------
+/** Render the quads of a grid which hasn't been busted into micropolygons.
+ *
+ * The quads are visited in grid order, skipping whole rows and then single
+ * quads whose bound is outside the sample region, and the rest are sampled
+ * through the one CqRasterGridQuad.
+ */
+void CqBucketProcessor::RenderRasterGrid( const CqRasterGrid& grid )
+{
+	bool UsingDof = QGetRenderContext()->UsingDepthOfField();
+	CqRasterGridQuad quad( grid );
+	TqInt cu = grid.uGridRes();
+	for ( TqInt iv = 0; iv < grid.vGridRes(); iv++ )
+	{
+		// Rows without any quads to sample have an empty bound, which would
+		// give a meaningless circle of confusion.
+		const CqBound& rowBound = grid.rowBound( iv );
+		if ( rowBound.vecMin().x() > rowBound.vecMax().x()
+			|| !touchesSampleRegion( rowBound, UsingDof ) )
+			continue;
+		TqInt rowStart = iv * ( cu + 1 );
+		for ( TqInt index = rowStart; index < rowStart + cu; index++ )
+		{
+			if ( !grid.isSampled( index ) )
+				continue;
+			CqBound bound = grid.quadBound( index );
+			if ( !touchesSampleRegion( bound, UsingDof ) )
+				continue;
+			quad.setQuad( index, bound );
+			RenderMicroPoly( &quad );
+		}
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Determine whether a micropolygon with the given tight raster bound may
+ * hit any samples in the sample region.
+ *
+ * \param bound - tight raster bound.
+ * \param usingDof - true if the bound should be expanded for depth of field.
+ */
+bool CqBucketProcessor::touchesSampleRegion( CqBound bound, bool usingDof ) const
+{
+	if ( usingDof )
+	{
+		const CqVector2D maxCoC = max(
+			QGetRenderContext()->GetCircleOfConfusion( bound.vecMin().z() ),
+			QGetRenderContext()->GetCircleOfConfusion( bound.vecMax().z() ) );
+		bound.vecMin() -= vectorCast<CqVector3D>( maxCoC );
+		bound.vecMax() += vectorCast<CqVector3D>( maxCoC );
+	}
+	const CqRegion& region = SampleRegion();
+	return bound.vecMax().x() >= region.xMin() && bound.vecMin().x() <= region.xMax()
+		&& bound.vecMax().y() >= region.yMin() && bound.vecMin().y() <= region.yMax();
+}
+
+
 //----------------------------------------------------------------------
 /** Render the given Surface
  */
 void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 {
 	// Cull surface if it's hidden
-	if ( !surface->pCSGNode() && !( (m_optCache.displayMode & DMode_Z) &&
-	                                (m_optCache.depthFilter == Filter_Max ||
-	                                 m_optCache.depthFilter == Filter_Average) ) )
+	bool canCullHidden = !surface->pCSGNode()
+		&& !( (m_optCache.displayMode & DMode_Z) &&
+		      (m_optCache.depthFilter == Filter_Max ||
+		       m_optCache.depthFilter == Filter_Average) )
+		&& surface->fCachedBound()
+		&& surface->pAttributes()->GetIntegerAttributeDef( "cull", "hidden", 1 ) == 1;
+	if ( canCullHidden )
 	{
 		AQSIS_TIME_SCOPE(Occlusion_culling);
-		if ( surface->fCachedBound() &&
-			 ( surface->pAttributes()->GetIntegerAttributeDef( "cull", "hidden", 1 ) == 1 ) &&
-		     m_OcclusionTree.canCull(surface->GetCachedRasterBound()) )
+		if ( m_OcclusionTree.canCull(surface->GetCachedRasterBound()) )
 		{
 			m_imageBuf.RepostSurface(*m_bucket, surface);
 			STATS_INC( GPR_occlusion_culled );
@@ -1022,10 +1198,27 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 			ADDREF( pGrid );
 			// Only shade in all cases since the Displacement could be called in the shadow map creation too.
 			// \note Timings for shading are broken down into component parts within this function.
-			pGrid->Shade();
+			// With "gridocclusion" on, the grid is also tested against the
+			// occlusion tree once displaced, and culled before shading.
+			pGrid->Shade( true, canCullHidden && m_optCache.gridOcclusion
+					? &m_OcclusionTree : 0 );
 			pGrid->TransferOutputVariables();
 
-			if ( pGrid->vfCulled() == false )
+			if ( pGrid->vfOcclusionCulled() )
+			{
+				// The grid may be visible in other buckets, so pass the
+				// surface on just as if its bound had been culled above.
+				// The displaced grid is usually much smaller than the
+				// bound, which has to allow for the displacement bound, so
+				// narrow the cached bound to it first.  The surface then
+				// only goes to the buckets the grid touches, and is culled
+				// there by the bound test above if the grid would be,
+				// without dicing and displacing it again.
+				tightenRasterBound( *surface, pGrid->occludedRasterBound(),
+						m_optCache );
+				m_imageBuf.RepostSurface(*m_bucket, surface);
+			}
+			else if ( pGrid->vfCulled() == false )
 			{
 				AQSIS_TIME_SCOPE(Bust_grids);
 				// Split any grids in this bucket waiting to be processed.
@@ -1098,12 +1291,22 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
 
     TqInt sample_hits = 0;
+	// Sample statistics are accumulated locally and added to the global
+	// counters once, to avoid contention between rendering threads.
+	TqInt samplesTested = 0;
+	TqInt samplesInBound = 0;
 
 	CqHitTestCache hitTestCache;
 	pMPG->CacheHitTestValues(hitTestCache, false);
 
     CqBound Bound = pMPG->GetBound();
 
+#ifdef AQSIS_SIMD_SSE2
+	// Test four samples at a time where the edge test alone decides a hit.
+	const bool bulkTest = pMPG->hasSimpleEdgeTest();
+	const CqHitTest4 hitTest4(hitTestCache, Bound, isCullable);
+#endif
+
 	TqFloat bminx = Bound.vecMin().x();
 	TqFloat bmaxx = Bound.vecMax().x();
 	TqFloat bminy = Bound.vecMin().y();
@@ -1159,13 +1362,55 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 			for ( ; n < end_n; n++ )
 			{
 				int index = index_start;
+#ifdef AQSIS_SIMD_SSE2
+				if ( bulkTest )
+				{
+					for ( m = start_m; m < end_m; m += 4, index += 4 )
+					{
+						int count = std::min(4, end_m - m);
+						const SqSampleData* samples = &(*pie2)->SampleData( index );
+						samplesTested += count;
+						int inBound = 0;
+						int hits = hitTest4.contains( samples, count, inBound );
+						if ( !inBound )
+							continue;
+						if ( UsingLevelOfDetail )
+						{
+							for ( int i = 0; i < count; ++i )
+							{
+								TqFloat LevelOfDetail = samples[i].detailLevel;
+								if ( LodBounds[ 0 ] > LevelOfDetail || LevelOfDetail >= LodBounds[ 1 ] )
+									inBound &= ~(1 << i);
+							}
+							hits &= inBound;
+						}
+						for ( int i = 0; i < count; ++i )
+						{
+							if ( !(inBound & (1 << i)) )
+								continue;
+							++samplesInBound;
+							if ( hits & (1 << i) )
+							{
+								// The same interpolation as CqMicroPolygon::fContains()
+								CqVector2D uv = hitTestCache.xyToUV( samples[i].position );
+								const TqFloat* z = hitTestCache.z;
+								TqFloat D = bilerp( z[0], z[1], z[2], z[3], uv );
+								sample_hits++;
+								StoreSample( pMPG, pie2->get(), index + i, D, uv );
+							}
+						}
+					}
+					index_start += iXSamples;
+					continue;
+				}
+#endif
 				for ( m = start_m; m < end_m; m++, index++ )
 				{
 					SqSampleData const& sampleData = (*pie2)->SampleData( index );
 					const CqVector2D& vecP = sampleData.position;
 					const TqFloat time = 0.0;
 
-					CqStats::IncI( CqStats::SPL_count );
+					++samplesTested;
 
 					if(!Bound.Contains2D( vecP ))
 						continue;
@@ -1185,7 +1430,7 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 						}
 					}
 
-					CqStats::IncI( CqStats::SPL_bound_hits );
+					++samplesInBound;
 
 					// Now check if the subsample hits the micropoly
 					bool SampleHit;
@@ -1211,6 +1456,8 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 			*/
 		}
 	}
+	CqStats::addI( CqStats::SPL_count, samplesTested );
+	CqStats::addI( CqStats::SPL_bound_hits, samplesInBound );
 }
 
 // this function assumes that either dof or mb or both are being used.
@@ -1223,6 +1470,8 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
 
     TqInt sample_hits = 0;
+	TqInt samplesTested = 0;
+	TqInt samplesInBound = 0;
 
 	CqHitTestCache hitTestCache;
 	pMPG->CacheHitTestValues(hitTestCache, UsingDof);
@@ -1378,7 +1627,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 
 						index++;
 
-						CqStats::IncI( CqStats::SPL_count );
+						++samplesTested;
 
 						if(IsMoving && (time < time0 || time > time1))
 						{
@@ -1408,7 +1657,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 							}
 
 
-							CqStats::IncI( CqStats::SPL_bound_hits );
+							++samplesInBound;
 
 							// Now check if the subsample hits the micropoly
 							bool SampleHit;
@@ -1442,7 +1691,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 								}
 							}
 
-							CqStats::IncI( CqStats::SPL_bound_hits );
+							++samplesInBound;
 
 							// Now check if the subsample hits the micropoly
 							bool SampleHit;
@@ -1462,6 +1711,8 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 			}
 		}
     }
+	CqStats::addI( CqStats::SPL_count, samplesTested );
+	CqStats::addI( CqStats::SPL_bound_hits, samplesInBound );
 }
 
 void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, TqInt index, TqFloat D, const CqVector2D& uv )
@@ -1482,7 +1733,7 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 
 	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
 	// Get a pointer to the hit storage.
-	SqImageSample* hit = 0;
+	TqFloat* hitData = 0;
 	if((m_CurrentMpgSampleInfo.isOpaque || (currentGridInfo.matteFlag
 				& SqImageSample::Flag_MatteAlpha)) && isCullable)
 	{
@@ -1494,7 +1745,11 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 		// 3) We don't need the entire set of samples for depth filtering.
 		//
 		// (2 and 3 also determine whether the hit is occlusion cullable.)
-		hit = &pie2->occludingHit(index);
+		//
+		// The occluding storage is a flat block of data per pixel, so this
+		// case needs no allocation and no CSG node.
+		TqUint& occlFlags = pie2->occludingFlags(index);
+		hitData = pie2->occludingHitData(index);
 		if((m_optCache.displayMode & DMode_Z) &&
 		    m_optCache.depthFilter == Filter_MidPoint)
 		{
@@ -1502,8 +1757,8 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 			// update the occluding depth with the *second closest* opaque
 			// surface rather than the closest.
 			TqFloat hitPrevZ = FLT_MAX;
-			if(hit->flags & SqImageSample::Flag_Valid)
-				hitPrevZ = pie2->sampleHitData(*hit)[Sample_Depth];
+			if(occlFlags & SqImageSample::Flag_Valid)
+				hitPrevZ = hitData[Sample_Depth];
 			if(hitPrevZ < D)
 			{
 				// view -->      |          |          |
@@ -1528,15 +1783,17 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 			sampleData.occlZ = D;
 			m_OcclusionTree.setSampleDepth(D, sampleData.occlusionIndex);
 		}
-		hit->flags = SqImageSample::Flag_Valid;
+		occlFlags = SqImageSample::Flag_Valid | currentGridInfo.matteFlag;
 	}
 	else
 	{
-		// Otherwise create some new storage for the hit data in sample hit
-		// vector.
-		pie2->Values(index).push_back(SqImageSample());
-		hit = &pie2->Values(index).back();
-		pie2->allocateHitData(*hit);
+		// Otherwise create some new storage for the hit data in the deep
+		// hits of the sample.
+		SqImageSample& hit = pie2->addDeepHit(index);
+		if(pMPG->pGrid()->usesCSG())
+			hit.csgNode = pMPG->pGrid()->pCSGNode();
+		hit.flags |= currentGridInfo.matteFlag;
+		hitData = pie2->sampleHitData(hit);
 	}
 
 	// Compute the color and opacity of the micropolygon at the hit point.
@@ -1545,7 +1802,6 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 	pMPG->InterpolateOutputs(m_CurrentMpgSampleInfo, uv, col, opa);
 
 	// Store the hit data for later use.
-	TqFloat* hitData = pie2->sampleHitData(*hit);
 	hitData[ Sample_Red ] = col[0];
 	hitData[ Sample_Green ] = col[1];
 	hitData[ Sample_Blue ] = col[2];
@@ -1556,10 +1812,6 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 	if(currentGridInfo.usesDataMap)
 		StoreExtraData(pMPG, hitData);
 
-	// Update CSG pointer and flags.
-	hit->csgNode = pMPG->pGrid()->pCSGNode();
-	hit->flags |= currentGridInfo.matteFlag;
-
 	// Mark the pixel as containing valid samples, used later for the cacheing and reuse.
 	pie2->markHasValidSamples();
 }
@@ -61,8 +61,11 @@ class CqBucketProcessor
 		/** Default constructor */
 		CqBucketProcessor(CqImageBuffer& imageBuf, const SqOptionCache& optCache);
 
-		/** Set the bucket to be processed */
-		void setBucket(CqBucket* bucket);
+		/** Set the bucket to be processed
+		 *
+		 * \param renderIndex - position of the bucket in the rendering order.
+		 */
+		void setBucket(CqBucket* bucket, TqInt renderIndex = 0);
 		/** Get the bucket to be processed */
 		const CqBucket* getBucket() const;
 
@@ -106,6 +109,8 @@ class CqBucketProcessor
 		void	CalculateDofBounds();
 		void	CombineElements();
 		void	FilterBucket();
+		void	FilterNonSeparable(TqInt datasize);
+		void	FilterSeparable(TqInt datasize);
 		void	ExposeBucket();
 
 		void	buildCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg);
@@ -118,6 +123,10 @@ class CqBucketProcessor
 		/** Render any waiting MPs.
 		 */
 		void RenderWaitingMPs();
+		/** Render the quads of a grid which is sampled intact.
+		 */
+		void RenderRasterGrid( const CqRasterGrid& grid );
+		bool touchesSampleRegion( CqBound bound, bool usingDof ) const;
 		void RenderSurface( boost::shared_ptr<CqSurface>& surface);
 		void ImageElement( TqInt iXPos, TqInt iYPos, CqImagePixel*& pie ) const;
 		/** Render a particular micropolygon.
@@ -162,6 +171,29 @@ class CqBucketProcessor
 		/// Vector of precalculated filter weights
 		std::vector<TqFloat>	m_aFilterValues;
 
+		/// Weight of the samples in a subpixel covered by the pixel filter.
+		struct SqFilterTap
+		{
+			TqInt pixelX;       ///< Pixel column, from the left of the filter area.
+			TqInt pixelY;       ///< Pixel row, from the top of the filter area.
+			TqInt sampleIndex;  ///< Sample in the pixel, or subpixel column or row for the separable taps.
+			TqFloat weight;
+		};
+		/// Taps for the subpixels covered by the filter, row by row.
+		std::vector<SqFilterTap> m_filterTaps;
+		/// Whether the filter edge cuts through subpixels.
+		bool	m_filterCutsSubpixels;
+		/// Whether the filter weights are the product of m_filterXTaps and m_filterYTaps.
+		bool	m_filterSeparable;
+		std::vector<SqFilterTap> m_filterXTaps;
+		std::vector<SqFilterTap> m_filterYTaps;
+		/// Filtered sample data and number of samples hit, for each pixel.
+		std::vector<TqFloat>	m_filteredSamples;
+		std::vector<TqInt>	m_filteredCounts;
+		/// Sample rows filtered along x by FilterSeparable().
+		std::vector<TqFloat>	m_filterRows;
+		std::vector<TqInt>	m_filterRowCounts;
+
 		SqMpgSampleInfo m_CurrentMpgSampleInfo;
 
 		CqOcclusionTree m_OcclusionTree;
@@ -179,6 +211,11 @@ class CqBucketProcessor
 		CqChannelBuffer	m_channelBuffer;
 
 		boost::array<CqRegion, SqBucketCacheSegment::last> m_cacheRegions;
+
+		/// MPs taken from the bucket by RenderWaitingMPs().
+		std::vector<CqMicroPolygonPtr> m_waitingMPs;
+		/// Grids taken from the bucket by RenderWaitingMPs().
+		std::vector<CqRasterGridPtr> m_waitingGrids;
 };
 
 
@@ -12,6 +12,7 @@
 //    anything useful
 
 
+#include <algorithm>
 #include <iostream>
 
 #undef DSPY_INTERNAL
@@ -19,6 +20,17 @@
 #include "debugdd.h"
 #include <aqsis/util/logging.h>
 
+namespace {
+
+SqDebugDspyImage g_lastImage;
+
+} // unnamed namespace
+
+const SqDebugDspyImage& DebugDspyLastImage()
+{
+	return g_lastImage;
+}
+
 PtDspyError DebugDspyImageQuery ( PtDspyImageHandle image, PtDspyQueryType type, size_t size, void *data )
 {
 	Aqsis::log() << Aqsis::debug << "Entering DspyImageQuery\n";
@@ -65,6 +77,12 @@ PtDspyError DebugDspyImageOpen ( PtDspyImageHandle *image,
 
 	flagsstuff->flags |= PkDspyFlagsWantsEmptyBuckets;
 
+	SqDebugDspyImage* img = new SqDebugDspyImage();
+	img->width = width;
+	img->height = height;
+	img->entrySize = 0;
+	*image = img;
+
 	return PkDspyErrorNone;
 }
 
@@ -80,7 +98,19 @@ PtDspyError DebugDspyImageData ( PtDspyImageHandle image,
 {
 	Aqsis::log() << Aqsis::debug << "Entering DspyImageData\n";
 
-	// Should do something useful here with the bucket data.
+	SqDebugDspyImage* img = reinterpret_cast<SqDebugDspyImage*>(image);
+	if(img->entrySize == 0)
+	{
+		img->entrySize = entrysize;
+		img->data.assign(img->width*img->height*entrysize, 0);
+	}
+	int rowSize = (xmax_plus_one - xmin)*entrysize;
+	for(int y = ymin; y < ymax_plus_one; ++y)
+	{
+		std::copy(data, data + rowSize,
+				&img->data[(y*img->width + xmin)*entrysize]);
+		data += rowSize;
+	}
 
 	return PkDspyErrorNone;
 }
@@ -90,6 +120,10 @@ PtDspyError DebugDspyImageClose ( PtDspyImageHandle image )
 {
 	Aqsis::log() << Aqsis::debug << "Entering DspyImageClose\n";
 
+	SqDebugDspyImage* img = reinterpret_cast<SqDebugDspyImage*>(image);
+	g_lastImage = *img;
+	delete img;
+
 	return PkDspyErrorNone;
 }
 
@@ -97,7 +131,7 @@ PtDspyError DebugDspyDelayImageClose ( PtDspyImageHandle image )
 {
 	Aqsis::log() << Aqsis::debug << "Entering DspyDelayImageClose\n";
 
-	return PkDspyErrorNone;
+	return DebugDspyImageClose(image);
 }
 
 
@@ -15,8 +15,28 @@
 #ifndef ___debugdd_Loaded___
 #define ___debugdd_Loaded___
 
+#include <vector>
+
 #include <aqsis/ri/ndspy.h>
 
+/// Pixel data received by the debug display for one image.
+struct SqDebugDspyImage
+{
+	int width;
+	int height;
+	/// Size of a pixel in bytes, as given by the first bucket.
+	int entrySize;
+	/// Pixels in row major order.
+	std::vector<unsigned char> data;
+};
+
+/** Get the image most recently closed by the debug display.
+ *
+ * This lets tests look at the output of a render without loading a display
+ * driver.
+ */
+const SqDebugDspyImage& DebugDspyLastImage();
+
 PtDspyError DebugDspyImageQuery ( PtDspyImageHandle image, PtDspyQueryType type, size_t size, void *data );
 PtDspyError DebugDspyImageOpen ( PtDspyImageHandle *image,
                             const char *drivername,
@@ -142,7 +142,7 @@ TqInt CqLinearCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& a
 				TqInt cPatches = SplitToPatch( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_patch );
-				STATS_SETI( GEO_crv_patch_created, STATS_GETI( GEO_crv_patch_created ) + cPatches );
+				STATS_ADDI( GEO_crv_patch_created, cPatches );
 
 				return cPatches;
 			}
@@ -153,7 +153,7 @@ TqInt CqLinearCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& a
 				TqInt cCurves = SplitToCurves( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_crv );
-				STATS_SETI( GEO_crv_crv_created, STATS_GETI( GEO_crv_crv_created ) + cCurves );
+				STATS_ADDI( GEO_crv_crv_created, cCurves );
 
 				return cCurves;
 			}
@@ -0,0 +1,156 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements the classes used for retained objects.
+*/
+
+#include "objectinstance.h"
+
+#include <map>
+
+#include "procedural.h"
+#include "renderer.h"
+#include "stats.h"
+
+namespace Aqsis {
+
+//---------------------------------------------------------------------
+// CqObjectMaster
+
+CqObjectMaster::CqObjectMaster()
+	: m_aSurfaces(),
+	m_aBounds(),
+	m_Bound()
+{}
+
+void CqObjectMaster::AddSurface( const boost::shared_ptr<CqSurface>& pSurface )
+{
+	// Procedurals can't be copied, since they generate their geometry
+	// through the RI when split.
+	if( dynamic_cast<CqProcedural*>( pSurface.get() ) )
+	{
+		Aqsis::log() << warning
+			<< "Procedurals inside object definitions are not supported, ignoring\n";
+		return;
+	}
+	CqBound bound;
+	pSurface->Bound( &bound );
+	m_Bound.Encapsulate( &bound );
+	m_aSurfaces.push_back( pSurface );
+	m_aBounds.push_back( bound );
+}
+
+
+//---------------------------------------------------------------------
+// CqObjectInstance
+
+CqObjectInstance::CqObjectInstance( const boost::shared_ptr<const CqObjectMaster>& pMaster )
+	: CqSurface(),
+	m_pMaster( pMaster ),
+	m_iSurface( -1 ),
+	m_Bound( pMaster->Bound() ),
+	m_matMasterToCurrent()
+{
+	// Place the object in the world, in the same way as the RI does for
+	// newly created primitives.
+	QGetRenderContext()->matSpaceToSpace( "object", "world", NULL,
+			pTransform().get(), pTransform()->Time( 0 ), m_matMasterToCurrent );
+	m_Bound.Transform( m_matMasterToCurrent );
+}
+
+CqObjectInstance::CqObjectInstance( const CqObjectInstance& from, TqInt iSurface )
+	: CqSurface(),
+	m_pMaster( from.m_pMaster ),
+	m_iSurface( iSurface ),
+	m_Bound( iSurface < 0 ? from.m_pMaster->Bound()
+			: from.m_pMaster->SurfaceBound( iSurface ) ),
+	m_matMasterToCurrent( from.m_matMasterToCurrent )
+{
+	from.CloneData( this );
+	m_Bound.Transform( m_matMasterToCurrent );
+}
+
+CqObjectInstance::~CqObjectInstance()
+{}
+
+void CqObjectInstance::Transform( const CqMatrix& matTx, const CqMatrix& /*matITTx*/,
+		const CqMatrix& /*matRTx*/, TqInt /*iTime*/ )
+{
+	m_matMasterToCurrent = matTx * m_matMasterToCurrent;
+	m_Bound.Transform( matTx );
+}
+
+TqInt CqObjectInstance::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
+{
+	const std::vector<boost::shared_ptr<CqSurface> >& masters = m_pMaster->Surfaces();
+	if( m_iSurface < 0 )
+	{
+		// Divide the instance into a part for each master primitive.  The
+		// object space of each primitive is the object space it had inside
+		// the object definition, placed by the instance transformation, so
+		// that is the transformation of its part.  Primitives of an object
+		// mostly share a few transformations, so the combined transformations
+		// are built once for each.
+		std::map<const IqTransform*, CqTransformPtr> combined;
+		for( TqInt i = 0, n = masters.size(); i < n; ++i )
+		{
+			const IqTransform* transMaster = masters[ i ]->pTransform().get();
+			CqTransformPtr& trans = combined[ transMaster ];
+			if( !trans )
+			{
+				const CqMatrix& matMaster = transMaster->matObjectToWorld( transMaster->Time( 0 ) );
+				if( matMaster.fIdentity() )
+					trans = m_pTransform;
+				else
+					trans.reset( new CqTransform( m_pTransform, m_pTransform->Time( 0 ),
+								matMaster, CqTransform::ConcatCurrent() ) );
+			}
+			boost::shared_ptr<CqObjectInstance> pPart( new CqObjectInstance( *this, i ) );
+			pPart->m_pTransform = trans;
+			aSplits.push_back( pPart );
+		}
+		STATS_INC( GEO_ins_split );
+		return masters.size();
+	}
+
+	boost::shared_ptr<CqSurface> pNew( masters[ m_iSurface ]->Clone() );
+	if( !pNew )
+		return 0;
+	CqMatrix matVTx = m_matMasterToCurrent;
+	matVTx[ 3 ][ 0 ] = matVTx[ 3 ][ 1 ] = matVTx[ 3 ][ 2 ] = 0;
+	matVTx[ 0 ][ 3 ] = matVTx[ 1 ][ 3 ] = matVTx[ 2 ][ 3 ] = 0;
+	matVTx[ 3 ][ 3 ] = 1;
+	CqMatrix matNTx = matVTx.Inverse().Transpose();
+	// Copy our attributes and the combined transformation to the new
+	// primitive.
+	pNew->SetSurfaceParameters( *this );
+	pNew->Transform( m_matMasterToCurrent, matNTx, matVTx );
+	pNew->PrepareTrimCurve();
+	aSplits.push_back( pNew );
+	return 1;
+}
+
+CqSurface* CqObjectInstance::Clone() const
+{
+	return new CqObjectInstance( *this, m_iSurface );
+}
+
+} // namespace Aqsis
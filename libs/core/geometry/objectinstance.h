@@ -0,0 +1,162 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares the classes used for retained objects, as created by
+                RiObjectBegin() and placed by RiObjectInstance().
+*/
+
+#ifndef OBJECTINSTANCE_H_INCLUDED
+#define OBJECTINSTANCE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/math/matrix.h>
+#include "bound.h"
+#include "surface.h"
+
+namespace Aqsis {
+
+/** \brief The master geometry of a retained object.
+ *
+ * The primitives created between RiObjectBegin() and RiObjectEnd() are kept
+ * here rather than being posted to the pipeline.  They are stored in the
+ * coordinate system which was current at RiObjectBegin(), and are shared by
+ * every instance of the object.
+ */
+class CqObjectMaster
+{
+	public:
+		CqObjectMaster();
+
+		/// Add a primitive to the object.
+		void	AddSurface( const boost::shared_ptr<CqSurface>& pSurface );
+
+		/// Get the primitives making up the object.
+		const std::vector<boost::shared_ptr<CqSurface> >& Surfaces() const
+		{
+			return m_aSurfaces;
+		}
+		/// Get the bound of the object in its own coordinate system.
+		const CqBound&	Bound() const
+		{
+			return m_Bound;
+		}
+		/// Get the bound of one primitive of the object.
+		const CqBound&	SurfaceBound( TqInt i ) const
+		{
+			return m_aBounds[ i ];
+		}
+
+	private:
+		std::vector<boost::shared_ptr<CqSurface> >	m_aSurfaces;
+		/// Bounds of the primitives in m_aSurfaces.
+		std::vector<CqBound>	m_aBounds;
+		CqBound	m_Bound;
+};
+
+
+/** \brief A placement of a retained object.
+ *
+ * An instance holds only a reference to the master geometry, along with the
+ * transformation and attributes current at RiObjectInstance().  As for
+ * procedurals, no geometry is created until the bound of the instance
+ * reaches a bucket.  Split() then first divides the instance into one part
+ * for each master primitive, each still sharing the master geometry, and a
+ * part places a copy of its primitive only once its own bound reaches a
+ * bucket.  The copies are freed again once they have been diced, so only
+ * the primitives being rendered at any one time are ever copied.
+ *
+ * The attributes of the copies are those of the instance, so attribute
+ * changes inside the object definition have no effect on the rendered
+ * result, as the RenderMan interface requires.
+ */
+class CqObjectInstance : public CqSurface
+{
+	public:
+		CqObjectInstance( const boost::shared_ptr<const CqObjectMaster>& pMaster );
+		virtual ~CqObjectInstance();
+
+		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+		virtual	void	Bound( CqBound* bound ) const
+		{
+			bound->vecMin() = m_Bound.vecMin();
+			bound->vecMax() = m_Bound.vecMax();
+			AdjustBoundForTransformationMotion( bound );
+		}
+		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 );
+		/*  We have no geometry of our own to dice.
+		 */
+		virtual bool	Diceable( const CqMatrix& /*matCtoR*/ )
+		{
+			return false;
+		}
+		virtual CqMicroPolyGridBase* Dice()
+		{
+			return NULL;
+		}
+		virtual bool	IsMotionBlurMatch( CqSurface* /*pSurf*/ )
+		{
+			return false;
+		}
+		virtual CqString strName() const
+		{
+			return "CqObjectInstance";
+		}
+		virtual TqUint	cUniform() const
+		{
+			return 0;
+		}
+		virtual TqUint	cVarying() const
+		{
+			return 0;
+		}
+		virtual TqUint	cVertex() const
+		{
+			return 0;
+		}
+		virtual TqUint	cFaceVarying() const
+		{
+			return 0;
+		}
+		virtual CqSurface* Clone() const;
+
+	private:
+		/// Construct a part of an instance placing only the given master
+		/// primitive, or all of them if iSurface is negative.
+		CqObjectInstance( const CqObjectInstance& from, TqInt iSurface );
+
+		boost::shared_ptr<const CqObjectMaster>	m_pMaster;
+		/// Index of the master primitive placed by this part of an instance,
+		/// or -1 for a whole instance.
+		TqInt	m_iSurface;
+		/// Bound of the instance in its current coordinate system.
+		CqBound	m_Bound;
+		/// Transformation from the object's coordinate system to the current one.
+		CqMatrix	m_matMasterToCurrent;
+};
+
+} // namespace Aqsis
+
+#endif // OBJECTINSTANCE_H_INCLUDED
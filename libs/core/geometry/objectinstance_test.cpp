@@ -0,0 +1,191 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for retained object instances.
+ */
+
+#include "objectinstance.h"
+
+#include <aqsis/ri/ri.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+#include "quadrics.h"
+#include "renderer.h"
+
+using namespace Aqsis;
+
+namespace {
+
+/// Create a sphere in the current coordinate system, in the same way as
+/// RiSphere.
+boost::shared_ptr<CqSurface> makeSphere(TqFloat radius)
+{
+	boost::shared_ptr<CqSphere> sphere(new CqSphere(radius, -radius, radius, 0, 360));
+	sphere->SetDefaultPrimitiveVariables();
+	CqMatrix matOtoW, matNOtoW, matVOtoW;
+	QGetRenderContext()->matSpaceToSpace("object", "world", NULL,
+			sphere->pTransform().get(), 0, matOtoW);
+	QGetRenderContext()->matNSpaceToSpace("object", "world", NULL,
+			sphere->pTransform().get(), 0, matNOtoW);
+	QGetRenderContext()->matVSpaceToSpace("object", "world", NULL,
+			sphere->pTransform().get(), 0, matVOtoW);
+	sphere->Transform(matOtoW, matNOtoW, matVOtoW);
+	return sphere;
+}
+
+/// Make an object of a unit sphere at the origin and a half unit sphere at
+/// x = 5.
+boost::shared_ptr<CqObjectMaster> makeMaster()
+{
+	boost::shared_ptr<CqObjectMaster> master(new CqObjectMaster());
+	RiAttributeBegin();
+	master->AddSurface(makeSphere(1));
+	RiTranslate(5, 0, 0);
+	master->AddSurface(makeSphere(0.5));
+	RiAttributeEnd();
+	return master;
+}
+
+void checkBound(const CqBound& bound, const CqVector3D& min,
+				const CqVector3D& max, TqFloat tol = 0.01)
+{
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		BOOST_CHECK_SMALL(bound.vecMin()[i] - min[i], tol);
+		BOOST_CHECK_SMALL(bound.vecMax()[i] - max[i], tol);
+	}
+}
+
+/// Sets up a world block for a test, and tears it down again.
+struct SqWorldFixture
+{
+	SqWorldFixture()
+	{
+		RiBegin(RI_NULL);
+		RiWorldBegin();
+	}
+	~SqWorldFixture()
+	{
+		RiWorldEnd();
+		RiEnd();
+	}
+};
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_CASE(CqObjectInstance_split_test, SqWorldFixture)
+{
+	boost::shared_ptr<CqObjectMaster> master = makeMaster();
+
+	RiAttributeBegin();
+	RiTranslate(0, 10, 0);
+	boost::shared_ptr<CqObjectInstance> instance(new CqObjectInstance(master));
+	RiAttributeEnd();
+	CqBound bound;
+	instance->Bound(&bound);
+	checkBound(bound, CqVector3D(-1,9,-1), CqVector3D(5.5,11,1));
+	IqTransformPtr instanceTrans = instance->pTransform();
+
+	// Splitting the instance gives a part for each master primitive, without
+	// copying any geometry yet.
+	std::vector<boost::shared_ptr<CqSurface> > parts;
+	BOOST_REQUIRE_EQUAL(instance->Split(parts), 2);
+	BOOST_REQUIRE_EQUAL(parts.size(), 2U);
+	BOOST_CHECK(instance->pTransform() == instanceTrans);
+	for(TqInt i = 0; i < 2; ++i)
+	{
+		BOOST_CHECK_EQUAL(parts[i]->strName(), CqString("CqObjectInstance"));
+		BOOST_CHECK(parts[i]->pAttributes() == instance->pAttributes());
+		BOOST_CHECK_EQUAL(master->Surfaces()[i].use_count(), 1);
+	}
+	parts[0]->Bound(&bound);
+	checkBound(bound, CqVector3D(-1,9,-1), CqVector3D(1,11,1));
+	parts[1]->Bound(&bound);
+	checkBound(bound, CqVector3D(4.5,9.5,-0.5), CqVector3D(5.5,10.5,0.5));
+
+	// Splitting a part places a copy of its primitive, with the attributes of
+	// the instance.
+	std::vector<boost::shared_ptr<CqSurface> > copies;
+	BOOST_REQUIRE_EQUAL(parts[1]->Split(copies), 1);
+	BOOST_REQUIRE_EQUAL(copies.size(), 1U);
+	BOOST_CHECK(copies[0] != master->Surfaces()[1]);
+	BOOST_CHECK(dynamic_cast<CqSphere*>(copies[0].get()));
+	BOOST_CHECK(copies[0]->pAttributes() == instance->pAttributes());
+	copies[0]->Bound(&bound);
+	checkBound(bound, CqVector3D(4.5,9.5,-0.5), CqVector3D(5.5,10.5,0.5));
+
+	// The master primitive is untouched.
+	master->Surfaces()[1]->Bound(&bound);
+	checkBound(bound, CqVector3D(4.5,-0.5,-0.5), CqVector3D(5.5,0.5,0.5));
+
+	// Clones keep the part they were made from.
+	boost::shared_ptr<CqSurface> clone(parts[0]->Clone());
+	clone->Bound(&bound);
+	checkBound(bound, CqVector3D(-1,9,-1), CqVector3D(1,11,1));
+}
+
+BOOST_FIXTURE_TEST_CASE(CqObjectInstance_transform_motion_test, SqWorldFixture)
+{
+	boost::shared_ptr<CqObjectMaster> master = makeMaster();
+
+	// An instance placed by a moving transformation moves with it.
+	RiAttributeBegin();
+	RiMotionBegin(2, 0.0f, 1.0f);
+		RiTranslate(0, 0, 0);
+		RiTranslate(0, 2, 0);
+	RiMotionEnd();
+	boost::shared_ptr<CqObjectInstance> instance(new CqObjectInstance(master));
+	RiAttributeEnd();
+	BOOST_CHECK(instance->pTransform()->cTimes() > 1);
+	CqBound bound;
+	instance->Bound(&bound);
+	checkBound(bound, CqVector3D(-1,-1,-1), CqVector3D(5.5,3,1));
+
+	std::vector<boost::shared_ptr<CqSurface> > parts;
+	BOOST_REQUIRE_EQUAL(instance->Split(parts), 2);
+	parts[1]->Bound(&bound);
+	checkBound(bound, CqVector3D(4.5,-0.5,-0.5), CqVector3D(5.5,2.5,0.5));
+
+	std::vector<boost::shared_ptr<CqSurface> > copies;
+	BOOST_REQUIRE_EQUAL(parts[1]->Split(copies), 1);
+	BOOST_CHECK(copies[0]->pTransform()->cTimes() > 1);
+	copies[0]->Bound(&bound);
+	checkBound(bound, CqVector3D(4.5,-0.5,-0.5), CqVector3D(5.5,2.5,0.5));
+}
+
+BOOST_FIXTURE_TEST_CASE(CqObjectInstance_motion_block_test, SqWorldFixture)
+{
+	// ObjectInstance isn't allowed inside a motion block, and is rejected
+	// there rather than being treated as a deformation key.
+	RtObjectHandle handle = RiObjectBegin();
+	RiSphere(1, -1, 1, 360, RI_NULL);
+	RiObjectEnd();
+	RiMotionBegin(2, 0.0f, 1.0f);
+		RiObjectInstance(handle);
+		RiObjectInstance(handle);
+	RiMotionEnd();
+	BOOST_CHECK(!QGetRenderContext()->pconCurrent()->fMotionBlock());
+	// Instancing outside the motion block still works.
+	RiObjectInstance(handle);
+}
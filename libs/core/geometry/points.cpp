@@ -36,13 +36,10 @@
 #include	"imagebuffer.h"
 #include	"renderer.h"
 #include	"bucketprocessor.h"
+#include	"shaders.h"
 
 namespace Aqsis {
 
-CqObjectPool<CqMovingMicroPolygonKeyPoints>	CqMovingMicroPolygonKeyPoints::m_thePool;
-CqObjectPool<CqMicroPolygonPoints>	CqMicroPolygonPoints::m_thePool;
-CqObjectPool<CqMicroPolygonMotionPoints>	CqMicroPolygonMotionPoints::m_thePool;
-
 class CqPointsKDTreeData::CqPointsKDTreeDataComparator
 {
 	public:
@@ -216,11 +213,11 @@ CqMicroPolyGridBase* CqPoints::Dice()
 	std::vector<CqParameter*>::iterator end = pPoints()->aUserParams().end();
 	std::vector<boost::shared_ptr<IqShader> > shaders;
 	boost::shared_ptr<IqShader> pShader;
-	if(NULL != (pShader = pGrid->pAttributes()->pshadSurface(QGetRenderContext()->Time())))
+	if(NULL != (pShader = threadShaderInstance(pGrid->pAttributes()->pshadSurface(QGetRenderContext()->Time()))))
 		shaders.push_back(pShader);
-	if(NULL != (pShader = pGrid->pAttributes()->pshadDisplacement(QGetRenderContext()->Time())))
+	if(NULL != (pShader = threadShaderInstance(pGrid->pAttributes()->pshadDisplacement(QGetRenderContext()->Time()))))
 		shaders.push_back(pShader);
-	if(NULL != (pShader = pGrid->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time())))
+	if(NULL != (pShader = threadShaderInstance(pGrid->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time()))))
 		shaders.push_back(pShader);
 	
 	for ( iUP = pPoints()->aUserParams().begin(); iUP != end ; iUP++ )
@@ -582,7 +579,7 @@ void CqMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long ymax )
 
 				pNew->AppendKey( Point, radius, keyTimes[iTime] );
 			}
-			boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+			CqMicroPolygonPtr pMP( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pMP );
 		}
 	}
@@ -641,7 +638,7 @@ void CqMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long ymax )
 			CqMicroPolygonPoints* pNew = new CqMicroPolygonPoints(this, iu);
 			pNew->Initialise( radius );
 
-			boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+			CqMicroPolygonPtr pMP( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pMP );
 		}
 	}
@@ -815,7 +812,7 @@ void CqMotionMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long y
 
 			pNew->AppendKey( Point, radius, Time( iTime ) );
 		}
-		boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+		CqMicroPolygonPtr pMP( pNew );
 		QGetRenderContext()->pImage()->AddMPG( pMP );
 	}
 
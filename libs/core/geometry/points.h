@@ -306,6 +306,10 @@ class CqMicroPolyGridPoints : public CqMicroPolyGrid
 		virtual void setDv();
 		virtual void CalcNormals();
 		virtual void CalcSurfaceDerivatives();
+		virtual bool canOcclusionCull() const
+		{
+			return false;
+		}
 };
 
 class CqMotionMicroPolyGridPoints : public CqMotionMicroPolyGrid
@@ -332,20 +336,6 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 		virtual	~CqMicroPolygonPoints()
 		{}
 
-		/** Overridden operator new to allocate micropolys from a pool.
-		    */
-		void* operator new( size_t size )
-		{
-			return( m_thePool.alloc() );
-		}
-
-		/** Overridden operator delete to allocate micropolys from a pool.
-		 */
-		void operator delete( void* p )
-		{
-			m_thePool.free( reinterpret_cast<CqMicroPolygonPoints*>(p) );
-		}
-
 	public:
 		void Initialise( TqFloat radius )
 		{
@@ -357,6 +347,10 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 			m_Bound.vecMin() = pos - CqVector3D(m_radius, m_radius, 0);
 			m_Bound.vecMax() = pos + CqVector3D(m_radius, m_radius, 0);
 		}
+		virtual bool hasSimpleEdgeTest() const
+		{
+			return false;
+		}
 		virtual	bool	Sample( CqHitTestCache& hitTestCache, SqSampleData const& sample, TqFloat& D, CqVector2D& uv, TqFloat time, bool UsingDof = false ) const;
 		virtual void CacheHitTestValues(CqHitTestCache& cache, bool usingDof) const;
 
@@ -366,8 +360,6 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 
 	private:
 		TqFloat	m_radius;
-
-		static	CqObjectPool<CqMicroPolygonPoints>	m_thePool;
 }
 ;
 
@@ -388,18 +380,18 @@ class CqMovingMicroPolygonKeyPoints
 		virtual ~CqMovingMicroPolygonKeyPoints()
 		{}
 
-		/** Overridden operator new to allocate micropolys from a pool.
-		    */
+		/** Overridden operator new to allocate keys from the arena.
+		 */
 		void* operator new( size_t size )
 		{
-			return( m_thePool.alloc() );
+			return( CqArena::alloc( size ) );
 		}
 
-		/** Overridden operator delete to allocate micropolys from a pool.
+		/** Overridden operator delete to return keys to the arena.
 		 */
-		void operator delete( void* p )
+		void operator delete( void* p, size_t size )
 		{
-			m_thePool.free( reinterpret_cast<CqMovingMicroPolygonKeyPoints*>(p) );
+			CqArena::free( p, size );
 		}
 
 	public:
@@ -422,8 +414,6 @@ class CqMovingMicroPolygonKeyPoints
 
 		CqVector3D	m_Point0;
 		TqFloat		m_radius;
-
-		static	CqObjectPool<CqMovingMicroPolygonKeyPoints>	m_thePool;
 }
 ;
 
@@ -446,20 +436,6 @@ class CqMicroPolygonMotionPoints : public CqMicroPolygon
 				delete( (*ikey) );
 		}
 
-		/** Overridden operator new to allocate micropolys from a pool.
-		    */
-		void* operator new( size_t size )
-		{
-			return( m_thePool.alloc() );
-		}
-
-		/** Overridden operator delete to allocate micropolys from a pool.
-		 */
-		void operator delete( void* p )
-		{
-			m_thePool.free( reinterpret_cast<CqMicroPolygonPoints*>(p) );
-		}
-
 	public:
 		void	AppendKey( const CqVector3D& vA, TqFloat radius, TqFloat time );
 		void	DeleteVariables( bool all )
@@ -488,6 +464,10 @@ class CqMicroPolygonMotionPoints : public CqMicroPolygon
 		{
 			return true;
 		}
+		virtual bool hasSimpleEdgeTest() const
+		{
+			return false;
+		}
 		virtual	bool	Sample( CqHitTestCache& hitTestCache, SqSampleData const& sample, TqFloat& D, CqVector2D& uv, TqFloat time, bool UsingDof = false ) const;
 		virtual void CacheHitTestValues(CqHitTestCache& cache, bool usingDof) const;
 		virtual void CacheOutputInterpCoeffs(SqMpgSampleInfo& cache) const;
@@ -498,9 +478,6 @@ class CqMicroPolygonMotionPoints : public CqMicroPolygon
 		bool	m_BoundReady;				///< Flag indicating the boundary has been initialised.
 		std::vector<TqFloat> m_Times;
 		std::vector<CqMovingMicroPolygonKeyPoints*>	m_Keys;
-
-		static	CqObjectPool<CqMicroPolygonMotionPoints>	m_thePool;
-
 };
 
 
@@ -594,6 +594,15 @@ class CqSurfacePointsPolygons : public CqSurface
 			return( false );
 		}
 
+		/** Set the attributes and transformation of the mesh.  The polygons
+		 * split from the mesh take theirs from the points, so those are set too.
+		 */
+		virtual	void	SetSurfaceParameters( const CqSurface& From )
+		{
+			CqSurface::SetSurfaceParameters( From );
+			if( m_pPoints )
+				m_pPoints->SetSurfaceParameters( From );
+		}
 		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 )
 		{
 			assert( m_pPoints );
@@ -35,6 +35,9 @@
 #include <list>
 
 #include <boost/tokenizer.hpp>
+#ifdef ENABLE_THREADING
+#include <boost/thread/recursive_mutex.hpp>
+#endif
 
 #include "renderer.h"
 #include <aqsis/util/file.h>
@@ -43,6 +46,18 @@
 
 namespace Aqsis {
 
+#ifdef ENABLE_THREADING
+namespace {
+
+/// Procedurals are split from the rendering threads, but the subdivide and
+/// free functions go back through the Ri interface, and the standard ones
+/// keep their own state, so only one runs at a time.  A procedural may post
+/// another which is split straight away, so the lock is recursive.
+boost::recursive_mutex g_proceduralMutex;
+
+} // unnamed namespace
+#endif
+
 
 /**
  * CqProcedural constructor.
@@ -72,6 +87,9 @@ CqProcedural::CqProcedural(RtPointer data, CqBound &B, RtProcSubdivFunc subfunc,
 
 TqInt CqProcedural::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
 {
+#ifdef ENABLE_THREADING
+	boost::recursive_mutex::scoped_lock lock(g_proceduralMutex);
+#endif
 	// Store current context, set current context to the stored one
 	boost::shared_ptr<CqModeBlock> pconSave = QGetRenderContext()->pconCurrent( m_pconStored );
 
@@ -118,6 +136,9 @@ void    CqProcedural::Transform( const CqMatrix& matTx, const CqMatrix& matITTx,
  */
 CqProcedural::~CqProcedural()
 {
+#ifdef ENABLE_THREADING
+	boost::recursive_mutex::scoped_lock lock(g_proceduralMutex);
+#endif
 	if( m_pFreeFunc )
 		m_pFreeFunc( m_pData );
 }
@@ -8,6 +8,7 @@ set(geometry_srcs
 	linearcurves.cpp
 	marchingcubes.cpp
 	nurbs.cpp
+	objectinstance.cpp
 	patch.cpp
 	points.cpp
 	polygon.cpp
@@ -30,6 +31,7 @@ set(geometry_hdrs
 	lookuptable.h
 	marchingcubes.h
 	nurbs.h
+	objectinstance.h
 	patch.h
 	points.h
 	polygon.h
@@ -42,5 +44,10 @@ set(geometry_hdrs
 )
 make_absolute(geometry_hdrs ${geometry_SOURCE_DIR})
 
+set(geometry_test_srcs
+	objectinstance_test.cpp
+)
+make_absolute(geometry_test_srcs ${geometry_SOURCE_DIR})
+
 include_directories(${geometry_SOURCE_DIR})
 
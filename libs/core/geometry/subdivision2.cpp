@@ -30,6 +30,7 @@
 
 #include	"patch.h"
 #include	"micropolygon.h"
+#include	"shaders.h"
 #include	<aqsis/math/vectorcast.h>
 
 namespace Aqsis {
@@ -2152,13 +2153,13 @@ void CqSurfaceSubdivisionPatch::StoreDice( CqMicroPolyGrid* pGrid, const boost::
 	{
 		/// \todo: Must transform point/vector/normal/matrix parameter variables from 'object' space to current before setting.
 		boost::shared_ptr<IqShader> pShader;
-		if ( pShader=pGrid->pAttributes() ->pshadSurface(m_Time) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadSurface(m_Time)) )
 			StoreDiceAPVar( pShader, ( *iUP ), iParam, iFVParam, iData );
 
-		if ( pShader=pGrid->pAttributes() ->pshadDisplacement(m_Time) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadDisplacement(m_Time)) )
 			StoreDiceAPVar( pShader, ( *iUP ), iParam, iFVParam, iData );
 
-		if ( pShader=pGrid->pAttributes() ->pshadAtmosphere(m_Time) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadAtmosphere(m_Time)) )
 			StoreDiceAPVar( pShader, ( *iUP ), iParam, iFVParam, iData );
 	}
 }
@@ -377,6 +377,15 @@ class CqSurfaceSubdivisionMesh : public CqSurface
 			return( false );
 		}
 
+		/** Set the attributes and transformation of the mesh.  The patches
+		 * split from the mesh take theirs from the points, so those are set too.
+		 */
+		virtual	void	SetSurfaceParameters( const CqSurface& From )
+		{
+			CqSurface::SetSurfaceParameters( From );
+			if( m_pTopology && m_pTopology->pPoints() )
+				m_pTopology->pPoints()->SetSurfaceParameters( From );
+		}
 		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 )
 		{
 			assert( m_pTopology );
@@ -29,6 +29,7 @@
 #include	"surface.h"
 #include	<aqsis/math/vector2d.h>
 #include	"imagebuffer.h"
+#include	"shaders.h"
 
 namespace Aqsis {
 
@@ -189,9 +190,7 @@ CqSurface::CqSurface()
 
 	STATS_INC( GPR_allocated );
 	STATS_INC( GPR_current );
-	TqInt cGprim = STATS_GETI( GPR_current );
-	TqInt cPeak = STATS_GETI( GPR_peak );
-	STATS_SETI( GPR_peak, cGprim > cPeak ? cGprim : cPeak );
+	STATS_MAXI( GPR_peak, STATS_GETI( GPR_current ) );
 }
 
 
@@ -510,13 +509,13 @@ CqMicroPolyGridBase* CqSurface::Dice()
 	for ( iUP = m_aUserParams.begin(); iUP != end ; iUP++ )
 	{
 		boost::shared_ptr<IqShader> pShader;
-		if ( pShader=pGrid->pAttributes() ->pshadSurface(QGetRenderContext()->Time()) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadSurface(QGetRenderContext()->Time())) )
 			pShader->SetArgument( ( *iUP ), this );
 
-		if ( pShader=pGrid->pAttributes() ->pshadDisplacement(QGetRenderContext()->Time()) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadDisplacement(QGetRenderContext()->Time())) )
 			pShader->SetArgument( ( *iUP ), this );
 
-		if ( pShader=pGrid->pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time()) )
+		if ( pShader=threadShaderInstance(pGrid->pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time())) )
 			pShader->SetArgument( ( *iUP ), this );
 	}
 
@@ -62,17 +62,17 @@ void CqGridSampler::setupGridPattern()
 		m_shuffledIndices[i] = i;
 }
 
-const CqVector2D* CqGridSampler::get2DSamples()		
+const CqVector2D* CqGridSampler::get2DSamples(TqUint /*pattern*/) const		
 {
 	return &m_2dSamples[0];
 }
 
-const TqFloat* CqGridSampler::get1DSamples()		
+const TqFloat* CqGridSampler::get1DSamples(TqUint /*pattern*/) const		
 {
 	return &m_1dSamples[0];
 }
 
-const TqInt* CqGridSampler::getShuffledIndices()		
+const TqInt* CqGridSampler::getShuffledIndices(TqUint /*pattern*/) const		
 {
 	return &m_shuffledIndices[0];
 }
@@ -50,9 +50,9 @@ class CqGridSampler : public IqSampler
 		~CqGridSampler();
 
 		/* Interface functions from IqSampler */
-		virtual const CqVector2D* get2DSamples();		
-		virtual const TqFloat* get1DSamples();	
-		virtual const TqInt* getShuffledIndices();
+		virtual const CqVector2D* get2DSamples(TqUint pattern) const;		
+		virtual const TqFloat* get1DSamples(TqUint pattern) const;	
+		virtual const TqInt* getShuffledIndices(TqUint pattern) const;
 
 	private:
 		TqInt numSamples() const;
@@ -0,0 +1,113 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the four-wide micropolygon hit test
+ */
+
+#include "micropolygon.h"
+
+#include <cstdlib>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace Aqsis;
+
+#ifdef AQSIS_SIMD_SSE2
+
+namespace {
+
+float rand01()
+{
+	return std::rand()/float(RAND_MAX);
+}
+
+/// The scalar bound, occlusion and edge tests from RenderMPG_Static().
+bool scalarHit(const CqHitTestCache& cache, const CqBound& bound, bool cullable,
+		const SqSampleData& sample, bool& inBound)
+{
+	inBound = bound.Contains2D(sample.position)
+		&& !(cullable && bound.vecMin().z() > sample.occlZ);
+	if(!inBound)
+		return false;
+	TqFloat x = sample.position.x(), y = sample.position.y();
+	for(int e = 0; e < 4; ++e)
+	{
+		TqFloat side = ((y - cache.m_Y[e]) * cache.m_YMultiplier[e])
+			- ((x - cache.m_X[e]) * cache.m_XMultiplier[e]);
+		if((e & 2) ? side < 0 : side <= 0)
+			return false;
+	}
+	return true;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqHitTest4_matches_scalar_test)
+{
+	std::srand(1);
+	SqSampleData samples[4];
+	int numHits = 0;
+	for(int quad = 0; quad < 2000; ++quad)
+	{
+		CqVector3D P[4];
+		for(int i = 0; i < 4; ++i)
+			P[i] = CqVector3D(4*rand01(), 4*rand01(), rand01());
+		CqHitTestCache cache;
+		for(int i = 0, j = 3; i < 4; j = i++)
+		{
+			cache.m_YMultiplier[i] = P[i].x() - P[j].x();
+			cache.m_XMultiplier[i] = P[i].y() - P[j].y();
+			cache.m_X[i] = P[j].x();
+			cache.m_Y[i] = P[j].y();
+		}
+		CqBound bound(CqVector3D(0.5f, 0.5f, 0.2f), CqVector3D(3.5f, 3.5f, 1));
+		bool cullable = quad & 1;
+		CqHitTest4 hitTest(cache, bound, cullable);
+		for(int k = 0; k < 50; ++k)
+		{
+			int count = 1 + std::rand() % 4;
+			for(int i = 0; i < 4; ++i)
+			{
+				// Include samples exactly on the vertices and edges.
+				samples[i].position = (k % 5 == 0)
+					? CqVector2D(P[i].x(), P[i].y())
+					: CqVector2D(4*rand01(), 4*rand01());
+				samples[i].occlZ = rand01();
+			}
+			int inBound = 0;
+			int hits = hitTest.contains(samples, count, inBound);
+			for(int i = 0; i < count; ++i)
+			{
+				bool expectInBound = false;
+				bool expectHit = scalarHit(cache, bound, cullable, samples[i],
+						expectInBound);
+				BOOST_CHECK_EQUAL(bool(inBound & (1 << i)), expectInBound);
+				BOOST_CHECK_EQUAL(bool(hits & (1 << i)), expectHit);
+				numHits += expectHit;
+			}
+			BOOST_CHECK_EQUAL(inBound >> count, 0);
+		}
+	}
+	BOOST_CHECK(numHits > 0);
+}
+
+#endif // AQSIS_SIMD_SSE2
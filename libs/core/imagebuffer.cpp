@@ -29,15 +29,21 @@
 #include    <windows.h>
 #endif
 #include	<math.h>
+#include	<algorithm>
+#include	<deque>
+#include	<map>
+#ifdef	ENABLE_THREADING
+#include	<boost/thread/tss.hpp>
+#endif
 
 #include	<aqsis/math/math.h>
+#include	<aqsis/util/threadscheduler.h>
 #include	"stats.h"
 #include	"options.h"
 #include	"renderer.h"
 #include	"surface.h"
 #include	"micropolygon.h"
 #include	"bucketprocessor.h"
-#include	"threadscheduler.h"
 #include	"multijitter.h"
 #include	"grid.h"
 
@@ -45,115 +51,247 @@
 namespace Aqsis {
 
 static TqInt bucketmodulo = -1;
-//static TqInt bucketdirection = -1;
 
-#define MULTIPROCESSING_NBUCKETS 1
-/** Implementing a work unit for a boost::thread (the operator()()
- * method), that is, a piece of code that will run in parallel.
+#ifdef	ENABLE_THREADING
+namespace {
+
+/// Holder for the bucket being rendered by each thread.
+boost::thread_specific_ptr<const CqBucket*> g_threadBucket;
+
+/// Record the bucket being rendered by the calling thread.
+void setThreadBucket(const CqBucket* bucket)
+{
+	if(!g_threadBucket.get())
+		g_threadBucket.reset(new const CqBucket*(0));
+	*g_threadBucket = bucket;
+}
+
+/// Get the bucket being rendered by the calling thread, or null if none.
+const CqBucket* threadBucket()
+{
+	return g_threadBucket.get() ? *g_threadBucket : 0;
+}
+
+} // unnamed namespace
+#endif
+
+namespace {
+
+/** Get the region of buckets touched by a surface, clamped to the given
+ * region of buckets.
+ *
+ * If the surface has been marked as undiceable by the eyeplane check, then we
+ * cannot get a valid bucket index from it as the projection of the bound would
+ * cross the camera plane and therefore give a false result, so it's taken to
+ * touch every bucket.
  */
-class CqThreadProcessor
+CqRegion bucketsTouched(const CqSurface& surface, const CqBound& rasterBound,
+		const CqRegion& buckets, const SqOptionCache& optCache)
+{
+	if(surface.IsUndiceable())
+		return buckets;
+	TqInt XMinb = static_cast<TqInt>( rasterBound.vecMin().x() ) / optCache.xBucketSize;
+	TqInt YMinb = static_cast<TqInt>( rasterBound.vecMin().y() ) / optCache.yBucketSize;
+	TqInt XMaxb = static_cast<TqInt>( rasterBound.vecMax().x() ) / optCache.xBucketSize;
+	TqInt YMaxb = static_cast<TqInt>( rasterBound.vecMax().y() ) / optCache.yBucketSize;
+	return CqRegion(
+		clamp( XMinb, buckets.xMin(), buckets.xMax()-1 ),
+		clamp( YMinb, buckets.yMin(), buckets.yMax()-1 ),
+		clamp( XMaxb, buckets.xMin(), buckets.xMax()-1 ) + 1,
+		clamp( YMaxb, buckets.yMin(), buckets.yMax()-1 ) + 1 );
+}
+
+/// Predicate for the surfaces which touch a given bucket.
+class CqTouchesBucket
+{
+	public:
+		CqTouchesBucket(const CqBucket& bucket, const CqRegion& buckets,
+				const SqOptionCache& optCache)
+			: m_col(bucket.getCol()),
+			m_row(bucket.getRow()),
+			m_buckets(buckets),
+			m_optCache(optCache)
+		{}
+		bool operator()(const boost::shared_ptr<CqSurface>& surface) const
+		{
+			const CqRegion touched = bucketsTouched(*surface,
+					surface->GetCachedRasterBound(), m_buckets, m_optCache);
+			return m_col >= touched.xMin() && m_col < touched.xMax()
+				&& m_row >= touched.yMin() && m_row < touched.yMax();
+		}
+	private:
+		TqInt m_col;
+		TqInt m_row;
+		const CqRegion& m_buckets;
+		const SqOptionCache& m_optCache;
+};
+
+/** Predicate for the surfaces which may send micropolygons or split surfaces
+ * to a given bucket.
+ *
+ * This is wider than CqTouchesBucket, since micropolygons are also sent to
+ * the buckets which they only touch through the filter width.
+ */
+class CqMayReachBucket
+{
+	public:
+		CqMayReachBucket(const CqBucket& bucket, const CqRegion& buckets,
+				const SqOptionCache& optCache)
+			: m_col(bucket.getCol()),
+			m_row(bucket.getRow()),
+			m_buckets(buckets),
+			m_optCache(optCache)
+		{}
+		bool operator()(const boost::shared_ptr<CqSurface>& surface) const
+		{
+			CqBound bound = surface->GetCachedRasterBound();
+			const CqVector3D filterRadius(lfloor(m_optCache.xFiltSize / 2.0f),
+					lfloor(m_optCache.yFiltSize / 2.0f), 0);
+			bound.vecMin() -= filterRadius;
+			bound.vecMax() += filterRadius;
+			const CqRegion touched = bucketsTouched(*surface, bound,
+					m_buckets, m_optCache);
+			return m_col >= touched.xMin() && m_col < touched.xMax()
+				&& m_row >= touched.yMin() && m_row < touched.yMax();
+		}
+	private:
+		TqInt m_col;
+		TqInt m_row;
+		const CqRegion& m_buckets;
+		const SqOptionCache& m_optCache;
+};
+
+} // unnamed namespace
+
+/** \brief Queue of bucket processors which have finished a piece of work.
+ *
+ * Worker threads push their bucket processor onto the queue once the bucket
+ * has been rendered or filtered; the main thread pops them off to decide what
+ * happens to each bucket next while the workers carry on with other buckets.
+ */
+class CqFinishedBucketQueue
 {
 public:
-	CqThreadProcessor(CqBucketProcessor* bucketProcessor) :
-		m_bucketProcessor(bucketProcessor) { }
-	void operator()()
+	CqFinishedBucketQueue() : m_failed(false) {}
+	/// Add a processor which has finished its work.
+	void push(CqBucketProcessor* processor, bool failed = false)
 	{
-		// printf("%p > start\n", m_bucketProcessor);
-		m_bucketProcessor->process();
-		// printf("%p < stop\n", m_bucketProcessor);
+#ifdef	ENABLE_THREADING
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		m_processors.push_back(processor);
+		m_failed |= failed;
+#ifdef	ENABLE_THREADING
+		m_bucketFinished.notify_one();
+#endif
+	}
+	/// Remove the oldest finished processor, waiting for one if necessary.
+	CqBucketProcessor* pop()
+	{
+#ifdef	ENABLE_THREADING
+		boost::mutex::scoped_lock lock(m_mutex);
+		while(m_processors.empty())
+			m_bucketFinished.wait(lock);
+#endif
+		assert(!m_processors.empty());
+		CqBucketProcessor* processor = m_processors.front();
+		m_processors.pop_front();
+		return processor;
+	}
+	/** Check whether any work unit has thrown.  The exception itself is
+	 * rethrown by CqThreadScheduler::joinAll().
+	 */
+	bool failed()
+	{
+#ifdef	ENABLE_THREADING
+		boost::mutex::scoped_lock lock(m_mutex);
+#endif
+		return m_failed;
 	}
 
 private:
-	CqBucketProcessor* m_bucketProcessor;
+	std::deque<CqBucketProcessor*> m_processors;
+	bool m_failed;
+#ifdef	ENABLE_THREADING
+	boost::mutex m_mutex;
+	boost::condition m_bucketFinished;
+#endif
 };
 
 
-/* mafm: implementation of a processor (work unit for a boost::thread)
- * where it takes buckets ready to process and does so continuously.
- * One simple addition would be to wait for new available buckets
- * which are provided dynamically.  This is not applicable at the
- * moment though, it would need RenderSurfaces() to process all of the
- * surfaces of the buckets before assigning them as ready; but at the
- * moment RenderSurfaces() can't run before assigning the bucket to
- * the bucket processor, and it doesn't seem possible to break this
- * interdependency.
+/// Stage reached by a bucket in flight.
+enum EqBucketStage
+{
+	Stage_Rendering,	///< Waiting for or being rendered in the pool.
+	Stage_Rendered,		///< Rendered, but more work may still arrive.
+	Stage_Filtering		///< Complete, waiting for or being filtered.
+};
+
+/// Results of a filtered bucket waiting to be sent to the display.
+struct SqFilteredBucket
+{
+	CqRegion displayRegion;
+	CqChannelBuffer channelBuffer;
+};
 
-boost::mutex displayMutex;
 
-class CqThreadProcessor2
+/** Implementing a work unit for the thread scheduler (the operator()()
+ * method), that is, a piece of code that will run in parallel.
+ *
+ * The unit either renders the processor's bucket, or filters it once it's
+ * complete.
+ */
+class CqThreadProcessor
 {
 public:
-	CqThreadProcessor2(const CqImageBuffer* imageBuffer,
-			   std::vector<CqBucket*>& bucketList,
-			   bool fImager,
-			   const CqColor& zThreshold,
-			   EqDepthFilter depthfilter,
-			   const CqVector2D& bHalf) :
-		m_imageBuffer(imageBuffer),
-		m_bucketList(bucketList),
-		m_fImager(fImager),
-		m_zThreshold(zThreshold),
-		m_depthfilter(depthfilter),
-		m_bHalf(bHalf) { }
-
+	CqThreadProcessor(CqBucketProcessor* bucketProcessor,
+			CqFinishedBucketQueue& finishedQueue, bool filter = false) :
+		m_bucketProcessor(bucketProcessor),
+		m_finishedQueue(&finishedQueue),
+		m_filter(filter) { }
 	void operator()()
 	{
-		while ( !m_bucketList.empty() )
+		try
 		{
-			CqBucket* bucket = m_bucketList.front();
-			m_bucketList.erase( m_bucketList.begin() );
-
-			m_bucketProcessor.setBucket( bucket );
-			if ( m_fImager )
-				m_bucketProcessor.setInitiallyEmpty(false);
-			
-			// Set up some bounds for the bucket.
-			const CqVector2D bPos = m_imageBuffer->BucketPosition( bucket->getCol(),
-									       bucket->getRow() );
-			const CqVector2D bSize = m_imageBuffer->BucketSize( bucket->getCol(),
-									    bucket->getRow() );
-			const CqVector2D vecMin = bPos - m_bHalf;
-			const CqVector2D vecMax = bPos + bSize + m_bHalf;
-
-			TqInt xmin = static_cast<TqInt>( vecMin.x() );
-			TqInt ymin = static_cast<TqInt>( vecMin.y() );
-			TqInt xmax = static_cast<TqInt>( vecMax.x() );
-			TqInt ymax = static_cast<TqInt>( vecMax.y() );
-			if ( xmin < m_imageBuffer->CropWindowXMin() - m_imageBuffer->FilterXWidth() / 2 )
-				xmin = static_cast<TqInt>(m_imageBuffer->CropWindowXMin() - m_imageBuffer->FilterXWidth() / 2.0f);
-			if ( ymin < m_imageBuffer->CropWindowYMin() - m_imageBuffer->FilterYWidth() / 2 )
-				ymin = static_cast<TqInt>(m_imageBuffer->CropWindowYMin() - m_imageBuffer->FilterYWidth() / 2.0f);
-			if ( xmax > m_imageBuffer->CropWindowXMax() + m_imageBuffer->FilterXWidth() / 2 )
-				xmax = static_cast<TqInt>(m_imageBuffer->CropWindowXMax() + m_imageBuffer->FilterXWidth() / 2.0f);
-			if ( ymax > m_imageBuffer->CropWindowYMax() + m_imageBuffer->FilterYWidth() / 2 )
-				ymax = static_cast<TqInt>(m_imageBuffer->CropWindowYMax() + m_imageBuffer->FilterYWidth() / 2.0f);
-
-			m_bucketProcessor.preProcess( bPos, bSize,
-						      m_imageBuffer->PixelXSamples(), m_imageBuffer->PixelYSamples(), m_imageBuffer->FilterXWidth(), m_imageBuffer->FilterYWidth(),
-						      xmin, xmax, ymin, ymax,
-						      m_imageBuffer->ClippingNear(), m_imageBuffer->ClippingFar() );
-			m_bucketProcessor.process();
-			m_bucketProcessor.postProcess( m_fImager, m_depthfilter, m_zThreshold );
-			{
-				TIME_SCOPE("Display bucket");
-				boost::mutex::scoped_lock lock(displayMutex);
-				QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucket );
-			}
-			m_bucketProcessor.reset();
+			if(m_filter)
+				m_bucketProcessor->postProcess();
+			else
+				render();
+		}
+		catch(...)
+		{
+			// Hand the processor back anyway, so the main thread isn't left
+			// waiting for it.
+			m_finishedQueue->push(m_bucketProcessor, true);
+			throw;
 		}
+		m_finishedQueue->push(m_bucketProcessor);
 	}
 
 private:
-	CqBucketProcessor m_bucketProcessor;
-	const CqImageBuffer* m_imageBuffer;
-	std::vector<CqBucket*> m_bucketList;
-	bool m_fImager;
-	CqColor m_zThreshold;
-	EqDepthFilter m_depthfilter;
-	CqVector2D m_bHalf;
-};
+	void render()
+	{
+#ifdef	ENABLE_THREADING
+		setThreadBucket(m_bucketProcessor->getBucket());
+#endif
+#ifdef	USE_TIMERS
+		double begin = CqProfiler::now();
+#endif
+		m_bucketProcessor->process();
+#ifdef	USE_TIMERS
+		const CqBucket* bucket = m_bucketProcessor->getBucket();
+		CqProfiler::addBucketSpan(begin, CqProfiler::now(),
+				bucket->getCol(), bucket->getRow());
+#endif
+#ifdef	ENABLE_THREADING
+		setThreadBucket(0);
+#endif
+	}
 
-*/
+	CqBucketProcessor* m_bucketProcessor;
+	CqFinishedBucketQueue* m_finishedQueue;
+	bool m_filter;
+};
 
 
 //----------------------------------------------------------------------
@@ -223,6 +361,38 @@ void	CqImageBuffer::SetImage()
 		rowPos += m_optCache.yBucketSize;
 	}
 
+	// Plan the order of the buckets.  This has to be known before any
+	// surfaces are posted, since each surface goes to the first bucket it
+	// touches in the order.
+	m_bucketOrder.reset();
+	if(const CqString* orderName = opts.GetStringOption("render", "bucketorder"))
+	{
+		m_bucketOrder = CqBucketOrder::create(orderName[0]);
+		if(!m_bucketOrder)
+			Aqsis::log() << warning << "Unknown bucket order \"" << orderName[0]
+				<< "\", using \"horizontal\"" << std::endl;
+	}
+	if(!m_bucketOrder)
+		m_bucketOrder = CqBucketOrder::create("horizontal");
+	m_bucketPlan.clear();
+	m_bucketOrder->plan(m_bucketRegion, m_bucketPlan);
+	assert(static_cast<TqInt>(m_bucketPlan.size()) == m_bucketRegion.area());
+	// Buckets which haven't been started by a dynamic order come after all
+	// those which have.
+	TqInt firstIndex = m_bucketOrder->isDynamic() ? m_bucketRegion.area() : 0;
+	for(TqInt i = 0, end = m_bucketPlan.size(); i < end; ++i)
+		Bucket(m_bucketPlan[i].col, m_bucketPlan[i].row).setRenderIndex(firstIndex + i);
+	m_nextPlanned = 0;
+	TqWaitingBuckets(CqStartsBefore(m_bucketOrder.get())).swap(m_waitingBuckets);
+	m_waitingPos.clear();
+	m_changedBuckets.clear();
+	if(m_bucketOrder->isDynamic())
+	{
+		for(TqInt i = 0, end = m_bucketPlan.size(); i < end; ++i)
+			m_waitingPos.push_back(m_waitingBuckets.insert(
+						SqWaitingBucket(SqBucketLoad(), i)).first);
+	}
+
 	m_CurrentBucketCol = m_bucketRegion.xMin();
 	m_CurrentBucketRow = m_bucketRegion.yMin();
 }
@@ -396,90 +566,139 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 		return ;
 	}
 
-	// If the primitive has been marked as undiceable by the eyeplane check, then we cannot get a valid
-	// bucket index from it as the projection of the bound would cross the camera plane and therefore give a false
-	// result, so just put it back in the current bucket for further splitting.
-	TqInt XMinb = 0;
-	TqInt YMinb = 0;
-	TqInt XMaxb = 0;
-	TqInt YMaxb = 0;
-	if (! pSurface->IsUndiceable() )
-	{
-		XMinb = static_cast<TqInt>( Bound.vecMin().x() ) / m_optCache.xBucketSize;
-		YMinb = static_cast<TqInt>( Bound.vecMin().y() ) / m_optCache.yBucketSize;
-		XMaxb = static_cast<TqInt>( Bound.vecMax().x() ) / m_optCache.xBucketSize;
-		YMaxb = static_cast<TqInt>( Bound.vecMax().y() ) / m_optCache.yBucketSize;
-	}
-	XMinb = clamp( XMinb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
-	YMinb = clamp( YMinb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
-	XMaxb = clamp( XMaxb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
-	YMaxb = clamp( YMaxb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
-
-	// Sanity check we are not putting into a bucket that has already been processed.
-	CqBucket* bucket = &Bucket( XMinb, YMinb );
-	if ( bucket->IsProcessed() )
-	{
-		// Scan over the buckets that the bound touches, looking for the first one that isn't processed.
-		TqInt yb = YMinb;
-		TqInt xb = XMinb + 1;
-		bool done = false;
-		while(!done && yb <= YMaxb)
+#ifdef	ENABLE_THREADING
+	boost::shared_lock<boost::shared_mutex> lock(m_postMutex, boost::defer_lock);
+	if ( m_bucketOrder->isDynamic() )
+		lock.lock();
+#endif
+	const CqRegion touched = bucketsTouched( *pSurface, Bound,
+			m_bucketRegion, m_optCache );
+	if ( CqBucket* bucket = firstOpenBucket( touched, 0 ) )
+	{
+		bucket->AddGPrim( pSurface, touched );
+		loadChanged( *bucket );
+	}
+}
+
+
+CqBucket* CqImageBuffer::firstOpenBucket( const CqRegion& touched,
+		const CqBucket* exclude )
+{
+	// Buckets are rendered in order of their render index, so look for the
+	// lowest one which may still receive the surface.
+	CqBucket* first = 0;
+	TqInt firstIndex = 0;
+	for ( TqInt yb = touched.yMin(); yb < touched.yMax(); ++yb )
+	{
+		for ( TqInt xb = touched.xMin(); xb < touched.xMax(); ++xb )
 		{
-			while(!done && xb <= XMaxb)
+			CqBucket& bucket = Bucket( xb, yb );
+			if ( &bucket == exclude || isBucketClosed( bucket ) )
+				continue;
+			TqInt index = bucket.renderIndex();
+			if ( !first || index < firstIndex )
 			{
-				CqBucket& availBucket = Bucket(xb, yb);
-				if(!availBucket.IsProcessed())
-				{
-					availBucket.AddGPrim(pSurface);
-					done = true;
-				}
-				++xb;
+				first = &bucket;
+				firstIndex = index;
 			}
-			xb = XMinb;
-			++yb;
 		}
 	}
-	else
+	return first;
+}
+
+
+void CqImageBuffer::gatherSurfaces( CqBucket& bucket )
+{
+	// A surface touching the bucket is held by the first open bucket it
+	// touches in the render order, so only the waiting buckets planned
+	// before this one need to be searched, and only those which have held a
+	// surface reaching this bucket.  The buckets which have been started are
+	// never searched: they come before this one in the render order.
+	const TqInt plannedIndex = bucket.renderIndex() - m_bucketRegion.area();
+	const TqInt col = bucket.getCol();
+	const TqInt row = bucket.getRow();
+	std::vector<boost::shared_ptr<CqSurface> > surfaces;
+	CqTouchesBucket touchesBucket( bucket, m_bucketRegion, m_optCache );
+	for ( TqWaitingBuckets::const_iterator i = m_waitingBuckets.begin();
+			i != m_waitingBuckets.end(); ++i )
 	{
-		bucket->AddGPrim( pSurface );
+		if ( i->planIndex > plannedIndex )
+			continue;
+		const SqBucketPos& pos = m_bucketPlan[i->planIndex];
+		CqBucket& other = Bucket( pos.col, pos.row );
+		const CqRegion reach = other.surfaceReach();
+		if ( col < reach.xMin() || col >= reach.xMax()
+			|| row < reach.yMin() || row >= reach.yMax() )
+			continue;
+		const TqInt numSurfaces = surfaces.size();
+		other.takeSurfacesIf( touchesBucket, surfaces );
+		if ( static_cast<TqInt>(surfaces.size()) > numSurfaces )
+			loadChanged( other );
+	}
+	for ( std::vector<boost::shared_ptr<CqSurface> >::const_iterator
+			i = surfaces.begin(); i != surfaces.end(); ++i )
+	{
+		bucket.AddGPrim( *i, bucketsTouched( **i, (*i)->GetCachedRasterBound(),
+					m_bucketRegion, m_optCache ) );
 	}
 }
 
 
+void CqImageBuffer::loadChanged( CqBucket& bucket )
+{
+	if ( !m_bucketOrder->isDynamic() || !bucket.setLoadChanged() )
+		return;
+#ifdef	ENABLE_THREADING
+	boost::mutex::scoped_lock lock(m_changedMutex);
+#endif
+	m_changedBuckets.push_back( &bucket );
+}
+
+
+bool CqImageBuffer::isBucketClosed(const CqBucket& bucket) const
+{
+	if ( bucket.IsProcessed() )
+		return true;
+#ifdef	ENABLE_THREADING
+	// Several buckets are rendered at once, but what ends up in each one
+	// must not depend on which thread gets there first.  A bucket which comes
+	// before the calling thread's bucket in the render order would already
+	// be finished in a serial render, so it's treated as closed.
+	const CqBucket* current = threadBucket();
+	if ( current && current != &bucket && bucket.IsInProgress()
+		&& bucket.renderIndex() < current->renderIndex() )
+		return true;
+#endif
+	return false;
+}
+
+
+bool CqImageBuffer::mayPostTo( const CqBucket& from, const CqBucket& to ) const
+{
+	return from.anySurface( CqMayReachBucket( to, m_bucketRegion, m_optCache ) );
+}
+
+
 void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
                                   const boost::shared_ptr<CqSurface>& surface)
 {
 	const CqBound rasterBound = surface->GetCachedRasterBound();
 
-	bool wasPosted = false;
 	// Surface is behind everying in this bucket but it may be visible in other
-	// buckets it overlaps.
-	//
-	// First look in bucket to the right
-	TqInt nextBucketX = oldBucket.getCol() + 1;
-	TqInt nextBucketY = oldBucket.getRow();
-	TqInt xpos = oldBucket.getXPosition() + oldBucket.getXSize();
-	if ( nextBucketX < m_bucketRegion.xMax() && rasterBound.vecMax().x() >= xpos )
+	// buckets it overlaps, so pass it on to the next of them in the render
+	// order.
+#ifdef	ENABLE_THREADING
+	boost::shared_lock<boost::shared_mutex> lock(m_postMutex, boost::defer_lock);
+	if ( m_bucketOrder->isDynamic() )
+		lock.lock();
+#endif
+	const CqRegion touched = bucketsTouched( *surface, rasterBound,
+			m_bucketRegion, m_optCache );
+	CqBucket* nextBucket = firstOpenBucket( touched, &oldBucket );
+	if ( nextBucket )
 	{
-		Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-		wasPosted = true;
-	}
-	else
-	{
-		// next row
-		++nextBucketY;
-		// find bucket containing left side of bound
-		nextBucketX = max<TqInt>(m_bucketRegion.xMin(),
-				lfloor(rasterBound.vecMin().x())/m_optCache.xBucketSize);
-		TqInt ypos = oldBucket.getYPosition() + oldBucket.getYSize();
-
-		if ( ( nextBucketX < m_bucketRegion.xMax() ) &&
-			( nextBucketY  < m_bucketRegion.yMax() ) &&
-			( rasterBound.vecMax().y() >= ypos ) )
-		{
-			Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-			wasPosted = true;
-		}
+		nextBucket->AddGPrim( surface, touched );
+		loadChanged( *nextBucket );
 	}
 
 #ifdef DEBUG
@@ -490,13 +709,13 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 	if(const CqString* name = surface->pAttributes()
 			->GetStringAttribute("identifier", "name"))
 		objName = name[0];
-	if(wasPosted)
+	if(nextBucket)
 	{
 		Aqsis::log() << info << "GPrim: \"" << objName
 			<< "\" occluded in bucket: "
 			<< oldBucket.getCol() << ", " << oldBucket.getRow()
 			<< " shifted into bucket: "
-			<< nextBucketX << ", " << nextBucketY << "\n";
+			<< nextBucket->getCol() << ", " << nextBucket->getRow() << "\n";
 	}
 	else
 	{
@@ -507,14 +726,18 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 }
 
 //----------------------------------------------------------------------
-/** Add a new micro polygon to the list of waiting ones.
- * \param pmpgNew Pointer to a CqMicroPolygon derived class.
+/** Find the range of buckets touched by the raster bound of a micropolygon
+ * or grid, expanded by depth of field and the filter width.
+ *
+ * \param B - tight raster bound.
+ * \param xMin, yMin, xMax, yMax - returns the inclusive range of buckets.
+ * \return False if no buckets are touched.
  */
 
-void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
+bool CqImageBuffer::bucketRange( CqBound B, TqInt& xMin, TqInt& yMin,
+		TqInt& xMax, TqInt& yMax ) const
 {
 	CqRenderer* renderContext = QGetRenderContext();
-	CqBound B = pmpgNew->GetBound();
 
 	// Expand the micropolygon bound for DoF if necessary.
 	if(renderContext->UsingDepthOfField())
@@ -535,17 +758,9 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	     B.vecMin().x() > renderContext->cropWindowXMax() + m_optCache.xFiltSize / 2.0f ||
 	     B.vecMin().y() > renderContext->cropWindowYMax() + m_optCache.yFiltSize / 2.0f )
 	{
-		return;
+		return false;
 	}
 
-	////////// Dump the micro polygon into a dump file //////////
-#if ENABLE_MPDUMP
-	if(m_mpdump.IsOpen())
-		m_mpdump.dump(*pmpgNew);
-#endif
-	/////////////////////////////////////////////////////////////
-
-
 	// Find out the minimum bucket touched by the micropoly bound.
 
 	B.vecMin().x( B.vecMin().x() - (lfloor(m_optCache.xFiltSize / 2.0f)) );
@@ -561,7 +776,7 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	if ( ( iXBb < m_bucketRegion.xMin() ) || ( iYBb < m_bucketRegion.yMin() ) ||
 	        ( iXBa >= m_bucketRegion.xMax() ) || ( iYBa >= m_bucketRegion.yMax() ) )
 	{
-		return ;
+		return false;
 	}
 
 	// Use sane values -- otherwise sometimes crashes, probably
@@ -571,6 +786,31 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	if ( iXBb >= m_bucketRegion.xMax() )  iXBb = m_bucketRegion.xMax() - 1;
 	if ( iYBb >= m_bucketRegion.yMax() )  iYBb = m_bucketRegion.yMax() - 1;
 
+	xMin = iXBa;
+	yMin = iYBa;
+	xMax = iXBb;
+	yMax = iYBb;
+	return true;
+}
+
+//----------------------------------------------------------------------
+/** Add a new micro polygon to the list of waiting ones.
+ * \param pmpgNew Pointer to a CqMicroPolygon derived class.
+ */
+
+void CqImageBuffer::AddMPG( CqMicroPolygonPtr& pmpgNew )
+{
+	TqInt iXBa, iYBa, iXBb, iYBb;
+	if ( !bucketRange( pmpgNew->GetBound(), iXBa, iYBa, iXBb, iYBb ) )
+		return;
+
+	////////// Dump the micro polygon into a dump file //////////
+#if ENABLE_MPDUMP
+	if(m_mpdump.IsOpen())
+		m_mpdump.dump(*pmpgNew);
+#endif
+	/////////////////////////////////////////////////////////////
+
 	// Add the MP to all the Buckets that it touches
 	for ( TqInt i = iXBa; i <= iXBb; i++ )
 	{
@@ -582,9 +822,56 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 			// previous bucket, and not in a subsequent one. When it gets processed in the later bucket
 			// the MPGs can leak into the previous one, shouldn't be a problem, as the occlusion culling 
 			// means the MPGs shouldn't be rendered in that bucket anyway.
-			if ( !bucket->IsProcessed() )
+			if ( !isBucketClosed(*bucket) )
 			{
 				bucket->AddMP( pmpgNew );
+				loadChanged( *bucket );
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/** Add a grid which is sampled intact to the buckets which it touches.
+ * \param grid Grid holding the quads to be sampled.
+ */
+
+void CqImageBuffer::AddRasterGrid( CqRasterGridPtr& grid )
+{
+	if ( grid->numQuads() == 0 )
+		return;
+	TqInt iXBa, iYBa, iXBb, iYBb;
+	if ( !bucketRange( grid->GetBound(), iXBa, iYBa, iXBb, iYBb ) )
+		return;
+
+#if ENABLE_MPDUMP
+	if(m_mpdump.IsOpen())
+	{
+		CqRasterGridQuad quad( *grid );
+		TqInt cu = grid->uGridRes();
+		for ( TqInt iv = 0; iv < grid->vGridRes(); iv++ )
+		{
+			for ( TqInt index = iv * ( cu + 1 ); index < iv * ( cu + 1 ) + cu; index++ )
+			{
+				if ( !grid->isSampled( index ) )
+					continue;
+				quad.setQuad( index, grid->quadBound( index ) );
+				m_mpdump.dump( quad );
+			}
+		}
+	}
+#endif
+
+	for ( TqInt i = iXBa; i <= iXBb; i++ )
+	{
+		for ( TqInt j = iYBa; j <= iYBb; j++ )
+		{
+			CqBucket* bucket = &Bucket( i, j );
+			// As for micropolygons, closed buckets are skipped.
+			if ( !isBucketClosed(*bucket) )
+			{
+				bucket->AddRasterGrid( grid );
+				loadChanged( *bucket );
 			}
 		}
 	}
@@ -594,8 +881,8 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 //----------------------------------------------------------------------
 /** Render any waiting Surfaces
  
-    Starting from the upper left corner of the image every bucket is
-    processed by computing its extent and calling RenderSurfaces().
+    Every bucket is processed by computing its extent and calling
+    RenderSurfaces(), in the order given by the bucket order.
     After the image is complete ImageComplete() is called.
  
     It will be nice to be able to remove Occlusion at demands.
@@ -635,62 +922,29 @@ void CqImageBuffer::RenderImage()
 	RtProgressFunc pProgressHandler = NULL;
 	pProgressHandler = QGetRenderContext()->pProgressHandler();
 
-	const CqString* pstrBucketOrder = QGetRenderContext() ->poptCurrent()->GetStringOption( "render", "bucketorder" );
-	enum EqBucketOrder order = Bucket_Horizontal;
-	if ( NULL != pstrBucketOrder )
-	{
-	if( !pstrBucketOrder[ 0 ].compare( "vertical" ) )
-		order = Bucket_Vertical;
-	else if ( !pstrBucketOrder[ 0 ].compare( "horizontal" ) )
-		order = Bucket_Horizontal;
-	else {
-		Aqsis::log() << warning << "Not supported \"" << pstrBucketOrder[ 0 ] << "\" " << std::endl;
-	}
-#ifdef NOTREADY
-	else if ( !pstrBucketOrder[ 0 ].compare( "zigzag" ) )
-		order = Bucket_ZigZag;
-	else if ( !pstrBucketOrder[ 0 ].compare( "circle" ) )
-		order = Bucket_Circle;
-	else if ( !pstrBucketOrder[ 0 ].compare( "random" ) )
-		order = Bucket_Random;
-#endif
-	}
-
-	// A counter for the number of processed buckets (used for progress reporting)
-	TqInt iBucket = 0;
-
-	std::vector<boost::shared_ptr<CqBucketProcessor> > bucketProcessors;
+	// Number of buckets to render concurrently; by default one per hardware
+	// thread.
 	TqInt numConcurrentBuckets = 1;
-
-/* mafm: Sample code to use with the CqThreadProcessor2 alternative
- * approach.
-
-	std::vector<std::vector<CqBucket*> > bucketLists;
-	bucketLists.resize(MULTIPROCESSING_NBUCKETS);
-	int index = 0;
-	do
-	{
-		bucketLists[index % MULTIPROCESSING_NBUCKETS].push_back( &(CurrentBucket()) );
-		++index;
-	} while ( NextBucket(order) );
-	boost::thread_group threadGroup;
-	for (int i = 0; i < MULTIPROCESSING_NBUCKETS; ++i)
+#ifdef		ENABLE_THREADING
+	numConcurrentBuckets = CqThreadScheduler::hardwareThreads();
+	if(const TqInt* threads = QGetRenderContext()->poptCurrent()->
+			GetIntegerOption("limits", "threads"))
 	{
-		threadGroup.create_thread( CqThreadProcessor2(this, bucketLists[i], fImager, zThreshold, depthfilter, bHalf) );
+		if(threads[0] > 0)
+			numConcurrentBuckets = threads[0];
 	}
-	threadGroup.join_all();
-	return;
-*/
-
-#ifdef		ENABLE_THREADING
-	numConcurrentBuckets = MULTIPROCESSING_NBUCKETS;
 #endif
 
-	for(int i = 0; i < numConcurrentBuckets; ++i)
-	{
-		bucketProcessors.push_back(boost::shared_ptr<CqBucketProcessor>(
-					new CqBucketProcessor(*this, m_optCache)));
-	}
+	// Processors are created while others are rendering, so the sample size
+	// shared by all the pixels is fixed before any are set up.
+	SqImageSample::sampleSize = QGetRenderContext() ->GetOutputDataTotalSize();
+
+	// A bucket may have to wait after rendering until nothing more can be
+	// sent to it, so allow some more buckets than threads in flight to keep
+	// the threads busy meanwhile.
+	TqInt maxProcessors = numConcurrentBuckets > 1 ? 2*numConcurrentBuckets : 1;
+	std::vector<boost::shared_ptr<CqBucketProcessor> > bucketProcessors;
+	std::vector<CqBucketProcessor*> idleProcessors;
 	CqMultiJitteredSampler jitteredSampler(m_optCache.xSamps, m_optCache.ySamps);
 	CqGridSampler gridSampler(m_optCache.xSamps, m_optCache.ySamps);
 
@@ -703,67 +957,186 @@ void CqImageBuffer::RenderImage()
 			sampler = &gridSampler;
 	}
 
+	// An imager shader keeps state while it runs, so buckets are filtered
+	// one at a time on this thread when there is one.
+	const bool filterInPool = !QGetRenderContext()->poptCurrent()->pshadImager();
+
+	// Buckets flow continuously through the thread pool.  Whenever a worker
+	// finishes rendering a bucket, the processor comes back to this thread,
+	// which sends the bucket off again to be filtered as soon as no other
+	// bucket can add anything more to it.  Once filtered, the results are
+	// copied out and the processor is given the next bucket straight away;
+	// only sending the results to the display happens in bucket order.
+	// The finished queue must outlive the scheduler, since the workers push
+	// onto it.
+	CqFinishedBucketQueue finishedQueue;
+	CqThreadScheduler threadScheduler(numConcurrentBuckets);
+	// Processors with a bucket in flight, in render order.
+	std::deque<CqBucketProcessor*> inFlight;
+	// What each processor in flight is doing.
+	std::map<CqBucketProcessor*, EqBucketStage> stages;
+	// Filtered buckets waiting for their turn to be displayed, by render
+	// index.
+	std::map<TqInt, SqFilteredBucket> filteredBuckets;
+	TqInt renderIndex = 0;
+	TqInt displayIndex = 0;
+
 	// Iterate over all buckets...
 	bool pendingBuckets = true;
-	while ( pendingBuckets && !m_fQuit )
+	while ( (pendingBuckets || !inFlight.empty()) && !m_fQuit )
 	{
-		CqThreadScheduler threadScheduler(numConcurrentBuckets);
-		std::vector<CqThreadProcessor> threadProcessors;
-
-		for (int i = 0; pendingBuckets && i < numConcurrentBuckets; ++i)
+		while ( pendingBuckets && !m_fQuit && ( !idleProcessors.empty()
+				|| static_cast<TqInt>(bucketProcessors.size()) < maxProcessors ) )
 		{
-			bucketProcessors[i]->setBucket(&CurrentBucket());
+			// Advance to next bucket, quit if nothing left.  The bucket is
+			// only chosen once it can be started, so that dynamic orders
+			// see the work waiting at that point.
+			pendingBuckets = NextBucket();
+			if ( !pendingBuckets )
+				break;
+
+			if ( idleProcessors.empty() )
+			{
+				bucketProcessors.push_back(boost::shared_ptr<CqBucketProcessor>(
+							new CqBucketProcessor(*this, m_optCache)));
+				idleProcessors.push_back(bucketProcessors.back().get());
+			}
+			CqBucketProcessor* bucketProcessor = idleProcessors.back();
+			idleProcessors.pop_back();
+			{
+				// Once the bucket is in progress, filtered neighbours leave
+				// its cache segments alone.
+#ifdef	ENABLE_THREADING
+				boost::mutex::scoped_lock cacheLock(m_cacheSegmentMutex);
+#endif
+				if ( m_bucketOrder->isDynamic() )
+				{
+					// Nothing may be posted to the other waiting buckets
+					// while the surfaces for this one are being gathered.
+#ifdef	ENABLE_THREADING
+					boost::unique_lock<boost::shared_mutex> lock(m_postMutex);
+#endif
+					gatherSurfaces(CurrentBucket());
+					bucketProcessor->setBucket(&CurrentBucket(), renderIndex++);
+				}
+				else
+					bucketProcessor->setBucket(&CurrentBucket(), renderIndex++);
+			}
 
 			// Prepare the bucket processor
-			bucketProcessors[i]->preProcess(sampler);
+			bucketProcessor->preProcess(sampler);
 
 #if ENABLE_MPDUMP
 			// Dump the pixel sample positions into a dump file
 			if(m_mpdump.IsOpen())
-				m_mpdump.dumpPixelSamples(*bucketProcessors[i]);
+				m_mpdump.dumpPixelSamples(*bucketProcessor);
 #endif
 
-			// Kick off a thread to process this bucket.
-			threadProcessors.push_back( CqThreadProcessor( bucketProcessors[i].get() ) );
-			threadScheduler.addWorkUnit( threadProcessors.back() );
-
-			// Advance to next bucket, quit if nothing left
-			iBucket += 1;
-			pendingBuckets = NextBucket(order);
+			// Hand the bucket over to the thread pool.
+			inFlight.push_back(bucketProcessor);
+			stages[bucketProcessor] = Stage_Rendering;
+			threadScheduler.addWorkUnit( CqThreadProcessor( bucketProcessor, finishedQueue ) );
 		}
 
-		// Wait for all current buckets to complete before allocating more to the available threads.
-		threadScheduler.joinAll();
-		threadProcessors.clear();
+		if ( inFlight.empty() )
+			break;
 
-		for (int i = 0; !m_fQuit && i < numConcurrentBuckets; ++i)
+		// Wait for any bucket to finish rendering or filtering.
+		CqBucketProcessor* finished = finishedQueue.pop();
+		if ( m_fQuit || finishedQueue.failed() )
+			break;
+
+		if ( stages[finished] == Stage_Filtering )
 		{
-			bucketProcessors[i]->postProcess();
+			// Copy out the results and release the processor.
+			SqFilteredBucket& filtered = filteredBuckets[finished->getBucket()->renderIndex()];
+			filtered.displayRegion = finished->DisplayRegion();
+			filtered.channelBuffer = finished->getChannelBuffer();
+			inFlight.erase(std::find(inFlight.begin(), inFlight.end(), finished));
+			stages.erase(finished);
+			finished->reset();
+			idleProcessors.push_back(finished);
+		}
+		else
+			stages[finished] = Stage_Rendered;
+
+		// Look for rendered buckets which are complete.  Only the buckets
+		// before a bucket in the render order can send it more work, and
+		// only while they have surfaces touching it.  Those buckets are
+		// checked in render order: anything which moves on to a later one
+		// comes from a surface which was still in an earlier one when that
+		// was checked.
+		std::vector<const CqBucket*> earlierBuckets;
+		for ( std::deque<CqBucketProcessor*>::iterator i = inFlight.begin();
+				i != inFlight.end(); ++i )
+		{
+			CqBucketProcessor* bucketProcessor = *i;
+			const CqBucket* bucket = bucketProcessor->getBucket();
+			EqBucketStage& stage = stages[bucketProcessor];
+			if ( stage == Stage_Rendered )
 			{
-				AQSIS_TIME_SCOPE(Display_bucket);
-				const CqBucket* bucket = bucketProcessors[i]->getBucket();
-				if (bucket)
+				bool complete = true;
+				for ( std::vector<const CqBucket*>::const_iterator earlier
+						= earlierBuckets.begin(); complete
+						&& earlier != earlierBuckets.end(); ++earlier )
+					complete = !mayPostTo( **earlier, *bucket );
+				// Work which arrived while the bucket was rendering is picked
+				// up straight away.  Otherwise the bucket is filtered once
+				// nothing more can arrive; it must be complete before
+				// checking for work, since the last of it may still be on
+				// the way.
+				if ( complete && !bucket->hasPendingSurfaces() && !bucket->hasPendingMPs() )
+				{
+					stage = Stage_Filtering;
+					if ( filterInPool )
+						threadScheduler.addWorkUnit( CqThreadProcessor(
+									bucketProcessor, finishedQueue, true ) );
+					else
+					{
+						bucketProcessor->postProcess();
+						finishedQueue.push(bucketProcessor);
+					}
+				}
+				else if ( bucket->hasPendingSurfaces() || bucket->hasPendingMPs() )
 				{
-					QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucketProcessors[i]->DisplayRegion(), &(bucketProcessors[i]->getChannelBuffer()) );
+					stage = Stage_Rendering;
+					threadScheduler.addWorkUnit( CqThreadProcessor( bucketProcessor, finishedQueue ) );
 				}
 			}
-			bucketProcessors[i]->reset();
+			if ( stage != Stage_Filtering )
+				earlierBuckets.push_back(bucket);
+		}
+
+		// Send the filtered buckets to the display in render order.
+		for ( std::map<TqInt, SqFilteredBucket>::iterator next = filteredBuckets.begin();
+				next != filteredBuckets.end() && next->first == displayIndex;
+				next = filteredBuckets.begin() )
+		{
+			{
+				AQSIS_TIME_SCOPE(Display_bucket);
+				QGetRenderContext() ->pDDmanager() ->DisplayBucket( next->second.displayRegion, &next->second.channelBuffer );
+			}
+			filteredBuckets.erase(next);
+			++displayIndex;
 
 			if ( pProgressHandler )
 			{
 				// Inform the status class how far we have got, and update UI.
-				float Complete = (100.0f * iBucket) / static_cast<float> ( m_bucketRegion.area() );
+				float Complete = (100.0f * displayIndex) / static_cast<float> ( m_bucketRegion.area() );
 				QGetRenderContext() ->Stats().SetComplete( Complete );
 				( *pProgressHandler ) ( Complete, QGetRenderContext() ->CurrentFrame() );
 			}
 
 #ifdef WIN32
-			if ( !( iBucket % bucketmodulo ) )
+			if ( !( displayIndex % bucketmodulo ) )
 				SetProcessWorkingSetSize( GetCurrentProcess(), 0xffffffff, 0xffffffff );
 #endif
 		}
 	}
 
+	// Make sure no worker is still touching the buckets if we quit early.
+	threadScheduler.joinAll();
+
 	// Pass >100 through to progress to allow it to indicate completion.
 	if ( pProgressHandler )
 	{
@@ -788,175 +1161,48 @@ void CqImageBuffer::Quit()
 
   \return True if there is still an unprocessed bucket left, otherwise False.
  */
-bool CqImageBuffer::NextBucket(EqBucketOrder order)
+bool CqImageBuffer::NextBucket()
 {
-	// only deal with horizontal bucket orders for now.
-	m_CurrentBucketCol++;
-
-	if( m_CurrentBucketCol >= m_bucketRegion.xMax() )
+	if( !m_bucketOrder->isDynamic() )
 	{
-		m_CurrentBucketCol = m_bucketRegion.xMin();
-		m_CurrentBucketRow++;
-		if( m_CurrentBucketRow >= m_bucketRegion.yMax() )
+		if( m_nextPlanned >= static_cast<TqInt>(m_bucketPlan.size()) )
 			return false;
+		m_CurrentBucketCol = m_bucketPlan[m_nextPlanned].col;
+		m_CurrentBucketRow = m_bucketPlan[m_nextPlanned].row;
+		++m_nextPlanned;
+		return true;
 	}
 
-	// General bucket orders are not ready for prime time.
-	// WARNING: The code below needs to be adjusted to deal with m_bucketRegion
-#if 0
-	TqInt cnt = 0;
-	TqInt total = m_bucketRegion.area();
-
-	for (TqInt i =0; i < m_cYBuckets - 1 ; i++)
-		for (TqInt j = 0; j < m_cXBuckets - 1; j++)
-			if (Bucket(j, i).IsProcessed() )
-				cnt ++;
-         
-	if ((order != Bucket_Vertical) &&
-	        (order != Bucket_Horizontal) &&
-	        (cnt == total))
-		return false;
-
-	switch (order)
+	// Re-sort the waiting buckets whose load has changed, and start the
+	// first.  Buckets are only started here, so none of the waiting ones can
+	// be started while this is going on.
+	std::vector<CqBucket*> changed;
 	{
-
-		case Bucket_Random :
-		{
-			CqRandom rg;
-			do
-			{
-				m_CurrentBucketCol = (TqInt) rg.RandomFloat(m_cXBuckets);
-				m_CurrentBucketRow = (TqInt) rg.RandomFloat(m_cYBuckets);
-				m_CurrentBucketCol = clamp(m_CurrentBucketCol, 0, m_cXBuckets - 1);
-				m_CurrentBucketRow = clamp(m_CurrentBucketRow, 0, m_cYBuckets - 1);
-			}
-			while ( Bucket(m_CurrentBucketCol, m_CurrentBucketRow).IsProcessed() );
-
-		}
-		break;
-
-		case Bucket_Circle :
-		{
-			static TqInt radius = 0;
-			static float theta = 0.0f;
-
-			if ((m_CurrentBucketCol == m_CurrentBucketRow) &&
-				(m_CurrentBucketRow == 0))
-			{
-				radius = 0;
-				theta = 0.0f;
-			}
-			TqFloat r = (TqFloat) sqrt(static_cast<double>((m_cXBuckets * m_cXBuckets) + (m_cYBuckets * m_cYBuckets))) + 2;
-			TqInt midx = m_cXBuckets/2;
-			TqInt midy = m_cYBuckets/2;
-
-
-			TqFloat delta = 0.01f;
-
-			do
-			{
-				if (radius > r)
-					break;
-				m_CurrentBucketCol = midx + (TqInt) (radius * cos(theta));
-				m_CurrentBucketRow = midy + (TqInt) (radius * sin(theta));
-
-				theta += delta;
-				if (theta > 6.28f)
-				{
-					theta = 0.0f;
-					radius ++;
-				}
-				if (radius > r)
-					break;
-
-				m_CurrentBucketCol = clamp(m_CurrentBucketCol, 0, m_cXBuckets - 1);
-				m_CurrentBucketRow = clamp(m_CurrentBucketRow, 0, m_cYBuckets - 1);
-			}
-			while (Bucket(m_CurrentBucketCol, m_CurrentBucketRow).IsProcessed());
-
-			if (radius > r)
-			{
-				// Maybe a bucket was not done
-				for (TqInt i =0; i < m_cYBuckets - 1 ; i++)
-					for (TqInt j = 0; j < m_cXBuckets - 1; j++)
-						if (!Bucket(j, i).IsProcessed() )
-						{
-							m_CurrentBucketCol = j;
-							m_CurrentBucketRow = i;
-
-						}
-			}
-
-
-		}
-		break;
-
-		case Bucket_ZigZag :
-		{
-
-			if (bucketdirection == 1)
-				m_CurrentBucketCol++;
-			else
-				m_CurrentBucketCol--;
-
-			if((bucketdirection == 1) && ( m_CurrentBucketCol >= m_cXBuckets ))
-			{
-
-				m_CurrentBucketCol = m_cXBuckets-1;
-				m_CurrentBucketRow++;
-				bucketdirection = -1;
-				if( m_CurrentBucketRow >= m_cYBuckets )
-					return( false );
-
-			}
-			else if((bucketdirection == -1) && ( m_CurrentBucketCol < 0 ))
-			{
-
-				m_CurrentBucketCol = 0;
-				m_CurrentBucketRow++;
-				bucketdirection = 1;
-
-				if( m_CurrentBucketRow >= m_cYBuckets )
-					return( false );
-
-			}
-		}
-		break;
-		case Bucket_Vertical :
-		{
-
-			m_CurrentBucketRow++;
-
-			if( m_CurrentBucketRow >= m_cYBuckets )
-			{
-
-				m_CurrentBucketRow = 0;
-				m_CurrentBucketCol++;
-
-				if( m_CurrentBucketCol >= m_cXBuckets )
-					return( false );
-
-			}
-		}
-		break;
-		default:
-		case Bucket_Horizontal :
-		{
-
-			m_CurrentBucketCol++;
-
-			if( m_CurrentBucketCol >= m_bucketRegion.xMax() )
-			{
-				m_CurrentBucketCol = m_bucketRegion.xMin();
-				m_CurrentBucketRow++;
-				if( m_CurrentBucketRow >= m_bucketRegion.yMax() )
-					return( false );
-			}
-		}
-		break;
-	}
+#ifdef	ENABLE_THREADING
+		boost::mutex::scoped_lock lock(m_changedMutex);
 #endif
-	return( true );
+		changed.swap(m_changedBuckets);
+	}
+	const TqInt firstPlanned = m_bucketRegion.area();
+	for( std::vector<CqBucket*>::const_iterator i = changed.begin();
+			i != changed.end(); ++i )
+	{
+		CqBucket& bucket = **i;
+		const SqBucketLoad load = bucket.takeLoad();
+		if( bucket.IsProcessed() || bucket.IsInProgress() )
+			continue;
+		TqWaitingBuckets::iterator& pos = m_waitingPos[bucket.renderIndex() - firstPlanned];
+		const TqInt planIndex = pos->planIndex;
+		m_waitingBuckets.erase(pos);
+		pos = m_waitingBuckets.insert(SqWaitingBucket(load, planIndex)).first;
+	}
+	if( m_waitingBuckets.empty() )
+		return false;
+	const SqBucketPos& next = m_bucketPlan[m_waitingBuckets.begin()->planIndex];
+	m_waitingBuckets.erase(m_waitingBuckets.begin());
+	m_CurrentBucketCol = next.col;
+	m_CurrentBucketRow = next.row;
+	return true;
 }
 
 //---------------------------------------------------------------------
@@ -30,11 +30,19 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<set>
 #include	<vector>
 
+#include	<boost/shared_ptr.hpp>
+#ifdef ENABLE_THREADING
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/shared_mutex.hpp>
+#endif
+
 #include	"surface.h"
 #include	<aqsis/math/vector2d.h>
 #include   	"bucket.h"
+#include	"bucketorder.h"
 #include	"mpdump.h"
 #include	"optioncache.h"
 
@@ -44,16 +52,6 @@ namespace Aqsis {
 class CqMicroPolygon;
 
 
-// Enumeration of the type of rendering order of the buckets (experimental)
-enum EqBucketOrder {
-        Bucket_Horizontal = 0,
-        Bucket_Vertical,
-        Bucket_ZigZag,
-        Bucket_Circle,
-        Bucket_Random
-};
-
-
 //-----------------------------------------------------------------------
 /**
   The main image and related data, also responsible for processing the rendering loop.
@@ -68,10 +66,11 @@ enum EqBucketOrder {
   (note: before calling this method the gprim has to be transformed into camera space!)
   All the gprims that can be culled at this point (i.e. CullSurface() returns true) 
   won't be stored inside the buffer. If a gprim can't be culled it is assigned to
-  the first bucket that touches its bound.
+  the first bucket in the render order that touches its bound.
  
   Once all the gprims are posted to the buffer the image can be rendered by calling
-  RenderImage(). Now all buckets will be processed one after another. 
+  RenderImage(). Now all buckets will be processed one after another, in the
+  order given by the "render" "bucketorder" option (see CqBucketOrder).
  
   \see CqBucket, CqSurface, CqRenderer
  */
@@ -84,11 +83,18 @@ class CqImageBuffer
 				m_cXBuckets( 0 ),
 				m_cYBuckets( 0 ),
 				m_CurrentBucketCol( 0 ),
-				m_CurrentBucketRow( 0 )
+				m_CurrentBucketRow( 0 ),
+				m_bucketOrder(),
+				m_bucketPlan(),
+				m_nextPlanned( 0 ),
+				m_waitingBuckets( CqStartsBefore( 0 ) ),
+				m_waitingPos(),
+				m_changedBuckets()
 		{}
 		~CqImageBuffer();
 
-		void AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew );
+		void AddMPG( CqMicroPolygonPtr& pmpgNew );
+		void AddRasterGrid( CqRasterGridPtr& grid );
 		void PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		/** \brief Repost a previously posted surface into the next unfinished bucket.
 		 *
@@ -122,6 +128,27 @@ class CqImageBuffer
 		 */
 		void	axialNeighbours(CqBucket const& bucket, std::vector<CqBucket*>& neighbours);
 
+		/// Get the bucket at position x,y in the grid.
+		const CqBucket& Bucket( TqInt x, TqInt y ) const
+		{
+			return m_Buckets[y][x];
+		}
+
+		/// Get the cache of commonly used options for the current frame.
+		const SqOptionCache& optCache() const
+		{
+			return m_optCache;
+		}
+#ifdef ENABLE_THREADING
+		/** Get the mutex which must be held while handing cached samples to
+		 * neighbouring buckets, or while starting a bucket.
+		 */
+		boost::mutex& cacheSegmentMutex()
+		{
+			return m_cacheSegmentMutex;
+		}
+#endif
+
 	private:
 		/// Get a pointer to the bucket at position x,y in the grid.
 		CqBucket& Bucket( TqInt x, TqInt y)
@@ -129,6 +156,35 @@ class CqImageBuffer
 			return m_Buckets[y][x];
 		}
 
+		/// A bucket which a dynamic order hasn't started yet.
+		struct SqWaitingBucket
+		{
+			/// Load of the bucket when it was last brought up to date.
+			SqBucketLoad load;
+			/// Position of the bucket in m_bucketPlan.
+			TqInt planIndex;
+
+			SqWaitingBucket(const SqBucketLoad& load, TqInt planIndex)
+				: load(load), planIndex(planIndex) {}
+		};
+		/// Sorts waiting buckets into the order they are to be started.
+		class CqStartsBefore
+		{
+			public:
+				CqStartsBefore(const CqBucketOrder* order) : m_order(order) {}
+				bool operator()(const SqWaitingBucket& a, const SqWaitingBucket& b) const
+				{
+					if(m_order->before(a.load, b.load))
+						return true;
+					if(m_order->before(b.load, a.load))
+						return false;
+					return a.planIndex < b.planIndex;
+				}
+			private:
+				const CqBucketOrder* m_order;
+		};
+		typedef std::set<SqWaitingBucket, CqStartsBefore> TqWaitingBuckets;
+
 		bool	m_fQuit;			///< Set by system if a quit has been requested.
 
 		/** m_bucketRegion defines the set of non-cropped buckets.  The set of
@@ -143,17 +199,93 @@ class CqImageBuffer
 		std::vector<std::vector<CqBucket> >	m_Buckets; ///< Array of bucket storage classes (row/col)
 		TqInt	m_CurrentBucketCol;	///< Column index of the bucket currently being processed.
 		TqInt	m_CurrentBucketRow;	///< Row index of the bucket currently being processed.
+		/// Order in which the buckets are rendered.
+		boost::shared_ptr<CqBucketOrder> m_bucketOrder;
+		/// Buckets in the order planned by m_bucketOrder.
+		std::vector<SqBucketPos> m_bucketPlan;
+		/// Position in m_bucketPlan of the next bucket to render.
+		TqInt	m_nextPlanned;
+		/** Buckets which haven't been started by a dynamic order, sorted
+		 * into the order they will be started if their loads don't change.
+		 */
+		TqWaitingBuckets m_waitingBuckets;
+		/// Position of each waiting bucket in m_waitingBuckets, by plan index.
+		std::vector<TqWaitingBuckets::iterator> m_waitingPos;
+		/// Buckets whose load has changed since m_waitingBuckets was sorted.
+		std::vector<CqBucket*> m_changedBuckets;
+#ifdef ENABLE_THREADING
+		/** Guards the choice of bucket for a surface against surfaces being
+		 * gathered for a new bucket.  Only used with dynamic bucket orders.
+		 */
+		boost::shared_mutex m_postMutex;
+		/// Guards the cache segments of buckets which haven't been started.
+		boost::mutex m_cacheSegmentMutex;
+		/// Guards m_changedBuckets.
+		boost::mutex m_changedMutex;
+#endif
 
 #if ENABLE_MPDUMP
 		CqMPDump	m_mpdump;
 #endif
 
 		bool	CullSurface( CqBound& Bound, const boost::shared_ptr<CqSurface>& pSurface );
+		bool	bucketRange( CqBound B, TqInt& xMin, TqInt& yMin,
+				TqInt& xMax, TqInt& yMax ) const;
+		/** Determine whether a bucket can no longer receive surfaces or
+		 * micropolygons from the calling thread.
+		 *
+		 * This is the case once the bucket has been processed, and also
+		 * when rendering concurrently for buckets which precede the calling
+		 * thread's bucket in the render order.
+		 */
+		bool	isBucketClosed( const CqBucket& bucket ) const;
+		/** Determine whether rendering one bucket may still add surfaces or
+		 * micropolygons to another.
+		 *
+		 * Anything a bucket posts comes from the surfaces waiting in it or
+		 * being rendered from it, and lies inside their bounds, so once none
+		 * of them touch the other bucket (allowing for the filter width)
+		 * nothing more can be sent there.
+		 *
+		 * \param from - bucket being rendered.
+		 * \param to - bucket which may receive work.
+		 */
+		bool	mayPostTo( const CqBucket& from, const CqBucket& to ) const;
+		/** Find the bucket which comes first in the render order out of
+		 * those a surface touches, and which can still receive surfaces.
+		 *
+		 * \param touched - region of buckets touched by the surface.
+		 * \param exclude - a bucket to skip, or null.
+		 *
+		 * \return The bucket, or null if all the buckets are closed.
+		 */
+		CqBucket* firstOpenBucket( const CqRegion& touched,
+				const CqBucket* exclude );
+		/** Record that work has been added to or taken from a bucket, so
+		 * that a dynamic order can bring its load up to date before choosing
+		 * the next bucket.
+		 */
+		void	loadChanged( CqBucket& bucket );
+		/** Collect the surfaces touching a bucket from the buckets which
+		 * haven't been started yet.
+		 *
+		 * A dynamic order may start any bucket, while a surface is only
+		 * held by the first bucket it touches in the planned order.  This
+		 * moves such surfaces into a newly started bucket so that they
+		 * aren't missed there.  This must be called just before the bucket
+		 * is started, while its render index is still the planned one.
+		 *
+		 * \param bucket - bucket which is about to be started.
+		 */
+		void	gatherSurfaces( CqBucket& bucket );
 		void	DeleteImage();
 
 		/** Move to the next bucket to process.
+		 *
+		 * \return True if there is still an unprocessed bucket left,
+		 * otherwise false.
 		 */
-		bool NextBucket(EqBucketOrder order);
+		bool NextBucket();
 
 		/** Get a pointer to the current bucket
 		 */
@@ -0,0 +1,118 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for rendering the image buckets in parallel.
+ */
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <aqsis/ri/ri.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "debugdd.h"
+
+namespace {
+
+/** Render a frame of overlapping translucent spheres which cross many
+ * buckets, and return the pixels.
+ *
+ * The output goes to the in-library debug display, as unquantized rgba.
+ */
+std::vector<unsigned char> renderFrame(RtInt threads, const char* bucketOrder)
+{
+	RiBegin(RI_NULL);
+	RtString debugDisplay = const_cast<char*>("debugdd");
+	RiOption(const_cast<char*>("display"), "string determinismtest",
+			&debugDisplay, RI_NULL);
+	RiOption(const_cast<char*>("limits"), "threads", &threads, RI_NULL);
+	RtInt bucketSize[2] = {8, 8};
+	RiOption(const_cast<char*>("limits"), "bucketsize", bucketSize, RI_NULL);
+	RtString order = const_cast<char*>(bucketOrder);
+	RiOption(const_cast<char*>("render"), "bucketorder", &order, RI_NULL);
+
+	RiDisplay(const_cast<char*>("determinism"),
+			const_cast<char*>("determinismtest"), RI_RGBA, RI_NULL);
+	RiFormat(64, 48, 1);
+	RiPixelSamples(3, 3);
+	RiQuantize(RI_RGBA, 0, 0, 0, 0);
+	RtFloat fov = 40;
+	RiProjection(RI_PERSPECTIVE, RI_FOV, &fov, RI_NULL);
+	RiTranslate(0, 0, 5);
+
+	RiWorldBegin();
+	RtColor opacity = {0.5, 0.5, 0.5};
+	RiOpacity(opacity);
+	for(TqInt i = 0; i < 12; ++i)
+	{
+		RiAttributeBegin();
+		RtColor col = {0.1f*(i%10), 1 - 0.08f*i, 0.5f};
+		RiColor(col);
+		RiTranslate(0.35f*(i%4) - 0.5f, 0.4f*(i/4) - 0.4f, 0.1f*i);
+		RiRotate(30.0f*i, 1, 1, 0);
+		RiSphere(0.6f, -0.6f, 0.6f, 360);
+		RiAttributeEnd();
+	}
+	RiWorldEnd();
+	RiEnd();
+
+	const SqDebugDspyImage& img = DebugDspyLastImage();
+	BOOST_REQUIRE_EQUAL(img.width, 64);
+	BOOST_REQUIRE_EQUAL(img.height, 48);
+	BOOST_REQUIRE_EQUAL(img.entrySize, 4*4);
+	return img.data;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqImageBuffer_threaded_render_deterministic_test)
+{
+	// With several threads the buckets are rendered and filtered in a
+	// different order on every run, which mustn't change any pixel.
+	const char* orders[] = {"horizontal", "vertical", "zigzag", "spiral",
+		"hilbert", "random", "memory"};
+	for(TqInt i = 0; i < 7; ++i)
+	{
+		BOOST_TEST_CHECKPOINT("bucket order " << orders[i]);
+		std::vector<unsigned char> reference = renderFrame(1, orders[i]);
+
+		// Make sure the scene covers many buckets, so the test means
+		// something.
+		TqInt coveredPixels = 0;
+		for(TqInt j = 0, n = reference.size()/16; j < n; ++j)
+		{
+			if(reinterpret_cast<const float*>(&reference[16*j])[3] > 0)
+				++coveredPixels;
+		}
+		BOOST_CHECK_GT(coveredPixels, 64*48/4);
+
+		for(RtInt threads = 2; threads <= 8; threads *= 2)
+		{
+			BOOST_TEST_CHECKPOINT("bucket order " << orders[i]
+					<< " with " << threads << " threads");
+			std::vector<unsigned char> pixels = renderFrame(threads, orders[i]);
+			BOOST_CHECK(pixels == reference);
+		}
+	}
+}
@@ -49,19 +49,19 @@ CqImagePixel::CqImagePixel(TqInt xSamples, TqInt ySamples)
 		m_YSamples(ySamples),
 		m_samples(new SqSampleData[xSamples*ySamples]),
 		m_hitSamples(),
+		m_occludingFlags(new TqUint[xSamples*ySamples]),
 		m_DofOffsetIndices(new TqInt[xSamples*ySamples]),
 		m_refCount(0),
-		m_hasValidSamples(false)
+		m_hasValidSamples(false),
+		m_hasDeepHits(false)
 {
 	assert(xSamples > 0);
 	assert(ySamples > 0);
 
 	TqInt nSamples = numSamples();
 	// Allocate sample storage for all the occluding hits.
-	TqInt sampSize = SqImageSample::sampleSize;
-	m_hitSamples.resize(nSamples*sampSize);
-	for(TqInt i = 0; i < nSamples; ++i)
-		m_samples[i].occludingHit.index = i*sampSize;
+	m_hitSamples.resize(nSamples*SqImageSample::sampleSize);
+	std::fill(m_occludingFlags.get(), m_occludingFlags.get() + nSamples, 0);
 }
 
 void CqImagePixel::swap(CqImagePixel& other)
@@ -70,9 +70,11 @@ void CqImagePixel::swap(CqImagePixel& other)
 	assert(m_YSamples == other.m_YSamples);
 
 	m_hitSamples.swap(other.m_hitSamples);
+	m_occludingFlags.swap(other.m_occludingFlags);
 	m_samples.swap(other.m_samples);
 	m_DofOffsetIndices.swap(other.m_DofOffsetIndices);
 	m_hasValidSamples = other.m_hasValidSamples;
+	std::swap(m_hasDeepHits, other.m_hasDeepHits);
 }
 
 void CqImagePixel::setupGridPattern(CqVector2D& offset, TqFloat opentime,
@@ -105,20 +107,18 @@ void CqImagePixel::setupGridPattern(CqVector2D& offset, TqFloat opentime,
 void CqImagePixel::clear()
 {
 	TqInt nSamples = numSamples();
-	TqInt sampSize = SqImageSample::sampleSize;
-	m_hitSamples.resize(nSamples*sampSize);
+	// Drop the deep hit data, keeping the occluding hits at the start.
+	m_hitSamples.resize(nSamples*SqImageSample::sampleSize);
 	m_hasValidSamples = false;
+	std::fill(m_occludingFlags.get(), m_occludingFlags.get() + nSamples, 0);
 	for(TqInt i = 0; i < nSamples; ++i)
 	{
-		if(!m_samples[i].data.empty())
+		if(m_hasDeepHits)
 			m_samples[i].data.clear();
-		m_samples[i].occludingHit.flags = 0;
-		// Reallocate the occluding samples, as their storage indices may have
-		// changed during the Combine() stage.
-		m_samples[i].occludingHit.index = i*sampSize;
 		// Reset the occluding depth to the maximum.
 		m_samples[i].occlZ = FLT_MAX;
 	}
+	m_hasDeepHits = false;
 }
 
 
@@ -143,191 +143,194 @@ class CqAscendingDepthSort
 
 void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 {
-	TqUint samplecount = 0;
-	TqInt sampleIndex = 0;
 	TqInt nSamples = numSamples();
 	for(TqInt sampIdx = 0; sampIdx < nSamples; ++sampIdx)
 	{
-		SqSampleData& sampleData = m_samples[sampIdx];
-
-		SqImageSample& occlHit = sampleData.occludingHit;
-		sampleIndex++;
-
-		if(!sampleData.data.empty())
+		// Pixels with only opaque hits never look at the deep hit lists.
+		if(m_hasDeepHits && !m_samples[sampIdx].data.empty())
+		{
+			combineDeepHits(sampIdx, depthfilter, zThreshold);
+			continue;
+		}
+		TqUint flags = m_occludingFlags[sampIdx];
+		if (flags & SqImageSample::Flag_Valid)
 		{
-			if (occlHit.flags & SqImageSample::Flag_Valid)
+			TqFloat* occlData = occludingHitData(sampIdx);
+			if(flags & SqImageSample::Flag_Matte)
+			{
+				// Opaque matte objects are fully transparent black; need
+				// to set the hit data to reflect this.
+				occlData[Sample_Red] = 0;
+				occlData[Sample_Green] = 0;
+				occlData[Sample_Blue] = 0;
+				occlData[Sample_ORed] = 0;
+				occlData[Sample_OGreen] = 0;
+				occlData[Sample_OBlue] = 0;
+			}
+			if(depthfilter == Filter_MidPoint)
 			{
-				//	insert occlHit into samples if it holds valid data.
-				sampleData.data.push_back(occlHit);
+				// For midpoint depth filters, average the occluding depth
+				// and the depth of the opaque sample.  The occluding depth
+				// represents one surface *behind* the opaque depth in this
+				// case.
+				occlData[Sample_Depth] = 0.5*(occlData[Sample_Depth]
+				                              + m_samples[sampIdx].occlZ);
 			}
-			// Sort the samples by depth.
-			std::sort(sampleData.data.begin(), sampleData.data.end(), CqAscendingDepthSort(*this));
+		}
+	}
+}
+
+void CqImagePixel::combineDeepHits( TqInt index, EqDepthFilter depthfilter,
+		const CqColor& zThreshold )
+{
+	SqSampleData& sampleData = m_samples[index];
+	TqUint& occlFlags = m_occludingFlags[index];
+
+	if (occlFlags & SqImageSample::Flag_Valid)
+	{
+		//	insert the occluding hit into samples if it holds valid data.
+		SqImageSample occlHit;
+		occlHit.index = index*SqImageSample::sampleSize;
+		occlHit.flags = occlFlags;
+		sampleData.data.push_back(occlHit);
+	}
+	// Sort the samples by depth.
+	std::sort(sampleData.data.begin(), sampleData.data.end(), CqAscendingDepthSort(*this));
 
-			// Find out if any of the samples are in a CSG tree.
-			bool bProcessed;
-			bool CqCSGRequired = CqCSGTreeNode::IsRequired();
-			if (CqCSGRequired)
+	// Find out if any of the samples are in a CSG tree.
+	bool bProcessed;
+	bool CqCSGRequired = CqCSGTreeNode::IsRequired();
+	if (CqCSGRequired)
+	{
+		do
+		{
+			bProcessed = false;
+			//Warning ProcessTree add or remove elements in samples list
+			//We could not optimized the for loop here at all.
+			for ( std::vector<SqImageSample>::iterator isample = sampleData.data.begin();
+			        isample != sampleData.data.end();
+			        ++isample )
 			{
-				do
+				if ( isample->csgNode )
 				{
-					bProcessed = false;
-					//Warning ProcessTree add or remove elements in samples list
-					//We could not optimized the for loop here at all.
-					for ( std::vector<SqImageSample>::iterator isample = sampleData.data.begin();
-					        isample != sampleData.data.end();
-					        ++isample )
-					{
-						if ( isample->csgNode )
-						{
-							isample->csgNode->ProcessTree( sampleData.data );
-							bProcessed = true;
-							break;
-						}
-					}
+					isample->csgNode->ProcessTree( sampleData.data );
+					bProcessed = true;
+					break;
 				}
-				while ( bProcessed );
 			}
+		}
+		while ( bProcessed );
+	}
+
+	CqColor samplecolor;
+	CqColor sampleopacity;
+	TqFloat opaqueDepths[2] = { sampleData.occlZ, FLT_MAX };
+	TqFloat maxOpaqueDepth = FLT_MAX;
+
+	for ( std::vector<SqImageSample>::reverse_iterator sample = sampleData.data.rbegin();
+	        sample != sampleData.data.rend();
+	        sample++ )
+	{
+		TqFloat* sample_data = sampleHitData(*sample);
+		if ( sample->flags & SqImageSample::Flag_Matte )
+		{
+			samplecolor = CqColor(
+				lerp( sample_data[Sample_ORed], samplecolor.r(), 0.0f ),
+				lerp( sample_data[Sample_OGreen], samplecolor.g(), 0.0f ),
+				lerp( sample_data[Sample_OBlue], samplecolor.b(), 0.0f )
+			);
+			sampleopacity = CqColor(
+				lerp( sample_data[Sample_Red], sampleopacity.r(), 0.0f ),
+				lerp( sample_data[Sample_Green], sampleopacity.g(), 0.0f ),
+				lerp( sample_data[Sample_Blue], sampleopacity.b(), 0.0f )
+			);
+		}
+		else
+		{
+			samplecolor = ( samplecolor *
+			                ( gColWhite - CqColor(clamp(sample_data[Sample_ORed], 0.0f, 1.0f), clamp(sample_data[Sample_OGreen], 0.0f, 1.0f), clamp(sample_data[Sample_OBlue], 0.0f, 1.0f)) ) ) +
+			              CqColor(sample_data[Sample_Red], sample_data[Sample_Green], sample_data[Sample_Blue]);
+			sampleopacity = ( ( gColWhite - sampleopacity ) *
+			                  CqColor(sample_data[Sample_ORed], sample_data[Sample_OGreen], sample_data[Sample_OBlue]) ) +
+			                sampleopacity;
+		}
 
-			CqColor samplecolor;
-			CqColor sampleopacity;
-			bool samplehit = false;
-			TqFloat opaqueDepths[2] = { sampleData.occlZ, FLT_MAX };
-			TqFloat maxOpaqueDepth = FLT_MAX;
+		// Now determine if the sample opacity meets the limit for
+		// depth mapping.  If so, store the depth in the appropriate
+		// nearest opaque sample slot.  The test is, if all channels of
+		// the opacity color are greater or equal to the threshold.
+		if(   sample_data[Sample_ORed]   >= zThreshold.r()
+		   && sample_data[Sample_OGreen] >= zThreshold.g()
+		   && sample_data[Sample_OBlue]  >= zThreshold.b())
+		{
+			// Make sure we store the nearest and second nearest depth values.
+			opaqueDepths[1] = opaqueDepths[0];
+			opaqueDepths[0] = sample_data[Sample_Depth];
+			// Store the max opaque depth too, if not already stored.
+			if(!(maxOpaqueDepth < FLT_MAX))
+				maxOpaqueDepth = sample_data[Sample_Depth];
+		}
+	}
 
-			for ( std::vector<SqImageSample>::reverse_iterator sample = sampleData.data.rbegin();
-			        sample != sampleData.data.rend();
-			        sample++ )
+	// Write the collapsed color values back into the occluding entry.
+	if ( !sampleData.data.empty() )
+	{
+		// The collapsed values are written into the top entry first, so
+		// that the extra sample data from the top entry is kept.
+		const SqImageSample& topHit = *sampleData.data.begin();
+		TqFloat* topData = sampleHitData(topHit);
+		// Set the color and opacity.
+		topData[Sample_Red] = samplecolor.r();
+		topData[Sample_Green] = samplecolor.g();
+		topData[Sample_Blue] = samplecolor.b();
+		topData[Sample_ORed] = sampleopacity.r();
+		topData[Sample_OGreen] = sampleopacity.g();
+		topData[Sample_OBlue] = sampleopacity.b();
+
+		TqFloat& topDepth = topData[Sample_Depth];
+		if ( depthfilter != Filter_Min )
+		{
+			if ( depthfilter == Filter_MidPoint )
 			{
-				TqFloat* sample_data = sampleHitData(*sample);
-				if ( sample->flags & SqImageSample::Flag_Matte )
-				{
-					samplecolor = CqColor(
-						lerp( sample_data[Sample_ORed], samplecolor.r(), 0.0f ),
-						lerp( sample_data[Sample_OGreen], samplecolor.g(), 0.0f ),
-						lerp( sample_data[Sample_OBlue], samplecolor.b(), 0.0f )
-					);
-					sampleopacity = CqColor(
-						lerp( sample_data[Sample_Red], sampleopacity.r(), 0.0f ),
-						lerp( sample_data[Sample_Green], sampleopacity.g(), 0.0f ),
-						lerp( sample_data[Sample_Blue], sampleopacity.b(), 0.0f )
-					);
-				}
+				// Use midpoint for depth
+				if ( sampleData.data.size() > 1 )
+					topDepth = ( ( opaqueDepths[0] + opaqueDepths[1] ) * 0.5f );
 				else
-				{
-					samplecolor = ( samplecolor *
-					                ( gColWhite - CqColor(clamp(sample_data[Sample_ORed], 0.0f, 1.0f), clamp(sample_data[Sample_OGreen], 0.0f, 1.0f), clamp(sample_data[Sample_OBlue], 0.0f, 1.0f)) ) ) +
-					              CqColor(sample_data[Sample_Red], sample_data[Sample_Green], sample_data[Sample_Blue]);
-					sampleopacity = ( ( gColWhite - sampleopacity ) *
-					                  CqColor(sample_data[Sample_ORed], sample_data[Sample_OGreen], sample_data[Sample_OBlue]) ) +
-					                sampleopacity;
-				}
-
-				// Now determine if the sample opacity meets the limit for
-				// depth mapping.  If so, store the depth in the appropriate
-				// nearest opaque sample slot.  The test is, if all channels of
-				// the opacity color are greater or equal to the threshold.
-				if(   sample_data[Sample_ORed]   >= zThreshold.r()
-				   && sample_data[Sample_OGreen] >= zThreshold.g()
-				   && sample_data[Sample_OBlue]  >= zThreshold.b())
-				{
-					// Make sure we store the nearest and second nearest depth values.
-					opaqueDepths[1] = opaqueDepths[0];
-					opaqueDepths[0] = sample_data[Sample_Depth];
-					// Store the max opaque depth too, if not already stored.
-					if(!(maxOpaqueDepth < FLT_MAX))
-						maxOpaqueDepth = sample_data[Sample_Depth];
-				}
-				samplehit = true;
+					topDepth = FLT_MAX;
 			}
-
-			if ( samplehit )
+			else if ( depthfilter == Filter_Max)
 			{
-				samplecount++;
+				topDepth = maxOpaqueDepth;
 			}
-
-			// Write the collapsed color values back into the occluding entry.
-			if ( !sampleData.data.empty() )
+			else if ( depthfilter == Filter_Average )
 			{
-				// Make sure the extra sample data from the top entry is copied
-				// to the occluding sample, which is then sent to the display.
-				occlHit = *sampleData.data.begin();
-				TqFloat* occlData = sampleHitData(occlHit);
-				// Set the color and opacity.
-				occlData[Sample_Red] = samplecolor.r();
-				occlData[Sample_Green] = samplecolor.g();
-				occlData[Sample_Blue] = samplecolor.b();
-				occlData[Sample_ORed] = sampleopacity.r();
-				occlData[Sample_OGreen] = sampleopacity.g();
-				occlData[Sample_OBlue] = sampleopacity.b();
-				occlHit.flags |= SqImageSample::Flag_Valid;
-
-				TqFloat& occlDepth = occlData[Sample_Depth];
-				if ( depthfilter != Filter_Min )
+				std::vector<SqImageSample>::iterator sample;
+				TqFloat totDepth = 0.0f;
+				TqInt totCount = 0;
+				for ( sample = sampleData.data.begin(); sample != sampleData.data.end(); sample++ )
 				{
-					if ( depthfilter == Filter_MidPoint )
+					TqFloat* sample_data = sampleHitData(*sample);
+					if(sample_data[Sample_ORed] >= zThreshold.r() || sample_data[Sample_OGreen] >= zThreshold.g() || sample_data[Sample_OBlue] >= zThreshold.b())
 					{
-						// Use midpoint for depth
-						if ( sampleData.data.size() > 1 )
-							occlDepth = ( ( opaqueDepths[0] + opaqueDepths[1] ) * 0.5f );
-						else
-							occlDepth = FLT_MAX;
+						totDepth += sample_data[Sample_Depth];
+						totCount++;
 					}
-					else if ( depthfilter == Filter_Max)
-					{
-						occlDepth = maxOpaqueDepth;
-					}
-					else if ( depthfilter == Filter_Average )
-					{
-						std::vector<SqImageSample>::iterator sample;
-						TqFloat totDepth = 0.0f;
-						TqInt totCount = 0;
-						for ( sample = sampleData.data.begin(); sample != sampleData.data.end(); sample++ )
-						{
-							TqFloat* sample_data = sampleHitData(*sample);
-							if(sample_data[Sample_ORed] >= zThreshold.r() || sample_data[Sample_OGreen] >= zThreshold.g() || sample_data[Sample_OBlue] >= zThreshold.b())
-							{
-								totDepth += sample_data[Sample_Depth];
-								totCount++;
-							}
-						}
-						totDepth /= totCount;
-
-						occlDepth = totDepth;
-					}
-					// Default to "min"
 				}
-				else
-					occlDepth = opaqueDepths[0];
+				totDepth /= totCount;
+
+				topDepth = totDepth;
 			}
+			// Default to "min"
 		}
 		else
-		{
-			if (occlHit.flags & SqImageSample::Flag_Valid)
-			{
-				TqFloat* occlData = sampleHitData(occlHit);
-				if(occlHit.flags & SqImageSample::Flag_Matte)
-				{
-					// Opaque matte objects are fully transparent black; need
-					// to set the hit data to reflect this.
-					occlData[Sample_Red] = 0;
-					occlData[Sample_Green] = 0;
-					occlData[Sample_Blue] = 0;
-					occlData[Sample_ORed] = 0;
-					occlData[Sample_OGreen] = 0;
-					occlData[Sample_OBlue] = 0;
-				}
-				if(depthfilter == Filter_MidPoint)
-				{
-					// For midpoint depth filters, average the occluding depth
-					// and the depth of the opaque sample.  The occluding depth
-					// represents one surface *behind* the opaque depth in this
-					// case.
-					occlData[Sample_Depth] = 0.5*(occlData[Sample_Depth]
-					                              + sampleData.occlZ);
-				}
-				samplecount++;
-			}
-		}
+			topDepth = opaqueDepths[0];
+
+		// Then the top entry becomes the occluding hit, which is sent to the
+		// display.
+		TqFloat* occlData = occludingHitData(index);
+		if(topData != occlData)
+			std::copy(topData, topData + SqImageSample::sampleSize, occlData);
+		occlFlags = topHit.flags | SqImageSample::Flag_Valid;
 	}
 }
 
@@ -335,16 +338,22 @@ void CqImagePixel::setSamples(IqSampler* sampler, CqVector2D& offset)
 {
 	TqInt nSamps = numSamples();
 
-	const TqInt* shuffledIndices = sampler->getShuffledIndices();
+	// The patterns are chosen from the pixel position, so that a pixel gets
+	// the same samples whichever bucket sets it up, and in whatever order.
+	const TqUint pixelKey = hashRandom(
+		static_cast<TqUint>(lfloor(offset.x()))*73856093U
+		^ static_cast<TqUint>(lfloor(offset.y()))*19349663U);
+
+	const TqInt* shuffledIndices = sampler->getShuffledIndices(pixelKey);
 	for(TqInt i = 0; i < nSamps; ++i)
 		m_DofOffsetIndices[i] = shuffledIndices[i];
 
 	// Get random distributions from the sample generator, and save them into
 	// the pixel sample data structures.
-	const CqVector2D* positions = sampler->get2DSamples();
-	const CqVector2D* dofOffsets = sampler->get2DSamples();
-	const TqFloat* times = sampler->get1DSamples();
-	const TqFloat* lods = sampler->get1DSamples();
+	const CqVector2D* positions = sampler->get2DSamples(pixelKey + 1);
+	const CqVector2D* dofOffsets = sampler->get2DSamples(pixelKey + 2);
+	const TqFloat* times = sampler->get1DSamples(pixelKey + 3);
+	const TqFloat* lods = sampler->get1DSamples(pixelKey + 4);
 
 	TqFloat opentime = QGetRenderContext() ->poptCurrent()->GetFloatOption( "System", "Shutter" ) [ 0 ];
 	TqFloat closetime = QGetRenderContext() ->poptCurrent()->GetFloatOption( "System", "Shutter" ) [ 1 ];
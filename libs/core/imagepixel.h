@@ -69,6 +69,11 @@ enum EqSampleIndices
  * bucket overlap cache and for scenes with lots of semitransparent depth
  * complexity.
  *
+ * SqImageSample is only used for the "deep" hits which can't be stored as the
+ * occluding hit of a sample, that is hits from semitransparent, matte or CSG
+ * surfaces.  The occluding hits have no SqImageSample; see
+ * CqImagePixel::occludingHitData().
+ *
  * The float array values stored at index in the associated CqImagePixel follow
  * the EqSampleIndices enum for the standard values, anything above
  * Sample_Alpha is a custom entry AOV usage.  See SqImagePixel::sampleHitData()
@@ -126,21 +131,10 @@ struct SqSampleData : private boost::noncopyable
 	TqUint      occlusionIndex;     ///< Index for sample in occlusion tree.
 	TqFloat		time;				///< Float sample time.
 	TqFloat		detailLevel;		///< Float level-of-detail sample.
-	std::vector<SqImageSample> data;	///< Array of surface "hits" for this sample.
-	/** \brief Minimum depth hit which occludes any hits further away
-	 *
-	 * During micropolygon sampling, occludingHit is used to store the surface
-	 * hit which is closest to the camera for the sample point.  Any
-	 * micropolygon hits further away than this can be culled without being
-	 * stored.  A micropolygon hit can occlude other surfaces when
-	 * 1) The micropoly is opaque
-	 * 2) The micropoly does not participate in CSG
-	 * 3) The z depthfilter is "min" or "midpoint" (midpoint uses special case code).
-	 */
-	SqImageSample occludingHit;
+	std::vector<SqImageSample> data;	///< Array of deep surface "hits" for this sample.
 	/** \brief Occluding depth.
 	 *
-	 * This should be the same as the depth in occludingHit, *except* when a
+	 * This should be the same as the depth of the occluding hit, *except* when a
 	 * depth filter mode not equal to "min" is enabled.  (ie, the "midpoint"
 	 * or other more exotic depth filters)
 	 */
@@ -216,17 +210,55 @@ class CqImagePixel : private boost::noncopyable
 		 */
 		void clear();
 
-		/** \brief Get a reference to the array of values for the specified sample.
+		/** \brief Get a reference to the array of deep hits for the specified sample.
 		 * \param index the index of the sample point within the pixel
 		 */
 		std::vector<SqImageSample>& Values( TqInt index );
 
-		/** \brief Get a reference to the image hit that represents the top
-		 * if the closest sample is occluding.
+		/** \brief Add a deep hit to the specified sample.
+		 *
+		 * Deep hits are kept in addition to the occluding hit, and are
+		 * needed for hits which don't occlude the surfaces behind them.  The
+		 * hit data is allocated with allocateHitData().
+		 *
+		 * \param index - The index of the sample within the pixel.
+		 * \return The new hit.
+		 */
+		SqImageSample& addDeepHit( TqInt index );
+
+		/// Determine whether any sample of the pixel has deep hits.
+		bool hasDeepHits() const;
+
+		/** \brief Get the flags of the occluding hit for a sample.
+		 *
+		 * The occluding hit is the surface hit closest to the camera for the
+		 * sample point, when that hit occludes anything further away.  A
+		 * micropolygon hit can occlude other surfaces when
+		 * 1) The micropoly is opaque
+		 * 2) The micropoly does not participate in CSG
+		 * 3) The z depthfilter is "min" or "midpoint" (midpoint uses special
+		 *    case code).
+		 *
+		 * After Combine(), the occluding hit holds the final value of the
+		 * sample.  The flags use the SqImageSample flag enum, and include
+		 * SqImageSample::Flag_Valid if the hit has been stored.
+		 *
+		 *  \param index - The index of the sample within the pixel to query.
+		 */
+		TqUint& occludingFlags( TqInt index );
+
+		//@{
+		/** \brief Get the data of the occluding hit for a sample.
+		 *
+		 * The occluding hits of all samples are stored in order at the start
+		 * of the pixel's hit data, so an opaque pixel is a single flat block
+		 * of sample data, without any per hit bookkeeping.
 		 *
 		 *  \param index - The index of the sample within the pixel to query.
 		 */
-		SqImageSample& occludingHit( TqInt index );
+		const TqFloat* occludingHitData( TqInt index ) const;
+		TqFloat* occludingHitData( TqInt index );
+		//@}
 
 		//@{
 		/** \brief Return the sample data associated with a micropolygon sample hit.
@@ -303,6 +335,10 @@ class CqImagePixel : private boost::noncopyable
 		void setSamples(IqSampler* sampler, CqVector2D& offset);
 
 	private:
+		/// Combine the deep hits of a sample into its occluding hit.
+		void combineDeepHits( TqInt index, EqDepthFilter depthfilter,
+				const CqColor& zThreshold );
+
 		/// boost::intrusive_ptr required function, to increment the reference count.
 		friend		void intrusive_ptr_add_ref(CqImagePixel* p);
 		/// boost::intrusive_ptr required function, to decrement the reference count.
@@ -315,8 +351,11 @@ class CqImagePixel : private boost::noncopyable
 		TqInt m_YSamples;
 		/// Array of sample positions within this pixel
 		boost::scoped_array<SqSampleData> m_samples;
-		/// Vector storing sample data for the sample hits within the pixel.
+		/// Vector storing sample data for the sample hits within the pixel,
+		/// starting with the occluding hits of each sample.
 		std::vector<TqFloat> m_hitSamples;
+		/// Flags for the occluding hit of each sample.
+		boost::scoped_array<TqUint> m_occludingFlags;
 		/// A mapping from dof bounding-box index to the sample that contains a
 		/// dof offset in that bb.
 		boost::scoped_array<TqInt> m_DofOffsetIndices;
@@ -324,6 +363,8 @@ class CqImagePixel : private boost::noncopyable
 		int m_refCount;
 		/// A flag to indicate successful sample hits in this pixel.
 		bool m_hasValidSamples;
+		/// A flag to indicate that some sample in the pixel has deep hits.
+		bool m_hasDeepHits;
 }; 
 
 /// Intrusive reference counted pointer to a pixel class.
@@ -399,7 +440,6 @@ inline SqSampleData::SqSampleData()
 	time(0),
 	detailLevel(0),
 	data(),
-	occludingHit(),
 	occlZ(FLT_MAX)
 { }
 
@@ -446,10 +486,37 @@ inline std::vector<SqImageSample>& CqImagePixel::Values( TqInt index )
 	return m_samples[index].data;
 }
 
-inline SqImageSample& CqImagePixel::occludingHit( TqInt index )
+inline SqImageSample& CqImagePixel::addDeepHit( TqInt index )
+{
+	assert(index < numSamples());
+	std::vector<SqImageSample>& hits = m_samples[index].data;
+	hits.push_back(SqImageSample());
+	allocateHitData(hits.back());
+	m_hasDeepHits = true;
+	return hits.back();
+}
+
+inline bool CqImagePixel::hasDeepHits() const
+{
+	return m_hasDeepHits;
+}
+
+inline TqUint& CqImagePixel::occludingFlags( TqInt index )
+{
+	assert(index < numSamples());
+	return m_occludingFlags[index];
+}
+
+inline const TqFloat* CqImagePixel::occludingHitData( TqInt index ) const
+{
+	assert(index < numSamples());
+	return &m_hitSamples[index*SqImageSample::sampleSize];
+}
+
+inline TqFloat* CqImagePixel::occludingHitData( TqInt index )
 {
 	assert(index < numSamples());
-	return m_samples[index].occludingHit;
+	return &m_hitSamples[index*SqImageSample::sampleSize];
 }
 
 inline const TqFloat* CqImagePixel::sampleHitData(const SqImageSample& hit) const
@@ -0,0 +1,91 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the storage and combining of pixel sample hits
+ */
+
+#include "imagepixel.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+void setHit(TqFloat* data, const CqColor& col, const CqColor& opa, TqFloat depth)
+{
+	data[Sample_Red] = col.r();
+	data[Sample_Green] = col.g();
+	data[Sample_Blue] = col.b();
+	data[Sample_ORed] = opa.r();
+	data[Sample_OGreen] = opa.g();
+	data[Sample_OBlue] = opa.b();
+	data[Sample_Depth] = depth;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqImagePixel_combine_opaque_test)
+{
+	CqImagePixel pixel(2, 2);
+	setHit(pixel.occludingHitData(0), CqColor(1,0,0), gColWhite, 2);
+	pixel.occludingFlags(0) = SqImageSample::Flag_Valid;
+	setHit(pixel.occludingHitData(3), CqColor(0,1,0), gColWhite, 3);
+	pixel.occludingFlags(3) = SqImageSample::Flag_Valid | SqImageSample::Flag_Matte;
+	BOOST_CHECK(!pixel.hasDeepHits());
+
+	pixel.Combine(Filter_Min, gColWhite);
+
+	BOOST_CHECK_EQUAL(pixel.occludingHitData(0)[Sample_Red], 1);
+	BOOST_CHECK_EQUAL(pixel.occludingHitData(0)[Sample_Depth], 2);
+	// Opaque matte hits become transparent black.
+	BOOST_CHECK_EQUAL(pixel.occludingHitData(3)[Sample_Green], 0);
+	BOOST_CHECK_EQUAL(pixel.occludingHitData(3)[Sample_OGreen], 0);
+	BOOST_CHECK(!(pixel.occludingFlags(1) & SqImageSample::Flag_Valid));
+}
+
+BOOST_AUTO_TEST_CASE(CqImagePixel_combine_deep_test)
+{
+	CqImagePixel pixel(1, 1);
+	setHit(pixel.occludingHitData(0), CqColor(1,0,0), gColWhite, 2);
+	pixel.occludingFlags(0) = SqImageSample::Flag_Valid;
+	pixel.SampleData(0).occlZ = 2;
+	SqImageSample& hit = pixel.addDeepHit(0);
+	setHit(pixel.sampleHitData(hit), CqColor(0,0.5,0), CqColor(0.5), 1);
+	BOOST_CHECK(pixel.hasDeepHits());
+
+	pixel.Combine(Filter_Min, gColWhite);
+
+	// The semitransparent green hit is composited over the opaque red one.
+	const TqFloat* data = pixel.occludingHitData(0);
+	BOOST_CHECK_CLOSE(data[Sample_Red], 0.5f, 1e-4f);
+	BOOST_CHECK_CLOSE(data[Sample_Green], 0.5f, 1e-4f);
+	BOOST_CHECK_CLOSE(data[Sample_ORed], 1.0f, 1e-4f);
+	BOOST_CHECK_EQUAL(data[Sample_Depth], 2);
+	BOOST_CHECK(pixel.occludingFlags(0) & SqImageSample::Flag_Valid);
+
+	pixel.clear();
+	BOOST_CHECK(!pixel.hasDeepHits());
+	BOOST_CHECK(pixel.Values(0).empty());
+	BOOST_CHECK(!(pixel.occludingFlags(0) & SqImageSample::Flag_Valid));
+}
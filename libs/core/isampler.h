@@ -38,6 +38,9 @@ class CqVector2D;
  * This interface provides sample distribution information for functions in Aqsis
  * that need to sample signals effectively.
  *
+ * Samplers hold no state which changes between calls, so the pattern used for
+ * a pixel depends only on the key the caller derives from it.  This keeps the
+ * samples the same whichever order, or thread, the pixels are set up in.
  */
 class IqSampler
 {
@@ -53,9 +56,12 @@ class IqSampler
 		 *
 		 * \note Currently this is expected to return a pixels worth of samples.
 		 *
+		 * \param pattern - key selecting one of the sampler's patterns.  The
+		 *                  same key always gives the same samples.
+		 *
 		 * \returns - a constant pointer to an array of sample positions.
 		 */
-		virtual const CqVector2D* get2DSamples() = 0;		
+		virtual const CqVector2D* get2DSamples(TqUint pattern) const = 0;
 		/** \brief Return a set of 1D sample positions over the specified region.
 		 *
 		 * Returns a set of 1D values for the number of samples requested.
@@ -64,17 +70,21 @@ class IqSampler
 		 *
 		 * \note Currently this is expected to return a pixels worth of samples.
 		 *
+		 * \param pattern - key selecting the pattern, as for get2DSamples().
+		 *
 		 * \returns - a constant pointer to an array of sample times.
 		 */
-		virtual const TqFloat* get1DSamples() = 0;	
+		virtual const TqFloat* get1DSamples(TqUint pattern) const = 0;
 		/** \brief Return a set of 1D shuffle offsets over the specified sample range.
 		 *
 		 *  Returns a set of integer indices between 0 and the number of samples, randomly
 		 *  shuffled for jittering array indices.
 		 *
+		 * \param pattern - key selecting the pattern, as for get2DSamples().
+		 *
 		 * \returns - a constant pointer to an array of integer indices.
 		 */
-		virtual const TqInt* getShuffledIndices() = 0;
+		virtual const TqInt* getShuffledIndices(TqUint pattern) const = 0;
 };
 
 } // namespace Aqsis
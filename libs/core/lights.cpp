@@ -27,6 +27,15 @@
 #include	"lights.h"
 #include	<aqsis/util/file.h>
 #include	"renderer.h"
+#include	"stats.h"
+
+#include	<cstring>
+
+#ifdef ENABLE_THREADING
+#include	<map>
+#include	<boost/thread/tss.hpp>
+#include	<boost/weak_ptr.hpp>
+#endif
 
 namespace Aqsis {
 
@@ -57,6 +66,167 @@ CqLightsource::~CqLightsource()
 }
 
 
+#ifdef ENABLE_THREADING
+namespace {
+
+/// Per-thread execution environment for a lightsource.
+struct SqThreadLightEnv
+{
+	boost::weak_ptr<const CqLightsource> light;
+	boost::shared_ptr<IqShaderExecEnv> env;
+	SqLightCache cache;
+};
+typedef std::map<const CqLightsource*, SqThreadLightEnv> TqThreadLightEnvMap;
+
+boost::thread_specific_ptr<TqThreadLightEnvMap> g_threadLightEnvs;
+
+} // unnamed namespace
+#endif
+
+IqShaderExecEnv* CqLightsource::execEnv() const
+{
+#ifdef ENABLE_THREADING
+	TqThreadLightEnvMap* envs = g_threadLightEnvs.get();
+	if(!envs)
+	{
+		envs = new TqThreadLightEnvMap();
+		g_threadLightEnvs.reset(envs);
+	}
+	TqThreadLightEnvMap::iterator i = envs->find(this);
+	if(i == envs->end() && envs->size() >= 64)
+	{
+		// Forget the environments of lights from previous frames.
+		for(i = envs->begin(); i != envs->end(); )
+		{
+			if(i->second.light.expired())
+				envs->erase(i++);
+			else
+				++i;
+		}
+	}
+	SqThreadLightEnv& entry = (*envs)[this];
+	// Lightsources are only destroyed between frames, but a new one may be
+	// allocated at the same address, so check the entry really is ours.
+	if(!entry.env || entry.light.lock().get() != this)
+	{
+		entry.light = shared_from_this();
+		entry.env = IqShaderExecEnv::create(QGetRenderContextI());
+		entry.cache = SqLightCache();
+	}
+	return entry.env.get();
+#else
+	assert( m_pShaderExecEnv );
+	return m_pShaderExecEnv.get();
+#endif
+}
+
+SqLightCache& CqLightsource::lightCache() const
+{
+#ifdef ENABLE_THREADING
+	// execEnv() makes sure this thread has a valid entry for the light.
+	execEnv();
+	return (*g_threadLightEnvs)[this].cache;
+#else
+	return m_cache;
+#endif
+}
+
+
+namespace {
+
+/// Determine whether the points in data are those in values.
+bool sameVectors( const std::vector<CqVector3D>& values, IqShaderData* data )
+{
+	if ( !data )
+		return values.empty();
+	if ( data->Size() != static_cast<TqUint>( values.size() ) || values.empty() )
+		return false;
+	const CqVector3D* points = 0;
+	data->GetPointPtr( points );
+	return std::memcmp( &values[0], points, values.size()*sizeof( CqVector3D ) ) == 0;
+}
+
+/// Copy the points in data into values.
+void copyVectors( IqShaderData* data, std::vector<CqVector3D>& values )
+{
+	if ( !data )
+	{
+		values.clear();
+		return;
+	}
+	const CqVector3D* points = 0;
+	data->GetPointPtr( points );
+	values.assign( points, points + data->Size() );
+}
+
+} // unnamed namespace
+
+//---------------------------------------------------------------------
+/** Initialise and evaluate the lightsource for a grid.
+ *
+ * Surface shaders run every light once for each illuminance loop, so a
+ * shader with several loops over the same points asks for the same results
+ * more than once.  When the light shader only depends on its inputs, the
+ * results from the previous evaluation are kept if Ps, Ns and the grid are
+ * unchanged.  Lights whose results don't vary over the surface at all are
+ * evaluated once per thread and shutter time, and only have L and Cl filled
+ * in from the cached values for subsequent grids.
+ */
+void CqLightsource::EvaluateCached( TqInt uGridRes, TqInt vGridRes, TqInt microPolygonCount, TqInt shadingPointCount, bool hasValidDerivatives,
+		IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface )
+{
+	boost::shared_ptr<IqShader> shader = pShader();
+	EqLightReuse reuse = shader ? shader->lightReuse() : LightReuse_None;
+	SqLightCache& cache = lightCache();
+	TqFloat time = QGetRenderContextI()->Time();
+
+	if ( reuse != LightReuse_None && cache.valid
+		&& cache.uGridRes == uGridRes && cache.vGridRes == vGridRes
+		&& cache.microPolygonCount == microPolygonCount
+		&& cache.shadingPointCount == shadingPointCount
+		&& cache.hasValidDerivatives == hasValidDerivatives
+		&& cache.surface == pSurface && cache.time == time
+		&& sameVectors( cache.Ps, pPs ) && sameVectors( cache.Ns, pNs ) )
+	{
+		STATS_INC( SHD_lights_reused );
+		return;
+	}
+
+	Initialise( uGridRes, vGridRes, microPolygonCount, shadingPointCount, hasValidDerivatives );
+	if ( reuse == LightReuse_Uniform && cache.uniformValid && cache.uniformTime == time )
+	{
+		if ( L() )
+			L() ->SetVector( cache.L );
+		if ( Cl() )
+			Cl() ->SetColor( cache.Cl );
+		STATS_INC( SHD_lights_reused );
+	}
+	else
+	{
+		Evaluate( pPs, pNs, pSurface );
+		STATS_INC( SHD_lights_evaluated );
+		if ( reuse == LightReuse_Uniform && L() && Cl() )
+		{
+			L() ->GetVector( cache.L, 0 );
+			Cl() ->GetColor( cache.Cl, 0 );
+			cache.uniformTime = time;
+			cache.uniformValid = true;
+		}
+	}
+
+	cache.uGridRes = uGridRes;
+	cache.vGridRes = vGridRes;
+	cache.microPolygonCount = microPolygonCount;
+	cache.shadingPointCount = shadingPointCount;
+	cache.hasValidDerivatives = hasValidDerivatives;
+	cache.surface = pSurface;
+	cache.time = time;
+	copyVectors( pPs, cache.Ps );
+	copyVectors( pNs, cache.Ns );
+	cache.valid = reuse != LightReuse_None;
+}
+
+
 //---------------------------------------------------------------------
 /** Initialise the environment for the specified grid size.
  * \param iGridRes Integer grid resolution.
@@ -65,14 +235,15 @@ CqLightsource::~CqLightsource()
 void CqLightsource::Initialise( TqInt uGridRes, TqInt vGridRes, TqInt microPolygonCount, TqInt shadingPointCount, bool hasValidDerivatives )
 {
 	TqInt Uses = gDefLightUses;
-	if ( m_pShader )
+	boost::shared_ptr<IqShader> shader = pShader();
+	if ( shader )
 	{
-		Uses |= m_pShader->Uses();
-		m_pShaderExecEnv->Initialise( uGridRes, vGridRes, microPolygonCount, shadingPointCount, hasValidDerivatives, m_pAttributes, boost::shared_ptr<IqTransform>(), m_pShader.get(), Uses );
+		Uses |= shader->Uses();
+		execEnv()->Initialise( uGridRes, vGridRes, microPolygonCount, shadingPointCount, hasValidDerivatives, m_pAttributes, boost::shared_ptr<IqTransform>(), shader.get(), Uses );
 	}
 
-	if ( m_pShader )
-		m_pShader->Initialise( uGridRes, vGridRes, shadingPointCount, m_pShaderExecEnv.get() );
+	if ( shader )
+		shader->Initialise( uGridRes, vGridRes, shadingPointCount, execEnv() );
 
 	if ( USES( Uses, EnvVars_L ) )
 		L() ->Initialise( shadingPointCount );
@@ -44,11 +44,39 @@
 #include <aqsis/version.h>
 #include <aqsis/core/ilightsource.h>
 #include "attributes.h"
+#include "shaders.h"
 #include "transform.h"
 
 namespace Aqsis {
 
 class CqLightsource;
+
+/** \brief The inputs and results of the last evaluation of a lightsource.
+ *
+ * Used by CqLightsource::EvaluateCached() to decide when the shader needn't
+ * be run again.
+ */
+struct SqLightCache
+{
+	/// True if the inputs below are those the environment was last evaluated for.
+	bool	valid;
+	TqInt	uGridRes;
+	TqInt	vGridRes;
+	TqInt	microPolygonCount;
+	TqInt	shadingPointCount;
+	bool	hasValidDerivatives;
+	const IqSurface* surface;
+	TqFloat	time;
+	std::vector<CqVector3D> Ps;
+	std::vector<CqVector3D> Ns;
+	/// True if L and Cl hold the results of a uniform light.
+	bool	uniformValid;
+	TqFloat	uniformTime;
+	CqVector3D L;
+	CqColor	Cl;
+
+	SqLightCache() : valid( false ), uniformValid( false ) {}
+};
 typedef boost::shared_ptr<CqLightsource> CqLightsourcePtr;
 
 //----------------------------------------------------------------------
@@ -75,7 +103,7 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		 */
 		virtual boost::shared_ptr<IqShader>	pShader() const
 		{
-			return ( m_pShader );
+			return ( threadShaderInstance(m_pShader) );
 		}
 		/** Initialise the shader execution environment.
 		 * \param uGridRes Integer grid size, not used.
@@ -90,9 +118,12 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		{
 			Ps() ->SetValueFromVariable( pPs );
 			Ns() ->SetValueFromVariable( pNs );
-			m_pShaderExecEnv->SetCurrentSurface(pSurface);
-			m_pShader->Evaluate( m_pShaderExecEnv.get() );
+			IqShaderExecEnv* env = execEnv();
+			env->SetCurrentSurface(pSurface);
+			pShader()->Evaluate( env );
 		}
+		virtual void	EvaluateCached( TqInt uGridRes, TqInt vGridRes, TqInt microPolygonCount, TqInt shadingPointCount, bool hasValidDerivatives,
+				IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface );
 		/** Get a pointer to the attributes state associated with this GPrim.
 		 * \return A pointer to a CqAttributes class.
 		 */
@@ -111,160 +142,141 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		// Redirect acces via IqShaderExecEnv
 		virtual	TqInt	uGridRes() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->uGridRes() );
+			return ( execEnv()->uGridRes() );
 		}
 		virtual	TqInt	vGridRes() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->vGridRes() );
+			return ( execEnv()->vGridRes() );
 		}
 		virtual	TqInt	microPolygonCount() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->microPolygonCount() );
+			return ( execEnv()->microPolygonCount() );
 		}
 		virtual	TqInt	shadingPointCount() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->shadingPointCount() );
+			return ( execEnv()->shadingPointCount() );
 		}
 /*		virtual	const CqMatrix&	matObjectToWorld() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->matObjectToWorld() );
+			return ( execEnv()->matObjectToWorld() );
 		}*/
 		virtual	IqShaderData* Cs()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Cs() );
+			return ( execEnv()->Cs() );
 		}
 		virtual	IqShaderData* Os()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Os() );
+			return ( execEnv()->Os() );
 		}
 		virtual	IqShaderData* Ng()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ng() );
+			return ( execEnv()->Ng() );
 		}
 		virtual	IqShaderData* du()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->du() );
+			return ( execEnv()->du() );
 		}
 		virtual	IqShaderData* dv()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dv() );
+			return ( execEnv()->dv() );
 		}
 		virtual	IqShaderData* L()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->L() );
+			return ( execEnv()->L() );
 		}
 		virtual	IqShaderData* Cl()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Cl() );
+			return ( execEnv()->Cl() );
 		}
 		virtual IqShaderData* Ol()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ol() );
+			return ( execEnv()->Ol() );
 		}
 		virtual IqShaderData* P()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->P() );
+			return ( execEnv()->P() );
 		}
 		virtual IqShaderData* dPdu()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dPdu() );
+			return ( execEnv()->dPdu() );
 		}
 		virtual IqShaderData* dPdv()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dPdv() );
+			return ( execEnv()->dPdv() );
 		}
 		virtual IqShaderData* N()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->N() );
+			return ( execEnv()->N() );
 		}
 		virtual IqShaderData* u()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->u() );
+			return ( execEnv()->u() );
 		}
 		virtual IqShaderData* v()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->v() );
+			return ( execEnv()->v() );
 		}
 		virtual IqShaderData* s()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->s() );
+			return ( execEnv()->s() );
 		}
 		virtual IqShaderData* t()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->t() );
+			return ( execEnv()->t() );
 		}
 		virtual IqShaderData* I()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->I() );
+			return ( execEnv()->I() );
 		}
 		virtual IqShaderData* Ci()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ci() );
+			return ( execEnv()->Ci() );
 		}
 		virtual IqShaderData* Oi()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Oi() );
+			return ( execEnv()->Oi() );
 		}
 		virtual IqShaderData* Ps()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ps() );
+			return ( execEnv()->Ps() );
 		}
 		virtual IqShaderData* E()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->E() );
+			return ( execEnv()->E() );
 		}
 		virtual IqShaderData* ncomps()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->ncomps() );
+			return ( execEnv()->ncomps() );
 		}
 		virtual IqShaderData* time()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->time() );
+			return ( execEnv()->time() );
 		}
 		virtual IqShaderData* alpha()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->alpha() );
+			return ( execEnv()->alpha() );
 		}
 		virtual IqShaderData* Ns()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ns() );
+			return ( execEnv()->Ns() );
 		}
 
 	private:
+		/** Get the shader execution environment for the calling thread.
+		 *
+		 * When threading is enabled each thread lights its grids through a
+		 * private environment (and shader instance, see pShader()), so that
+		 * lights can be evaluated for several grids at once.
+		 */
+		IqShaderExecEnv* execEnv() const;
+		/// Get the cache for the environment returned by execEnv().
+		SqLightCache& lightCache() const;
+
 		boost::shared_ptr<IqShader>	m_pShader;				///< Pointer to the associated shader.
 		CqAttributesPtr	m_pAttributes;			///< Pointer to the associated attributes.
 		CqTransformPtr m_pTransform;		///< Pointer to the transformation state associated with this GPrim.
 		boost::shared_ptr<IqShaderExecEnv>	m_pShaderExecEnv;	///< Pointer to the shader execution environment.
+		mutable SqLightCache	m_cache;	///< Cache for m_pShaderExecEnv.
 }
 ;
 
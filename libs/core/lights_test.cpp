@@ -0,0 +1,198 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for reusing the results of lightsource shaders.
+ */
+
+#include "lights.h"
+
+#include <sstream>
+#include <string>
+
+#include <aqsis/ri/ri.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "renderer.h"
+#include "stats.h"
+
+using namespace Aqsis;
+
+namespace {
+
+/// Sets up a world block for a test, and tears it down again.
+struct SqWorldFixture
+{
+	SqWorldFixture()
+	{
+		RiBegin(RI_NULL);
+		RiWorldBegin();
+	}
+	~SqWorldFixture()
+	{
+		RiWorldEnd();
+		RiEnd();
+	}
+};
+
+/** Load a light shader from its compiled text form.
+ *
+ * \param uses - the globals the shader reads or writes, besides L and Cl.
+ * \param code - code segment which sets L and Cl.
+ */
+boost::shared_ptr<IqShader> loadLight(TqInt uses, const char* code)
+{
+	std::ostringstream program;
+	program << "lightsource\nAQSIS_V 2\n\n\nsegment Data\n\nUSES "
+		<< (uses | (1 << EnvVars_L) | (1 << EnvVars_Cl))
+		<< "\n\nvarying float x\n\n\nsegment Init\n\n\nsegment Code\n"
+		<< code;
+	std::istringstream in(program.str());
+	boost::shared_ptr<IqShader> shader = createShaderVM(QGetRenderContext(), in, "");
+	shader->PrepareDefArgs();
+	return shader;
+}
+
+/// Light with the same results everywhere.
+const char* uniformLightCode =
+	"\tpushif 0.5\n\tsetfp\n\tpop L\n"
+	"\tpushif 0.25\n\tsetfc\n\tpop Cl\n";
+/// Light with results which depend on Ps.
+const char* pointsLightCode =
+	"\tpushv Ps\n\tpop L\n"
+	"\tpushv Ps\n\tsetpc\n\tpushif 0.125\n\tmulfc\n\tpop Cl\n";
+
+/// Points being lit, and their normals, for a grid of n points.
+struct SqSurfacePoints
+{
+	boost::shared_ptr<IqShaderExecEnv> env;
+
+	SqSurfacePoints(IqShader* shader, TqInt n, TqFloat offset)
+		: env(IqShaderExecEnv::create(QGetRenderContext()))
+	{
+		env->Initialise(n-1, 0, n-1, n, false, IqAttributesPtr(), IqTransformPtr(),
+				shader, (1 << EnvVars_P) | (1 << EnvVars_N));
+		for(TqInt i = 0; i < n; ++i)
+		{
+			env->P()->SetPoint(CqVector3D(0.1f*i + offset, 1.0f/(i + 3), -0.7f*i), i);
+			env->N()->SetNormal(CqVector3D(0, 0.3f*i, 1), i);
+		}
+	}
+};
+
+/// Get the L and Cl results of a light as raw bytes.
+std::string lightResults(CqLightsource& light, TqInt n)
+{
+	std::string results;
+	for(TqInt i = 0; i < n; ++i)
+	{
+		CqVector3D L;
+		CqColor Cl;
+		light.L()->GetVector(L, i);
+		light.Cl()->GetColor(Cl, i);
+		results.append(reinterpret_cast<const char*>(&L), sizeof(L));
+		results.append(reinterpret_cast<const char*>(&Cl), sizeof(Cl));
+	}
+	return results;
+}
+
+/** Check that the light gives exactly the results of a fresh evaluation when
+ * evaluated with caching.
+ *
+ * \return the number of evaluations which reused earlier results.
+ */
+TqInt checkCachedResults(const char* code, TqInt uses)
+{
+	boost::shared_ptr<IqShader> shader = loadLight(uses, code);
+	boost::shared_ptr<CqLightsource> light(new CqLightsource(shader));
+	boost::shared_ptr<CqLightsource> freshLight(new CqLightsource(loadLight(uses, code)));
+
+	const TqInt n = 9;
+	SqSurfacePoints a(shader.get(), n, 0);
+	SqSurfacePoints b(shader.get(), n, 2.5f);
+	// Grids a, a again, then b; the repeat and the uniform results for b
+	// may be reused.
+	SqSurfacePoints* grids[] = {&a, &a, &b, &b};
+	TqInt reusedBefore = gStats_getI(CqStats::SHD_lights_reused);
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		BOOST_TEST_CHECKPOINT("grid " << i);
+		IqShaderExecEnv& env = *grids[i]->env;
+		light->EvaluateCached(n-1, 0, n-1, n, false, env.P(), env.N(), 0);
+		freshLight->Initialise(n-1, 0, n-1, n, false);
+		freshLight->Evaluate(env.P(), env.N(), 0);
+		BOOST_CHECK(lightResults(*light, n) == lightResults(*freshLight, n));
+	}
+	return gStats_getI(CqStats::SHD_lights_reused) - reusedBefore;
+}
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_CASE(CqShaderVM_lightReuse_test, SqWorldFixture)
+{
+	BOOST_CHECK_EQUAL(loadLight(0, uniformLightCode)->lightReuse(), LightReuse_Uniform);
+	// The constant globals don't stop the results being uniform.
+	BOOST_CHECK_EQUAL(loadLight((1 << EnvVars_time) | (1 << EnvVars_ncomps)
+				| (1 << EnvVars_Ol), uniformLightCode)->lightReuse(), LightReuse_Uniform);
+	BOOST_CHECK_EQUAL(loadLight(1 << EnvVars_Ps, pointsLightCode)->lightReuse(),
+			LightReuse_Points);
+
+	// Reading any other global may make the results vary between points.
+	const EqEnvVars varying[] = {EnvVars_Cs, EnvVars_Os, EnvVars_Ng,
+		EnvVars_du, EnvVars_dv, EnvVars_P, EnvVars_dPdu, EnvVars_dPdv,
+		EnvVars_N, EnvVars_u, EnvVars_v, EnvVars_s, EnvVars_t, EnvVars_I,
+		EnvVars_Ci, EnvVars_Oi, EnvVars_Ps, EnvVars_E, EnvVars_alpha,
+		EnvVars_Ns};
+	for(TqUint i = 0; i < sizeof(varying)/sizeof(varying[0]); ++i)
+	{
+		BOOST_TEST_CHECKPOINT(gVariableNames[varying[i]]);
+		BOOST_CHECK_EQUAL(loadLight(1 << varying[i], uniformLightCode)->lightReuse(),
+				LightReuse_Points);
+	}
+
+	// Varying outputs are only reusable for the same points.
+	std::string outputCode = std::string(uniformLightCode) + "\tpushif 1\n\tpop x\n";
+	std::ostringstream program;
+	program << "lightsource\nAQSIS_V 2\n\n\nsegment Data\n\nUSES "
+		<< ((1 << EnvVars_L) | (1 << EnvVars_Cl))
+		<< "\n\noutput param varying float x\n\n\nsegment Init\n\tpushif 0\n\tpop x\n"
+		<< "\n\nsegment Code\n" << outputCode;
+	std::istringstream in(program.str());
+	BOOST_CHECK_EQUAL(createShaderVM(QGetRenderContext(), in, "")->lightReuse(),
+			LightReuse_Points);
+
+	// Random numbers are different on every run.
+	BOOST_CHECK_EQUAL(loadLight(0, "\tfrandom\n\tsetfc\n\tpop Cl\n")->lightReuse(),
+			LightReuse_None);
+}
+
+BOOST_FIXTURE_TEST_CASE(CqLightsource_EvaluateCached_test, SqWorldFixture)
+{
+	// A uniform light is reused for the repeated grid, and its uniform
+	// results for both evaluations of the other grid.
+	BOOST_CHECK_EQUAL(checkCachedResults(uniformLightCode, 0), 3);
+	// A light depending on the points is only reused for repeated grids.
+	BOOST_CHECK_EQUAL(checkCachedResults(pointsLightCode, 1 << EnvVars_Ps), 2);
+	// A light reading u is classified as varying, so is rerun on new grids
+	// even though this one happens not to use it.
+	BOOST_CHECK_EQUAL(checkCachedResults(uniformLightCode, 1 << EnvVars_u), 2);
+}
@@ -40,9 +40,6 @@
 namespace Aqsis {
 
 
-CqObjectPool<CqMicroPolygon> CqMicroPolygon::m_thePool;
-CqObjectPool<CqMovingMicroPolygonKey>	CqMovingMicroPolygonKey::m_thePool;
-
 void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>& surface)
 {
 	const IqAttributes& attrs = *pAttributes();
@@ -78,9 +75,7 @@ CqMicroPolyGrid::CqMicroPolyGrid() : CqMicroPolyGridBase(),
 	STATS_INC( GRD_allocated );
 	STATS_INC( GRD_current );
 	STATS_INC( GRD_allocated );
-	TqInt cGRD = STATS_GETI( GRD_current );
-	TqInt cPeak = STATS_GETI( GRD_peak );
-	STATS_SETI( GRD_peak, cGRD > cPeak ? cGRD : cPeak );
+	STATS_MAXI( GRD_peak, STATS_GETI( GRD_current ) );
 }
 
 
@@ -126,11 +121,11 @@ void CqMicroPolyGrid::Initialise( TqInt cu, TqInt cv, const boost::shared_ptr<Cq
 
 	/// \note This should delete through the interface that created it.
 
-	m_pShaderExecEnv->Initialise( cu, cv, numMicroPolygons(cu, cv), numShadingPoints(cu, cv), hasValidDerivatives(), pSurface->pAttributes(), pSurface->pTransform(), pSurface->pAttributes()->pshadSurface(QGetRenderContext()->Time()).get(), lUses );
+	boost::shared_ptr<IqShader> pshadSurface = threadShaderInstance(pSurface ->pAttributes() ->pshadSurface(QGetRenderContext()->Time()));
+	boost::shared_ptr<IqShader> pshadDisplacement = threadShaderInstance(pSurface ->pAttributes() ->pshadDisplacement(QGetRenderContext()->Time()));
+	boost::shared_ptr<IqShader> pshadAtmosphere = threadShaderInstance(pSurface ->pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time()));
 
-	boost::shared_ptr<IqShader> pshadSurface = pSurface ->pAttributes() ->pshadSurface(QGetRenderContext()->Time());
-	boost::shared_ptr<IqShader> pshadDisplacement = pSurface ->pAttributes() ->pshadDisplacement(QGetRenderContext()->Time());
-	boost::shared_ptr<IqShader> pshadAtmosphere = pSurface ->pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time());
+	m_pShaderExecEnv->Initialise( cu, cv, numMicroPolygons(cu, cv), numShadingPoints(cu, cv), hasValidDerivatives(), pSurface->pAttributes(), pSurface->pTransform(), pshadSurface.get(), lUses );
 
 	if ( pshadSurface )
 		pshadSurface->Initialise( cu, cv, numShadingPoints(cu, cv), m_pShaderExecEnv.get() );
@@ -342,12 +337,15 @@ void CqMicroPolyGrid::ExpandGridBoundaries(TqFloat amount)
 /** Shade the grid using the surface parameters of the surface passed and store the color values for each micropolygon.
  */
 
-void CqMicroPolyGrid::Shade( bool canCullGrid )
+void CqMicroPolyGrid::Shade( bool canCullGrid, const CqOcclusionTree* occlusionTree )
 {
 	// Sanity checks
 	if ( NULL == pVar(EnvVars_P) || NULL == pVar(EnvVars_I) )
 		return ;
 
+	AQSIS_TIME_SCOPE(Shade_grid);
+	AQSIS_TIME_SCOPE_NAMES(std::string(), pSurface()->strName());
+
 	TqInt lUses = pSurface() ->Uses();
 	TqInt gs = m_pShaderExecEnv->shadingPointCount();
 	TqInt gsmin1 = gs - 1;
@@ -414,10 +412,11 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 	if ( USES( lUses, EnvVars_Oi ) )
 		pVar(EnvVars_Oi) ->SetColor( gColWhite );
 
-	boost::shared_ptr<IqShader> pshadDisplacement = pSurface()->pAttributes()->pshadDisplacement(QGetRenderContext()->Time());
+	boost::shared_ptr<IqShader> pshadDisplacement = threadShaderInstance(pSurface()->pAttributes()->pshadDisplacement(QGetRenderContext()->Time()));
 	if ( pshadDisplacement )
 	{
 		AQSIS_TIME_SCOPE(Displacement_shading);
+		AQSIS_TIME_SCOPE_NAMES(pshadDisplacement->strName(), pSurface()->strName());
 		pshadDisplacement->Evaluate( m_pShaderExecEnv.get() );
 
 		// Re-calculate geometric normals and surface derivatives after displacement.
@@ -428,6 +427,25 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 			CalcSurfaceDerivatives();
 	}
 
+	// Cull the grid if it's hidden behind the samples already rendered,
+	// before it's shaded.  P is final now that displacement has been run.
+	if ( canCullGrid && occlusionTree && canOcclusionCull() )
+	{
+		bool occluded = false;
+		{
+			AQSIS_TIME_SCOPE(Occlusion_culling);
+			occluded = isOccluded( *occlusionTree, m_occludedRasterBound );
+		}
+		if ( occluded )
+		{
+			m_fCulled = true;
+			m_fOcclusionCulled = true;
+			STATS_INC( GRD_occlusion_culled );
+			DeleteVariables( true );
+			return ;
+		}
+	}
+
 	// Now try and cull any hidden MPs if Sides==1
 	if ( ( pAttributes() ->GetIntegerAttribute( "System", "Sides" ) [ 0 ] == 1 ) && !m_pCSGNode &&
 		 ( pAttributes() ->GetIntegerAttributeDef( "cull", "backfacing", 1 ) == 1 ) )
@@ -474,19 +492,21 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 	}
 
 	// Now shade the grid.
-	boost::shared_ptr<IqShader> pshadSurface = pSurface() ->pAttributes() ->pshadSurface(QGetRenderContext()->Time());
+	boost::shared_ptr<IqShader> pshadSurface = threadShaderInstance(pSurface() ->pAttributes() ->pshadSurface(QGetRenderContext()->Time()));
 	if ( pshadSurface )
 	{
 		AQSIS_TIME_SCOPE(Surface_shading);
+		AQSIS_TIME_SCOPE_NAMES(pshadSurface->strName(), pSurface()->strName());
 		m_pShaderExecEnv->SetCurrentSurface(pSurface());
 		pshadSurface->Evaluate( m_pShaderExecEnv.get() );
 	}
 
 	// Perform atmosphere shading
-	boost::shared_ptr<IqShader> pshadAtmosphere = pSurface()->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time());
+	boost::shared_ptr<IqShader> pshadAtmosphere = threadShaderInstance(pSurface()->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time()));
 	if ( pshadAtmosphere )
 	{
 		AQSIS_TIME_SCOPE(Atmosphere_shading);
+		AQSIS_TIME_SCOPE_NAMES(pshadAtmosphere->strName(), pSurface()->strName());
 		pshadAtmosphere->Evaluate( m_pShaderExecEnv.get() );
 	}
 
@@ -526,14 +546,50 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 					m_pShaderExecEnv->shadingPointCount() ) - 2, 0, 7 ) );
 }
 
+//---------------------------------------------------------------------
+/** Determine whether the grid is hidden behind the samples in the occlusion
+ * tree, from the raster bound of P.  The bound is returned in rasterBound,
+ * with z in camera space as for the cached raster bound of a surface.
+ *
+ * Micropolygons only have the bound of the grid points when nothing moves and
+ * there's no depth of field, so the grid is never culled otherwise.
+ */
+
+bool CqMicroPolyGrid::isOccluded( const CqOcclusionTree& occlusionTree, CqBound& rasterBound )
+{
+	if ( QGetRenderContext()->UsingDepthOfField()
+		 || pSurface()->pTransform()->cTimes() > 1
+		 || QGetRenderContext()->GetCameraTransform()->cTimes() > 1 )
+		return false;
+
+	CqMatrix matCameraToRaster;
+	QGetRenderContext() ->matSpaceToSpace( "camera", "raster", NULL, NULL, QGetRenderContext()->Time(), matCameraToRaster );
+
+	const CqVector3D* pP = NULL;
+	pVar(EnvVars_P) ->GetPointPtr( pP );
+	TqInt gs = m_pShaderExecEnv->shadingPointCount();
+	rasterBound = CqBound();
+	for ( TqInt i = 0; i < gs; i++ )
+	{
+		// Points behind the eye don't project sensibly.
+		if ( pP[ i ].z() <= 0 )
+			return false;
+		CqVector3D rasterP = matCameraToRaster * pP[ i ];
+		rasterP.z( pP[ i ].z() );
+		rasterBound.Encapsulate( rasterP );
+	}
+	return occlusionTree.canCull( rasterBound );
+}
+
+
 //---------------------------------------------------------------------
 /** Transfer any shader variables marked as "otuput" as they may be needed by the display devices.
  */
 
 void CqMicroPolyGrid::TransferOutputVariables()
 {
-	boost::shared_ptr<IqShader> pSurface = this->pAttributes()->pshadSurface(QGetRenderContext()->Time());
-	boost::shared_ptr<IqShader> pAtmosphere = this->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time());
+	boost::shared_ptr<IqShader> pSurface = threadShaderInstance(this->pAttributes()->pshadSurface(QGetRenderContext()->Time()));
+	boost::shared_ptr<IqShader> pAtmosphere = threadShaderInstance(this->pAttributes()->pshadAtmosphere(QGetRenderContext()->Time()));
 
 	// Only bother transferring ones that have been used in a RiDisplay request.
 	std::map<std::string, CqRenderer::SqOutputDataEntry>& outputVars = QGetRenderContext()->GetMapOfOutputDataEntries();
@@ -632,6 +688,8 @@ void CqMicroPolyGrid::DeleteVariables( bool all )
 
 //---------------------------------------------------------------------
 /** Split the shaded grid into microploygons, and insert them into the relevant buckets in the image buffer.
+ * When the "gridsampling" hider option is on and the grid doesn't move, it's
+ * inserted whole as a CqRasterGrid instead.
  * \param xmin Integer minimum extend of the image part being rendered, takes into account buckets and clipping.
  * \param xmax Integer maximum extend of the image part being rendered, takes into account buckets and clipping.
  * \param ymin Integer minimum extend of the image part being rendered, takes into account buckets and clipping.
@@ -763,6 +821,13 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 
 	ADDREF( this );
 
+	// With "gridsampling" on, a grid which doesn't move is kept intact and
+	// sampled quad by quad, rather than busted into micropolygons.
+	CqImageBuffer* imageBuffer = QGetRenderContext()->pImage();
+	CqRasterGridPtr rasterGrid;
+	if ( tTime == 1 && imageBuffer->optCache().gridSampling )
+		rasterGrid = new CqRasterGrid( this );
+
 	TqInt iv;
 //	bool tooSmall_ = false;
 //	TqFloat smallArea = 1.0;
@@ -834,25 +899,29 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 					fTrimmed = true;
 			}
 
-			if ( tTime > 1 )
+			if ( rasterGrid )
 			{
-				boost::shared_ptr<CqMicroPolygonMotion> pNew(new CqMicroPolygonMotion(this, iIndex));
+				rasterGrid->addQuad( iIndex, fTrimmed );
+			}
+			else if ( tTime > 1 )
+			{
+				boost::intrusive_ptr<CqMicroPolygonMotion> pNew(new CqMicroPolygonMotion(this, iIndex));
 				if ( fTrimmed )
 					pNew->MarkTrimmed();
 				std::map<TqFloat, TqInt>::iterator keyFrame;
 				for ( keyFrame = keyframeTimes.begin(); keyFrame!=keyframeTimes.end(); keyFrame++ )
 					pNew->AppendKey( aaPtimes[ keyFrame->second ][ iIndex ], aaPtimes[ keyFrame->second ][ iIndex + 1 ], aaPtimes[ keyFrame->second ][ iIndex + cu + 1 ], aaPtimes[ keyFrame->second ][ iIndex + cu + 2 ],  keyFrame->first);
 				pNew->Initialise();
-				boost::shared_ptr<CqMicroPolygon> pTemp(pNew);
-				QGetRenderContext()->pImage()->AddMPG( pTemp );
+				CqMicroPolygonPtr pTemp(pNew);
+				imageBuffer->AddMPG( pTemp );
 			}
 			else
 			{
-				boost::shared_ptr<CqMicroPolygon> pNew(new CqMicroPolygon(this, iIndex));
+				CqMicroPolygonPtr pNew(new CqMicroPolygon(this, iIndex));
 				if ( fTrimmed )
 					pNew->MarkTrimmed();
 				pNew->Initialise();
-				QGetRenderContext()->pImage()->AddMPG( pNew );
+				imageBuffer->AddMPG( pNew );
 			}
 
 			// Calculate MPG area
@@ -864,11 +933,9 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 			area *= 0.5f;
 			area = fabs(area);
 
-			STATS_SETF( MPG_average_area, STATS_GETF( MPG_average_area ) + area );
-			if( area < STATS_GETF( MPG_min_area ) )
-				STATS_SETF( MPG_min_area, area );
-			if( area > STATS_GETF( MPG_max_area ) )
-				STATS_SETF( MPG_max_area, area );
+			STATS_ADDF( MPG_average_area, area );
+			STATS_MINF( MPG_min_area, area );
+			STATS_MAXF( MPG_max_area, area );
 
 		//	smallArea = std::min(smallArea, area);
 		//	bigArea = std::max(bigArea, area);
@@ -878,6 +945,8 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 		//	}
 		}
 	}
+	if ( rasterGrid )
+		imageBuffer->AddRasterGrid( rasterGrid );
 	AQSIS_TIMER_STOP(Bust_grids);
 //	if(tooSmall_)
 //	{
@@ -917,7 +986,7 @@ CqMotionMicroPolyGrid::~CqMotionMicroPolyGrid()
 /** Shade the primary grid.
  */
 
-void CqMotionMicroPolyGrid::Shade( bool canCullGrid )
+void CqMotionMicroPolyGrid::Shade( bool canCullGrid, const CqOcclusionTree* occlusionTree )
 {
 	CqMicroPolyGrid * pGrid = static_cast<CqMicroPolyGrid*>( GetMotionObject( Time( 0 ) ) );
 	pGrid->Shade(false);
@@ -1132,11 +1201,11 @@ void CqMotionMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 					fTrimmed = true;
 			}
 
-			boost::shared_ptr<CqMicroPolygonMotion> pNew( new CqMicroPolygonMotion( this, iIndex ) );
+			boost::intrusive_ptr<CqMicroPolygonMotion> pNew( new CqMicroPolygonMotion( this, iIndex ) );
 			for ( iTime = 0; iTime < cTimes(); iTime++ )
 				pNew->AppendKey( aaPtimes[ iTime ][ iIndex ], aaPtimes[ iTime ][ iIndex + 1 ], aaPtimes[ iTime ][ iIndex + cu + 1 ], aaPtimes[ iTime ][ iIndex + cu + 2 ], Time( iTime ) );
 			pNew->Initialise();
-			boost::shared_ptr<CqMicroPolygon> pTemp( pNew );
+			CqMicroPolygonPtr pTemp( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pTemp );
 		}
 	}
@@ -1160,16 +1229,18 @@ void CqMotionMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 /** Default constructor
  */
 
-CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGrid( pGrid ), m_Index(Index), m_Flags( 0 )
+CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGrid( pGrid ), m_Index(Index), m_Flags( 0 ), m_refCount( 0 )
 {
 	STATS_INC( MPG_allocated );
 	STATS_INC( MPG_current );
-	TqInt cMPG = STATS_GETI( MPG_current );
-	TqInt cPeak = STATS_GETI( MPG_peak );
-	STATS_SETI( MPG_peak, cMPG > cPeak ? cMPG : cPeak );
+	STATS_MAXI( MPG_peak, STATS_GETI( MPG_current ) );
 	ADDREF(pGrid);
 }
 
+CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid ) : m_IndexCode( 0 ), m_pGrid( pGrid ), m_Index( 0 ), m_Flags( MicroPolyFlags_GridQuad ), m_refCount( 0 )
+{
+}
+
 
 //---------------------------------------------------------------------
 /** Destructor
@@ -1177,6 +1248,8 @@ CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGr
 
 CqMicroPolygon::~CqMicroPolygon()
 {
+	if ( m_Flags & MicroPolyFlags_GridQuad )
+		return;
 	if ( m_pGrid )
 		RELEASEREF( m_pGrid );
 	STATS_INC( MPG_deallocated );
@@ -1674,6 +1747,70 @@ void CqMicroPolygon::CalculateBound()
 
 
 
+//---------------------------------------------------------------------
+// CqRasterGrid implementation
+//---------------------------------------------------------------------
+
+CqRasterGrid::CqRasterGrid( CqMicroPolyGrid* pGrid )
+	: m_pGrid( pGrid ),
+	m_uGridRes( pGrid->uGridRes() ),
+	m_vGridRes( pGrid->vGridRes() ),
+	m_x(),
+	m_y(),
+	m_z(),
+	m_quadFlags(),
+	m_rowBounds( pGrid->vGridRes() ),
+	m_bound(),
+	m_numQuads( 0 ),
+	m_refCount( 0 )
+{
+	ADDREF( m_pGrid );
+	const CqVector3D* pP = NULL;
+	m_pGrid->pVar(EnvVars_P) ->GetPointPtr( pP );
+	TqInt numVerts = ( m_uGridRes + 1 ) * ( m_vGridRes + 1 );
+	m_x.resize( numVerts );
+	m_y.resize( numVerts );
+	m_z.resize( numVerts );
+	for ( TqInt i = 0; i < numVerts; ++i )
+	{
+		m_x[i] = pP[i].x();
+		m_y[i] = pP[i].y();
+		m_z[i] = pP[i].z();
+	}
+	m_quadFlags.resize( numVerts, 0 );
+}
+
+CqRasterGrid::~CqRasterGrid()
+{
+	RELEASEREF( m_pGrid );
+}
+
+void CqRasterGrid::addQuad( TqInt index, bool trimmed )
+{
+	m_quadFlags[index] = QuadFlags_Sampled | ( trimmed ? QuadFlags_Trimmed : 0 );
+	CqBound bound = quadBound( index );
+	m_rowBounds[index / ( m_uGridRes + 1 )].Encapsulate( &bound );
+	m_bound.Encapsulate( &bound );
+	++m_numQuads;
+}
+
+
+//---------------------------------------------------------------------
+// CqRasterGridQuad implementation
+//---------------------------------------------------------------------
+
+void CqRasterGridQuad::setQuad( TqInt index, const CqBound& bound )
+{
+	m_Index = index;
+	m_Flags = MicroPolyFlags_GridQuad;
+	if ( m_rasterGrid.isTrimmed( index ) )
+		m_Flags |= MicroPolyFlags_Trimmed;
+	ComputeVertexOrder();
+	m_Bound = bound;
+}
+
+
+
 //---------------------------------------------------------------------
 // CqMicroPolygonMotion implementation
 //---------------------------------------------------------------------
@@ -29,10 +29,14 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<aqsis/math/simd.h>
+
+#include	<boost/intrusive_ptr.hpp>
 #include	<boost/utility.hpp>
 
+#include	"arena.h"
+#include	"atomic.h"
 #include	"bilinear.h"
-#include	<aqsis/util/pool.h>
 #include	<aqsis/math/color.h>
 #include	<aqsis/util/list.h>
 #include	"bound.h"
@@ -49,6 +53,7 @@
 namespace Aqsis {
 
 class CqImageBuffer;
+class CqOcclusionTree;
 class CqSurface;
 class CqMicroPolygon;
 class CqBucketProcessor;
@@ -104,18 +109,35 @@ struct SqMpgSampleInfo
 class CqMicroPolyGridBase : public CqRefCount
 {
 	public:
-		CqMicroPolyGridBase() : m_fCulled( false ), m_fTriangular( false )
+		CqMicroPolyGridBase() : m_fCulled( false ), m_fOcclusionCulled( false ), m_fTriangular( false )
 		{}
 		virtual	~CqMicroPolyGridBase()
 		{}
 
+		/** Overridden operator new to allocate grids from the arena.
+		 */
+		void* operator new( size_t size )
+		{
+			return( CqArena::alloc( size ) );
+		}
+
+		/** Overridden operator delete to return grids to the arena.
+		 */
+		void operator delete( void* p, size_t size )
+		{
+			CqArena::free( p, size );
+		}
+
 		/** Pure virtual function, splits the grid into micropolys.
 		 * \param pBP Pointer to the bucket processor for the current bucket.
 		 */
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax ) = 0;
 		/** Pure virtual, shade the grid.
+		 * \param canCullGrid Whether the whole grid may be culled during shading.
+		 * \param occlusionTree If not null, the grid is culled before surface
+		 * shading when it's hidden behind the samples in this tree.
 		 */
-		virtual	void	Shade(bool canCullGrid = true ) = 0;
+		virtual	void	Shade(bool canCullGrid = true, const CqOcclusionTree* occlusionTree = 0 ) = 0;
 		virtual	void	TransferOutputVariables() = 0;
 		/*
 		 * Delete all the variables per grid 
@@ -134,6 +156,20 @@ class CqMicroPolyGridBase : public CqRefCount
 		{
 			return m_fCulled;
 		}
+		/** Query whether the grid was culled by the occlusion tree passed to
+		 * Shade(), in which case it may still be visible in other buckets.
+		 */
+		bool vfOcclusionCulled() const
+		{
+			return m_fOcclusionCulled;
+		}
+		/** Get the raster bound of the displaced grid points, as tested
+		 * against the occlusion tree.  Only set if vfOcclusionCulled().
+		 */
+		const CqBound& occludedRasterBound() const
+		{
+			return m_occludedRasterBound;
+		}
 		/** Query whether this grid is being rendered as a triangle.
 		 */
 		virtual bool fTriangular() const
@@ -197,6 +233,8 @@ class CqMicroPolyGridBase : public CqRefCount
 
 	protected:
 		bool m_fCulled; ///< Boolean indicating the entire grid is culled.
+		bool m_fOcclusionCulled; ///< Boolean indicating the grid was culled as hidden before surface shading.
+		CqBound m_occludedRasterBound; ///< Raster bound of the grid points when culled as hidden.
 		CqTriangleSplitLine	m_TriangleSplitLine;	///< Two endpoints of the line that is used to turn the quad into a triangle at sample time.
 		bool	m_fTriangular;			///< Flag indicating that this grid should be rendered as a triangular grid with a phantom fourth corner.
 
@@ -289,7 +327,7 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 
 		// Overrides from CqMicroPolyGridBase
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
-		virtual	void	Shade( bool canCullGrid = true );
+		virtual	void	Shade( bool canCullGrid = true, const CqOcclusionTree* occlusionTree = 0 );
 		virtual	void	TransferOutputVariables();
 
 		/** Get a pointer to the surface which this grid belongs.
@@ -378,8 +416,20 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		 *  Set the value of dv if needed, dv is constant across the grid being shaded.
 		 */
 		virtual void setDv();
+		/** \brief Determine whether the grid can be culled from the raster
+		 * bound of its shading points.
+		 *
+		 * This is false for grids whose micropolygons extend beyond the
+		 * shading points, such as points.
+		 */
+		virtual bool canOcclusionCull() const
+		{
+			return true;
+		}
 
 	private:
+		bool	isOccluded( const CqOcclusionTree& occlusionTree, CqBound& rasterBound );
+
 		bool	m_bShadingNormals;		///< Flag indicating shading normals have been filled in and don't need to be calculated during shading.
 		bool	m_bGeometricNormals;	///< Flag indicating geometric normals have been filled in and don't need to be calculated during shading.
 		boost::shared_ptr<CqSurface> m_pSurface;	///< Pointer to the surface for this grid.
@@ -408,7 +458,7 @@ class CqMotionMicroPolyGrid : public CqMicroPolyGridBase, public CqMotionSpec<Cq
 
 
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
-		virtual	void	Shade( bool canCullGrid = true );
+		virtual	void	Shade( bool canCullGrid = true, const CqOcclusionTree* occlusionTree = 0 );
 		virtual	void	TransferOutputVariables();
 		
 		/**
@@ -550,6 +600,53 @@ struct CqHitTestCache
 	CqInvBilinear xyToUV;
 };
 
+#ifdef AQSIS_SIMD_SSE2
+//----------------------------------------------------------------------
+/** \class CqHitTest4
+ * Bound, occlusion and edge tests for four samples at once.
+ *
+ * The edge equations cached in a CqHitTestCache are splatted across SSE
+ * registers and evaluated for four samples together.  The arithmetic is the
+ * same as in CqMicroPolygon::fContains(), so a sample passes here exactly
+ * when it passes there.  Only valid for micropolygons where
+ * hasSimpleEdgeTest() is true.
+ */
+class CqHitTest4
+{
+	public:
+		/** \brief Splat the hit test coefficients.
+		 *
+		 * \param cache - cache filled by CacheHitTestValues() without DoF.
+		 * \param bound - bound of the micropolygon.
+		 * \param cullable - if true, samples with an occluding hit nearer
+		 *                   than the bound are rejected.
+		 */
+		CqHitTest4(const CqHitTestCache& cache, const CqBound& bound, bool cullable);
+
+		/** \brief Test count consecutive samples, with 1 <= count <= 4.
+		 *
+		 * \param samples - samples to test.
+		 * \param count - number of samples.
+		 * \param inBound - returns a bit mask of the samples which are in the
+		 *                  bound and not occluded.
+		 * \return A bit mask of the samples which hit the micropolygon.
+		 */
+		int contains(const SqSampleData* samples, int count, int& inBound) const;
+
+	private:
+		__m128 m_minX;
+		__m128 m_minY;
+		__m128 m_maxX;
+		__m128 m_maxY;
+		__m128 m_minZ;
+		bool m_cullable;
+		__m128 m_X[4];
+		__m128 m_Y[4];
+		__m128 m_XMultiplier[4];
+		__m128 m_YMultiplier[4];
+};
+#endif
+
 //----------------------------------------------------------------------
 /** \class CqMicroPolygon
  * Abstract base class from which static and motion micropolygons are derived.
@@ -569,19 +666,20 @@ class CqMicroPolygon : boost::noncopyable
 		CqMicroPolygon( CqMicroPolyGridBase* pGrid, TqInt Index );
 		virtual	~CqMicroPolygon();
 
-		/** Overridden operator new to allocate micropolys from a pool.
-		 * \todo Review: Unused parameter size
+		/** Overridden operator new to allocate micropolys from the arena.
+		 *
+		 * Derived micropolygons are allocated in the same way.
 		 */
 		void* operator new( size_t size )
 		{
-			return( m_thePool.alloc() );
+			return( CqArena::alloc( size ) );
 		}
 
-		/** Overridden operator delete to allocate micropolys from a pool.
+		/** Overridden operator delete to return micropolys to the arena.
 		 */
-		void operator delete( void* p )
+		void operator delete( void* p, size_t size )
 		{
-			m_thePool.free( reinterpret_cast<CqMicroPolygon*>(p) );
+			CqArena::free( p, size );
 		}
 
 #ifdef _DEBUG
@@ -591,12 +689,23 @@ class CqMicroPolygon : boost::noncopyable
 		}
 #endif
 
-	private:
+	protected:
+		/** Constructor for a micropolygon which views the quads of a grid one
+		 * after another, see CqRasterGridQuad.
+		 *
+		 * The grid is kept alive by the owner of the view, so no reference to
+		 * it is taken, and the view isn't counted as an allocated micropolygon.
+		 *
+		 * \param pGrid CqMicroPolyGrid pointer.
+		 */
+		explicit CqMicroPolygon( CqMicroPolyGridBase* pGrid );
+
 		enum EqMicroPolyFlags
 		{
 			MicroPolyFlags_Trimmed		= 0x0001,
 			MicroPolyFlags_Hit		= 0x0002,
 			MicroPolyFlags_PushedForward	= 0x0004,
+			MicroPolyFlags_GridQuad		= 0x0008,
 		};
 
 	public:
@@ -696,6 +805,18 @@ class CqMicroPolygon : boost::noncopyable
 			return false;
 		}
 
+		/** \brief Determine whether a hit is decided by the edge test alone.
+		 *
+		 * When true, Sample() without DoF hits exactly the samples inside
+		 * the four edges cached by CacheHitTestValues(), so samples can be
+		 * tested in bulk.  Degenerate and trimmed micropolygons, and
+		 * derived classes with their own hit test, return false.
+		 */
+		virtual bool hasSimpleEdgeTest() const
+		{
+			return !( m_IndexCode & Degeneracy_Mask ) && !IsTrimmed();
+		}
+
 		/** Check if the sample point is within the micropoly.
 		 * \param vecSample 2D sample point.
 		 * \param time The frame time at which to check.
@@ -812,10 +933,213 @@ class CqMicroPolygon : boost::noncopyable
 		void cachePointInPolyTest(CqHitTestCache& cache, CqVector3D* points) const;
 
 	private:
-		static	CqObjectPool<CqMicroPolygon> m_thePool;
+		/// boost::intrusive_ptr required function, to increment the reference count.
+		friend void intrusive_ptr_add_ref(CqMicroPolygon* p);
+		/// boost::intrusive_ptr required function, to decrement the reference
+		/// count and delete if necessary.
+		friend void intrusive_ptr_release(CqMicroPolygon* p);
+
+		/// Number of buckets holding the micropolygon.
+		TqInt m_refCount;
 }
 ;
 
+/** \brief Intrusive reference counted pointer to a micropolygon.
+ *
+ * A micropolygon is held by each bucket it touches until that bucket has
+ * been sampled.  Keeping the count in the micropolygon saves the separate
+ * allocation which boost::shared_ptr would need.
+ */
+typedef boost::intrusive_ptr<CqMicroPolygon> CqMicroPolygonPtr;
+
+inline void intrusive_ptr_add_ref(CqMicroPolygon* p)
+{
+	atomicAddAndFetch(p->m_refCount, 1);
+}
+
+inline void intrusive_ptr_release(CqMicroPolygon* p)
+{
+	if(atomicAddAndFetch(p->m_refCount, -1) == 0)
+		delete p;
+}
+
+
+//----------------------------------------------------------------------
+/** \class CqRasterGrid
+ * A shaded grid which is sampled intact rather than busted into individual
+ * micropolygons.
+ *
+ * With the "gridsampling" hider option turned on, CqMicroPolyGrid::Split()
+ * makes one of these in place of a CqMicroPolygon for each quad of a grid
+ * which doesn't move.  The raster space vertex positions are kept as separate
+ * x, y and z arrays, alongside a flag per quad saying whether it is to be
+ * sampled at all and whether it is trimmed.  The shader output variables stay
+ * in the shaded grid, which is held for as long as the raster grid is.
+ *
+ * A raster grid is held by every bucket which its bound touches, and the
+ * bucket processor samples its quads in grid order.
+ */
+class CqRasterGrid : boost::noncopyable
+{
+	public:
+		/** Copy the raster space vertex positions of a grid which has been
+		 * projected by Split().  No quads are sampled to start with.
+		 *
+		 * \param pGrid - grid to sample.
+		 */
+		CqRasterGrid( CqMicroPolyGrid* pGrid );
+		~CqRasterGrid();
+
+		/// Overridden operator new to allocate raster grids from the arena.
+		void* operator new( size_t size )
+		{
+			return( CqArena::alloc( size ) );
+		}
+		/// Overridden operator delete to return raster grids to the arena.
+		void operator delete( void* p, size_t size )
+		{
+			CqArena::free( p, size );
+		}
+
+		/** Mark a quad to be sampled.
+		 *
+		 * \param index - grid index of the top left vertex of the quad.
+		 * \param trimmed - true if a trim curve may pass through the quad.
+		 */
+		void addQuad( TqInt index, bool trimmed );
+
+		/// Get the shaded grid.
+		CqMicroPolyGrid* pGrid() const
+		{
+			return m_pGrid;
+		}
+		/// Number of quads in the u direction.
+		TqInt uGridRes() const
+		{
+			return m_uGridRes;
+		}
+		/// Number of quads in the v direction.
+		TqInt vGridRes() const
+		{
+			return m_vGridRes;
+		}
+		/// Number of quads to be sampled.
+		TqInt numQuads() const
+		{
+			return m_numQuads;
+		}
+		/// Tight raster bound of the quads to be sampled.
+		const CqBound& GetBound() const
+		{
+			return m_bound;
+		}
+		/// Tight raster bound of the quads to be sampled in row iv of the grid.
+		const CqBound& rowBound( TqInt iv ) const
+		{
+			return m_rowBounds[iv];
+		}
+		/// Determine whether the quad with the given grid index is sampled.
+		bool isSampled( TqInt index ) const
+		{
+			return ( m_quadFlags[index] & QuadFlags_Sampled ) != 0;
+		}
+		/// Determine whether the quad with the given grid index is trimmed.
+		bool isTrimmed( TqInt index ) const
+		{
+			return ( m_quadFlags[index] & QuadFlags_Trimmed ) != 0;
+		}
+		/// Compute the tight raster bound of the quad with the given grid index.
+		CqBound quadBound( TqInt index ) const;
+
+	private:
+		enum EqQuadFlags
+		{
+			QuadFlags_Sampled = 0x01,
+			QuadFlags_Trimmed = 0x02,
+		};
+
+		/// boost::intrusive_ptr required function, to increment the reference count.
+		friend void intrusive_ptr_add_ref(CqRasterGrid* p);
+		/// boost::intrusive_ptr required function, to decrement the reference
+		/// count and delete if necessary.
+		friend void intrusive_ptr_release(CqRasterGrid* p);
+
+		CqMicroPolyGrid* m_pGrid;	///< Shaded grid, holding the output variables.
+		TqInt m_uGridRes;
+		TqInt m_vGridRes;
+		/// Raster space vertex positions, indexed in the same way as the grid.
+		std::vector<TqFloat> m_x;
+		std::vector<TqFloat> m_y;
+		std::vector<TqFloat> m_z;
+		/// EqQuadFlags for each quad, indexed by the grid index of its top left vertex.
+		std::vector<TqUchar> m_quadFlags;
+		/// Bound of the sampled quads in each row.
+		std::vector<CqBound> m_rowBounds;
+		CqBound m_bound;
+		TqInt m_numQuads;
+		/// Number of buckets holding the raster grid.
+		TqInt m_refCount;
+};
+
+/// Intrusive reference counted pointer to a raster grid.
+typedef boost::intrusive_ptr<CqRasterGrid> CqRasterGridPtr;
+
+inline void intrusive_ptr_add_ref(CqRasterGrid* p)
+{
+	atomicAddAndFetch(p->m_refCount, 1);
+}
+
+inline void intrusive_ptr_release(CqRasterGrid* p)
+{
+	if(atomicAddAndFetch(p->m_refCount, -1) == 0)
+		delete p;
+}
+
+inline CqBound CqRasterGrid::quadBound( TqInt index ) const
+{
+	TqInt a = index;
+	TqInt b = index + 1;
+	TqInt c = index + m_uGridRes + 1;
+	TqInt d = index + m_uGridRes + 2;
+	return CqBound(
+		std::min( std::min( m_x[a], m_x[b] ), std::min( m_x[c], m_x[d] ) ),
+		std::min( std::min( m_y[a], m_y[b] ), std::min( m_y[c], m_y[d] ) ),
+		std::min( std::min( m_z[a], m_z[b] ), std::min( m_z[c], m_z[d] ) ),
+		std::max( std::max( m_x[a], m_x[b] ), std::max( m_x[c], m_x[d] ) ),
+		std::max( std::max( m_y[a], m_y[b] ), std::max( m_y[c], m_y[d] ) ),
+		std::max( std::max( m_z[a], m_z[b] ), std::max( m_z[c], m_z[d] ) ) );
+}
+
+
+//----------------------------------------------------------------------
+/** \class CqRasterGridQuad
+ * A micropolygon which is moved across the quads of a CqRasterGrid.
+ *
+ * The bucket processor samples a raster grid by pointing one of these at each
+ * quad in turn, so the usual micropolygon sampling code is used without a
+ * micropolygon being allocated, bound into buckets or reference counted per
+ * quad.
+ */
+class CqRasterGridQuad : public CqMicroPolygon
+{
+	public:
+		CqRasterGridQuad( const CqRasterGrid& rasterGrid )
+			: CqMicroPolygon( rasterGrid.pGrid() ),
+			m_rasterGrid( rasterGrid )
+		{ }
+
+		/** Point the micropolygon at a quad of the grid.
+		 *
+		 * \param index - grid index of the top left vertex of the quad.
+		 * \param bound - bound of the quad, from CqRasterGrid::quadBound().
+		 */
+		void setQuad( TqInt index, const CqBound& bound );
+
+	private:
+		const CqRasterGrid& m_rasterGrid;
+};
+
+
 
 
 //----------------------------------------------------------------------
@@ -835,19 +1159,18 @@ class CqMovingMicroPolygonKey
 			m_BoundReady(false)
 		{ }
 
-		/** Overridden operator new to allocate micropolys from a pool.
-		 * \todo Review: Unused parameter size
+		/** Overridden operator new to allocate keys from the arena.
 		 */
 		void* operator new( size_t size )
 		{
-			return( m_thePool.alloc() );
+			return( CqArena::alloc( size ) );
 		}
 
-		/** Overridden operator delete to allocate micropolys from a pool.
+		/** Overridden operator delete to return keys to the arena.
 		 */
-		void operator delete( void* p )
+		void operator delete( void* p, size_t size )
 		{
-			m_thePool.free( reinterpret_cast<CqMovingMicroPolygonKey*>(p) );
+			CqArena::free( p, size );
 		}
 
 
@@ -862,8 +1185,6 @@ class CqMovingMicroPolygonKey
 	protected:
 		CqBound m_Bound;
 		bool	m_BoundReady;
-
-		static	CqObjectPool<CqMovingMicroPolygonKey>	m_thePool;
 }
 ;
 
@@ -892,20 +1213,6 @@ class CqMicroPolygonMotion : public CqMicroPolygon
 		 */
 		virtual void Initialise();
 
-		/** Overridden operator new to avoid the pool allocator from CqMicroPolygon.
-		 */
-		void* operator new( size_t size )
-		{
-			return( malloc(size) );
-		}
-
-		/** Overridden operator delete to allocate micropolys from a pool.
-		 */
-		void operator delete( void* p )
-		{
-			free( p );
-		}
-
 
 	public:
 		void	AppendKey( const CqVector3D& vA, const CqVector3D& vB, const CqVector3D& vC, const CqVector3D& vD, TqFloat time );
@@ -990,6 +1297,67 @@ inline void CqMicroPolyGrid::setDv()
 
 //-----------------------------------------------------------------------
 
+#ifdef AQSIS_SIMD_SSE2
+//----------------------------------------------------------------------
+inline CqHitTest4::CqHitTest4(const CqHitTestCache& cache, const CqBound& bound,
+		bool cullable)
+	: m_minX(_mm_set1_ps(bound.vecMin().x())),
+	m_minY(_mm_set1_ps(bound.vecMin().y())),
+	m_maxX(_mm_set1_ps(bound.vecMax().x())),
+	m_maxY(_mm_set1_ps(bound.vecMax().y())),
+	m_minZ(_mm_set1_ps(bound.vecMin().z())),
+	m_cullable(cullable)
+{
+	for(int e = 0; e < 4; ++e)
+	{
+		m_X[e] = _mm_set1_ps(cache.m_X[e]);
+		m_Y[e] = _mm_set1_ps(cache.m_Y[e]);
+		m_XMultiplier[e] = _mm_set1_ps(cache.m_XMultiplier[e]);
+		m_YMultiplier[e] = _mm_set1_ps(cache.m_YMultiplier[e]);
+	}
+}
+
+inline int CqHitTest4::contains(const SqSampleData* samples, int count,
+		int& inBound) const
+{
+	assert(count >= 1 && count <= 4);
+	// Unused lanes repeat the last sample and are masked off below.
+	const SqSampleData& s0 = samples[0];
+	const SqSampleData& s1 = samples[count > 1 ? 1 : 0];
+	const SqSampleData& s2 = samples[count > 2 ? 2 : 0];
+	const SqSampleData& s3 = samples[count > 3 ? 3 : 0];
+	__m128 x = _mm_setr_ps(s0.position.x(), s1.position.x(),
+			s2.position.x(), s3.position.x());
+	__m128 y = _mm_setr_ps(s0.position.y(), s1.position.y(),
+			s2.position.y(), s3.position.y());
+	// The negated comparisons match CqBound::Contains2D() and the scalar
+	// occlusion test.
+	__m128 pass = _mm_and_ps(
+			_mm_and_ps(_mm_cmpnlt_ps(x, m_minX), _mm_cmpngt_ps(x, m_maxX)),
+			_mm_and_ps(_mm_cmpnlt_ps(y, m_minY), _mm_cmpngt_ps(y, m_maxY)));
+	if(m_cullable)
+	{
+		__m128 occlZ = _mm_setr_ps(s0.occlZ, s1.occlZ, s2.occlZ, s3.occlZ);
+		pass = _mm_and_ps(pass, _mm_cmpngt_ps(m_minZ, occlZ));
+	}
+	inBound = _mm_movemask_ps(pass) & ((1 << count) - 1);
+	if(!inBound)
+		return 0;
+	// The first two edges exclude points on the edge, the second two
+	// include them, as in fContains().
+	const __m128 zero = _mm_setzero_ps();
+	for(int e = 0; e < 4; ++e)
+	{
+		__m128 side = _mm_sub_ps(
+				_mm_mul_ps(_mm_sub_ps(y, m_Y[e]), m_YMultiplier[e]),
+				_mm_mul_ps(_mm_sub_ps(x, m_X[e]), m_XMultiplier[e]));
+		pass = _mm_and_ps(pass, (e & 2) ? _mm_cmpnlt_ps(side, zero)
+				: _mm_cmpnle_ps(side, zero));
+	}
+	return _mm_movemask_ps(pass) & inBound;
+}
+#endif
+
 } // namespace Aqsis
 
 #endif	// !MICROPOLYGON_H_INCLUDED
@@ -0,0 +1,368 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for sampling grids without busting them into
+ * micropolygons.
+ */
+
+#include "micropolygon.h"
+
+#include <sstream>
+#include <vector>
+
+#include <aqsis/ri/ri.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "debugdd.h"
+#include "renderer.h"
+#include "stats.h"
+
+using namespace Aqsis;
+
+namespace {
+
+/// Sets up a world block for a test, and tears it down again.
+struct SqWorldFixture
+{
+	SqWorldFixture()
+	{
+		RiBegin(RI_NULL);
+		RiWorldBegin();
+	}
+	~SqWorldFixture()
+	{
+		RiWorldEnd();
+		RiEnd();
+	}
+};
+
+const TqInt cu = 3;
+const TqInt cv = 3;
+
+/// Raster position of vertex (u,v) of the test grid.
+CqVector3D gridVertex(TqInt u, TqInt v)
+{
+	return CqVector3D(10.0f*u + v, 8.0f*v - 0.5f*u*u, 1.0f + 0.25f*u + v);
+}
+
+/** Make a grid holding only the vertex positions, in raster space.
+ *
+ * The grid is owned by the raster grid made from it.
+ */
+CqMicroPolyGrid* createGrid()
+{
+	std::ostringstream program;
+	program << "surface\nAQSIS_V 2\n\n\nsegment Data\n\nUSES " << (1 << EnvVars_P)
+		<< "\n\n\nsegment Init\n\n\nsegment Code\n";
+	std::istringstream in(program.str());
+	boost::shared_ptr<IqShader> shader = createShaderVM(QGetRenderContext(), in, "");
+
+	CqMicroPolyGrid* grid = new CqMicroPolyGrid();
+	TqInt numVerts = (cu+1)*(cv+1);
+	grid->pShaderExecEnv()->Initialise(cu, cv, cu*cv, numVerts, false,
+			IqAttributesPtr(), IqTransformPtr(), shader.get(), 1 << EnvVars_P);
+	for(TqInt v = 0, i = 0; v <= cv; ++v)
+	{
+		for(TqInt u = 0; u <= cu; ++u, ++i)
+			grid->pVar(EnvVars_P)->SetPoint(gridVertex(u, v), i);
+	}
+	return grid;
+}
+
+void checkBoundsEqual(const CqBound& a, const CqBound& b)
+{
+	BOOST_CHECK(a.vecMin() == b.vecMin());
+	BOOST_CHECK(a.vecMax() == b.vecMax());
+}
+
+bool isEmpty(const CqBound& bound)
+{
+	return bound.vecMin().x() > bound.vecMax().x();
+}
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_CASE(CqRasterGrid_addQuad_test, SqWorldFixture)
+{
+	CqRasterGridPtr rasterGrid(new CqRasterGrid(createGrid()));
+	BOOST_CHECK_EQUAL(rasterGrid->uGridRes(), cu);
+	BOOST_CHECK_EQUAL(rasterGrid->vGridRes(), cv);
+	BOOST_CHECK_EQUAL(rasterGrid->numQuads(), 0);
+	for(TqInt iv = 0; iv < cv; ++iv)
+		BOOST_CHECK(isEmpty(rasterGrid->rowBound(iv)));
+
+	// The quad bounds enclose exactly the four corners of each quad.
+	for(TqInt v = 0; v < cv; ++v)
+	{
+		for(TqInt u = 0; u < cu; ++u)
+		{
+			TqInt index = v*(cu+1) + u;
+			BOOST_CHECK(!rasterGrid->isSampled(index));
+			CqBound expected;
+			for(TqInt k = 0; k < 4; ++k)
+			{
+				CqVector3D vert = gridVertex(u + k%2, v + k/2);
+				expected.Encapsulate(vert);
+			}
+			checkBoundsEqual(rasterGrid->quadBound(index), expected);
+		}
+	}
+
+	// Sample two quads of the first row and one trimmed quad of the last,
+	// leaving the middle row empty.
+	rasterGrid->addQuad(0, false);
+	rasterGrid->addQuad(2, false);
+	TqInt lastRow = 2*(cu+1);
+	rasterGrid->addQuad(lastRow + 1, true);
+	BOOST_CHECK_EQUAL(rasterGrid->numQuads(), 3);
+
+	BOOST_CHECK(rasterGrid->isSampled(0));
+	BOOST_CHECK(!rasterGrid->isSampled(1));
+	BOOST_CHECK(rasterGrid->isSampled(2));
+	BOOST_CHECK(rasterGrid->isSampled(lastRow + 1));
+	BOOST_CHECK(!rasterGrid->isTrimmed(0));
+	BOOST_CHECK(!rasterGrid->isTrimmed(2));
+	BOOST_CHECK(rasterGrid->isTrimmed(lastRow + 1));
+	for(TqInt index = cu+1; index < 2*(cu+1) - 1; ++index)
+		BOOST_CHECK(!rasterGrid->isSampled(index));
+
+	CqBound firstRow = rasterGrid->quadBound(0);
+	CqBound quad2 = rasterGrid->quadBound(2);
+	firstRow.Encapsulate(&quad2);
+	checkBoundsEqual(rasterGrid->rowBound(0), firstRow);
+	BOOST_CHECK(isEmpty(rasterGrid->rowBound(1)));
+	checkBoundsEqual(rasterGrid->rowBound(2), rasterGrid->quadBound(lastRow + 1));
+
+	CqBound all = firstRow;
+	CqBound last = rasterGrid->quadBound(lastRow + 1);
+	all.Encapsulate(&last);
+	checkBoundsEqual(rasterGrid->GetBound(), all);
+}
+
+namespace {
+
+/** Render a frame with grid sampling on or off, and return the pixels.
+ *
+ * The frame has surfaces partly off the image, a trimmed patch, and
+ * optionally depth of field.
+ */
+std::vector<unsigned char> renderFrame(RtInt gridSampling, bool dof)
+{
+	RiBegin(RI_NULL);
+	RtString debugDisplay = const_cast<char*>("debugdd");
+	RiOption(const_cast<char*>("display"), "string gridtest", &debugDisplay, RI_NULL);
+	RtInt bucketSize[2] = {8, 8};
+	RiOption(const_cast<char*>("limits"), "bucketsize", bucketSize, RI_NULL);
+	RiHider(const_cast<char*>("hidden"), "integer gridsampling", &gridSampling, RI_NULL);
+
+	RiDisplay(const_cast<char*>("grid"), const_cast<char*>("gridtest"), RI_RGBAZ, RI_NULL);
+	RiFormat(48, 40, 1);
+	RiPixelSamples(2, 2);
+	RiQuantize(RI_RGBA, 0, 0, 0, 0);
+	RtFloat fov = 40;
+	RiProjection(RI_PERSPECTIVE, RI_FOV, &fov, RI_NULL);
+	if(dof)
+		RiDepthOfField(2.8f, 0.5f, 4.5f);
+	RiTranslate(0, 0, 5);
+
+	RiWorldBegin();
+	RtColor opacity = {0.7f, 0.7f, 0.7f};
+	RiOpacity(opacity);
+	for(TqInt i = 0; i < 5; ++i)
+	{
+		RiAttributeBegin();
+		RtColor col = {0.2f*i, 1 - 0.15f*i, 0.4f};
+		RiColor(col);
+		// The outer spheres lie partly off the image.
+		RiTranslate(0.9f*(i%3) - 0.9f, 0.8f*(i/3) - 0.6f, 0.3f*i);
+		RiRotate(25.0f*i, 1, 0, 1);
+		RiSphere(0.55f, -0.55f, 0.55f, 300);
+		RiAttributeEnd();
+	}
+
+	// A patch with a hole cut in it.
+	RiAttributeBegin();
+	RiTranslate(0, 0, -0.5f);
+	RtInt nloops = 1;
+	RtInt ncurves = 1;
+	RtInt order = 3;
+	RtFloat knot[] = {0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+	RtFloat amin = 0;
+	RtFloat amax = 4;
+	RtInt n = 9;
+	RtFloat u[] = {0.5f, 0.8f, 0.8f, 0.8f, 0.5f, 0.2f, 0.2f, 0.2f, 0.5f};
+	RtFloat v[] = {0.2f, 0.2f, 0.5f, 0.8f, 0.8f, 0.8f, 0.5f, 0.2f, 0.2f};
+	RtFloat w[] = {1, 0.707f, 1, 0.707f, 1, 0.707f, 1, 0.707f, 1};
+	RiTrimCurve(nloops, &ncurves, &order, knot, &amin, &amax, &n, u, v, w);
+	RtFloat uknot[] = {0, 0, 1, 1};
+	RtFloat vknot[] = {0, 0, 1, 1};
+	RtFloat P[] = {-0.6f, -0.5f, 0,  0.6f, -0.5f, 0.2f,
+		-0.6f, 0.5f, 0.2f,  0.6f, 0.5f, 0};
+	RiNuPatch(2, 2, uknot, 0, 1, 2, 2, vknot, 0, 1, RI_P, P, RI_NULL);
+	RiAttributeEnd();
+	RiWorldEnd();
+	RiEnd();
+
+	const SqDebugDspyImage& img = DebugDspyLastImage();
+	BOOST_REQUIRE_EQUAL(img.width, 48);
+	BOOST_REQUIRE_EQUAL(img.height, 40);
+	return img.data;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqRasterGrid_gridsampling_matches_busting_test)
+{
+	// Sampling the grids intact must give exactly the same image as busting
+	// them into micropolygons.
+	for(TqInt dof = 0; dof < 2; ++dof)
+	{
+		BOOST_TEST_CHECKPOINT("depth of field " << dof);
+		std::vector<unsigned char> busted = renderFrame(0, dof != 0);
+		std::vector<unsigned char> sampled = renderFrame(1, dof != 0);
+		BOOST_CHECK(busted == sampled);
+	}
+}
+
+namespace {
+
+/// Result of a render for the grid occlusion tests.
+struct SqOcclusionRender
+{
+	std::vector<float> pixels;
+	TqInt gridsCulled;
+};
+
+/// Add a bilinear patch with corners (x0,y0) and (x1,y1) at depth z.
+void occlusionPatch(RtFloat x0, RtFloat y0, RtFloat x1, RtFloat y1, RtFloat z)
+{
+	RtFloat P[] = {x0, y0, z,  x1, y0, z,  x0, y1, z,  x1, y1, z};
+	RiPatch(RI_BILINEAR, RI_P, P, RI_NULL);
+}
+
+/** Render a frame of patches behind an opaque square, with grid occlusion
+ * culling on or off.
+ *
+ * The square covers raster x and y from about 5 to 27 of the 32x32 image.
+ * The hidden patch lies well inside it, but has a displacement bound which
+ * reaches past its edges so that the patch isn't culled by its bound in the
+ * first bucket.  The partly visible patch pokes out past the right edge.
+ */
+SqOcclusionRender renderOcclusionFrame(RtInt gridOcclusion, bool hidden,
+		bool partlyVisible)
+{
+	RiBegin(RI_NULL);
+	RtString debugDisplay = const_cast<char*>("debugdd");
+	RiOption(const_cast<char*>("display"), "string occltest", &debugDisplay, RI_NULL);
+	RtInt bucketSize[2] = {8, 8};
+	RiOption(const_cast<char*>("limits"), "bucketsize", bucketSize, RI_NULL);
+	RiHider(const_cast<char*>("hidden"), "integer gridocclusion", &gridOcclusion, RI_NULL);
+
+	RiDisplay(const_cast<char*>("occlusion"), const_cast<char*>("occltest"), RI_RGBA, RI_NULL);
+	RiFormat(32, 32, 1);
+	RiPixelSamples(2, 2);
+	RiQuantize(RI_RGBA, 0, 0, 0, 0);
+	RtFloat fov = 40;
+	RiProjection(RI_PERSPECTIVE, RI_FOV, &fov, RI_NULL);
+
+	RiWorldBegin();
+	RtColor green = {0, 1, 0};
+	RiColor(green);
+	occlusionPatch(-1, -1, 1, 1, 4);
+	if(hidden)
+	{
+		RiAttributeBegin();
+		RtFloat dispBound = 1.5f;
+		RiAttribute(const_cast<char*>("displacementbound"), "float sphere",
+				&dispBound, RI_NULL);
+		occlusionPatch(-0.5f, -0.5f, 0.5f, 0.5f, 6);
+		RiAttributeEnd();
+	}
+	if(partlyVisible)
+	{
+		RtColor red = {1, 0, 0};
+		RiColor(red);
+		occlusionPatch(1, -0.5f, 2, 0.5f, 6);
+	}
+	RiWorldEnd();
+
+	SqOcclusionRender result;
+	result.gridsCulled = STATS_GETI(GRD_occlusion_culled);
+	RiEnd();
+
+	const SqDebugDspyImage& img = DebugDspyLastImage();
+	BOOST_REQUIRE_EQUAL(img.width, 32);
+	BOOST_REQUIRE_EQUAL(img.height, 32);
+	BOOST_REQUIRE_EQUAL(img.entrySize, 4*4);
+	const float* pixels = reinterpret_cast<const float*>(&img.data[0]);
+	result.pixels.assign(pixels, pixels + img.data.size()/sizeof(float));
+	return result;
+}
+
+/// Get channel c of pixel (x,y) of a 32x32 rgba render.
+float occlusionPixel(const SqOcclusionRender& render, TqInt x, TqInt y, TqInt c)
+{
+	return render.pixels[4*(32*y + x) + c];
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqMicroPolyGrid_occlusion_culls_hidden_grid_test)
+{
+	// With grid occlusion off, the hidden grid is shaded and its
+	// micropolygons culled one by one.
+	SqOcclusionRender off = renderOcclusionFrame(0, true, false);
+	BOOST_CHECK_EQUAL(off.gridsCulled, 0);
+
+	// With it on, the grid is culled once it's displaced, in the first
+	// bucket which dices it.  The surface then only goes on to the buckets
+	// the grid touches, and is culled there by its bound without dicing it
+	// again, so the grid is only culled once.
+	SqOcclusionRender on = renderOcclusionFrame(1, true, false);
+	BOOST_CHECK_EQUAL(on.gridsCulled, 1);
+	BOOST_CHECK(on.pixels == off.pixels);
+}
+
+BOOST_AUTO_TEST_CASE(CqMicroPolyGrid_occlusion_keeps_partly_visible_grid_test)
+{
+	SqOcclusionRender on = renderOcclusionFrame(1, false, true);
+	// The part of the grid to the right of the square is rendered.
+	BOOST_CHECK_GT(occlusionPixel(on, 29, 16, 0), 0.1f);
+	BOOST_CHECK_EQUAL(occlusionPixel(on, 29, 16, 1), 0.0f);
+	BOOST_CHECK_GT(occlusionPixel(on, 29, 16, 3), 0.99f);
+	// The square is in front of the rest of it.
+	BOOST_CHECK_EQUAL(occlusionPixel(on, 24, 16, 0), 0.0f);
+	BOOST_CHECK_GT(occlusionPixel(on, 24, 16, 1), 0.1f);
+
+	SqOcclusionRender off = renderOcclusionFrame(0, false, true);
+	BOOST_CHECK(on.pixels == off.pixels);
+}
+
+BOOST_AUTO_TEST_CASE(CqMicroPolyGrid_occlusion_image_unchanged_test)
+{
+	// Grid occlusion culling must not change a single bit of the image.
+	SqOcclusionRender off = renderOcclusionFrame(0, true, true);
+	SqOcclusionRender on = renderOcclusionFrame(1, true, true);
+	BOOST_CHECK_GT(on.gridsCulled, 0);
+	BOOST_CHECK(on.pixels == off.pixels);
+}
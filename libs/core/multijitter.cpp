@@ -202,23 +202,20 @@ void CqMultiJitteredSampler::setupJitterPattern(TqInt offset)
 }
 
 
-const CqVector2D* CqMultiJitteredSampler::get2DSamples()		
+const CqVector2D* CqMultiJitteredSampler::get2DSamples(TqUint pattern) const
 {
-	TqInt jitterIndex = m_random.RandomInt(m_cacheSize);
-	return &m_2dSamples[this->numSamples()*jitterIndex];
+	return &m_2dSamples[patternOffset(pattern)];
 }
 
 
-const TqFloat* CqMultiJitteredSampler::get1DSamples()		
+const TqFloat* CqMultiJitteredSampler::get1DSamples(TqUint pattern) const
 {
-	TqInt jitterIndex = m_random.RandomInt(m_cacheSize);
-	return &m_1dSamples[this->numSamples()*jitterIndex];
+	return &m_1dSamples[patternOffset(pattern)];
 }
 
-const TqInt* CqMultiJitteredSampler::getShuffledIndices()
+const TqInt* CqMultiJitteredSampler::getShuffledIndices(TqUint pattern) const
 {
-	TqInt jitterIndex = m_random.RandomInt(m_cacheSize);
-	return &m_shuffledIndices[this->numSamples()*jitterIndex];
+	return &m_shuffledIndices[patternOffset(pattern)];
 }
 
 //---------------------------------------------------------------------
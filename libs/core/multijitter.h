@@ -51,14 +51,16 @@ class CqMultiJitteredSampler : public IqSampler
 		~CqMultiJitteredSampler();
 
 		/* Interface functions from IqSampler */
-		virtual const CqVector2D* get2DSamples();		
-		virtual const TqFloat* get1DSamples();		
-		virtual const TqInt* getShuffledIndices();
+		virtual const CqVector2D* get2DSamples(TqUint pattern) const;		
+		virtual const TqFloat* get1DSamples(TqUint pattern) const;		
+		virtual const TqInt* getShuffledIndices(TqUint pattern) const;
 
 	private:
 		/// Static define for the number of distribution patterns to cache.
 		static const TqInt m_cacheSize = 250;
 		TqInt numSamples() const;
+		/// Offset of the cached pattern selected by the given key.
+		TqInt patternOffset(TqUint pattern) const;
 		void multiJitterIndices(TqInt* indices, TqInt numX, TqInt numY);
 		/** \brief Set up a jittered sample pattern for a pixel's worth of samples.
 		 *
@@ -80,7 +82,6 @@ class CqMultiJitteredSampler : public IqSampler
 		std::vector<CqVector2D>	m_2dSamples;
 		std::vector<TqFloat>	m_1dSamples;
 		std::vector<TqInt>		m_shuffledIndices;
-		CqRandom				m_random;
 };
 
 //==============================================================================
@@ -97,7 +98,6 @@ inline CqMultiJitteredSampler::CqMultiJitteredSampler(TqInt pixelXSamples, TqInt
 
 	for(TqInt i = 0; i < m_cacheSize; ++i)
 		setupJitterPattern(i*numSamples());
-	m_random.Reseed(19);
 }
 
 inline CqMultiJitteredSampler::~CqMultiJitteredSampler()
@@ -109,6 +109,11 @@ inline TqInt CqMultiJitteredSampler::numSamples() const
 	return m_pixelXSamples * m_pixelYSamples;
 }
 
+inline TqInt CqMultiJitteredSampler::patternOffset(TqUint pattern) const
+{
+	return numSamples()*(hashRandom(pattern) % m_cacheSize);
+}
+
 
 
 
@@ -0,0 +1,125 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the multijittered pixel sampler
+ */
+
+#include "multijitter.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/util/threadscheduler.h>
+
+using namespace Aqsis;
+
+namespace {
+
+const TqInt pixelSamples = 3;
+const TqInt numSamples = pixelSamples*pixelSamples;
+const TqInt numKeys = 2000;
+
+/// Everything the sampler hands out for one pattern key.
+struct SqPattern
+{
+	std::vector<CqVector2D> positions;
+	std::vector<TqFloat> times;
+	std::vector<TqInt> indices;
+};
+
+void fetchPattern(const CqMultiJitteredSampler& sampler, TqUint key,
+		SqPattern& pattern)
+{
+	const CqVector2D* positions = sampler.get2DSamples(key);
+	const TqFloat* times = sampler.get1DSamples(key);
+	const TqInt* indices = sampler.getShuffledIndices(key);
+	pattern.positions.assign(positions, positions + numSamples);
+	pattern.times.assign(times, times + numSamples);
+	pattern.indices.assign(indices, indices + numSamples);
+}
+
+/// Fetch the patterns for a range of keys, many times over, so that the
+/// threads fetching neighbouring ranges overlap.
+void fetchPatterns(const CqMultiJitteredSampler& sampler, TqInt begin,
+		TqInt end, std::vector<SqPattern>& patterns)
+{
+	for(TqInt repeat = 0; repeat < 20; ++repeat)
+		for(TqInt key = begin; key < end; ++key)
+			fetchPattern(sampler, key, patterns[key]);
+}
+
+void checkPatternsEqual(const std::vector<SqPattern>& a,
+		const std::vector<SqPattern>& b)
+{
+	BOOST_REQUIRE_EQUAL(a.size(), b.size());
+	for(TqInt key = 0; key < static_cast<TqInt>(a.size()); ++key)
+	{
+		for(TqInt i = 0; i < numSamples; ++i)
+		{
+			// Compare exactly; the samples must be bit for bit identical.
+			BOOST_CHECK_EQUAL(a[key].positions[i].x(), b[key].positions[i].x());
+			BOOST_CHECK_EQUAL(a[key].positions[i].y(), b[key].positions[i].y());
+			BOOST_CHECK_EQUAL(a[key].times[i], b[key].times[i]);
+			BOOST_CHECK_EQUAL(a[key].indices[i], b[key].indices[i]);
+		}
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqMultiJitteredSampler_order_independent_test)
+{
+	// The pattern for a key doesn't depend on what was asked for before.
+	CqMultiJitteredSampler sampler(pixelSamples, pixelSamples);
+	std::vector<SqPattern> forward(numKeys);
+	for(TqInt key = 0; key < numKeys; ++key)
+		fetchPattern(sampler, key, forward[key]);
+	std::vector<SqPattern> backward(numKeys);
+	for(TqInt key = numKeys-1; key >= 0; --key)
+		fetchPattern(sampler, key, backward[key]);
+	checkPatternsEqual(forward, backward);
+}
+
+BOOST_AUTO_TEST_CASE(CqMultiJitteredSampler_threaded_determinism_test)
+{
+	// Patterns fetched from many threads at once are bit for bit the same as
+	// those fetched from a single thread.
+	CqMultiJitteredSampler sampler(pixelSamples, pixelSamples);
+	std::vector<SqPattern> single(numKeys);
+	fetchPatterns(sampler, 0, numKeys, single);
+
+	std::vector<SqPattern> threaded(numKeys);
+	{
+		CqThreadScheduler scheduler(8);
+		const TqInt chunk = 50;
+		for(TqInt begin = 0; begin < numKeys; begin += chunk)
+		{
+			scheduler.addWorkUnit(boost::bind(fetchPatterns, boost::cref(sampler),
+						begin, begin + chunk, boost::ref(threaded)));
+		}
+		scheduler.joinAll();
+	}
+	checkPatternsEqual(single, threaded);
+}
@@ -42,7 +42,10 @@ SqOptionCache::SqOptionCache()
 	maxEyeSplits(1),
 	displayMode(DMode_None),
 	depthFilter(Filter_Min),
-	zThreshold()
+	zThreshold(),
+	gridOcclusion(false),
+	gridSampling(false),
+	separableFilter(true)
 { }
 
 void SqOptionCache::cacheOptions(const IqOptions& opts)
@@ -114,6 +117,21 @@ void SqOptionCache::cacheOptions(const IqOptions& opts)
 	zThreshold = CqColor(1.0f);
 	if(const CqColor* zTh = opts.GetColorOption("limits", "zthreshold"))
 		zThreshold = zTh[0];
+
+	// Culling of hidden grids before shading.
+	gridOcclusion = false;
+	if(const TqInt* gridOccl = opts.GetIntegerOption("Hider", "gridocclusion"))
+		gridOcclusion = gridOccl[0] != 0;
+
+	// Sampling of grids without busting them into micropolygons.
+	gridSampling = false;
+	if(const TqInt* gridSamp = opts.GetIntegerOption("Hider", "gridsampling"))
+		gridSampling = gridSamp[0] != 0;
+
+	// Filtering with separate passes along x and y.
+	separableFilter = true;
+	if(const TqInt* sepFilt = opts.GetIntegerOption("Hider", "separablefilter"))
+		separableFilter = sepFilt[0] != 0;
 }
 
 } // namespace Aqsis
@@ -67,6 +67,9 @@ struct SqOptionCache
 
 	EqDepthFilter depthFilter; ///< Type of depth filter to use
 	CqColor zThreshold; ///< Opacity threshold for inclusion in depth maps
+	bool gridOcclusion; ///< Occlusion cull grids after displacement
+	bool gridSampling;  ///< Sample static grids intact rather than busting them
+	bool separableFilter; ///< Filter in two passes when the pixel filter allows
 
 	/// Initialise all options to non-catastrophic defaults.
 	SqOptionCache();
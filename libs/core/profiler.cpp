@@ -0,0 +1,471 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Implements the per thread profiler for render phases.
+ */
+
+#include "profiler.h"
+
+#ifdef USE_TIMERS
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#ifdef ENABLE_THREADING
+#	include <boost/thread/mutex.hpp>
+#	include <boost/thread/tss.hpp>
+#endif
+
+namespace Aqsis {
+
+namespace {
+
+/// A span recorded by the profiler.
+struct SqProfileEvent
+{
+	EqTimerStats::Enum id;
+	TqInt shader;      ///< index of the shader name, or -1
+	TqInt object;      ///< index of the object name, or -1
+	TqInt col;         ///< bucket column, or -1 if the span isn't a bucket
+	TqInt row;         ///< bucket row
+	double begin;      ///< microseconds since the start of the frame
+	double end;
+};
+
+/// Timer totals and events of a single thread.
+struct SqThreadProfile
+{
+	/// Index of the thread, used as the thread id in traces.
+	TqInt index;
+	/// Start times of AQSIS_TIMER_START.
+	double started[EqTimerStats::size];
+	/// Total seconds per timer since the last addTimes().
+	double totals[EqTimerStats::size];
+	long numSamples[EqTimerStats::size];
+	std::vector<SqProfileEvent> events;
+	/// Names of shaders and objects, which the events refer to by index.
+	std::vector<std::string> names;
+	std::map<std::string, TqInt> nameIndices;
+
+	SqThreadProfile(TqInt index)
+		: index(index),
+		events(),
+		names(),
+		nameIndices()
+	{
+		std::fill(started, started + EqTimerStats::size, 0.0);
+		std::fill(totals, totals + EqTimerStats::size, 0.0);
+		std::fill(numSamples, numSamples + EqTimerStats::size, 0L);
+	}
+
+	/// Get the index of a name, adding it if necessary.
+	TqInt nameIndex(const char* name)
+	{
+		if(!name)
+			return -1;
+		std::map<std::string, TqInt>::iterator i = nameIndices.find(name);
+		if(i == nameIndices.end())
+		{
+			i = nameIndices.insert(std::make_pair(std::string(name),
+						static_cast<TqInt>(names.size()))).first;
+			names.push_back(name);
+		}
+		return i->second;
+	}
+
+	void clearEvents()
+	{
+		events.clear();
+		names.clear();
+		nameIndices.clear();
+	}
+};
+
+/** \brief Owner of the thread profiles.
+ *
+ * The profiles outlive their threads, so the times of a finished thread are
+ * still reported.  The profile of a finished thread is handed on to the next
+ * thread to start.
+ */
+class CqProfileStore
+{
+	public:
+		CqProfileStore() : m_profiles(), m_spare() {}
+		~CqProfileStore()
+		{
+			for(std::vector<SqThreadProfile*>::iterator i = m_profiles.begin();
+					i != m_profiles.end(); ++i)
+				delete *i;
+		}
+
+		SqThreadProfile* newProfile()
+		{
+#			ifdef ENABLE_THREADING
+			boost::mutex::scoped_lock lock(m_mutex);
+#			endif
+			if(!m_spare.empty())
+			{
+				SqThreadProfile* profile = m_spare.back();
+				m_spare.pop_back();
+				return profile;
+			}
+			m_profiles.push_back(new SqThreadProfile(m_profiles.size()));
+			return m_profiles.back();
+		}
+		void releaseProfile(SqThreadProfile* profile)
+		{
+#			ifdef ENABLE_THREADING
+			boost::mutex::scoped_lock lock(m_mutex);
+#			endif
+			m_spare.push_back(profile);
+		}
+
+		const std::vector<SqThreadProfile*>& profiles() const
+		{
+			return m_profiles;
+		}
+
+	private:
+		std::vector<SqThreadProfile*> m_profiles;
+		std::vector<SqThreadProfile*> m_spare;
+#		ifdef ENABLE_THREADING
+		boost::mutex m_mutex;
+#		endif
+};
+
+// The store must outlive the thread profile pointers below.
+CqProfileStore g_profileStore;
+
+#ifdef ENABLE_THREADING
+void releaseProfile(SqThreadProfile* profile)
+{
+	g_profileStore.releaseProfile(profile);
+}
+
+boost::thread_specific_ptr<SqThreadProfile> g_threadProfile(releaseProfile);
+
+inline SqThreadProfile& threadProfile()
+{
+	SqThreadProfile* profile = g_threadProfile.get();
+	if(!profile)
+	{
+		profile = g_profileStore.newProfile();
+		g_threadProfile.reset(profile);
+	}
+	return *profile;
+}
+#else
+SqThreadProfile& threadProfile()
+{
+	static SqThreadProfile* profile = g_profileStore.newProfile();
+	return *profile;
+}
+#endif
+
+/// Time origin for the events.
+boost::posix_time::ptime g_frameStart
+	= boost::posix_time::microsec_clock::universal_time();
+/// Whether events are being recorded.
+bool g_recording = false;
+
+void addEvent(const SqProfileEvent& event, double seconds)
+{
+	SqThreadProfile& profile = threadProfile();
+	profile.totals[event.id] += seconds;
+	++profile.numSamples[event.id];
+	if(g_recording)
+		profile.events.push_back(event);
+}
+
+/// Category of the events of a timer in traces.
+const char* timerCategory(EqTimerStats::Enum id)
+{
+	switch(id)
+	{
+		case EqTimerStats::Display_bucket:
+		case EqTimerStats::Prepare_bucket:
+		case EqTimerStats::Render_bucket:
+			return "bucket";
+		case EqTimerStats::Project_points:
+		case EqTimerStats::Bust_grids:
+		case EqTimerStats::Shade_grid:
+			return "grid";
+		case EqTimerStats::Atmosphere_shading:
+		case EqTimerStats::Displacement_shading:
+		case EqTimerStats::Imager_shading:
+		case EqTimerStats::Surface_shading:
+			return "shader";
+		case EqTimerStats::Combine_samples:
+		case EqTimerStats::Filter_samples:
+		case EqTimerStats::Render_MPGs:
+		case EqTimerStats::Sample_grid:
+			return "sampling";
+		default:
+			return "render";
+	}
+}
+
+/// Write a string as a JSON string literal.
+void writeJsonString(std::ostream& out, const std::string& str)
+{
+	out << '"';
+	for(std::string::const_iterator c = str.begin(); c != str.end(); ++c)
+	{
+		switch(*c)
+		{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if(static_cast<unsigned char>(*c) < 0x20)
+				{
+					out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+						<< static_cast<int>(*c) << std::dec << std::setfill(' ');
+				}
+				else
+					out << *c;
+		}
+	}
+	out << '"';
+}
+
+/// Time and number of spans attributed to a shader or object.
+struct SqAttribution
+{
+	double shading;
+	long numShaded;
+	double sampling;
+	long numSampled;
+	SqAttribution() : shading(0), numShaded(0), sampling(0), numSampled(0) {}
+};
+
+typedef std::map<std::string, SqAttribution> TqAttributionMap;
+typedef std::pair<std::string, SqAttribution> TqAttributionEntry;
+
+bool greaterTotal(const TqAttributionEntry& a, const TqAttributionEntry& b)
+{
+	return a.second.shading + a.second.sampling
+		> b.second.shading + b.second.sampling;
+}
+
+void printAttributionTable(std::ostream& out, const char* title,
+		const TqAttributionMap& attribution, bool withSampling)
+{
+	std::vector<TqAttributionEntry> sorted(attribution.begin(), attribution.end());
+	std::sort(sorted.begin(), sorted.end(), greaterTotal);
+	out << std::setw(65) << std::setfill('-') << "-\n" << std::setfill(' ')
+		<< title << "\n"
+		<< std::setw(65) << std::setfill('-') << "-\n" << std::setfill(' ');
+	std::ios_base::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	for(std::vector<TqAttributionEntry>::const_iterator i = sorted.begin();
+			i != sorted.end(); ++i)
+	{
+		const SqAttribution& a = i->second;
+		out << std::left << std::setw(32) << i->first << std::right
+			<< " shading " << std::setw(8) << a.shading << "s ("
+			<< a.numShaded << " grids)";
+		if(withSampling)
+		{
+			out << ", sampling " << std::setw(8) << a.sampling << "s ("
+				<< a.numSampled << " spans)";
+		}
+		out << "\n";
+	}
+	out.flags(flags);
+}
+
+} // unnamed namespace
+
+
+void CqProfiler::beginFrame(bool record)
+{
+	const std::vector<SqThreadProfile*>& profiles = g_profileStore.profiles();
+	for(std::vector<SqThreadProfile*>::const_iterator i = profiles.begin();
+			i != profiles.end(); ++i)
+		(*i)->clearEvents();
+	g_frameStart = boost::posix_time::microsec_clock::universal_time();
+	g_recording = record;
+}
+
+bool CqProfiler::recording()
+{
+	return g_recording;
+}
+
+double CqProfiler::now()
+{
+	return static_cast<double>((boost::posix_time::microsec_clock::universal_time()
+				- g_frameStart).total_microseconds());
+}
+
+void CqProfiler::start(EqTimerStats::Enum id)
+{
+	threadProfile().started[id] = now();
+}
+
+void CqProfiler::stop(EqTimerStats::Enum id)
+{
+	addSpan(id, threadProfile().started[id], now());
+}
+
+void CqProfiler::addSpan(EqTimerStats::Enum id, double begin, double end,
+		const char* shaderName, const char* objectName)
+{
+	SqThreadProfile& profile = threadProfile();
+	SqProfileEvent event = { id, -1, -1, -1, -1, begin, end };
+	if(g_recording)
+	{
+		event.shader = profile.nameIndex(shaderName);
+		event.object = profile.nameIndex(objectName);
+	}
+	addEvent(event, (end - begin)*1e-6);
+}
+
+void CqProfiler::addBucketSpan(double begin, double end, TqInt col, TqInt row)
+{
+	SqProfileEvent event = { EqTimerStats::Render_bucket, -1, -1, col, row,
+		begin, end };
+	addEvent(event, (end - begin)*1e-6);
+}
+
+void CqProfiler::addTimes(CqTimerSet<EqTimerStats>& timers)
+{
+	const std::vector<SqThreadProfile*>& profiles = g_profileStore.profiles();
+	for(std::vector<SqThreadProfile*>::const_iterator i = profiles.begin();
+			i != profiles.end(); ++i)
+	{
+		SqThreadProfile& profile = **i;
+		for(TqInt id = 0; id < EqTimerStats::size; ++id)
+		{
+			if(profile.numSamples[id] == 0)
+				continue;
+			timers.getTimer(static_cast<EqTimerStats::Enum>(id))
+				.add(profile.totals[id], profile.numSamples[id]);
+			profile.totals[id] = 0;
+			profile.numSamples[id] = 0;
+		}
+	}
+}
+
+void CqProfiler::writeTrace(std::ostream& out)
+{
+	std::ios_base::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(1);
+	out << "{\"traceEvents\":[\n";
+	bool first = true;
+	const std::vector<SqThreadProfile*>& profiles = g_profileStore.profiles();
+	for(std::vector<SqThreadProfile*>::const_iterator i = profiles.begin();
+			i != profiles.end(); ++i)
+	{
+		const SqThreadProfile& profile = **i;
+		if(profile.events.empty())
+			continue;
+		if(!first)
+			out << ",\n";
+		first = false;
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+			<< profile.index << ",\"args\":{\"name\":\"render thread "
+			<< profile.index << "\"}}";
+		for(std::vector<SqProfileEvent>::const_iterator e = profile.events.begin();
+				e != profile.events.end(); ++e)
+		{
+			out << ",\n{\"name\":";
+			writeJsonString(out, enumString(e->id));
+			out << ",\"cat\":\"" << timerCategory(e->id)
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << profile.index
+				<< ",\"ts\":" << e->begin << ",\"dur\":" << e->end - e->begin;
+			if(e->shader >= 0 || e->object >= 0 || e->col >= 0)
+			{
+				out << ",\"args\":{";
+				const char* sep = "";
+				if(e->shader >= 0)
+				{
+					out << "\"shader\":";
+					writeJsonString(out, profile.names[e->shader]);
+					sep = ",";
+				}
+				if(e->object >= 0)
+				{
+					out << sep << "\"object\":";
+					writeJsonString(out, profile.names[e->object]);
+					sep = ",";
+				}
+				if(e->col >= 0)
+					out << sep << "\"col\":" << e->col << ",\"row\":" << e->row;
+				out << "}";
+			}
+			out << "}";
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	out.flags(flags);
+}
+
+void CqProfiler::printAttribution(std::ostream& out)
+{
+	TqAttributionMap shaders;
+	TqAttributionMap objects;
+	const std::vector<SqThreadProfile*>& profiles = g_profileStore.profiles();
+	for(std::vector<SqThreadProfile*>::const_iterator i = profiles.begin();
+			i != profiles.end(); ++i)
+	{
+		const SqThreadProfile& profile = **i;
+		for(std::vector<SqProfileEvent>::const_iterator e = profile.events.begin();
+				e != profile.events.end(); ++e)
+		{
+			double seconds = (e->end - e->begin)*1e-6;
+			if(e->shader >= 0)
+			{
+				SqAttribution& a = shaders[profile.names[e->shader]];
+				a.shading += seconds;
+				++a.numShaded;
+			}
+			if(e->object >= 0)
+			{
+				SqAttribution& a = objects[profile.names[e->object]];
+				if(e->id == EqTimerStats::Sample_grid)
+				{
+					a.sampling += seconds;
+					++a.numSampled;
+				}
+				else if(e->id == EqTimerStats::Shade_grid)
+				{
+					a.shading += seconds;
+					++a.numShaded;
+				}
+			}
+		}
+	}
+	if(!shaders.empty())
+		printAttributionTable(out, "Time per shader", shaders, false);
+	if(!objects.empty())
+		printAttributionTable(out, "Time per object", objects, true);
+}
+
+} // namespace Aqsis
+
+#endif // USE_TIMERS
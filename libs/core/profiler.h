@@ -0,0 +1,285 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Declares the timers for render phases, and the profiler which
+ * records them per thread.
+ */
+
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <iosfwd>
+#include <string>
+
+#include <aqsis/util/timer.h>
+#include <aqsis/util/enum.h>
+
+namespace Aqsis {
+
+#ifdef USE_TIMERS
+
+/// Append time taken to the end of the current scope to the named timer.
+#define AQSIS_TIME_SCOPE(id) CqProfileScope aq_scope_timer__(EqTimerStats::id)
+/** \brief Attach a shader and object name to the span of the enclosing
+ * AQSIS_TIME_SCOPE.
+ *
+ * The names are only evaluated while the profiler is recording events.
+ */
+#define AQSIS_TIME_SCOPE_NAMES(shaderName, objectName) \
+	do { if(aq_scope_timer__.recording()) \
+		aq_scope_timer__.setNames(shaderName, objectName); } while(0)
+/// Start the named timer.
+#define AQSIS_TIMER_START(id) CqProfiler::start(EqTimerStats::id)
+/// Stop the named timer and append the time since the corresponding TIMER_START
+#define AQSIS_TIMER_STOP(id) CqProfiler::stop(EqTimerStats::id)
+
+/// A class enum containing constants for each operation to be timed.
+struct EqTimerStats
+{
+	enum Enum
+	{
+		// surface handling
+		Post_surface,
+		Dicable_check,
+		Dicing,
+		Splitting,
+		// buckets
+		Display_bucket,
+		Prepare_bucket,
+		Render_bucket,
+		// culling
+		Backface_culling,
+		Occlusion_culling_initialisation,
+		Occlusion_culling_surfaces,
+		Occlusion_culling,
+		Transparency_culling_micropolygons,
+		// grids
+		Project_points,
+		Bust_grids,
+		Shade_grid,
+		// shading
+		Atmosphere_shading,
+		Displacement_shading,
+		Imager_shading,
+		Surface_shading,
+		// texturing
+		Make_texture,
+		// raytracing
+		Raytrace_build,
+		// sampling
+		Combine_samples,
+		Filter_samples,
+		Render_MPGs,
+		Sample_grid,
+		// high level
+		Frame,
+		Parse,
+
+		// invalid
+		LAST,
+	};
+	static const TqInt size = LAST;
+};
+
+AQSIS_ENUM_INFO_BEGIN(EqTimerStats::Enum, EqTimerStats::LAST)
+	// surface handling
+	"Post surface",
+	"Dicable check",
+	"Dicing",
+	"Splitting",
+	//buckets
+	"Display bucket",
+	"Prepare bucket",
+	"Render bucket",
+	// culling
+	"Backface culling",
+	"Occlusion culling initialisation",
+	"Occlusion culling surfaces",
+	"Occlusion culling",
+	"Transparency culling micropolygons",
+	// grids
+	"Project points",
+	"Bust grids",
+	"Shade grid",
+	// shading
+	"Atmosphere shading",
+	"Displacement shading",
+	"Imager shading",
+	"Surface shading",
+	// texturing
+	"Make texture",
+	// raytracing
+	"Raytrace build",
+	// sampling
+	"Combine samples",
+	"Filter samples",
+	"Render MPGs",
+	"Sample grid",
+	// high level
+	"Frame",
+	"Parse",
+	// invalid
+	"LAST"
+AQSIS_ENUM_INFO_END
+
+extern CqTimerSet<EqTimerStats> g_timerSet;
+
+
+//------------------------------------------------------------------------------
+/** \brief Per thread recorder for the timers of render phases.
+ *
+ * Each thread accumulates the total time of each timer in its own record, so
+ * the timers may be used from the bucket threads without any locking.  The
+ * totals are moved into g_timerSet by addTimes() when the statistics are
+ * printed.
+ *
+ * While recording is turned on for a frame, every timed span is also kept as
+ * an event with its begin and end time, and optionally the names of the
+ * shader and object being worked on, or the bucket being rendered.  The
+ * events can be written out in the Chrome trace event format, which trace
+ * viewers such as chrome://tracing and Perfetto display as a timeline per
+ * thread, and summed up per shader and object by printAttribution().
+ *
+ * beginFrame(), addTimes(), writeTrace() and printAttribution() read the
+ * records of all threads, so must only be called while no other thread is
+ * rendering.
+ */
+class CqProfiler
+{
+	public:
+		/** \brief Start a new frame.
+		 *
+		 * Discards the events of the previous frame, and resets the time
+		 * origin of the events.
+		 *
+		 * \param record - whether to record events during the frame.
+		 */
+		static void beginFrame(bool record);
+		/// Determine whether events are being recorded.
+		static bool recording();
+
+		/// Current time in microseconds since the start of the frame.
+		static double now();
+
+		/// Start a timer for the calling thread.
+		static void start(EqTimerStats::Enum id);
+		/// Stop a timer started by the calling thread.
+		static void stop(EqTimerStats::Enum id);
+
+		/** \brief Add a span to a timer for the calling thread.
+		 *
+		 * The span is recorded as an event if recording is turned on.
+		 *
+		 * \param id - timer for the span
+		 * \param begin, end - times of the span, as returned by now()
+		 * \param shaderName - name of the shader run during the span, or 0
+		 * \param objectName - name of the object worked on, or 0
+		 */
+		static void addSpan(EqTimerStats::Enum id, double begin, double end,
+				const char* shaderName = 0, const char* objectName = 0);
+		/// Add a span for rendering a bucket, given its column and row.
+		static void addBucketSpan(double begin, double end, TqInt col, TqInt row);
+
+		/// Move the time accumulated by all threads into the given timers.
+		static void addTimes(CqTimerSet<EqTimerStats>& timers);
+
+		/// Write the recorded events in the Chrome trace event JSON format.
+		static void writeTrace(std::ostream& out);
+		/** \brief Print the time spent per shader and per object.
+		 *
+		 * Shading time is attributed to the shader which was run and the
+		 * object being shaded, and sampling time to the object owning the
+		 * sampled micropolygons.
+		 */
+		static void printAttribution(std::ostream& out);
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Scope class adding the time until the end of the scope to a timer.
+ *
+ * Created by AQSIS_TIME_SCOPE.
+ */
+class CqProfileScope
+{
+	public:
+		CqProfileScope(EqTimerStats::Enum id);
+		~CqProfileScope();
+
+		/// Determine whether the span will be recorded as an event.
+		bool recording() const;
+		/// Set the names of the shader and object worked on during the span.
+		void setNames(const std::string& shaderName, const std::string& objectName);
+
+	private:
+		EqTimerStats::Enum m_id;
+		double m_begin;
+		bool m_recording;
+		std::string m_shaderName;
+		std::string m_objectName;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline CqProfileScope::CqProfileScope(EqTimerStats::Enum id)
+	: m_id(id),
+	m_begin(CqProfiler::now()),
+	m_recording(CqProfiler::recording()),
+	m_shaderName(),
+	m_objectName()
+{ }
+
+inline CqProfileScope::~CqProfileScope()
+{
+	CqProfiler::addSpan(m_id, m_begin, CqProfiler::now(),
+			m_shaderName.empty() ? 0 : m_shaderName.c_str(),
+			m_objectName.empty() ? 0 : m_objectName.c_str());
+}
+
+inline bool CqProfileScope::recording() const
+{
+	return m_recording;
+}
+
+inline void CqProfileScope::setNames(const std::string& shaderName,
+		const std::string& objectName)
+{
+	m_shaderName = shaderName;
+	m_objectName = objectName;
+}
+
+#else // USE_TIMERS
+
+// dummy declarations if compiled without timers.
+#define AQSIS_TIME_SCOPE(name)
+#define AQSIS_TIME_SCOPE_NAMES(shaderName, objectName)
+#define AQSIS_TIMER_START(identifier)
+#define AQSIS_TIMER_STOP(identifier)
+
+#endif // USE_TIMERS
+
+} // namespace Aqsis
+
+#endif // PROFILER_H_INCLUDED
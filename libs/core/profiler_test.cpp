@@ -0,0 +1,97 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the render phase profiler
+ */
+
+#include "profiler.h"
+
+#include <sstream>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#ifdef USE_TIMERS
+
+using namespace Aqsis;
+
+namespace {
+
+bool contains(const std::string& str, const std::string& sub)
+{
+	return str.find(sub) != std::string::npos;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqProfiler_trace_test)
+{
+	CqProfiler::beginFrame(true);
+	{
+		AQSIS_TIME_SCOPE(Shade_grid);
+		AQSIS_TIME_SCOPE_NAMES(std::string(), "sphere \"1\"");
+		{
+			AQSIS_TIME_SCOPE(Surface_shading);
+			AQSIS_TIME_SCOPE_NAMES("plastic", "sphere \"1\"");
+		}
+	}
+	CqProfiler::addSpan(EqTimerStats::Sample_grid, 10, 30, 0, "sphere \"1\"");
+	CqProfiler::addBucketSpan(0, 100, 2, 3);
+
+	std::ostringstream trace;
+	CqProfiler::writeTrace(trace);
+	const std::string str = trace.str();
+	BOOST_CHECK(contains(str, "{\"traceEvents\":["));
+	BOOST_CHECK(contains(str, "\"name\":\"Shade grid\",\"cat\":\"grid\",\"ph\":\"X\""));
+	BOOST_CHECK(contains(str, "\"args\":{\"shader\":\"plastic\",\"object\":\"sphere \\\"1\\\"\"}"));
+	BOOST_CHECK(contains(str, "\"ts\":10.0,\"dur\":20.0"));
+	BOOST_CHECK(contains(str, "\"name\":\"Render bucket\""));
+	BOOST_CHECK(contains(str, "\"args\":{\"col\":2,\"row\":3}"));
+
+	std::ostringstream attribution;
+	CqProfiler::printAttribution(attribution);
+	BOOST_CHECK(contains(attribution.str(), "Time per shader"));
+	BOOST_CHECK(contains(attribution.str(), "plastic"));
+	BOOST_CHECK(contains(attribution.str(), "(1 spans)"));
+
+	CqTimerSet<EqTimerStats> timers;
+	CqProfiler::addTimes(timers);
+	BOOST_CHECK_EQUAL(timers.getTimer(EqTimerStats::Shade_grid).numSamples(), 1);
+	BOOST_CHECK_EQUAL(timers.getTimer(EqTimerStats::Render_bucket).numSamples(), 1);
+	BOOST_CHECK_CLOSE(timers.getTimer(EqTimerStats::Sample_grid).totalTime(), 20e-6, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(CqProfiler_not_recording_test)
+{
+	CqProfiler::beginFrame(false);
+	AQSIS_TIMER_START(Dicing);
+	AQSIS_TIMER_STOP(Dicing);
+
+	std::ostringstream trace;
+	CqProfiler::writeTrace(trace);
+	BOOST_CHECK(!contains(trace.str(), "Dicing"));
+
+	CqTimerSet<EqTimerStats> timers;
+	CqProfiler::addTimes(timers);
+	BOOST_CHECK_EQUAL(timers.getTimer(EqTimerStats::Dicing).numSamples(), 1);
+}
+
+#endif // USE_TIMERS
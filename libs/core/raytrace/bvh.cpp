@@ -0,0 +1,499 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ * \brief Bounding volume hierarchy over triangles, used by the raytracer.
+ */
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#include <aqsis/util/threadscheduler.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Number of bins used to evaluate the surface area heuristic.
+const TqInt numBins = 16;
+/// Leaves are always made for ranges of at most this many triangles.
+const TqInt minLeafSize = 2;
+/// The surface area heuristic may make leaves of up to this many triangles.
+const TqInt maxLeafSize = 16;
+/// Deeper ranges are made into leaves, which bounds the traversal stacks.
+const TqInt maxDepth = 60;
+/// Cost of visiting a node, relative to one triangle intersection.
+const TqFloat traversalCost = 1.0f;
+/// Builds with fewer triangles than this are not worth threading.
+const TqInt minParallelBuild = 8192;
+
+/// Half the surface area of a box.
+inline TqFloat halfArea(const TqFloat lo[3], const TqFloat hi[3])
+{
+	TqFloat dx = hi[0] - lo[0];
+	TqFloat dy = hi[1] - lo[1];
+	TqFloat dz = hi[2] - lo[2];
+	return dx*dy + dy*dz + dz*dx;
+}
+
+inline void emptyBound(TqFloat lo[3], TqFloat hi[3])
+{
+	lo[0] = lo[1] = lo[2] = FLT_MAX;
+	hi[0] = hi[1] = hi[2] = -FLT_MAX;
+}
+
+inline void growBound(TqFloat lo[3], TqFloat hi[3],
+		const TqFloat plo[3], const TqFloat phi[3])
+{
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		lo[i] = std::min(lo[i], plo[i]);
+		hi[i] = std::max(hi[i], phi[i]);
+	}
+}
+
+/** Clip a ray segment against a box.
+ *
+ * \param tEntry - receives the ray parameter where the ray enters the box.
+ * \return true if the segment [tMin, tMax] overlaps the box.
+ */
+inline bool hitBound(const TqFloat lo[3], const TqFloat hi[3],
+		const TqFloat org[3], const TqFloat invDir[3],
+		TqFloat tMin, TqFloat tMax, TqFloat& tEntry)
+{
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		TqFloat t0 = (lo[i] - org[i])*invDir[i];
+		TqFloat t1 = (hi[i] - org[i])*invDir[i];
+		if(t0 > t1)
+			std::swap(t0, t1);
+		tMin = t0 > tMin ? t0 : tMin;
+		tMax = t1 < tMax ? t1 : tMax;
+		if(tMin > tMax)
+			return false;
+	}
+	tEntry = tMin;
+	return true;
+}
+
+/// A ray unpacked into the form used for traversal.
+struct SqTraversalRay
+{
+	TqFloat org[3];
+	TqFloat invDir[3];
+	CqVector3D origin;
+	CqVector3D direction;
+	TqFloat tMin;
+	TqFloat tMax;
+
+	void set(const SqRay& ray)
+	{
+		origin = ray.origin;
+		direction = ray.direction;
+		for(TqInt i = 0; i < 3; ++i)
+		{
+			org[i] = ray.origin[i];
+			invDir[i] = 1.0f/ray.direction[i];
+		}
+		tMin = ray.tMin;
+		tMax = ray.tMax;
+	}
+};
+
+} // unnamed namespace
+
+
+/// Work unit building one subtree of the hierarchy.
+class CqBvh::CqBuildWorker
+{
+	public:
+		CqBuildWorker(CqBvh& bvh, SqBuildTask& task)
+			: m_bvh(&bvh),
+			m_task(&task)
+		{ }
+		void operator()()
+		{
+			m_task->nodes.resize(1);
+			m_bvh->buildRange(m_task->nodes, 0, m_task->begin, m_task->end,
+					m_task->depth, 0, 0);
+		}
+	private:
+		CqBvh* m_bvh;
+		SqBuildTask* m_task;
+};
+
+
+CqBvh::CqBvh()
+	: m_nodes(),
+	m_triangles(),
+	m_refs()
+{ }
+
+void CqBvh::build(std::vector<SqRayTriangle>& triangles, TqInt numThreads)
+{
+	clear();
+	TqInt numTris = triangles.size();
+	if(numTris == 0)
+		return;
+
+	// Gather the bounds and centroids of the triangles.
+	m_refs.resize(numTris);
+	for(TqInt i = 0; i < numTris; ++i)
+	{
+		const SqRayTriangle& tri = triangles[i];
+		SqPrimRef& ref = m_refs[i];
+		for(TqInt j = 0; j < 3; ++j)
+		{
+			ref.lo[j] = std::min(tri.v0[j], std::min(tri.v1[j], tri.v2[j]));
+			ref.hi[j] = std::max(tri.v0[j], std::max(tri.v1[j], tri.v2[j]));
+			ref.centroid[j] = 0.5f*(ref.lo[j] + ref.hi[j]);
+		}
+		ref.index = i;
+	}
+
+	m_nodes.reserve(2*numTris/minLeafSize);
+	m_nodes.resize(1);
+	if(numThreads > 1 && numTris >= minParallelBuild)
+	{
+		// Build the top of the tree here, leaving ranges of at most taskSize
+		// triangles to be built as independent subtrees.
+		TqInt taskSize = std::max(numTris/(4*numThreads), minParallelBuild/8);
+		std::vector<SqBuildTask> tasks;
+		buildRange(m_nodes, 0, 0, numTris, 0, taskSize, &tasks);
+		{
+			CqThreadScheduler scheduler(numThreads);
+			for(TqInt i = 0, end = tasks.size(); i < end; ++i)
+				scheduler.addWorkUnit(CqBuildWorker(*this, tasks[i]));
+			scheduler.joinAll();
+		}
+		for(TqInt i = 0, end = tasks.size(); i < end; ++i)
+			spliceTask(tasks[i]);
+	}
+	else
+		buildRange(m_nodes, 0, 0, numTris, 0, 0, 0);
+
+	// Store the triangles in leaf order.
+	m_triangles.resize(numTris);
+	for(TqInt i = 0; i < numTris; ++i)
+	{
+		const SqRayTriangle& tri = triangles[m_refs[i].index];
+		SqTriangleAccel& accel = m_triangles[i];
+		accel.v0 = tri.v0;
+		accel.e1 = tri.v1 - tri.v0;
+		accel.e2 = tri.v2 - tri.v0;
+	}
+	std::vector<SqPrimRef>().swap(m_refs);
+	std::vector<SqRayTriangle>().swap(triangles);
+}
+
+void CqBvh::clear()
+{
+	std::vector<SqNode>().swap(m_nodes);
+	std::vector<SqTriangleAccel>().swap(m_triangles);
+	std::vector<SqPrimRef>().swap(m_refs);
+}
+
+TqInt CqBvh::numTriangles() const
+{
+	return m_triangles.size();
+}
+
+TqInt CqBvh::numNodes() const
+{
+	return m_nodes.size();
+}
+
+void CqBvh::buildRange(std::vector<SqNode>& nodes, TqInt nodeIndex,
+		TqInt begin, TqInt end, TqInt depth, TqInt taskSize,
+		std::vector<SqBuildTask>* tasks)
+{
+	TqFloat lo[3], hi[3], cLo[3], cHi[3];
+	emptyBound(lo, hi);
+	emptyBound(cLo, cHi);
+	for(TqInt i = begin; i < end; ++i)
+	{
+		growBound(lo, hi, m_refs[i].lo, m_refs[i].hi);
+		growBound(cLo, cHi, m_refs[i].centroid, m_refs[i].centroid);
+	}
+	SqNode& node = nodes[nodeIndex];
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		node.lo[i] = lo[i];
+		node.hi[i] = hi[i];
+	}
+	node.index = begin;
+	node.count = end - begin;
+
+	TqInt count = end - begin;
+	if(tasks && count <= taskSize)
+	{
+		// Leave the range to be built as a separate subtree.
+		SqBuildTask task;
+		task.begin = begin;
+		task.end = end;
+		task.node = nodeIndex;
+		task.depth = depth;
+		tasks->push_back(task);
+		return;
+	}
+	if(count <= minLeafSize || depth >= maxDepth)
+		return;
+
+	// Split along the axis of largest centroid extent.
+	TqInt axis = 0;
+	for(TqInt i = 1; i < 3; ++i)
+		if(cHi[i] - cLo[i] > cHi[axis] - cLo[axis])
+			axis = i;
+	TqFloat extent = cHi[axis] - cLo[axis];
+	TqInt mid = begin;
+	if(extent > 0)
+	{
+		// Bin the centroids and sweep the bins for the cheapest split.
+		TqInt binCounts[numBins];
+		TqFloat binLo[numBins][3], binHi[numBins][3];
+		for(TqInt b = 0; b < numBins; ++b)
+		{
+			binCounts[b] = 0;
+			emptyBound(binLo[b], binHi[b]);
+		}
+		TqFloat binScale = numBins*(1 - 1e-5f)/extent;
+		for(TqInt i = begin; i < end; ++i)
+		{
+			TqInt b = static_cast<TqInt>((m_refs[i].centroid[axis] - cLo[axis])*binScale);
+			b = std::min(std::max(b, 0), numBins - 1);
+			++binCounts[b];
+			growBound(binLo[b], binHi[b], m_refs[i].lo, m_refs[i].hi);
+		}
+		TqFloat rightCost[numBins];
+		TqFloat accLo[3], accHi[3];
+		emptyBound(accLo, accHi);
+		TqInt accCount = 0;
+		for(TqInt b = numBins - 1; b > 0; --b)
+		{
+			growBound(accLo, accHi, binLo[b], binHi[b]);
+			accCount += binCounts[b];
+			rightCost[b] = accCount ? accCount*halfArea(accLo, accHi) : 0;
+		}
+		emptyBound(accLo, accHi);
+		accCount = 0;
+		TqInt bestSplit = -1;
+		TqFloat bestCost = FLT_MAX;
+		for(TqInt b = 1; b < numBins; ++b)
+		{
+			growBound(accLo, accHi, binLo[b-1], binHi[b-1]);
+			accCount += binCounts[b-1];
+			if(accCount == 0 || accCount == count)
+				continue;
+			TqFloat cost = accCount*halfArea(accLo, accHi) + rightCost[b];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+		if(bestSplit > 0)
+		{
+			bestCost = traversalCost + bestCost/halfArea(lo, hi);
+			if(bestCost >= count && count <= maxLeafSize)
+				return;
+			SqPrimRef* first = &m_refs[0] + begin;
+			SqPrimRef* last = &m_refs[0] + end;
+			SqPrimRef* split = first;
+			for(SqPrimRef* ref = first; ref != last; ++ref)
+			{
+				TqInt b = static_cast<TqInt>((ref->centroid[axis] - cLo[axis])*binScale);
+				if(b < bestSplit)
+					std::swap(*ref, *split++);
+			}
+			mid = begin + (split - first);
+		}
+	}
+	if(mid == begin || mid == end)
+	{
+		// All the centroids coincide; split the range in half if it's too
+		// big to be a leaf.
+		if(count <= maxLeafSize)
+			return;
+		mid = begin + count/2;
+	}
+
+	TqInt child = nodes.size();
+	nodes.resize(child + 2);
+	nodes[nodeIndex].index = child;
+	nodes[nodeIndex].count = 0;
+	buildRange(nodes, child, begin, mid, depth + 1, taskSize, tasks);
+	buildRange(nodes, child + 1, mid, end, depth + 1, taskSize, tasks);
+}
+
+void CqBvh::spliceTask(const SqBuildTask& task)
+{
+	// Node 0 of the subtree replaces the placeholder node; the rest are
+	// appended, so with base one less than the size before appending,
+	// subtree node i > 0 ends up at base + i.
+	TqInt base = m_nodes.size() - 1;
+	for(TqInt i = 0, end = task.nodes.size(); i < end; ++i)
+	{
+		SqNode node = task.nodes[i];
+		if(node.count == 0)
+			node.index += base;
+		if(i == 0)
+			m_nodes[task.node] = node;
+		else
+			m_nodes.push_back(node);
+	}
+}
+
+inline bool CqBvh::intersectTriangle(const SqTriangleAccel& tri,
+		const CqVector3D& org, const CqVector3D& dir,
+		TqFloat tMin, TqFloat& tMax)
+{
+	CqVector3D p = dir % tri.e2;
+	TqFloat det = tri.e1 * p;
+	if(det == 0)
+		return false;
+	TqFloat invDet = 1.0f/det;
+	CqVector3D s = org - tri.v0;
+	TqFloat u = (s * p)*invDet;
+	if(u < 0 || u > 1)
+		return false;
+	CqVector3D q = s % tri.e1;
+	TqFloat v = (dir * q)*invDet;
+	if(v < 0 || u + v > 1)
+		return false;
+	TqFloat t = (tri.e2 * q)*invDet;
+	if(t < tMin || t > tMax)
+		return false;
+	tMax = t;
+	return true;
+}
+
+bool CqBvh::intersect(const SqRay& ray, TqFloat& tHit) const
+{
+	if(m_nodes.empty())
+		return false;
+	SqTraversalRay r;
+	r.set(ray);
+	TqFloat tEntry = 0;
+	if(!hitBound(m_nodes[0].lo, m_nodes[0].hi, r.org, r.invDir, r.tMin, r.tMax, tEntry))
+		return false;
+
+	bool hit = false;
+	TqInt stack[maxDepth + 4];
+	TqInt top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const SqNode& node = m_nodes[stack[--top]];
+		if(node.count > 0)
+		{
+			for(TqInt i = node.index, end = node.index + node.count; i < end; ++i)
+				hit |= intersectTriangle(m_triangles[i], r.origin, r.direction, r.tMin, r.tMax);
+			continue;
+		}
+		// Visit the nearer child first, so that the far one can be culled
+		// by any hit found in the near one.
+		TqFloat t0 = 0, t1 = 0;
+		const SqNode& c0 = m_nodes[node.index];
+		const SqNode& c1 = m_nodes[node.index + 1];
+		bool hit0 = hitBound(c0.lo, c0.hi, r.org, r.invDir, r.tMin, r.tMax, t0);
+		bool hit1 = hitBound(c1.lo, c1.hi, r.org, r.invDir, r.tMin, r.tMax, t1);
+		if(hit0 && hit1)
+		{
+			if(t0 <= t1)
+			{
+				stack[top++] = node.index + 1;
+				stack[top++] = node.index;
+			}
+			else
+			{
+				stack[top++] = node.index;
+				stack[top++] = node.index + 1;
+			}
+		}
+		else if(hit0)
+			stack[top++] = node.index;
+		else if(hit1)
+			stack[top++] = node.index + 1;
+	}
+	if(hit)
+		tHit = r.tMax;
+	return hit;
+}
+
+void CqBvh::occluded(const SqRay* rays, TqInt count, bool* occluded) const
+{
+	assert(count <= maxPacketSize);
+	SqTraversalRay r[maxPacketSize];
+	TqInt active = 0;
+	for(TqInt i = 0; i < count; ++i)
+	{
+		occluded[i] = false;
+		r[i].set(rays[i]);
+		active |= 1 << i;
+	}
+	if(m_nodes.empty())
+		return;
+
+	TqInt stack[maxDepth + 4];
+	TqInt top = 0;
+	stack[top++] = 0;
+	while(top > 0 && active)
+	{
+		const SqNode& node = m_nodes[stack[--top]];
+		// Find which of the active rays enter the node.
+		TqInt nodeMask = 0;
+		TqFloat tEntry;
+		for(TqInt i = 0; i < count; ++i)
+		{
+			if((active & (1 << i)) && hitBound(node.lo, node.hi, r[i].org,
+						r[i].invDir, r[i].tMin, r[i].tMax, tEntry))
+				nodeMask |= 1 << i;
+		}
+		if(!nodeMask)
+			continue;
+		if(node.count > 0)
+		{
+			for(TqInt j = node.index, end = node.index + node.count; j < end; ++j)
+			{
+				for(TqInt i = 0; i < count; ++i)
+				{
+					TqFloat tMax = r[i].tMax;
+					if((nodeMask & (1 << i)) && intersectTriangle(m_triangles[j],
+								r[i].origin, r[i].direction, r[i].tMin, tMax))
+					{
+						occluded[i] = true;
+						nodeMask &= ~(1 << i);
+						active &= ~(1 << i);
+					}
+				}
+				if(!nodeMask)
+					break;
+			}
+			continue;
+		}
+		stack[top++] = node.index + 1;
+		stack[top++] = node.index;
+	}
+}
+
+} // namespace Aqsis
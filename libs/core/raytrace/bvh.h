@@ -0,0 +1,154 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ * \brief Bounding volume hierarchy over triangles, used by the raytracer.
+ */
+
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED 1
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <aqsis/core/iraytrace.h>
+#include <aqsis/math/vector3d.h>
+
+namespace Aqsis {
+
+/// A triangle of the raytracing database.
+struct SqRayTriangle
+{
+	CqVector3D	v0;
+	CqVector3D	v1;
+	CqVector3D	v2;
+};
+
+/** \brief A bounding volume hierarchy over a set of triangles.
+ *
+ * The hierarchy is built top down with the surface area heuristic, evaluated
+ * over a fixed number of bins along the axis of largest centroid extent.
+ * Once the top levels have split the triangles into enough independent
+ * subtrees, the subtrees are built concurrently on a CqThreadScheduler and
+ * then stitched into a single node array.
+ *
+ * Nodes are 32 bytes, and the two children of an interior node are stored
+ * next to each other.  Queries don't modify the hierarchy, so any number of
+ * threads may trace rays against it concurrently once build() has returned.
+ */
+class CqBvh
+{
+	public:
+		/// Maximum number of rays traced together by occluded().
+		static const TqInt maxPacketSize = 8;
+
+		/// Construct an empty hierarchy which no ray hits.
+		CqBvh();
+
+		/** \brief Build the hierarchy over a set of triangles.
+		 *
+		 * \param triangles - triangles to build over.  Their contents are
+		 *                    consumed and the vector is left empty.
+		 * \param numThreads - number of threads to use for the build.
+		 */
+		void build(std::vector<SqRayTriangle>& triangles, TqInt numThreads);
+		/// Discard the hierarchy.
+		void clear();
+
+		/// Get the number of triangles in the hierarchy.
+		TqInt numTriangles() const;
+		/// Get the number of nodes in the hierarchy.
+		TqInt numNodes() const;
+
+		/** \brief Find the nearest triangle hit by a ray.
+		 *
+		 * \param ray - ray to trace.
+		 * \param tHit - receives the ray parameter of the nearest hit.
+		 * \return true if the ray hit a triangle within [tMin, tMax].
+		 */
+		bool intersect(const SqRay& ray, TqFloat& tHit) const;
+
+		/** \brief Test a packet of rays for any hit.
+		 *
+		 * The rays of the packet traverse the hierarchy together: a node is
+		 * visited once if any active ray of the packet enters its bound, and
+		 * rays drop out of the packet as soon as they are found to hit
+		 * something.  This amortises the node fetches over coherent rays.
+		 *
+		 * \param rays - rays to test.
+		 * \param count - number of rays, at most maxPacketSize.
+		 * \param occluded - receives true for each ray which hits a triangle.
+		 */
+		void occluded(const SqRay* rays, TqInt count, bool* occluded) const;
+
+	private:
+		/// A node of the hierarchy.
+		struct SqNode
+		{
+			TqFloat	lo[3];
+			/// First child for interior nodes, first triangle for leaves.
+			TqInt	index;
+			TqFloat	hi[3];
+			/// Number of triangles; zero for interior nodes.
+			TqInt	count;
+		};
+		/// Triangle stored in the form used by the intersection test.
+		struct SqTriangleAccel
+		{
+			CqVector3D	v0;
+			CqVector3D	e1;
+			CqVector3D	e2;
+		};
+		/// Per-triangle build information.
+		struct SqPrimRef
+		{
+			TqFloat	lo[3];
+			TqFloat	hi[3];
+			TqFloat	centroid[3];
+			TqInt	index;
+		};
+		/// A range of primitives to be built into a subtree.
+		struct SqBuildTask
+		{
+			TqInt	begin;
+			TqInt	end;
+			TqInt	node;
+			TqInt	depth;
+			std::vector<SqNode>	nodes;
+		};
+		class CqBuildWorker;
+
+		void buildRange(std::vector<SqNode>& nodes, TqInt nodeIndex,
+				TqInt begin, TqInt end, TqInt depth, TqInt taskSize,
+				std::vector<SqBuildTask>* tasks);
+		void spliceTask(const SqBuildTask& task);
+
+		static bool intersectTriangle(const SqTriangleAccel& tri,
+				const CqVector3D& org, const CqVector3D& dir,
+				TqFloat tMin, TqFloat& tMax);
+
+		std::vector<SqNode> m_nodes;
+		std::vector<SqTriangleAccel> m_triangles;
+		std::vector<SqPrimRef> m_refs;
+};
+
+} // namespace Aqsis
+
+#endif // BVH_H_INCLUDED
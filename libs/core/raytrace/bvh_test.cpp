@@ -0,0 +1,173 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the raytracing bounding volume hierarchy.
+ */
+
+#include "bvh.h"
+
+#include <cmath>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+SqRayTriangle makeTriangle(const CqVector3D& v0, const CqVector3D& v1, const CqVector3D& v2)
+{
+	SqRayTriangle tri;
+	tri.v0 = v0;
+	tri.v1 = v1;
+	tri.v2 = v2;
+	return tri;
+}
+
+SqRay makeRay(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat tMax = 1e30f)
+{
+	SqRay ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.tMin = 0;
+	ray.tMax = tMax;
+	return ray;
+}
+
+/// A grid of unit quads in the plane z = depth, two triangles per quad.
+void addPlane(std::vector<SqRayTriangle>& tris, TqInt res, TqFloat depth)
+{
+	for(TqInt j = 0; j < res; ++j)
+	{
+		for(TqInt i = 0; i < res; ++i)
+		{
+			CqVector3D p00(i, j, depth), p10(i+1, j, depth);
+			CqVector3D p01(i, j+1, depth), p11(i+1, j+1, depth);
+			tris.push_back(makeTriangle(p00, p10, p11));
+			tris.push_back(makeTriangle(p00, p11, p01));
+		}
+	}
+}
+
+/// Brute force nearest hit, to check the hierarchy against.
+bool bruteIntersect(const std::vector<SqRayTriangle>& tris, const SqRay& ray, TqFloat& tHit)
+{
+	bool hit = false;
+	tHit = ray.tMax;
+	for(TqInt i = 0, end = tris.size(); i < end; ++i)
+	{
+		CqVector3D e1 = tris[i].v1 - tris[i].v0;
+		CqVector3D e2 = tris[i].v2 - tris[i].v0;
+		CqVector3D p = ray.direction % e2;
+		TqFloat det = e1 * p;
+		if(det == 0)
+			continue;
+		CqVector3D s = ray.origin - tris[i].v0;
+		TqFloat u = (s * p)/det;
+		CqVector3D q = s % e1;
+		TqFloat v = (ray.direction * q)/det;
+		TqFloat t = (e2 * q)/det;
+		if(u >= 0 && v >= 0 && u + v <= 1 && t >= ray.tMin && t < tHit)
+		{
+			tHit = t;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(bvh_empty_test)
+{
+	CqBvh bvh;
+	TqFloat tHit = 0;
+	SqRay ray = makeRay(CqVector3D(0,0,0), CqVector3D(0,0,1));
+	BOOST_CHECK(!bvh.intersect(ray, tHit));
+	bool occluded = true;
+	bvh.occluded(&ray, 1, &occluded);
+	BOOST_CHECK(!occluded);
+}
+
+BOOST_AUTO_TEST_CASE(bvh_nearest_hit_test)
+{
+	std::vector<SqRayTriangle> tris;
+	addPlane(tris, 8, 5);
+	addPlane(tris, 8, 2);
+	CqBvh bvh;
+	bvh.build(tris, 1);
+	BOOST_CHECK(tris.empty());
+	BOOST_CHECK_EQUAL(bvh.numTriangles(), 256);
+
+	TqFloat tHit = 0;
+	BOOST_REQUIRE(bvh.intersect(makeRay(CqVector3D(3.3f,4.6f,0), CqVector3D(0,0,1)), tHit));
+	BOOST_CHECK_CLOSE(tHit, 2.0f, 1e-4f);
+	// Rays are segments: stopping short of the planes misses them.
+	BOOST_CHECK(!bvh.intersect(makeRay(CqVector3D(3.3f,4.6f,0), CqVector3D(0,0,1), 1.5f), tHit));
+	// Rays outside the planes miss.
+	BOOST_CHECK(!bvh.intersect(makeRay(CqVector3D(9,4,0), CqVector3D(0,0,1)), tHit));
+}
+
+BOOST_AUTO_TEST_CASE(bvh_packet_test)
+{
+	std::vector<SqRayTriangle> tris;
+	addPlane(tris, 4, 1);
+	CqBvh bvh;
+	bvh.build(tris, 1);
+
+	SqRay rays[CqBvh::maxPacketSize];
+	for(TqInt i = 0; i < CqBvh::maxPacketSize; ++i)
+		rays[i] = makeRay(CqVector3D(0.75f*i + 0.1f, 0.5f, 0), CqVector3D(0,0,1));
+	// Shorten one ray so it stops before the plane.
+	rays[1].tMax = 0.5f;
+	bool occluded[CqBvh::maxPacketSize];
+	bvh.occluded(rays, CqBvh::maxPacketSize, occluded);
+	for(TqInt i = 0; i < CqBvh::maxPacketSize; ++i)
+		BOOST_CHECK_EQUAL(occluded[i], i != 1 && rays[i].origin.x() < 4);
+}
+
+BOOST_AUTO_TEST_CASE(bvh_threaded_build_test)
+{
+	// Enough triangles to build subtrees concurrently, compared against a
+	// brute force search.
+	std::vector<SqRayTriangle> tris;
+	for(TqInt k = 0; k < 6; ++k)
+		addPlane(tris, 32, 1 + 0.7f*k);
+	std::vector<SqRayTriangle> reference(tris);
+	CqBvh bvh;
+	bvh.build(tris, 4);
+	BOOST_CHECK_EQUAL(bvh.numTriangles(), static_cast<TqInt>(reference.size()));
+
+	for(TqInt i = 0; i < 200; ++i)
+	{
+		TqFloat a = 0.1f*i;
+		SqRay ray = makeRay(CqVector3D(16 + 10*std::cos(a), 16 + 10*std::sin(a), 0),
+				CqVector3D(std::sin(0.37f*i), std::cos(0.53f*i), 1));
+		TqFloat tBvh = 0, tBrute = 0;
+		bool hitBvh = bvh.intersect(ray, tBvh);
+		bool hitBrute = bruteIntersect(reference, ray, tBrute);
+		BOOST_CHECK_EQUAL(hitBvh, hitBrute);
+		if(hitBvh && hitBrute)
+			BOOST_CHECK_CLOSE(tBvh, tBrute, 1e-3f);
+	}
+}
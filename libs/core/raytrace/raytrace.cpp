@@ -26,8 +26,57 @@
 #include	<aqsis/aqsis.h>
 #include	"raytrace.h"
 
+#include	<algorithm>
+#include	<cmath>
+
+#include	<aqsis/util/threadscheduler.h>
+
+#include	"micropolygon.h"
+#include	"points.h"
+#include	"procedural.h"
+#include	"renderer.h"
+#include	"stats.h"
+#include	"surface.h"
+
 namespace Aqsis {
 
+namespace {
+
+/// Primitives still undiceable after this many splits are left out.
+const TqInt maxTessellationSplits = 16;
+
+/** Get the matrix used to choose the tessellation rate of a primitive.
+ *
+ * Primitives are diced as if every part of them faced the camera, in the
+ * same way as for Attribute "dice" "rasterorient" 0, so that parts of the
+ * scene seen only by rays are still tessellated finely enough.
+ */
+CqMatrix tessellationCoords(const CqSurface& surface)
+{
+	CqMatrix matCtoR;
+	QGetRenderContext()->matSpaceToSpace("camera", "raster", NULL, NULL, 0, matCtoR);
+	TqFloat xscale = matCtoR[0][0];
+	TqFloat yscale = matCtoR[1][1];
+	const IqOptions& opts = *QGetRenderContext()->poptCurrent();
+	if(opts.GetIntegerOption("System", "Projection")[0] == ProjectionPerspective)
+	{
+		// Scale by the distance to the primitive, which may surround the
+		// camera, so don't let the distance fall below half its depth.
+		CqBound bound;
+		surface.Bound(&bound);
+		TqFloat midz = 0.5f*(bound.vecMin().z() + bound.vecMax().z());
+		TqFloat dist = std::max(std::fabs(midz),
+				0.5f*(bound.vecMax().z() - bound.vecMin().z()));
+		dist = std::max(dist, opts.GetFloatOption("System", "Clipping")[0]);
+		xscale /= dist;
+		yscale /= dist;
+	}
+	TqFloat zscale = std::max(std::fabs(xscale), std::fabs(yscale));
+	return CqMatrix(xscale, yscale, zscale);
+}
+
+} // unnamed namespace
+
 
 /// Required function that implements Class Factory design pattern for Raytrace libraries
 IqRaytrace* CreateRaytracer()
@@ -36,14 +85,147 @@ IqRaytrace* CreateRaytracer()
 }
 
 
-void CqRaytrace::Initialise()
+CqRaytrace::CqRaytrace()
+	: m_primitives(),
+	m_triangles(),
+	m_bvh(),
+	m_fFinalised(false)
 {}
 
+void CqRaytrace::Initialise()
+{
+	m_primitives.clear();
+	m_triangles.clear();
+	m_bvh.clear();
+	m_fFinalised = false;
+}
+
 void CqRaytrace::AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface)
-{}
+{
+	if(m_fFinalised)
+		return;
+	boost::shared_ptr<CqSurface> surface = boost::dynamic_pointer_cast<CqSurface>(pSurface);
+	if(!surface || surface->pAttributes()->GetIntegerAttributeDef("visibility", "transmission", 0) == 0)
+		return;
+	// Expanding a procedural here would create its contents twice, and
+	// points have no surface to tessellate.
+	if(dynamic_cast<CqProcedural*>(surface.get())
+		|| dynamic_cast<CqPoints*>(surface.get()))
+		return;
+
+	// Work on a copy, so that splitting and dicing can't disturb the
+	// primitive the renderer holds.  In multipass mode the primitive hasn't
+	// been moved into camera space yet.
+	boost::shared_ptr<CqSurface> copy(surface->Clone());
+	const TqInt* pMultipass = QGetRenderContext()->GetIntegerOption("Render", "multipass");
+	if(pMultipass && pMultipass[0])
+	{
+		CqMatrix matWtoC, matNWtoC, matVWtoC;
+		QGetRenderContext()->matSpaceToSpace("world", "camera", NULL, copy->pTransform().get(), 0, matWtoC);
+		QGetRenderContext()->matNSpaceToSpace("world", "camera", NULL, copy->pTransform().get(), 0, matNWtoC);
+		QGetRenderContext()->matVSpaceToSpace("world", "camera", NULL, copy->pTransform().get(), 0, matVWtoC);
+		copy->Transform(matWtoC, matNWtoC, matVWtoC);
+	}
+	m_primitives.push_back(copy);
+}
 
 void CqRaytrace::Finalise()
-{}
+{
+	AQSIS_TIME_SCOPE(Raytrace_build);
+
+	for(TqInt i = 0, end = m_primitives.size(); i < end; ++i)
+		Tessellate(m_primitives[i], 0);
+	m_primitives.clear();
+
+	TqInt numThreads = 1;
+#ifdef	ENABLE_THREADING
+	numThreads = CqThreadScheduler::hardwareThreads();
+	if(const TqInt* threads = QGetRenderContext()->poptCurrent()->
+			GetIntegerOption("limits", "threads"))
+	{
+		if(threads[0] > 0)
+			numThreads = threads[0];
+	}
+#endif
+	m_bvh.build(m_triangles, numThreads);
+	m_fFinalised = true;
+	STATS_SETI( RAY_triangles, m_bvh.numTriangles() );
+}
+
+bool CqRaytrace::Intersect(const SqRay& ray, TqFloat& tHit) const
+{
+	STATS_INC( RAY_traced );
+	bool hit = m_bvh.intersect(ray, tHit);
+	if(hit)
+		STATS_INC( RAY_hits );
+	return hit;
+}
+
+void CqRaytrace::Occluded(const SqRay* rays, TqInt count, bool* occluded) const
+{
+	TqInt hits = 0;
+	for(TqInt i = 0; i < count; i += CqBvh::maxPacketSize)
+	{
+		TqInt packetSize = std::min(count - i, CqBvh::maxPacketSize);
+		m_bvh.occluded(rays + i, packetSize, occluded + i);
+		for(TqInt j = i; j < i + packetSize; ++j)
+			hits += occluded[j];
+	}
+	STATS_ADDI( RAY_traced, count );
+	STATS_ADDI( RAY_hits, hits );
+}
+
+/** Split a primitive until it can be diced, and add the diced grids to the
+ * triangle list.
+ */
+void CqRaytrace::Tessellate(const boost::shared_ptr<CqSurface>& pSurface, TqInt splitCount)
+{
+	if(pSurface->Diceable(tessellationCoords(*pSurface)))
+	{
+		CqMicroPolyGridBase* pGrid = pSurface->Dice();
+		if(pGrid)
+		{
+			ADDREF( pGrid );
+			AddGrid(*pGrid);
+			RELEASEREF( pGrid );
+		}
+	}
+	else if(!pSurface->fDiscard() && splitCount < maxTessellationSplits)
+	{
+		std::vector<boost::shared_ptr<CqSurface> > aSplits;
+		TqInt cSplits = pSurface->Split(aSplits);
+		for(TqInt i = 0; i < cSplits; ++i)
+			Tessellate(aSplits[i], splitCount + 1);
+	}
+}
+
+/** Add two triangles for each micropolygon of a grid.
+ */
+void CqRaytrace::AddGrid(CqMicroPolyGridBase& grid)
+{
+	IqShaderData* pVarP = grid.pVar(EnvVars_P);
+	if(!pVarP)
+		return;
+	const CqVector3D* pP = 0;
+	pVarP->GetPointPtr(pP);
+	TqInt cu = grid.uGridRes();
+	TqInt cv = grid.vGridRes();
+	SqRayTriangle tri;
+	for(TqInt v = 0; v < cv; ++v)
+	{
+		for(TqInt u = 0; u < cu; ++u)
+		{
+			TqInt i = v*(cu + 1) + u;
+			tri.v0 = pP[i];
+			tri.v1 = pP[i + 1];
+			tri.v2 = pP[i + cu + 2];
+			m_triangles.push_back(tri);
+			tri.v1 = pP[i + cu + 2];
+			tri.v2 = pP[i + cu + 1];
+			m_triangles.push_back(tri);
+		}
+	}
+}
 
 
 //---------------------------------------------------------------------
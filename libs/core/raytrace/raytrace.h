@@ -13,16 +13,32 @@
 #ifndef	___raytrace_Loaded___
 #define	___raytrace_Loaded___
 
+#include	<vector>
+
 #include	<aqsis/aqsis.h>
-#include	"iraytrace.h"
+#include	<aqsis/core/iraytrace.h>
+#include	"bvh.h"
 
 namespace Aqsis {
 
+class CqSurface;
+class CqMicroPolyGridBase;
 
+/** \brief The raytracing database.
+ *
+ * A copy of each primitive with Attribute "visibility" "transmission" set is
+ * kept as it is added.  Finalise() tessellates the copies into triangles, by
+ * splitting and dicing them at their shading rate, and then builds a CqBvh
+ * over the triangles, which ray queries use for the rest of the frame.
+ * Tessellation waits for Finalise() so that it sees the options which are
+ * only set at WorldEnd, such as the grid size.  Displacement is not applied
+ * to the tessellation, and primitives added after Finalise(), such as the
+ * contents of procedurals, are not traced.  Primitives from motion blocks
+ * are added at their keyframe nearest the shutter open time.
+ */
 struct CqRaytrace : public IqRaytrace
 {
-	CqRaytrace()
-	{}
+	CqRaytrace();
 	virtual ~CqRaytrace()
 	{}
 
@@ -31,6 +47,17 @@ struct CqRaytrace : public IqRaytrace
 	virtual	void	Initialise();
 	virtual	void	AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface);
 	virtual void	Finalise();
+	virtual bool	Intersect(const SqRay& ray, TqFloat& tHit) const;
+	virtual void	Occluded(const SqRay* rays, TqInt count, bool* occluded) const;
+
+	private:
+		void	Tessellate(const boost::shared_ptr<CqSurface>& pSurface, TqInt splitCount);
+		void	AddGrid(CqMicroPolyGridBase& grid);
+
+		std::vector<boost::shared_ptr<CqSurface> >	m_primitives;	///< Primitives waiting for Finalise().
+		std::vector<SqRayTriangle>	m_triangles;	///< Triangles of the tessellated primitives.
+		CqBvh	m_bvh;			///< Hierarchy over the triangles, built by Finalise().
+		bool	m_fFinalised;	///< Set once the hierarchy has been built.
 };
 
 
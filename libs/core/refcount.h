@@ -17,6 +17,8 @@
 #include	<vector>
 #include	<list>
 
+#include	"atomic.h"
+
 /**
  * These are debug and non-debug versions of the macros ADDREF and RELEASEREF.
  *
@@ -123,14 +125,15 @@ class CqRefCount
 		{
 			return ( m_cReferences );
 		}
+		/// Objects may be shared between rendering threads, so the count is
+		/// updated atomically when threading is enabled.
 		void	AddRef()
 		{
-			m_cReferences++;
+			Aqsis::atomicAddAndFetch( m_cReferences, 1 );
 		}
 		void	Release()
 		{
-			m_cReferences--;
-			if ( m_cReferences <= 0 )
+			if ( Aqsis::atomicAddAndFetch( m_cReferences, -1 ) <= 0 )
 				delete( this );
 		}
 
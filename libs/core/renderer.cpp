@@ -29,12 +29,16 @@
 #include	<time.h>
 #include	<boost/bind.hpp>
 #include	<boost/filesystem/fstream.hpp>
+#ifdef ENABLE_THREADING
+#include	<boost/thread/tss.hpp>
+#endif
 
 #include	"imagebuffer.h"
 #include	"lights.h"
 #include	"renderer.h"
 #include	"shaders.h"
 #include	"nurbs.h"
+#include	"objectinstance.h"
 #include	"points.h"
 #include	"lath.h"
 #include	"transform.h"
@@ -63,8 +67,34 @@ static const TqUlong shash = CqString::hash( "shader" ); //< == "shader"
 static const TqUlong chash = CqString::hash( "camera" ); //< == "camera"
 static const TqUlong cuhash = CqString::hash( "current" ); //< == "current"
 
-static CqMatrix oldkey[2];  //< to eliminate Inverse(), Transpose() matrix ops.
-static CqMatrix oldresult[2];
+namespace {
+
+/// Caches for speeding up repeated coordinate system queries.
+struct SqSpaceCache
+{
+	CqMatrix oldkey[2];  //< to eliminate Inverse(), Transpose() matrix ops.
+	CqMatrix oldresult[2];
+	TqInt awhich;        //< last coordinate system found by WhichMatToWorld
+	TqInt bwhich;        //< last coordinate system found by WhichMatWorldTo
+	SqSpaceCache() : awhich(0), bwhich(0) {}
+};
+
+/// Get the space cache for the calling thread; shaders query coordinate
+/// systems from all the rendering threads at once.
+SqSpaceCache& spaceCache()
+{
+#ifdef ENABLE_THREADING
+	static boost::thread_specific_ptr<SqSpaceCache> threadCache;
+	if(!threadCache.get())
+		threadCache.reset(new SqSpaceCache());
+	return *threadCache;
+#else
+	static SqSpaceCache cache;
+	return cache;
+#endif
+}
+
+} // unnamed namespace
 
 //---------------------------------------------------------------------
 /** Default constructor for the main renderer class. Initialises current state.
@@ -82,6 +112,9 @@ CqRenderer::CqRenderer()
 	m_Shaders(),
 	m_InstancedShaders(),
 	m_lights(),
+	m_objects(),
+	m_objectName(),
+	m_pObjectDefinition(),
 	m_textureCache(),
 	m_fSaveGPrims(false),
 	m_pTransCamera(new CqTransform()),
@@ -172,10 +205,10 @@ CqRenderer::~CqRenderer()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginMainModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( !m_pconCurrent )
+	if ( !currentContext() )
 	{
-		m_pconCurrent = boost::shared_ptr<CqModeBlock>( new CqMainModeBlock( m_pconCurrent ) );
-		return ( m_pconCurrent );
+		currentContext() = boost::shared_ptr<CqModeBlock>( new CqMainModeBlock( currentContext() ) );
+		return ( currentContext() );
 	}
 	else
 		return boost::shared_ptr<CqModeBlock>( );
@@ -191,12 +224,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginMainModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginFrameModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginFrameModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginFrameModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -215,12 +248,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginFrameModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginWorldModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginWorldModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginWorldModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -238,12 +271,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginWorldModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginAttributeModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginAttributeModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginAttributeModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -262,12 +295,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginAttributeModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginTransformModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginTransformModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginTransformModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -286,12 +319,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginTransformModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginSolidModeBlock( CqString& type )
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginSolidModeBlock( type );
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginSolidModeBlock( type );
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -310,12 +343,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginSolidModeBlock( CqString& type )
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginObjectModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginObjectModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginObjectModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -334,12 +367,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginObjectModeBlock()
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginMotionModeBlock( TqInt N, TqFloat times[] )
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginMotionModeBlock( N, times );
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginMotionModeBlock( N, times );
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -356,12 +389,12 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginMotionModeBlock( TqInt N, TqFloa
 boost::shared_ptr<CqModeBlock>	CqRenderer::BeginResourceModeBlock()
 {
 	// XXX: Error checking may eventually be unnecessary.  - ajb
-	if ( m_pconCurrent )
+	if ( currentContext() )
 	{
-		boost::shared_ptr<CqModeBlock> pconNew = m_pconCurrent->BeginResourceModeBlock();
+		boost::shared_ptr<CqModeBlock> pconNew = currentContext()->BeginResourceModeBlock();
 		if ( pconNew )
 		{
-			m_pconCurrent = pconNew;
+			currentContext() = pconNew;
 			return ( pconNew );
 		}
 		else
@@ -377,10 +410,10 @@ boost::shared_ptr<CqModeBlock>	CqRenderer::BeginResourceModeBlock()
 
 void	CqRenderer::EndMainModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == BeginEnd))
+	if ( currentContext() && (currentContext()->Type() == BeginEnd))
 	{
-		m_pconCurrent->EndMainModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndMainModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -391,10 +424,10 @@ void	CqRenderer::EndMainModeBlock()
 
 void	CqRenderer::EndFrameModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Frame ))
+	if ( currentContext() && (currentContext()->Type() == Frame ))
 	{
-		m_pconCurrent->EndFrameModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndFrameModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -405,10 +438,10 @@ void	CqRenderer::EndFrameModeBlock()
 
 void	CqRenderer::EndWorldModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == World))
+	if ( currentContext() && (currentContext()->Type() == World))
 	{
-		m_pconCurrent->EndWorldModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndWorldModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -419,10 +452,10 @@ void	CqRenderer::EndWorldModeBlock()
 
 void	CqRenderer::EndAttributeModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Attribute))
+	if ( currentContext() && (currentContext()->Type() == Attribute))
 	{
-		m_pconCurrent->EndAttributeModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndAttributeModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -433,12 +466,12 @@ void	CqRenderer::EndAttributeModeBlock()
 
 void	CqRenderer::EndTransformModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Transform))
+	if ( currentContext() && (currentContext()->Type() == Transform))
 	{
 		// Copy the current state of the attributes UP the stack as a TransformBegin/End doesn't store them
-		m_pconCurrent->pconParent()->m_pattrCurrent = m_pconCurrent->m_pattrCurrent;
-		m_pconCurrent->EndTransformModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->pconParent()->m_pattrCurrent = currentContext()->m_pattrCurrent;
+		currentContext()->EndTransformModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -449,10 +482,10 @@ void	CqRenderer::EndTransformModeBlock()
 
 void	CqRenderer::EndSolidModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Solid ) )
+	if ( currentContext() && (currentContext()->Type() == Solid ) )
 	{
-		m_pconCurrent->EndSolidModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndSolidModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -463,10 +496,10 @@ void	CqRenderer::EndSolidModeBlock()
 
 void	CqRenderer::EndObjectModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Object ) )
+	if ( currentContext() && (currentContext()->Type() == Object ) )
 	{
-		m_pconCurrent->EndObjectModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndObjectModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -477,14 +510,14 @@ void	CqRenderer::EndObjectModeBlock()
 
 void	CqRenderer::EndMotionModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Motion) )
+	if ( currentContext() && (currentContext()->Type() == Motion) )
 	{
-		boost::shared_ptr<CqModeBlock> pconParent = m_pconCurrent->pconParent();
+		boost::shared_ptr<CqModeBlock> pconParent = currentContext()->pconParent();
 		// Copy the current state of the attributes UP the stack as a TransformBegin/End doesn't store them
-		pconParent->m_pattrCurrent = m_pconCurrent->m_pattrCurrent;
-		pconParent->m_ptransCurrent = m_pconCurrent->m_ptransCurrent;
-		m_pconCurrent->EndMotionModeBlock();
-		m_pconCurrent = pconParent;
+		pconParent->m_pattrCurrent = currentContext()->m_pattrCurrent;
+		pconParent->m_ptransCurrent = currentContext()->m_ptransCurrent;
+		currentContext()->EndMotionModeBlock();
+		currentContext() = pconParent;
 	}
 }
 
@@ -495,10 +528,10 @@ void	CqRenderer::EndMotionModeBlock()
 
 void	CqRenderer::EndResourceModeBlock()
 {
-	if ( m_pconCurrent && (m_pconCurrent->Type() == Resource))
+	if ( currentContext() && (currentContext()->Type() == Resource))
 	{
-		m_pconCurrent->EndResourceModeBlock();
-		m_pconCurrent = m_pconCurrent->pconParent();
+		currentContext()->EndResourceModeBlock();
+		currentContext() = currentContext()->pconParent();
 	}
 }
 
@@ -509,8 +542,8 @@ void	CqRenderer::EndResourceModeBlock()
 
 TqFloat	CqRenderer::Time() const
 {
-	if ( m_pconCurrent && m_pconCurrent->Type() == Motion)
-		return ( m_pconCurrent->Time() );
+	if ( currentContext() && currentContext()->Type() == Motion)
+		return ( currentContext()->Time() );
 	else
 		return ( QGetRenderContext() ->poptCurrent()->GetFloatOption( "System", "Shutter" ) [ 0 ] );
 }
@@ -522,8 +555,8 @@ TqFloat	CqRenderer::Time() const
 
 void CqRenderer::AdvanceTime()
 {
-	if ( m_pconCurrent )
-		m_pconCurrent->AdvanceTime();
+	if ( currentContext() )
+		currentContext()->AdvanceTime();
 }
 
 
@@ -533,8 +566,8 @@ void CqRenderer::AdvanceTime()
 
 const IqOptionsPtr CqRenderer::poptCurrent() const
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->poptCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->poptCurrent() );
 	else
 	{
 		return ( m_poptDefault );
@@ -547,8 +580,8 @@ const IqOptionsPtr CqRenderer::poptCurrent() const
 
 IqOptionsPtr CqRenderer::poptWriteCurrent()
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->poptWriteCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->poptWriteCurrent() );
 	else
 	{
 		return ( m_poptDefault );
@@ -560,8 +593,8 @@ IqOptionsPtr CqRenderer::poptWriteCurrent()
 
 IqOptionsPtr CqRenderer::pushOptions()
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->pushOptions() );
+	if ( currentContext() )
+		return ( currentContext()->pushOptions() );
 	else
 	{
 		// \note: cannot push/pop options outside the Main block.
@@ -575,8 +608,8 @@ IqOptionsPtr CqRenderer::pushOptions()
 
 IqOptionsPtr CqRenderer::popOptions()
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->popOptions() );
+	if ( currentContext() )
+		return ( currentContext()->popOptions() );
 	else
 	{
 		// \note: cannot push/pop options outside the Main block.
@@ -591,8 +624,8 @@ IqOptionsPtr CqRenderer::popOptions()
 
 CqAttributesPtr CqRenderer::pattrCurrent() const
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->pattrCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->pattrCurrent() );
 	else
 		return ( m_pAttrDefault );
 }
@@ -604,8 +637,8 @@ CqAttributesPtr CqRenderer::pattrCurrent() const
 
 CqAttributesPtr CqRenderer::pattrWriteCurrent() const
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->pattrWriteCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->pattrWriteCurrent() );
 	else
 		return ( m_pAttrDefault );
 }
@@ -617,8 +650,8 @@ CqAttributesPtr CqRenderer::pattrWriteCurrent() const
 
 CqTransformPtr CqRenderer::ptransCurrent() const
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->ptransCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->ptransCurrent() );
 	else
 		return ( m_pTransDefault );
 }
@@ -631,8 +664,8 @@ CqTransformPtr CqRenderer::ptransCurrent() const
 #if 0
 CqTransformPtr CqRenderer::ptransWriteCurrent()
 {
-	if ( m_pconCurrent )
-		return ( m_pconCurrent->ptransWriteCurrent() );
+	if ( currentContext() )
+		return ( currentContext()->ptransWriteCurrent() );
 	else
 		return ( m_pTransDefault );
 }
@@ -640,26 +673,26 @@ CqTransformPtr CqRenderer::ptransWriteCurrent()
 
 void	CqRenderer::ptransSetTime( const CqMatrix& matTrans )
 {
-	assert(m_pconCurrent);
+	assert(currentContext());
 
-	CqTransformPtr newTrans( new CqTransform( m_pconCurrent->ptransCurrent(), Time(), matTrans, CqTransform::Set() ) );
-	m_pconCurrent->ptransSetCurrent( newTrans );
+	CqTransformPtr newTrans( new CqTransform( currentContext()->ptransCurrent(), Time(), matTrans, CqTransform::Set() ) );
+	currentContext()->ptransSetCurrent( newTrans );
 }
 
 void	CqRenderer::ptransSetCurrentTime( const CqMatrix& matTrans )
 {
-	assert(m_pconCurrent);
+	assert(currentContext());
 
-	CqTransformPtr newTrans( new CqTransform( m_pconCurrent->ptransCurrent(), Time(), matTrans, CqTransform::SetCurrent() ) );
-	m_pconCurrent->ptransSetCurrent( newTrans );
+	CqTransformPtr newTrans( new CqTransform( currentContext()->ptransCurrent(), Time(), matTrans, CqTransform::SetCurrent() ) );
+	currentContext()->ptransSetCurrent( newTrans );
 }
 
 void	CqRenderer::ptransConcatCurrentTime( const CqMatrix& matTrans )
 {
-	assert(m_pconCurrent);
+	assert(currentContext());
 
-	CqTransformPtr newTrans( new CqTransform( m_pconCurrent->ptransCurrent(), Time(), matTrans, CqTransform::ConcatCurrent() ) );
-	m_pconCurrent->ptransSetCurrent( newTrans );
+	CqTransformPtr newTrans( new CqTransform( currentContext()->ptransCurrent(), Time(), matTrans, CqTransform::ConcatCurrent() ) );
+	currentContext()->ptransSetCurrent( newTrans );
 }
 
 
@@ -945,17 +978,18 @@ bool	CqRenderer::matVSpaceToSpace( const char* strFrom, const char* strTo, const
 
 
 
-	if (memcmp((void *) oldkey[0].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
+	SqSpaceCache& cache = spaceCache();
+	if (memcmp((void *) cache.oldkey[0].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
 	{
-		oldkey[0] = result;
+		cache.oldkey[0] = result;
 		result[ 3 ][ 0 ] = result[ 3 ][ 1 ] = result[ 3 ][ 2 ] = result[ 0 ][ 3 ] = result[ 1 ][ 3 ] = result[ 2 ][ 3 ] = 0.0;
 		result[ 3 ][ 3 ] = 1.0;
-		oldresult[0] = result;
+		cache.oldresult[0] = result;
 
 	}
 	else
 	{
-		result = oldresult[0];
+		result = cache.oldresult[0];
 	}
 	return ( true );
 }
@@ -1013,18 +1047,19 @@ bool	CqRenderer::matNSpaceToSpace( const char* strFrom, const char* strTo, const
 
 
 	result = matB * matA;
-	if (memcmp((void *) oldkey[1].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
+	SqSpaceCache& cache = spaceCache();
+	if (memcmp((void *) cache.oldkey[1].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
 	{
-		oldkey[1] = result;
+		cache.oldkey[1] = result;
 		result[ 3 ][ 0 ] = result[ 3 ][ 1 ] = result[ 3 ][ 2 ] = result[ 0 ][ 3 ] = result[ 1 ][ 3 ] = result[ 2 ][ 3 ] = 0.0;
 		result[ 3 ][ 3 ] = 1.0;
 		result = result.Inverse().Transpose();
-		oldresult[1] = result;
+		cache.oldresult[1] = result;
 
 	}
 	else
 	{
-		result = oldresult[1];
+		result = cache.oldresult[1];
 	}
 
 	return ( true );
@@ -1176,8 +1211,7 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 	fileName += RI_SHADER_EXTENSION;
 	boost::filesystem::path shaderPath
 		= poptCurrent()->findRiFileNothrow(fileName, "shader");
-	boost::filesystem::ifstream shaderFile(shaderPath);
-	if(shaderFile)
+	if(!shaderPath.empty())
 	{
 		Aqsis::log() << info << "Loading shader \"" << strName
 			<< "\" from file \"" << native(shaderPath)
@@ -1196,7 +1230,7 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 		boost::shared_ptr<IqShader> pShader;
 		try
 		{
-			pShader = createShaderVM(this, shaderFile, dsoPath);
+			pShader = createShaderVM(this, native(shaderPath), dsoPath);
 		}
 		catch(XqBadShader& e)
 		{
@@ -1258,6 +1292,13 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 
 void CqRenderer::StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface )
 {
+	// Primitives of an object definition are retained for the instances
+	// rather than rendered.
+	if(m_pObjectDefinition)
+	{
+		m_pObjectDefinition->AddSurface(pSurface);
+		return;
+	}
 	// If we are not in a mode that allows 'extra' passes, then fasttrack the primitive directly into the pipeline.
 	const TqInt* pMultipass = GetIntegerOption("Render", "multipass");
 	if(pMultipass && pMultipass[0])
@@ -1382,6 +1423,31 @@ CqLightsourcePtr CqRenderer::findLight(const char* name)
 	return i->second;
 }
 
+void CqRenderer::BeginObjectDefinition(const char* name)
+{
+	m_objectName = name;
+	m_pObjectDefinition.reset(new CqObjectMaster());
+}
+
+void CqRenderer::EndObjectDefinition()
+{
+	if(!m_pObjectDefinition)
+		return;
+	// A new definition replaces any previous object of the same name;
+	// instances already created keep the old one.
+	m_objects[m_objectName] = m_pObjectDefinition;
+	m_pObjectDefinition.reset();
+}
+
+boost::shared_ptr<const CqObjectMaster> CqRenderer::findObject(const char* name) const
+{
+	TqObjectMap::const_iterator i = m_objects.find(name);
+	if(i == m_objects.end())
+		AQSIS_THROW_XQERROR(XqValidation, EqE_BadHandle,
+				"unknown object \"" << name << "\" encountered");
+	return i->second;
+}
+
 //---------------------------------------------------------------------
 /** Add a new requested display driver to the list.
  */
@@ -1460,7 +1526,7 @@ bool	CqRenderer::GetBasisMatrix( CqMatrix& matBasis, const CqString& name )
  */
 bool CqRenderer::WhichMatToWorld( CqMatrix &matA, TqUlong thash )
 {
-	static TqInt awhich = 0;
+	TqInt& awhich = spaceCache().awhich;
 	TqInt tmp = awhich;
 
 
@@ -1491,7 +1557,7 @@ bool CqRenderer::WhichMatToWorld( CqMatrix &matA, TqUlong thash )
 
 bool CqRenderer::WhichMatWorldTo( CqMatrix &matB, TqUlong thash )
 {
-	static TqInt bwhich = 0;
+	TqInt& bwhich = spaceCache().bwhich;
 	TqInt tmp = bwhich;
 
 
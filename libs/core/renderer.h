@@ -32,6 +32,10 @@
 #include	<iostream>
 #include	<time.h>
 
+#ifdef ENABLE_THREADING
+#include	<boost/thread/tss.hpp>
+#endif
+
 #include	<aqsis/aqsis.h>
 
 #include	<aqsis/ri/ri.h>
@@ -43,8 +47,7 @@
 #include	<aqsis/riutil/tokendictionary.h>
 #include	"iddmanager.h"
 #include	<aqsis/core/irenderer.h>
-#include	"iraytrace.h"
-#include	"iraytrace.h"
+#include	<aqsis/core/iraytrace.h>
 #include	<aqsis/tex/filtering/itexturecache.h>
 #include	"lights.h"
 
@@ -54,6 +57,7 @@ namespace Aqsis {
 
 class CqImageBuffer;
 class CqModeBlock;
+class CqObjectMaster;
 
 struct SqCoordSys
 {
@@ -149,13 +153,22 @@ class CqRenderer : public IqRenderer
 		virtual	void	AdvanceTime();
 
 		/** Set a pointer to the current context.
-		 * Primarily for Procedural objects
+		 * Primarily for Procedural objects.  When threading is enabled the
+		 * new context is only seen by the calling thread, until it's set
+		 * back to the shared one.
 		 * \return Pointer to a previous CqModeBlock.
 		 */
 		virtual	boost::shared_ptr<CqModeBlock>	pconCurrent(const boost::shared_ptr<CqModeBlock>& pcon )
 		{
-			boost::shared_ptr<CqModeBlock> prev = m_pconCurrent;
+			boost::shared_ptr<CqModeBlock> prev = currentContext();
+#ifdef ENABLE_THREADING
+			if(pcon == m_pconCurrent)
+				m_threadContext.reset();
+			else
+				m_threadContext.reset(new boost::shared_ptr<CqModeBlock>(pcon));
+#else
 			m_pconCurrent = pcon;
+#endif
 			return ( prev );
 		}
 		/** Get a pointer to the current context.
@@ -163,14 +176,14 @@ class CqRenderer : public IqRenderer
 		 */
 		virtual	boost::shared_ptr<CqModeBlock>	pconCurrent()
 		{
-			return ( m_pconCurrent );
+			return ( currentContext() );
 		}
 		/** Get a erad only pointer to the current context.
 		 * \return Pointer to a CqModeBlock derived class.
 		 */
 		virtual const	boost::shared_ptr<CqModeBlock>	pconCurrent() const
 		{
-			return ( m_pconCurrent );
+			return ( currentContext() );
 		}
 		/** Get a pointer to the current image buffer.
 		 * \return A CqImageBuffer pointer.
@@ -278,6 +291,18 @@ class CqRenderer : public IqRenderer
 		/// Find the light associated with the given name
 		CqLightsourcePtr findLight(const char* name);
 
+		/// Begin the definition of a retained object with the given name.
+		void	BeginObjectDefinition( const char* name );
+		/// End the current object definition, making it available to instances.
+		void	EndObjectDefinition();
+		/// Get the object being defined, or null outside an object definition.
+		CqObjectMaster*	pObjectDefinition() const
+		{
+			return m_pObjectDefinition.get();
+		}
+		/// Find the retained object associated with the given name
+		boost::shared_ptr<const CqObjectMaster> findObject( const char* name ) const;
+
 		void	PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		void	StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface );
 		void	PostWorld();
@@ -477,7 +502,7 @@ class CqRenderer : public IqRenderer
 
 		/** Get a pointer to the raytracing subsystem
 		 */
-		IqRaytrace*	pRaytracer() const
+		virtual	IqRaytrace*	pRaytracer() const
 		{
 			return( m_pRaytracer );
 		}
@@ -523,10 +548,36 @@ class CqRenderer : public IqRenderer
 	private:
 		const SqOutputDataEntry* FindOutputDataEntry(const char* name);
 
+		/** Get the current context as seen by the calling thread.
+		 *
+		 * This is the context set for this thread by pconCurrent(), if any,
+		 * otherwise the one shared by all threads.
+		 */
+		boost::shared_ptr<CqModeBlock>& currentContext()
+		{
+#ifdef ENABLE_THREADING
+			if(m_threadContext.get())
+				return *m_threadContext;
+#endif
+			return m_pconCurrent;
+		}
+		const boost::shared_ptr<CqModeBlock>& currentContext() const
+		{
+#ifdef ENABLE_THREADING
+			if(m_threadContext.get())
+				return *m_threadContext;
+#endif
+			return m_pconCurrent;
+		}
+
 		/// Map type to hold loaded reference shaders.
 		typedef std::map< CqShaderKey, boost::shared_ptr<IqShader> > TqShaderMap;
 
 		boost::shared_ptr<CqModeBlock>	m_pconCurrent;					///< Pointer to the current context.
+#ifdef ENABLE_THREADING
+		/// Context set by pconCurrent() for the calling thread only.
+		mutable boost::thread_specific_ptr<boost::shared_ptr<CqModeBlock> > m_threadContext;
+#endif
 		CqStats	m_Stats;						///< Global statistics.
 		CqAttributesPtr	m_pAttrDefault;					///< Default attributes.
 		CqOptionsPtr m_poptDefault;  					///< Pointer to default options.
@@ -542,6 +593,11 @@ class CqRenderer : public IqRenderer
 		typedef std::map<std::string, CqLightsourcePtr> TqLightMap;
 		TqLightMap m_lights;
 
+		typedef std::map<std::string, boost::shared_ptr<CqObjectMaster> > TqObjectMap;
+		TqObjectMap m_objects;	///< Retained objects, by name.
+		std::string m_objectName;	///< Name of the object being defined.
+		boost::shared_ptr<CqObjectMaster> m_pObjectDefinition;	///< Object being defined.
+
 		boost::shared_ptr<IqTextureCache> m_textureCache; ///< Cache for aqsistex texture access.
 		 
 
@@ -30,8 +30,91 @@
 #include	"shaders.h"
 #include	<aqsis/util/file.h>
 
+#ifdef ENABLE_THREADING
+#include	<map>
+#include	<boost/thread/tss.hpp>
+#include	<boost/weak_ptr.hpp>
+#endif
+
 namespace Aqsis {
 
+#ifdef ENABLE_THREADING
+namespace {
+
+/// Per-thread shader instance, remembering which shader it was cloned from.
+struct SqThreadShader
+{
+	boost::weak_ptr<IqShader> original;
+	boost::shared_ptr<IqShader> instance;
+};
+typedef std::map<const IqShader*, SqThreadShader> TqThreadShaderMap;
+
+boost::thread_specific_ptr<TqThreadShaderMap> g_threadShaders;
+
+/// Drop any instances whose original shader no longer exists.
+void pruneThreadShaders(TqThreadShaderMap& shaders)
+{
+	for(TqThreadShaderMap::iterator i = shaders.begin(); i != shaders.end(); )
+	{
+		if(i->second.original.expired())
+			shaders.erase(i++);
+		else
+			++i;
+	}
+}
+
+} // unnamed namespace
+#endif
+
+boost::shared_ptr<IqShader> threadShaderInstance(const boost::shared_ptr<IqShader>& shader)
+{
+#ifdef ENABLE_THREADING
+	if(!shader)
+		return shader;
+	TqThreadShaderMap* shaders = g_threadShaders.get();
+	if(!shaders)
+	{
+		shaders = new TqThreadShaderMap();
+		g_threadShaders.reset(shaders);
+	}
+	TqThreadShaderMap::iterator i = shaders->find(shader.get());
+	if(i != shaders->end())
+	{
+		// The address may have been reused by a new shader since the
+		// instance was created, so check it really is the same one.
+		if(i->second.original.lock() == shader)
+			return i->second.instance;
+		shaders->erase(i);
+	}
+	// Keep the cache from filling up with instances of shaders which have
+	// been discarded (eg, at the end of a frame).
+	if(shaders->size() >= 64)
+		pruneThreadShaders(*shaders);
+	SqThreadShader& entry = (*shaders)[shader.get()];
+	entry.original = shader;
+	entry.instance = shader->Clone();
+	return entry.instance;
+#else
+	return shader;
+#endif
+}
+
+
+CqLayeredShader::CqLayeredShader(const CqLayeredShader& from)
+	: IqShader(),
+	m_Uses(from.m_Uses),
+	m_pTransform(from.m_pTransform),
+	m_strName(from.m_strName),
+	m_outsideWorld(from.m_outsideWorld),
+	m_Layers(),
+	m_LayerMap(from.m_LayerMap),
+	m_Connections(from.m_Connections)
+{
+	m_Layers.reserve(from.m_Layers.size());
+	for(std::vector<std::pair<CqString, boost::shared_ptr<IqShader> > >::const_iterator
+			i = from.m_Layers.begin(); i != from.m_Layers.end(); ++i)
+		m_Layers.push_back(std::make_pair(i->first, i->second->Clone()));
+}
 
 
 /** Add a new layer to this layered shader.
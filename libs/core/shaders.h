@@ -152,10 +152,12 @@ class CqLayeredShader : public IqShader
 			// are the only ones valid outside the world.
 			m_outsideWorld = !QGetRenderContextI()->IsWorldBegin();
 		}
-		CqLayeredShader(const CqLayeredShader& from)
-		{
-			/// \todo Need to implement a proper copy constrctor, and operator=.
-		}
+		/** \brief Copy constructor
+		 *
+		 * Each layer is cloned, so that the copy may be executed independently
+		 * of the original.
+		 */
+		CqLayeredShader(const CqLayeredShader& from);
 		virtual	~CqLayeredShader()
 		{}
 
@@ -270,6 +272,10 @@ class CqLayeredShader : public IqShader
 			// Not sure, probably always return false for now.
 			return ( false );
 		}
+		virtual	EqLightReuse	lightReuse() const
+		{
+			return ( LightReuse_None );
+		}
 		virtual boost::shared_ptr<IqShader> Clone() const
 		{
 			return boost::shared_ptr<IqShader>(new CqLayeredShader(*this));
@@ -341,9 +347,26 @@ class CqLayeredShader : public IqShader
 			CqString m_variable2Name;
 		};
 		std::multimap<CqString, SqLayerConnection> m_Connections;
+
+		CqLayeredShader& operator=(const CqLayeredShader& from);
 }
 ;
 
+//-----------------------------------------------------------------------
+/** \brief Get the instance of a shader which the calling thread should run.
+ *
+ * Shader instances hold their execution state (stack, local variables and
+ * the current grid), so they cannot be evaluated on two grids at once.  When
+ * threading is enabled this returns a clone of the shader which is private to
+ * the calling thread, created on first use; otherwise the shader itself is
+ * returned.
+ *
+ * All operations that prepare or run a shader for a particular grid
+ * (SetArgument with primitive variables, Initialise, Evaluate and
+ * FindArgument on the results) must go through the same instance.
+ */
+boost::shared_ptr<IqShader> threadShaderInstance(const boost::shared_ptr<IqShader>& shader);
+
 
 //-----------------------------------------------------------------------
 
@@ -69,6 +69,26 @@ void gStats_setF( TqInt index, TqFloat value )
 {
 	CqStats::setF( index, value );
 }
+void gStats_addI( TqInt index, TqInt value )
+{
+	CqStats::addI( index, value );
+}
+void gStats_maxI( TqInt index, TqInt value )
+{
+	CqStats::maxI( index, value );
+}
+void gStats_addF( TqInt index, TqFloat value )
+{
+	CqStats::addF( index, value );
+}
+void gStats_minF( TqInt index, TqFloat value )
+{
+	CqStats::minF( index, value );
+}
+void gStats_maxF( TqInt index, TqFloat value )
+{
+	CqStats::maxF( index, value );
+}
 TqFloat	 CqStats::m_floatVars[ CqStats::_Last_float ];		///< Float variables
 TqInt	 CqStats::m_intVars[ CqStats::_Last_int ];			///< Int variables
 /**
@@ -125,8 +145,12 @@ void CqStats::PrintStats( TqInt level ) const
 		Max		:= 3
 	*/
 #	ifdef USE_TIMERS
+	CqProfiler::addTimes(g_timerSet);
 	if( level > 0 )
+	{
 		g_timerSet.printTimes(MSG);
+		CqProfiler::printAttribution(MSG);
+	}
 #	endif // USE_TIMERS
 
 	MSG << std::setiosflags(std::ios_base::fixed)
@@ -191,7 +215,10 @@ void CqStats::PrintStats( TqInt level ) const
 		<<					"\t" << STATS_INT_GETI( GEO_prc_split ) << " split (" << _geo_prc_s_q << "%)\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dl ) << " dynamic load,\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dra ) << " dynamic read archive,\n\t\t"
-		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t\t"
+		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t"
+		<< "Object instances:\n"
+		<<					"\t\t" << STATS_INT_GETI( GEO_ins_created ) << " created\n\t"
+		<<					"\t" << STATS_INT_GETI( GEO_ins_split ) << " expanded\n"
 		<< std::endl;
 		/*
 			GPrim stats - End
@@ -222,11 +249,13 @@ void CqStats::PrintStats( TqInt level ) const
 		TqFloat	_grd_init_quote	= 0.0f;
 		TqFloat	_grd_shade_quote= 0.0f;
 		TqFloat	_grd_cull_quote = 0.0f;
+		TqFloat	_grd_occl_quote = 0.0f;
 		if (STATS_INT_GETI(GRD_created))
 		{
 			_grd_init_quote = 100.0f *  _grd_init / STATS_INT_GETI( GRD_created );
 			_grd_shade_quote = 100.0f *  _grd_shade / STATS_INT_GETI( GRD_created );
 			_grd_cull_quote = 100.0f *  STATS_INT_GETI( GRD_culled ) / STATS_INT_GETI( GRD_created );
+			_grd_occl_quote = 100.0f *  STATS_INT_GETI( GRD_occlusion_culled ) / STATS_INT_GETI( GRD_created );
 		}
 		if (_grd_init == 0)
 			_grd_init = 1;
@@ -250,7 +279,8 @@ void CqStats::PrintStats( TqInt level ) const
 		TqFloat	_grd_shd_g256	=	100.0f * STATS_INT_GETI( GRD_shd_size_g256 ) / _grd_shade;
 		MSG << "Grids:\n\t"
 		<< STATS_INT_GETI( GRD_created ) << " created, " << STATS_INT_GETI( GRD_peak ) << " peak,\n\t"
-		<< _grd_init << " initialized (" << _grd_init_quote << "%),\n\t" << _grd_shade << " shaded (" << _grd_shade_quote << "%), " << STATS_INT_GETI( GRD_culled ) << " culled (" << _grd_cull_quote << "%)\n\n"
+		<< _grd_init << " initialized (" << _grd_init_quote << "%),\n\t" << _grd_shade << " shaded (" << _grd_shade_quote << "%), " << STATS_INT_GETI( GRD_culled ) << " culled (" << _grd_cull_quote << "%),\n\t"
+		<< STATS_INT_GETI( GRD_occlusion_culled ) << " occlusion culled before shading (" << _grd_occl_quote << "%)\n\n"
 		<< "\tGrid count/size (diced grids):\n"
 		<< "\t+------+------+------+------+------+------+------+------+\n"
 		<< "\t|<=  4 |<=  8 |<= 16 |<= 32 |<= 64 |<=128 |<=256 | >256 |\n"
@@ -402,6 +432,63 @@ void CqStats::PrintStats( TqInt level ) const
 			Sampling - End
 			-------------------------------------------------------------------
 		*/
+		/*
+			-------------------------------------------------------------------
+			Raytracing
+		*/
+		if (STATS_INT_GETI( RAY_triangles ))
+		{
+			TqFloat _ray_h = 0.0f;
+			if (STATS_INT_GETI( RAY_traced ))
+				_ray_h = 100.0f * STATS_INT_GETI( RAY_hits ) / STATS_INT_GETI( RAY_traced );
+			MSG << "Raytracing:\n\t"
+			<< STATS_INT_GETI( RAY_triangles ) << " triangles\n\t"
+			<< STATS_INT_GETI( RAY_traced ) << " rays traced, "
+			<< STATS_INT_GETI( RAY_hits ) << " hits (" << _ray_h << "%)\n"
+			<< std::endl;
+		}
+		/*
+			Raytracing - End
+			-------------------------------------------------------------------
+		*/
+		/*
+			-------------------------------------------------------------------
+			Lightsources
+		*/
+		if (STATS_INT_GETI( SHD_lights_evaluated ))
+		{
+			TqInt _lights = STATS_INT_GETI( SHD_lights_evaluated ) + STATS_INT_GETI( SHD_lights_reused );
+			MSG << "Lights:\n\t"
+			<< _lights << " light evaluations requested, "
+			<< STATS_INT_GETI( SHD_lights_evaluated ) << " run, "
+			<< STATS_INT_GETI( SHD_lights_reused ) << " reused from cache ("
+			<< 100.0f * STATS_INT_GETI( SHD_lights_reused ) / _lights << "%)\n"
+			<< std::endl;
+		}
+		/*
+			Lightsources - End
+			-------------------------------------------------------------------
+		*/
+		/*
+			-------------------------------------------------------------------
+			Texture tile cache
+		*/
+		if (STATS_INT_GETI( TEX_tile_misses ))
+		{
+			TqInt _tex_lookups = STATS_INT_GETI( TEX_tile_hits ) + STATS_INT_GETI( TEX_tile_misses );
+			MSG << "Texture tiles:\n\t"
+			<< _tex_lookups << " lookups, "
+			<< STATS_INT_GETI( TEX_tile_hits ) << " hits ("
+			<< 100.0f * STATS_INT_GETI( TEX_tile_hits ) / _tex_lookups << "%), "
+			<< STATS_INT_GETI( TEX_tile_misses ) << " misses\n\t"
+			<< STATS_INT_GETI( TEX_tile_evictions ) << " evicted, "
+			<< STATS_INT_GETI( TEX_tile_memory ) << " KB in cache at end of frame\n"
+			<< std::endl;
+		}
+		/*
+			Texture tile cache - End
+			-------------------------------------------------------------------
+		*/
 		/*
 			Shading stats
 			-------------------------------------------------------------------
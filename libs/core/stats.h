@@ -30,11 +30,15 @@
 #include <aqsis/aqsis.h>
 
 #include <time.h>
+#include <cstring>
 #include <iostream>
+#if defined(ENABLE_THREADING) && !defined(AQSIS_COMPILER_GCC)
+#	include <intrin.h>
+#endif
 
-#include <aqsis/util/timer.h>
 #include <aqsis/ri/ri.h>
-#include <aqsis/util/enum.h>
+
+#include "profiler.h"
 
 namespace Aqsis {
 
@@ -44,6 +48,11 @@ extern TqInt gStats_getI( TqInt index );
 extern void gStats_setI( TqInt index, TqInt value );
 extern TqFloat gStats_getF( TqInt index );
 extern void gStats_setF( TqInt index, TqFloat value );
+extern void gStats_addI( TqInt index, TqInt value );
+extern void gStats_maxI( TqInt index, TqInt value );
+extern void gStats_addF( TqInt index, TqFloat value );
+extern void gStats_minF( TqInt index, TqFloat value );
+extern void gStats_maxF( TqInt index, TqFloat value );
 
 #define STATS_INC( index )				gStats_IncI( CqStats::index )
 #define STATS_DEC( index )				gStats_DecI( CqStats::index )
@@ -51,111 +60,13 @@ extern void gStats_setF( TqInt index, TqFloat value );
 #define	STATS_SETI( index , value )		gStats_setI( CqStats::index , value )
 #define	STATS_GETF( index )				gStats_getF( CqStats::index )
 #define	STATS_SETF( index , value )		gStats_setF( CqStats::index , value )
+#define	STATS_ADDI( index , value )		gStats_addI( CqStats::index , value )
+#define	STATS_MAXI( index , value )		gStats_maxI( CqStats::index , value )
+#define	STATS_ADDF( index , value )		gStats_addF( CqStats::index , value )
+#define	STATS_MINF( index , value )		gStats_minF( CqStats::index , value )
+#define	STATS_MAXF( index , value )		gStats_maxF( CqStats::index , value )
 
 
-//----------------------------------------------------------------------
-// Timer stuff.
-
-#ifdef USE_TIMERS
-
-/// Append time taken to the end of the current scope to the named timer.
-#define AQSIS_TIME_SCOPE(id) CqScopeTimer aq_scope_timer__(\
-		g_timerSet.getTimer(EqTimerStats::id))
-/// Start the named timer.
-#define AQSIS_TIMER_START(id) g_timerSet.getTimer(EqTimerStats::id).start()
-/// Stop the named timer and append the time since the corresponding TIMER_START
-#define AQSIS_TIMER_STOP(id) g_timerSet.getTimer(EqTimerStats::id).stop()
-
-/// A class enum containing constants for each operation to be timed.
-struct EqTimerStats
-{
-	enum Enum
-	{
-		// surface handling
-		Post_surface,
-		Dicable_check,
-		Dicing,
-		Splitting,
-		// buckets
-		Display_bucket,
-		Prepare_bucket,
-		// culling
-		Backface_culling,
-		Occlusion_culling_initialisation,
-		Occlusion_culling_surfaces,
-		Occlusion_culling,
-		Transparency_culling_micropolygons,
-		// grids
-		Project_points,
-		Bust_grids,
-		// shading
-		Atmosphere_shading,
-		Displacement_shading,
-		Imager_shading,
-		Surface_shading,
-		// texturing
-		Make_texture,
-		// sampling
-		Combine_samples,
-		Filter_samples,
-		Render_MPGs,
-		// high level
-		Frame,
-		Parse,
-
-		// invalid
-		LAST,
-	};
-	static const TqInt size = LAST;
-};
-
-AQSIS_ENUM_INFO_BEGIN(EqTimerStats::Enum, EqTimerStats::LAST)
-	// surface handling
-	"Post surface",
-	"Dicable check",
-	"Dicing",
-	"Splitting",
-	//buckets
-	"Display bucket",
-	"Prepare bucket",
-	// culling
-	"Backface culling",
-	"Occlusion culling initialisation",
-	"Occlusion culling surfaces",
-	"Occlusion culling",
-	"Transparency culling micropolygons",
-	// grids
-	"Project points",
-	"Bust grids",
-	// shading
-	"Atmosphere shading",
-	"Displacement shading",
-	"Imager shading",
-	"Surface shading",
-	// texturing
-	"Make texture",
-	// sampling
-	"Combine samples",
-	"Filter samples",
-	"Render MPGs",
-	// high level
-	"Frame",
-	"Parse",
-	// invalid
-	"LAST"
-AQSIS_ENUM_INFO_END
-
-extern CqTimerSet<EqTimerStats> g_timerSet;
-
-#else // USE_TIMERS
-
-// dummy declarations if compiled without timers.
-#define AQSIS_TIME_SCOPE(name)
-#define AQSIS_TIMER_START(identifier)
-#define AQSIS_TIMER_STOP(identifier)
-
-#endif // USE_TIMERS
-
 //----------------------------------------------------------------------
 /** \class CqStats
    \brief Class containing statistics information.
@@ -196,16 +107,87 @@ class CqStats
 			m_Complete = complete;
 		}
 
+		// When threading is enabled, the statistics may be updated from
+		// several rendering threads at once.  All the modifying functions
+		// below are then atomic, while the plain get/set functions are only
+		// meant for initialisation and reporting.
+
 		//! Increase an integer specified by an EqIntIndex value by one
 		static void IncI( const TqInt index )
 		{
-			m_intVars[ index ]++;
+			addI( index, 1 );
 		}
 
 		//! Decrease an integer specified by an EqIntIndex value by one
 		static void DecI( const TqInt index )
 		{
-			m_intVars[ index ]--;
+			addI( index, -1 );
+		}
+
+		//! Add value to an integer specified by an EqIntIndex value
+		static void addI( const TqInt index, const TqInt value )
+		{
+#ifdef ENABLE_THREADING
+			atomicAdd( m_intVars[ index ], value );
+#else
+			m_intVars[ index ] += value;
+#endif
+		}
+
+		//! Raise an integer specified by an EqIntIndex value to at least value
+		static void maxI( const TqInt index, const TqInt value )
+		{
+#ifdef ENABLE_THREADING
+			TqInt old = m_intVars[ index ];
+			while( value > old )
+			{
+				TqInt prev = atomicCompareAndSwap( m_intVars[ index ], old, value );
+				if( prev == old )
+					break;
+				old = prev;
+			}
+#else
+			if( value > m_intVars[ index ] )
+				m_intVars[ index ] = value;
+#endif
+		}
+
+		//! Add value to a float specified by an EqFloatIndex value
+		static void addF( const TqInt index, const TqFloat value )
+		{
+#ifdef ENABLE_THREADING
+			TqFloat old = m_floatVars[ index ];
+			while( !compareAndSwapF( index, old, old + value ) )
+				old = m_floatVars[ index ];
+#else
+			m_floatVars[ index ] += value;
+#endif
+		}
+
+		//! Lower a float specified by an EqFloatIndex value to at most value
+		static void minF( const TqInt index, const TqFloat value )
+		{
+#ifdef ENABLE_THREADING
+			TqFloat old = m_floatVars[ index ];
+			while( value < old && !compareAndSwapF( index, old, value ) )
+				old = m_floatVars[ index ];
+#else
+			if( value < m_floatVars[ index ] )
+				m_floatVars[ index ] = value;
+#endif
+		}
+
+		//! Raise a float specified by an EqFloatIndex value to at least value
+		static void maxF( const TqInt index, const TqFloat value )
+		{
+#ifdef ENABLE_THREADING
+			TqFloat old = m_floatVars[ index ];
+			while( value > old && !compareAndSwapF( index, old, value ) )
+				old = m_floatVars[ index ];
+#else
+			if( value > m_floatVars[ index ] )
+				m_floatVars[ index ] = value;
+#endif
 		}
 
 		//! Set an integer specified by an EqIntIndex value to value
@@ -317,10 +299,16 @@ class CqStats
 		       GEO_prc_created_dra,
 		       GEO_prc_created_prp,
 
+		       // Object instances
+
+		       GEO_ins_created,
+		       GEO_ins_split,
+
 		       // Grid stats
 
 		       GRD_created,
 		       GRD_culled,
+		       GRD_occlusion_culled,
 		       GRD_current,
 		       GRD_peak,
 		       GRD_allocated,
@@ -374,6 +362,8 @@ class CqStats
 		       MPG_pushed_far_down,
 
 		       // Shading stats
+		       SHD_lights_evaluated,
+		       SHD_lights_reused,
 
 		       // Sampling stats
 
@@ -381,6 +371,19 @@ class CqStats
 		       SPL_bound_hits,
 		       SPL_hits,
 
+		       // Raytracing stats
+
+		       RAY_triangles,
+		       RAY_traced,
+		       RAY_hits,
+
+		       // Texture tile cache stats
+
+		       TEX_tile_hits,
+		       TEX_tile_misses,
+		       TEX_tile_evictions,
+		       TEX_tile_memory,
+
 		       // Parameters
 		       PRM_created,
 		       PRM_current,
@@ -424,6 +427,38 @@ class CqStats
 	private:
 		std::ostream& TimeToString( std::ostream& os, TqFloat t, TqFloat tot ) const;
 
+#ifdef ENABLE_THREADING
+		/// Atomically add delta to value.
+		static void atomicAdd( TqInt& value, TqInt delta )
+		{
+#	ifdef AQSIS_COMPILER_GCC
+			__sync_fetch_and_add( &value, delta );
+#	else
+			_InterlockedExchangeAdd( reinterpret_cast<volatile long*>(&value), delta );
+#	endif
+		}
+		/// Atomically set value to newValue if it equals expected.
+		/// \return the value held before the operation.
+		static TqInt atomicCompareAndSwap( TqInt& value, TqInt expected, TqInt newValue )
+		{
+#	ifdef AQSIS_COMPILER_GCC
+			return __sync_val_compare_and_swap( &value, expected, newValue );
+#	else
+			return _InterlockedCompareExchange( reinterpret_cast<volatile long*>(&value),
+					newValue, expected );
+#	endif
+		}
+		/// Atomically replace a float variable if it still holds expected.
+		static bool compareAndSwapF( const TqInt index, TqFloat expected, TqFloat newValue )
+		{
+			TqInt expectedBits, newBits;
+			std::memcpy( &expectedBits, &expected, sizeof(TqInt) );
+			std::memcpy( &newBits, &newValue, sizeof(TqInt) );
+			return atomicCompareAndSwap( *reinterpret_cast<TqInt*>(&m_floatVars[ index ]),
+					expectedBits, newBits ) == expectedBits;
+		}
+#endif
+
 		TqFloat	m_Complete;						///< Current percentage complete.
 
 		static TqFloat	 m_floatVars[ _Last_float ];		///< Float variables
@@ -36,6 +36,10 @@
 
 #include <aqsis/math/cellnoise.h>
 
+#include <boost/static_assert.hpp>
+
+#include <aqsis/math/simd.h>
+
 namespace Aqsis {
 
 //---------------------------------------------------------------------
@@ -49,6 +53,12 @@ inline TqUint permTableIndex(TqFloat x)
 	return static_cast<TqUint>(static_cast<TqInt>(x)) & 0x7ff;
 }
 
+// The array functions read the components of points in place.
+BOOST_STATIC_ASSERT(sizeof(CqVector3D) == 3*sizeof(TqFloat));
+
+// Number of points hashed at a time by the array functions.
+const TqInt hashChunkSize = 64;
+
 } // unnamed namespace
 
 //---------------------------------------------------------------------
@@ -254,6 +264,148 @@ CqVector3D CqCellNoise::PCellNoise4( const CqVector3D& P, TqFloat v )
 }
 
 
+//---------------------------------------------------------------------
+// Array versions
+
+void CqCellNoise::FCellNoise1( const TqFloat* u, TqFloat* result, TqInt n )
+{
+	const TqFloat* coords[] = {u};
+	const TqInt strides[] = {1};
+	cellNoise(coords, strides, 1, result, n);
+}
+
+void CqCellNoise::FCellNoise2( const TqFloat* u, const TqFloat* v, TqFloat* result, TqInt n )
+{
+	const TqFloat* coords[] = {u, v};
+	const TqInt strides[] = {1, 1};
+	cellNoise(coords, strides, 2, result, n);
+}
+
+void CqCellNoise::FCellNoise3( const CqVector3D* P, TqFloat* result, TqInt n )
+{
+	const TqFloat* p = reinterpret_cast<const TqFloat*>(P);
+	// As for the single point version, the second coordinate is P.x()
+	const TqFloat* coords[] = {p, p, p + 2};
+	const TqInt strides[] = {3, 3, 3};
+	cellNoise(coords, strides, 3, result, n);
+}
+
+void CqCellNoise::FCellNoise4( const CqVector3D* P, const TqFloat* v, TqFloat* result, TqInt n )
+{
+	const TqFloat* p = reinterpret_cast<const TqFloat*>(P);
+	const TqFloat* coords[] = {p, p + 1, p + 2, v};
+	const TqInt strides[] = {3, 3, 3, 1};
+	cellNoise(coords, strides, 4, result, n);
+}
+
+void CqCellNoise::PCellNoise1( const TqFloat* u, CqVector3D* result, TqInt n )
+{
+	const TqFloat* coords[] = {u};
+	const TqInt strides[] = {1};
+	cellNoise(coords, strides, 1, result, n);
+}
+
+void CqCellNoise::PCellNoise2( const TqFloat* u, const TqFloat* v, CqVector3D* result, TqInt n )
+{
+	const TqFloat* coords[] = {u, v};
+	const TqInt strides[] = {1, 1};
+	cellNoise(coords, strides, 2, result, n);
+}
+
+void CqCellNoise::PCellNoise3( const CqVector3D* P, CqVector3D* result, TqInt n )
+{
+	const TqFloat* p = reinterpret_cast<const TqFloat*>(P);
+	const TqFloat* coords[] = {p, p + 1, p + 2};
+	const TqInt strides[] = {3, 3, 3};
+	cellNoise(coords, strides, 3, result, n);
+}
+
+void CqCellNoise::PCellNoise4( const CqVector3D* P, const TqFloat* v, CqVector3D* result, TqInt n )
+{
+	const TqFloat* p = reinterpret_cast<const TqFloat*>(P);
+	const TqFloat* coords[] = {p, p + 1, p + 2, v};
+	const TqInt strides[] = {3, 3, 3, 1};
+	cellNoise(coords, strides, 4, result, n);
+}
+
+void CqCellNoise::hashCells( const TqFloat* const* coords, const TqInt* strides,
+                             TqInt numCoords, TqInt begin, TqInt end, TqInt* hash )
+{
+	TqInt i = begin;
+#	ifdef AQSIS_SIMD_SSE2
+	// Compute the table indices of four points at a time, and then chain
+	// the table lookups for each point.
+	for(; i + 4 <= end; i += 4, hash += 4)
+	{
+		TqInt index[4][4];
+		for(TqInt a = 0; a < numCoords; ++a)
+		{
+			TqInt s = strides[a];
+			const TqFloat* c = coords[a] + i*s;
+			__m128 x = _mm_setr_ps(c[0], c[s], c[2*s], c[3*s]);
+			// if ( x < 0.0 ) x -= 1;
+			x = _mm_sub_ps(x, _mm_and_ps(_mm_cmplt_ps(x, _mm_setzero_ps()),
+						_mm_set1_ps(1.0f)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(index[a]),
+					_mm_and_si128(_mm_cvttps_epi32(x), _mm_set1_epi32(0x7ff)));
+		}
+		for(TqInt k = 0; k < 4; ++k)
+		{
+			TqInt h = 0;
+			for(TqInt a = 0; a < numCoords; ++a)
+				h = m_PermuteTable[h + index[a][k]];
+			hash[k] = h;
+		}
+	}
+#	endif
+	for(; i < end; ++i, ++hash)
+	{
+		TqInt h = 0;
+		for(TqInt a = 0; a < numCoords; ++a)
+		{
+			TqFloat x = coords[a][i*strides[a]];
+			if ( x < 0.0 )
+				x -= 1;
+			h = m_PermuteTable[h + permTableIndex(x)];
+		}
+		*hash = h;
+	}
+}
+
+void CqCellNoise::cellNoise( const TqFloat* const* coords, const TqInt* strides,
+                             TqInt numCoords, TqFloat* result, TqInt n )
+{
+	TqInt hash[hashChunkSize];
+	for(TqInt begin = 0; begin < n; begin += hashChunkSize)
+	{
+		TqInt end = begin + hashChunkSize < n ? begin + hashChunkSize : n;
+		hashCells(coords, strides, numCoords, begin, end, hash);
+		for(TqInt i = begin; i < end; ++i)
+			result[i] = m_RandomTable[ hash[i - begin] ];
+	}
+}
+
+void CqCellNoise::cellNoise( const TqFloat* const* coords, const TqInt* strides,
+                             TqInt numCoords, CqVector3D* result, TqInt n )
+{
+	TqInt hash[hashChunkSize];
+	for(TqInt begin = 0; begin < n; begin += hashChunkSize)
+	{
+		TqInt end = begin + hashChunkSize < n ? begin + hashChunkSize : n;
+		hashCells(coords, strides, numCoords, begin, end, hash);
+		for(TqInt i = begin; i < end; ++i)
+		{
+			TqInt h = hash[i - begin];
+			result[i].x( m_RandomTable[ h ] );
+			h = m_PermuteTable[ h ];
+			result[i].y( m_RandomTable[ h ] );
+			h = m_PermuteTable[ h ];
+			result[i].z( m_RandomTable[ h ] );
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 /** Random permutation lookup table.
  */
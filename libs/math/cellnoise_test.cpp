@@ -104,4 +104,51 @@ BOOST_AUTO_TEST_CASE(CqCellNoise_4D_point_cellnoise_test)
 			Aqsis::CqVector3D(0.67021f, 0.930112f, 0.82147f));
 }
 
+BOOST_AUTO_TEST_CASE(CqCellNoise_array_matches_scalar_test)
+{
+	// Include negative coordinates and points on cell boundaries, where
+	// rounding to the cell index matters.
+	const TqInt n = 21;
+	TqFloat u[n], v[n];
+	Aqsis::CqVector3D P[n];
+	for(TqInt i = 0; i < n; ++i)
+	{
+		u[i] = -5.0f + 0.5f*i;
+		v[i] = 2.7f - 0.31f*i;
+		P[i] = Aqsis::CqVector3D(u[i], v[i], 0.23f*i*i - 4.0f);
+	}
+
+	Aqsis::CqCellNoise cn;
+	TqFloat f[n];
+	Aqsis::CqVector3D p[n];
+	cn.FCellNoise1(u, f, n);
+	cn.PCellNoise1(u, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], cn.FCellNoise1(u[i]));
+		BOOST_CHECK(p[i] == cn.PCellNoise1(u[i]));
+	}
+	cn.FCellNoise2(u, v, f, n);
+	cn.PCellNoise2(u, v, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], cn.FCellNoise2(u[i], v[i]));
+		BOOST_CHECK(p[i] == cn.PCellNoise2(u[i], v[i]));
+	}
+	cn.FCellNoise3(P, f, n);
+	cn.PCellNoise3(P, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], cn.FCellNoise3(P[i]));
+		BOOST_CHECK(p[i] == cn.PCellNoise3(P[i]));
+	}
+	cn.FCellNoise4(P, v, f, n);
+	cn.PCellNoise4(P, v, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], cn.FCellNoise4(P[i], v[i]));
+		BOOST_CHECK(p[i] == cn.PCellNoise4(P[i], v[i]));
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
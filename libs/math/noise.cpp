@@ -59,6 +59,127 @@ namespace Aqsis {
 #define	O3z	31.91
 #define	O3t	37.48
 
+namespace {
+
+/** \brief Arguments of a chunk of points for the array noise functions.
+ *
+ * CqNoise1234 takes each coordinate and period as a separate array, so the
+ * arguments are split up into arrays here, a chunk of points at a time.
+ */
+class CqNoiseChunk
+{
+	public:
+		/// Maximum number of points in a chunk.
+		static const TqInt size = 64;
+
+		CqNoiseChunk(TqInt dims, bool periodic)
+			: m_dims(dims),
+			m_periodic(periodic)
+		{ }
+
+		/// Set the coordinates of point i of the chunk.
+		void setCoords(TqInt i, TqFloat x, TqFloat y = 0, TqFloat z = 0, TqFloat t = 0)
+		{
+			m_coords[0][i] = x;
+			m_coords[1][i] = y;
+			m_coords[2][i] = z;
+			m_coords[3][i] = t;
+		}
+		/// Set the periods of point i, rounded as for the single point functions.
+		void setPeriods(TqInt i, TqFloat pfx, TqFloat pfy = 0, TqFloat pfz = 0, TqFloat pft = 0)
+		{
+			TqFloat pf[] = {pfx, pfy, pfz, pft};
+			for(TqInt a = 0; a < m_dims; ++a)
+			{
+				TqFloat p = pf[a] + 0.5f;
+				m_periods[a][i] = FASTFLOOR( p );
+			}
+		}
+		/** \brief Evaluate the noise of the first n points of the chunk.
+		 *
+		 * \param component - 0 for float noise, or the component of vector
+		 *                    noise, for which the coordinates are offset.
+		 */
+		void eval(TqInt n, TqInt component, TqFloat* result) const;
+		/// Evaluate the vector noise of the first n points of the chunk.
+		void eval(TqInt n, CqVector3D* result) const;
+
+	private:
+		TqInt m_dims;
+		bool m_periodic;
+		TqFloat m_coords[4][size];
+		TqInt m_periods[4][size];
+};
+
+void CqNoiseChunk::eval(TqInt n, TqInt component, TqFloat* result) const
+{
+	static const double offsets[2][4] = {
+		{ O1x, O1y, O1z, O1t },
+		{ O2x, O2y, O2z, O2t }
+	};
+	const TqFloat* c[4] = { m_coords[0], m_coords[1], m_coords[2], m_coords[3] };
+	TqFloat offsetCoords[4][size];
+	if(component > 0)
+	{
+		for(TqInt a = 0; a < m_dims; ++a)
+		{
+			for(TqInt i = 0; i < n; ++i)
+				offsetCoords[a][i] = m_coords[a][i] + offsets[component-1][a];
+			c[a] = offsetCoords[a];
+		}
+	}
+	const TqInt* p[4] = { m_periods[0], m_periods[1], m_periods[2], m_periods[3] };
+	switch(m_dims)
+	{
+		case 1:
+			if(m_periodic)
+				CqNoise1234::pnoise( c[0], p[0], result, n );
+			else
+				CqNoise1234::noise( c[0], result, n );
+			break;
+		case 2:
+			if(m_periodic)
+				CqNoise1234::pnoise( c[0], c[1], p[0], p[1], result, n );
+			else
+				CqNoise1234::noise( c[0], c[1], result, n );
+			break;
+		case 3:
+			if(m_periodic)
+				CqNoise1234::pnoise( c[0], c[1], c[2], p[0], p[1], p[2], result, n );
+			else
+				CqNoise1234::noise( c[0], c[1], c[2], result, n );
+			break;
+		default:
+			if(m_periodic)
+				CqNoise1234::pnoise( c[0], c[1], c[2], c[3], p[0], p[1], p[2], p[3], result, n );
+			else
+				CqNoise1234::noise( c[0], c[1], c[2], c[3], result, n );
+			break;
+	}
+	for(TqInt i = 0; i < n; ++i)
+		result[i] = 0.5f * ( 1.0f + result[i] );
+}
+
+void CqNoiseChunk::eval(TqInt n, CqVector3D* result) const
+{
+	TqFloat a[size];
+	TqFloat b[size];
+	TqFloat c[size];
+	eval(n, 0, a);
+	eval(n, 1, b);
+	eval(n, 2, c);
+	for(TqInt i = 0; i < n; ++i)
+		result[i] = CqVector3D( a[i], b[i], c[i] );
+}
+
+/// Number of points in the chunk starting at point i of n.
+inline TqInt chunkLength(TqInt i, TqInt n)
+{
+	return n - i < CqNoiseChunk::size ? n - i : CqNoiseChunk::size;
+}
+
+} // unnamed namespace
+
 
 //---------------------------------------------------------------------
 /** 1D float Perlin noise, SL "noise()"
@@ -376,5 +497,244 @@ CqColor	CqNoise::CGPNoise4( const CqVector3D& v, TqFloat t, const CqVector3D& pv
 }
 
 
+//---------------------------------------------------------------------
+// Array versions
+//
+// These split the arguments into a chunk at a time and evaluate them with
+// the array functions of CqNoise1234.
+
+//---------------------------------------------------------------------
+void CqNoise::FGNoise1( const TqFloat* x, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 1, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, x[i+j] );
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGPNoise1( const TqFloat* x, const TqFloat* px, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 1, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, x[i+j] );
+			chunk.setPeriods( j, px[i+j] );
+		}
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGNoise2( const TqFloat* x, const TqFloat* y, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 2, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, x[i+j], y[i+j] );
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGPNoise2( const TqFloat* x, const TqFloat* y, const TqFloat* px, const TqFloat* py, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 2, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, x[i+j], y[i+j] );
+			chunk.setPeriods( j, px[i+j], py[i+j] );
+		}
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGNoise3( const CqVector3D* v, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 3, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z() );
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGPNoise3( const CqVector3D* v, const CqVector3D* pv, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 3, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z() );
+			chunk.setPeriods( j, pv[i+j].x(), pv[i+j].y(), pv[i+j].z() );
+		}
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGNoise4( const CqVector3D* v, const TqFloat* t, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 4, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z(), t[i+j] );
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::FGPNoise4( const CqVector3D* v, const TqFloat* t, const CqVector3D* pv, const TqFloat* pt, TqFloat* result, TqInt n )
+{
+	CqNoiseChunk chunk( 4, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z(), t[i+j] );
+			chunk.setPeriods( j, pv[i+j].x(), pv[i+j].y(), pv[i+j].z(), pt[i+j] );
+		}
+		chunk.eval( m, 0, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGNoise1( const TqFloat* x, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 1, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, x[i+j] );
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGPNoise1( const TqFloat* x, const TqFloat* px, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 1, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, x[i+j] );
+			chunk.setPeriods( j, px[i+j] );
+		}
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGNoise2( const TqFloat* x, const TqFloat* y, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 2, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, x[i+j], y[i+j] );
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGPNoise2( const TqFloat* x, const TqFloat* y, const TqFloat* px, const TqFloat* py, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 2, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, x[i+j], y[i+j] );
+			chunk.setPeriods( j, px[i+j], py[i+j] );
+		}
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGNoise3( const CqVector3D* v, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 3, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z() );
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGPNoise3( const CqVector3D* v, const CqVector3D* pv, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 3, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z() );
+			chunk.setPeriods( j, pv[i+j].x(), pv[i+j].y(), pv[i+j].z() );
+		}
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGNoise4( const CqVector3D* v, const TqFloat* t, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 4, false );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z(), t[i+j] );
+		chunk.eval( m, result + i );
+	}
+}
+
+//---------------------------------------------------------------------
+void CqNoise::PGPNoise4( const CqVector3D* v, const TqFloat* t, const CqVector3D* pv, const TqFloat* pt, CqVector3D* result, TqInt n )
+{
+	CqNoiseChunk chunk( 4, true );
+	for(TqInt i = 0; i < n; i += CqNoiseChunk::size)
+	{
+		TqInt m = chunkLength( i, n );
+		for(TqInt j = 0; j < m; ++j)
+		{
+			chunk.setCoords( j, v[i+j].x(), v[i+j].y(), v[i+j].z(), t[i+j] );
+			chunk.setPeriods( j, pv[i+j].x(), pv[i+j].y(), pv[i+j].z(), pt[i+j] );
+		}
+		chunk.eval( m, result + i );
+	}
+}
+
+
 } // namespace Aqsis
 //---------------------------------------------------------------------
@@ -38,6 +38,8 @@
 
 #include	<aqsis/math/noise1234.h>
 
+#include	<aqsis/math/simd.h>
+
 namespace Aqsis {
 
 // This is the new and improved, C(2) continuous interpolant
@@ -549,6 +551,330 @@ TqFloat CqNoise1234::pnoise( TqFloat x, TqFloat y, TqFloat z, TqFloat w,
 	return 0.87f * ( NLERP( s, n0, n1 ) );
 }
 
+//---------------------------------------------------------------------
+// Array versions
+//
+// With SSE2 these evaluate four points at a time.  The helpers below perform
+// the same float operations as FASTFLOOR, FADE, NLERP and grad() above, in
+// the same order, so the results are identical to those of the single point
+// functions.  SSE2 has no gather instruction, so the permutation table is
+// read a lane at a time.
+
+#ifdef AQSIS_SIMD_SSE2
+
+namespace {
+
+/// Lattice cells of four points along one axis.
+struct SqLattice4
+{
+	TqInt i0[4];  ///< Cell index, wrapped to 0..255
+	TqInt i1[4];  ///< Index of the next cell, wrapped to 0..255
+	__m128 f0;    ///< Offset from the cell
+	__m128 f1;    ///< Offset from the next cell
+	__m128 fade;  ///< FADE(f0)
+};
+
+inline __m128 fade4(__m128 t)
+{
+	__m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+	return _mm_mul_ps(t3, _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(
+			_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10)));
+}
+
+inline __m128 lerp4(__m128 t, __m128 a, __m128 b)
+{
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+inline __m128 select4(__m128i mask, __m128 a, __m128 b)
+{
+	__m128 m = _mm_castsi128_ps(mask);
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+/// Negate the lanes of x for which the given bit of h is set.
+template<int bit>
+inline __m128 negateIf(__m128i h, __m128 x)
+{
+	return _mm_xor_ps(x, _mm_castsi128_ps(_mm_slli_epi32(
+			_mm_and_si128(h, _mm_set1_epi32(1 << bit)), 31 - bit)));
+}
+
+/// FASTFLOOR(x), setting the offsets and interpolant of the cells.
+inline __m128i floor4(__m128 x, SqLattice4& l)
+{
+	__m128i ix = _mm_cvttps_epi32(x);
+	// Subtract one wherever !(x > 0)
+	ix = _mm_add_epi32(ix, _mm_castps_si128(_mm_cmpngt_ps(x, _mm_setzero_ps())));
+	l.f0 = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+	l.f1 = _mm_sub_ps(l.f0, _mm_set1_ps(1.0f));
+	l.fade = fade4(l.f0);
+	return ix;
+}
+
+/// Lattice cells for noise().
+inline void lattice4(__m128 x, SqLattice4& l)
+{
+	__m128i ix = floor4(x, l);
+	const __m128i wrap = _mm_set1_epi32(0xff);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(l.i0), _mm_and_si128(ix, wrap));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(l.i1),
+			_mm_and_si128(_mm_add_epi32(ix, _mm_set1_epi32(1)), wrap));
+}
+
+/// Lattice cells for pnoise(), wrapped to the periods px.
+inline void plattice4(__m128 x, const TqInt* px, SqLattice4& l)
+{
+	TqInt ix[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ix), floor4(x, l));
+	for(TqInt k = 0; k < 4; ++k)
+	{
+		TqInt p = px[k] < 1 ? 1 : px[k];
+		l.i1[k] = ( ( ix[k] + 1 ) % p ) & 0xff;
+		l.i0[k] = ( ix[k] % p ) & 0xff;
+	}
+}
+
+inline __m128 grad4( __m128i hash, __m128 x )
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	__m128 grad = _mm_cvtepi32_ps(_mm_add_epi32(
+				_mm_and_si128(h, _mm_set1_epi32(7)), _mm_set1_epi32(1)));
+	return _mm_mul_ps(negateIf<3>(h, grad), x);
+}
+
+inline __m128 grad4( __m128i hash, __m128 x, __m128 y )
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+	__m128i lt4 = _mm_cmplt_epi32(h, _mm_set1_epi32(4));
+	__m128 u = select4(lt4, x, y);
+	__m128 v = select4(lt4, y, x);
+	return _mm_add_ps(negateIf<0>(h, u),
+			negateIf<1>(h, _mm_mul_ps(_mm_set1_ps(2.0f), v)));
+}
+
+inline __m128 grad4( __m128i hash, __m128 x, __m128 y, __m128 z )
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	__m128 u = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(8)), x, y);
+	__m128i h12or14 = _mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+			_mm_cmpeq_epi32(h, _mm_set1_epi32(14)));
+	__m128 v = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(4)), y,
+			select4(h12or14, x, z));
+	return _mm_add_ps(negateIf<0>(h, u), negateIf<1>(h, v));
+}
+
+inline __m128 grad4( __m128i hash, __m128 x, __m128 y, __m128 z, __m128 t )
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(31));
+	__m128 u = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(24)), x, y);
+	__m128 v = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(16)), y, z);
+	__m128 w = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(8)), z, t);
+	return _mm_add_ps(_mm_add_ps(negateIf<0>(h, u), negateIf<1>(h, v)),
+			negateIf<2>(h, w));
+}
+
+/// Offset of corner c of the cells along axis a, for a dims dimensional lattice.
+template<int dims>
+inline __m128 cornerOffset(const SqLattice4* l, TqInt c, TqInt a)
+{
+	return (c & (1 << (dims-1-a))) ? l[a].f1 : l[a].f0;
+}
+
+/// Gradient at corner c of the cells.
+template<int dims>
+__m128 cornerGrad(__m128i hash, const SqLattice4* l, TqInt c);
+
+template<>
+inline __m128 cornerGrad<1>(__m128i hash, const SqLattice4* l, TqInt c)
+{
+	return grad4(hash, cornerOffset<1>(l, c, 0));
+}
+
+template<>
+inline __m128 cornerGrad<2>(__m128i hash, const SqLattice4* l, TqInt c)
+{
+	return grad4(hash, cornerOffset<2>(l, c, 0), cornerOffset<2>(l, c, 1));
+}
+
+template<>
+inline __m128 cornerGrad<3>(__m128i hash, const SqLattice4* l, TqInt c)
+{
+	return grad4(hash, cornerOffset<3>(l, c, 0), cornerOffset<3>(l, c, 1),
+			cornerOffset<3>(l, c, 2));
+}
+
+template<>
+inline __m128 cornerGrad<4>(__m128i hash, const SqLattice4* l, TqInt c)
+{
+	return grad4(hash, cornerOffset<4>(l, c, 0), cornerOffset<4>(l, c, 1),
+			cornerOffset<4>(l, c, 2), cornerOffset<4>(l, c, 3));
+}
+
+/** \brief Noise at four points, given their lattice cells.
+ *
+ * Corner c of the cells is at the next cell along the last axis when bit 0
+ * of c is set, along the second last axis when bit 1 is set, and so on.
+ * Interpolating between neighbouring corners along the last axis first then
+ * follows the order of the single point functions.
+ */
+template<int dims>
+inline __m128 noise4(const unsigned char* perm, const SqLattice4* l, TqFloat scale)
+{
+	const TqInt numCorners = 1 << dims;
+	TqInt hash[numCorners][4];
+	for(TqInt k = 0; k < 4; ++k)
+	{
+		for(TqInt c = 0; c < numCorners; ++c)
+		{
+			// perm[ix + perm[iy + ...]]
+			TqInt h = 0;
+			for(TqInt a = dims-1; a >= 0; --a)
+				h = perm[((c & (1 << (dims-1-a))) ? l[a].i1 : l[a].i0)[k] + h];
+			hash[c][k] = h;
+		}
+	}
+	__m128 n[numCorners];
+	for(TqInt c = 0; c < numCorners; ++c)
+		n[c] = cornerGrad<dims>(_mm_loadu_si128(
+					reinterpret_cast<const __m128i*>(hash[c])), l, c);
+	for(TqInt a = dims-1; a >= 0; --a)
+		for(TqInt c = 0; c < (1 << a); ++c)
+			n[c] = lerp4(l[a].fade, n[2*c], n[2*c+1]);
+	return _mm_mul_ps(_mm_set1_ps(scale), n[0]);
+}
+
+/** \brief Noise at the points of an array, four at a time.
+ *
+ * \param coords - arrays of coordinates along each axis
+ * \param periods - arrays of periods along each axis for periodic noise, or
+ *                  null for noise()
+ * \return the number of points evaluated, a multiple of four.
+ */
+template<int dims>
+TqInt noiseArray(const unsigned char* perm, const TqFloat* const* coords,
+		const TqInt* const* periods, TqFloat scale, TqFloat* result, TqInt n)
+{
+	TqInt i = 0;
+	for(; i + 4 <= n; i += 4)
+	{
+		SqLattice4 l[dims];
+		for(TqInt a = 0; a < dims; ++a)
+		{
+			__m128 x = _mm_loadu_ps(coords[a] + i);
+			if(periods)
+				plattice4(x, periods[a] + i, l[a]);
+			else
+				lattice4(x, l[a]);
+		}
+		_mm_storeu_ps(result + i, noise4<dims>(perm, l, scale));
+	}
+	return i;
+}
+
+} // unnamed namespace
+
+#endif // AQSIS_SIMD_SSE2
+
+void CqNoise1234::noise( const TqFloat* x, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x};
+	i = noiseArray<1>(perm, coords, 0, 0.188f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = noise( x[i] );
+}
+
+void CqNoise1234::noise( const TqFloat* x, const TqFloat* y, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y};
+	i = noiseArray<2>(perm, coords, 0, 0.507f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = noise( x[i], y[i] );
+}
+
+void CqNoise1234::noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                         TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y, z};
+	i = noiseArray<3>(perm, coords, 0, 0.936f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = noise( x[i], y[i], z[i] );
+}
+
+void CqNoise1234::noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                         const TqFloat* w, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y, z, w};
+	i = noiseArray<4>(perm, coords, 0, 0.87f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = noise( x[i], y[i], z[i], w[i] );
+}
+
+void CqNoise1234::pnoise( const TqFloat* x, const TqInt* px, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x};
+	const TqInt* periods[] = {px};
+	i = noiseArray<1>(perm, coords, periods, 0.188f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = pnoise( x[i], px[i] );
+}
+
+void CqNoise1234::pnoise( const TqFloat* x, const TqFloat* y, const TqInt* px,
+                          const TqInt* py, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y};
+	const TqInt* periods[] = {px, py};
+	i = noiseArray<2>(perm, coords, periods, 0.507f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = pnoise( x[i], y[i], px[i], py[i] );
+}
+
+void CqNoise1234::pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                          const TqInt* px, const TqInt* py, const TqInt* pz,
+                          TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y, z};
+	const TqInt* periods[] = {px, py, pz};
+	i = noiseArray<3>(perm, coords, periods, 0.936f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = pnoise( x[i], y[i], z[i], px[i], py[i], pz[i] );
+}
+
+void CqNoise1234::pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                          const TqFloat* w, const TqInt* px, const TqInt* py,
+                          const TqInt* pz, const TqInt* pw, TqFloat* result, TqInt n )
+{
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	const TqFloat* coords[] = {x, y, z, w};
+	const TqInt* periods[] = {px, py, pz, pw};
+	i = noiseArray<4>(perm, coords, periods, 0.87f, result, n);
+#	endif
+	for(; i < n; ++i)
+		result[i] = pnoise( x[i], y[i], z[i], w[i], px[i], py[i], pz[i], pw[i] );
+}
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
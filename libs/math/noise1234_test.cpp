@@ -92,4 +92,52 @@ BOOST_AUTO_TEST_CASE(CqNoise1234_4D_float_Perlin_periodic_noise_test)
 	BOOST_CHECK_CLOSE(noise.pnoise(1.5f, -0.2f, 0.7f, 3.0f, 2, 5, -2, 3), -0.369483441f, epsilon);
 }
 
+BOOST_AUTO_TEST_CASE(CqNoise1234_array_matches_scalar_test)
+{
+	// Use a length which isn't a multiple of the vector width, so that both
+	// the vectorised loop and the scalar tail are exercised.
+	const TqInt n = 23;
+	TqFloat x[n], y[n], z[n], w[n];
+	TqInt px[n], py[n], pz[n], pw[n];
+	for(TqInt i = 0; i < n; ++i)
+	{
+		x[i] = -5.3f + 0.71f*i;
+		y[i] = 2.9f - 0.37f*i;
+		z[i] = 0.13f*i*i - 3.0f;
+		w[i] = 1.7f + 0.5f*i;
+		px[i] = i % 4 + 1;
+		py[i] = i % 3 + 2;
+		pz[i] = 5 - i % 7;
+		pw[i] = i % 5 + 1;
+	}
+
+	TqFloat result[n];
+	Aqsis::CqNoise1234::noise(x, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::noise(x[i]));
+	Aqsis::CqNoise1234::noise(x, y, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::noise(x[i], y[i]));
+	Aqsis::CqNoise1234::pnoise(x, px, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::pnoise(x[i], px[i]));
+	Aqsis::CqNoise1234::pnoise(x, y, px, py, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::pnoise(x[i], y[i], px[i], py[i]));
+	Aqsis::CqNoise1234::noise(x, y, z, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::noise(x[i], y[i], z[i]));
+	Aqsis::CqNoise1234::noise(x, y, z, w, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::noise(x[i], y[i], z[i], w[i]));
+	Aqsis::CqNoise1234::pnoise(x, y, z, px, py, pz, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::pnoise(x[i], y[i], z[i],
+					px[i], py[i], pz[i]));
+	Aqsis::CqNoise1234::pnoise(x, y, z, w, px, py, pz, pw, result, n);
+	for(TqInt i = 0; i < n; ++i)
+		BOOST_CHECK_EQUAL(result[i], Aqsis::CqNoise1234::pnoise(x[i], y[i], z[i], w[i],
+					px[i], py[i], pz[i], pw[i]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -216,4 +216,84 @@ BOOST_AUTO_TEST_CASE(CqNoise_4D_color_Perlin_periodic_noise_test)
 	BOOST_CHECK_PREDICATE(colEquals, (noise.CGPNoise4(Aqsis::CqVector3D(1.0f, 2.0f, 3.0f), 2.0f, Aqsis::CqVector3D(1.0f, 2.0f, 3.0f), 2.0f))(Aqsis::CqColor(0.5f, 0.62703f, 0.349767f)));
 }
 
+BOOST_AUTO_TEST_CASE(CqNoise_array_matches_scalar_test)
+{
+	// A length which isn't a multiple of the vector width exercises the
+	// scalar tail of the array functions too.
+	const TqInt n = 19;
+	TqFloat x[n], y[n], t[n], px[n], py[n], pt[n];
+	Aqsis::CqVector3D v[n], pv[n];
+	for(TqInt i = 0; i < n; ++i)
+	{
+		x[i] = -4.1f + 0.63f*i;
+		y[i] = 3.3f - 0.29f*i;
+		t[i] = 0.11f*i*i - 2.0f;
+		px[i] = TqFloat(i % 4 + 1);
+		py[i] = TqFloat(i % 3 + 2);
+		pt[i] = TqFloat(5 - i % 4);
+		v[i] = Aqsis::CqVector3D(x[i], y[i], 1.7f + 0.45f*i);
+		pv[i] = Aqsis::CqVector3D(px[i], py[i], TqFloat(i % 5 + 1));
+	}
+
+	// The array functions must give exactly the same results.
+	TqFloat f[n];
+	Aqsis::CqVector3D p[n];
+	Aqsis::CqNoise::FGNoise1(x, f, n);
+	Aqsis::CqNoise::PGNoise1(x, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGNoise1(x[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGNoise1(x[i]));
+	}
+	Aqsis::CqNoise::FGPNoise1(x, px, f, n);
+	Aqsis::CqNoise::PGPNoise1(x, px, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGPNoise1(x[i], px[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGPNoise1(x[i], px[i]));
+	}
+	Aqsis::CqNoise::FGNoise2(x, y, f, n);
+	Aqsis::CqNoise::PGNoise2(x, y, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGNoise2(x[i], y[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGNoise2(x[i], y[i]));
+	}
+	Aqsis::CqNoise::FGPNoise2(x, y, px, py, f, n);
+	Aqsis::CqNoise::PGPNoise2(x, y, px, py, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGPNoise2(x[i], y[i], px[i], py[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGPNoise2(x[i], y[i], px[i], py[i]));
+	}
+	Aqsis::CqNoise::FGNoise3(v, f, n);
+	Aqsis::CqNoise::PGNoise3(v, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGNoise3(v[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGNoise3(v[i]));
+	}
+	Aqsis::CqNoise::FGPNoise3(v, pv, f, n);
+	Aqsis::CqNoise::PGPNoise3(v, pv, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGPNoise3(v[i], pv[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGPNoise3(v[i], pv[i]));
+	}
+	Aqsis::CqNoise::FGNoise4(v, t, f, n);
+	Aqsis::CqNoise::PGNoise4(v, t, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGNoise4(v[i], t[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGNoise4(v[i], t[i]));
+	}
+	Aqsis::CqNoise::FGPNoise4(v, t, pv, pt, f, n);
+	Aqsis::CqNoise::PGPNoise4(v, t, pv, pt, p, n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i], Aqsis::CqNoise::FGPNoise4(v[i], t[i], pv[i], pt[i]));
+		BOOST_CHECK(p[i] == Aqsis::CqNoise::PGPNoise4(v[i], t[i], pv[i], pt[i]));
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Factoring of 2D filter kernels into horizontal and vertical parts.
+ */
+
+#include <aqsis/math/separable.h>
+
+#include <cmath>
+
+namespace Aqsis {
+
+bool separateKernel(const TqFloat* kernel, TqInt width, TqInt height,
+		std::vector<TqFloat>& xWeights, std::vector<TqFloat>& yWeights,
+		TqFloat absTolerance)
+{
+	// Factor the kernel about its largest weight.  If the kernel is separable,
+	// the row and column through that weight are multiples of the horizontal
+	// and vertical weights.
+	TqInt iMax = 0;
+	TqInt jMax = 0;
+	TqFloat maxWeight = 0;
+	for(TqInt j = 0; j < height; ++j)
+	{
+		for(TqInt i = 0; i < width; ++i)
+		{
+			TqFloat weight = std::fabs(kernel[j*width + i]);
+			if(weight > maxWeight)
+			{
+				maxWeight = weight;
+				iMax = i;
+				jMax = j;
+			}
+		}
+	}
+	if(maxWeight == 0)
+		return false;
+	std::vector<TqFloat> xw(kernel + jMax*width, kernel + (jMax+1)*width);
+	std::vector<TqFloat> yw(height);
+	TqFloat pivot = kernel[jMax*width + iMax];
+	for(TqInt j = 0; j < height; ++j)
+		yw[j] = kernel[j*width + iMax]/pivot;
+	// Check that the product reproduces the kernel.
+	const TqFloat tolerance = 1e-4f*maxWeight + absTolerance;
+	for(TqInt j = 0; j < height; ++j)
+	{
+		for(TqInt i = 0; i < width; ++i)
+		{
+			if(std::fabs(kernel[j*width + i] - xw[i]*yw[j]) > tolerance)
+				return false;
+		}
+	}
+	xWeights.swap(xw);
+	yWeights.swap(yw);
+	return true;
+}
+
+} // namespace Aqsis
@@ -0,0 +1,106 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for separating filter kernels.
+ */
+
+#include <aqsis/math/separable.h>
+
+#include <cmath>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_CASE(separateKernel_product_test)
+{
+	// A gaussian times a triangle, with negative lobes in y like a
+	// catmull-rom filter.
+	const TqInt width = 5;
+	const TqInt height = 4;
+	const TqFloat x[width] = {0.1f, 0.6f, 1.0f, 0.6f, 0.1f};
+	const TqFloat y[height] = {-0.1f, 0.5f, 0.5f, -0.1f};
+	TqFloat kernel[width*height];
+	for(TqInt j = 0; j < height; ++j)
+		for(TqInt i = 0; i < width; ++i)
+			kernel[j*width + i] = x[i]*y[j];
+
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	BOOST_REQUIRE(separateKernel(kernel, width, height, xWeights, yWeights));
+	BOOST_REQUIRE_EQUAL(xWeights.size(), std::size_t(width));
+	BOOST_REQUIRE_EQUAL(yWeights.size(), std::size_t(height));
+	for(TqInt j = 0; j < height; ++j)
+		for(TqInt i = 0; i < width; ++i)
+			BOOST_CHECK_CLOSE(xWeights[i]*yWeights[j], kernel[j*width + i], 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(separateKernel_nonseparable_test)
+{
+	// A radially symmetric cone isn't a product of 1D weights.
+	const TqInt size = 5;
+	TqFloat kernel[size*size];
+	for(TqInt j = 0; j < size; ++j)
+		for(TqInt i = 0; i < size; ++i)
+			kernel[j*size + i] = std::max(0.0f, 3 - std::sqrt(TqFloat((i-2)*(i-2) + (j-2)*(j-2))));
+
+	std::vector<TqFloat> xWeights(1, 42.0f);
+	std::vector<TqFloat> yWeights(1, 42.0f);
+	BOOST_CHECK(!separateKernel(kernel, size, size, xWeights, yWeights));
+	// The weights are left alone on failure.
+	BOOST_CHECK_EQUAL(xWeights.size(), 1U);
+	BOOST_CHECK_EQUAL(yWeights[0], 42.0f);
+
+	const TqFloat zeros[4] = {0, 0, 0, 0};
+	BOOST_CHECK(!separateKernel(zeros, 2, 2, xWeights, yWeights));
+}
+
+BOOST_AUTO_TEST_CASE(separateKernel_tolerance_test)
+{
+	// A separable kernel where one small weight was rounded to zero is only
+	// accepted with the extra absolute tolerance.
+	const TqInt size = 3;
+	const TqFloat x[size] = {0.02f, 1.0f, 0.02f};
+	TqFloat kernel[size*size];
+	for(TqInt j = 0; j < size; ++j)
+		for(TqInt i = 0; i < size; ++i)
+			kernel[j*size + i] = x[i]*x[j];
+	kernel[0] = 0;
+
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	BOOST_CHECK(!separateKernel(kernel, size, size, xWeights, yWeights));
+	BOOST_CHECK(separateKernel(kernel, size, size, xWeights, yWeights, 1e-3f));
+}
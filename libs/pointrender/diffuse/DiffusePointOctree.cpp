@@ -31,9 +31,14 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <exception>
+#include <fstream>
 
 #include <Partio.h>
 
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/static_assert.hpp>
+
 #include <aqsis/util/logging.h>
 
 #include "DiffusePointOctree.h"
@@ -44,6 +49,31 @@ using Imath::V3f;
 using Imath::C3f;
 using Imath::Box3f;
 
+// Point tree files are written directly from memory, so the node layout must
+// be the same everywhere.
+BOOST_STATIC_ASSERT(sizeof(DiffusePointOctree::Node) == 128);
+
+namespace {
+
+/// Header of a point tree file.
+///
+/// The header is followed by the nodes, then by the point data.
+struct PointTreeHeader {
+	char magic[8];
+	boost::uint32_t version;
+	boost::uint32_t dataSize;
+	boost::uint64_t nodeCount;
+	boost::uint64_t dataCount;
+	/// Pad the header so that the nodes are cache line aligned.
+	boost::uint64_t reserved[4];
+};
+BOOST_STATIC_ASSERT(sizeof(PointTreeHeader) == 64);
+
+const char pointTreeMagic[8] = {'A','q','s','P','t','r','e','e'};
+const boost::uint32_t pointTreeVersion = 1;
+
+} // unnamed namespace
+
 
 static void releasePartioFile(Partio::ParticlesInfo* file) {
 	if (file)
@@ -51,22 +81,27 @@ static void releasePartioFile(Partio::ParticlesInfo* file) {
 }
 
 bool loadDiffusePointFile(PointArray& points, const std::string& fileName) {
-	namespace Pio = Partio;
-	boost::shared_ptr < Pio::ParticlesData > ptFile(Pio::read(fileName.c_str()), releasePartioFile);
+	boost::shared_ptr < Partio::ParticlesData > ptFile(Partio::read(fileName.c_str()), releasePartioFile);
 	if (!ptFile)
 		return false;
+	return loadDiffusePoints(points, *ptFile, fileName);
+}
+
+bool loadDiffusePoints(PointArray& points, const Partio::ParticlesData& ptFile,
+		const std::string& fileName) {
+	namespace Pio = Partio;
 	// Look for the necessary attributes in the file
 	Pio::ParticleAttribute posAttr;
 	Pio::ParticleAttribute norAttr;
 	Pio::ParticleAttribute rAttr;
 	Pio::ParticleAttribute radAttr;
-	if (!ptFile->attributeInfo("position", posAttr) || !ptFile->attributeInfo(
-			"normal", norAttr) || !ptFile->attributeInfo("radius", rAttr)) {
+	if (!ptFile.attributeInfo("position", posAttr) || !ptFile.attributeInfo(
+			"normal", norAttr) || !ptFile.attributeInfo("radius", rAttr)) {
 		Aqsis::log() << "Couldn't find required attribute in \"" << fileName
 				<< "\"\n";
 		return false;
 	}
-	bool hasRadiosity = ptFile->attributeInfo("_radiosity", radAttr);
+	bool hasRadiosity = ptFile.attributeInfo("_radiosity", radAttr);
 	// Check types
 	if (posAttr.type != Pio::VECTOR || norAttr.type != Pio::VECTOR
 			|| rAttr.type != Pio::FLOAT || rAttr.count != 1
@@ -77,7 +112,7 @@ bool loadDiffusePointFile(PointArray& points, const std::string& fileName) {
 		return false;
 	}
 	// Allocate extra space in output array
-	int npts = ptFile->numParticles();
+	int npts = ptFile.numParticles();
 	points.stride = 10;
 	std::vector<float>& data = points.data;
 	data.resize(data.size() + npts * 10, 0);
@@ -87,13 +122,13 @@ bool loadDiffusePointFile(PointArray& points, const std::string& fileName) {
 	Pio::ParticleAccessor norAcc(norAttr);
 	Pio::ParticleAccessor rAcc(rAttr);
 	Pio::ParticleAccessor radAcc(radAttr);
-	Pio::ParticlesData::const_iterator pt = ptFile->begin();
+	Pio::ParticlesData::const_iterator pt = ptFile.begin();
 	pt.addAccessor(posAcc);
 	pt.addAccessor(norAcc);
 	pt.addAccessor(rAcc);
 	if (hasRadiosity)
 		pt.addAccessor(radAcc);
-	for (; pt != ptFile->end(); ++pt) {
+	for (; pt != ptFile.end(); ++pt) {
 		// TODO: Use nicer types here?
 		const Pio::Data<float, 3>& P = posAcc.data<Pio::Data<float, 3> > (pt);
 		const Pio::Data<float, 3>& N = norAcc.data<Pio::Data<float, 3> > (pt);
@@ -121,9 +156,25 @@ bool loadDiffusePointFile(PointArray& points, const std::string& fileName) {
 }
 
 //------------------------------------------------------------------------------
+bool isDiffusePointTreeName(const std::string& fileName) {
+	const char* ext = ".ptree";
+	size_t extLen = std::strlen(ext);
+	return fileName.size() > extLen && fileName.compare(fileName.size()
+			- extLen, extLen, ext) == 0;
+}
+
+//------------------------------------------------------------------------------
+DiffusePointOctree::DiffusePointOctree() :
+	m_nodeStorage(), m_dataStorage(), m_file(), m_nodes(0), m_nnodes(0),
+			m_data(0), m_dataSize(0) {
+}
+
 DiffusePointOctree::DiffusePointOctree(const PointArray& points) :
-	m_root(0), m_dataSize(points.stride) {
+	m_nodeStorage(), m_dataStorage(), m_file(), m_nodes(0), m_nnodes(0),
+			m_data(0), m_dataSize(points.stride) {
 	size_t npoints = points.size();
+	if (npoints == 0)
+		return;
 	// Super naive, recursive top-down construction.
 	//
 	// TODO: Investigate bottom-up construction based on sorting in
@@ -161,19 +212,26 @@ DiffusePointOctree::DiffusePointOctree(const PointArray& points) :
 	float maxDim2 = std::max(std::max(d.x, d.y), d.z) / 2;
 	bound.min = c - V3f(maxDim2);
 	bound.max = c + V3f(maxDim2);
-	m_root = makeTree(0, &workspace[0], npoints, m_dataSize, bound);
+	m_nodeStorage.reserve(npoints / 2);
+	m_dataStorage.reserve(npoints * m_dataSize);
+	makeTree(0, &workspace[0], npoints, bound);
+	m_nodes = &m_nodeStorage[0];
+	m_nnodes = m_nodeStorage.size();
+	m_data = &m_dataStorage[0];
 }
 
-DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float** points,
-		size_t npoints, int dataSize, const Box3f& bound) {
+int DiffusePointOctree::makeTree(int depth, const float** points,
+		size_t npoints, const Box3f& bound) {
 	assert(npoints != 0);
-	Node* node = new Node;
+	int nodeIndex = m_nodeStorage.size();
+	m_nodeStorage.push_back(Node());
+	Node* node = &m_nodeStorage.back();
+	std::memset(node, 0, sizeof(Node));
 	node->bound = bound;
 	V3f c = bound.center();
 	node->center = c;
 	V3f diag = bound.size();
 	node->boundRadius = diag.length() / 2.0f;
-	node->npoints = 0;
 	size_t pointsPerLeaf = 8;
 	// Limit max depth of tree to prevent infinite recursion when
 	// greater than pointsPerLeaf points lie at the same position in
@@ -183,10 +241,10 @@ DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float**
 	int maxDepth = 24;
 	if (npoints <= pointsPerLeaf || depth >= maxDepth) {
 		// Small number of child points: make this a leaf node and
-		// store the points directly in the data member.
+		// store the points in the data array.
+		int dataSize = m_dataSize;
 		node->npoints = npoints;
-		// Copy over data into node.
-		node->data.reset(new float[npoints * dataSize]);
+		node->dataOffset = m_dataStorage.size();
 		float sumA = 0;
 		V3f sumP(0);
 		V3f sumN(0);
@@ -194,8 +252,7 @@ DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float**
 		for (size_t j = 0; j < npoints; ++j) {
 			const float* p = points[j];
 			// copy extra data
-			for (int i = 0; i < dataSize; ++i)
-				node->data[j * dataSize + i] = p[i];
+			m_dataStorage.insert(m_dataStorage.end(), p, p + dataSize);
 			// compute averages (area weighted)
 			float A = p[6] * p[6] * M_PI;
 			sumA += A;
@@ -207,7 +264,7 @@ DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float**
 		node->aggN = sumN.normalized();
 		node->aggR = sqrtf(sumA/M_PI);
 		node->aggCol = 1.0f / sumA * sumCol;
-		return node;
+		return nodeIndex;
 	}
 	// allocate extra workspace for storing child points (ugh!)
 	std::vector<const float*> workspace(8 * npoints);
@@ -237,8 +294,11 @@ DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float**
 		bnd.max.x = (i % 2 == 0) ? c.x : bound.max.x;
 		bnd.max.y = ((i / 2) % 2 == 0) ? c.y : bound.max.y;
 		bnd.max.z = ((i / 4) % 2 == 0) ? c.z : bound.max.z;
-		Node* child = makeTree(depth + 1, P[i], np[i], dataSize, bnd);
-		node->children[i] = child;
+		int childIndex = makeTree(depth + 1, P[i], np[i], bnd);
+		// Building the child may have reallocated the node storage.
+		node = &m_nodeStorage[nodeIndex];
+		node->children[i] = childIndex;
+		const Node* child = &m_nodeStorage[childIndex];
 		// Weighted average with weight = disk surface area.
 		float A = child->aggR * child->aggR*M_PI;
 		sumA += A;
@@ -250,19 +310,85 @@ DiffusePointOctree::Node* DiffusePointOctree::makeTree(int depth, const float**
 	node->aggN = sumN.normalized();
 	node->aggR = sqrtf(sumA/M_PI);
 	node->aggCol = 1.0f / sumA * sumCol;
-	return node;
+	return nodeIndex;
 }
 
-void DiffusePointOctree::deleteTree(Node* n) {
-	if (!n)
-		return;
-	for (int i = 0; i < 8; ++i)
-		deleteTree(n->children[i]);
-	delete n;
+DiffusePointOctree::~DiffusePointOctree() {
 }
 
-DiffusePointOctree::~DiffusePointOctree() {
-	deleteTree( m_root);
+boost::shared_ptr<DiffusePointOctree> DiffusePointOctree::mapFile(
+		const std::string& fileName) {
+	boost::shared_ptr<DiffusePointOctree> tree;
+	// Check the header before mapping, so that other point cloud formats
+	// can be rejected cheaply.
+	PointTreeHeader header;
+	{
+		std::ifstream in(fileName.c_str(), std::ios::binary);
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+				|| std::memcmp(header.magic, pointTreeMagic,
+						sizeof(pointTreeMagic)) != 0)
+			return tree;
+	}
+	if (header.version != pointTreeVersion || header.dataSize < 10) {
+		Aqsis::log() << error << "Unsupported point tree version or layout in \""
+				<< fileName << "\"\n";
+		return tree;
+	}
+	tree.reset(new DiffusePointOctree());
+	try {
+		tree->m_file.reset(new boost::iostreams::mapped_file_source(fileName));
+	} catch (std::exception& e) {
+		Aqsis::log() << error << "Could not map point tree \"" << fileName
+				<< "\": " << e.what() << "\n";
+		tree.reset();
+		return tree;
+	}
+	// Only the sizes are validated; checking the nodes themselves would
+	// page in the whole file.
+	boost::uint64_t nodeBytes = header.nodeCount * sizeof(Node);
+	if (header.nodeCount == 0 || tree->m_file->size() != sizeof(header)
+			+ nodeBytes + header.dataCount * sizeof(float)) {
+		Aqsis::log() << error << "Point tree \"" << fileName
+				<< "\" is truncated or corrupt\n";
+		tree.reset();
+		return tree;
+	}
+	const char* base = tree->m_file->data();
+	tree->m_nodes = reinterpret_cast<const Node*>(base + sizeof(header));
+	tree->m_nnodes = header.nodeCount;
+	tree->m_data = reinterpret_cast<const float*>(base + sizeof(header)
+			+ nodeBytes);
+	tree->m_dataSize = header.dataSize;
+	return tree;
+}
+
+bool DiffusePointOctree::writeFile(const std::string& fileName) const {
+	if (m_nnodes == 0) {
+		Aqsis::log() << error << "Can't write empty point tree \"" << fileName
+				<< "\"\n";
+		return false;
+	}
+	PointTreeHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, pointTreeMagic, sizeof(pointTreeMagic));
+	header.version = pointTreeVersion;
+	header.dataSize = m_dataSize;
+	header.nodeCount = m_nnodes;
+	// The last node written is the last leaf, so its points end the data.
+	const Node& last = m_nodes[m_nnodes - 1];
+	header.dataCount = last.dataOffset + last.npoints * m_dataSize;
+	std::ofstream out(fileName.c_str(), std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(m_nodes), m_nnodes * sizeof(Node));
+	out.write(reinterpret_cast<const char*>(m_data), header.dataCount
+			* sizeof(float));
+	out.close();
+	if (!out) {
+		Aqsis::log() << error << "Could not write point tree \"" << fileName
+				<< "\"\n";
+		return false;
+	}
+	return true;
 }
 
 }
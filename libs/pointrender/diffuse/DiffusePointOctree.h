@@ -31,17 +31,22 @@
 #ifndef DIFFUSEPOINTOCTREE_H_
 #define DIFFUSEPOINTOCTREE_H_
 
+#include <string>
 #include <vector>
 
 #include <OpenEXR/ImathVec.h>
 #include <OpenEXR/ImathBox.h>
 #include <OpenEXR/ImathColor.h>
 
-#include <boost/scoped_array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "PointArray.h"
 
+namespace boost { namespace iostreams { class mapped_file_source; } }
+namespace Partio { class ParticlesData; }
+
 namespace Aqsis {
 
 /// Load in point array from aqsis point cloud file format
@@ -53,23 +58,35 @@ namespace Aqsis {
 /// success, false on error.
 bool loadDiffusePointFile(PointArray& points, const std::string& fileName);
 
+/// Append the points of an open Partio point cloud to a point array
+///
+/// This is the guts of loadDiffusePointFile(); fileName is used only for
+/// error messages.
+bool loadDiffusePoints(PointArray& points, const Partio::ParticlesData& ptFile,
+		const std::string& fileName);
+
+/// Determine whether a file name has the extension of a point tree file.
+bool isDiffusePointTreeName(const std::string& fileName);
+
 //------------------------------------------------------------------------------
 /// Naive octree for storing a point hierarchy
+///
+/// The nodes live in a single array in depth first order, so that each
+/// subtree occupies a contiguous range of the array, and the leaf points live
+/// in a second array in the same order.  Nodes refer to their children and
+/// points by index rather than by pointer, which allows the tree to be saved
+/// with writeFile() and memory mapped back in by mapFile().  A mapped tree is
+/// paged in by the operating system as it is traversed, so only the parts of
+/// the hierarchy visited by the integrators ever become resident.
 class DiffusePointOctree {
 
 public:
 	/// Tree node
 	///
 	/// Leaf nodes have npoints > 0, specifying the number of child points
-	/// contained.
+	/// contained.  The layout is written directly to point tree files, so
+	/// must not change without bumping the file version.
 	struct Node {
-		Node() :
-			bound(), center(0), boundRadius(0), aggP(0), aggN(0), aggR(0),
-					aggCol(0), npoints(0), data() {
-			children[0] = children[1] = children[2] = children[3] = 0;
-			children[4] = children[5] = children[6] = children[7] = 0;
-		}
-
 		/// Data derived from octree bounding box
 		Imath::Box3f bound;
 		Imath::V3f center;
@@ -79,19 +96,27 @@ public:
 		Imath::V3f aggN;
 		float aggR;
 		Imath::C3f aggCol;
-		// Child nodes, to be indexed as children[z][y][x]
-		Node* children[8];
-		// bool used;
+		/// Child node indices, to be indexed as children[z][y][x].  The root
+		/// is never a child, so zero marks a missing child.
+		boost::int32_t children[8];
 		/// Number of child points for the leaf node case
-		int npoints;
-		// Collection of points in leaf.
-		boost::scoped_array<float> data;
+		boost::int32_t npoints;
+		/// Offset of the first leaf point in the point data array.
+		boost::uint64_t dataOffset;
 	};
 
 
 private:
 
-	Node* m_root;
+	/// Storage for trees built in memory
+	std::vector<Node> m_nodeStorage;
+	std::vector<float> m_dataStorage;
+	/// Mapping for trees read from a file
+	boost::scoped_ptr<boost::iostreams::mapped_file_source> m_file;
+
+	const Node* m_nodes;
+	size_t m_nnodes;
+	const float* m_data;
 	int m_dataSize;
 
 public:
@@ -101,9 +126,34 @@ public:
 
 	~DiffusePointOctree();
 
-	/// Get root node of tree
+	/// Memory map a tree saved by writeFile()
+	///
+	/// Only the file header is read; the nodes and points are paged in on
+	/// demand.  Returns a null pointer if the file isn't a point tree file, or
+	/// couldn't be mapped.
+	static boost::shared_ptr<DiffusePointOctree> mapFile(
+			const std::string& fileName);
+
+	/// Save the tree in the format read by mapFile()
+	///
+	/// The file is written in native byte order.  Returns false on error.
+	bool writeFile(const std::string& fileName) const;
+
+	/// Get root node of tree, or null for a tree with no points.
 	const Node* root() const {
-		return m_root;
+		return m_nnodes ? m_nodes : 0;
+	}
+
+	/// Get child i of an interior node, or null if it has no such child.
+	const Node* child(const Node* node, int i) const {
+		return node->children[i] ? m_nodes + node->children[i] : 0;
+	}
+
+	/// Get the point data of a leaf node.
+	///
+	/// There are node->npoints points, each with dataSize() floats.
+	const float* pointData(const Node* node) const {
+		return m_data + node->dataOffset;
 	}
 
 	/// Get number of floats representing each point.
@@ -111,18 +161,25 @@ public:
 		return m_dataSize;
 	}
 
+	/// Get number of nodes in the tree.
+	size_t nodeCount() const {
+		return m_nnodes;
+	}
+
 private:
+	DiffusePointOctree();
+
 	/// Build a tree node from the given points
 	///
+	/// The node and its subtree are appended to the node storage, and the
+	/// points of its leaves to the data storage.
+	///
 	/// \param depth - depth of the node to be created
 	/// \param points - pointers to point data
 	/// \param npoints - number of points in points array
-	/// \param dataSize - number of floats representing each point
-	static Node* makeTree(int depth, const float** points, size_t npoints,
-			int dataSize, const Imath::Box3f& bound);
-
-	/// Recursively delete tree, depth first.
-	static void deleteTree(Node* n);
+	/// \return index of the new node
+	int makeTree(int depth, const float** points, size_t npoints,
+			const Imath::Box3f& bound);
 
 };
 
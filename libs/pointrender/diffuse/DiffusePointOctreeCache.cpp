@@ -47,20 +47,28 @@ namespace Aqsis {
 //------------------------------------------------------------------------------
 DiffusePointOctree* DiffusePointOctreeCache::find(const std::string& fileName)
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
     MapType::const_iterator i = m_cache.find(fileName);
     if(i == m_cache.end())
     {
-        // Try to open the file
+        // Try to open the file, first as a point tree which can be mapped
+        // directly.
         //
         // TODO: Path handling
-        PointArray points;
-        // Convert to octree
-        boost::shared_ptr<DiffusePointOctree> tree;
-        if(loadDiffusePointFile(points, fileName))
-            tree.reset(new DiffusePointOctree(points));
-        else
-            Aqsis::log() << error << "Point cloud file \"" << fileName
-                         << "\" not found\n";
+        boost::shared_ptr<DiffusePointOctree> tree
+            = DiffusePointOctree::mapFile(fileName);
+        if(!tree)
+        {
+            PointArray points;
+            // Convert to octree
+            if(loadDiffusePointFile(points, fileName))
+                tree.reset(new DiffusePointOctree(points));
+            else
+                Aqsis::log() << error << "Point cloud file \"" << fileName
+                             << "\" not found\n";
+        }
         // Insert into map.  If we couldn't load the file, we insert
         // a null pointer to record the failure.
         m_cache.insert(MapType::value_type(fileName, tree));
@@ -72,6 +80,9 @@ DiffusePointOctree* DiffusePointOctreeCache::find(const std::string& fileName)
 
 void DiffusePointOctreeCache::clear()
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
     m_cache.clear();
 }
 
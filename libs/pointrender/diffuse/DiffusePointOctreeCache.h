@@ -33,6 +33,9 @@
 #include <map>
 
 #include <boost/shared_ptr.hpp>
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
 #include "DiffusePointOctree.h"
 
 namespace Aqsis {
@@ -43,6 +46,10 @@ private:
 
 	typedef std::map<std::string, boost::shared_ptr<DiffusePointOctree> > MapType;
 	MapType m_cache;
+#ifdef ENABLE_THREADING
+	/// Shaders on all rendering threads look up trees at once.
+	boost::mutex m_mutex;
+#endif
 
 public:
 	/// Find a cached point octree by file name
@@ -0,0 +1,211 @@
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for saving and memory mapping point trees.
+ */
+
+#include "DiffusePointOctree.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../RadiosityIntegrator.h"
+#include "../microbuf_proj_func.h"
+
+using namespace Aqsis;
+using Imath::V3f;
+using Imath::C3f;
+
+namespace {
+
+/// Name of a point tree file which is removed when the object is destroyed.
+class CqTempTreeFile
+{
+	public:
+		CqTempTreeFile()
+			: m_fileName()
+		{
+			for(int i = 0;; ++i)
+			{
+				char name[64];
+				std::sprintf(name, "aqsis_tmpfile_%05d.ptree", i);
+				if(!boost::filesystem::exists(name))
+				{
+					m_fileName = name;
+					break;
+				}
+			}
+		}
+		~CqTempTreeFile()
+		{
+			boost::filesystem::remove(m_fileName);
+		}
+		const std::string& name() const
+		{
+			return m_fileName;
+		}
+	private:
+		std::string m_fileName;
+};
+
+void addPoint(PointArray& points, const V3f& P, const V3f& N, float r,
+			  const C3f& col)
+{
+	float pt[] = {P.x, P.y, P.z, N.x, N.y, N.z, r, col.x, col.y, col.z};
+	points.data.insert(points.data.end(), pt, pt + 10);
+}
+
+/// Make a point cloud of a coloured sphere around the origin, opened at the
+/// top, standing on a ground plane.
+void makePoints(PointArray& points)
+{
+	points.stride = 10;
+	const int nTheta = 24;
+	const int nPhi = 48;
+	for(int i = 0; i < nTheta; ++i)
+	{
+		float theta = M_PI*(i + 0.5f)/nTheta;
+		if(theta < 0.5f)
+			continue;
+		for(int j = 0; j < nPhi; ++j)
+		{
+			float phi = 2*M_PI*(j + 0.5f)/nPhi;
+			V3f N(std::sin(theta)*std::cos(phi), std::sin(theta)*std::sin(phi),
+				  std::cos(theta));
+			addPoint(points, N, -N, 0.1f, C3f(float(i)/nTheta, float(j)/nPhi, 0.5f));
+		}
+	}
+	for(int i = -10; i <= 10; ++i)
+		for(int j = -10; j <= 10; ++j)
+			addPoint(points, V3f(0.2f*i, 0.2f*j, -1.2f), V3f(0,0,1), 0.12f,
+					 C3f(0.2f, 0.8f, 0.1f));
+}
+
+/// Integrate occlusion and radiosity for a few query points.
+void queryTree(const DiffusePointOctree& tree, std::vector<float>& results)
+{
+	const V3f queries[][2] = {
+		{V3f(0,0,0), V3f(0,0,1)},
+		{V3f(0.3f,0.1f,-0.2f), V3f(1,0,0)},
+		{V3f(0,0,-0.9f), V3f(0,0,1)},
+		{V3f(1.5f,0,-1.1f), V3f(0,0,1)},
+		{V3f(0,1.5f,0), V3f(0,-1,0)}
+	};
+	RadiosityIntegrator integrator(10);
+	for(int i = 0, n = sizeof(queries)/sizeof(queries[0]); i < n; ++i)
+	{
+		V3f N = queries[i][1].normalized();
+		integrator.clear();
+		microRasterize(integrator, queries[i][0], N, M_PI_2, 0.03f, tree);
+		float occ = 0;
+		C3f col = integrator.radiosity(N, M_PI_2, &occ);
+		results.push_back(occ);
+		results.push_back(col.x);
+		results.push_back(col.y);
+		results.push_back(col.z);
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(DiffusePointOctree_roundtrip_test)
+{
+	PointArray points;
+	makePoints(points);
+	DiffusePointOctree tree(points);
+	BOOST_REQUIRE(tree.root());
+	CqTempTreeFile file;
+	BOOST_REQUIRE(tree.writeFile(file.name()));
+
+	boost::shared_ptr<DiffusePointOctree> mapped =
+		DiffusePointOctree::mapFile(file.name());
+	BOOST_REQUIRE(mapped);
+	BOOST_REQUIRE_EQUAL(mapped->nodeCount(), tree.nodeCount());
+	BOOST_CHECK_EQUAL(mapped->dataSize(), tree.dataSize());
+
+	// The mapped tree has the same structure and points as the original.
+	int nleafPoints = 0;
+	for(size_t i = 0; i < tree.nodeCount(); ++i)
+	{
+		const DiffusePointOctree::Node* a = tree.root() + i;
+		const DiffusePointOctree::Node* b = mapped->root() + i;
+		BOOST_CHECK(std::memcmp(a, b, sizeof(*a)) == 0);
+		if(a->npoints > 0)
+		{
+			nleafPoints += a->npoints;
+			BOOST_CHECK(std::memcmp(tree.pointData(a), mapped->pointData(b),
+						a->npoints*tree.dataSize()*sizeof(float)) == 0);
+		}
+	}
+	BOOST_CHECK_EQUAL(nleafPoints, static_cast<int>(points.size()));
+
+	// Queries give exactly the same results on both trees.
+	std::vector<float> expected, actual;
+	queryTree(tree, expected);
+	queryTree(*mapped, actual);
+	BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+	bool someOcclusion = false;
+	for(size_t i = 0; i < expected.size(); ++i)
+	{
+		BOOST_CHECK_EQUAL(expected[i], actual[i]);
+		if(i % 4 == 0 && expected[i] > 0.1f)
+			someOcclusion = true;
+	}
+	BOOST_CHECK(someOcclusion);
+}
+
+BOOST_AUTO_TEST_CASE(DiffusePointOctree_mapFile_reject_test)
+{
+	PointArray points;
+	makePoints(points);
+	DiffusePointOctree tree(points);
+	CqTempTreeFile file;
+
+	// Files which aren't point trees are rejected.
+	{
+		std::ofstream out(file.name().c_str(), std::ios::binary);
+		out << "Not a point tree, but long enough to hold a point tree header";
+	}
+	BOOST_CHECK(!DiffusePointOctree::mapFile(file.name()));
+
+	// As are truncated point trees.
+	BOOST_REQUIRE(tree.writeFile(file.name()));
+	boost::filesystem::resize_file(file.name(),
+			boost::filesystem::file_size(file.name()) - sizeof(float));
+	BOOST_CHECK(!DiffusePointOctree::mapFile(file.name()));
+}
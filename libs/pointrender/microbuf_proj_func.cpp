@@ -432,9 +432,13 @@ template void renderDisk<RadiosityIntegrator>(RadiosityIntegrator&,
 /// Render point hierarchy into microbuffer.
 template<typename IntegratorT>
 static void renderNode(IntegratorT& integrator, V3f P, V3f N, float cosConeAngle,
-                       float sinConeAngle, float maxSolidAngle, int dataSize,
-                       const DiffusePointOctree::Node* node)
+                       float sinConeAngle, float maxSolidAngle,
+                       const DiffusePointOctree& tree)
 {
+    const DiffusePointOctree::Node* node = tree.root();
+    if(!node)
+        return;
+    const int dataSize = tree.dataSize();
     // This is an iterative traversal of the point hierarchy, since it's
     // slightly faster than a recursive traversal.
     //
@@ -487,9 +491,10 @@ static void renderNode(IntegratorT& integrator, V3f P, V3f N, float cosConeAngle
                 std::pair<float, int> childOrder[8];
                 // INDIRECT
                 assert(node->npoints <= 8);
+                const float* pointData = tree.pointData(node);
                 for(int i = 0; i < node->npoints; ++i)
                 {
-                    const float* data = &node->data[i*dataSize];
+                    const float* data = &pointData[i*dataSize];
                     V3f p = V3f(data[0], data[1], data[2]) - P;
                     childOrder[i].first = p.length2();
                     childOrder[i].second = i;
@@ -497,7 +502,7 @@ static void renderNode(IntegratorT& integrator, V3f P, V3f N, float cosConeAngle
                 std::sort(childOrder, childOrder + node->npoints);
                 for(int i = 0; i < node->npoints; ++i)
                 {
-                    const float* data = &node->data[childOrder[i].second*dataSize];
+                    const float* data = &pointData[childOrder[i].second*dataSize];
                     V3f p = V3f(data[0], data[1], data[2]) - P;
                     V3f n = V3f(data[3], data[4], data[5]);
                     float r = data[6];
@@ -513,7 +518,7 @@ static void renderNode(IntegratorT& integrator, V3f P, V3f N, float cosConeAngle
                 int nchildren = 0;
                 for(int i = 0; i < 8; ++i)
                 {
-                    DiffusePointOctree::Node* child = node->children[i];
+                    const DiffusePointOctree::Node* child = tree.child(node, i);
                     if(!child)
                         continue;
                     children[nchildren].first = (child->center - P).length2();
@@ -643,7 +648,7 @@ void microRasterize(IntegratorT& integrator, V3f P, V3f N, float coneAngle,
     float cosConeAngle = cos(coneAngle);
     float sinConeAngle = sin(coneAngle);
     renderNode(integrator, P, N, cosConeAngle, sinConeAngle,
-               maxSolidAngle, points.dataSize(), points.root());
+               maxSolidAngle, points);
 }
 
 
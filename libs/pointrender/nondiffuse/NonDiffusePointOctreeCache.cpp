@@ -24,6 +24,9 @@ namespace Aqsis {
 //------------------------------------------------------------------------------
 NonDiffusePointOctree* NonDiffusePointOctreeCache::find(const std::string& fileName)
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
     MapType::const_iterator i = m_cache.find(fileName);
     if(i == m_cache.end())
     {
@@ -65,6 +68,9 @@ NonDiffusePointOctree* NonDiffusePointOctreeCache::find(const std::string& fileN
 
 void NonDiffusePointOctreeCache::clear()
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(m_mutex);
+#endif
     m_cache.clear();
 }
 
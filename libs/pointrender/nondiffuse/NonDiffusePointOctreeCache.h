@@ -11,6 +11,9 @@
 #include <map>
 
 #include <boost/shared_ptr.hpp>
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
 #include "NonDiffusePointOctree.h"
 
 namespace Aqsis {
@@ -21,6 +24,10 @@ private:
 
 	typedef std::map<std::string, boost::shared_ptr<NonDiffusePointOctree> > MapType;
 	MapType m_cache;
+#ifdef ENABLE_THREADING
+	/// Shaders on all rendering threads look up trees at once.
+	boost::mutex m_mutex;
+#endif
 
 public:
 	/// Find a cached point octree by file name
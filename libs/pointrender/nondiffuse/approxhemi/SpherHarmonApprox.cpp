@@ -19,13 +19,13 @@ using Imath::V3f;
 using Imath::C3f;
 using std::vector;
 
-int SpherHarmonApprox::nApproximationSamples = 1000;
-
-SpherHarmonApprox::SpherHarmonApprox(int numBands): shApprox(numBands) {
+SpherHarmonApprox::SpherHarmonApprox(int numBands, int nSamples)
+	: shApprox(numBands), nApproximationSamples(nSamples) {
 
 }
 
-SpherHarmonApprox::SpherHarmonApprox(const float* data1, int length): shApprox(0) {
+SpherHarmonApprox::SpherHarmonApprox(const float* data1, int length)
+	: shApprox(0), nApproximationSamples(1000) {
 	shApprox.SetCoefficients(&data1[1],length-1);
 }
 
@@ -104,7 +104,7 @@ HemiApprox::Type SpherHarmonApprox::getType() {
 }
 
 HemiApprox* SpherHarmonApprox::getDarkApprox() {
-	return new SpherHarmonApprox(shApprox.GetNumBands());
+	return new SpherHarmonApprox(shApprox.GetNumBands(), nApproximationSamples);
 }
 
 
@@ -16,15 +16,16 @@ namespace Aqsis {
 
 class SpherHarmonApprox: public HemiApprox {
 
-public:
-	static int nApproximationSamples;
 private:
 	SHProjection<float> shApprox;
+	// Number of samples used to project a hemisphere; set per bake3d() call,
+	// which may run on several threads at once.
+	int nApproximationSamples;
 
 
 public:
 
-	SpherHarmonApprox(int nBands);
+	SpherHarmonApprox(int nBands, int nSamples = 1000);
 
 	SpherHarmonApprox(const float* data, int length);
 
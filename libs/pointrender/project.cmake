@@ -19,6 +19,11 @@ set(pointrender_srcs
 )
 
 make_absolute(pointrender_srcs ${pointrender_SOURCE_DIR})
+
+set(pointrender_test_srcs
+    diffuse/DiffusePointOctree_test.cpp
+)
+make_absolute(pointrender_test_srcs ${pointrender_SOURCE_DIR})
 list(APPEND pointrender_srcs ${partio_srcs})
 list(APPEND pointrender_srcs ${pngpp_srcs})
 
@@ -49,4 +54,4 @@ source_group("Header Files" FILES ${pointrender_hdrs})
 
 include_directories(${pointrender_SOURCE_DIR})
 
-set(pointrender_libs ${partio_libs} ${math_libs})
+set(pointrender_libs ${partio_libs} ${math_libs} ${Boost_IOSTREAMS_LIBRARY})
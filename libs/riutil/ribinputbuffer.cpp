@@ -35,6 +35,8 @@
 
 #include "ribinputbuffer.h"
 
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream_buffer.hpp>
 #ifdef USE_GZIPPED_RIB
 #	include <boost/iostreams/filtering_stream.hpp>
 #	include <boost/iostreams/filter/gzip.hpp>
@@ -42,21 +44,47 @@
 
 #include <aqsis/util/exception.h>
 
+#include "ribprescan.h"
+
 namespace Aqsis {
 
 RibInputBuffer::RibInputBuffer(std::istream& inStream, const std::string& streamName)
 	: m_inStream(&inStream),
 	m_streamName(streamName),
 	m_gzipStream(),
+	m_buf(m_buffer),
 	m_bufPos(1),
 	m_bufEnd(2),
+	m_memData(0),
+	m_memSize(0),
 	m_currPos(1,0),
 	m_prevPos(-1,-1)
 {
 	// Zero the putback chars
 	m_buffer[0] = 0;
 	m_buffer[1] = 0;
-	if(isGzippedStream(inStream))
+	typedef boost::iostreams::stream_buffer<
+		boost::iostreams::mapped_file_source> MappedFileBuf;
+	const bool isGzipped = isGzippedStream(inStream);
+	MappedFileBuf* mappedBuf = dynamic_cast<MappedFileBuf*>(inStream.rdbuf());
+	if(!isGzipped && mappedBuf && mappedBuf->is_open())
+	{
+		// The file is already in memory, so read it in place starting from
+		// the current stream position.
+		std::streamoff offset = inStream.tellg();
+		if(offset < 0)
+			offset = 0;
+		const boost::iostreams::mapped_file_source& file = **mappedBuf;
+		if(static_cast<std::size_t>(offset) < file.size())
+		{
+			m_memData = reinterpret_cast<const CharType*>(file.data()) + offset;
+			m_memSize = file.size() - offset;
+			m_buf = m_memData;
+			m_bufPos = -1;
+			m_bufEnd = m_memSize;
+		}
+	}
+	else if(isGzipped)
 	{
 #		ifdef USE_GZIPPED_RIB
 		// Initialise gzip decompressor
@@ -73,6 +101,43 @@ RibInputBuffer::RibInputBuffer(std::istream& inStream, const std::string& stream
 	}
 }
 
+RibInputBuffer::RibInputBuffer(const char* data, std::size_t size,
+		const std::string& streamName, int startLine)
+	: m_inStream(0),
+	m_streamName(streamName),
+	m_gzipStream(),
+	m_buf(reinterpret_cast<const CharType*>(data)),
+	m_bufPos(-1),
+	m_bufEnd(size),
+	m_memData(reinterpret_cast<const CharType*>(data)),
+	m_memSize(size),
+	m_currPos(startLine,0),
+	m_prevPos(-1,-1)
+{
+	m_buffer[0] = 0;
+	m_buffer[1] = 0;
+}
+
+void RibInputBuffer::getRun(const RibCharSet& stopChars, std::string& outStr)
+{
+	const CharType* begin = m_buf + m_bufPos + 1;
+	const CharType* end = findRunEnd(stopChars);
+	outStr.append(begin, end);
+	skip(end - begin);
+}
+
+void RibInputBuffer::skipRun(const RibCharSet& stopChars)
+{
+	skip(findRunEnd(stopChars) - (m_buf + m_bufPos + 1));
+}
+
+/// Find the end of the run of buffered characters which aren't in stopChars.
+inline const RibInputBuffer::CharType* RibInputBuffer::findRunEnd(
+		const RibCharSet& stopChars) const
+{
+	return stopChars.findFirst(m_buf + m_bufPos + 1, m_buf + m_bufEnd);
+}
+
 /** \brief Fill the internal buffer with as many characters as possible
  * (guarenteed >= 1)
  *
@@ -90,6 +155,20 @@ void RibInputBuffer::bufferNextChars()
 	// Precondition: m_bufPos is pointing to a one off the end of the valid
 	// characters in the buffer.
 	assert(m_bufPos == m_bufEnd);
+	if(m_memData || !m_inStream)
+	{
+		// Memory input is exhausted; keep the last two characters for
+		// lookback, followed by an eof.  This repeats for each later read.
+		CharType c0 = m_bufEnd >= 2 ? m_buf[m_bufEnd-2] : 0;
+		CharType c1 = m_bufEnd >= 1 ? m_buf[m_bufEnd-1] : 0;
+		m_buffer[0] = c0;
+		m_buffer[1] = c1;
+		m_buffer[2] = eof;
+		m_buf = m_buffer;
+		m_bufPos = 2;
+		m_bufEnd = 3;
+		return;
+	}
 	// first make sure that we're not at the maximum extent of the buffer; if
 	// so we need to wrap around to the beginning.
 	if(m_bufEnd == m_bufSize)
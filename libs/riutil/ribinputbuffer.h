@@ -38,7 +38,9 @@
 
 #include <aqsis/aqsis.h>
 
+#include <cstddef>
 #include <iostream>
+#include <string>
 
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -46,6 +48,8 @@
 namespace Aqsis
 {
 
+class RibCharSet;
+
 /// A holder for source code positions.
 struct SourcePos
 {
@@ -68,6 +72,11 @@ struct SourcePos
  * stdin, the "end" of the rib stream may be encountered at any time.  This
  * class therefore makes sure that any input buffering of a requested number of
  * characters is non-blocking.
+ *
+ * When the RIB is already in memory there's no need for any of this, and the
+ * buffer reads the characters in place.  This happens for streams which read
+ * from a boost::iostreams::mapped_file_source (see openRibFile()), and for
+ * buffers constructed directly on a block of memory.
  */
 class RibInputBuffer : boost::noncopyable
 {
@@ -85,20 +94,71 @@ class RibInputBuffer : boost::noncopyable
 		 */
 		RibInputBuffer(std::istream& inStream,
 				const std::string& streamName = "unknown");
+		/** \brief Construct an input buffer which reads from memory.
+		 *
+		 * The memory must outlive the buffer.
+		 *
+		 * \param data - characters to read.
+		 * \param size - number of characters in data.
+		 * \param streamName - name of the stream used in error messages.
+		 * \param startLine - line number of the first character, for when
+		 *                    data is part of a larger stream.
+		 */
+		RibInputBuffer(const char* data, std::size_t size,
+				const std::string& streamName = "unknown", int startLine = 1);
 
 		/// Get the next character from the input stream
 		CharType get();
 		/// Put the last character back into the input stream
 		void unget();
+		/** \brief Get a run of characters which need no special treatment.
+		 *
+		 * The characters following the last one obtained with get(), up to
+		 * but not including the first one in the set stopChars, are
+		 * appended to outStr.  The run stops early at the end of the
+		 * characters which are currently buffered, so the next get() may
+		 * return a character which isn't in stopChars.
+		 *
+		 * Line numbers aren't updated for the run, so stopChars must
+		 * contain '\r' and '\n'.  It should also contain eof.
+		 */
+		void getRun(const RibCharSet& stopChars, std::string& outStr);
+		/** \brief Skip a run of characters which need no special treatment.
+		 *
+		 * As for getRun(), but the characters are discarded.
+		 */
+		void skipRun(const RibCharSet& stopChars);
+		/** \brief Look at the buffered characters without consuming them.
+		 *
+		 * This allows tokens to be decoded in place.
+		 *
+		 * \param count - set to the number of characters following the last
+		 *                one obtained with get() which are currently buffered.
+		 * \return A pointer to the character following the last one obtained
+		 *         with get().
+		 */
+		const CharType* buffered(std::ptrdiff_t& count) const;
+		/** \brief Consume characters examined with buffered().
+		 *
+		 * Line numbers aren't updated, so the characters must not contain
+		 * any line endings.
+		 */
+		void skip(std::ptrdiff_t count);
 
 		/// Return the position of the previous character obtained with get()
 		SourcePos pos() const;
 		/// Return the name of the input stream
 		const std::string& streamName() const;
 
+		/// Return the memory the buffer reads from, or null for a stream.
+		const char* memoryData() const;
+		/// Return the number of characters in memoryData().
+		std::size_t memorySize() const;
+
 	private:
 		static bool isGzippedStream(std::istream& in);
 		void bufferNextChars();
+		const CharType* findRunEnd(const RibCharSet& stopChars) const;
 
 		/// Stream we are reading from.
 		std::istream* m_inStream;
@@ -111,10 +171,16 @@ class RibInputBuffer : boost::noncopyable
 		static const int m_bufSize = 256;
 		/// Internal buffer of characters.
 		CharType m_buffer[m_bufSize];
+		/// Characters being read; either m_buffer or the input memory.
+		const CharType* m_buf;
 		/// Position of current character [ie, last char returned with get() ]
-		int m_bufPos;
+		std::ptrdiff_t m_bufPos;
 		/// Position of last valid character in input buffer.
-		int m_bufEnd;
+		std::ptrdiff_t m_bufEnd;
+		/// Memory being read, or null when reading from a stream.
+		const CharType* m_memData;
+		/// Number of characters in m_memData.
+		std::size_t m_memSize;
 
 		/// Current source location
 		SourcePos m_currPos;
@@ -133,12 +199,13 @@ inline RibInputBuffer::CharType RibInputBuffer::get()
 	++m_bufPos;
 	if(m_bufPos >= m_bufEnd)
 		bufferNextChars();
-	CharType c = m_buffer[m_bufPos];
+	CharType c = m_buf[m_bufPos];
 
-	// Keep line and column numbers up to date.
+	// Keep line and column numbers up to date.  The first character read
+	// from memory has nothing before it.
 	m_prevPos = m_currPos;
 	++m_currPos.col;
-	if(c == '\r' || (c == '\n' && m_buffer[m_bufPos-1] != '\r'))
+	if(c == '\r' || (c == '\n' && (m_bufPos == 0 || m_buf[m_bufPos-1] != '\r')))
 	{
 		++m_currPos.line;
 		m_currPos.col = 0;
@@ -150,9 +217,9 @@ inline RibInputBuffer::CharType RibInputBuffer::get()
 
 inline void RibInputBuffer::unget()
 {
-	// Precondition: current buffer position is at least two chars into the
-	// buffer so that lookback can work.
-	assert(m_bufPos >= 1);
+	// Precondition: a character has been read since the buffer was last
+	// refilled, so that lookback can work.
+	assert(m_bufPos >= 0);
 	--m_bufPos;
 	m_currPos = m_prevPos;
 }
@@ -167,6 +234,32 @@ inline const std::string& RibInputBuffer::streamName() const
 	return m_streamName;
 }
 
+inline const RibInputBuffer::CharType* RibInputBuffer::buffered(
+		std::ptrdiff_t& count) const
+{
+	count = m_bufEnd - (m_bufPos + 1);
+	return m_buf + m_bufPos + 1;
+}
+
+inline void RibInputBuffer::skip(std::ptrdiff_t count)
+{
+	if(count <= 0)
+		return;
+	m_bufPos += count;
+	m_currPos.col += count;
+	m_prevPos = SourcePos(m_currPos.line, m_currPos.col - 1);
+}
+
+inline const char* RibInputBuffer::memoryData() const
+{
+	return reinterpret_cast<const char*>(m_memData);
+}
+
+inline std::size_t RibInputBuffer::memorySize() const
+{
+	return m_memSize;
+}
+
 } // namespace Aqsis
 
 #endif // RIBINPUTBUFFER_H_INCLUDED
@@ -34,6 +34,7 @@
  */
 
 #include "ribinputbuffer.h"
+#include "ribprescan.h"
 
 #define BOOST_TEST_DYN_LINK
 
@@ -119,4 +120,58 @@ BOOST_AUTO_TEST_CASE(RibInputBuffer_bufwrap_test)
 	BOOST_CHECK_EQUAL(extractedStr, inStr);
 }
 
+BOOST_AUTO_TEST_CASE(RibInputBuffer_memory_test)
+{
+	// A buffer on memory which is part of a larger stream starting at line 10.
+	std::string inStr = "ab\"cd \\x\"\r\nline2 # c\n";
+	RibInputBuffer inBuf(inStr.data(), inStr.size(), "mem", 10);
+	BOOST_CHECK_EQUAL(inBuf.memoryData(), inStr.data());
+	BOOST_CHECK_EQUAL(inBuf.memorySize(), inStr.size());
+
+	BOOST_CHECK_EQUAL(inBuf.get(), 'a');
+	BOOST_CHECK_EQUAL(inBuf.pos().line, 10);
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 1);
+
+	// The rest of the memory is buffered, and can be examined in place.
+	std::ptrdiff_t count = 0;
+	const RibInputBuffer::CharType* chars = inBuf.buffered(count);
+	BOOST_CHECK_EQUAL(count, static_cast<std::ptrdiff_t>(inStr.size() - 1));
+	BOOST_CHECK_EQUAL(static_cast<const void*>(chars),
+			static_cast<const void*>(inStr.data() + 1));
+	inBuf.skip(1);
+	BOOST_CHECK_EQUAL(inBuf.get(), '"');
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 3);
+
+	// Runs stop at the first character in the set.
+	std::string run;
+	inBuf.getRun(RibCharSet("\"\\\r\n\377"), run);
+	BOOST_CHECK_EQUAL(run, "cd ");
+	BOOST_CHECK_EQUAL(inBuf.get(), '\\');
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 7);
+	BOOST_CHECK_EQUAL(inBuf.get(), 'x');
+	BOOST_CHECK_EQUAL(inBuf.get(), '"');
+	BOOST_CHECK_EQUAL(inBuf.get(), '\r');
+	BOOST_CHECK_EQUAL(inBuf.get(), '\n');
+	BOOST_CHECK_EQUAL(inBuf.pos().line, 11);
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 0);
+
+	inBuf.skipRun(RibCharSet("#\r\n\377"));
+	BOOST_CHECK_EQUAL(inBuf.get(), '#');
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 7);
+	inBuf.unget();
+	BOOST_CHECK_EQUAL(inBuf.get(), '#');
+	BOOST_CHECK_EQUAL(inBuf.pos().col, 7);
+
+	// The end of the memory gives eof from then on, and the last character
+	// can still be put back.
+	BOOST_CHECK_EQUAL(inBuf.get(), ' ');
+	BOOST_CHECK_EQUAL(inBuf.get(), 'c');
+	BOOST_CHECK_EQUAL(inBuf.get(), '\n');
+	BOOST_CHECK_EQUAL(inBuf.pos().line, 12);
+	BOOST_CHECK(inBuf.get() == RibInputBuffer::eof);
+	inBuf.unget();
+	BOOST_CHECK(inBuf.get() == RibInputBuffer::eof);
+	BOOST_CHECK(inBuf.get() == RibInputBuffer::eof);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
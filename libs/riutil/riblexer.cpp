@@ -198,7 +198,9 @@ RibLexer::FloatArray RibLexerImpl::getFloatArray(int length)
         // Read an array in [ num1 num2 ... num_n ] format
 
         m_tokenizer.get(); // consume '['
-        bool parsing = true;
+        // Read the elements in bulk where possible, falling back to reading
+        // them one token at a time for anything unusual.
+        bool parsing = !m_tokenizer.getFloatArrayElements(buf);
         while(parsing)
         {
             const RibToken& tok = m_tokenizer.get();
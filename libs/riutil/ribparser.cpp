@@ -38,6 +38,10 @@
 
 #include <cfloat>
 #include <cstring>  // for strcpy
+#include <fstream>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream.hpp>
 
 #include "riblexer.h"
 #include <aqsis/riutil/errorhandler.h>
@@ -50,6 +54,30 @@ RibParser* RibParser::create(Ri::RendererServices& services)
     return new RibParserImpl(services);
 }
 
+boost::shared_ptr<std::istream> openRibFile(const std::string& fileName)
+{
+    namespace io = boost::iostreams;
+    try
+    {
+        // RibInputBuffer recognizes this stream type and reads the mapped
+        // memory directly.
+        boost::shared_ptr<io::stream<io::mapped_file_source> > mappedFile(
+                new io::stream<io::mapped_file_source>(
+                    io::mapped_file_source(fileName)));
+        if(mappedFile->is_open())
+            return mappedFile;
+    }
+    catch(std::exception&)
+    {
+        // Not mappable; eg, an empty file or a pipe.
+    }
+    boost::shared_ptr<std::ifstream> file(
+            new std::ifstream(fileName.c_str(), std::ios::binary));
+    if(!*file)
+        return boost::shared_ptr<std::istream>();
+    return file;
+}
+
 //------------------------------------------------------------------------------
 // RibParserImpl implementation
 
@@ -0,0 +1,203 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Parse throughput of large RIB files.
+ *
+ * A RIB file of baked geometry is generated, then parsed from a std::ifstream
+ * and from a stream opened with openRibFile(), which reads the file in place
+ * and tokenizes it in parallel when aqsis is built with threading.  The
+ * requests seen by each are checked against each other before the
+ * throughputs are reported.
+ *
+ * Usage: ribparser_bench [size in MB] [file name]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <aqsis/riutil/errorhandler.h>
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ricxxutil.h>
+#include <aqsis/riutil/tokendictionary.h>
+#include <aqsis/util/timer.h>
+
+using namespace Aqsis;
+
+namespace {
+
+/// Renderer which counts the geometry it's given.
+class CountingRenderer : public StubRenderer
+{
+	public:
+		TqUlong numPolys;
+		TqUlong numValues;
+		TqUlong numComments;
+
+		CountingRenderer() : numPolys(0), numValues(0), numComments(0) {}
+
+		virtual RtVoid PointsPolygons(const IntArray& nverts,
+				const IntArray& verts, const ParamList& pList)
+		{
+			numPolys += nverts.size();
+			for(size_t i = 0; i < pList.size(); ++i)
+				numValues += pList[i].size();
+		}
+		virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
+		{
+			++numComments;
+		}
+};
+
+class PrintErrorHandler : public Ri::ErrorHandler
+{
+	public:
+		PrintErrorHandler() : ErrorHandler(Warning) {}
+	protected:
+		virtual void dispatch(int code, const std::string& message)
+		{
+			std::cerr << message << "\n";
+		}
+};
+
+/// Just enough services to parse geometry.
+class BenchServices : public Ri::RendererServices
+{
+	public:
+		virtual Ri::ErrorHandler& errorHandler() { return m_errorHandler; }
+		virtual RtFilterFunc getFilterFunc(RtConstToken name) const { return 0; }
+		virtual RtConstBasis* getBasis(RtConstToken name) const { return 0; }
+		virtual RtErrorFunc getErrorFunc(RtConstToken name) const { return 0; }
+		virtual RtProcSubdivFunc getProcSubdivFunc(RtConstToken name) const { return 0; }
+		virtual Ri::TypeSpec getDeclaration(RtConstToken token,
+				const char** nameBegin = 0, const char** nameEnd = 0) const
+		{
+			return m_tokenDict.lookup(token, nameBegin, nameEnd);
+		}
+		virtual Ri::Renderer& firstFilter() { return m_renderer; }
+		virtual void addFilter(const char* name,
+				const Ri::ParamList& filterParams = Ri::ParamList()) {}
+		virtual void addFilter(Ri::Filter& filter) {}
+		virtual void parseRib(std::istream& ribStream, const char* name,
+				Ri::Renderer& context) {}
+
+	private:
+		TokenDict m_tokenDict;
+		PrintErrorHandler m_errorHandler;
+		StubRenderer m_renderer;
+};
+
+/// Write about sizeMB megabytes of RIB holding meshes of quads.
+void writeRib(const std::string& fileName, int sizeMB)
+{
+	std::ofstream out(fileName.c_str(), std::ios::binary);
+	const int gridSize = 32;
+	for(int mesh = 0; out.tellp() < std::streamoff(sizeMB) << 20; ++mesh)
+	{
+		out << "AttributeBegin\n# mesh " << mesh << "\n"
+			<< "Attribute \"identifier\" \"name\" [\"mesh_" << mesh << "\"]\n"
+			<< "PointsPolygons [";
+		for(int i = 0; i < gridSize*gridSize; ++i)
+			out << "4 ";
+		out << "]\n[";
+		for(int v = 0; v < gridSize; ++v)
+		{
+			for(int u = 0; u < gridSize; ++u)
+			{
+				int i = v*(gridSize+1) + u;
+				out << i << ' ' << i+1 << ' ' << i+gridSize+2 << ' '
+					<< i+gridSize+1 << ' ';
+			}
+		}
+		out << "]\n\"P\" [";
+		for(int v = 0; v <= gridSize; ++v)
+		{
+			for(int u = 0; u <= gridSize; ++u)
+				out << u*0.03125f << ' ' << v*0.03125f << ' ' << mesh*0.5f << ' ';
+			out << '\n';
+		}
+		out << "]\n\"st\" [";
+		for(int v = 0; v <= gridSize; ++v)
+			for(int u = 0; u <= gridSize; ++u)
+				out << u/float(gridSize) << ' ' << v/float(gridSize) << ' ';
+		out << "]\nAttributeEnd\n";
+	}
+}
+
+/// Parse the stream, returning the time taken.
+double parse(std::istream& in, CountingRenderer& renderer)
+{
+	BenchServices services;
+	boost::shared_ptr<RibParser> parser(RibParser::create(services));
+	CqTimer timer;
+	timer.start();
+	parser->parseStream(in, "bench", renderer);
+	timer.stop();
+	return timer.totalTime();
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[])
+{
+	int sizeMB = argc > 1 ? std::atoi(argv[1]) : 256;
+	std::string fileName = argc > 2 ? argv[2] : "ribparser_bench.rib";
+
+	std::cout << "writing " << sizeMB << "MB of RIB to " << fileName << "\n";
+	writeRib(fileName, sizeMB);
+
+	CountingRenderer streamCounts;
+	std::ifstream streamIn(fileName.c_str(), std::ios::binary);
+	double streamTime = parse(streamIn, streamCounts);
+
+	CountingRenderer mappedCounts;
+	boost::shared_ptr<std::istream> mappedIn = openRibFile(fileName);
+	double mappedTime = mappedIn ? parse(*mappedIn, mappedCounts) : 0;
+
+	std::remove(fileName.c_str());
+
+	bool matched = mappedIn && streamCounts.numPolys == mappedCounts.numPolys
+		&& streamCounts.numValues == mappedCounts.numValues
+		&& streamCounts.numComments == mappedCounts.numComments;
+	if(!matched)
+	{
+		std::cout << "MISMATCH between stream and mapped parses\n";
+		return 1;
+	}
+	std::cout << "parsed " << streamCounts.numPolys << " polygons\n"
+		<< "std::ifstream:  " << streamTime << "s, "
+		<< sizeMB/streamTime << " MB/s\n"
+		<< "openRibFile():  " << mappedTime << "s, "
+		<< sizeMB/mappedTime << " MB/s\n";
+	return 0;
+}
@@ -0,0 +1,175 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Bulk character scanning and splitting of in-memory RIB.
+ */
+
+#include "ribprescan.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace Aqsis
+{
+
+RibCharSet::RibCharSet(const char* chars, bool highChars)
+	: m_numChars(0),
+	m_highChars(highChars)
+{
+	std::memset(m_table, 0, sizeof(m_table));
+	for(const char* c = chars; *c; ++c)
+	{
+		assert(m_numChars < maxChars);
+		m_chars[m_numChars++] = static_cast<unsigned char>(*c);
+		m_table[static_cast<unsigned char>(*c)] = true;
+	}
+	if(highChars)
+	{
+		for(int c = 0200; c < 256; ++c)
+			m_table[c] = true;
+	}
+}
+
+
+namespace {
+
+// Characters which need attention at the top level, ie, outside strings and
+// comments.  Newlines only matter when looking for somewhere to split.
+const RibCharSet topLevelChars("\"#\r", true);
+const RibCharSet topLevelLineChars("\"#\r\n", true);
+// Characters which need attention inside strings and comments.
+const RibCharSet stringChars("\"\\\r\n\377");
+const RibCharSet commentChars("\r\n\377");
+
+/// Skip a line ending at c, counting lines the way RibInputBuffer does.
+inline const unsigned char* skipLineEnd(const unsigned char* c,
+		const unsigned char* end, int& line)
+{
+	++line;
+	if(*c == '\r' && c + 1 < end && c[1] == '\n')
+		return c + 2;
+	return c + 1;
+}
+
+inline bool isLetter(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+} // unnamed namespace
+
+bool splitRibChunks(const char* data, std::size_t size, std::size_t chunkSize,
+		std::vector<RibChunk>& chunks)
+{
+	const unsigned char* begin = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* end = begin + size;
+	const unsigned char* chunkBegin = begin;
+	int chunkLine = 1;
+	int line = 1;
+	const unsigned char* c = begin;
+	while(c < end)
+	{
+		const std::size_t chunkRemaining = chunkSize - std::min(chunkSize,
+				static_cast<std::size_t>(c - chunkBegin));
+		const bool wantSplit = chunkRemaining == 0;
+		// Until the chunk is full, newlines are only counted; stop at the
+		// end of the chunk so the split isn't skipped over.
+		const unsigned char* searchEnd = end;
+		if(!wantSplit && static_cast<std::size_t>(end - c) > chunkRemaining)
+			searchEnd = c + chunkRemaining;
+		const unsigned char* next = wantSplit ? topLevelLineChars.findFirst(c, end)
+			: topLevelChars.findFirst(c, searchEnd);
+		line += std::count(c, next, '\n');
+		c = next;
+		if(c == end)
+			break;
+		if(c == searchEnd && !wantSplit)
+			continue;
+		switch(*c)
+		{
+			case '"':
+				// Skip the string, including any escaped quotes.
+				++c;
+				while(c < end)
+				{
+					c = stringChars.findFirst(c, end);
+					if(c == end)
+						break;
+					if(*c == '"')
+					{
+						++c;
+						break;
+					}
+					else if(*c == '\\')
+					{
+						++c;
+						if(c == end)
+							break;
+						if(*c == '\r' || *c == '\n')
+							c = skipLineEnd(c, end, line);
+						else if(*c == 0377)
+							return false;
+						else
+							++c;
+					}
+					else if(*c == '\r' || *c == '\n')
+						c = skipLineEnd(c, end, line);
+					else
+						return false;
+				}
+				break;
+			case '#':
+				c = commentChars.findFirst(c + 1, end);
+				if(c < end && *c == 0377)
+					return false;
+				break;
+			case '\r':
+			case '\n':
+				c = skipLineEnd(c, end, line);
+				if(wantSplit && c < end && isLetter(*c))
+				{
+					chunks.push_back(RibChunk(chunkBegin - begin, c - begin, chunkLine));
+					chunkBegin = c;
+					chunkLine = line;
+				}
+				break;
+			default:
+				// Binary encoded token.
+				return false;
+		}
+	}
+	if(chunkBegin < end)
+		chunks.push_back(RibChunk(chunkBegin - begin, size, chunkLine));
+	return true;
+}
+
+} // namespace Aqsis
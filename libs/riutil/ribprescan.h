@@ -0,0 +1,170 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Bulk character scanning and splitting of in-memory RIB.
+ */
+
+#ifndef RIBPRESCAN_H_INCLUDED
+#define RIBPRESCAN_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+#include <vector>
+
+#include <aqsis/math/simd.h>
+
+namespace Aqsis
+{
+
+//------------------------------------------------------------------------------
+/** \brief A small set of characters which can be searched for in bulk.
+ *
+ * The tokenizer spends most of its time on runs of characters which need no
+ * special treatment: the body of a string or comment, or the whitespace and
+ * digits of a long numeric array.  A character set lets these runs be skipped
+ * sixteen characters at a time by comparing against each member of the set
+ * with SSE2, falling back to a table lookup elsewhere.
+ */
+class RibCharSet
+{
+	public:
+		/** \brief Construct a set.
+		 *
+		 * \param chars - null terminated list of the characters in the set;
+		 *                at most maxChars of them.
+		 * \param highChars - if true, all characters >= 0200 are also in the
+		 *                    set.  This is how binary RIB is detected.
+		 */
+		RibCharSet(const char* chars, bool highChars = false);
+
+		/// Determine whether c is in the set.
+		bool contains(unsigned char c) const;
+
+		/** \brief Find the first character in [begin,end) which is in the set.
+		 *
+		 * \return A pointer to the character, or end if there isn't one.
+		 */
+		const unsigned char* findFirst(const unsigned char* begin,
+				const unsigned char* end) const;
+
+	private:
+		static const int maxChars = 8;
+
+		bool m_table[256];
+		unsigned char m_chars[maxChars];
+		int m_numChars;
+		bool m_highChars;
+};
+
+
+//------------------------------------------------------------------------------
+/// A part of an ASCII RIB stream which starts with a request.
+struct RibChunk
+{
+	/// Offset of the first character.
+	std::size_t begin;
+	/// Offset of one past the last character.
+	std::size_t end;
+	/// Line number of the first character.
+	int startLine;
+
+	RibChunk(std::size_t begin, std::size_t end, int startLine)
+		: begin(begin), end(end), startLine(startLine) {}
+};
+
+/** \brief Split in-memory RIB into chunks which can be tokenized separately.
+ *
+ * The RIB is scanned once with the same rules the tokenizer uses for strings
+ * and comments, and split at the first line beginning with a request name
+ * after each chunkSize characters.  Since each chunk then starts at a token
+ * boundary, tokenizing the chunks separately gives the same tokens as
+ * tokenizing the whole.
+ *
+ * Binary RIB can't be split this way since encoded requests and strings
+ * defined in one chunk may be used in another, so the split fails when a
+ * binary-encoded byte appears outside a string or comment.
+ *
+ * \param data - RIB to split.
+ * \param size - number of characters in data.
+ * \param chunkSize - approximate size of each chunk.
+ * \param chunks - the chunks are appended here in order.
+ * \return false if the RIB contained binary encoding.
+ */
+bool splitRibChunks(const char* data, std::size_t size, std::size_t chunkSize,
+		std::vector<RibChunk>& chunks);
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline bool RibCharSet::contains(unsigned char c) const
+{
+	return m_table[c];
+}
+
+inline const unsigned char* RibCharSet::findFirst(const unsigned char* begin,
+		const unsigned char* end) const
+{
+	const unsigned char* p = begin;
+#ifdef AQSIS_SIMD_SSE2
+	__m128i splat[maxChars];
+	for(int i = 0; i < m_numChars; ++i)
+		splat[i] = _mm_set1_epi8(static_cast<char>(m_chars[i]));
+	for(; end - p >= 16; p += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		// The sign bits of the characters are exactly the high characters.
+		int mask = m_highChars ? _mm_movemask_epi8(block) : 0;
+		for(int i = 0; i < m_numChars; ++i)
+			mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(block, splat[i]));
+		if(mask)
+		{
+			while(!(mask & 1))
+			{
+				mask >>= 1;
+				++p;
+			}
+			return p;
+		}
+	}
+#endif
+	for(; p < end; ++p)
+	{
+		if(m_table[*p])
+			return p;
+	}
+	return end;
+}
+
+} // namespace Aqsis
+
+#endif // RIBPRESCAN_H_INCLUDED
@@ -0,0 +1,122 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Unit tests for bulk scanning and splitting of RIB.
+ */
+
+#include "ribprescan.h"
+
+#define BOOST_TEST_DYN_LINK
+
+#include <cstring>
+#include <string>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+const unsigned char* uchars(const std::string& s)
+{
+	return reinterpret_cast<const unsigned char*>(s.data());
+}
+
+std::string chunkText(const std::string& rib, const RibChunk& chunk)
+{
+	return rib.substr(chunk.begin, chunk.end - chunk.begin);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(rib_prescan_tests)
+
+BOOST_AUTO_TEST_CASE(RibCharSet_findFirst_test)
+{
+	RibCharSet set("\"\\");
+	BOOST_CHECK(set.contains('"'));
+	BOOST_CHECK(!set.contains('a'));
+
+	// Matches both within and after the first sixteen characters.
+	std::string s = "a long string which ends with a \\ and \" here";
+	const unsigned char* begin = uchars(s);
+	const unsigned char* end = begin + s.size();
+	BOOST_CHECK_EQUAL(set.findFirst(begin, end) - begin, int(s.find('\\')));
+	BOOST_CHECK_EQUAL(set.findFirst(begin, begin + 10) - begin, 10);
+	std::string t = "ab\"c";
+	BOOST_CHECK_EQUAL(set.findFirst(uchars(t), uchars(t) + t.size()) - uchars(t), 2);
+
+	RibCharSet highSet("#", true);
+	std::string h = "0123456789abcdefghij\200";
+	BOOST_CHECK_EQUAL(highSet.findFirst(uchars(h), uchars(h) + h.size()) - uchars(h),
+			int(h.size() - 1));
+}
+
+BOOST_AUTO_TEST_CASE(splitRibChunks_test)
+{
+	std::string rib =
+		"Sphere 1 -1 1 360\n"
+		"Attribute \"identifier\" \"name\" [\"a\nSphere\"]\n"
+		"# a comment\nSphere\n"
+		"  Polygon \"P\" [0 0 0]\n"
+		"Sphere 1 -1 1 360\n";
+	std::vector<RibChunk> chunks;
+	BOOST_REQUIRE(splitRibChunks(rib.data(), rib.size(), 1, chunks));
+	// Splits are at lines starting with a letter, outside strings and comments.
+	BOOST_REQUIRE_EQUAL(chunks.size(), 4U);
+	BOOST_CHECK_EQUAL(chunkText(rib, chunks[0]), "Sphere 1 -1 1 360\n");
+	BOOST_CHECK_EQUAL(chunks[0].startLine, 1);
+	BOOST_CHECK_EQUAL(chunkText(rib, chunks[1]),
+		"Attribute \"identifier\" \"name\" [\"a\nSphere\"]\n# a comment\n");
+	BOOST_CHECK_EQUAL(chunks[1].startLine, 2);
+	BOOST_CHECK_EQUAL(chunkText(rib, chunks[2]), "Sphere\n  Polygon \"P\" [0 0 0]\n");
+	BOOST_CHECK_EQUAL(chunks[2].startLine, 5);
+	BOOST_CHECK_EQUAL(chunkText(rib, chunks[3]), "Sphere 1 -1 1 360\n");
+	BOOST_CHECK_EQUAL(chunks[3].startLine, 7);
+
+	// Large chunks leave the RIB whole.
+	chunks.clear();
+	BOOST_REQUIRE(splitRibChunks(rib.data(), rib.size(), 1000, chunks));
+	BOOST_REQUIRE_EQUAL(chunks.size(), 1U);
+	BOOST_CHECK_EQUAL(chunks[0].end, rib.size());
+}
+
+BOOST_AUTO_TEST_CASE(splitRibChunks_binary_test)
+{
+	std::vector<RibChunk> chunks;
+	// High characters are allowed in strings and comments only.
+	std::string ascii = "Option \"\200\" # \201\nSphere 1 -1 1 360\n";
+	BOOST_CHECK(splitRibChunks(ascii.data(), ascii.size(), 1, chunks));
+	std::string binary = "Sphere \201 -1 1 360\n";
+	BOOST_CHECK(!splitRibChunks(binary.data(), binary.size(), 1, chunks));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -38,22 +38,52 @@
 #include <cctype>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <sstream>
 
+#include <utility>
+
 #include <boost/cstdint.hpp> // for uint64_t
+#include <boost/scoped_ptr.hpp>
+#ifdef ENABLE_THREADING
+#	include <deque>
+#	include <boost/bind.hpp>
+#	include <boost/exception_ptr.hpp>
+#	include <boost/thread/condition_variable.hpp>
+#	include <boost/thread/mutex.hpp>
+#	include <boost/thread/thread.hpp>
+#endif
 
 #include <aqsis/math/math.h>
+#include <aqsis/util/exception.h>
+
+#include "ribprescan.h"
 
 namespace Aqsis
 {
 
+namespace {
+
+// Characters which interrupt a run of ordinary characters in a string or a
+// comment.
+const RibCharSet stringStopChars("\"\\\r\n\377");
+const RibCharSet commentStopChars("\r\n\377");
+
+/// Approximate size of the chunks which are tokenized in parallel.
+const std::size_t parallelChunkSize = 1 << 20;
+/// Smallest input worth tokenizing in parallel.
+const std::size_t parallelMinSize = 8*parallelChunkSize;
+
+} // unnamed namespace
+
 /** Struct to save the input state of the lexer inside pushInput(), so that it
  * can be restored inside popInput()
  */
 struct RibTokenizer::InputState
 {
 	RibInputBuffer inBuf;
+	boost::shared_ptr<ChunkedInput> chunkedInput;
 	SourcePos currPos;
 	SourcePos nextPos;
 	RibToken nextTok;
@@ -61,23 +91,348 @@ struct RibTokenizer::InputState
 	CommentCallback commentCallback;
 
 	InputState(std::istream& inStream, const std::string& streamName,
-			const SourcePos& currPos, const SourcePos& nextPos,
-			const RibToken& nextTok, bool haveNext,
-			const CommentCallback& callback)
+			const RibTokenizer& tokenizer)
 		: inBuf(inStream, streamName),
-		currPos(currPos),
-		nextPos(nextPos),
-		nextTok(nextTok),
-		haveNext(haveNext),
-		commentCallback(callback)
+		chunkedInput(),
+		currPos(tokenizer.m_currPos),
+		nextPos(tokenizer.m_nextPos),
+		nextTok(tokenizer.m_nextTok),
+		haveNext(tokenizer.m_haveNext),
+		commentCallback(tokenizer.m_commentCallback)
 	{ }
+
+	InputState(const char* data, std::size_t size, const std::string& streamName,
+			int startLine, const RibTokenizer& tokenizer)
+		: inBuf(data, size, streamName, startLine),
+		chunkedInput(),
+		currPos(tokenizer.m_currPos),
+		nextPos(tokenizer.m_nextPos),
+		nextTok(tokenizer.m_nextTok),
+		haveNext(tokenizer.m_haveNext),
+		commentCallback(tokenizer.m_commentCallback)
+	{ }
+};
+
+
+#ifdef ENABLE_THREADING
+/** \brief Tokens of in-memory ASCII RIB, prepared by worker threads.
+ *
+ * The chunks from splitRibChunks() are tokenized by a fixed set of worker
+ * threads, one per processor, into lists of tokens, their positions, and the
+ * comments between them.  Only a limited number of chunks are queued ahead of
+ * the chunk being read, which bounds the memory used by the token lists.
+ *
+ * An exception thrown while tokenizing a chunk is kept, and rethrown to the
+ * reader when it gets to that chunk.
+ */
+class RibTokenizer::ChunkedInput : boost::noncopyable
+{
+	public:
+		ChunkedInput(const char* data, const std::vector<RibChunk>& chunks,
+				const std::string& streamName, bool keepComments)
+			: m_data(data),
+			m_chunks(chunks),
+			m_streamName(streamName),
+			m_keepComments(keepComments),
+			m_tokenChunks(chunks.size()),
+			m_spareChunk(),
+			m_window(std::max(2u, 2*boost::thread::hardware_concurrency())),
+			m_current(0),
+			m_currentReady(false),
+			m_endPos(1,1),
+			m_tokenPos(0),
+			m_commentPos(0),
+			m_mutex(),
+			m_workReady(),
+			m_chunkDone(),
+			m_queue(),
+			m_stopping(false),
+			m_workers()
+		{
+			for(std::size_t i = 0; i < m_window && i < m_chunks.size(); ++i)
+				startChunk(i);
+			std::size_t numWorkers = std::min<std::size_t>(m_chunks.size(),
+					std::max(1u, boost::thread::hardware_concurrency()));
+			for(std::size_t i = 0; i < numWorkers; ++i)
+				m_workers.create_thread(boost::bind(&ChunkedInput::work, this));
+		}
+
+		~ChunkedInput()
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_stopping = true;
+			}
+			m_workReady.notify_all();
+			m_workers.join_all();
+		}
+
+		/** \brief Get the next token.
+		 *
+		 * Any comments found before the token are passed to callback.
+		 */
+		void get(RibToken& tok, SourcePos& pos, const CommentCallback& callback)
+		{
+			while(m_current < m_chunks.size())
+			{
+				const TokenChunk& chunk = currentChunk();
+				while(m_commentPos < chunk.comments.size()
+						&& chunk.comments[m_commentPos].first <= m_tokenPos)
+				{
+					if(callback)
+						callback(chunk.comments[m_commentPos].second);
+					++m_commentPos;
+				}
+				if(m_tokenPos < chunk.tokens.size())
+				{
+					tok = chunk.tokens[m_tokenPos];
+					pos = chunk.positions[m_tokenPos];
+					++m_tokenPos;
+					return;
+				}
+				m_endPos = chunk.endPos;
+				nextChunk();
+			}
+			tok = RibToken::ENDOFFILE;
+			pos = m_endPos;
+		}
+
+		/** \brief Get the numeric elements of an array, up to and including
+		 * the closing ']'.
+		 *
+		 * \return false if something other than a number was found before the
+		 * end of the array, in which case it is left to be read by get().
+		 */
+		bool getFloatArrayElements(std::vector<float>& buf, SourcePos& pos)
+		{
+			if(m_current >= m_chunks.size())
+				return false;
+			// Arrays never span chunks, since chunks start with a request.
+			const TokenChunk& chunk = currentChunk();
+			std::size_t nextComment = m_commentPos < chunk.comments.size()
+				? chunk.comments[m_commentPos].first : chunk.tokens.size();
+			for(std::size_t i = m_tokenPos; i < chunk.tokens.size(); ++i)
+			{
+				if(i >= nextComment)
+				{
+					// Let get() pass the comments on in order.
+					m_tokenPos = i;
+					return false;
+				}
+				const RibToken& tok = chunk.tokens[i];
+				switch(tok.type())
+				{
+					case RibToken::FLOAT:
+						buf.push_back(tok.floatVal());
+						break;
+					case RibToken::INTEGER:
+						buf.push_back(tok.intVal());
+						break;
+					case RibToken::ARRAY_END:
+						pos = chunk.positions[i];
+						m_tokenPos = i + 1;
+						return true;
+					default:
+						m_tokenPos = i;
+						return false;
+				}
+			}
+			m_tokenPos = chunk.tokens.size();
+			return false;
+		}
+
+	private:
+		/// Tokens of one chunk.
+		struct TokenChunk
+		{
+			std::vector<RibToken> tokens;
+			std::vector<SourcePos> positions;
+			/// Comments, with the index of the token which follows them.
+			std::vector<std::pair<std::size_t, std::string> > comments;
+			/// Position of the end of the chunk.
+			SourcePos endPos;
+			/// True once a worker has finished with the chunk.
+			bool done;
+			/// Exception thrown while tokenizing the chunk, if any.
+			boost::exception_ptr error;
+
+			TokenChunk()
+				: tokens(),
+				positions(),
+				comments(),
+				endPos(1,1),
+				done(false),
+				error()
+			{ }
+
+			void addComment(const std::string& comment)
+			{
+				comments.push_back(std::make_pair(tokens.size(), comment));
+			}
+		};
+
+		/** \brief Get the chunk being read, waiting for it to be tokenized.
+		 *
+		 * If tokenizing the chunk failed, the exception is thrown here once;
+		 * afterwards the tokens found before the failure can be read.
+		 */
+		const TokenChunk& currentChunk()
+		{
+			TokenChunk& chunk = *m_tokenChunks[m_current];
+			if(!m_currentReady)
+			{
+				boost::exception_ptr error;
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					while(!chunk.done)
+						m_chunkDone.wait(lock);
+					std::swap(error, chunk.error);
+				}
+				m_currentReady = true;
+				if(error)
+					boost::rethrow_exception(error);
+			}
+			return chunk;
+		}
+
+		/// Move on to the next chunk, and queue another one.
+		void nextChunk()
+		{
+			// Recycle the finished chunk so its storage is reused.
+			m_spareChunk = m_tokenChunks[m_current];
+			m_tokenChunks[m_current].reset();
+			++m_current;
+			m_currentReady = false;
+			m_tokenPos = 0;
+			m_commentPos = 0;
+			if(m_current + m_window - 1 < m_chunks.size())
+				startChunk(m_current + m_window - 1);
+		}
+
+		/// Queue chunk i to be tokenized.
+		void startChunk(std::size_t i)
+		{
+			if(m_spareChunk)
+			{
+				m_spareChunk->tokens.clear();
+				m_spareChunk->positions.clear();
+				m_spareChunk->comments.clear();
+				m_tokenChunks[i].swap(m_spareChunk);
+			}
+			else
+				m_tokenChunks[i].reset(new TokenChunk());
+			m_tokenChunks[i]->done = false;
+			m_tokenChunks[i]->error = boost::exception_ptr();
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_queue.push_back(i);
+			}
+			m_workReady.notify_one();
+		}
+
+		/// Tokenize queued chunks until the input is destroyed.
+		void work()
+		{
+			while(true)
+			{
+				std::size_t i = 0;
+				TokenChunk* out = 0;
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					while(m_queue.empty() && !m_stopping)
+						m_workReady.wait(lock);
+					if(m_stopping)
+						return;
+					i = m_queue.front();
+					m_queue.pop_front();
+					out = m_tokenChunks[i].get();
+				}
+				boost::exception_ptr error;
+				try
+				{
+					tokenizeChunk(m_data, m_chunks[i], m_streamName,
+							m_keepComments, *out);
+				}
+				catch(XqException& e)
+				{
+					// Keep the error code and message for the parser.
+					error = boost::copy_exception(e);
+				}
+				catch(...)
+				{
+					error = boost::current_exception();
+				}
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					out->error = error;
+					out->done = true;
+				}
+				m_chunkDone.notify_all();
+			}
+		}
+
+		static void tokenizeChunk(const char* data, const RibChunk& chunk,
+				const std::string& streamName, bool keepComments,
+				TokenChunk& out)
+		{
+			RibTokenizer tokenizer;
+			CommentCallback callback;
+			if(keepComments)
+				callback = boost::bind(&TokenChunk::addComment, &out, _1);
+			tokenizer.pushChunk(data + chunk.begin, chunk.end - chunk.begin,
+					streamName, chunk.startLine, callback);
+			while(true)
+			{
+				const RibToken& tok = tokenizer.get();
+				if(tok.type() == RibToken::ENDOFFILE)
+					break;
+				out.tokens.push_back(tok);
+				out.positions.push_back(tokenizer.m_currPos);
+			}
+			out.endPos = tokenizer.m_currPos;
+		}
+
+		const char* m_data;
+		std::vector<RibChunk> m_chunks;
+		std::string m_streamName;
+		bool m_keepComments;
+		/// Tokens of the chunks being tokenized or waiting to be read.
+		std::vector<boost::shared_ptr<TokenChunk> > m_tokenChunks;
+		/// A finished chunk, kept for reuse.
+		boost::shared_ptr<TokenChunk> m_spareChunk;
+		/// Number of chunks queued or tokenized ahead of the reader.
+		std::size_t m_window;
+		/// Chunk being read.
+		std::size_t m_current;
+		/// True once the reader has waited for the current chunk.
+		bool m_currentReady;
+		/// Position of the end of the last chunk read.
+		SourcePos m_endPos;
+		/// Position of the next token in the current chunk.
+		std::size_t m_tokenPos;
+		/// Position of the next comment in the current chunk.
+		std::size_t m_commentPos;
+
+		/// Protects the queue, and the done flags and errors of the chunks.
+		boost::mutex m_mutex;
+		/// Signalled when a chunk is queued, or the workers should stop.
+		boost::condition_variable m_workReady;
+		/// Signalled when a worker finishes a chunk.
+		boost::condition_variable m_chunkDone;
+		/// Indices of the chunks waiting for a worker.
+		std::deque<std::size_t> m_queue;
+		/// Set when the workers should stop.
+		bool m_stopping;
+		boost::thread_group m_workers;
 };
+#endif // ENABLE_THREADING
 
 //-------------------------------------------------------------------------------
 // RibTokenizer implementation
 
 RibTokenizer::RibTokenizer()
 	: m_inBuf(0),
+	m_chunkedInput(0),
 	m_inputStack(),
 	m_currPos(1,1),
 	m_nextPos(1,1),
@@ -86,16 +441,58 @@ RibTokenizer::RibTokenizer()
 	m_commentCallback(),
 	m_encodedRequests(256),
 	m_encodedStrings(),
-	m_arrayElementsRemaining(-1)
-{ }
+	m_arrayElementsRemaining(-1),
+	m_parallelChunkSize(parallelChunkSize),
+	m_parallelMinSize(std::numeric_limits<std::size_t>::max())
+{
+#	ifdef ENABLE_THREADING
+	// Splitting the input only pays off with several processors.
+	if(boost::thread::hardware_concurrency() > 1)
+		m_parallelMinSize = parallelMinSize;
+#	endif
+}
+
+void RibTokenizer::setParallelChunking(std::size_t chunkSize,
+		std::size_t minSize)
+{
+	m_parallelChunkSize = chunkSize;
+	m_parallelMinSize = minSize;
+}
 
 void RibTokenizer::pushInput(std::istream& inStream, const std::string& streamName,
 		const CommentCallback& callback)
 {
-	m_inputStack.push( boost::shared_ptr<InputState>(
-				new InputState(inStream, streamName, m_currPos, m_nextPos,
-					m_nextTok, m_haveNext, m_commentCallback)) );
-	m_inBuf = &m_inputStack.top()->inBuf;
+	InputState* state = new InputState(inStream, streamName, *this);
+#	ifdef ENABLE_THREADING
+	// Split large in-memory ASCII RIB up for tokenizing in parallel.
+	if(state->inBuf.memoryData()
+			&& state->inBuf.memorySize() >= m_parallelMinSize)
+	{
+		std::vector<RibChunk> chunks;
+		if(splitRibChunks(state->inBuf.memoryData(), state->inBuf.memorySize(),
+					m_parallelChunkSize, chunks))
+		{
+			state->chunkedInput.reset(new ChunkedInput(
+					state->inBuf.memoryData(), chunks, streamName, !callback.empty()));
+		}
+	}
+#	endif
+	pushState(state, callback);
+}
+
+/// Push input from memory which is part of a larger stream.
+void RibTokenizer::pushChunk(const char* data, std::size_t size,
+		const std::string& streamName, int startLine,
+		const CommentCallback& callback)
+{
+	pushState(new InputState(data, size, streamName, startLine, *this), callback);
+}
+
+void RibTokenizer::pushState(InputState* state, const CommentCallback& callback)
+{
+	m_inputStack.push(boost::shared_ptr<InputState>(state));
+	m_inBuf = &state->inBuf;
+	m_chunkedInput = state->chunkedInput.get();
 	m_currPos = SourcePos(1,1);
 	m_nextPos = SourcePos(1,1);
 	m_haveNext = false;
@@ -115,9 +512,15 @@ void RibTokenizer::popInput()
 	// Pop the stack, and restore the buffer
 	m_inputStack.pop();
 	if(!m_inputStack.empty())
+	{
 		m_inBuf = &m_inputStack.top()->inBuf;
+		m_chunkedInput = m_inputStack.top()->chunkedInput.get();
+	}
 	else
+	{
 		m_inBuf = 0;
+		m_chunkedInput = 0;
+	}
 }
 
 std::string RibTokenizer::streamPos() const
@@ -142,6 +545,13 @@ void RibTokenizer::scanNext(RibToken& tok)
 		tok = RibToken::ENDOFFILE;
 		return;
 	}
+#	ifdef ENABLE_THREADING
+	if(m_chunkedInput)
+	{
+		m_chunkedInput->get(tok, m_nextPos, m_commentCallback);
+		return;
+	}
+#	endif
 	if(m_arrayElementsRemaining >= 0)
 	{
 		// If we're currently decoding a float array, return the next element,
@@ -354,9 +764,167 @@ void RibTokenizer::scanNext(RibToken& tok)
 	}
 }
 
+bool RibTokenizer::getFloatArrayElements(std::vector<float>& buf)
+{
+	assert(!m_haveNext);
+#	ifdef ENABLE_THREADING
+	if(m_chunkedInput)
+	{
+		if(!m_chunkedInput->getFloatArrayElements(buf, m_nextPos))
+			return false;
+		m_currPos = m_nextPos;
+		return true;
+	}
+#	endif
+	if(!m_inBuf)
+		return false;
+	if(m_arrayElementsRemaining >= 0)
+	{
+		// Binary float array; all the elements are known to be there.
+		buf.reserve(buf.size() + m_arrayElementsRemaining);
+		for(; m_arrayElementsRemaining > 0; --m_arrayElementsRemaining)
+			buf.push_back(decodeFloat32(*m_inBuf));
+		m_arrayElementsRemaining = -1;
+		m_currPos = m_inBuf->pos();
+		return true;
+	}
+	RibToken tok;
+	while(true)
+	{
+		RibInputBuffer::CharType c = m_inBuf->get();
+		m_nextPos = m_inBuf->pos();
+		switch(c)
+		{
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+				break;
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+			case '-': case '+': case '.':
+				m_inBuf->unget();
+				readNumber(*m_inBuf, tok);
+				if(tok.type() == RibToken::FLOAT)
+					buf.push_back(tok.floatVal());
+				else if(tok.type() == RibToken::INTEGER)
+					buf.push_back(tok.intVal());
+				else
+				{
+					// Leave the bad token for get() to report.
+					m_nextTok = tok;
+					m_haveNext = true;
+					return false;
+				}
+				break;
+			case ']':
+				m_currPos = m_nextPos;
+				return true;
+			default:
+				m_inBuf->unget();
+				return false;
+		}
+	}
+}
+
+namespace {
+
+const double powersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isDigit(RibInputBuffer::CharType c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/** \brief Read a simple ASCII number directly from the input buffer.
+ *
+ * Nearly all the numbers in a RIB stream are simple and lie entirely within
+ * the buffered characters, so they can be decoded without the per-character
+ * overhead of RibInputBuffer::get().  Anything out of the ordinary, including
+ * malformed numbers and numbers which run past the buffered characters, is
+ * left for readNumber() to deal with.
+ *
+ * \return true if a number was read into tok.
+ */
+bool readNumberInPlace(RibInputBuffer& inBuf, RibToken& tok)
+{
+	std::ptrdiff_t count = 0;
+	const RibInputBuffer::CharType* begin = inBuf.buffered(count);
+	const RibInputBuffer::CharType* end = begin + count;
+	const RibInputBuffer::CharType* p = begin;
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+	// Decimal digits of the mantissa, and the power of ten they're scaled by.
+	boost::uint64_t mantissa = 0;
+	int numDigits = 0;
+	int exponent = 0;
+	bool isFloat = false;
+	for(; p < end && isDigit(*p); ++p, ++numDigits)
+		mantissa = 10*mantissa + (*p - '0');
+	if(p < end && *p == '.')
+	{
+		isFloat = true;
+		for(++p; p < end && isDigit(*p); ++p, ++numDigits, --exponent)
+			mantissa = 10*mantissa + (*p - '0');
+	}
+	if(numDigits == 0 || numDigits > 18 || (!isFloat && numDigits > 9))
+		return false;
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		isFloat = true;
+		bool negativeExp = false;
+		++p;
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExp = *p == '-';
+			++p;
+		}
+		int expDigits = 0;
+		int exp = 0;
+		for(; p < end && isDigit(*p) && expDigits < 4; ++p, ++expDigits)
+			exp = 10*exp + (*p - '0');
+		if(expDigits == 0)
+			return false;
+		exponent += negativeExp ? -exp : exp;
+	}
+	// Make sure the number has ended within the buffered characters.
+	if(p == end || isDigit(*p))
+		return false;
+	if(isFloat)
+	{
+		double value = static_cast<double>(mantissa);
+		if(exponent < 0)
+			value = exponent >= -22 ? value/powersOfTen[-exponent]
+				: value*std::pow(10.0, exponent);
+		else if(exponent > 0)
+			value = exponent <= 22 ? value*powersOfTen[exponent]
+				: value*std::pow(10.0, exponent);
+		tok = static_cast<float>(negative ? -value : value);
+	}
+	else
+	{
+		int intVal = static_cast<int>(mantissa);
+		tok = negative ? -intVal : intVal;
+	}
+	inBuf.skip(p - begin);
+	return true;
+}
+
+} // unnamed namespace
+
 /// Read in an ASCII number (integer or real)
 void RibTokenizer::readNumber(RibInputBuffer& inBuf, RibToken& tok)
 {
+	if(readNumberInPlace(inBuf, tok))
+		return;
+
 	RibInputBuffer::CharType c = 0;
 	int sign = 1;
 	int intResult = 0;
@@ -474,6 +1042,7 @@ void RibTokenizer::readString(RibInputBuffer& inBuf, RibToken& tok)
 	bool stringFinished = false;
 	while(!stringFinished)
 	{
+		inBuf.getRun(stringStopChars, outString);
 		RibInputBuffer::CharType c = inBuf.get();
 		switch(c)
 		{
@@ -604,6 +1173,7 @@ void RibTokenizer::readComment(RibInputBuffer& inBuf)
 		while(c != '\n' && c != '\r' && c != RibInputBuffer::eof)
 		{
 			comment += c;
+			inBuf.getRun(commentStopChars, comment);
 			c = inBuf.get();
 		}
 		m_commentCallback(comment);
@@ -611,7 +1181,10 @@ void RibTokenizer::readComment(RibInputBuffer& inBuf)
 	else
 	{
 		while(c != '\n' && c != '\r' && c != RibInputBuffer::eof)
+		{
+			inBuf.skipRun(commentStopChars);
 			c = inBuf.get();
+		}
 	}
 	inBuf.unget();
 }
@@ -66,7 +66,15 @@ namespace Aqsis
  * std::ios_base::sync_with_stdio(false) to encourage buffering directly by the
  * C++ iostream library.  If not, bytes are likely to be read one at a time,
  * resulting in significantly poor lexer performance (measured to be
- * approximately a factor of two slower on linux/g++/amd64).
+ * approximately a factor of two slower on linux/g++/amd64).  Better still,
+ * RIB files should be opened with openRibFile() so that they're read directly
+ * from memory.
+ *
+ * Large ASCII RIB in memory is tokenized in parallel when aqsis is built with
+ * threading: the RIB is split into chunks starting with a request (see
+ * splitRibChunks()), which are tokenized ahead of time by worker threads.
+ * The tokens are delivered in order, with the same positions and comments as
+ * they would have when tokenized sequentially.
  */
 class RibTokenizer : boost::noncopyable
 {
@@ -99,6 +107,29 @@ class RibTokenizer : boost::noncopyable
 		 * using null input and will always return EOF tokens.
 		 */
 		void popInput();
+		/** \brief Set how in-memory RIB is split for tokenizing in parallel.
+		 *
+		 * Input pushed afterwards which is at least minSize characters long
+		 * is split into chunks of roughly chunkSize characters.  By default
+		 * this is 1MB chunks of input from 8MB, and only with several
+		 * processors.  The setting has no effect without threading.
+		 */
+		void setParallelChunking(std::size_t chunkSize, std::size_t minSize);
+
+		/** \brief Read the elements of a numeric array in bulk.
+		 *
+		 * This should be called directly after the ARRAY_BEGIN token of an
+		 * array has been obtained with get().  The numbers in the array up to
+		 * and including the closing ARRAY_END are read and appended to buf.
+		 * This avoids the overhead of returning each element as a separate
+		 * token, which dominates the time taken for the large arrays of
+		 * baked geometry.
+		 *
+		 * \return false if a token other than a number or ARRAY_END was
+		 * found; the elements before it are in buf, and the remainder should
+		 * be read with get().
+		 */
+		bool getFloatArrayElements(std::vector<float>& buf);
 
 		/** \brief Get the next token.
 		 * \return The next token from the input stream.
@@ -121,6 +152,12 @@ class RibTokenizer : boost::noncopyable
 	private:
 		typedef std::map<int, std::string> EncodedStringMap;
 		struct InputState;
+		class ChunkedInput;
+
+		void pushState(InputState* state, const CommentCallback& callback);
+		void pushChunk(const char* data, std::size_t size,
+				const std::string& streamName, int startLine,
+				const CommentCallback& callback);
 
 		//--------------------------------------------------
 		/// \name ASCII RIB decoding functions
@@ -152,6 +189,8 @@ class RibTokenizer : boost::noncopyable
 		// Member data
 		/// Input buffer from which characters are read.
 		RibInputBuffer* m_inBuf;
+		/// Tokens prepared in parallel for the current input, if any.
+		ChunkedInput* m_chunkedInput;
 		/// Stack of input buffers.
 		std::stack<boost::shared_ptr<InputState> > m_inputStack;
 		/// source position of previous token in input stream
@@ -173,6 +212,11 @@ class RibTokenizer : boost::noncopyable
 
 		/// Number of array elements remaining in current encoded float array.
 		int m_arrayElementsRemaining;
+
+		/// Approximate size of the chunks tokenized in parallel.
+		std::size_t m_parallelChunkSize;
+		/// Size of the smallest input which is tokenized in parallel.
+		std::size_t m_parallelMinSize;
 };
 
 
@@ -33,14 +33,22 @@
  * \author Chris Foster  [chris42f (at) gmail (dot) com]
  */
 
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <sstream>
 
 #include "ribtokenizer.h"
 
 #define BOOST_TEST_DYN_LINK
 
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream.hpp>
 #include <boost/test/auto_unit_test.hpp>
 
+#include <aqsis/riutil/ribparser.h>
+
 #define ADD_ESCAPES(x) #x
 
 #define CHECK_EOF(tokenizer) BOOST_CHECK_EQUAL(tokenizer.get(), \
@@ -445,4 +453,170 @@ BOOST_AUTO_TEST_CASE(RibTokenizer_end_of_file_test)
 	BOOST_CHECK_EQUAL(f.t.get(), RibToken(RibToken::ENDOFFILE));
 }
 
+BOOST_AUTO_TEST_CASE(RibTokenizer_number_in_place_test)
+{
+	// Simple numbers are decoded in place from memory; the rest fall back
+	// to the character by character decoding.
+	TokenizerFixture f("0.1 -2.5e-3 1e-30 +.5 -0 1. 5E2 123456789 1234567890 "
+		"12345678901234567890.0 1e ");
+	RibTokenizer& t = f.t;
+	BOOST_CHECK_EQUAL(t.get().floatVal(), 0.1f);
+	BOOST_CHECK_EQUAL(t.get().floatVal(), -2.5e-3f);
+	BOOST_CHECK_CLOSE(t.get().floatVal(), 1e-30f, 1e-4f);
+	BOOST_CHECK_EQUAL(t.get().floatVal(), 0.5f);
+	BOOST_CHECK_EQUAL(t.get(), RibToken(0));
+	BOOST_CHECK_EQUAL(t.get().floatVal(), 1.0f);
+	BOOST_CHECK_EQUAL(t.get().floatVal(), 500.0f);
+	BOOST_CHECK_EQUAL(t.get(), RibToken(123456789));
+	BOOST_CHECK_EQUAL(t.get(), RibToken(1234567890));
+	BOOST_CHECK_CLOSE(t.get().floatVal(), 12345678901234567890.0f, 1e-4f);
+	BOOST_CHECK_EQUAL(t.get().type(), RibToken::ERROR);
+	CHECK_EOF(t);
+}
+
+namespace {
+
+/// Name of a file which is removed when the object is destroyed.
+class TempRibFile
+{
+	public:
+		TempRibFile(const std::string& contents)
+			: m_fileName()
+		{
+			for(int i = 0;; ++i)
+			{
+				char name[64];
+				std::sprintf(name, "aqsis_tmpfile_%05d.rib", i);
+				if(!boost::filesystem::exists(name))
+				{
+					m_fileName = name;
+					break;
+				}
+			}
+			std::ofstream out(m_fileName.c_str(), std::ios::binary);
+			out << contents;
+		}
+		~TempRibFile()
+		{
+			boost::filesystem::remove(m_fileName);
+		}
+		const std::string& name() const
+		{
+			return m_fileName;
+		}
+	private:
+		std::string m_fileName;
+};
+
+/// Record of the tokens, positions and comments read from a tokenizer.
+struct TokenLog
+{
+	std::vector<std::string> entries;
+	void operator()(const std::string& comment)
+	{
+		entries.push_back("comment: " + comment);
+	}
+};
+
+/** Read all the tokens from a stream into a log.
+ *
+ * Numeric arrays are read with getFloatArrayElements().  Numbers are logged
+ * with the given precision.
+ */
+void readTokens(std::istream& in, std::size_t chunkSize, int precision,
+		TokenLog& log)
+{
+	RibTokenizer t;
+	if(chunkSize > 0)
+		t.setParallelChunking(chunkSize, 0);
+	t.pushInput(in, "test_stream", boost::ref(log));
+	while(true)
+	{
+		const RibToken& tok = t.get();
+		std::ostringstream entry;
+		entry << std::setprecision(precision) << tok << " at " << t.streamPos();
+		log.entries.push_back(entry.str());
+		if(tok.type() == RibToken::ENDOFFILE)
+			break;
+		if(tok.type() == RibToken::ARRAY_BEGIN)
+		{
+			std::vector<float> buf;
+			bool complete = t.getFloatArrayElements(buf);
+			std::ostringstream elements;
+			elements << std::setprecision(precision) << "elements:";
+			for(std::size_t i = 0; i < buf.size(); ++i)
+				elements << " " << buf[i];
+			if(complete)
+				elements << " ] at " << t.streamPos();
+			log.entries.push_back(elements.str());
+		}
+	}
+	t.popInput();
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(RibTokenizer_chunked_input_test)
+{
+	// The requests in strings and comments mustn't be taken as the start of
+	// a chunk, and the array with a comment and a string inside has to be
+	// read partly with get().
+	std::string block =
+		"##RenderMan RIB\n"
+		"version 3.04\n"
+		"Option \"searchpath\" \"shader\" [\"a\n"
+		"Sphere 1 -1 1 360\n"
+		"b\"]\n"
+		"# a comment which mentions\n"
+		"# Sphere 1 -1 1 360 over several lines\n"
+		"Attribute \"identifier\" \"name\" [\"x\"]   # trailing comment\n"
+		"Polygon \"P\" [0 0 0  1.5 -2.25e3 +.5  1e-30 12345678901234567890 -0.000001\n"
+		"# comment inside an array\n"
+		" 3 4 5] \"Cs\" [1 0 0]\n"
+		"Surface \"plastic\" \"Ks\" 0.5 \"string texturename\" \"tex\\\"with\\\\escapes\r\n"
+		"Sphere\"\n"
+		"PointsPolygons [3] [0 1 2] \"P\" [0 0 0 \"oops\" 1 1 1]\n"
+		"WorldEnd\n";
+	std::string rib;
+	for(int i = 0; i < 20; ++i)
+		rib += block;
+
+	// A file opened with openRibFile() is read in place from memory.  This
+	// is the reference for chunked tokenizing.
+	TempRibFile file(rib);
+	TokenLog reference;
+	{
+		boost::shared_ptr<std::istream> in = openRibFile(file.name());
+		BOOST_REQUIRE(in);
+		BOOST_REQUIRE(dynamic_cast<boost::iostreams::stream<
+				boost::iostreams::mapped_file_source>*>(in.get()));
+		readTokens(*in, 0, 9, reference);
+	}
+	BOOST_REQUIRE_GT(reference.entries.size(), 20*50U);
+
+	// Numbers which cross the end of the buffer when reading from a stream
+	// aren't decoded in place, which may change their last bits.
+	{
+		std::istringstream in(rib);
+		TokenLog stream;
+		readTokens(in, 0, 6, stream);
+		boost::shared_ptr<std::istream> memIn = openRibFile(file.name());
+		TokenLog memory;
+		readTokens(*memIn, 0, 6, memory);
+		BOOST_CHECK_EQUAL_COLLECTIONS(stream.entries.begin(), stream.entries.end(),
+				memory.entries.begin(), memory.entries.end());
+	}
+
+	// Chunked tokenizing gives exactly the same tokens for any size of chunk.
+	for(std::size_t chunkSize = 1; chunkSize < 2*block.size(); chunkSize += 13)
+	{
+		BOOST_TEST_CHECKPOINT("chunk size " << chunkSize);
+		boost::shared_ptr<std::istream> in = openRibFile(file.name());
+		TokenLog chunked;
+		readTokens(*in, chunkSize, 9, chunked);
+		BOOST_CHECK_EQUAL_COLLECTIONS(chunked.entries.begin(), chunked.entries.end(),
+				reference.entries.begin(), reference.entries.end());
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
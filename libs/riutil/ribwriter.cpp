@@ -977,10 +977,11 @@ RtVoid RibWriter<Formatter>::ReadArchive(RtConstToken name,
         boostfs::path path = findFileNothrow(name, m_archiveSearchPath);
         if(!path.empty())
         {
-            std::ifstream inputFile(native(path).c_str());
+            boost::shared_ptr<std::istream> inputFile =
+                openRibFile(native(path));
             if(inputFile)
             {
-                m_services.parseRib(inputFile, name, m_services.firstFilter());
+                m_services.parseRib(*inputFile, name, m_services.firstFilter());
                 didRead = true;
             }
         }
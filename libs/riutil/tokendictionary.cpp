@@ -149,6 +149,7 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 2, "bucketsize"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "eyesplits"),
 	CqPrimvarToken(class_uniform,  type_color,   1, "zthreshold"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "threads"),
 	// Option "searchpath"
 	CqPrimvarToken(class_uniform,  type_string,  1, "shader"),
 	CqPrimvarToken(class_uniform,  type_string,  1, "archive"),
@@ -159,8 +160,14 @@ const CqPrimvarToken standardVarsInit[] = {
 	// Option "statistics"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "endofframe"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "echoapi"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "profile"),
+	CqPrimvarToken(class_uniform,  type_string,  1, "tracefile"),
+	// Option "shader"
+	CqPrimvarToken(class_uniform,  type_string,  1, "engine"),
 	// Option "shutter"
 	CqPrimvarToken(class_uniform,  type_float,   1, "offset"),
+	// Option "trace"
+	CqPrimvarToken(class_uniform,  type_integer, 1, "rayocclusion"),
 	// Projection
 	CqPrimvarToken(class_uniform,  type_float,   1, "fov"),
 
@@ -186,12 +193,19 @@ const CqPrimvarToken standardVarsInit[] = {
 	// Hider
 	CqPrimvarToken(class_uniform,  type_integer, 1, "jitter"),
 	CqPrimvarToken(class_uniform,  type_string,  1, "depthfilter"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "gridocclusion"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "gridsampling"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "separablefilter"),
 	// Attribute "dice"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "binary"),
 	// Attribute "mpdump"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "enabled"),
 	// Attribute "derivatives"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "centered"),
+	// Attribute "visibility"
+	CqPrimvarToken(class_uniform,  type_integer, 1, "transmission"),
+	// Attribute "irradiance"
+	CqPrimvarToken(class_uniform,  type_float,   1, "shadingrate"),
 
 	//--------------------------------------------------
 	// Aqsis-specific options / attributes
@@ -0,0 +1,618 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Implements lowering of shader programs to register form, and its execution.
+*/
+
+#include "shadervm.h"
+
+#include "registerprogram.h"
+
+namespace Aqsis {
+
+/*
+ * Stack opcodes which can be lowered to register form.
+ * Stack function, register opcode, N operands, operand types, result type.
+ */
+SqRegOpTrans CqShaderVM::m_RegTransTable[] =
+    {
+        {&CqShaderVM::SO_addff, RegOp_AddFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_subff, RegOp_SubFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_mulff, RegOp_MulFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_divff, RegOp_DivFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_lsff, RegOp_LsFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_gtff, RegOp_GtFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_leff, RegOp_LeFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_geff, RegOp_GeFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_eqff, RegOp_EqFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_neff, RegOp_NeFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_land, RegOp_LAndFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_lor, RegOp_LOrFF, 2, type_float, type_float, type_float},
+        {&CqShaderVM::SO_negf, RegOp_NegF, 1, type_float, type_invalid, type_float},
+
+        {&CqShaderVM::SO_addpp, RegOp_AddPP, 2, type_point, type_point, type_point},
+        {&CqShaderVM::SO_subpp, RegOp_SubPP, 2, type_point, type_point, type_point},
+        {&CqShaderVM::SO_mulpp, RegOp_MulPP, 2, type_point, type_point, type_point},
+        {&CqShaderVM::SO_divpp, RegOp_DivPP, 2, type_point, type_point, type_point},
+        {&CqShaderVM::SO_dotpp, RegOp_DotPP, 2, type_point, type_point, type_float},
+        {&CqShaderVM::SO_crspp, RegOp_CrsPP, 2, type_point, type_point, type_point},
+        {&CqShaderVM::SO_negp, RegOp_NegP, 1, type_point, type_invalid, type_point},
+
+        {&CqShaderVM::SO_addcc, RegOp_AddCC, 2, type_color, type_color, type_color},
+        {&CqShaderVM::SO_subcc, RegOp_SubCC, 2, type_color, type_color, type_color},
+        {&CqShaderVM::SO_mulcc, RegOp_MulCC, 2, type_color, type_color, type_color},
+        {&CqShaderVM::SO_divcc, RegOp_DivCC, 2, type_color, type_color, type_color},
+        {&CqShaderVM::SO_negc, RegOp_NegC, 1, type_color, type_invalid, type_color},
+
+        {&CqShaderVM::SO_addfp, RegOp_AddFP, 2, type_float, type_point, type_point},
+        {&CqShaderVM::SO_subfp, RegOp_SubFP, 2, type_float, type_point, type_point},
+        {&CqShaderVM::SO_mulfp, RegOp_MulFP, 2, type_float, type_point, type_point},
+        {&CqShaderVM::SO_divfp, RegOp_DivFP, 2, type_float, type_point, type_point},
+
+        {&CqShaderVM::SO_addfc, RegOp_AddFC, 2, type_float, type_color, type_color},
+        {&CqShaderVM::SO_subfc, RegOp_SubFC, 2, type_float, type_color, type_color},
+        {&CqShaderVM::SO_mulfc, RegOp_MulFC, 2, type_float, type_color, type_color},
+        {&CqShaderVM::SO_divfc, RegOp_DivFC, 2, type_float, type_color, type_color},
+
+        {&CqShaderVM::SO_setfp, RegOp_SetFP, 1, type_float, type_invalid, type_point},
+        {&CqShaderVM::SO_setfc, RegOp_SetFC, 1, type_float, type_invalid, type_color},
+        {&CqShaderVM::SO_setpc, RegOp_SetPC, 1, type_point, type_invalid, type_color},
+        {&CqShaderVM::SO_setcp, RegOp_SetCP, 1, type_color, type_invalid, type_point},
+    };
+
+TqInt CqShaderVM::m_cRegTransSize = sizeof( m_RegTransTable ) / sizeof( m_RegTransTable[ 0 ] );
+
+
+namespace {
+
+/// Storage used for values of a shader variable type by the register kernels.
+enum EqRegStorage
+{
+	Storage_Float,
+	Storage_Triple,
+	Storage_Color,
+	Storage_Other,
+	Storage_Unknown
+};
+
+EqRegStorage regStorage( EqVariableType type )
+{
+	switch ( type )
+	{
+		case type_float:
+			return ( Storage_Float );
+		case type_point:
+		case type_vector:
+		case type_normal:
+			return ( Storage_Triple );
+		case type_color:
+			return ( Storage_Color );
+		default:
+			return ( Storage_Other );
+	}
+}
+
+/// Get a pointer to the values of a float operand, which may be a constant.
+inline void regOperand( const SqRegisterBlock& block, const std::vector<IqShaderData*>& regs,
+		TqInt reg, const TqFloat*& res )
+{
+	const SqRegister& r = block.m_registers[ reg ];
+	if ( r.m_kind == SqRegister::Reg_Constant )
+		res = &block.m_constants[ r.m_index ];
+	else
+		regs[ reg ] ->GetFloatPtr( res );
+}
+
+/// Get a pointer to the values of a point, vector or normal operand.
+inline void regOperand( const SqRegisterBlock& block, const std::vector<IqShaderData*>& regs,
+		TqInt reg, const CqVector3D*& res )
+{
+	regs[ reg ] ->GetPointPtr( res );
+}
+
+/// Get a pointer to the values of a color operand.
+inline void regOperand( const SqRegisterBlock& block, const std::vector<IqShaderData*>& regs,
+		TqInt reg, const CqColor*& res )
+{
+	regs[ reg ] ->GetColorPtr( res );
+}
+
+} // unnamed namespace
+
+
+//---------------------------------------------------------------------
+/** Determine if a register operand holds values of the given type.
+ *
+ * System variables are resolved only when the program runs, so they are
+ * assumed to match, as the stack opcodes assume.
+ */
+
+bool CqShaderVM::RegisterMatches( const SqRegisterBlock& block, TqInt reg, EqVariableType type ) const
+{
+	const SqRegister& r = block.m_registers[ reg ];
+	EqRegStorage storage = Storage_Unknown;
+	switch ( r.m_kind )
+	{
+		case SqRegister::Reg_Constant:
+			storage = Storage_Float;
+			break;
+		case SqRegister::Reg_Temp:
+			storage = regStorage( r.m_type );
+			break;
+		case SqRegister::Reg_Variable:
+			if ( !( r.m_index & 0x8000 ) )
+			{
+				const IqShaderData* pVar = m_LocalVars[ r.m_index ];
+				storage = pVar->isArray() ? Storage_Other : regStorage( pVar->Type() );
+			}
+			break;
+	}
+	return ( storage == Storage_Unknown || storage == regStorage( type ) );
+}
+
+
+//---------------------------------------------------------------------
+/** Lower the initialisation and main programs to register form.
+ *
+ * Each straight line run of stack bytecodes made up of variable pushes,
+ * constants, assignments and the common arithmetic and comparison opcodes is
+ * replaced by a register block, which refers to the variables directly
+ * rather than pushing them onto the stack.  Runs end at any other opcode and
+ * at jump targets, so the remaining stack opcodes execute unchanged, with
+ * any values computed for them left on the stack by the block.
+ *
+ * The blocks of both programs are kept together, so that copies of the
+ * shader share them.
+ */
+
+void CqShaderVM::LowerProgram()
+{
+	boost::shared_ptr<std::vector<SqRegisterBlock> > blocks( new std::vector<SqRegisterBlock>() );
+	LowerSegment( m_ProgramInit, *blocks );
+	LowerSegment( m_Program, *blocks );
+
+	if ( !blocks->empty() )
+		m_RegisterBlocks = blocks;
+}
+
+
+//---------------------------------------------------------------------
+/** Lower one program segment, adding its register blocks to blocks.
+ */
+
+void CqShaderVM::LowerSegment( std::vector<UsProgramElement>& program, std::vector<SqRegisterBlock>& blocks )
+{
+	TqUint size = program.size();
+
+	// Find the jump targets, which must only ever start a block.
+	std::vector<bool> jumpTargets( size + 1, false );
+	TqUint i = 0;
+	while ( i < size )
+	{
+		void ( CqShaderVM::*pCommand ) () = program[ i ].m_Command;
+		if ( pCommand == &CqShaderVM::SO_jnz ||
+		        pCommand == &CqShaderVM::SO_jmp ||
+		        pCommand == &CqShaderVM::SO_jz ||
+		        pCommand == &CqShaderVM::SO_RS_JZ ||
+		        pCommand == &CqShaderVM::SO_S_JZ )
+		{
+			// Only the labels of the main program are resolved by
+			// LoadProgram(), so leave any other segment with jumps alone.
+			if ( &program != &m_Program )
+				return;
+			jumpTargets[ program[ i + 1 ].m_Label.m_Offset ] = true;
+		}
+		i += 1 + ParamCount( pCommand );
+	}
+
+	SqRegisterBlock block;
+	std::vector<TqInt> stack;
+	TqUint start = 0;
+	i = 0;
+	while ( i < size )
+	{
+		TqInt cParams = ParamCount( program[ i ].m_Command );
+		if ( jumpTargets[ i ] )
+		{
+			CloseRegisterBlock( program, blocks, block, stack, start, i );
+			start = i;
+		}
+		if ( !LowerInstruction( program, block, stack, i ) )
+		{
+			CloseRegisterBlock( program, blocks, block, stack, start, i );
+			start = i + 1 + cParams;
+		}
+		i += 1 + cParams;
+	}
+	CloseRegisterBlock( program, blocks, block, stack, start, size );
+}
+
+
+//---------------------------------------------------------------------
+/** Add the stack opcode at the given offset of a program to a register block.
+ * \return false if the opcode cannot be lowered.
+ */
+
+bool CqShaderVM::LowerInstruction( const std::vector<UsProgramElement>& program, SqRegisterBlock& block,
+		std::vector<TqInt>& stack, TqUint offset )
+{
+	void ( CqShaderVM::*pCommand ) () = program[ offset ].m_Command;
+	SqRegister reg;
+	reg.m_type = type_invalid;
+
+	if ( pCommand == &CqShaderVM::SO_nop )
+		return ( true );
+
+	if ( pCommand == &CqShaderVM::SO_pushv )
+	{
+		reg.m_kind = SqRegister::Reg_Variable;
+		reg.m_index = program[ offset + 1 ].m_iVariable;
+		stack.push_back( block.m_registers.size() );
+		block.m_registers.push_back( reg );
+		return ( true );
+	}
+
+	if ( pCommand == &CqShaderVM::SO_pushif )
+	{
+		reg.m_kind = SqRegister::Reg_Constant;
+		reg.m_index = block.m_constants.size();
+		block.m_constants.push_back( program[ offset + 1 ].m_FloatVal );
+		stack.push_back( block.m_registers.size() );
+		block.m_registers.push_back( reg );
+		return ( true );
+	}
+
+	if ( pCommand == &CqShaderVM::SO_drop )
+	{
+		if ( stack.empty() )
+			return ( false );
+		stack.pop_back();
+		return ( true );
+	}
+
+	SqRegInstr instr;
+	if ( pCommand == &CqShaderVM::SO_pop )
+	{
+		TqInt iVar = program[ offset + 1 ].m_iVariable;
+		if ( stack.empty() ||
+		        ( !( iVar & 0x8000 ) && m_LocalVars[ iVar ] ->isArray() ) )
+			return ( false );
+		reg.m_kind = SqRegister::Reg_Variable;
+		reg.m_index = iVar;
+		instr.m_op = RegOp_Store;
+		instr.m_dst = block.m_registers.size();
+		instr.m_a = stack.back();
+		instr.m_b = -1;
+		block.m_registers.push_back( reg );
+		block.m_instrs.push_back( instr );
+		stack.pop_back();
+		return ( true );
+	}
+
+	TqInt op;
+	for ( op = 0; op < m_cRegTransSize; op++ )
+		if ( m_RegTransTable[ op ].m_pCommand == pCommand )
+			break;
+	if ( op == m_cRegTransSize )
+		return ( false );
+
+	const SqRegOpTrans& trans = m_RegTransTable[ op ];
+	if ( stack.size() < static_cast<TqUint>( trans.m_cOperands ) )
+		return ( false );
+	instr.m_op = trans.m_op;
+	instr.m_a = stack.back();
+	instr.m_b = trans.m_cOperands > 1 ? stack[ stack.size() - 2 ] : -1;
+	if ( !RegisterMatches( block, instr.m_a, trans.m_aType ) ||
+	        ( instr.m_b >= 0 && !RegisterMatches( block, instr.m_b, trans.m_bType ) ) )
+		return ( false );
+
+	reg.m_kind = SqRegister::Reg_Temp;
+	reg.m_index = 0;
+	reg.m_type = trans.m_resultType;
+	instr.m_dst = block.m_registers.size();
+	block.m_registers.push_back( reg );
+	block.m_instrs.push_back( instr );
+	stack.resize( stack.size() - trans.m_cOperands );
+	stack.push_back( instr.m_dst );
+	return ( true );
+}
+
+
+//---------------------------------------------------------------------
+/** Finish the register block being built, replacing the program elements
+ * from start to end with it if it does any work.
+ */
+
+void CqShaderVM::CloseRegisterBlock( std::vector<UsProgramElement>& program, std::vector<SqRegisterBlock>& blocks,
+		SqRegisterBlock& block, std::vector<TqInt>& stack, TqUint start, TqUint end )
+{
+	if ( !block.m_instrs.empty() )
+	{
+		assert( end - start >= 2 );
+		block.m_results = stack;
+		block.m_length = end - start;
+		program[ start ].m_Command = &CqShaderVM::SO_regblock;
+		program[ start + 1 ].m_intVal = blocks.size();
+		blocks.push_back( block );
+	}
+	block = SqRegisterBlock();
+	stack.clear();
+}
+
+
+//---------------------------------------------------------------------
+/** Get the number of program elements following the given opcode.
+ */
+
+TqInt CqShaderVM::ParamCount( void ( CqShaderVM::*pCommand ) () )
+{
+	for ( TqInt i = 0; i < m_cTransSize; i++ )
+		if ( m_TransTable[ i ].m_pCommand == pCommand )
+			return ( m_TransTable[ i ].m_cParams );
+	return ( 0 );
+}
+
+
+//---------------------------------------------------------------------
+/** Execute a register block.
+ */
+
+void CqShaderVM::SO_regblock()
+{
+	const SqRegisterBlock& block = ( *m_RegisterBlocks ) [ ReadNext().m_intVal ];
+
+	std::vector<IqShaderData*>& regs = m_RegisterFile;
+	regs.assign( block.m_registers.size(), 0 );
+	TqUint r;
+	for ( r = 0; r < block.m_registers.size(); r++ )
+	{
+		if ( block.m_registers[ r ].m_kind == SqRegister::Reg_Variable )
+			regs[ r ] = GetVar( block.m_registers[ r ].m_index );
+	}
+
+	bool fRunning = m_pEnv->IsRunning();
+	const CqBitVector& RS = m_pEnv->RunningState();
+	// Use the unmasked kernels if every shading point is running.
+	const CqBitVector* pMask = ( RS.Count() == RS.Size() ) ? 0 : &RS;
+
+	std::vector<SqRegInstr>::const_iterator instr;
+	for ( instr = block.m_instrs.begin(); instr != block.m_instrs.end(); ++instr )
+	{
+		if ( instr->m_op == RegOp_Store )
+		{
+			if ( fRunning )
+				StoreRegister( block, *instr, pMask );
+			continue;
+		}
+
+		const SqRegister& a = block.m_registers[ instr->m_a ];
+		bool fAVar = a.m_kind != SqRegister::Reg_Constant && regs[ instr->m_a ] ->Size() > 1;
+		bool fBVar = false;
+		if ( instr->m_b >= 0 )
+		{
+			const SqRegister& b = block.m_registers[ instr->m_b ];
+			fBVar = b.m_kind != SqRegister::Reg_Constant && regs[ instr->m_b ] ->Size() > 1;
+		}
+		IqShaderData* pResult = GetNextTemp( block.m_registers[ instr->m_dst ].m_type,
+		                                     ( fAVar || fBVar ) ? class_varying : class_uniform );
+		pResult->SetSize( m_shadingPointCount );
+		regs[ instr->m_dst ] = pResult;
+		if ( !fRunning )
+			continue;
+
+		TqInt n = fAVar ? regs[ instr->m_a ] ->Size() : ( fBVar ? regs[ instr->m_b ] ->Size() : 1 );
+
+#define	REG_BINARY(KERNEL, A, B, R) \
+			{ \
+				const A* pA; \
+				const B* pB; \
+				R* pR; \
+				regOperand( block, regs, instr->m_a, pA ); \
+				regOperand( block, regs, instr->m_b, pB ); \
+				pResult->GetValuePtr( pR ); \
+				KERNEL( pA, fAVar, pB, fBVar, pR, n, pMask ); \
+			} \
+			break;
+#define	REG_UNARY(KERNEL, A, R) \
+			{ \
+				const A* pA; \
+				R* pR; \
+				regOperand( block, regs, instr->m_a, pA ); \
+				pResult->GetValuePtr( pR ); \
+				KERNEL( pA, fAVar, pR, n, pMask ); \
+			} \
+			break;
+
+		switch ( instr->m_op )
+		{
+				case RegOp_AddFF:	REG_BINARY( RegOpADD, TqFloat, TqFloat, TqFloat )
+				case RegOp_SubFF:	REG_BINARY( RegOpSUB, TqFloat, TqFloat, TqFloat )
+				case RegOp_MulFF:	REG_BINARY( RegOpMUL, TqFloat, TqFloat, TqFloat )
+				case RegOp_DivFF:	REG_BINARY( RegOpDIV, TqFloat, TqFloat, TqFloat )
+				case RegOp_LsFF:	REG_BINARY( RegOpLSS, TqFloat, TqFloat, TqFloat )
+				case RegOp_GtFF:	REG_BINARY( RegOpGRT, TqFloat, TqFloat, TqFloat )
+				case RegOp_LeFF:	REG_BINARY( RegOpLE, TqFloat, TqFloat, TqFloat )
+				case RegOp_GeFF:	REG_BINARY( RegOpGE, TqFloat, TqFloat, TqFloat )
+				case RegOp_EqFF:	REG_BINARY( RegOpEQ, TqFloat, TqFloat, TqFloat )
+				case RegOp_NeFF:	REG_BINARY( RegOpNE, TqFloat, TqFloat, TqFloat )
+				case RegOp_LAndFF:	REG_BINARY( RegOpLAND, TqFloat, TqFloat, TqFloat )
+				case RegOp_LOrFF:	REG_BINARY( RegOpLOR, TqFloat, TqFloat, TqFloat )
+				case RegOp_NegF:	REG_UNARY( RegOpNEG, TqFloat, TqFloat )
+
+				case RegOp_AddPP:	REG_BINARY( RegOpADD, CqVector3D, CqVector3D, CqVector3D )
+				case RegOp_SubPP:	REG_BINARY( RegOpSUB, CqVector3D, CqVector3D, CqVector3D )
+				case RegOp_MulPP:	REG_BINARY( RegOpMULV, CqVector3D, CqVector3D, CqVector3D )
+				case RegOp_DivPP:	REG_BINARY( RegOpDIV, CqVector3D, CqVector3D, CqVector3D )
+				case RegOp_DotPP:	REG_BINARY( RegOpMUL, CqVector3D, CqVector3D, TqFloat )
+				case RegOp_CrsPP:	REG_BINARY( RegOpCRS, CqVector3D, CqVector3D, CqVector3D )
+				case RegOp_NegP:	REG_UNARY( RegOpNEG, CqVector3D, CqVector3D )
+
+				case RegOp_AddCC:	REG_BINARY( RegOpADD, CqColor, CqColor, CqColor )
+				case RegOp_SubCC:	REG_BINARY( RegOpSUB, CqColor, CqColor, CqColor )
+				case RegOp_MulCC:	REG_BINARY( RegOpMUL, CqColor, CqColor, CqColor )
+				case RegOp_DivCC:	REG_BINARY( RegOpDIV, CqColor, CqColor, CqColor )
+				case RegOp_NegC:	REG_UNARY( RegOpNEG, CqColor, CqColor )
+
+				case RegOp_AddFP:	REG_BINARY( RegOpADD, TqFloat, CqVector3D, CqVector3D )
+				case RegOp_SubFP:	REG_BINARY( RegOpSUB, TqFloat, CqVector3D, CqVector3D )
+				case RegOp_MulFP:	REG_BINARY( RegOpMUL, TqFloat, CqVector3D, CqVector3D )
+				case RegOp_DivFP:	REG_BINARY( RegOpDIV, TqFloat, CqVector3D, CqVector3D )
+
+				case RegOp_AddFC:	REG_BINARY( RegOpADD, TqFloat, CqColor, CqColor )
+				case RegOp_SubFC:	REG_BINARY( RegOpSUB, TqFloat, CqColor, CqColor )
+				case RegOp_MulFC:	REG_BINARY( RegOpMUL, TqFloat, CqColor, CqColor )
+				case RegOp_DivFC:	REG_BINARY( RegOpDIV, TqFloat, CqColor, CqColor )
+
+				case RegOp_SetFP:	REG_UNARY( RegOpCAST, TqFloat, CqVector3D )
+				case RegOp_SetFC:	REG_UNARY( RegOpCAST, TqFloat, CqColor )
+				case RegOp_SetPC:	REG_UNARY( RegOpCAST, CqVector3D, CqColor )
+				case RegOp_SetCP:	REG_UNARY( RegOpCAST, CqColor, CqVector3D )
+
+				default:
+				assert( false );
+				break;
+		}
+
+#undef	REG_BINARY
+#undef	REG_UNARY
+	}
+
+	// Leave the values still required on the stack, as the stack opcodes
+	// would have done...
+	std::vector<TqInt>::const_iterator res;
+	for ( res = block.m_results.begin(); res != block.m_results.end(); ++res )
+	{
+		const SqRegister& reg = block.m_registers[ *res ];
+		switch ( reg.m_kind )
+		{
+				case SqRegister::Reg_Variable:
+				PushV( regs[ *res ] );
+				break;
+				case SqRegister::Reg_Constant:
+				{
+					IqShaderData* pResult = GetNextTemp( type_float, class_uniform );
+					pResult->SetFloat( block.m_constants[ reg.m_index ] );
+					Push( pResult );
+				}
+				break;
+				case SqRegister::Reg_Temp:
+				Push( regs[ *res ] );
+				regs[ *res ] = 0;
+				break;
+		}
+	}
+	// ...and return the rest of the temporaries to the pools.
+	for ( r = 0; r < block.m_registers.size(); r++ )
+	{
+		if ( block.m_registers[ r ].m_kind == SqRegister::Reg_Temp && regs[ r ] )
+		{
+			SqStackEntry temp;
+			temp.m_IsTemp = true;
+			temp.m_Data = regs[ r ];
+			Release( temp );
+		}
+	}
+
+	// Skip the rest of the stack bytecodes replaced by the block.
+	m_PC += block.m_length - 2;
+	m_PO += block.m_length - 2;
+}
+
+
+//---------------------------------------------------------------------
+/** Execute a register store, the equivalent of the pop opcode.
+ */
+
+void CqShaderVM::StoreRegister( const SqRegisterBlock& block, const SqRegInstr& instr, const CqBitVector* pMask )
+{
+	std::vector<IqShaderData*>& regs = m_RegisterFile;
+	IqShaderData* pDst = regs[ instr.m_dst ];
+	const SqRegister& src = block.m_registers[ instr.m_a ];
+	bool fConstant = src.m_kind == SqRegister::Reg_Constant;
+	IqShaderData* pSrc = regs[ instr.m_a ];
+
+	EqRegStorage storage = regStorage( pDst->Type() );
+	if ( storage != Storage_Other && !pDst->isArray() &&
+	        storage == ( fConstant ? Storage_Float : regStorage( pSrc->Type() ) ) )
+	{
+		bool fSrcVar = !fConstant && pSrc->Size() > 1;
+		bool fDstVar = pDst->Size() > 1;
+		TqInt n = pDst->Size();
+		switch ( storage )
+		{
+				case Storage_Float:
+				{
+					const TqFloat* pA;
+					TqFloat* pR;
+					regOperand( block, regs, instr.m_a, pA );
+					pDst->GetFloatPtr( pR );
+					RegOpSTORE( pA, fSrcVar, pR, fDstVar, n, pMask );
+				}
+				break;
+				case Storage_Triple:
+				{
+					const CqVector3D* pA;
+					CqVector3D* pR;
+					regOperand( block, regs, instr.m_a, pA );
+					pDst->GetPointPtr( pR );
+					RegOpSTORE( pA, fSrcVar, pR, fDstVar, n, pMask );
+				}
+				break;
+				case Storage_Color:
+				{
+					const CqColor* pA;
+					CqColor* pR;
+					regOperand( block, regs, instr.m_a, pA );
+					pDst->GetColorPtr( pR );
+					RegOpSTORE( pA, fSrcVar, pR, fDstVar, n, pMask );
+				}
+				break;
+				default:
+				break;
+		}
+		return;
+	}
+
+	// Conversions between types are left to the variables, exactly as the
+	// pop opcode does.
+	SqStackEntry temp;
+	temp.m_IsTemp = fConstant;
+	temp.m_Data = pSrc;
+	if ( fConstant )
+	{
+		temp.m_Data = GetNextTemp( type_float, class_uniform );
+		temp.m_Data->SetFloat( block.m_constants[ src.m_index ] );
+	}
+	TqUint ext = max( m_pEnv->shadingPointCount(), pDst->Size() );
+	bool fVarying = ext > 1;
+	const CqBitVector& RS = m_pEnv->RunningState();
+	for ( TqUint i = 0; i < ext; i++ )
+	{
+		if ( !fVarying || RS.Value( i ) )
+			pDst->SetValueFromVariable( temp.m_Data, i );
+	}
+	if ( fConstant )
+		Release( temp );
+}
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
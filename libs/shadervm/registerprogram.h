@@ -0,0 +1,337 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares the register form of shader programs used by CqShaderVM.
+*/
+
+//? Is .h included already?
+#ifndef REGISTERPROGRAM_H_INCLUDED
+#define REGISTERPROGRAM_H_INCLUDED 1
+
+#include	<vector>
+
+#include	<aqsis/aqsis.h>
+
+#include	<aqsis/util/bitvector.h>
+#include	<aqsis/shadervm/ishaderdata.h>
+#include	"shaderstack.h"
+#include	"simdkernels.h"
+
+namespace Aqsis {
+
+//----------------------------------------------------------------------
+/** \enum EqRegOpCode
+ * Opcodes of the register form of a shader program.
+ *
+ * Each opcode is specialised by the types of its operands, so that the
+ * kernel used to execute it can address the operand storage directly.  The
+ * suffixes follow the stack opcodes they replace; for binary opcodes the
+ * first operand is the one which was on the top of the stack.
+ */
+enum EqRegOpCode
+{
+	RegOp_AddFF,
+	RegOp_SubFF,
+	RegOp_MulFF,
+	RegOp_DivFF,
+	RegOp_LsFF,
+	RegOp_GtFF,
+	RegOp_LeFF,
+	RegOp_GeFF,
+	RegOp_EqFF,
+	RegOp_NeFF,
+	RegOp_LAndFF,
+	RegOp_LOrFF,
+	RegOp_NegF,
+
+	RegOp_AddPP,
+	RegOp_SubPP,
+	RegOp_MulPP,
+	RegOp_DivPP,
+	RegOp_DotPP,
+	RegOp_CrsPP,
+	RegOp_NegP,
+
+	RegOp_AddCC,
+	RegOp_SubCC,
+	RegOp_MulCC,
+	RegOp_DivCC,
+	RegOp_NegC,
+
+	RegOp_AddFP,
+	RegOp_SubFP,
+	RegOp_MulFP,
+	RegOp_DivFP,
+
+	RegOp_AddFC,
+	RegOp_SubFC,
+	RegOp_MulFC,
+	RegOp_DivFC,
+
+	RegOp_SetFP,
+	RegOp_SetFC,
+	RegOp_SetPC,
+	RegOp_SetCP,
+
+	RegOp_Store		///< Assign the operand to the destination variable.
+};
+
+//----------------------------------------------------------------------
+/** \struct SqRegister
+ * Description of a register of a register block.
+ *
+ * Registers refer either to a shader variable, to a float constant held in
+ * the block, or to a temporary result which is taken from the shader stack
+ * temporary pools when the block is executed.
+ */
+struct SqRegister
+{
+	enum EqKind
+	{
+		Reg_Variable,
+		Reg_Constant,
+		Reg_Temp
+	};
+
+	EqKind	m_kind;
+	TqInt	m_index;		///< Variable index (top bit indicates system variable), or constant index.
+	EqVariableType	m_type;	///< Type of a temporary result.
+};
+
+//----------------------------------------------------------------------
+/** \struct SqRegInstr
+ * A single three address instruction of a register block.
+ */
+struct SqRegInstr
+{
+	EqRegOpCode	m_op;
+	TqInt	m_dst;		///< Register receiving the result.
+	TqInt	m_a;		///< First operand register.
+	TqInt	m_b;		///< Second operand register, or -1 for unary opcodes.
+};
+
+//----------------------------------------------------------------------
+/** \struct SqRegisterBlock
+ * A straight line run of stack bytecodes lowered to register form.
+ *
+ * A register block replaces a run of program elements which contains no
+ * jump targets.  The first element of the run is replaced by the SO_regblock
+ * opcode and the second by the index of the block, while the rest are
+ * skipped over when the block has executed.
+ */
+struct SqRegisterBlock
+{
+	std::vector<SqRegister>	m_registers;
+	std::vector<SqRegInstr>	m_instrs;
+	std::vector<TqFloat>	m_constants;
+	std::vector<TqInt>		m_results;	///< Registers left on the stack, in push order.
+	TqInt	m_length;					///< Number of program elements replaced.
+};
+
+//----------------------------------------------------------------------
+// Register kernels.
+//
+// These operate directly on the storage of the operands.  A null mask means
+// that all shading points are running, and selects the unmasked loops.  The
+// varying arithmetic is handed to the vectorised kernels of simdkernels.h
+// where there is one for the operand types.
+
+// OP The operator to use.
+// NAME The name to give the kernel.
+// A, B The operand types, R the result type.
+// n The number of elements of the varying operand(s).
+
+#define RegOpABR(OP, NAME) \
+		template <class A, class B, class R>	\
+		inline void	RegOp##NAME( const A* pA, bool fAVar, const B* pB, bool fBVar, R* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			TqInt i; \
+			if( ( fAVar || fBVar ) && SimdOp##NAME( pA, fAVar, pB, fBVar, pR, n, pMask ) ) \
+				return; \
+			if( fAVar && fBVar ) \
+			{ \
+				if( pMask ) \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						if ( pMask->Value( i ) ) \
+							pR[ i ] = ( pA[ i ] OP pB[ i ] ); \
+				} \
+				else \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						pR[ i ] = ( pA[ i ] OP pB[ i ] ); \
+				} \
+			} \
+			else if( fAVar ) \
+			{ \
+				const B vB = *pB; \
+				if( pMask ) \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						if ( pMask->Value( i ) ) \
+							pR[ i ] = ( pA[ i ] OP vB ); \
+				} \
+				else \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						pR[ i ] = ( pA[ i ] OP vB ); \
+				} \
+			} \
+			else if( fBVar ) \
+			{ \
+				const A vA = *pA; \
+				if( pMask ) \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						if ( pMask->Value( i ) ) \
+							pR[ i ] = ( vA OP pB[ i ] ); \
+				} \
+				else \
+				{ \
+					for ( i = 0; i < n; i++ ) \
+						pR[ i ] = ( vA OP pB[ i ] ); \
+				} \
+			} \
+			else \
+			{ \
+				*pR = ( *pA OP *pB ); \
+			} \
+		}
+
+RegOpABR( +, ADD )
+RegOpABR( -, SUB )
+RegOpABR( *, MUL )
+RegOpABR( /, DIV )
+RegOpABR( %, CRS )
+RegOpABR( <, LSS )
+RegOpABR( >, GRT )
+RegOpABR( <=, LE )
+RegOpABR( >=, GE )
+RegOpABR( ==, EQ )
+RegOpABR( !=, NE )
+RegOpABR( &&, LAND )
+RegOpABR( ||, LOR )
+
+/** Special case vector multiplication, which is done componentwise.
+ */
+inline CqVector3D RegMulV( const CqVector3D& a, const CqVector3D& b )
+{
+	return ( CqVector3D( a.x() * b.x(), a.y() * b.y(), a.z() * b.z() ) );
+}
+
+inline void	RegOpMULV( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar,
+		CqVector3D* pR, TqInt n, const CqBitVector* pMask )
+{
+	if( fAVar || fBVar )
+		SimdOpMULV( pA, fAVar, pB, fBVar, pR, n, pMask );
+	else
+		*pR = RegMulV( *pA, *pB );
+}
+
+/** Negate a float, point or color operand.
+ */
+template <class A>
+inline void	RegOpNEG( const A* pA, bool fAVar, A* pR, TqInt n, const CqBitVector* pMask )
+{
+	TqInt i;
+	if( !fAVar )
+		*pR = -( *pA );
+	else if( pMask )
+	{
+		for ( i = 0; i < n; i++ )
+			if ( pMask->Value( i ) )
+				pR[ i ] = -pA[ i ];
+	}
+	else
+	{
+		for ( i = 0; i < n; i++ )
+			pR[ i ] = -pA[ i ];
+	}
+}
+
+/** Cast an operand to another type, as the set* opcodes do.
+ */
+template <class A, class R>
+inline void	RegOpCAST( const A* pA, bool fAVar, R* pR, TqInt n, const CqBitVector* pMask )
+{
+	TqInt i;
+	if( !fAVar )
+		*pR = detail::castShaderVar<A, R>( *pA );
+	else if( pMask )
+	{
+		for ( i = 0; i < n; i++ )
+			if ( pMask->Value( i ) )
+				pR[ i ] = detail::castShaderVar<A, R>( pA[ i ] );
+	}
+	else
+	{
+		for ( i = 0; i < n; i++ )
+			pR[ i ] = detail::castShaderVar<A, R>( pA[ i ] );
+	}
+}
+
+/** Assign an operand to a variable of the same storage type.
+ *
+ * A uniform destination takes the first element of the operand, in the same
+ * way as CqShaderVariableUniform::SetValueFromVariable().
+ */
+template <class T>
+inline void	RegOpSTORE( const T* pA, bool fAVar, T* pR, bool fRVar, TqInt n, const CqBitVector* pMask )
+{
+	TqInt i;
+	if( !fRVar )
+		*pR = *pA;
+	else if( fAVar )
+	{
+		if( pMask )
+		{
+			for ( i = 0; i < n; i++ )
+				if ( pMask->Value( i ) )
+					pR[ i ] = pA[ i ];
+		}
+		else
+		{
+			for ( i = 0; i < n; i++ )
+				pR[ i ] = pA[ i ];
+		}
+	}
+	else
+	{
+		const T vA = *pA;
+		if( pMask )
+		{
+			for ( i = 0; i < n; i++ )
+				if ( pMask->Value( i ) )
+					pR[ i ] = vA;
+		}
+		else
+		{
+			for ( i = 0; i < n; i++ )
+				pR[ i ] = vA;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
+
+#endif	// !REGISTERPROGRAM_H_INCLUDED
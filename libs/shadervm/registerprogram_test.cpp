@@ -0,0 +1,351 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests comparing the register and stack shader engines.
+ */
+
+#include "shadervm.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+/// Renderer context which only knows about Option "shader" "engine".
+class CqEngineRenderer : public IqRenderer
+{
+	public:
+		CqEngineRenderer(const char* engine) : m_engine(engine) {}
+
+		virtual	const CqString* GetStringOption( const char* strName, const char* strParam ) const
+		{
+			if ( std::string(strName) == "shader" && std::string(strParam) == "engine" )
+				return &m_engine;
+			return 0;
+		}
+
+		virtual	bool matSpaceToSpace( const char*, const char*, const IqTransform*, const IqTransform*, TqFloat, CqMatrix& ) { return false; }
+		virtual	bool matVSpaceToSpace( const char*, const char*, const IqTransform*, const IqTransform*, TqFloat, CqMatrix& ) { return false; }
+		virtual	bool matNSpaceToSpace( const char*, const char*, const IqTransform*, const IqTransform*, TqFloat, CqMatrix& ) { return false; }
+		virtual	const TqFloat* GetFloatOption( const char*, const char* ) const { return 0; }
+		virtual	const TqInt* GetIntegerOption( const char*, const char* ) const { return 0; }
+		virtual	const CqVector3D* GetPointOption( const char*, const char* ) const { return 0; }
+		virtual	const CqColor* GetColorOption( const char*, const char* ) const { return 0; }
+		virtual	TqFloat* GetFloatOptionWrite( const char*, const char* ) { return 0; }
+		virtual	TqInt* GetIntegerOptionWrite( const char*, const char* ) { return 0; }
+		virtual	CqString* GetStringOptionWrite( const char*, const char* ) { return 0; }
+		virtual	CqVector3D* GetPointOptionWrite( const char*, const char* ) { return 0; }
+		virtual	CqColor* GetColorOptionWrite( const char*, const char* ) { return 0; }
+		virtual	void PrintString( const char* ) {}
+		virtual	IqTextureCache& textureCache() { throw std::logic_error("no texture cache"); }
+		virtual	IqTextureMapOld* GetEnvironmentMap( const CqString& ) { return 0; }
+		virtual	IqTextureMapOld* GetOcclusionMap( const CqString& ) { return 0; }
+		virtual	IqTextureMapOld* GetLatLongMap( const CqString& ) { return 0; }
+		virtual	IqRaytrace* pRaytracer() const { return 0; }
+		virtual	bool GetBasisMatrix( CqMatrix&, const CqString& ) { return false; }
+		virtual TqInt RegisterOutputData( const char* ) { return -1; }
+		virtual TqInt OutputDataIndex( const char* ) { return -1; }
+		virtual TqInt OutputDataSamples( const char* ) { return 0; }
+		virtual	void SetCurrentFrame( TqInt ) {}
+		virtual	TqInt CurrentFrame() const { return 0; }
+		virtual	TqFloat Time() const { return 0; }
+		virtual	bool IsWorldBegin() const { return true; }
+
+	private:
+		CqString m_engine;
+};
+
+/// A stack opcode which the register engine lowers.
+struct SqLoweredOp
+{
+	const char* name;
+	char aType;		///< Type of the operand on the top of the stack: f, p or c.
+	char bType;		///< Type of the second operand, or 0 for unary opcodes.
+	char resultType;
+};
+
+const SqLoweredOp loweredOps[] = {
+	{"addff", 'f', 'f', 'f'}, {"subff", 'f', 'f', 'f'}, {"mulff", 'f', 'f', 'f'},
+	{"divff", 'f', 'f', 'f'}, {"lsff", 'f', 'f', 'f'}, {"gtff", 'f', 'f', 'f'},
+	{"leff", 'f', 'f', 'f'}, {"geff", 'f', 'f', 'f'}, {"eqff", 'f', 'f', 'f'},
+	{"neff", 'f', 'f', 'f'}, {"land", 'f', 'f', 'f'}, {"lor", 'f', 'f', 'f'},
+	{"negf", 'f', 0, 'f'},
+	{"addpp", 'p', 'p', 'p'}, {"subpp", 'p', 'p', 'p'}, {"mulpp", 'p', 'p', 'p'},
+	{"divpp", 'p', 'p', 'p'}, {"dotpp", 'p', 'p', 'f'}, {"crspp", 'p', 'p', 'p'},
+	{"negp", 'p', 0, 'p'},
+	{"addcc", 'c', 'c', 'c'}, {"subcc", 'c', 'c', 'c'}, {"mulcc", 'c', 'c', 'c'},
+	{"divcc", 'c', 'c', 'c'}, {"negc", 'c', 0, 'c'},
+	{"addfp", 'f', 'p', 'p'}, {"subfp", 'f', 'p', 'p'}, {"mulfp", 'f', 'p', 'p'},
+	{"divfp", 'f', 'p', 'p'},
+	{"addfc", 'f', 'c', 'c'}, {"subfc", 'f', 'c', 'c'}, {"mulfc", 'f', 'c', 'c'},
+	{"divfc", 'f', 'c', 'c'},
+	{"setfp", 'f', 0, 'p'}, {"setfc", 'f', 0, 'c'}, {"setpc", 'p', 0, 'c'},
+	{"setcp", 'c', 0, 'p'},
+};
+const TqInt numLoweredOps = sizeof(loweredOps)/sizeof(loweredOps[0]);
+
+/// Operand variations: both varying, first uniform, second uniform, and
+/// second a constant (floats only).
+const char* const variants[] = {"vv", "uv", "vu", "vk"};
+const TqInt numVariants = 4;
+
+const TqInt numPoints = 37;
+
+const char* typeName(char type)
+{
+	switch(type)
+	{
+		case 'p': return "point";
+		case 'c': return "color";
+		default: return "float";
+	}
+}
+
+std::string resultName(const char* prefix, TqInt op, TqInt variant)
+{
+	std::ostringstream name;
+	name << prefix << op << variants[variant];
+	return name.str();
+}
+
+bool hasVariant(const SqLoweredOp& op, TqInt variant)
+{
+	if(variant == 3)
+		return op.bType == 'f';
+	return op.bType || variant < 2;
+}
+
+/// Emit the code for every lowered opcode, storing into results named with
+/// the given prefix.
+void emitOps(std::ostream& out, const char* prefix)
+{
+	for(TqInt op = 0; op < numLoweredOps; ++op)
+	{
+		const SqLoweredOp& o = loweredOps[op];
+		for(TqInt v = 0; v < numVariants; ++v)
+		{
+			if(!hasVariant(o, v))
+				continue;
+			if(o.bType)
+			{
+				if(v == 3)
+					out << "\tpushif 1.75\n";
+				else
+					out << "\tpushv " << o.bType << (v == 2 ? "u" : "b") << "\n";
+			}
+			out << "\tpushv " << o.aType << (v == 1 ? "u" : "a") << "\n"
+				<< "\t" << o.name << "\n"
+				<< "\tpop " << resultName(prefix, op, v) << "\n";
+		}
+	}
+}
+
+/** Build a program running every lowered opcode on varying, uniform and
+ * constant operands, once with all points running and once inside a
+ * conditional which masks some of them off.
+ */
+std::string testProgram()
+{
+	std::ostringstream out;
+	out << "surface\nAQSIS_V 2\n\n\nsegment Data\n\nUSES 0\n\n"
+		<< "param uniform float iu\n";
+	const char types[] = {'f', 'p', 'c'};
+	for(TqInt t = 0; t < 3; ++t)
+	{
+		out << "varying " << typeName(types[t]) << " " << types[t] << "a\n"
+			<< "varying " << typeName(types[t]) << " " << types[t] << "b\n"
+			<< "uniform " << typeName(types[t]) << " " << types[t] << "u\n";
+	}
+	for(TqInt op = 0; op < numLoweredOps; ++op)
+	{
+		for(TqInt v = 0; v < numVariants; ++v)
+		{
+			if(!hasVariant(loweredOps[op], v))
+				continue;
+			const char* type = typeName(loweredOps[op].resultType);
+			out << "varying " << type << " " << resultName("r", op, v) << "\n"
+				<< "varying " << type << " " << resultName("m", op, v) << "\n";
+		}
+	}
+
+	// The initialisation program is lowered too.
+	out << "\n\nsegment Init\n"
+		<< "\tpushif 2\n\tpushif 3\n\tmulff\n\tpushif 0.5\n\taddff\n\tpop iu\n";
+
+	out << "\n\nsegment Code\n";
+	emitOps(out, "r");
+	// Give the masked results a known value at the points which are off.
+	for(TqInt op = 0; op < numLoweredOps; ++op)
+	{
+		for(TqInt v = 0; v < numVariants; ++v)
+		{
+			if(!hasVariant(loweredOps[op], v))
+				continue;
+			out << "\tpushif 7\n";
+			if(loweredOps[op].resultType == 'p')
+				out << "\tsetfp\n";
+			else if(loweredOps[op].resultType == 'c')
+				out << "\tsetfc\n";
+			out << "\tpop " << resultName("m", op, v) << "\n";
+		}
+	}
+	out << "\tS_CLEAR\n\tpushif 0\n\tpushv fa\n\tgtff\n\tS_GET\n"
+		<< "\tRS_PUSH\n\tRS_GET\n\tRS_JZ 0\n";
+	emitOps(out, "m");
+	out << ":0\n\tRS_POP\n";
+	return out.str();
+}
+
+/// Load the test program with the given engine and run it.
+struct SqTestShader
+{
+	CqEngineRenderer renderer;
+	boost::shared_ptr<IqShader> shader;
+	boost::shared_ptr<CqShaderExecEnv> env;
+
+	SqTestShader(const char* engine)
+		: renderer(engine)
+	{
+		std::istringstream program(testProgram());
+		shader = createShaderVM(&renderer, program, "");
+		shader->PrepareDefArgs();
+		env.reset(new CqShaderExecEnv(&renderer));
+		env->Initialise(numPoints-1, 0, numPoints-1, numPoints, false,
+				IqAttributesPtr(), IqTransformPtr(), shader.get(), shader->Uses());
+		shader->Initialise(numPoints-1, 0, numPoints, env.get());
+
+		// Inputs; every third point has a negative fa, so is masked off in
+		// the conditional.
+		shader->FindArgument("fu")->SetFloat(-1.25f);
+		shader->FindArgument("pu")->SetPoint(CqVector3D(0.5f, -2, 3));
+		shader->FindArgument("cu")->SetColor(CqColor(0.25f, 2, -0.75f));
+		for(TqInt i = 0; i < numPoints; ++i)
+		{
+			TqFloat x = 0.5f + 0.25f*i;
+			shader->FindArgument("fa")->SetFloat(i % 3 == 0 ? -x : x, i);
+			shader->FindArgument("fb")->SetFloat(i % 4 == 0 ? x : 1.5f - 0.125f*i, i);
+			shader->FindArgument("pa")->SetPoint(CqVector3D(x, 2 - 0.5f*i, 0.3f*i + 0.7f), i);
+			shader->FindArgument("pb")->SetPoint(CqVector3D(1.5f, x*x, -x), i);
+			shader->FindArgument("ca")->SetColor(CqColor(-x, 0.75f, 0.1f*i + 0.2f), i);
+			shader->FindArgument("cb")->SetColor(CqColor(x + 1, -0.5f, 0.3f), i);
+		}
+		shader->Evaluate(env.get());
+	}
+};
+
+void checkSameValues(IqShaderData* stack, IqShaderData* reg)
+{
+	BOOST_REQUIRE_EQUAL(stack->Size(), reg->Size());
+	for(TqUint i = 0; i < stack->Size(); ++i)
+	{
+		switch(stack->Type())
+		{
+			case type_float:
+			{
+				TqFloat a, b;
+				stack->GetFloat(a, i);
+				reg->GetFloat(b, i);
+				BOOST_CHECK_CLOSE(a, b, 1e-4f);
+			}
+			break;
+			case type_point:
+			{
+				CqVector3D a, b;
+				stack->GetPoint(a, i);
+				reg->GetPoint(b, i);
+				for(TqInt j = 0; j < 3; ++j)
+					BOOST_CHECK_CLOSE(a[j], b[j], 1e-4f);
+			}
+			break;
+			case type_color:
+			{
+				CqColor a, b;
+				stack->GetColor(a, i);
+				reg->GetColor(b, i);
+				for(TqInt j = 0; j < 3; ++j)
+					BOOST_CHECK_CLOSE(a[j], b[j], 1e-4f);
+			}
+			break;
+			default:
+			BOOST_ERROR("unexpected result type");
+		}
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqShaderVM_register_engine_matches_stack_test)
+{
+	SqTestShader stack("stack");
+	SqTestShader reg("register");
+
+	for(TqInt op = 0; op < numLoweredOps; ++op)
+	{
+		for(TqInt v = 0; v < numVariants; ++v)
+		{
+			if(!hasVariant(loweredOps[op], v))
+				continue;
+			BOOST_TEST_CHECKPOINT(loweredOps[op].name << " " << variants[v]);
+			checkSameValues(stack.shader->FindArgument(resultName("r", op, v)),
+					reg.shader->FindArgument(resultName("r", op, v)));
+			checkSameValues(stack.shader->FindArgument(resultName("m", op, v)),
+					reg.shader->FindArgument(resultName("m", op, v)));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqShaderVM_register_engine_masking_test)
+{
+	// Results computed inside the conditional keep their old value at the
+	// points which aren't running.
+	SqTestShader reg("register");
+	for(TqInt op = 0; op < numLoweredOps; ++op)
+	{
+		if(loweredOps[op].resultType != 'f')
+			continue;
+		IqShaderData* result = reg.shader->FindArgument(resultName("m", op, 0));
+		for(TqInt i = 0; i < numPoints; i += 3)
+		{
+			TqFloat value = 0;
+			result->GetFloat(value, i);
+			BOOST_CHECK_EQUAL(value, 7);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqShaderVM_register_init_program_test)
+{
+	SqTestShader stack("stack");
+	SqTestShader reg("register");
+	TqFloat stackValue = 0, regValue = 0;
+	stack.shader->FindArgument("iu")->GetFloat(stackValue);
+	reg.shader->FindArgument("iu")->GetFloat(regValue);
+	BOOST_CHECK_EQUAL(stackValue, 6.5f);
+	BOOST_CHECK_EQUAL(regValue, 6.5f);
+}
@@ -0,0 +1,190 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+ *
+ * \brief Interpolation of point cloud lighting over a coarse grid lattice.
+ */
+
+#ifndef IRRADIANCELATTICE_H_INCLUDED
+#define IRRADIANCELATTICE_H_INCLUDED
+
+#include <algorithm>
+#include <vector>
+
+#include <aqsis/util/bitvector.h>
+
+#include <OpenEXR/ImathColor.h>
+
+namespace Aqsis {
+
+/// Lighting integrated from the point cloud at a single shading point.
+struct SqIrradianceSample
+{
+	Imath::C3f radiosity;
+	float occlusion;
+
+	SqIrradianceSample() : radiosity(0), occlusion(0) {}
+};
+
+/// Bilinear interpolation between the samples at four corners.
+inline SqIrradianceSample bilerp(const SqIrradianceSample& s00,
+								 const SqIrradianceSample& s10,
+								 const SqIrradianceSample& s01,
+								 const SqIrradianceSample& s11, float u, float v)
+{
+	SqIrradianceSample res;
+	res.radiosity = (1-v)*((1-u)*s00.radiosity + u*s10.radiosity)
+					+ v*((1-u)*s01.radiosity + u*s11.radiosity);
+	res.occlusion = (1-v)*((1-u)*s00.occlusion + u*s10.occlusion)
+					+ v*((1-u)*s01.occlusion + u*s11.occlusion);
+	return res;
+}
+
+/// Get the knots of a 1D lattice covering [0,res] with the given stride.  The
+/// last knot is always at res, so the final interval may be shorter.
+inline void latticeKnots(int res, int stride, std::vector<int>& knots)
+{
+	knots.clear();
+	for(int i = 0; i < res; i += stride)
+		knots.push_back(i);
+	knots.push_back(res);
+}
+
+/// Maximum difference between the four corner samples of a cell, over the
+/// occlusion and each radiosity channel.
+inline float sampleVariation(const SqIrradianceSample& s00,
+							 const SqIrradianceSample& s10,
+							 const SqIrradianceSample& s01,
+							 const SqIrradianceSample& s11)
+{
+	float variation = 0;
+	for(int c = -1; c < 3; ++c)
+	{
+		float a = c < 0 ? s00.occlusion : s00.radiosity[c];
+		float b = c < 0 ? s10.occlusion : s10.radiosity[c];
+		float d = c < 0 ? s01.occlusion : s01.radiosity[c];
+		float e = c < 0 ? s11.occlusion : s11.radiosity[c];
+		float lo = std::min(std::min(a, b), std::min(d, e));
+		float hi = std::max(std::max(a, b), std::max(d, e));
+		variation = std::max(variation, hi - lo);
+	}
+	return variation;
+}
+
+/** \brief Integrate lighting over a grid by interpolating across a lattice.
+ *
+ * The running vertices on a coarse lattice of the grid are integrated first.
+ * Every running vertex of a lattice cell is then integrated directly if the
+ * cell corners vary by more than maxVariation, or if any corner isn't
+ * running; the rest are interpolated from the cell corners.  Vertices which
+ * aren't running are never integrated, since the shader inputs there may
+ * not have been computed.
+ *
+ * \param uGridRes, vGridRes - number of micropolygons across the grid.
+ * \param stride - lattice spacing in grid vertices.
+ * \param maxVariation - largest corner variation of an interpolated cell.
+ * \param RS - running state of the grid vertices.
+ * \param integrate - functor called as integrate(points, samples) which
+ *                    stores the integrated lighting of each grid index in
+ *                    points into samples.
+ * \param samples - storage for the result at each grid vertex.
+ */
+template<typename IntegrateFuncT>
+void latticeIntegrate(int uGridRes, int vGridRes, int stride,
+					  float maxVariation, const CqBitVector& RS,
+					  IntegrateFuncT integrate,
+					  std::vector<SqIrradianceSample>& samples)
+{
+	int uSize = uGridRes+1;
+	int npoints = uSize*(vGridRes+1);
+	std::vector<bool> computed(npoints, false);
+	std::vector<int> points;
+	points.reserve(npoints);
+	std::vector<int> uKnots, vKnots;
+	latticeKnots(uGridRes, stride, uKnots);
+	latticeKnots(vGridRes, stride, vKnots);
+	int nu = uKnots.size();
+	int nv = vKnots.size();
+	for(int j = 0; j < nv; ++j)
+	{
+		for(int i = 0; i < nu; ++i)
+		{
+			int igrid = vKnots[j]*uSize + uKnots[i];
+			if(RS.Value(igrid))
+			{
+				points.push_back(igrid);
+				computed[igrid] = true;
+			}
+		}
+	}
+	integrate(points, samples);
+
+	// Cells which can't be interpolated are integrated at every vertex.
+	points.clear();
+	for(int j = 0; j < nv-1; ++j)
+	{
+		for(int i = 0; i < nu-1; ++i)
+		{
+			int u0 = uKnots[i], u1 = uKnots[i+1];
+			int v0 = vKnots[j], v1 = vKnots[j+1];
+			int i00 = v0*uSize + u0, i10 = v0*uSize + u1;
+			int i01 = v1*uSize + u0, i11 = v1*uSize + u1;
+			if(computed[i00] && computed[i10] && computed[i01] && computed[i11]
+			   && sampleVariation(samples[i00], samples[i10], samples[i01],
+								  samples[i11]) <= maxVariation)
+				continue;
+			for(int v = v0; v <= v1; ++v)
+			{
+				for(int u = u0; u <= u1; ++u)
+				{
+					int igrid = v*uSize + u;
+					if(!computed[igrid] && RS.Value(igrid))
+					{
+						points.push_back(igrid);
+						computed[igrid] = true;
+					}
+				}
+			}
+		}
+	}
+	integrate(points, samples);
+
+	// Every vertex of a cell which was integrated above has been computed, so
+	// any vertex left over lies in a cell with four good corners.
+	for(int igrid = 0; igrid < npoints; ++igrid)
+	{
+		if(computed[igrid] || !RS.Value(igrid))
+			continue;
+		int v = igrid/uSize;
+		int u = igrid - v*uSize;
+		int i = std::min(u/stride, nu-2);
+		int j = std::min(v/stride, nv-2);
+		int u0 = uKnots[i], u1 = uKnots[i+1];
+		int v0 = vKnots[j], v1 = vKnots[j+1];
+		samples[igrid] = bilerp(samples[v0*uSize + u0], samples[v0*uSize + u1],
+								samples[v1*uSize + u0], samples[v1*uSize + u1],
+								float(u - u0)/(u1 - u0), float(v - v0)/(v1 - v0));
+	}
+}
+
+} // namespace Aqsis
+
+#endif // IRRADIANCELATTICE_H_INCLUDED
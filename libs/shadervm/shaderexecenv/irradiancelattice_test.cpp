@@ -0,0 +1,173 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the lattice interpolation of point cloud lighting.
+ */
+
+#include "irradiancelattice.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+const int uRes = 12;
+const int vRes = 9;
+const int uSize = uRes+1;
+const int npoints = uSize*(vRes+1);
+
+/// Lighting functions of the grid vertex position.
+float linearLight(int u, int v)
+{
+	return 0.05f*u + 0.02f*v;
+}
+float stepLight(int u, int v)
+{
+	return u + v > 10 ? 1.0f : 0.0f;
+}
+
+/// Stand in for the point cloud integrator, which records the vertices it's
+/// asked to integrate.
+class CqFakeIntegrate
+{
+	public:
+		CqFakeIntegrate(float (*light)(int, int), const CqBitVector& RS,
+						std::vector<int>& integrated)
+			: m_light(light),
+			m_RS(RS),
+			m_integrated(integrated)
+		{}
+		void operator()(const std::vector<int>& points,
+						std::vector<SqIrradianceSample>& samples) const
+		{
+			for(int i = 0, n = points.size(); i < n; ++i)
+			{
+				int igrid = points[i];
+				BOOST_CHECK(m_RS.Value(igrid));
+				++m_integrated[igrid];
+				float value = m_light(igrid % uSize, igrid / uSize);
+				samples[igrid].occlusion = value;
+				samples[igrid].radiosity = Imath::C3f(value, 0.5f*value, 0);
+			}
+		}
+	private:
+		float (*m_light)(int, int);
+		const CqBitVector& m_RS;
+		std::vector<int>& m_integrated;
+};
+
+int totalIntegrated(const std::vector<int>& integrated)
+{
+	int total = 0;
+	for(int i = 0; i < npoints; ++i)
+	{
+		BOOST_CHECK(integrated[i] <= 1);
+		total += integrated[i];
+	}
+	return total;
+}
+
+void checkSamples(float (*light)(int, int), const CqBitVector& RS,
+				  const std::vector<SqIrradianceSample>& samples)
+{
+	for(int igrid = 0; igrid < npoints; ++igrid)
+	{
+		if(!RS.Value(igrid))
+			continue;
+		float value = light(igrid % uSize, igrid / uSize);
+		BOOST_CHECK_CLOSE(samples[igrid].occlusion + 1, value + 1, 1e-4f);
+		BOOST_CHECK_CLOSE(samples[igrid].radiosity.y + 1, 0.5f*value + 1, 1e-4f);
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(latticeIntegrate_interpolation_test)
+{
+	// Bilinear lighting is reproduced exactly from the lattice knots alone.
+	CqBitVector RS(npoints);
+	RS.SetAll(true);
+	std::vector<int> integrated(npoints, 0);
+	std::vector<SqIrradianceSample> samples(npoints);
+	latticeIntegrate(uRes, vRes, 4, 0.5f, RS,
+					 CqFakeIntegrate(linearLight, RS, integrated), samples);
+	checkSamples(linearLight, RS, samples);
+	// Knots at u = 0,4,8,12 and v = 0,4,8,9.
+	BOOST_CHECK_EQUAL(totalIntegrated(integrated), 16);
+	BOOST_CHECK_EQUAL(integrated[4*uSize + 8], 1);
+	BOOST_CHECK_EQUAL(integrated[9*uSize + 12], 1);
+}
+
+BOOST_AUTO_TEST_CASE(latticeIntegrate_maxvariation_test)
+{
+	// Cells straddling the step are refined, the flat cells interpolated.
+	CqBitVector RS(npoints);
+	RS.SetAll(true);
+	std::vector<int> integrated(npoints, 0);
+	std::vector<SqIrradianceSample> samples(npoints);
+	latticeIntegrate(uRes, vRes, 4, 0.5f, RS,
+					 CqFakeIntegrate(stepLight, RS, integrated), samples);
+	checkSamples(stepLight, RS, samples);
+	int total = totalIntegrated(integrated);
+	BOOST_CHECK(total > 16);
+	BOOST_CHECK(total < npoints);
+	// The corner cells are flat so their interiors are interpolated.
+	BOOST_CHECK_EQUAL(integrated[1*uSize + 1], 0);
+	BOOST_CHECK_EQUAL(integrated[8*uSize + 10], 0);
+
+	// With a large enough maxvariation only the knots are integrated.
+	std::fill(integrated.begin(), integrated.end(), 0);
+	latticeIntegrate(uRes, vRes, 4, 2.0f, RS,
+					 CqFakeIntegrate(stepLight, RS, integrated), samples);
+	BOOST_CHECK_EQUAL(totalIntegrated(integrated), 16);
+}
+
+BOOST_AUTO_TEST_CASE(latticeIntegrate_running_state_test)
+{
+	// Vertices which aren't running are never integrated, and cells with a
+	// corner which isn't running are integrated directly instead of being
+	// interpolated from it.
+	CqBitVector RS(npoints);
+	RS.SetAll(true);
+	for(int v = 0; v <= vRes; ++v)
+		for(int u = 0; u <= 4; ++u)
+			RS.SetValue(v*uSize + u, false);
+	RS.SetValue(4*uSize + 8, false);
+	std::vector<int> integrated(npoints, 0);
+	std::vector<SqIrradianceSample> samples(npoints);
+	latticeIntegrate(uRes, vRes, 4, 0.5f, RS,
+					 CqFakeIntegrate(linearLight, RS, integrated), samples);
+	checkSamples(linearLight, RS, samples);
+	for(int igrid = 0; igrid < npoints; ++igrid)
+	{
+		if(!RS.Value(igrid))
+			BOOST_CHECK_EQUAL(integrated[igrid], 0);
+	}
+	// Cells next to the missing knot and the stopped columns are integrated.
+	BOOST_CHECK_EQUAL(integrated[5*uSize + 9], 1);
+	BOOST_CHECK_EQUAL(integrated[1*uSize + 5], 1);
+	BOOST_CHECK_EQUAL(integrated[9*uSize + 5], 1);
+	// Cells with four running corners are still interpolated.
+	BOOST_CHECK_EQUAL(integrated[9*uSize + 9], 0);
+}
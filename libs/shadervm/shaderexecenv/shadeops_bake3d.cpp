@@ -25,12 +25,17 @@
 #include <cstring>
 
 #include <Partio.h>
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
 
 #include "shaderexecenv.h"
 
 #include <aqsis/util/autobuffer.h>
 #include <aqsis/util/logging.h>
 
+#include "../../pointrender/diffuse/DiffusePointOctree.h"
+
 #include <OpenEXR/ImathVec.h>
 
 namespace Aqsis
@@ -227,10 +232,23 @@ class Bake3dCache
         }
 
         /// Flush all files to disk and clear the cache
+        ///
+        /// Files named with a ".ptree" extension are built into a point
+        /// hierarchy and saved in a form which indirectdiffuse() and friends
+        /// can memory map, rather than being written by Partio.
         void flush()
         {
             for(FileMap::iterator i = m_files.begin(); i != m_files.end(); ++i)
-                Partio::write(i->first.c_str(), *i->second);
+            {
+                if(isDiffusePointTreeName(i->first))
+                {
+                    PointArray points;
+                    if(loadDiffusePoints(points, *i->second, i->first))
+                        DiffusePointOctree(points).writeFile(i->first);
+                }
+                else
+                    Partio::write(i->first.c_str(), *i->second);
+            }
             m_files.clear();
         }
 
@@ -242,9 +260,17 @@ class Bake3dCache
 
 // TODO: Make non-global
 static Bake3dCache g_bakeCloudCache;
+#ifdef ENABLE_THREADING
+// Held for the whole of bake3d(), since the point clouds are written as well
+// as looked up.
+static boost::mutex g_bakeMutex;
+#endif
 
 void flushBakeCache()
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(g_bakeMutex);
+#endif
     g_bakeCloudCache.flush();
 }
 
@@ -270,6 +296,9 @@ void CqShaderExecEnv::SO_bake3d( IqShaderData* ptc,
                                  IqShader* pShader,
                                  TqInt cParams, IqShaderData** apParams )
 {
+#ifdef ENABLE_THREADING
+    boost::mutex::scoped_lock lock(g_bakeMutex);
+#endif
     const CqBitVector& RS = RunningState();
     CqString ptcName;
     ptc->GetString(ptcName);
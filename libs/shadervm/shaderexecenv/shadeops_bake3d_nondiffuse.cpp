@@ -82,6 +82,8 @@ void CqShaderExecEnv::SO_bake3d_nondiffuse(IqShaderData* ptc,
 	int faceRes = 10;
 	// Number of bands of Spherical Harmonics to use (in bands)
 	int nBands = 5;
+	// Number of samples used to fit the Spherical Harmonics
+	int nSamples = 1000;
 	// Default coordinate system to use
 	CqString coordSystem = "world";
 	// Holding the categories of the lights to use.
@@ -137,7 +139,7 @@ void CqShaderExecEnv::SO_bake3d_nondiffuse(IqShaderData* ptc,
 				if (paramValue->Type() == type_float) {
 					float tmp = -1;
 					paramValue->GetFloat(tmp);
-					SpherHarmonApprox::nApproximationSamples = std::max(0, static_cast<int> (tmp));
+					nSamples = std::max(0, static_cast<int> (tmp));
 				}
 			} else if (paramName == "approxhemi") {
 				CqString str;
@@ -299,7 +301,7 @@ void CqShaderExecEnv::SO_bake3d_nondiffuse(IqShaderData* ptc,
 				approxHemi = new CubeMapApprox(faceRes);
 				break;
 			case HemiApprox::SpherHarmon:
-				approxHemi = new SpherHarmonApprox(nBands);
+				approxHemi = new SpherHarmonApprox(nBands, nSamples);
 				break;
 			case HemiApprox::PhongModel:
 				approxHemi = new PhongModelApprox(nLights);
@@ -27,6 +27,7 @@
 #include	<stdio.h>
 
 #include	"shaderexecenv.h"
+#include	"../simdkernels.h"
 #include	<aqsis/math/spline.h>
 
 namespace Aqsis {
@@ -99,6 +100,22 @@ void	CqShaderExecEnv::SO_smoothstep( IqShaderData* _min, IqShaderData* _max, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, _min, _max, value ) )
+	{
+		const TqFloat* __p_min;
+		const TqFloat* __p_max;
+		const TqFloat* __pvalue;
+		TqFloat* __pResult;
+		(_min)->GetFloatPtr( __p_min );
+		(_max)->GetFloatPtr( __p_max );
+		(value)->GetFloatPtr( __pvalue );
+		(Result)->GetFloatPtr( __pResult );
+		simd::ternaryF<simd::SqSmoothstepOp>( simd::CqFloatIn( __p_min, (_min)->Size() > 1 ),
+				simd::CqFloatIn( __p_max, (_max)->Size() > 1 ),
+				simd::CqFloatIn( __pvalue, (value)->Size() > 1 ), __pResult, __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -694,6 +711,17 @@ void	CqShaderExecEnv::SO_normalize( IqShaderData* V, IqShaderData* Result, IqSha
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, V ) )
+	{
+		const CqVector3D* __pV;
+		CqVector3D* __pResult;
+		(V)->GetVectorPtr( __pV );
+		(Result)->GetVectorPtr( __pResult );
+		simd::normalize( simd::CqTripleIn( simd::comps( __pV ), (V)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	CqVector3D _old(1,0,0);
 	CqVector3D _unit(1,0,0);
 	do
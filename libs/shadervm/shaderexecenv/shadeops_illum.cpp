@@ -156,11 +156,11 @@ void CqShaderExecEnv::ValidateIlluminanceCache( IqShaderData* pP, IqShaderData*
 		while ( li < m_pAttributes ->cLights() )
 		{
 			IqLightsource * lp = m_pAttributes ->pLight( li );
-			// Initialise the lightsource
-			lp->Initialise( uGridRes(), vGridRes(), microPolygonCount(), shadingPointCount(), m_hasValidDerivatives );
 			m_Illuminate = 0;
-			// Evaluate the lightsource
-			lp->Evaluate( Ps, Ns, m_pCurrentSurface );
+			// Initialise and evaluate the lightsource, unless it still holds
+			// the results for these points from a previous illuminance loop.
+			lp->EvaluateCached( uGridRes(), vGridRes(), microPolygonCount(), shadingPointCount(), m_hasValidDerivatives,
+					Ps, Ns, m_pCurrentSurface );
 			li++;
 		}
 		m_IlluminanceCacheValid = true;
@@ -918,6 +918,7 @@ void CqShaderExecEnv::SO_illuminate( IqShaderData* P, IqShaderData* Axis, IqShad
 		while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
 	}
 
+	m_distantLight = false;
 	m_Illuminate++;
 }
 
@@ -961,6 +962,7 @@ void CqShaderExecEnv::SO_solar( IqShaderData* Axis, IqShaderData* Angle, IqShade
 	}
 	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
 
+	m_distantLight = true;
 	m_Illuminate++;
 }
 
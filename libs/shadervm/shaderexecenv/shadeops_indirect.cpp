@@ -33,8 +33,6 @@ using Imath::C3f;
 static DiffusePointOctreeCache g_diffusePtcCache;
 static NonDiffusePointOctreeCache g_nonDiffusePtcCache;
 
-static int microBufIndex = 0;
-
 /**
  * Helper function of "SO_indirect", calculating the radiance from the nondiffuse pointcloud.
  */
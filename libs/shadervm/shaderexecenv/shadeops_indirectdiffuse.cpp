@@ -23,12 +23,16 @@
 		\author Paul C. Gregory (pgregory@aqsis.org)
 */
 
+#include	<algorithm>
+#include	<cmath>
 #include	<string>
+#include	<vector>
 #include	<stdio.h>
 
 #include	<aqsis/math/math.h>
 #include	<aqsis/core/ilightsource.h>
 #include	"shaderexecenv.h"
+#include	"irradiancelattice.h"
 
 #include <OpenEXR/ImathMath.h>
 #include <OpenEXR/ImathVec.h>
@@ -63,8 +67,153 @@ void storeZeroResult<RadiosityIntegrator>(IqShaderData* result, int igrid)
 {
 	result->SetColor(CqColor(0.0f),igrid);
 }
+
+/// Grid data and parameters needed to integrate the point cloud at a vertex.
+struct SqPointCloudQuery
+{
+	IqShaderData* P;
+	IqShaderData* N;
+	int uGridRes;
+	int vGridRes;
+	CqMatrix positionTrans;
+	CqMatrix normalTrans;
+	int faceRes;
+	float maxSolidAngle;
+	float coneAngle;
+	float bias;
+	const DiffusePointOctree* pointTree;
+};
+
+void integratedSample(const OcclusionIntegrator& integrator, const V3f& N,
+					  float coneAngle, SqIrradianceSample& sample)
+{
+	sample.occlusion = integrator.occlusion(N, coneAngle);
+}
+void integratedSample(const RadiosityIntegrator& integrator, const V3f& N,
+					  float coneAngle, SqIrradianceSample& sample)
+{
+	sample.radiosity = integrator.radiosity(N, coneAngle, &sample.occlusion);
+}
+
+/// Store an integrated sample into the shader result variables.
+template<typename T>
+void storeSample(const SqIrradianceSample& sample, IqShaderData* result,
+				 IqShaderData* /*occlusionResult*/, int igrid)
+{
+	result->SetFloat(sample.occlusion, igrid);
+}
+template<>
+void storeSample<RadiosityIntegrator>(const SqIrradianceSample& sample,
+									  IqShaderData* result,
+									  IqShaderData* occlusionResult, int igrid)
+{
+	const C3f& col = sample.radiosity;
+	result->SetColor(CqColor(col.x, col.y, col.z), igrid);
+	if(occlusionResult)
+		occlusionResult->SetFloat(sample.occlusion, igrid);
+}
+
+/// Integrate the point cloud at each of the given grid indices, storing the
+/// result for grid index igrid into samples[igrid].
+template<typename IntegratorT>
+void integratePoints(const SqPointCloudQuery& query,
+					 const std::vector<int>& points,
+					 std::vector<SqIrradianceSample>& samples)
+{
+	// Number of vertices in u-direction of grid
+	int uSize = query.uGridRes+1;
+	int npoints = points.size();
+#pragma omp parallel
+	{
+	// Compute occlusion for each point
+	IntegratorT integrator(query.faceRes);
+#pragma omp for
+	for(int ipoint = 0; ipoint < npoints; ++ipoint)
+	{
+		int igrid = points[ipoint];
+		CqVector3D Pval;
+		// TODO: What about RiPoints?  They're not a 2D grid!
+		int v = igrid/uSize;
+		int u = igrid - v*uSize;
+		float uinterp = 0;
+		float vinterp = 0;
+		// Microgrids sometimes meet each other at an acute angle.
+		// Computing occlusion at the vertices where the grids meet is
+		// then rather difficult because an occluding disk passes
+		// exactly through the point to be occluded.  This usually
+		// results in obvious light leakage from the other side of the
+		// surface.
+		//
+		// To avoid this problem, we modify the position of any
+		// vertices at the edges of grids by moving them inward
+		// slightly.
+		//
+		// TODO: Make adjustable?
+		const float edgeShrink = 0.2f;
+		if(u == 0)
+			uinterp = edgeShrink;
+		else if(u == query.uGridRes)
+		{
+			uinterp = 1 - edgeShrink;
+			--u;
+		}
+		if(v == 0)
+			vinterp = edgeShrink;
+		else if(v == query.vGridRes)
+		{
+			vinterp = 1 - edgeShrink;
+			--v;
+		}
+		if(uinterp != 0 || vinterp != 0)
+		{
+			CqVector3D _P1; CqVector3D _P2;
+			CqVector3D _P3; CqVector3D _P4;
+			query.P->GetPoint(_P1, v*uSize + u);
+			query.P->GetPoint(_P2, v*uSize + u+1);
+			query.P->GetPoint(_P3, (v+1)*uSize + u);
+			query.P->GetPoint(_P4, (v+1)*uSize + u+1);
+			Pval = (1-vinterp)*(1-uinterp) * _P1 +
+				   (1-vinterp)*uinterp     * _P2 +
+				   vinterp*(1-uinterp)     * _P3 +
+				   vinterp*uinterp         * _P4;
+		}
+		else
+			query.P->GetVector(Pval, igrid);
+		CqVector3D Nval;   query.N->GetVector(Nval, igrid);
+		Pval = query.positionTrans * Pval;
+		Nval = query.normalTrans * Nval;
+		V3f Pval2(Pval.x(), Pval.y(), Pval.z());
+		V3f Nval2(Nval.x(), Nval.y(), Nval.z());
+		// TODO: It may make more sense to scale bias by the current
+		// micropolygon radius - that way we avoid problems with an
+		// absolute length scale.
+		if(query.bias != 0)
+			Pval2 += Nval2*query.bias;
+		integrator.clear();
+		microRasterize(integrator, Pval2, Nval2, query.coneAngle,
+					   query.maxSolidAngle, *query.pointTree);
+		integratedSample(integrator, Nval2, query.coneAngle, samples[igrid]);
+	}
+	}
 }
 
+/// Functor integrating a point cloud query at a set of grid indices.
+template<typename IntegratorT>
+class CqIntegratePoints
+{
+	public:
+		CqIntegratePoints(const SqPointCloudQuery& query) : m_query(query) {}
+		void operator()(const std::vector<int>& points,
+						std::vector<SqIrradianceSample>& samples) const
+		{
+			integratePoints<IntegratorT>(m_query, points, samples);
+		}
+	private:
+		const SqPointCloudQuery& m_query;
+};
+
+} // unnamed namespace
+
 
 // FIXME: It's pretty ugly to have a global cache here!
 //
@@ -94,6 +243,7 @@ void CqShaderExecEnv::pointCloudIntegrate(IqShaderData* P, IqShaderData* N,
 	float maxSolidAngle = 0.03;
 	float coneAngle = M_PI_2;
 	float bias = 0;
+	float maxVariation = 0.02f;
 	CqString coordSystem = "world";
 	IqShaderData* occlusionResult = 0;
 	for(int i = 0; i < cParams; i+=2)
@@ -124,6 +274,11 @@ void CqShaderExecEnv::pointCloudIntegrate(IqShaderData* P, IqShaderData* N,
 			if(paramValue->Type() == type_float)
 				paramValue->GetFloat(bias);
 		}
+		else if(paramName == "maxvariation")
+		{
+			if(paramValue->Type() == type_float)
+				paramValue->GetFloat(maxVariation);
+		}
 		else if(paramName == "microbufres")
 		{
 			if(paramValue->Type() == type_float)
@@ -157,95 +312,62 @@ void CqShaderExecEnv::pointCloudIntegrate(IqShaderData* P, IqShaderData* N,
 	getRenderContext()->matSpaceToSpace("current", coordSystem.c_str(),
 										pShader->getTransform(),
 										pTransform().get(), 0, positionTrans);
-	CqMatrix normalTrans = normalTransform(positionTrans);
-
-	// TODO: interpolation.  3delight uses Attribute "irradiance"
-	// "shadingrate" to control interpolation; PRMan uses the "maxvariation"
-	// parameter.
-
-	// Number of vertices in u-direction of grid
-	int uSize = m_uGridRes+1;
 
 	bool varying = result->Class() == class_varying;
 	const CqBitVector& RS = RunningState();
 	if(pointTree)
 	{
+		SqPointCloudQuery query;
+		query.P = P;
+		query.N = N;
+		query.uGridRes = m_uGridRes;
+		query.vGridRes = m_vGridRes;
+		query.positionTrans = positionTrans;
+		query.normalTrans = normalTransform(positionTrans);
+		query.faceRes = faceRes;
+		query.maxSolidAngle = maxSolidAngle;
+		query.coneAngle = coneAngle;
+		query.bias = bias;
+		query.pointTree = pointTree;
+
 		int npoints = varying ? shadingPointCount() : 1;
-#pragma omp parallel
+		std::vector<SqIrradianceSample> samples(npoints);
+
+		// Interpolation spacing in grid vertices.  Attribute "irradiance"
+		// "shadingrate" gives the area between integrated points in the same
+		// units as ShadingRate, which is roughly the area of a micropolygon.
+		int stride = 1;
+		const TqFloat* irradianceRate = m_pAttributes ?
+			m_pAttributes->GetFloatAttribute("irradiance", "shadingrate") : 0;
+		if(varying && irradianceRate && m_uGridRes > 0 && m_vGridRes > 0
+		   && npoints == (m_uGridRes+1)*(m_vGridRes+1))
 		{
-		// Compute occlusion for each point
-		IntegratorT integrator(faceRes);
-#pragma omp for
-		for(int igrid = 0; igrid < npoints; ++igrid)
+			TqFloat shadingRate = m_pAttributes->GetFloatAttribute("System", "ShadingRate")[0];
+			if(shadingRate > 0 && irradianceRate[0] > shadingRate)
+				stride = static_cast<int>(std::sqrt(irradianceRate[0]/shadingRate) + 0.5f);
+		}
+
+		if(stride <= 1)
 		{
-			if(!varying || RS.Value(igrid))
+			std::vector<int> points;
+			points.reserve(npoints);
+			for(int igrid = 0; igrid < npoints; ++igrid)
 			{
-				CqVector3D Pval;
-				// TODO: What about RiPoints?  They're not a 2D grid!
-				int v = igrid/uSize;
-				int u = igrid - v*uSize;
-				float uinterp = 0;
-				float vinterp = 0;
-				// Microgrids sometimes meet each other at an acute angle.
-				// Computing occlusion at the vertices where the grids meet is
-				// then rather difficult because an occluding disk passes
-				// exactly through the point to be occluded.  This usually
-				// results in obvious light leakage from the other side of the
-				// surface.
-				//
-				// To avoid this problem, we modify the position of any
-				// vertices at the edges of grids by moving them inward
-				// slightly.
-				//
-				// TODO: Make adjustable?
-				const float edgeShrink = 0.2f;
-				if(u == 0)
-					uinterp = edgeShrink;
-				else if(u == m_uGridRes)
-				{
-					uinterp = 1 - edgeShrink;
-					--u;
-				}
-				if(v == 0)
-					vinterp = edgeShrink;
-				else if(v == m_vGridRes)
-				{
-					vinterp = 1 - edgeShrink;
-					--v;
-				}
-				if(uinterp != 0 || vinterp != 0)
-				{
-					CqVector3D _P1; CqVector3D _P2;
-					CqVector3D _P3; CqVector3D _P4;
-					int uSize = m_uGridRes + 1;
-					P->GetPoint(_P1, v*uSize + u);
-					P->GetPoint(_P2, v*uSize + u+1);
-					P->GetPoint(_P3, (v+1)*uSize + u);
-					P->GetPoint(_P4, (v+1)*uSize + u+1);
-					Pval = (1-vinterp)*(1-uinterp) * _P1 +
-						   (1-vinterp)*uinterp     * _P2 +
-						   vinterp*(1-uinterp)     * _P3 +
-						   vinterp*uinterp         * _P4;
-				}
-				else
-					P->GetVector(Pval, igrid);
-				CqVector3D Nval;   N->GetVector(Nval, igrid);
-				Pval = positionTrans * Pval;
-				Nval = normalTrans * Nval;
-				V3f Pval2(Pval.x(), Pval.y(), Pval.z());
-				V3f Nval2(Nval.x(), Nval.y(), Nval.z());
-				// TODO: It may make more sense to scale bias by the current
-				// micropolygon radius - that way we avoid problems with an
-				// absolute length scale.
-				if(bias != 0)
-					Pval2 += Nval2*bias;
-				integrator.clear();
-				microRasterize(integrator, Pval2, Nval2, coneAngle,
-							   maxSolidAngle, *pointTree);
-				storeIntegratedResult(integrator, Nval2, coneAngle, result,
-									  occlusionResult, igrid);
+				if(!varying || RS.Value(igrid))
+					points.push_back(igrid);
 			}
+			integratePoints<IntegratorT>(query, points, samples);
+		}
+		else
+		{
+			latticeIntegrate(m_uGridRes, m_vGridRes, stride, maxVariation, RS,
+							 CqIntegratePoints<IntegratorT>(query), samples);
 		}
+
+		for(int igrid = 0; igrid < npoints; ++igrid)
+		{
+			if(!varying || RS.Value(igrid))
+				storeSample<IntegratorT>(samples[igrid], result, occlusionResult, igrid);
 		}
 	}
 	else
@@ -265,17 +387,25 @@ void CqShaderExecEnv::pointCloudIntegrate(IqShaderData* P, IqShaderData* N,
 
 
 //----------------------------------------------------------------------
-static void storeIntegratedResult(const OcclusionIntegrator& integrator,
-								  const V3f& N, float coneAngle,
-								  IqShaderData* result,
-								  IqShaderData* /*occlusionResult*/, int igrid)
-{
-	result->SetFloat(integrator.occlusion(N, coneAngle), igrid);
-}
-
 // occlusion(P,N,samples)
 void CqShaderExecEnv::SO_occlusion_rt( IqShaderData* P, IqShaderData* N, IqShaderData* samples, IqShaderData* Result, IqShader* pShader, int cParams, IqShaderData** apParams )
 {
+	// Without a point cloud, trace rays against the raytracing database if
+	// Option "trace" "rayocclusion" is on.  Otherwise the result is zero.
+	CqString paramName;
+	bool hasPointCloud = false;
+	for(int i = 0; i < cParams; i += 2)
+	{
+		apParams[i]->GetString(paramName, 0);
+		if(paramName == "filename")
+			hasPointCloud = true;
+	}
+	const TqInt* rayOcclusion = getRenderContext()->GetIntegerOption("trace", "rayocclusion");
+	if(!hasPointCloud && rayOcclusion && rayOcclusion[0] != 0)
+	{
+		traceOcclusion(P, N, samples, Result, cParams, apParams);
+		return;
+	}
 	pointCloudIntegrate<OcclusionIntegrator>(P, N, Result, cParams, apParams,
 											 pShader);
 }
@@ -283,18 +413,6 @@ void CqShaderExecEnv::SO_occlusion_rt( IqShaderData* P, IqShaderData* N, IqShade
 
 //----------------------------------------------------------------------
 // indirectdiffuse(P, N, samples, ...)
-static void storeIntegratedResult(const RadiosityIntegrator& integrator,
-								  const V3f& N, float coneAngle,
-								  IqShaderData* result,
-								  IqShaderData* occlusionResult, int igrid)
-{
-	float occ = 0;
-	C3f col = integrator.radiosity(N, coneAngle, &occ);
-	result->SetColor(CqColor(col.x, col.y, col.z), igrid);
-	if(occlusionResult)
-		occlusionResult->SetFloat(occ, igrid);
-}
-
 void CqShaderExecEnv::SO_indirectdiffuse(IqShaderData* P,
 										IqShaderData* N,
 										IqShaderData* samples,
@@ -28,6 +28,7 @@
 
 #include <aqsis/math/math.h>
 #include "shaderexecenv.h"
+#include "../simdkernels.h"
 #include <aqsis/util/logging.h>
 
 namespace Aqsis {
@@ -746,6 +747,22 @@ void	CqShaderExecEnv::SO_clamp( IqShaderData* a, IqShaderData* _min, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, a, _min, _max ) )
+	{
+		const TqFloat* __pa;
+		const TqFloat* __p_min;
+		const TqFloat* __p_max;
+		TqFloat* __pResult;
+		(a)->GetFloatPtr( __pa );
+		(_min)->GetFloatPtr( __p_min );
+		(_max)->GetFloatPtr( __p_max );
+		(Result)->GetFloatPtr( __pResult );
+		simd::ternaryF<simd::SqClampOp>( simd::CqFloatIn( __pa, (a)->Size() > 1 ),
+				simd::CqFloatIn( __p_min, (_min)->Size() > 1 ),
+				simd::CqFloatIn( __p_max, (_max)->Size() > 1 ), __pResult, __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -774,6 +791,23 @@ void	CqShaderExecEnv::SO_pclamp( IqShaderData* a, IqShaderData* _min, IqShaderDa
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, a, _min, _max ) )
+	{
+		const CqVector3D* __pa;
+		const CqVector3D* __p_min;
+		const CqVector3D* __p_max;
+		CqVector3D* __pResult;
+		(a)->GetPointPtr( __pa );
+		(_min)->GetPointPtr( __p_min );
+		(_max)->GetPointPtr( __p_max );
+		(Result)->GetPointPtr( __pResult );
+		simd::ternaryT<simd::SqClampOp>( simd::CqTripleIn( simd::comps( __pa ), (a)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __p_min ), (_min)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __p_max ), (_max)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -802,6 +836,23 @@ void	CqShaderExecEnv::SO_cclamp( IqShaderData* a, IqShaderData* _min, IqShaderDa
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, a, _min, _max ) )
+	{
+		const CqColor* __pa;
+		const CqColor* __p_min;
+		const CqColor* __p_max;
+		CqColor* __pResult;
+		(a)->GetColorPtr( __pa );
+		(_min)->GetColorPtr( __p_min );
+		(_max)->GetColorPtr( __p_max );
+		(Result)->GetColorPtr( __pResult );
+		simd::ternaryT<simd::SqClampOp>( simd::CqTripleIn( simd::comps( __pa ), (a)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __p_min ), (_min)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __p_max ), (_max)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
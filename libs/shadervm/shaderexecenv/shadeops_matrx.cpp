@@ -27,6 +27,7 @@
 #include	<stdio.h>
 
 #include	"shaderexecenv.h"
+#include	"../simdkernels.h"
 
 namespace Aqsis {
 
@@ -56,6 +57,17 @@ void CqShaderExecEnv::SO_transform( IqShaderData* fromspace, IqShaderData* tospa
 
 		__iGrid = 0;
 		const CqBitVector& RS = RunningState();
+		TqInt __n = __fVarying ? shadingPointCount() : 1;
+		if ( simd::directAccess( __n, Result, p ) )
+		{
+			const CqVector3D* __pp;
+			CqVector3D* __pResult;
+			(p)->GetPointPtr( __pp );
+			(Result)->GetPointPtr( __pResult );
+			simd::transform( mat, simd::CqTripleIn( simd::comps( __pp ), (p)->Size() > 1 ),
+					simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+			return;
+		}
 		do
 		{
 			if(!__fVarying || RS.Value( __iGrid ) )
@@ -108,6 +120,17 @@ void CqShaderExecEnv::SO_transform( IqShaderData* tospace, IqShaderData* p, IqSh
 
 		__iGrid = 0;
 		const CqBitVector& RS = RunningState();
+		TqInt __n = __fVarying ? shadingPointCount() : 1;
+		if ( simd::directAccess( __n, Result, p ) )
+		{
+			const CqVector3D* __pp;
+			CqVector3D* __pResult;
+			(p)->GetPointPtr( __pp );
+			(Result)->GetPointPtr( __pResult );
+			simd::transform( mat, simd::CqTripleIn( simd::comps( __pp ), (p)->Size() > 1 ),
+					simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+			return;
+		}
 		do
 		{
 			if(!__fVarying || RS.Value( __iGrid ) )
@@ -151,6 +174,19 @@ void CqShaderExecEnv::SO_transformm( IqShaderData* tospace, IqShaderData* p, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( tospace->Size() == 1 && simd::directAccess( __n, Result, p ) )
+	{
+		CqMatrix _aq_tospace;
+		(tospace)->GetMatrix(_aq_tospace,0);
+		const CqVector3D* __pp;
+		CqVector3D* __pResult;
+		(p)->GetPointPtr( __pp );
+		(Result)->GetPointPtr( __pResult );
+		simd::transform( _aq_tospace, simd::CqTripleIn( simd::comps( __pp ), (p)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -447,6 +483,23 @@ void CqShaderExecEnv::SO_cmix( IqShaderData* color0, IqShaderData* color1, IqSha
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, color0, color1, value ) )
+	{
+		const CqColor* __pcolor0;
+		const CqColor* __pcolor1;
+		const TqFloat* __pvalue;
+		CqColor* __pResult;
+		(color0)->GetColorPtr( __pcolor0 );
+		(color1)->GetColorPtr( __pcolor1 );
+		(value)->GetFloatPtr( __pvalue );
+		(Result)->GetColorPtr( __pResult );
+		simd::ternaryT<simd::SqMixOp>( simd::CqTripleIn( simd::comps( __pcolor0 ), (color0)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __pcolor1 ), (color1)->Size() > 1 ),
+				simd::CqFloatIn( __pvalue, (value)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -506,6 +559,22 @@ void	CqShaderExecEnv::SO_fmix( IqShaderData* f0, IqShaderData* f1, IqShaderData*
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, f0, f1, value ) )
+	{
+		const TqFloat* __pf0;
+		const TqFloat* __pf1;
+		const TqFloat* __pvalue;
+		TqFloat* __pResult;
+		(f0)->GetFloatPtr( __pf0 );
+		(f1)->GetFloatPtr( __pf1 );
+		(value)->GetFloatPtr( __pvalue );
+		(Result)->GetFloatPtr( __pResult );
+		simd::ternaryF<simd::SqMixOp>( simd::CqFloatIn( __pf0, (f0)->Size() > 1 ),
+				simd::CqFloatIn( __pf1, (f1)->Size() > 1 ),
+				simd::CqFloatIn( __pvalue, (value)->Size() > 1 ), __pResult, __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -534,6 +603,23 @@ void    CqShaderExecEnv::SO_pmix( IqShaderData* p0, IqShaderData* p1, IqShaderDa
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, p0, p1, value ) )
+	{
+		const CqVector3D* __pp0;
+		const CqVector3D* __pp1;
+		const TqFloat* __pvalue;
+		CqVector3D* __pResult;
+		(p0)->GetPointPtr( __pp0 );
+		(p1)->GetPointPtr( __pp1 );
+		(value)->GetFloatPtr( __pvalue );
+		(Result)->GetPointPtr( __pResult );
+		simd::ternaryT<simd::SqMixOp>( simd::CqTripleIn( simd::comps( __pp0 ), (p0)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __pp1 ), (p1)->Size() > 1 ),
+				simd::CqFloatIn( __pvalue, (value)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -592,6 +678,23 @@ void    CqShaderExecEnv::SO_vmix( IqShaderData* v0, IqShaderData* v1, IqShaderDa
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	TqInt __n = __fVarying ? shadingPointCount() : 1;
+	if ( simd::directAccess( __n, Result, v0, v1, value ) )
+	{
+		const CqVector3D* __pv0;
+		const CqVector3D* __pv1;
+		const TqFloat* __pvalue;
+		CqVector3D* __pResult;
+		(v0)->GetVectorPtr( __pv0 );
+		(v1)->GetVectorPtr( __pv1 );
+		(value)->GetFloatPtr( __pvalue );
+		(Result)->GetVectorPtr( __pResult );
+		simd::ternaryT<simd::SqMixOp>( simd::CqTripleIn( simd::comps( __pv0 ), (v0)->Size() > 1 ),
+				simd::CqTripleIn( simd::comps( __pv1 ), (v1)->Size() > 1 ),
+				simd::CqFloatIn( __pvalue, (value)->Size() > 1 ),
+				simd::comps( __pResult ), __n, __fVarying ? &RS : 0 );
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -26,11 +26,76 @@
 
 #include	<stdio.h>
 
+#include	<vector>
+
 #include	"shaderexecenv.h"
 #include	<aqsis/math/vectorcast.h>
 
 namespace Aqsis {
 
+namespace {
+
+/** \brief An argument of a noise shadeop, as an array over the grid.
+ *
+ * The array noise functions take a value for each shading point.  Varying
+ * arguments are read in place, and uniform ones are repeated for each point.
+ */
+template<typename T>
+class CqGridArg
+{
+	public:
+		CqGridArg(const IqShaderData* arg, TqInt n)
+			: m_values(),
+			m_p(0)
+		{
+			if(arg->ArrayLength() == 0 && arg->Size() > 1
+				&& static_cast<TqInt>(arg->Size()) >= n)
+			{
+				arg->GetValuePtr(m_p);
+			}
+			else
+			{
+				m_values.resize(n);
+				for(TqInt i = 0; i < n; ++i)
+					arg->GetValue(m_values[i], i);
+				m_p = &m_values[0];
+			}
+		}
+		/// Values for all the shading points.
+		const T* get() const
+		{
+			return m_p;
+		}
+	private:
+		std::vector<T> m_values;
+		const T* m_p;
+};
+
+/// Store the noise of the running shading points in Result.
+template<typename T>
+void setGridResults(IqShaderData* Result, const std::vector<T>& values,
+		const CqBitVector& RS)
+{
+	for(TqInt i = 0, n = values.size(); i < n; ++i)
+	{
+		if(RS.Value(i))
+			Result->SetValue(values[i], i);
+	}
+}
+
+/// Store the vector noise of the running shading points in a color Result.
+void setGridColors(IqShaderData* Result, const std::vector<CqVector3D>& values,
+		const CqBitVector& RS)
+{
+	for(TqInt i = 0, n = values.size(); i < n; ++i)
+	{
+		if(RS.Value(i))
+			Result->SetColor(vectorCast<CqColor>(values[i]), i);
+	}
+}
+
+} // unnamed namespace
+
 
 void	CqShaderExecEnv::SO_frandom( IqShaderData* Result, IqShader* pShader )
 {
@@ -112,6 +177,15 @@ void	CqShaderExecEnv::SO_fnoise1( IqShaderData* v, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGNoise1(__v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -137,6 +211,16 @@ void CqShaderExecEnv::SO_fnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -163,6 +247,15 @@ void CqShaderExecEnv::SO_fnoise3( IqShaderData* p, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGNoise3(__p.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -189,6 +282,16 @@ void CqShaderExecEnv::SO_fnoise4( IqShaderData* p, IqShaderData* t, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGNoise4(__p.get(), __t.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -215,6 +318,15 @@ void	CqShaderExecEnv::SO_cnoise1( IqShaderData* v, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise1(__v.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -240,6 +352,16 @@ void CqShaderExecEnv::SO_cnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -266,6 +388,15 @@ void CqShaderExecEnv::SO_cnoise3( IqShaderData* p, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise3(__p.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -292,6 +423,16 @@ void CqShaderExecEnv::SO_cnoise4( IqShaderData* p, IqShaderData* t, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise4(__p.get(), __t.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -318,6 +459,15 @@ void CqShaderExecEnv::SO_pnoise1( IqShaderData* v, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise1(__v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -343,6 +493,16 @@ void CqShaderExecEnv::SO_pnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -369,6 +529,15 @@ void CqShaderExecEnv::SO_pnoise3( IqShaderData* p, IqShaderData* Result, IqShade
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise3(__p.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -395,6 +564,16 @@ void CqShaderExecEnv::SO_pnoise4( IqShaderData* p, IqShaderData* t, IqShaderData
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGNoise4(__p.get(), __t.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -422,6 +601,15 @@ void CqShaderExecEnv::SO_fcellnoise1( IqShaderData* v, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<TqFloat> __result(__n);
+		m_cellnoise.FCellNoise1(__v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -444,6 +632,15 @@ void CqShaderExecEnv::SO_ccellnoise1( IqShaderData* v, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise1(__v.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -466,6 +663,15 @@ void CqShaderExecEnv::SO_pcellnoise1( IqShaderData* v, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise1(__v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -491,6 +697,16 @@ void CqShaderExecEnv::SO_fcellnoise2( IqShaderData* u, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<TqFloat> __result(__n);
+		m_cellnoise.FCellNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -515,6 +731,16 @@ void CqShaderExecEnv::SO_ccellnoise2( IqShaderData* u, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -539,6 +765,16 @@ void CqShaderExecEnv::SO_pcellnoise2( IqShaderData* u, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise2(__u.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -565,6 +801,15 @@ void CqShaderExecEnv::SO_fcellnoise3( IqShaderData* p, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<TqFloat> __result(__n);
+		m_cellnoise.FCellNoise3(__p.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -586,6 +831,15 @@ void CqShaderExecEnv::SO_ccellnoise3( IqShaderData* p, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise3(__p.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -607,6 +861,15 @@ void CqShaderExecEnv::SO_pcellnoise3( IqShaderData* p, IqShaderData* Result, IqS
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise3(__p.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -632,6 +895,16 @@ void CqShaderExecEnv::SO_fcellnoise4( IqShaderData* p, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<TqFloat> __result(__n);
+		m_cellnoise.FCellNoise4(__p.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -656,6 +929,16 @@ void CqShaderExecEnv::SO_ccellnoise4( IqShaderData* p, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise4(__p.get(), __v.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -680,6 +963,16 @@ void CqShaderExecEnv::SO_pcellnoise4( IqShaderData* p, IqShaderData* v, IqShader
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_cellnoise.PCellNoise4(__p.get(), __v.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -708,6 +1001,16 @@ void CqShaderExecEnv::SO_fpnoise1( IqShaderData* v, IqShaderData* period, IqShad
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __period(period, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGPNoise1(__v.get(), __period.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -737,6 +1040,18 @@ void CqShaderExecEnv::SO_fpnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __uperiod(uperiod, __n);
+		CqGridArg<TqFloat> __vperiod(vperiod, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGPNoise2(__u.get(), __v.get(), __uperiod.get(), __vperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -769,6 +1084,16 @@ void CqShaderExecEnv::SO_fpnoise3( IqShaderData* p, IqShaderData* pperiod, IqSha
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGPNoise3(__p.get(), __pperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -799,6 +1124,18 @@ void CqShaderExecEnv::SO_fpnoise4( IqShaderData* p, IqShaderData* t, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		CqGridArg<TqFloat> __tperiod(tperiod, __n);
+		std::vector<TqFloat> __result(__n);
+		m_noise.FGPNoise4(__p.get(), __t.get(), __pperiod.get(), __tperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -831,6 +1168,16 @@ void CqShaderExecEnv::SO_cpnoise1( IqShaderData* v, IqShaderData* period, IqShad
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __period(period, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise1(__v.get(), __period.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -860,6 +1207,18 @@ void CqShaderExecEnv::SO_cpnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __uperiod(uperiod, __n);
+		CqGridArg<TqFloat> __vperiod(vperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise2(__u.get(), __v.get(), __uperiod.get(), __vperiod.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -892,6 +1251,16 @@ void CqShaderExecEnv::SO_cpnoise3( IqShaderData* p, IqShaderData* pperiod, IqSha
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise3(__p.get(), __pperiod.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -922,6 +1291,18 @@ void CqShaderExecEnv::SO_cpnoise4( IqShaderData* p, IqShaderData* t, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		CqGridArg<TqFloat> __tperiod(tperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise4(__p.get(), __t.get(), __pperiod.get(), __tperiod.get(), &__result[0], __n);
+		setGridColors(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -954,6 +1335,16 @@ void CqShaderExecEnv::SO_ppnoise1( IqShaderData* v, IqShaderData* period, IqShad
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __period(period, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise1(__v.get(), __period.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -983,6 +1374,18 @@ void CqShaderExecEnv::SO_ppnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<TqFloat> __u(u, __n);
+		CqGridArg<TqFloat> __v(v, __n);
+		CqGridArg<TqFloat> __uperiod(uperiod, __n);
+		CqGridArg<TqFloat> __vperiod(vperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise2(__u.get(), __v.get(), __uperiod.get(), __vperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -1015,6 +1418,16 @@ void CqShaderExecEnv::SO_ppnoise3( IqShaderData* p, IqShaderData* pperiod, IqSha
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise3(__p.get(), __pperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
@@ -1045,6 +1458,18 @@ void CqShaderExecEnv::SO_ppnoise4( IqShaderData* p, IqShaderData* t, IqShaderDat
 
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
+	if(__fVarying)
+	{
+		TqInt __n = shadingPointCount();
+		CqGridArg<CqVector3D> __p(p, __n);
+		CqGridArg<TqFloat> __t(t, __n);
+		CqGridArg<CqVector3D> __pperiod(pperiod, __n);
+		CqGridArg<TqFloat> __tperiod(tperiod, __n);
+		std::vector<CqVector3D> __result(__n);
+		m_noise.PGPNoise4(__p.get(), __t.get(), __pperiod.get(), __tperiod.get(), &__result[0], __n);
+		setGridResults(Result, __result, RS);
+		return;
+	}
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
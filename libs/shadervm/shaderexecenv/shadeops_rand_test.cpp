@@ -0,0 +1,305 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests comparing the noise shadeops on whole grids with the
+ * same shadeops run a point at a time.
+ */
+
+#include <aqsis/shadervm/ishaderexecenv.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../shadervariable.h"
+
+using namespace Aqsis;
+
+namespace {
+
+// Not a multiple of four, so that the scalar tail of the array noise runs too.
+const TqInt n = 23;
+// Marks results at the points which aren't running.
+const TqFloat untouched = -123.0f;
+
+/// Arguments taken by the noise shadeops.
+enum EqNoiseArg
+{
+	Arg_u,
+	Arg_v,
+	Arg_t,
+	Arg_uperiod,
+	Arg_vperiod,
+	Arg_tperiod,
+	Arg_p,
+	Arg_pperiod
+};
+
+TqFloat floatArg(EqNoiseArg arg, TqInt i)
+{
+	switch(arg)
+	{
+		case Arg_u:
+			return -4.5f + 0.5f*i;
+		case Arg_v:
+			return 2.2f - 0.37f*i;
+		case Arg_t:
+			return 0.09f*i*i - 1.5f;
+		case Arg_uperiod:
+			return TqFloat(i % 4 + 1);
+		case Arg_vperiod:
+			return TqFloat(i % 3 + 2);
+		case Arg_tperiod:
+		default:
+			return TqFloat(5 - i % 4);
+	}
+}
+
+CqVector3D pointArg(EqNoiseArg arg, TqInt i)
+{
+	if(arg == Arg_p)
+		return CqVector3D(floatArg(Arg_u, i), floatArg(Arg_v, i), 0.4f + 0.3f*i);
+	return CqVector3D(floatArg(Arg_uperiod, i), floatArg(Arg_vperiod, i), TqFloat(i % 5 + 1));
+}
+
+/** Create an argument for a shadeop.
+ *
+ * Varying arguments hold the value for each shading point, while uniform ones
+ * hold the value for the given point.
+ */
+IqShaderData* createArg(EqNoiseArg arg, bool varying, TqInt point = 0)
+{
+	IqShaderData* data = 0;
+	if(arg == Arg_p || arg == Arg_pperiod)
+	{
+		if(varying)
+			data = new CqShaderVariableVaryingPoint("arg");
+		else
+			data = new CqShaderVariableUniformPoint("arg");
+		data->Initialise(n);
+		for(TqInt i = 0; i < (varying ? n : 1); ++i)
+			data->SetPoint(pointArg(arg, varying ? i : point), i);
+	}
+	else
+	{
+		if(varying)
+			data = new CqShaderVariableVaryingFloat("arg");
+		else
+			data = new CqShaderVariableUniformFloat("arg");
+		data->Initialise(n);
+		for(TqInt i = 0; i < (varying ? n : 1); ++i)
+			data->SetFloat(floatArg(arg, varying ? i : point), i);
+	}
+	return data;
+}
+
+/// Create a result for a shadeop, with all values set to untouched.
+IqShaderData* createResult(EqVariableType type, bool varying)
+{
+	IqShaderData* data = 0;
+	switch(type)
+	{
+		case type_float:
+			if(varying)
+				data = new CqShaderVariableVaryingFloat("Result");
+			else
+				data = new CqShaderVariableUniformFloat("Result");
+			data->SetFloat(untouched);
+			break;
+		case type_color:
+			if(varying)
+				data = new CqShaderVariableVaryingColor("Result");
+			else
+				data = new CqShaderVariableUniformColor("Result");
+			data->SetColor(CqColor(untouched));
+			break;
+		default:
+			if(varying)
+				data = new CqShaderVariableVaryingPoint("Result");
+			else
+				data = new CqShaderVariableUniformPoint("Result");
+			data->SetPoint(CqVector3D(untouched, untouched, untouched));
+			break;
+	}
+	// Copy the first value to all the points.
+	data->Initialise(n);
+	return data;
+}
+
+/// Get a result as a vector, whatever its type.
+CqVector3D resultAt(const IqShaderData* result, TqInt i)
+{
+	switch(result->Type())
+	{
+		case type_float:
+		{
+			TqFloat f = 0;
+			result->GetFloat(f, i);
+			return CqVector3D(f, 0, 0);
+		}
+		case type_color:
+		{
+			CqColor c;
+			result->GetColor(c, i);
+			return CqVector3D(c.r(), c.g(), c.b());
+		}
+		default:
+		{
+			CqVector3D p;
+			result->GetPoint(p, i);
+			return p;
+		}
+	}
+}
+
+typedef void (IqShaderExecEnv::*TqNoiseOp1)(IqShaderData*, IqShaderData*, IqShader*);
+typedef void (IqShaderExecEnv::*TqNoiseOp2)(IqShaderData*, IqShaderData*,
+		IqShaderData*, IqShader*);
+typedef void (IqShaderExecEnv::*TqNoiseOp4)(IqShaderData*, IqShaderData*,
+		IqShaderData*, IqShaderData*, IqShaderData*, IqShader*);
+
+/// A noise shadeop, and the arguments it takes.
+struct SqNoiseOp
+{
+	const char* name;
+	EqVariableType resultType;
+	TqInt numArgs;
+	EqNoiseArg args[4];
+	TqNoiseOp1 op1;
+	TqNoiseOp2 op2;
+	TqNoiseOp4 op4;
+
+	void call(IqShaderExecEnv& env, IqShaderData** a, IqShaderData* result) const
+	{
+		switch(numArgs)
+		{
+			case 1:
+				(env.*op1)(a[0], result, 0);
+				break;
+			case 2:
+				(env.*op2)(a[0], a[1], result, 0);
+				break;
+			default:
+				(env.*op4)(a[0], a[1], a[2], a[3], result, 0);
+				break;
+		}
+	}
+};
+
+#define NOISE_OP1(name, type, a)  \
+	{#name, type, 1, {a}, &IqShaderExecEnv::SO_##name, 0, 0}
+#define NOISE_OP2(name, type, a, b)  \
+	{#name, type, 2, {a, b}, 0, &IqShaderExecEnv::SO_##name, 0}
+#define NOISE_OP4(name, type, a, b, c, d)  \
+	{#name, type, 4, {a, b, c, d}, 0, 0, &IqShaderExecEnv::SO_##name}
+
+const SqNoiseOp noiseOps[] = {
+	NOISE_OP1(fnoise1, type_float, Arg_u),
+	NOISE_OP2(fnoise2, type_float, Arg_u, Arg_v),
+	NOISE_OP1(fnoise3, type_float, Arg_p),
+	NOISE_OP2(fnoise4, type_float, Arg_p, Arg_t),
+	NOISE_OP1(cnoise1, type_color, Arg_u),
+	NOISE_OP2(cnoise2, type_color, Arg_u, Arg_v),
+	NOISE_OP1(cnoise3, type_color, Arg_p),
+	NOISE_OP2(cnoise4, type_color, Arg_p, Arg_t),
+	NOISE_OP1(pnoise1, type_point, Arg_u),
+	NOISE_OP2(pnoise2, type_point, Arg_u, Arg_v),
+	NOISE_OP1(pnoise3, type_point, Arg_p),
+	NOISE_OP2(pnoise4, type_point, Arg_p, Arg_t),
+	NOISE_OP1(fcellnoise1, type_float, Arg_u),
+	NOISE_OP2(fcellnoise2, type_float, Arg_u, Arg_v),
+	NOISE_OP1(fcellnoise3, type_float, Arg_p),
+	NOISE_OP2(fcellnoise4, type_float, Arg_p, Arg_t),
+	NOISE_OP1(ccellnoise1, type_color, Arg_u),
+	NOISE_OP2(ccellnoise2, type_color, Arg_u, Arg_v),
+	NOISE_OP1(ccellnoise3, type_color, Arg_p),
+	NOISE_OP2(ccellnoise4, type_color, Arg_p, Arg_t),
+	NOISE_OP1(pcellnoise1, type_point, Arg_u),
+	NOISE_OP2(pcellnoise2, type_point, Arg_u, Arg_v),
+	NOISE_OP1(pcellnoise3, type_point, Arg_p),
+	NOISE_OP2(pcellnoise4, type_point, Arg_p, Arg_t),
+	NOISE_OP2(fpnoise1, type_float, Arg_u, Arg_uperiod),
+	NOISE_OP4(fpnoise2, type_float, Arg_u, Arg_v, Arg_uperiod, Arg_vperiod),
+	NOISE_OP2(fpnoise3, type_float, Arg_p, Arg_pperiod),
+	NOISE_OP4(fpnoise4, type_float, Arg_p, Arg_t, Arg_pperiod, Arg_tperiod),
+	NOISE_OP2(cpnoise1, type_color, Arg_u, Arg_uperiod),
+	NOISE_OP4(cpnoise2, type_color, Arg_u, Arg_v, Arg_uperiod, Arg_vperiod),
+	NOISE_OP2(cpnoise3, type_color, Arg_p, Arg_pperiod),
+	NOISE_OP4(cpnoise4, type_color, Arg_p, Arg_t, Arg_pperiod, Arg_tperiod),
+	NOISE_OP2(ppnoise1, type_point, Arg_u, Arg_uperiod),
+	NOISE_OP4(ppnoise2, type_point, Arg_u, Arg_v, Arg_uperiod, Arg_vperiod),
+	NOISE_OP2(ppnoise3, type_point, Arg_p, Arg_pperiod),
+	NOISE_OP4(ppnoise4, type_point, Arg_p, Arg_t, Arg_pperiod, Arg_tperiod),
+};
+
+/** Check a shadeop run on a grid against the same shadeop run on each
+ * point with uniform arguments.
+ *
+ * Only the first argument is varying unless allVarying is set; the others
+ * then take their values at point 0.
+ */
+void checkNoiseOp(IqShaderExecEnv& env, const SqNoiseOp& op, bool allVarying)
+{
+	IqShaderData* args[4];
+	for(TqInt a = 0; a < op.numArgs; ++a)
+		args[a] = createArg(op.args[a], a == 0 || allVarying);
+	boost::scoped_ptr<IqShaderData> result(createResult(op.resultType, true));
+	op.call(env, args, result.get());
+	for(TqInt a = 0; a < op.numArgs; ++a)
+		delete args[a];
+
+	const CqBitVector& RS = env.RunningState();
+	for(TqInt i = 0; i < n; ++i)
+	{
+		BOOST_TEST_CHECKPOINT(op.name << " at point " << i);
+		for(TqInt a = 0; a < op.numArgs; ++a)
+			args[a] = createArg(op.args[a], false, a == 0 || allVarying ? i : 0);
+		boost::scoped_ptr<IqShaderData> pointResult(createResult(op.resultType, false));
+		op.call(env, args, pointResult.get());
+		for(TqInt a = 0; a < op.numArgs; ++a)
+			delete args[a];
+
+		if(!RS.Value(i))
+			pointResult.reset(createResult(op.resultType, false));
+		BOOST_CHECK_MESSAGE(resultAt(result.get(), i) == resultAt(pointResult.get(), 0),
+				op.name << " differs at point " << i);
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqShaderExecEnv_noise_grid_matches_points_test)
+{
+	boost::shared_ptr<IqShaderExecEnv> env = IqShaderExecEnv::create(0);
+	env->Initialise(n-1, 0, n-1, n, false, IqAttributesPtr(), IqTransformPtr(), 0, 0);
+	// Stop some points in each group of four.
+	env->ClearCurrentState();
+	for(TqInt i = 0; i < n; ++i)
+		env->CurrentState().SetValue(i, i % 3 != 1 && i != 8);
+	env->GetCurrentState();
+
+	for(TqUint i = 0; i < sizeof(noiseOps)/sizeof(noiseOps[0]); ++i)
+	{
+		checkNoiseOp(*env, noiseOps[i], true);
+		checkNoiseOp(*env, noiseOps[i], false);
+	}
+}
@@ -30,6 +30,10 @@
 #include "shaderexecenv.h"
 
 
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
+
 #include <aqsis/util/autobuffer.h>
 #include <aqsis/util/logging.h>
 
@@ -76,6 +80,9 @@ class Texture3dCache
         /// Find a point cloud with the given name, or open it from file.
         Partio::ParticlesData* find(const std::string& fileName)
         {
+#ifdef ENABLE_THREADING
+            boost::mutex::scoped_lock lock(m_mutex);
+#endif
             Partio::ParticlesDataMutable* pointFile = 0;
             FileMap::iterator ptcIter = m_files.find(fileName);
             if(ptcIter == m_files.end())
@@ -105,12 +112,18 @@ class Texture3dCache
         /// Flush all files from the cache.
         void clear()
         {
+#ifdef ENABLE_THREADING
+            boost::mutex::scoped_lock lock(m_mutex);
+#endif
             m_files.clear();
         }
 
     private:
         typedef std::map<std::string, boost::shared_ptr<Partio::ParticlesDataMutable> > FileMap;
         FileMap m_files;
+#ifdef ENABLE_THREADING
+        boost::mutex m_mutex;
+#endif
 };
 }
 
@@ -31,8 +31,12 @@
 
 #include	<map>
 #include	<string>
+#include	<cfloat>
 #include	<cstdio>
 #include	<cstring>
+#include	<vector>
+
+#include	<boost/scoped_array.hpp>
 
 #include	"shaderexecenv.h"
 #include	<aqsis/tex/filtering/ienvironmentsampler.h>
@@ -42,6 +46,8 @@
 #include	<aqsis/tex/filtering/itexturesampler.h>
 #include	<aqsis/tex/io/texfileheader.h>
 #include	<aqsis/tex/buffers/channellist.h>
+#include	<aqsis/core/iraytrace.h>
+#include	<aqsis/math/random.h>
 
 namespace Aqsis
 {
@@ -210,6 +216,22 @@ class CqSampleOptionExtractorBase
 				opts.setStartChannel(tmp);
 			}
 		}
+
+		/** \brief Determine whether any of the cached options vary over the grid.
+		 *
+		 * If not, extractVarying(0, opts) gives the options for every
+		 * shading point.
+		 */
+		bool hasVaryingOptions() const
+		{
+			return isVarying(m_sBlur) || isVarying(m_tBlur) || isVarying(m_channel);
+		}
+
+	private:
+		static bool isVarying(const IqShaderData* param)
+		{
+			return param && param->Class() == class_varying;
+		}
 };
 
 
@@ -255,9 +277,53 @@ class CqSampleOptionExtractor
 		}
 
 		CqSampleOptionExtractorBase<CqTextureSampleOptions>::extractVarying;
+		CqSampleOptionExtractorBase<CqTextureSampleOptions>::hasVaryingOptions;
 };
 
 
+//------------------------------------------------------------------------------
+/** \brief Sample a texture over the filter regions of the running points of
+ * a grid.
+ *
+ * When none of the sample options vary over the grid, all the regions are
+ * handed to the sampler together so that it can order the texture lookups
+ * for cache coherence.  Otherwise each point is sampled with its own options.
+ *
+ * \param texSampler - sampler for the texture
+ * \param regions - filter region for each shading point
+ * \param runningState - flags for the shading points to sample
+ * \param optExtractor - extractor for the varying sample options
+ * \param sampleOpts - sample options, with the uniform options already set
+ * \param outSamps - output samples; sampleOpts.numChannels() are placed at
+ *                   outSamps + i*sampleOpts.numChannels() for shading point i.
+ */
+template<typename RegionT>
+void sampleTextureGrid(const IqTextureSampler& texSampler,
+		const std::vector<RegionT>& regions, const CqBitVector& runningState,
+		CqSampleOptionExtractor& optExtractor,
+		CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	TqInt numPoints = regions.size();
+	if(!optExtractor.hasVaryingOptions())
+	{
+		optExtractor.extractVarying(0, sampleOpts);
+		texSampler.sampleGrid(&regions[0], numPoints, &runningState,
+				sampleOpts, outSamps);
+		return;
+	}
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(runningState.Value(gridIdx))
+		{
+			optExtractor.extractVarying(gridIdx, sampleOpts);
+			texSampler.sample(regions[gridIdx], sampleOpts,
+					outSamps + gridIdx*numChannels);
+		}
+	}
+}
+
+
 //------------------------------------------------------------------------------
 class CqShadowOptionExtractor
 	: private CqSampleOptionExtractorBase<CqShadowSampleOptions>
@@ -350,6 +416,44 @@ void getRenderContextShadowOpts(const IqRenderer& context, CqShadowSampleOptions
 		sampleOpts.setBiasHigh(*biasPtr);
 }
 
+/// Ray offset used by shadow("raytrace") when no shadow bias is given.
+const TqFloat defaultRayBias = 0.01f;
+
+/** Get the uniform value of a float parameter from an RSL varargs list.
+ *
+ * 
+eturn true if the parameter was found.
+ */
+bool uniformFloatParam(int cParams, IqShaderData** apParams, const char* name,
+		TqFloat& value)
+{
+	CqString paramName;
+	for(int i = 0; i + 1 < cParams; i += 2)
+	{
+		apParams[i]->GetString(paramName, 0);
+		if(paramName == name && apParams[i+1]->Type() == type_float)
+		{
+			apParams[i+1]->GetFloat(value, 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Get a random key from the bits of a position.
+TqUint positionKey(const CqVector3D& p)
+{
+	TqUint key = 0;
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		TqUint bits = 0;
+		TqFloat coord = p[i];
+		std::memcpy(&bits, &coord, sizeof(bits));
+		key = hashRandom(key ^ bits);
+	}
+	return key;
+}
+
 } // unnamed namespace.
 
 //----------------------------------------------------------------------
@@ -386,12 +490,13 @@ void CqShaderExecEnv::SO_ftexture2(IqShaderData* name, IqShaderData* s, IqShader
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
-	gridIdx = 0;
-	do
+	const TqInt numPoints = shadingPointCount();
+	std::vector<SqSamplePllgram> regions(numPoints,
+			SqSamplePllgram(CqVector2D(), CqVector2D(), CqVector2D()));
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Edges of region to be filtered.
 			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
 			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
@@ -401,14 +506,18 @@ void CqShaderExecEnv::SO_ftexture2(IqShaderData* name, IqShaderData* s, IqShader
 			s->GetFloat(ss,gridIdx);
 			t->GetFloat(tt,gridIdx);
 			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(region, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
+			regions[gridIdx] = SqSamplePllgram(CqVector2D(ss,tt), diffUst, diffVst);
 		}
 	}
-	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(numPoints, 0);
+	sampleTextureGrid(texSampler, regions, RS, optExtractor, sampleOpts, &texSamples[0]);
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+			Result->SetFloat(texSamples[gridIdx], gridIdx);
+	}
 }
 
 //----------------------------------------------------------------------
@@ -438,12 +547,13 @@ void CqShaderExecEnv::SO_ftexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
-	gridIdx = 0;
-	do
+	const TqInt numPoints = shadingPointCount();
+	std::vector<SqSampleQuad> quads(numPoints,
+			SqSampleQuad(CqVector2D(), CqVector2D(), CqVector2D(), CqVector2D()));
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Compute the sample quadrilateral box.  Unfortunately we need all
 			// these temporaries because the shader data interface leaves a bit
 			// to be desired ;-)
@@ -455,16 +565,19 @@ void CqShaderExecEnv::SO_ftexture3( IqShaderData* name, IqShaderData* s1, IqShad
 			TqFloat t2Val = 0;  t2->GetFloat(t2Val, gridIdx);
 			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
 			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
-			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
+			quads[gridIdx] = SqSampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
 						CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(sampleQuad, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
 		}
 	}
-	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(numPoints, 0);
+	sampleTextureGrid(texSampler, quads, RS, optExtractor, sampleOpts, &texSamples[0]);
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+			Result->SetFloat(texSamples[gridIdx], gridIdx);
+	}
 }
 
 //----------------------------------------------------------------------
@@ -501,12 +614,13 @@ void CqShaderExecEnv::SO_ctexture2( IqShaderData* name, IqShaderData* s, IqShade
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
-	gridIdx = 0;
-	do
+	const TqInt numPoints = shadingPointCount();
+	std::vector<SqSamplePllgram> regions(numPoints,
+			SqSamplePllgram(CqVector2D(), CqVector2D(), CqVector2D()));
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Edges of region to be filtered.
 			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
 			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
@@ -516,15 +630,21 @@ void CqShaderExecEnv::SO_ctexture2( IqShaderData* name, IqShaderData* s, IqShade
 			s->GetFloat(ss,gridIdx);
 			t->GetFloat(tt,gridIdx);
 			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(region, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
-			Result->SetColor(resultCol, gridIdx);
+			regions[gridIdx] = SqSamplePllgram(CqVector2D(ss,tt), diffUst, diffVst);
+		}
+	}
+
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(3*numPoints, 0);
+	sampleTextureGrid(texSampler, regions, RS, optExtractor, sampleOpts, &texSamples[0]);
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+		{
+			const TqFloat* texSample = &texSamples[3*gridIdx];
+			Result->SetColor(CqColor(texSample[0], texSample[1], texSample[2]), gridIdx);
 		}
 	}
-	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
 }
 
 //----------------------------------------------------------------------
@@ -554,12 +674,13 @@ void CqShaderExecEnv::SO_ctexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
-	gridIdx = 0;
-	do
+	const TqInt numPoints = shadingPointCount();
+	std::vector<SqSampleQuad> quads(numPoints,
+			SqSampleQuad(CqVector2D(), CqVector2D(), CqVector2D(), CqVector2D()));
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Compute the sample quadrilateral box.  Unfortunately we need all
 			// these temporaries because the shader data interface leaves a bit
 			// to be desired ;-)
@@ -571,16 +692,22 @@ void CqShaderExecEnv::SO_ctexture3( IqShaderData* name, IqShaderData* s1, IqShad
 			TqFloat t2Val = 0;  t2->GetFloat(t2Val, gridIdx);
 			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
 			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
-			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
+			quads[gridIdx] = SqSampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
 					CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(sampleQuad, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
-			Result->SetColor(resultCol, gridIdx);
 		}
 	}
-	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(3*numPoints, 0);
+	sampleTextureGrid(texSampler, quads, RS, optExtractor, sampleOpts, &texSamples[0]);
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+		{
+			const TqFloat* texSample = &texSamples[3*gridIdx];
+			Result->SetColor(CqColor(texSample[0], texSample[1], texSample[2]), gridIdx);
+		}
+	}
 }
 
 
@@ -862,6 +989,11 @@ void CqShaderExecEnv::SO_shadow( IqShaderData* name, IqShaderData* P, IqShaderDa
 	// Get the shadow map.
 	CqString mapName;
 	name->GetString(mapName, gridIdx);
+	if(mapName == "raytrace")
+	{
+		traceShadow(P, Result, cParams, apParams);
+		return;
+	}
 	const IqShadowSampler& shadSampler
 		= getRenderContext()->textureCache().findShadowSampler(mapName.c_str());
 
@@ -901,6 +1033,213 @@ void CqShaderExecEnv::SO_shadow( IqShaderData* name, IqShaderData* P, IqShaderDa
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
 }
 
+/** Trace shadow rays from each point of P towards the light.
+ *
+ * Inside illuminate() the ray ends at the light position, while inside
+ * solar() it runs off along -L without limit.  The shadow bias offsets both
+ * ends of the ray so that surfaces don't shadow themselves.  No filtering is
+ * done; each point is either fully shadowed or not at all.
+ */
+void CqShaderExecEnv::traceShadow(IqShaderData* P, IqShaderData* Result, int cParams, IqShaderData** apParams)
+{
+	IqRaytrace* raytracer = getRenderContext()->pRaytracer();
+
+	CqShadowSampleOptions sampleOpts;
+	getRenderContextShadowOpts(*getRenderContext(), sampleOpts);
+	CqShadowOptionExtractor optExtractor(apParams, cParams, sampleOpts);
+
+	TqInt numPoints = shadingPointCount();
+	std::vector<SqRay> rays;
+	std::vector<TqInt> rayPoints;
+	rays.reserve(numPoints);
+	rayPoints.reserve(numPoints);
+
+	const CqBitVector& RS = RunningState();
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(!RS.Value(gridIdx))
+			continue;
+		Result->SetFloat(0, gridIdx);
+		CqVector3D dir;
+		if(!raytracer || !L())
+			continue;
+		L()->GetVector(dir, gridIdx);
+		TqFloat len = dir.Magnitude();
+		if(len <= 0)
+			continue;
+		optExtractor.extractVarying(gridIdx, sampleOpts);
+		TqFloat bias = sampleOpts.biasLow() > 0 ? sampleOpts.biasLow() : defaultRayBias;
+
+		SqRay ray;
+		P->GetPoint(ray.origin, gridIdx);
+		ray.direction = -dir;
+		ray.tMin = bias/len;
+		ray.tMax = m_distantLight ? FLT_MAX : 1 - bias/len;
+		if(ray.tMax <= ray.tMin)
+			continue;
+		rays.push_back(ray);
+		rayPoints.push_back(gridIdx);
+	}
+
+	if(rays.empty())
+		return;
+	boost::scoped_array<bool> occluded(new bool[rays.size()]);
+	raytracer->Occluded(&rays[0], rays.size(), occluded.get());
+	for(TqInt i = 0, end = rays.size(); i < end; ++i)
+	{
+		if(occluded[i])
+			Result->SetFloat(1, rayPoints[i]);
+	}
+}
+
+/** Trace occlusion rays from each point of P.
+ *
+ * The rays are cosine distributed over the cone of half angle "coneangle"
+ * about N, stratified in the polar angle, and offset from P by "bias".  Rays
+ * are only traced out to "maxdist".  The sample positions are keyed by the
+ * position of each point, so that the result doesn't depend on the order in
+ * which grids are shaded.  Rays for the same sample at neighbouring points
+ * are traced together, as they tend to be coherent.
+ */
+void CqShaderExecEnv::traceOcclusion(IqShaderData* P, IqShaderData* N, IqShaderData* samples,
+		IqShaderData* Result, int cParams, IqShaderData** apParams)
+{
+	IqRaytrace* raytracer = getRenderContext()->pRaytracer();
+
+	TqFloat coneAngle = M_PI_2;
+	TqFloat bias = defaultRayBias;
+	TqFloat maxDist = FLT_MAX;
+	uniformFloatParam(cParams, apParams, "coneangle", coneAngle);
+	uniformFloatParam(cParams, apParams, "bias", bias);
+	uniformFloatParam(cParams, apParams, "maxdist", maxDist);
+	coneAngle = clamp(coneAngle, 0.0f, static_cast<TqFloat>(M_PI_2));
+	TqFloat sinMax = std::sin(coneAngle);
+	TqFloat sin2Max = sinMax*sinMax;
+	TqFloat numSamplesF = 1;
+	if(samples)
+		samples->GetFloat(numSamplesF, 0);
+	TqInt numSamples = std::max(1, static_cast<TqInt>(numSamplesF));
+
+	// Work out the frame and random offsets of each point.
+	TqInt numPoints = shadingPointCount();
+	std::vector<TqInt> points;
+	std::vector<CqVector3D> origins, normals, tangents, bitangents;
+	std::vector<TqFloat> offsets1, offsets2;
+	const CqBitVector& RS = RunningState();
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(!RS.Value(gridIdx))
+			continue;
+		Result->SetFloat(0, gridIdx);
+		CqVector3D PP, NN;
+		P->GetPoint(PP, gridIdx);
+		N->GetNormal(NN, gridIdx);
+		if(!raytracer || NN.Magnitude2() <= 0)
+			continue;
+		NN.Unit();
+		// Any vector perpendicular to N will do for the tangent.
+		CqVector3D T = std::fabs(NN.x()) < 0.5f ? CqVector3D(1, 0, 0) : CqVector3D(0, 1, 0);
+		T = (T % NN).Unit();
+		TqUint key = positionKey(PP);
+		points.push_back(gridIdx);
+		origins.push_back(PP);
+		normals.push_back(NN);
+		tangents.push_back(T);
+		bitangents.push_back(NN % T);
+		key = hashRandom(key);
+		offsets1.push_back((key >> 8)*(1.0f/(1 << 24)));
+		key = hashRandom(key);
+		offsets2.push_back((key >> 8)*(1.0f/(1 << 24)));
+	}
+	if(points.empty())
+		return;
+
+	TqInt numRayPoints = points.size();
+	std::vector<TqInt> hits(numRayPoints, 0);
+	std::vector<SqRay> rays(numRayPoints);
+	boost::scoped_array<bool> occluded(new bool[numRayPoints]);
+	for(TqInt sample = 0; sample < numSamples; ++sample)
+	{
+		for(TqInt i = 0; i < numRayPoints; ++i)
+		{
+			// Stratified in sin^2 of the angle from N, which gives a cosine
+			// distribution, and spread around N by the golden ratio.
+			TqFloat u1 = (sample + offsets1[i])/numSamples;
+			TqFloat u2 = sample*0.618034f + offsets2[i];
+			u2 -= std::floor(u2);
+			TqFloat sin2Theta = u1*sin2Max;
+			TqFloat sinTheta = std::sqrt(sin2Theta);
+			TqFloat cosTheta = std::sqrt(std::max(0.0f, 1 - sin2Theta));
+			TqFloat phi = 2*M_PI*u2;
+			SqRay& ray = rays[i];
+			ray.origin = origins[i];
+			ray.direction = cosTheta*normals[i]
+				+ (sinTheta*std::cos(phi))*tangents[i]
+				+ (sinTheta*std::sin(phi))*bitangents[i];
+			ray.tMin = bias;
+			ray.tMax = maxDist;
+		}
+		raytracer->Occluded(&rays[0], numRayPoints, occluded.get());
+		for(TqInt i = 0; i < numRayPoints; ++i)
+			hits[i] += occluded[i];
+	}
+	for(TqInt i = 0; i < numRayPoints; ++i)
+		Result->SetFloat(static_cast<TqFloat>(hits[i])/numSamples, points[i]);
+}
+
+/** Trace a ray from each point of Psrc to the matching point of Pdst.
+ *
+ * The raytracing database holds only opaque surfaces, so the result is white
+ * where nothing lies between the points and black otherwise.  Both ends of
+ * the segment are offset by "bias".
+ */
+void CqShaderExecEnv::SO_transmission(IqShaderData* Psrc, IqShaderData* Pdst, IqShaderData* Result, IqShader* pShader, int cParams, IqShaderData** apParams)
+{
+	if(!getRenderContext())
+		return;
+	IqRaytrace* raytracer = getRenderContext()->pRaytracer();
+	TqFloat bias = defaultRayBias;
+	uniformFloatParam(cParams, apParams, "bias", bias);
+
+	TqInt numPoints = shadingPointCount();
+	std::vector<SqRay> rays;
+	std::vector<TqInt> rayPoints;
+	rays.reserve(numPoints);
+	rayPoints.reserve(numPoints);
+
+	const CqBitVector& RS = RunningState();
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(!RS.Value(gridIdx))
+			continue;
+		Result->SetColor(gColWhite, gridIdx);
+		if(!raytracer)
+			continue;
+		SqRay ray;
+		CqVector3D dst;
+		Psrc->GetPoint(ray.origin, gridIdx);
+		Pdst->GetPoint(dst, gridIdx);
+		ray.direction = dst - ray.origin;
+		TqFloat len = ray.direction.Magnitude();
+		if(len <= 2*bias)
+			continue;
+		ray.tMin = bias/len;
+		ray.tMax = 1 - bias/len;
+		rays.push_back(ray);
+		rayPoints.push_back(gridIdx);
+	}
+
+	if(rays.empty())
+		return;
+	boost::scoped_array<bool> occluded(new bool[rays.size()]);
+	raytracer->Occluded(&rays[0], rays.size(), occluded.get());
+	for(TqInt i = 0, end = rays.size(); i < end; ++i)
+	{
+		if(occluded[i])
+			Result->SetColor(gColBlack, rayPoints[i]);
+	}
+}
+
 //----------------------------------------------------------------------
 // shadow(S,P,P,P,P)
 
@@ -1313,6 +1652,11 @@ void CqShaderExecEnv::SO_occlusion(IqShaderData* name, IqShaderData* P, IqShader
 	// Get the occlusion map.
 	CqString mapName;
 	name->GetString(mapName, gridIdx);
+	if(mapName == "raytrace")
+	{
+		traceOcclusion(P, N, samples, Result, cParams, apParams);
+		return;
+	}
 	const IqOcclusionSampler& occSampler
 		= getRenderContext()->textureCache().findOcclusionSampler(mapName.c_str());
 
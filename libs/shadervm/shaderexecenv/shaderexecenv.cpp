@@ -140,6 +140,7 @@ CqShaderExecEnv::CqShaderExecEnv(IqRenderer* pRenderContext)
 	m_shadingPointCount(0),
 	m_li(0),
 	m_Illuminate(0),
+	m_distantLight(false),
 	m_IlluminanceCacheValid(false),
 	m_gatherSample(0),
 	m_pAttributes(),
@@ -193,6 +194,7 @@ void CqShaderExecEnv::Initialise( const TqInt uGridRes, const TqInt vGridRes,
 
 	m_li = 0;
 	m_Illuminate = 0;
+	m_distantLight = false;
 	m_IlluminanceCacheValid = false;
 
 	// Initialise the state bitvectors
@@ -383,6 +383,22 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 								 IqShaderData* result, int cParams,
 								 IqShaderData** apParams, IqShader* pShader);
 
+		/// Helper function for SO_shadow, implementing shadow("raytrace", P).
+		///
+		/// Traces a ray from each point towards the light with the renderer's
+		/// raytracer, storing 1 in result for occluded points and 0 otherwise.
+		void traceShadow(IqShaderData* P, IqShaderData* result, int cParams,
+						 IqShaderData** apParams);
+
+		/// Helper function for SO_occlusion and SO_occlusion_rt, implementing
+		/// occlusion with the renderer's raytracer.
+		///
+		/// Traces samples rays over the cone about N from each point, storing
+		/// the fraction which hit anything in result.
+		void traceOcclusion(IqShaderData* P, IqShaderData* N,
+							IqShaderData* samples, IqShaderData* result,
+							int cParams, IqShaderData** apParams);
+
 		/// Turn 1D iteration into 2D grid indices
 		///
 		/// u is the fast changing index; v is slow changing.
@@ -430,6 +446,7 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 		TqInt	m_shadingPointCount;			///< The resolution of the grid.
 		TqUint	m_li;					///< Light index, used during illuminance loop.
 		TqInt	m_Illuminate;
+		bool	m_distantLight;				///< True inside solar(), where L is a direction rather than a position.
 		bool	m_IlluminanceCacheValid;	///< Flag indicating whether the illuminance cache is valid.
 		TqUint	m_gatherSample;				///< Sample index, used during gather loop.
 		IqConstAttributesPtr m_pAttributes;	///< Pointer to the associated attributes.
@@ -557,6 +574,7 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 		virtual STD_SO	SO_specular( NORMALVAL N, VECTORVAL V, FLOATVAL roughness, DEFPARAM );
 		virtual STD_SO	SO_phong( NORMALVAL N, VECTORVAL V, FLOATVAL size, DEFPARAM );
 		virtual STD_SO	SO_trace( POINTVAL P, VECTORVAL R, DEFPARAM );
+		virtual STD_SO	SO_transmission( POINTVAL Psrc, POINTVAL Pdst, DEFPARAMVAR );
 		virtual STD_SO	SO_ftexture1( STRINGVAL name, DEFPARAMVAR );
 		virtual STD_SO	SO_ftexture2( STRINGVAL name, FLOATVAL s, FLOATVAL t, DEFPARAMVAR );
 		virtual STD_SO	SO_ftexture3( STRINGVAL name, FLOATVAL s1, FLOATVAL t1, FLOATVAL s2, FLOATVAL t2, FLOATVAL s3, FLOATVAL t3, FLOATVAL s4, FLOATVAL t4, DEFPARAMVAR );
@@ -27,29 +27,67 @@
 #include	"shaderstack.h"
 #include	<aqsis/shadervm/ishaderdata.h>
 
-#undef SHADERSTACKSTATS /* define if you want to know at run-time the max. depth of stack */
+#ifdef ENABLE_THREADING
+#include	<boost/thread/tss.hpp>
+#endif
 
 
 namespace Aqsis {
 
 TqUint   CqShaderStack::m_samples = 18;
-TqUint   CqShaderStack::m_maxsamples = 18;
 
-std::deque<CqShaderVariableUniformFloat*>			CqShaderStack::m_UFPool;
-std::deque<CqShaderVariableUniformPoint*>			CqShaderStack::m_UPPool;
-std::deque<CqShaderVariableUniformString*>			CqShaderStack::m_USPool;
-std::deque<CqShaderVariableUniformColor*>			CqShaderStack::m_UCPool;
-std::deque<CqShaderVariableUniformNormal*>			CqShaderStack::m_UNPool;
-std::deque<CqShaderVariableUniformVector*>			CqShaderStack::m_UVPool;
-std::deque<CqShaderVariableUniformMatrix*>			CqShaderStack::m_UMPool;
+namespace {
+
+/// Delete all the variables held in a pool of temporaries.
+template<typename T>
+void deletePoolContents(std::deque<T*>& pool)
+{
+	while( !pool.empty() )
+	{
+		delete(pool.front());
+		pool.pop_front();
+	}
+}
+
+} // unnamed namespace
+
+CqShaderStack::SqTempPools::~SqTempPools()
+{
+	clear();
+}
+
+void CqShaderStack::SqTempPools::clear()
+{
+	deletePoolContents(m_UFPool);
+	deletePoolContents(m_VFPool);
+	deletePoolContents(m_UPPool);
+	deletePoolContents(m_VPPool);
+	deletePoolContents(m_USPool);
+	deletePoolContents(m_VSPool);
+	deletePoolContents(m_UCPool);
+	deletePoolContents(m_VCPool);
+	deletePoolContents(m_UNPool);
+	deletePoolContents(m_VNPool);
+	deletePoolContents(m_UVPool);
+	deletePoolContents(m_VVPool);
+	deletePoolContents(m_UMPool);
+	deletePoolContents(m_VMPool);
+}
 
-std::deque<CqShaderVariableVaryingFloat*>			CqShaderStack::m_VFPool;
-std::deque<CqShaderVariableVaryingPoint*>			CqShaderStack::m_VPPool;
-std::deque<CqShaderVariableVaryingString*>			CqShaderStack::m_VSPool;
-std::deque<CqShaderVariableVaryingColor*>			CqShaderStack::m_VCPool;
-std::deque<CqShaderVariableVaryingNormal*>			CqShaderStack::m_VNPool;
-std::deque<CqShaderVariableVaryingVector*>			CqShaderStack::m_VVPool;
-std::deque<CqShaderVariableVaryingMatrix*>			CqShaderStack::m_VMPool;
+CqShaderStack::SqTempPools& CqShaderStack::tempPools()
+{
+#ifdef ENABLE_THREADING
+	// Each rendering thread recycles its own temporaries; the pools are
+	// deleted automatically when the thread exits.
+	static boost::thread_specific_ptr<SqTempPools> threadPools;
+	if(!threadPools.get())
+		threadPools.reset(new SqTempPools());
+	return *threadPools;
+#else
+	static SqTempPools pools;
+	return pools;
+#endif
+}
 
 
 //----------------------------------------------------------------------
@@ -59,29 +97,30 @@ std::deque<CqShaderVariableVaryingMatrix*>			CqShaderStack::m_VMPool;
 
 IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _class )
 {
+	SqTempPools& pools = tempPools();
 	switch ( type )
 	{
 			case type_float:
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UFPool.empty() )
+					if( pools.m_UFPool.empty() )
 						return( new CqShaderVariableUniformFloat() );
 					else
 					{
-						IqShaderData* ret = m_UFPool.front();
-						m_UFPool.pop_front();
+						IqShaderData* ret = pools.m_UFPool.front();
+						pools.m_UFPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VFPool.empty() )
+					if( pools.m_VFPool.empty() )
 						return( new CqShaderVariableVaryingFloat() );
 					else
 					{
-						IqShaderData* ret = m_VFPool.front();
-						m_VFPool.pop_front();
+						IqShaderData* ret = pools.m_VFPool.front();
+						pools.m_VFPool.pop_front();
 						return( ret );
 					}
 				}
@@ -91,23 +130,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UPPool.empty() )
+					if( pools.m_UPPool.empty() )
 						return( new CqShaderVariableUniformPoint() );
 					else
 					{
-						IqShaderData* ret = m_UPPool.front();
-						m_UPPool.pop_front();
+						IqShaderData* ret = pools.m_UPPool.front();
+						pools.m_UPPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VPPool.empty() )
+					if( pools.m_VPPool.empty() )
 						return( new CqShaderVariableVaryingPoint() );
 					else
 					{
-						IqShaderData* ret = m_VPPool.front();
-						m_VPPool.pop_front();
+						IqShaderData* ret = pools.m_VPPool.front();
+						pools.m_VPPool.pop_front();
 						return( ret );
 					}
 				}
@@ -117,23 +156,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_USPool.empty() )
+					if( pools.m_USPool.empty() )
 						return( new CqShaderVariableUniformString() );
 					else
 					{
-						IqShaderData* ret = m_USPool.front();
-						m_USPool.pop_front();
+						IqShaderData* ret = pools.m_USPool.front();
+						pools.m_USPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VSPool.empty() )
+					if( pools.m_VSPool.empty() )
 						return( new CqShaderVariableVaryingString() );
 					else
 					{
-						IqShaderData* ret = m_VSPool.front();
-						m_VSPool.pop_front();
+						IqShaderData* ret = pools.m_VSPool.front();
+						pools.m_VSPool.pop_front();
 						return( ret );
 					}
 				}
@@ -143,23 +182,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UCPool.empty() )
+					if( pools.m_UCPool.empty() )
 						return( new CqShaderVariableUniformColor() );
 					else
 					{
-						IqShaderData* ret = m_UCPool.front();
-						m_UCPool.pop_front();
+						IqShaderData* ret = pools.m_UCPool.front();
+						pools.m_UCPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VCPool.empty() )
+					if( pools.m_VCPool.empty() )
 						return( new CqShaderVariableVaryingColor() );
 					else
 					{
-						IqShaderData* ret = m_VCPool.front();
-						m_VCPool.pop_front();
+						IqShaderData* ret = pools.m_VCPool.front();
+						pools.m_VCPool.pop_front();
 						return( ret );
 					}
 				}
@@ -169,23 +208,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UNPool.empty() )
+					if( pools.m_UNPool.empty() )
 						return( new CqShaderVariableUniformNormal() );
 					else
 					{
-						IqShaderData* ret = m_UNPool.front();
-						m_UNPool.pop_front();
+						IqShaderData* ret = pools.m_UNPool.front();
+						pools.m_UNPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VNPool.empty() )
+					if( pools.m_VNPool.empty() )
 						return( new CqShaderVariableVaryingNormal() );
 					else
 					{
-						IqShaderData* ret = m_VNPool.front();
-						m_VNPool.pop_front();
+						IqShaderData* ret = pools.m_VNPool.front();
+						pools.m_VNPool.pop_front();
 						return( ret );
 					}
 				}
@@ -195,23 +234,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UVPool.empty() )
+					if( pools.m_UVPool.empty() )
 						return( new CqShaderVariableUniformVector() );
 					else
 					{
-						IqShaderData* ret = m_UVPool.front();
-						m_UVPool.pop_front();
+						IqShaderData* ret = pools.m_UVPool.front();
+						pools.m_UVPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VVPool.empty() )
+					if( pools.m_VVPool.empty() )
 						return( new CqShaderVariableVaryingVector() );
 					else
 					{
-						IqShaderData* ret = m_VVPool.front();
-						m_VVPool.pop_front();
+						IqShaderData* ret = pools.m_VVPool.front();
+						pools.m_VVPool.pop_front();
 						return( ret );
 					}
 				}
@@ -221,23 +260,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UMPool.empty() )
+					if( pools.m_UMPool.empty() )
 						return( new CqShaderVariableUniformMatrix() );
 					else
 					{
-						IqShaderData* ret = m_UMPool.front();
-						m_UMPool.pop_front();
+						IqShaderData* ret = pools.m_UMPool.front();
+						pools.m_UMPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VMPool.empty() )
+					if( pools.m_VMPool.empty() )
 						return( new CqShaderVariableVaryingMatrix() );
 					else
 					{
-						IqShaderData* ret = m_VMPool.front();
-						m_VMPool.pop_front();
+						IqShaderData* ret = pools.m_VMPool.front();
+						pools.m_VMPool.pop_front();
 						return( ret );
 					}
 				}
@@ -256,6 +295,7 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
  */
 void CqShaderStack::Release( SqStackEntry s )
 {
+	SqTempPools& pools = tempPools();
 	if( s.m_IsTemp )
 	{
 		switch( s.m_Data->Type() )
@@ -263,63 +303,63 @@ void CqShaderStack::Release( SqStackEntry s )
 				case type_float:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UFPool.push_back(reinterpret_cast<CqShaderVariableUniformFloat*>(s.m_Data) );
+						pools.m_UFPool.push_back(reinterpret_cast<CqShaderVariableUniformFloat*>(s.m_Data) );
 					else
-						m_VFPool.push_back(reinterpret_cast<CqShaderVariableVaryingFloat*>(s.m_Data) );
+						pools.m_VFPool.push_back(reinterpret_cast<CqShaderVariableVaryingFloat*>(s.m_Data) );
 					break;
 				}
 
 				case type_point:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UPPool.push_back(reinterpret_cast<CqShaderVariableUniformPoint*>(s.m_Data) );
+						pools.m_UPPool.push_back(reinterpret_cast<CqShaderVariableUniformPoint*>(s.m_Data) );
 					else
-						m_VPPool.push_back(reinterpret_cast<CqShaderVariableVaryingPoint*>(s.m_Data) );
+						pools.m_VPPool.push_back(reinterpret_cast<CqShaderVariableVaryingPoint*>(s.m_Data) );
 					break;
 				}
 
 				case type_string:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_USPool.push_back(reinterpret_cast<CqShaderVariableUniformString*>(s.m_Data) );
+						pools.m_USPool.push_back(reinterpret_cast<CqShaderVariableUniformString*>(s.m_Data) );
 					else
-						m_VSPool.push_back(reinterpret_cast<CqShaderVariableVaryingString*>(s.m_Data) );
+						pools.m_VSPool.push_back(reinterpret_cast<CqShaderVariableVaryingString*>(s.m_Data) );
 					break;
 				}
 
 				case type_color:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UCPool.push_back(reinterpret_cast<CqShaderVariableUniformColor*>(s.m_Data) );
+						pools.m_UCPool.push_back(reinterpret_cast<CqShaderVariableUniformColor*>(s.m_Data) );
 					else
-						m_VCPool.push_back(reinterpret_cast<CqShaderVariableVaryingColor*>(s.m_Data) );
+						pools.m_VCPool.push_back(reinterpret_cast<CqShaderVariableVaryingColor*>(s.m_Data) );
 					break;
 				}
 
 				case type_normal:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UNPool.push_back(reinterpret_cast<CqShaderVariableUniformNormal*>(s.m_Data) );
+						pools.m_UNPool.push_back(reinterpret_cast<CqShaderVariableUniformNormal*>(s.m_Data) );
 					else
-						m_VNPool.push_back(reinterpret_cast<CqShaderVariableVaryingNormal*>(s.m_Data) );
+						pools.m_VNPool.push_back(reinterpret_cast<CqShaderVariableVaryingNormal*>(s.m_Data) );
 					break;
 				}
 
 				case type_vector:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UVPool.push_back(reinterpret_cast<CqShaderVariableUniformVector*>(s.m_Data) );
+						pools.m_UVPool.push_back(reinterpret_cast<CqShaderVariableUniformVector*>(s.m_Data) );
 					else
-						m_VVPool.push_back(reinterpret_cast<CqShaderVariableVaryingVector*>(s.m_Data) );
+						pools.m_VVPool.push_back(reinterpret_cast<CqShaderVariableVaryingVector*>(s.m_Data) );
 					break;
 				}
 
 				case type_matrix:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UMPool.push_back(reinterpret_cast<CqShaderVariableUniformMatrix*>(s.m_Data) );
+						pools.m_UMPool.push_back(reinterpret_cast<CqShaderVariableUniformMatrix*>(s.m_Data) );
 					else
-						m_VMPool.push_back(reinterpret_cast<CqShaderVariableVaryingMatrix*>(s.m_Data) );
+						pools.m_VMPool.push_back(reinterpret_cast<CqShaderVariableVaryingMatrix*>(s.m_Data) );
 					break;
 				}
 				
@@ -330,22 +370,5 @@ void CqShaderStack::Release( SqStackEntry s )
 }
 
 
-//----------------------------------------------------------------------
-/** Prints the max. depth stack for now to stdout.
- *  if SHADERSTACKSTATS is defined
- * TODO: maybe later prints outs statistics about the running of the VM.
- */
-
-void CqShaderStack::Statistics()
-{
-#ifdef SHADERSTACKSTATS
-	static TqInt done = 0;
-	if (!done)
-	{
-		std::cout << "The shaderstack's max. depth was " << m_maxsamples << std::endl;
-		done = 1;
-	}
-#endif
-}
 } // namespace Aqsis
 //---------------------------------------------------------------------
@@ -42,6 +42,7 @@
 #include	<aqsis/util/bitvector.h>
 #include	"shadervariable.h"
 #include	"shadervm_common.h"
+#include	"simdkernels.h"
 #include	<aqsis/math/vectorcast.h>
 
 namespace Aqsis {
@@ -164,6 +165,8 @@ static CqMatrix temp_matrix;
 				pB->GetValuePtr( pdB ); \
 				pRes->GetValuePtr( pdR ); \
 				ii = pA->Size(); \
+				if ( SimdOp##NAME( pdA, true, pdB, true, pdR, ii, &RunningState ) ) \
+					return; \
 				for ( i = 0; i < ii; i++ ) \
 				{ \
 					if ( RunningState.Value( i ) ) \
@@ -180,6 +183,8 @@ static CqMatrix temp_matrix;
 				pA->GetValuePtr( pdA ); \
 				pB->GetValue( vB ); \
 				pRes->GetValuePtr( pdR ); \
+				if ( SimdOp##NAME( pdA, true, &vB, false, pdR, ii, &RunningState ) ) \
+					return; \
 				for ( i = 0; i < ii; i++ ) \
 				{ \
 					if ( RunningState.Value( i ) ) \
@@ -195,6 +200,8 @@ static CqMatrix temp_matrix;
 				pB->GetValuePtr( pdB ); \
 				pA->GetValue( vA ); \
 				pRes->GetValuePtr( pdR ); \
+				if ( SimdOp##NAME( &vA, false, pdB, true, pdR, ii, &RunningState ) ) \
+					return; \
 				for ( i = 0; i < ii; i++ ) \
 				{ \
 					if ( RunningState.Value( i ) ) \
@@ -228,13 +235,11 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 	public:
 		CqShaderStack() : m_iTop( 0 )
 		{
-			m_maxsamples = max(m_maxsamples, m_samples);
-			m_Stack.resize( m_maxsamples);
+			m_Stack.resize( m_samples );
 		}
 		virtual ~CqShaderStack()
 		{
 			m_Stack.clear();
-			Statistics();
 		}
 
 
@@ -254,9 +259,6 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 			m_Stack[ m_iTop ].m_Data = pv;
 			m_Stack[ m_iTop ].m_IsTemp = true;
 			m_iTop ++;
-			m_maxsamples = max(m_iTop, m_maxsamples);
-
-
 		}
 
 		//----------------------------------------------------------------------
@@ -274,8 +276,6 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 			m_Stack[ m_iTop ].m_Data = pv;
 			m_Stack[ m_iTop ].m_IsTemp = false;
 			m_iTop ++;
-			m_maxsamples = max(m_iTop, m_maxsamples);
-
 		}
 
 		//----------------------------------------------------------------------
@@ -318,11 +318,6 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 			Release(Pop(f));
 		}
 
-		/**
-		 * Print the max number of depth if compiled for it.
-		 */
-		static void Statistics();
-
 		/** set the more efficient number of samples per type of variable at run-time.
 		 */
 		static void	SetSamples(TqInt n)
@@ -334,34 +329,47 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 		std::vector<SqStackEntry>	m_Stack;
 		TqUint	m_iTop;										///< Index of the top entry.
 
-		static std::deque<CqShaderVariableUniformFloat*>				m_UFPool;
-		// Integer
-		static std::deque<CqShaderVariableUniformPoint*>				m_UPPool;
-		static std::deque<CqShaderVariableUniformString*>			m_USPool;
-		static std::deque<CqShaderVariableUniformColor*>				m_UCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableUniformNormal*>			m_UNPool;
-		static std::deque<CqShaderVariableUniformVector*>			m_UVPool;
-		// Void
-		static std::deque<CqShaderVariableUniformMatrix*>			m_UMPool;
-		// SixteenTuple
-
-		static std::deque<CqShaderVariableVaryingFloat*>				m_VFPool;
-		// Integer
-		static std::deque<CqShaderVariableVaryingPoint*>				m_VPPool;
-		static std::deque<CqShaderVariableVaryingString*>			m_VSPool;
-		static std::deque<CqShaderVariableVaryingColor*>				m_VCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableVaryingNormal*>			m_VNPool;
-		static std::deque<CqShaderVariableVaryingVector*>			m_VVPool;
-		// Void
-		static std::deque<CqShaderVariableVaryingMatrix*>			m_VMPool;
-		// SixteenTuple
+		/** \brief Pools of temporary variables, recycled between executions.
+		 *
+		 * When threading is enabled each thread gets its own set of pools, so
+		 * that shaders can run concurrently without locking.
+		 */
+		struct SqTempPools
+		{
+			std::deque<CqShaderVariableUniformFloat*>				m_UFPool;
+			// Integer
+			std::deque<CqShaderVariableUniformPoint*>				m_UPPool;
+			std::deque<CqShaderVariableUniformString*>			m_USPool;
+			std::deque<CqShaderVariableUniformColor*>				m_UCPool;
+			// Triple
+			// hPoint
+			std::deque<CqShaderVariableUniformNormal*>			m_UNPool;
+			std::deque<CqShaderVariableUniformVector*>			m_UVPool;
+			// Void
+			std::deque<CqShaderVariableUniformMatrix*>			m_UMPool;
+			// SixteenTuple
+
+			std::deque<CqShaderVariableVaryingFloat*>				m_VFPool;
+			// Integer
+			std::deque<CqShaderVariableVaryingPoint*>				m_VPPool;
+			std::deque<CqShaderVariableVaryingString*>			m_VSPool;
+			std::deque<CqShaderVariableVaryingColor*>				m_VCPool;
+			// Triple
+			// hPoint
+			std::deque<CqShaderVariableVaryingNormal*>			m_VNPool;
+			std::deque<CqShaderVariableVaryingVector*>			m_VVPool;
+			// Void
+			std::deque<CqShaderVariableVaryingMatrix*>			m_VMPool;
+			// SixteenTuple
+
+			~SqTempPools();
+			/// Delete all the variables held in the pools.
+			void clear();
+		};
+		/// Get the temporary variable pools belonging to the calling thread.
+		static SqTempPools& tempPools();
 
 		static TqUint    m_samples; // by default == 18 see shaderstack.cpp
-		static TqUint    m_maxsamples;
 }
 ;
 
@@ -404,57 +412,30 @@ inline void	OpMULV( IqShaderData* pA, IqShaderData* pB, IqShaderData* pRes,
 	CqVector3D vA, vB;
 	CqVector3D* pdA;
 	CqVector3D* pdB;
-	TqInt i, ii;
+	CqVector3D* pdR;
 
 	bool fAVar = pA->Size() > 1;
 	bool fBVar = pB->Size() > 1;
 
-	if ( fAVar && fBVar )
-	{
-		/* Both are varying, must go accross all processing each element. */
-		pA->GetValuePtr( pdA );
-		pB->GetValuePtr( pdB );
-		ii = pA->Size();
-		for ( i = 0; i < ii; i++ )
-		{
-			if ( RunningState.Value( i ) )
-				pRes->SetValue( CqVector3D( pdA->x() * pdB->x(),
-				                            pdA->y() * pdB->y(),
-				                            pdA->z() * pdB->z() ), i );
-			pdA++;
-			pdB++;
-		}
-	}
-	else if ( !fBVar && fAVar )
+	if ( fAVar || fBVar )
 	{
-		/* A is varying, can just get B's value once. */
-		ii = pA->Size();
-		pA->GetValuePtr( pdA );
-		pB->GetValue( vB );
-		for ( i = 0; i < ii; i++ )
+		/* Varying, a uniform operand is passed as a single value. */
+		if ( fAVar )
+			pA->GetValuePtr( pdA );
+		else
 		{
-			if ( RunningState.Value( i ) )
-				pRes->SetValue( CqVector3D( pdA->x() * vB.x(),
-				                            pdA->y() * vB.y(),
-				                            pdA->z() * vB.z() ), i );
-			pdA++;
+			pA->GetValue( vA );
+			pdA = &vA;
 		}
-	}
-	else if ( !fAVar && fBVar )
-		\
-	{
-		/* B is varying, can just get A's value once. */
-		ii = pB->Size();
-		pB->GetValuePtr( pdB );
-		pA->GetValue( vA );
-		for ( i = 0; i < ii; i++ )
+		if ( fBVar )
+			pB->GetValuePtr( pdB );
+		else
 		{
-			if ( RunningState.Value( i ) )
-				pRes->SetValue( CqVector3D( vA.x() * pdB->x(),
-				                            vA.y() * pdB->y(),
-				                            vA.z() * pdB->z() ), i );
-			pdB++;
+			pB->GetValue( vB );
+			pdB = &vB;
 		}
+		pRes->GetValuePtr( pdR );
+		SimdOpMULV( pdA, fAVar, pdB, fBVar, pdR, fAVar ? pA->Size() : pB->Size(), &RunningState );
 	}
 	else
 	{
@@ -984,6 +984,10 @@ class CqShaderVariableUniformColor : public CqShaderVariableUniform<type_color,
 		{
 			res = &m_Value;
 		}
+		virtual	void	GetColorPtr( CqColor*& res )
+		{
+			res = &m_Value;
+		}
 		virtual	void	SetColor( const CqColor& c )
 		{
 			m_Value = c;
@@ -25,12 +25,22 @@
 
 #include "shadervm.h"
 
+#include <algorithm>
 #include <cstring>
 #include <ctype.h>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <sstream>
 #include <stddef.h>
 
+#include <boost/cstdint.hpp>
+#ifdef ENABLE_THREADING
+#	include <boost/thread/mutex.hpp>
+#	include <boost/thread/once.hpp>
+#endif
+
 #include <aqsis/core/isurface.h>
 #include <aqsis/slcomp/icodegen.h>
 #include <aqsis/util/logging.h>
@@ -55,7 +65,126 @@ boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
 	boost::shared_ptr<CqShaderVM> shader(new CqShaderVM(renderContext));
 	if(!dsoPath.empty())
 		shader->SetDSOPath(dsoPath.c_str());
-	shader->LoadProgram(&programFile);
+	boost::shared_ptr<CqSlxReader> reader = CqSlxReader::create(programFile);
+	shader->LoadProgram(*reader);
+	return shader;
+}
+
+namespace {
+
+/// Determine whether the stack engine is selected with Option "shader" "engine".
+bool stackEngineSelected(IqRenderer* renderContext)
+{
+	const CqString* engine = NULL;
+	if ( NULL != renderContext )
+		engine = renderContext->GetStringOption( "shader", "engine" );
+	return NULL != engine && engine[ 0 ].compare( "stack" ) == 0;
+}
+
+/// Hash the contents of a program file with 64 bit FNV-1a.
+boost::uint64_t programHash( const std::string& contents )
+{
+	boost::uint64_t hash = 14695981039346656037ULL;
+	for ( std::string::const_iterator c = contents.begin(); c != contents.end(); ++c )
+	{
+		hash ^= static_cast<unsigned char>( *c );
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/// A loaded program, with the contents of the file it was loaded from.
+struct SqCachedProgram
+{
+	std::string::size_type size;
+	boost::uint64_t hash;
+	/// Value of g_programCacheClock when the program was last used.
+	TqUint lastUsed;
+	boost::shared_ptr<const CqShaderVM> shader;
+};
+/// Loaded programs, by file path, DSO path and engine.
+typedef std::map<std::string, SqCachedProgram> TqProgramCache;
+/// Number of programs to keep; the least recently used are dropped beyond this.
+const TqUint maxCachedPrograms = 64;
+
+TqProgramCache g_programCache;
+TqUint g_programCacheClock = 0;
+#ifdef ENABLE_THREADING
+boost::mutex g_programCacheMutex;
+#endif
+
+} // unnamed namespace
+
+boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
+                                           const std::string& programPath,
+                                           const std::string& dsoPath)
+{
+	// The file is read every time, and the cached program used only if the
+	// contents are the same; modification times are too coarse to tell
+	// whether a shader was recompiled within the same second.
+	std::ifstream programFile(programPath.c_str(), std::ios::in | std::ios::binary);
+	if(!programFile)
+	{
+		AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+			"Could not open \"" << programPath << "\"");
+	}
+	std::string contents( ( std::istreambuf_iterator<char>( programFile ) ),
+			std::istreambuf_iterator<char>() );
+	boost::uint64_t hash = programHash( contents );
+	std::string key = programPath + '\n' + dsoPath;
+	if(stackEngineSelected(renderContext))
+		key += "\nstack";
+
+	boost::shared_ptr<const CqShaderVM> program;
+	{
+#		ifdef ENABLE_THREADING
+		boost::mutex::scoped_lock lock(g_programCacheMutex);
+#		endif
+		TqProgramCache::iterator cached = g_programCache.find(key);
+		if(cached != g_programCache.end() && cached->second.size == contents.size()
+				&& cached->second.hash == hash)
+		{
+			cached->second.lastUsed = ++g_programCacheClock;
+			program = cached->second.shader;
+		}
+	}
+	if(!program)
+	{
+		std::istringstream programText(contents);
+		boost::shared_ptr<CqShaderVM> shader(new CqShaderVM(renderContext));
+		if(!dsoPath.empty())
+			shader->SetDSOPath(dsoPath.c_str());
+		boost::shared_ptr<CqSlxReader> reader = CqSlxReader::create(programText);
+		shader->LoadProgram(*reader);
+		// Programs calling DSO shadeops aren't cached, since the shadeops are
+		// initialised and shut down along with the shader which found them.
+		if(!shader->m_ActiveDSOMap.empty())
+			return shader;
+		shader->SetRenderContext(0);
+		program = shader;
+#		ifdef ENABLE_THREADING
+		boost::mutex::scoped_lock lock(g_programCacheMutex);
+#		endif
+		SqCachedProgram entry = { contents.size(), hash, ++g_programCacheClock, program };
+		g_programCache[key] = entry;
+		if(g_programCache.size() > maxCachedPrograms)
+		{
+			TqProgramCache::iterator oldest = g_programCache.begin();
+			for(TqProgramCache::iterator i = g_programCache.begin();
+					i != g_programCache.end(); ++i)
+			{
+				if(i->second.lastUsed < oldest->second.lastUsed)
+					oldest = i;
+			}
+			g_programCache.erase(oldest);
+		}
+	}
+
+	// Copies of the cached shader share its program strings, so keep it alive
+	// for as long as they are.
+	boost::shared_ptr<CqShaderVM> shader(new CqShaderVM(*program));
+	shader->m_ProgramOwner = program;
+	shader->SetRenderContext(renderContext);
 	return shader;
 }
 
@@ -352,6 +481,7 @@ SqOpCodeTrans CqShaderVM::m_TransTable[] =
         {"specular", 0, &CqShaderVM::SO_specular, 0, {0}},
         {"phong", 0, &CqShaderVM::SO_phong, 0, {0}},
         {"trace", 0, &CqShaderVM::SO_trace, 0, {0}},
+        {"transmission", 0, &CqShaderVM::SO_transmission, 0, {0}},
         {"ftexture1", 0, &CqShaderVM::SO_ftexture1, 0, {0}},
         {"ftexture2", 0, &CqShaderVM::SO_ftexture2, 0, {0}},
         {"ftexture3", 0, &CqShaderVM::SO_ftexture3, 0, {0}},
@@ -515,6 +645,9 @@ CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
 	m_ProgramInit(),
 	m_Program(),
 	m_ProgramStrings(),
+	m_ProgramOwner(),
+	m_RegisterBlocks(),
+	m_RegisterFile(),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -522,17 +655,11 @@ CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
 	m_PO(0),
 	m_PE(0),
 	m_fAmbient(true),
+	m_lightReuse(LightReuse_Uniform),
 	m_outsideWorld(false),
-	m_pRenderContext(pRenderContext)
+	m_pRenderContext(0)
 {
-	// Find out if this shader is being declared outside the world construct. If so
-	// if is effectively being defined in 'camera' space, which will affect the
-	// transformation of parameters. Should only affect lightsource shaders as these
-	// are the only ones valid outside the world.
-	if (NULL != m_pRenderContext)
-		m_outsideWorld = !m_pRenderContext->IsWorldBegin();
-	else
-		m_outsideWorld = false;
+	SetRenderContext(pRenderContext);
 }
 
 CqShaderVM::CqShaderVM(const CqShaderVM& From)
@@ -548,6 +675,9 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 	m_ProgramInit(),
 	m_Program(),
 	m_ProgramStrings(),
+	m_ProgramOwner(),
+	m_RegisterBlocks(),
+	m_RegisterFile(),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -555,10 +685,17 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 	m_PO(0),
 	m_PE(0),
 	m_fAmbient(true),
+	m_lightReuse(LightReuse_Uniform),
 	m_outsideWorld(false),
 	m_pRenderContext(0)
 {
 	*this = From;
+	SetRenderContext(m_pRenderContext);
+}
+
+void CqShaderVM::SetRenderContext( IqRenderer* pRenderContext )
+{
+	m_pRenderContext = pRenderContext;
 	// Find out if this shader is being declared outside the world construct. If so
 	// if is effectively being defined in 'camera' space, which will affect the
 	// transformation of parameters. Should only affect lightsource shaders as these
@@ -867,65 +1004,63 @@ void CqShaderVM::DefaultSurface()
 	                           ";
 
 	std::stringstream defStream(pDefSurfaceShader);
+	boost::shared_ptr<CqSlxReader> reader = CqSlxReader::create(defStream);
 
-	LoadProgram(&defStream);
+	LoadProgram(*reader);
 }
 
 
 //---------------------------------------------------------------------
-/**
-* Function to determine if not the character is ' '
+/** Find an opcode in the translation table.
 */
+namespace {
 
-static bool notspace(char C)
-{
-	bool retval = true;
+typedef std::map<TqUlong, TqInt> TqOpcodeMap;
+/// Index of each opcode in CqShaderVM::m_TransTable, by the hash of its name.
+TqOpcodeMap g_opcodes;
+#ifdef ENABLE_THREADING
+boost::once_flag g_opcodesOnce = BOOST_ONCE_INIT;
+#endif
 
-	if ((C == 0x20) ||
-	        (( C >= 0x09 ) && (C <= 0x0D)))
-		retval = false;
+} // unnamed namespace
 
-	return retval;
+void CqShaderVM::HashOpcodes()
+{
+	for ( TqInt i = 0; i < m_cTransSize; i++ )
+	{
+		if ( !m_TransTable[ i ].m_hash )
+			m_TransTable[ i ].m_hash = CqString::hash( m_TransTable[ i ].m_strName );
+		// Keep the first of any opcodes with the same hash, as a search
+		// of the table would.
+		g_opcodes.insert( std::make_pair( m_TransTable[ i ].m_hash, i ) );
+	}
 }
 
-//---------------------------------------------------------------------
-/** Set the shader type important for Imager' shader
-*/
-void CqShaderVM::SetType(EqShaderType type)
+TqInt CqShaderVM::OpcodeIndex( TqUlong hash )
 {
-	m_Type = type;
+#	ifdef ENABLE_THREADING
+	boost::call_once( g_opcodesOnce, &CqShaderVM::HashOpcodes );
+#	else
+	if ( g_opcodes.empty() )
+		HashOpcodes();
+#	endif
+	TqOpcodeMap::const_iterator i = g_opcodes.find( hash );
+	return i == g_opcodes.end() ? m_cTransSize : i->second;
 }
 
 //---------------------------------------------------------------------
-/** Load a token from a compiled slx file.
+/** Set the shader type important for Imager' shader
 */
-
-void CqShaderVM::GetToken( char* token, TqInt l, std::istream* pFile )
+void CqShaderVM::SetType(EqShaderType type)
 {
-	char c;
-	TqInt i = 0;
-	( *pFile ) >> std::ws;
-	c = pFile->get();
-	if ( c == ':' && i == 0 )
-	{
-		token[ 0 ] = c;
-		token[ 1 ] = '\0';
-		return ;	// Special case for labels.
-	}
-	while ( notspace( c ) && i < l - 1 )
-	{
-		token[ i++ ] = c;
-		token[ i ] = '\0';
-		c = pFile->get();
-	}
+	m_Type = type;
 }
 
-
 //---------------------------------------------------------------------
 /** Load a program from a compiled slx file.
 */
 
-void CqShaderVM::LoadProgram( std::istream* pFile )
+void CqShaderVM::LoadProgram( CqSlxReader& reader )
 {
 	enum EqSegment
 	{
@@ -933,20 +1068,19 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 	    Seg_Init,
 	    Seg_Code,
 	};
-	char token[ 255 ];
+	const char* token;
 	EqSegment	Segment = Seg_Data;
 	std::vector<UsProgramElement>*	pProgramArea = NULL;
 	std::vector<TqInt>	aLabels;
+	std::vector<TqUint>	aJumps;
 	boost::shared_ptr<CqShaderExecEnv> StdEnv(new CqShaderExecEnv(m_pRenderContext));
 	TqInt	array_count = 0;
-	TqUlong  htoken, i;
+	TqUlong  htoken;
 
 	bool fShaderSpec = false;
-	while ( !pFile->eof() )
+	while ( !reader.eof() )
 	{
-		GetToken( token, 255, pFile );
-
-		htoken = CqString::hash(token);
+		token = reader.readWord( htoken );
 
 		// Check for type and version information.
 		if ( !fShaderSpec )
@@ -990,7 +1124,7 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 		if ( strcmp( token, "AQSIS_V" ) == 0 )
 		{
-			GetToken( token, 255, pFile );
+			token = reader.readWord( htoken );
 			// Check that the version string matches the current one.  If not,
 			// fail fatally.
 			const char* slxVersion = AQSIS_XSTR(AQSIS_SLX_VERSION);
@@ -1006,14 +1140,13 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 		if ( ushash == htoken) // == "USES"
 		{
-			( *pFile ) >> m_Uses;
+			m_Uses = reader.readInt();
 			continue;
 		}
 
 		if ( shash == htoken ) // == "segment"
 		{
-			GetToken( token, 255, pFile );
-			htoken = CqString::hash(token);
+			token = reader.readWord( htoken );
 
 			if ( dhash == htoken ) // == "Data"
 				Segment = Seg_Data;
@@ -1058,34 +1191,33 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 							VarClass = class_uniform;
 						else
 							VarType = enumCast<EqVariableType>(token);
-						GetToken( token, 255, pFile );
-						htoken = CqString::hash(token);
+						token = reader.readWord( htoken );
 					}
-					// Check for array type variable.
-					if ( token[ strlen( token ) - 1 ] == ']' )
 					{
-						unsigned int i = 0;
-						while ( i < strlen( token ) && token[ i ] != '[' ) i++;
-						if ( i == strlen( token ) )
+						// Check for array type variable.
+						std::string varName( token );
+						if ( !varName.empty() && varName[ varName.size() - 1 ] == ']' )
 						{
-							AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-								"Invalid variable specification in slx file");
+							std::string::size_type i = varName.find( '[' );
+							if ( i == std::string::npos )
+							{
+								AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+									"Invalid variable specification in slx file");
+							}
+							array_count = atoi( varName.c_str() + i + 1 );
+							varName.erase( i );
+							fVarArray = true;
 						}
-						token[ strlen( token ) - 1 ] = '\0';
-						token[ i ] = '\0';
-						i++;
-						array_count = atoi( &token[ i ] );
-						fVarArray = true;
+						// Check if there is a valid variable specifier
+						if ( VarType == type_invalid ||
+						        VarClass == class_invalid )
+							continue;
+
+						if ( fVarArray )
+							AddLocalVariable( CreateVariableArray( VarType, VarClass, varName.c_str(), array_count, varStorage ) );
+						else
+							AddLocalVariable( CreateVariable( VarType, VarClass, varName.c_str(), varStorage ) );
 					}
-					// Check if there is a valid variable specifier
-					if ( VarType == type_invalid ||
-					        VarClass == class_invalid )
-						continue;
-
-					if ( fVarArray )
-						AddLocalVariable( CreateVariableArray( VarType, VarClass, token, array_count, varStorage ) );
-					else
-						AddLocalVariable( CreateVariable( VarType, VarClass, token, varStorage ) );
 					break;
 
 				case Seg_Init:
@@ -1093,31 +1225,26 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 					// Check if it is a label
 					if ( strcmp( token, ":" ) == 0 )
 					{
-						( *pFile ) >> std::ws;
-						TqFloat f;
-						( *pFile ) >> f;
+						TqFloat f = reader.readFloat();
 						if ( aLabels.size() < ( f + 1 ) )
 							aLabels.resize( static_cast<TqInt>( f ) + 1 );
 						aLabels[ static_cast<TqInt>( f ) ] = pProgramArea->size();
 						AddCommand( &CqShaderVM::SO_nop, pProgramArea );
 						break;
 					}
-					// Find the opcode in the translation table.
-					TqInt i;
-					for ( i = 0; i < m_cTransSize; i++ )
+					// Find the opcode in the translation table.  External
+					// calls are handled on the first pass of the loop.
+					TqInt i = ( ehash == htoken ) ? 0 : OpcodeIndex( htoken );
+					for ( ; i < m_cTransSize; i++ )
 					{
-						if ( !m_TransTable[ i ].m_hash )
-						{
-							m_TransTable[ i ].m_hash = CqString::hash(m_TransTable[ i ].m_strName);
-						}
-
 						if ( ehash == htoken )
 						{
 							CqString strFunc, strRetType, strArgTypes ;
 							EqVariableType RetType;
 							std::list<EqVariableType> ArgTypes;
 
-							*pFile >> strFunc;
+							TqUlong hword;
+							strFunc = reader.readWord( hword );
 							strFunc = strFunc.substr(1,strFunc.length() - 2);
 							std::list<SqDSOExternalCall*> *candidates = NULL;
 							m_itActiveDSOMap = m_ActiveDSOMap.find( strFunc );
@@ -1138,7 +1265,7 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 							};
 
 							// pick out the return type
-							*pFile >> strRetType;
+							strRetType = reader.readWord( hword );
 							m_itTypeIdMap = m_TypeIdMap.find( strRetType[1] );
 							if (m_itTypeIdMap != m_TypeIdMap.end())
 							{
@@ -1152,7 +1279,7 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 									" shadeop: \"" << strFunc << "\" : \"" << strRetType << "\"");
 							}
 
-							*pFile >> strArgTypes;
+							strArgTypes = reader.readWord( hword );
 							for ( TqUint x=1; x < strArgTypes.length()-1; x++ )
 							{
 								m_itTypeIdMap = m_TypeIdMap.find( strArgTypes[x] )
@@ -1239,6 +1366,8 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 								(*candidate)->initialised = true;
 							}
 
+							// Nothing is known about what a DSO shadeop does.
+							m_lightReuse = LightReuse_None;
 							AddCommand( &CqShaderVM::SO_external, pProgramArea );
 							AddDSOExternalCall( (*candidate),pProgramArea );
 
@@ -1259,8 +1388,34 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 							        &CqShaderVM::SO_solar2 == m_TransTable[ i ].m_pCommand )
 								m_fAmbient = false;
 
+							// Lights using these can't have their results
+							// reused; see lightReuse().
+							if( &CqShaderVM::SO_frandom == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_crandom == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_prandom == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_printf == m_TransTable[ i ].m_pCommand )
+								m_lightReuse = LightReuse_None;
+							// These depend on the points being lit or on the
+							// surface, without appearing in the USES mask.
+							else if( &CqShaderVM::SO_illuminate == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_illuminate2 == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_solar == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_surface == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_displacement == m_TransTable[ i ].m_pCommand ||
+							        &CqShaderVM::SO_atmosphere == m_TransTable[ i ].m_pCommand )
+								m_lightReuse = std::min( m_lightReuse, LightReuse_Points );
+
 							// Add this opcode to the program segment.
 							AddCommand( m_TransTable[ i ].m_pCommand, pProgramArea );
+							// Remember where the labels of jumps are, so they
+							// can be resolved once the code is complete.
+							if ( pProgramArea == &m_Program &&
+							        ( &CqShaderVM::SO_jnz == m_TransTable[ i ].m_pCommand ||
+							          &CqShaderVM::SO_jmp == m_TransTable[ i ].m_pCommand ||
+							          &CqShaderVM::SO_jz == m_TransTable[ i ].m_pCommand ||
+							          &CqShaderVM::SO_RS_JZ == m_TransTable[ i ].m_pCommand ||
+							          &CqShaderVM::SO_S_JZ == m_TransTable[ i ].m_pCommand ) )
+								aJumps.push_back( m_Program.size() );
 
 							// Process this opcodes parameters.
 							TqInt p;
@@ -1268,7 +1423,8 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 							{
 								if ( m_TransTable[ i ].m_aParamTypes[ p ] == type_invalid )
 								{
-									GetToken( token, 255, pFile );
+									TqUlong hvar;
+									token = reader.readWord( hvar );
 									TqInt iVar;
 									if ( ( iVar = FindLocalVarIndex( token ) ) >= 0 )
 										AddVariable( iVar, pProgramArea );
@@ -1283,24 +1439,14 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 									switch ( m_TransTable[ i ].m_aParamTypes[ p ] )
 									{
 										case type_float:
-											{
-												( *pFile ) >> std::ws;
-												TqFloat f;
-												( *pFile ) >> f;
-												AddFloat( f, pProgramArea );
-											}
+											AddFloat( reader.readFloat(), pProgramArea );
 											break;
 										case type_integer:
-											{
-												( *pFile ) >> std::ws;
-												TqInt i;
-												( *pFile ) >> i;
-												AddInteger( i, pProgramArea );
-											}
+											AddInteger( reader.readInt(), pProgramArea );
 											break;
 										case type_string:
 											{
-												CqString s = GetString(pFile);
+												CqString s = reader.readString();
 												AddString( s.c_str(), pProgramArea );
 											}
 											break;
@@ -1322,162 +1468,34 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 					break;
 			}
 		}
-		( *pFile ) >> std::ws;
 	}
 	// Now we need to complete any label jump statements.
-	i = 0;
-	while ( i < m_Program.size() )
-	{
-		UsProgramElement E = m_Program[ i++ ]
-		                     ;
-		if ( E.m_Command == &CqShaderVM::SO_jnz ||
-		        E.m_Command == &CqShaderVM::SO_jmp ||
-		        E.m_Command == &CqShaderVM::SO_jz ||
-		        E.m_Command == &CqShaderVM::SO_RS_JZ ||
-		        E.m_Command == &CqShaderVM::SO_S_JZ)
-		{
-			SqLabel lab;
-			lab.m_Offset = aLabels[ static_cast<unsigned int>( m_Program[ i ].m_FloatVal ) ];
-			lab.m_pAddress = &m_Program[ lab.m_Offset ];
-			m_Program[ i ].m_Label = lab;
-			i++;
-		}
-		else
-		{
-			// Find the command so that we can skip the parameters
-			TqInt j;
-			for ( j = 0; j < m_cTransSize; j++ )
-			{
-				if ( m_TransTable[ j ].m_pCommand == E.m_Command )
-				{
-					i += m_TransTable[ j ].m_cParams;
-					break;
-				}
-			}
-		}
-	}
-}
-
-CqString CqShaderVM::GetString(std::istream* pFile)
-{
-	( *pFile ) >> std::ws;
-	char c;
-	CqString s( "" );
-	bool escapeChar = false;
-
-	pFile->get();
-	while ( (( c = pFile->get() ) != '"') || escapeChar  )
-	{
-		if(escapeChar)
-		{
-			//Treatment for escape char
-			switch(c)
-			{
-				case 'a'://Bell (alert)
-					s += '\a';
-					escapeChar = false;
-					break;
-				case 'v'://Vertical tab
-					s += '\v';
-					escapeChar = false;
-					break;
-				case '\''://Single quotation mark
-					s += "'";
-					escapeChar = false;
-					break;
-				case '?'://Literal question mark
-					s += '\?';
-					escapeChar = false;
-					break;
-				case 'n'://New line
-					s += '\n';
-					escapeChar = false;
-					break;
-				case 'r'://Carriage return
-					s += '\r';
-					escapeChar = false;
-					break;
-				case 't'://Horizontal tab
-					s += '\t';
-					escapeChar = false;
-					break;
-				case 'b'://Backspace
-					s += '\b';
-					escapeChar = false;
-					break;
-				case 'f'://Formfeed
-					s += '\f';
-					escapeChar = false;
-					break;
-				case '"'://Double quotation mark
-					s += '"';
-					escapeChar = false;
-					break;
-				case '\\'://Backslash
-					s += '\\';
-					escapeChar = false;
-					break;
-				case 'x'://Hexadecimal
-				case '0'://octal
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-					GetNumericEscapeChar(pFile, s,  c);
-					escapeChar = false;
-					break;
-				default :
-					escapeChar = false;
-					break;
-			}
-		}
-		else
-			if (c ==  '\\')
-				escapeChar = true;
-			else
-				s += c;
-	}
-	 return s;
-}
-
-void CqShaderVM::GetNumericEscapeChar(std::istream* pFile, CqString &s, char c)
-{
-	CqString a("");
-	bool isHexadecimal = (c =='x');
-	unsigned int maxLength;
-
-	if (isHexadecimal)
-	{
-		maxLength = 2;
-	}
-	else
+	for ( std::vector<TqUint>::const_iterator jump = aJumps.begin(); jump != aJumps.end(); ++jump )
 	{
-		a += c;
-		maxLength = 3;
+		SqLabel lab;
+		lab.m_Offset = aLabels[ static_cast<unsigned int>( m_Program[ *jump ].m_FloatVal ) ];
+		lab.m_pAddress = &m_Program[ lab.m_Offset ];
+		m_Program[ *jump ].m_Label = lab;
 	}
-	c = pFile->get();
 
-	while ((( c >= '0' && c <= '9') || ((( c >= 'a' && c <= 'f') || ( c >= 'A' && c <= 'F')) && isHexadecimal)) && (a.length() <maxLength))
+	// Lights reading any global besides their outputs and the constants, or
+	// with outputs which the shader may set differently at each point, are
+	// only reusable for the same points.
+	const TqInt uniformLightGlobals = ( 1 << EnvVars_L ) | ( 1 << EnvVars_Cl ) |
+		( 1 << EnvVars_Ol ) | ( 1 << EnvVars_ncomps ) | ( 1 << EnvVars_time );
+	if ( m_Uses & ~uniformLightGlobals )
+		m_lightReuse = std::min( m_lightReuse, LightReuse_Points );
+	for ( std::vector<IqShaderData*>::const_iterator var = m_LocalVars.begin();
+			var != m_LocalVars.end(); ++var )
 	{
-		a += c;
-		c = pFile->get();
+		if ( ( *var )->Storage() == IqShaderData::OutputParameter )
+			m_lightReuse = std::min( m_lightReuse, LightReuse_Points );
 	}
 
-	int numericalBase;
-
-	if(isHexadecimal)
-		numericalBase = 16;
-	else
-		numericalBase = 8;
-	char result = strtoul(a.c_str(), NULL, numericalBase);
-
-	if (result != 0) s += result;
-	pFile->unget();
+	// Lower the program to register form, unless the stack engine has been
+	// selected.
+	if ( !stackEngineSelected( m_pRenderContext ) )
+		LowerProgram();
 }
 
 //---------------------------------------------------------------------
@@ -1519,7 +1537,9 @@ CqShaderVM&	CqShaderVM::operator=( const CqShaderVM& From )
 	m_Uses = From.m_Uses;
 	m_pTransform = From.m_pTransform;
 	m_strName = From.m_strName;
+	m_Type = From.m_Type;
 	m_fAmbient = From.m_fAmbient;
+	m_lightReuse = From.m_lightReuse;
 	m_outsideWorld = From.m_outsideWorld;
 	m_pRenderContext = From.m_pRenderContext;
 
@@ -1528,11 +1548,24 @@ CqShaderVM&	CqShaderVM::operator=( const CqShaderVM& From )
 	for ( i = From.m_LocalVars.begin(); i != From.m_LocalVars.end(); i++ )
 		m_LocalVars.push_back( ( *i ) ->Clone() );
 
+	// ...and the cached instance parameters, pointing each one at our own
+	// copy of the corresponding local variable.
+	for ( i = From.m_InstancedParams.begin(); i < From.m_InstancedParams.end(); i += 2 )
+	{
+		TqUint varIndex = std::find(From.m_LocalVars.begin(), From.m_LocalVars.end(),
+				*(i+1)) - From.m_LocalVars.begin();
+		assert(varIndex < m_LocalVars.size());
+		m_InstancedParams.push_back( ( *i ) ->Clone() );
+		m_InstancedParams.push_back( m_LocalVars[varIndex] );
+	}
+
 	// Copy the intialisation program.
 	m_ProgramInit.assign(From.m_ProgramInit.begin(), From.m_ProgramInit.end());
 
-	// Copy the main program.
+	// Copy the main program, sharing its register blocks.
 	m_Program.assign(From.m_Program.begin(), From.m_Program.end());
+	m_RegisterBlocks = From.m_RegisterBlocks;
+	m_ProgramOwner = From.m_ProgramOwner;
 
 	return ( *this );
 }
@@ -1945,82 +1978,7 @@ const std::vector<IqShaderData*>& CqShaderVM::GetArguments() const
 void CqShaderVM::ShutdownShaderEngine()
 {
 	// Free any temporary variables in the buckets.
-	while( !m_UFPool.empty() )
-	{
-		delete(m_UFPool.front());
-		m_UFPool.pop_front();
-	}
-	while( !m_VFPool.empty() )
-	{
-		delete(m_VFPool.front());
-		m_VFPool.pop_front();
-	}
-
-	while( !m_UPPool.empty() )
-	{
-		delete(m_UPPool.front());
-		m_UPPool.pop_front();
-	}
-	while( !m_VPPool.empty() )
-	{
-		delete(m_VPPool.front());
-		m_VPPool.pop_front();
-	}
-
-	while( !m_USPool.empty() )
-	{
-		delete(m_USPool.front());
-		m_USPool.pop_front();
-	}
-	while( !m_VSPool.empty() )
-	{
-		delete(m_VSPool.front());
-		m_VSPool.pop_front();
-	}
-
-	while( !m_UCPool.empty() )
-	{
-		delete(m_UCPool.front());
-		m_UCPool.pop_front();
-	}
-	while( !m_VCPool.empty() )
-	{
-		delete(m_VCPool.front());
-		m_VCPool.pop_front();
-	}
-
-	while( !m_UNPool.empty() )
-	{
-		delete(m_UNPool.front());
-		m_UNPool.pop_front();
-	}
-	while( !m_VNPool.empty() )
-	{
-		delete(m_VNPool.front());
-		m_VNPool.pop_front();
-	}
-
-	while( !m_UVPool.empty() )
-	{
-		delete(m_UVPool.front());
-		m_UVPool.pop_front();
-	}
-	while( !m_VVPool.empty() )
-	{
-		delete(m_VVPool.front());
-		m_VVPool.pop_front();
-	}
-
-	while( !m_UMPool.empty() )
-	{
-		delete(m_UMPool.front());
-		m_UMPool.pop_front();
-	}
-	while( !m_VMPool.empty() )
-	{
-		delete(m_VMPool.front());
-		m_VMPool.pop_front();
-	}
+	tempPools().clear();
 }
 
 
@@ -50,6 +50,8 @@
 #include 	"dsoshadeops.h"
 #include	<aqsis/core/itransform.h>
 #include	"shadervm_common.h"
+#include	"registerprogram.h"
+#include	"slxreader.h"
 
 
 namespace Aqsis {
@@ -73,6 +75,23 @@ struct SqOpCodeTrans
 ;
 
 
+//----------------------------------------------------------------------
+/** \struct SqRegOpTrans
+ * Structure for translating a stack opcode into a register opcode.
+ */
+
+struct SqRegOpTrans
+{
+	void (CqShaderVM::*m_pCommand ) ();	///< Member pointer to the stack function.
+	EqRegOpCode	m_op;				///< Equivalent register opcode.
+	TqInt	m_cOperands;			///< Number of operands taken from the stack.
+	EqVariableType	m_aType;		///< Type of the first (top of stack) operand.
+	EqVariableType	m_bType;		///< Type of the second operand.
+	EqVariableType	m_resultType;	///< Type of the result.
+}
+;
+
+
 class CqShaderVM;
 union UsProgramElement;
 
@@ -161,6 +180,10 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		{
 			return ( m_fAmbient );
 		}
+		virtual	EqLightReuse	lightReuse() const
+		{
+			return ( m_lightReuse );
+		}
 		virtual	boost::shared_ptr<IqShader> Clone() const
 		{
 			return boost::shared_ptr<IqShader>(new CqShaderVM(*this));
@@ -206,19 +229,41 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		CqShaderVM&	operator=( const CqShaderVM& From );
 
 	private:
-		/** \brief Load a compiled shader program from the given stream
+		/** \brief Load a compiled shader program from the given reader
 		 *
 		 * \throw XqBadShader If the program was compiled with a different
 		 *   version of aqsis, or is invalid in any other way.
 		 */
-		void	LoadProgram( std::istream* pFile );
+		void	LoadProgram( CqSlxReader& reader );
+		/// Set the renderer the shader belongs to.
+		void	SetRenderContext( IqRenderer* pRenderContext );
 		void	Execute( IqShaderExecEnv* pEnv );
 		void	ExecuteInit();
 
+		/** \brief Lower the initialisation and main programs to register form.
+		 *
+		 * Straight line runs of simple opcodes are replaced by register
+		 * blocks, which are executed by SO_regblock().  The stack opcodes are
+		 * kept for everything else, and for the whole program when the
+		 * "stack" engine is selected with Option "shader" "engine".
+		 */
+		void	LowerProgram();
+		void	LowerSegment( std::vector<UsProgramElement>& program, std::vector<SqRegisterBlock>& blocks );
+		bool	LowerInstruction( const std::vector<UsProgramElement>& program, SqRegisterBlock& block,
+				std::vector<TqInt>& stack, TqUint offset );
+		void	CloseRegisterBlock( std::vector<UsProgramElement>& program, std::vector<SqRegisterBlock>& blocks,
+				SqRegisterBlock& block, std::vector<TqInt>& stack, TqUint start, TqUint end );
+		bool	RegisterMatches( const SqRegisterBlock& block, TqInt reg, EqVariableType type ) const;
+		void	StoreRegister( const SqRegisterBlock& block, const SqRegInstr& instr, const CqBitVector* pMask );
+		static TqInt	ParamCount( void ( CqShaderVM::*pCommand ) () );
+
 		// Allow createShaderVM to call LoadProgram:
 		friend boost::shared_ptr<IqShader> createShaderVM(
 				IqRenderer* renderContext, std::istream& programFile,
 				const std::string& dsoPath);
+		friend boost::shared_ptr<IqShader> createShaderVM(
+				IqRenderer* renderContext, const std::string& programPath,
+				const std::string& dsoPath);
 
 		struct SqArgumentRecord
 		{
@@ -241,6 +286,9 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		std::vector<UsProgramElement>	m_ProgramInit;		///< Bytecodes of the intialisation program.
 		std::vector<UsProgramElement>	m_Program;			///< Bytecodes of the main program.
 		std::list<CqString*>			m_ProgramStrings;	///< Strings used by the program, which are stored additionally as UsProgramElements.
+		boost::shared_ptr<const CqShaderVM>	m_ProgramOwner;	///< Cached shader owning the strings and external calls of the program, if it came from the program cache.
+		boost::shared_ptr<const std::vector<SqRegisterBlock> >	m_RegisterBlocks;	///< Register blocks of both programs, shared between copies.
+		std::vector<IqShaderData*>	m_RegisterFile;		///< Registers of the block being executed.
 		TqInt	m_uGridRes;
 		TqInt	m_vGridRes;
 		TqInt	m_shadingPointCount;
@@ -248,26 +296,11 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		TqInt	m_PO;							///< Current program offset.
 		TqInt	m_PE;							///< Offset of the end of the program.
 		bool	m_fAmbient;						///< Flag indicating if this is an ambient light source ( if it is indeed a light source ).
+		EqLightReuse	m_lightReuse;			///< How the results may be reused if this is a light source.
 		bool	m_outsideWorld;						///< Flag indicating this shader was declared outside the world.
 		IqRenderer*	m_pRenderContext;
 
 
-		/** \brief Get a string from a program file and interpret escaped chars
-		 *
-		 * Assumes the leading quote (") has already been removed from the
-		 * input, and reads up until the trailing quote
-		 *
-		 * \param pFile shader stream
-		 * \return String
-		 */
-		static CqString GetString(std::istream* pFile);
-		/** \brief Read in and interpret a numeric escape sequence as a character
-		 *
-		 * \param pFile shader stream
-		 * \param s result string
-		 * \param c, current character
-		 */
-		static void GetNumericEscapeChar(std::istream* pFile, CqString &s, char c);
 		/** Determine whether the program execution has finished.
 		 */
 		bool	fDone()
@@ -331,7 +364,10 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 					return ( m );
 			return ( -1 );
 		}
-		void	GetToken( char* token, TqInt l, std::istream* pFile );
+		/// Find the index of an opcode in m_TransTable from the hash of its name, or m_cTransSize if there isn't one.
+		static TqInt	OpcodeIndex( TqUlong hash );
+		/// Hash the opcode names, and index m_TransTable by them for OpcodeIndex().
+		static void	HashOpcodes();
 
 		/** Add a command to the program data area.
 		 * \param pCommand Pointer to the opcode function.
@@ -397,6 +433,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		}
 
 		void	SO_nop();
+		void	SO_regblock();
 		void	SO_dup();
 		void	SO_drop();
 		void	SO_debug_break();
@@ -593,6 +630,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		void	SO_specular();
 		void	SO_phong();
 		void	SO_trace();
+		void	SO_transmission();
 		void	SO_shadow();
 		void	SO_shadow1();
 		void	SO_ftexture1();
@@ -703,6 +741,8 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 
 		static	SqOpCodeTrans	m_TransTable[];		///< Static opcode translation table.
 		static	TqInt	m_cTransSize;		///< Size of translation table.
+		static	SqRegOpTrans	m_RegTransTable[];	///< Static stack to register opcode translation table.
+		static	TqInt	m_cRegTransSize;	///< Size of register translation table.
 }
 ;
 
@@ -757,6 +757,12 @@ void CqShaderVM::SO_trace()
 	FUNC2( type_color, m_pEnv->SO_trace );
 }
 
+void CqShaderVM::SO_transmission()
+{
+	VARFUNC;
+	FUNC2PLUS( type_color, m_pEnv->SO_transmission );
+}
+
 
 // Macros for declaring the texture shadeops
 #define	TEXTURE(t,func)	POPV(count); /* additional parameter count */\
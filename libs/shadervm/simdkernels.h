@@ -0,0 +1,770 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares vectorised kernels for the varying arithmetic of the shader VM.
+*/
+
+//? Is .h included already?
+#ifndef SIMDKERNELS_H_INCLUDED
+#define SIMDKERNELS_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<boost/static_assert.hpp>
+
+#include	<aqsis/math/vector3d.h>
+#include	<aqsis/math/color.h>
+#include	<aqsis/math/matrix.h>
+#include	<aqsis/math/simd.h>
+#include	<aqsis/util/bitvector.h>
+#include	<aqsis/shadervm/ishaderdata.h>
+
+namespace Aqsis {
+
+/** \brief Vectorised kernels for the shader VM.
+ *
+ * The kernels process four shading points per step.  Varying operands are
+ * arrays of floats, or of triples of floats for points and colors which are
+ * stored interleaved (xyzxyz...) in the shader variables.  Componentwise
+ * operations on triples work directly on the interleaved layout, while dot
+ * and cross products, normalisation and transformation transpose each group
+ * of four points into separate x, y and z registers.
+ *
+ * Results are stored under the running state mask, as the scalar loops do: a
+ * null mask means that all shading points are running.  Every kernel ends
+ * with a scalar loop which handles the points left over from the last group
+ * of four, and all of them when SSE2 isn't available, so the results are the
+ * same as those of the scalar operators on CqVector3D and CqColor.
+ */
+namespace simd {
+
+BOOST_STATIC_ASSERT(sizeof(CqVector3D) == 3*sizeof(TqFloat));
+BOOST_STATIC_ASSERT(sizeof(CqColor) == 3*sizeof(TqFloat));
+
+//----------------------------------------------------------------------
+// Lane masks and masked stores.
+
+#ifdef AQSIS_SIMD_SSE2
+
+/// Running state of the four points starting at i, as the low four bits.
+inline TqInt laneBits(const CqBitVector* pMask, TqInt i)
+{
+	return pMask ? pMask->Value4(i) : 0xf;
+}
+
+/** Expand running state bits into a lane mask.
+ *
+ * \param bits - running state of four points.
+ * \param sel - the bit of bits selecting each lane.
+ */
+inline __m128 laneMask(TqInt bits, __m128i sel)
+{
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(
+				_mm_and_si128(_mm_set1_epi32(bits), sel), sel));
+}
+
+/// Choose lanes from a where the mask is set, and from b elsewhere.
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/// Store four floats, leaving the elements of points which aren't running.
+inline void store1(TqFloat* p, __m128 v, TqInt bits)
+{
+	if(bits == 0xf)
+		_mm_storeu_ps(p, v);
+	else
+		_mm_storeu_ps(p, select(laneMask(bits, _mm_setr_epi32(1, 2, 4, 8)),
+					v, _mm_loadu_ps(p)));
+}
+
+/// Store four interleaved triples, leaving those of points which aren't running.
+inline void store3(TqFloat* p, const __m128 v[3], TqInt bits)
+{
+	if(bits == 0xf)
+	{
+		_mm_storeu_ps(p, v[0]);
+		_mm_storeu_ps(p + 4, v[1]);
+		_mm_storeu_ps(p + 8, v[2]);
+	}
+	else
+	{
+		_mm_storeu_ps(p, select(laneMask(bits, _mm_setr_epi32(1, 1, 1, 2)),
+					v[0], _mm_loadu_ps(p)));
+		_mm_storeu_ps(p + 4, select(laneMask(bits, _mm_setr_epi32(2, 2, 4, 4)),
+					v[1], _mm_loadu_ps(p + 4)));
+		_mm_storeu_ps(p + 8, select(laneMask(bits, _mm_setr_epi32(4, 8, 8, 8)),
+					v[2], _mm_loadu_ps(p + 8)));
+	}
+}
+
+/** Transpose four interleaved triples into x, y and z registers.
+ *
+ * The input registers hold x0y0z0x1, y1z1x2y2 and z2x3y3z3.
+ */
+inline void toSoA(const __m128 v[3], __m128& x, __m128& y, __m128& z)
+{
+	__m128 t = _mm_shuffle_ps(v[1], v[2], _MM_SHUFFLE(0, 1, 0, 2));
+	x = _mm_shuffle_ps(v[0], t, _MM_SHUFFLE(2, 0, 3, 0));
+	__m128 t1 = _mm_shuffle_ps(v[0], v[1], _MM_SHUFFLE(0, 0, 0, 1));
+	__m128 t2 = _mm_shuffle_ps(v[1], v[2], _MM_SHUFFLE(0, 2, 0, 3));
+	y = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2, 0, 2, 0));
+	t = _mm_shuffle_ps(v[0], v[1], _MM_SHUFFLE(0, 1, 0, 2));
+	z = _mm_shuffle_ps(t, v[2], _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+/// Inverse of toSoA().
+inline void toAoS(__m128 x, __m128 y, __m128 z, __m128 v[3])
+{
+	__m128 t = _mm_shuffle_ps(z, x, _MM_SHUFFLE(0, 1, 0, 0));
+	v[0] = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), t, _MM_SHUFFLE(2, 0, 1, 0));
+	v[1] = _mm_shuffle_ps(_mm_unpacklo_ps(y, z), _mm_unpackhi_ps(x, y),
+			_MM_SHUFFLE(1, 0, 3, 2));
+	__m128 t1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 3, 2));
+	__m128 t2 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+	v[2] = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/// Repeat each of four floats three times, to match interleaved triples.
+inline void expandT(__m128 f, __m128 v[3])
+{
+	v[0] = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 0, 0, 0));
+	v[1] = _mm_shuffle_ps(f, f, _MM_SHUFFLE(2, 2, 1, 1));
+	v[2] = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 2));
+}
+
+/// Sum the components of each of four interleaved triples.
+inline __m128 sumT(const __m128 v[3])
+{
+	__m128 x, y, z;
+	toSoA(v, x, y, z);
+	return _mm_add_ps(_mm_add_ps(x, y), z);
+}
+
+#endif // AQSIS_SIMD_SSE2
+
+//----------------------------------------------------------------------
+// Operand streams.
+
+/** A float operand, either varying or uniform.
+ *
+ * When combined with triples, the float applies to each of the components of
+ * the corresponding point.
+ */
+class CqFloatIn
+{
+	public:
+		CqFloatIn(const TqFloat* p, bool fVar)
+			: m_p(p),
+			m_fVar(fVar)
+		{
+#ifdef AQSIS_SIMD_SSE2
+			m_uniform = _mm_set1_ps(*p);
+#endif
+		}
+		/// Component k of point i.
+		TqFloat at(TqInt i, TqInt /*k*/ = 0) const
+		{
+			return m_p[m_fVar ? i : 0];
+		}
+#ifdef AQSIS_SIMD_SSE2
+		/// The floats of the four points starting at i.
+		__m128 load(TqInt i) const
+		{
+			return m_fVar ? _mm_loadu_ps(m_p + i) : m_uniform;
+		}
+		/// The floats of four points, laid out to match interleaved triples.
+		void loadT(TqInt i, __m128 v[3]) const
+		{
+			expandT(load(i), v);
+		}
+#endif
+	private:
+		const TqFloat* m_p;
+		bool m_fVar;
+#ifdef AQSIS_SIMD_SSE2
+		__m128 m_uniform;
+#endif
+};
+
+/// A point or color operand, either varying or uniform.
+class CqTripleIn
+{
+	public:
+		CqTripleIn(const TqFloat* p, bool fVar)
+			: m_p(p),
+			m_fVar(fVar)
+		{
+#ifdef AQSIS_SIMD_SSE2
+			m_uniform[0] = _mm_setr_ps(p[0], p[1], p[2], p[0]);
+			m_uniform[1] = _mm_setr_ps(p[1], p[2], p[0], p[1]);
+			m_uniform[2] = _mm_setr_ps(p[2], p[0], p[1], p[2]);
+#endif
+		}
+		/// Component k of point i.
+		TqFloat at(TqInt i, TqInt k) const
+		{
+			return m_p[m_fVar ? 3*i + k : k];
+		}
+#ifdef AQSIS_SIMD_SSE2
+		/// The interleaved triples of the four points starting at i.
+		void loadT(TqInt i, __m128 v[3]) const
+		{
+			if(m_fVar)
+			{
+				const TqFloat* p = m_p + 3*i;
+				v[0] = _mm_loadu_ps(p);
+				v[1] = _mm_loadu_ps(p + 4);
+				v[2] = _mm_loadu_ps(p + 8);
+			}
+			else
+			{
+				v[0] = m_uniform[0];
+				v[1] = m_uniform[1];
+				v[2] = m_uniform[2];
+			}
+		}
+		/// The components of the four points starting at i.
+		void loadSoA(TqInt i, __m128& x, __m128& y, __m128& z) const
+		{
+			if(m_fVar)
+			{
+				__m128 v[3];
+				loadT(i, v);
+				toSoA(v, x, y, z);
+			}
+			else
+			{
+				x = _mm_set1_ps(m_p[0]);
+				y = _mm_set1_ps(m_p[1]);
+				z = _mm_set1_ps(m_p[2]);
+			}
+		}
+#endif
+	private:
+		const TqFloat* m_p;
+		bool m_fVar;
+#ifdef AQSIS_SIMD_SSE2
+		__m128 m_uniform[3];
+#endif
+};
+
+//----------------------------------------------------------------------
+// Componentwise operations.  Each provides the operation on single floats,
+// which defines the result, and on four floats at once.
+
+struct SqAddOp
+{
+	static TqFloat apply(TqFloat a, TqFloat b) { return a + b; }
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+#endif
+};
+
+struct SqSubOp
+{
+	static TqFloat apply(TqFloat a, TqFloat b) { return a - b; }
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+#endif
+};
+
+struct SqMulOp
+{
+	static TqFloat apply(TqFloat a, TqFloat b) { return a * b; }
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+#endif
+};
+
+struct SqDivOp
+{
+	static TqFloat apply(TqFloat a, TqFloat b) { return a / b; }
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+#endif
+};
+
+/// mix(a, b, t), as ( 1 - t ) * a + t * b
+struct SqMixOp
+{
+	static TqFloat apply(TqFloat a, TqFloat b, TqFloat t)
+	{
+		return ( 1.0f - t ) * a + t * b;
+	}
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 a, __m128 b, __m128 t)
+	{
+		return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), t), a),
+				_mm_mul_ps(t, b));
+	}
+#endif
+};
+
+/// clamp(x, min, max), with the same precedence as Aqsis::clamp().
+struct SqClampOp
+{
+	static TqFloat apply(TqFloat x, TqFloat lo, TqFloat hi)
+	{
+		return x < lo ? lo : (x > hi ? hi : x);
+	}
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 x, __m128 lo, __m128 hi)
+	{
+		__m128 r = select(_mm_cmpgt_ps(x, hi), hi, x);
+		return select(_mm_cmplt_ps(x, lo), lo, r);
+	}
+#endif
+};
+
+/// smoothstep(min, max, x), the hermite step used by SO_smoothstep.
+struct SqSmoothstepOp
+{
+	static TqFloat apply(TqFloat lo, TqFloat hi, TqFloat x)
+	{
+		if(x < lo)
+			return 0.0f;
+		else if(x >= hi)
+			return 1.0f;
+		TqFloat v = ( x - lo ) / ( hi - lo );
+		return v * v * ( 3.0f - 2.0f * v );
+	}
+#ifdef AQSIS_SIMD_SSE2
+	static __m128 apply(__m128 lo, __m128 hi, __m128 x)
+	{
+		__m128 v = _mm_div_ps(_mm_sub_ps(x, lo), _mm_sub_ps(hi, lo));
+		__m128 r = _mm_mul_ps(_mm_mul_ps(v, v),
+				_mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), v)));
+		r = select(_mm_cmpge_ps(x, hi), _mm_set1_ps(1.0f), r);
+		return select(_mm_cmplt_ps(x, lo), _mm_setzero_ps(), r);
+	}
+#endif
+};
+
+//----------------------------------------------------------------------
+// Kernels.
+
+/// r = a OP b for float operands.
+template<typename OpT>
+inline void binaryF(const CqFloatIn& aIn, const CqFloatIn& bIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const CqFloatIn a(aIn);
+	const CqFloatIn b(bIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		store1(r + i, OpT::apply(a.load(i), b.load(i)), bits);
+	}
+#endif
+	for(; i < n; ++i)
+		if(!pMask || pMask->Value(i))
+			r[i] = OpT::apply(a.at(i), b.at(i));
+}
+
+/// r = OP(a, b, c) for float operands.
+template<typename OpT>
+inline void ternaryF(const CqFloatIn& aIn, const CqFloatIn& bIn, const CqFloatIn& cIn,
+		TqFloat* r, TqInt n, const CqBitVector* pMask)
+{
+	const CqFloatIn a(aIn);
+	const CqFloatIn b(bIn);
+	const CqFloatIn c(cIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		store1(r + i, OpT::apply(a.load(i), b.load(i), c.load(i)), bits);
+	}
+#endif
+	for(; i < n; ++i)
+		if(!pMask || pMask->Value(i))
+			r[i] = OpT::apply(a.at(i), b.at(i), c.at(i));
+}
+
+/** r = a OP b componentwise, with a triple result.
+ *
+ * Either operand may be a CqFloatIn or a CqTripleIn.
+ */
+template<typename OpT, typename InA, typename InB>
+inline void binaryT(const InA& aIn, const InB& bIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const InA a(aIn);
+	const InB b(bIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 va[3], vb[3];
+		a.loadT(i, va);
+		b.loadT(i, vb);
+		va[0] = OpT::apply(va[0], vb[0]);
+		va[1] = OpT::apply(va[1], vb[1]);
+		va[2] = OpT::apply(va[2], vb[2]);
+		store3(r + 3*i, va, bits);
+	}
+#endif
+	for(; i < n; ++i)
+		if(!pMask || pMask->Value(i))
+			for(TqInt k = 0; k < 3; ++k)
+				r[3*i + k] = OpT::apply(a.at(i, k), b.at(i, k));
+}
+
+/// r = OP(a, b, c) componentwise, with a triple result.
+template<typename OpT, typename InA, typename InB, typename InC>
+inline void ternaryT(const InA& aIn, const InB& bIn, const InC& cIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const InA a(aIn);
+	const InB b(bIn);
+	const InC c(cIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 va[3], vb[3], vc[3];
+		a.loadT(i, va);
+		b.loadT(i, vb);
+		c.loadT(i, vc);
+		va[0] = OpT::apply(va[0], vb[0], vc[0]);
+		va[1] = OpT::apply(va[1], vb[1], vc[1]);
+		va[2] = OpT::apply(va[2], vb[2], vc[2]);
+		store3(r + 3*i, va, bits);
+	}
+#endif
+	for(; i < n; ++i)
+		if(!pMask || pMask->Value(i))
+			for(TqInt k = 0; k < 3; ++k)
+				r[3*i + k] = OpT::apply(a.at(i, k), b.at(i, k), c.at(i, k));
+}
+
+/// r = a . b
+inline void dot(const CqTripleIn& aIn, const CqTripleIn& bIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const CqTripleIn a(aIn);
+	const CqTripleIn b(bIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 va[3], vb[3];
+		a.loadT(i, va);
+		b.loadT(i, vb);
+		va[0] = _mm_mul_ps(va[0], vb[0]);
+		va[1] = _mm_mul_ps(va[1], vb[1]);
+		va[2] = _mm_mul_ps(va[2], vb[2]);
+		store1(r + i, sumT(va), bits);
+	}
+#endif
+	for(; i < n; ++i)
+		if(!pMask || pMask->Value(i))
+			r[i] = a.at(i, 0)*b.at(i, 0) + a.at(i, 1)*b.at(i, 1) + a.at(i, 2)*b.at(i, 2);
+}
+
+/// r = a x b
+inline void cross(const CqTripleIn& aIn, const CqTripleIn& bIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const CqTripleIn a(aIn);
+	const CqTripleIn b(bIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 ax, ay, az, bx, by, bz;
+		a.loadSoA(i, ax, ay, az);
+		b.loadSoA(i, bx, by, bz);
+		__m128 v[3];
+		toAoS(_mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)),
+				_mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)),
+				_mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)), v);
+		store3(r + 3*i, v, bits);
+	}
+#endif
+	for(; i < n; ++i)
+	{
+		if(!pMask || pMask->Value(i))
+		{
+			TqFloat ax = a.at(i, 0), ay = a.at(i, 1), az = a.at(i, 2);
+			TqFloat bx = b.at(i, 0), by = b.at(i, 1), bz = b.at(i, 2);
+			r[3*i] = ay*bz - az*by;
+			r[3*i + 1] = az*bx - ax*bz;
+			r[3*i + 2] = ax*by - ay*bx;
+		}
+	}
+}
+
+/// r = a / |a|, leaving zero length vectors unchanged as CqVector3D::Unit() does.
+inline void normalize(const CqTripleIn& aIn, TqFloat* r, TqInt n, const CqBitVector* pMask)
+{
+	const CqTripleIn a(aIn);
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 v[3], sq[3];
+		a.loadT(i, v);
+		sq[0] = _mm_mul_ps(v[0], v[0]);
+		sq[1] = _mm_mul_ps(v[1], v[1]);
+		sq[2] = _mm_mul_ps(v[2], v[2]);
+		__m128 len = _mm_sqrt_ps(sumT(sq));
+		__m128 zero = _mm_cmpeq_ps(len, _mm_setzero_ps());
+		// Divide by one where the length is zero.
+		__m128 lenT[3];
+		expandT(select(zero, _mm_set1_ps(1.0f), len), lenT);
+		v[0] = _mm_div_ps(v[0], lenT[0]);
+		v[1] = _mm_div_ps(v[1], lenT[1]);
+		v[2] = _mm_div_ps(v[2], lenT[2]);
+		store3(r + 3*i, v, bits);
+	}
+#endif
+	for(; i < n; ++i)
+	{
+		if(!pMask || pMask->Value(i))
+		{
+			CqVector3D v(a.at(i, 0), a.at(i, 1), a.at(i, 2));
+			v.Unit();
+			r[3*i] = v.x();
+			r[3*i + 1] = v.y();
+			r[3*i + 2] = v.z();
+		}
+	}
+}
+
+#ifdef AQSIS_SIMD_SSE2
+/// Column col of the row vector (x, y, z, 1) times the matrix elements e.
+inline __m128 transformComp(const TqFloat* e, TqInt col, __m128 x, __m128 y, __m128 z)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(e[col]), x), _mm_mul_ps(_mm_set1_ps(e[4 + col]), y)),
+				_mm_mul_ps(_mm_set1_ps(e[8 + col]), z)), _mm_set1_ps(e[12 + col]));
+}
+#endif
+
+/// r = m * p, with the homogeneous divide of CqMatrix::operator*(const CqVector3D&).
+inline void transform(const CqMatrix& m, const CqTripleIn& pIn, TqFloat* r,
+		TqInt n, const CqBitVector* pMask)
+{
+	const CqTripleIn p(pIn);
+	const TqFloat* e = m.pElements();
+	const bool fIdentity = m.fIdentity();
+	TqInt i = 0;
+#ifdef AQSIS_SIMD_SSE2
+	const __m128 one = _mm_set1_ps(1.0f);
+	for(; i + 4 <= n; i += 4)
+	{
+		TqInt bits = laneBits(pMask, i);
+		__m128 v[3];
+		if(fIdentity)
+			p.loadT(i, v);
+		else
+		{
+			__m128 x, y, z;
+			p.loadSoA(i, x, y, z);
+			__m128 rx = transformComp(e, 0, x, y, z);
+			__m128 ry = transformComp(e, 1, x, y, z);
+			__m128 rz = transformComp(e, 2, x, y, z);
+			__m128 h = transformComp(e, 3, x, y, z);
+			__m128 divide = _mm_cmpneq_ps(h, one);
+			__m128 invh = _mm_div_ps(one, h);
+			toAoS(select(divide, _mm_mul_ps(rx, invh), rx),
+					select(divide, _mm_mul_ps(ry, invh), ry),
+					select(divide, _mm_mul_ps(rz, invh), rz), v);
+		}
+		store3(r + 3*i, v, bits);
+	}
+#endif
+	for(; i < n; ++i)
+	{
+		if(!pMask || pMask->Value(i))
+		{
+			CqVector3D v = m * CqVector3D(p.at(i, 0), p.at(i, 1), p.at(i, 2));
+			r[3*i] = v.x();
+			r[3*i + 1] = v.y();
+			r[3*i + 2] = v.z();
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+// Typed entry points.
+
+inline const TqFloat* comps(const CqVector3D* p)
+{
+	return reinterpret_cast<const TqFloat*>(p);
+}
+inline const TqFloat* comps(const CqColor* p)
+{
+	return reinterpret_cast<const TqFloat*>(p);
+}
+inline TqFloat* comps(CqVector3D* p)
+{
+	return reinterpret_cast<TqFloat*>(p);
+}
+inline TqFloat* comps(CqColor* p)
+{
+	return reinterpret_cast<TqFloat*>(p);
+}
+
+/** Check whether shadeop arguments can be handed to the kernels directly.
+ *
+ * The arguments must be non-array values holding either one element or at
+ * least n of them.  The result must hold n elements, unless n is one.
+ *
+ * \param n - number of shading points the shadeop runs over.
+ */
+inline bool directAccess(TqInt n, const IqShaderData* pResult,
+		const IqShaderData* a, const IqShaderData* b = 0, const IqShaderData* c = 0)
+{
+	const IqShaderData* args[] = { pResult, a, b, c };
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		const IqShaderData* arg = args[i];
+		if(!arg)
+			continue;
+		TqInt size = arg->Size();
+		if(arg->ArrayLength() > 0 || size < (i == 0 ? n : 1) || (size > 1 && size < n))
+			return false;
+	}
+	return true;
+}
+
+} // namespace simd
+
+
+//----------------------------------------------------------------------
+// Dispatch from the varying paths of the VM arithmetic operators.
+//
+// SimdOpNAME() runs the vectorised kernel for the operand types, returning
+// false if there isn't one so the caller falls back to its scalar loop.  The
+// operands follow the conventions of the RegOp kernels in registerprogram.h.
+
+#define	SimdOpFallback(NAME) \
+		template <class A, class B, class R> \
+		inline bool	SimdOp##NAME( const A*, bool, const B*, bool, R*, TqInt, const CqBitVector* ) \
+		{ \
+			return false; \
+		}
+
+#define	SimdOpComponentwise(OPT, NAME) \
+		SimdOpFallback(NAME) \
+		inline bool	SimdOp##NAME( const TqFloat* pA, bool fAVar, const TqFloat* pB, bool fBVar, \
+				TqFloat* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			simd::binaryF<OPT>( simd::CqFloatIn( pA, fAVar ), simd::CqFloatIn( pB, fBVar ), pR, n, pMask ); \
+			return true; \
+		} \
+		inline bool	SimdOp##NAME( const CqColor* pA, bool fAVar, const CqColor* pB, bool fBVar, \
+				CqColor* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			simd::binaryT<OPT>( simd::CqTripleIn( simd::comps( pA ), fAVar ), \
+					simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask ); \
+			return true; \
+		} \
+		inline bool	SimdOp##NAME( const TqFloat* pA, bool fAVar, const CqVector3D* pB, bool fBVar, \
+				CqVector3D* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			simd::binaryT<OPT>( simd::CqFloatIn( pA, fAVar ), \
+					simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask ); \
+			return true; \
+		} \
+		inline bool	SimdOp##NAME( const TqFloat* pA, bool fAVar, const CqColor* pB, bool fBVar, \
+				CqColor* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			simd::binaryT<OPT>( simd::CqFloatIn( pA, fAVar ), \
+					simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask ); \
+			return true; \
+		}
+
+/// Componentwise operators between points, which don't include multiplication.
+#define	SimdOpPointwise(OPT, NAME) \
+		inline bool	SimdOp##NAME( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar, \
+				CqVector3D* pR, TqInt n, const CqBitVector* pMask ) \
+		{ \
+			simd::binaryT<OPT>( simd::CqTripleIn( simd::comps( pA ), fAVar ), \
+					simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask ); \
+			return true; \
+		}
+
+SimdOpComponentwise( simd::SqAddOp, ADD )
+SimdOpComponentwise( simd::SqSubOp, SUB )
+SimdOpComponentwise( simd::SqMulOp, MUL )
+SimdOpComponentwise( simd::SqDivOp, DIV )
+SimdOpPointwise( simd::SqAddOp, ADD )
+SimdOpPointwise( simd::SqSubOp, SUB )
+SimdOpPointwise( simd::SqDivOp, DIV )
+
+SimdOpFallback( DOT )
+inline bool	SimdOpDOT( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar,
+		TqFloat* pR, TqInt n, const CqBitVector* pMask )
+{
+	simd::dot( simd::CqTripleIn( simd::comps( pA ), fAVar ),
+			simd::CqTripleIn( simd::comps( pB ), fBVar ), pR, n, pMask );
+	return true;
+}
+
+/// Vector multiplication is the dot product.
+inline bool	SimdOpMUL( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar,
+		TqFloat* pR, TqInt n, const CqBitVector* pMask )
+{
+	return SimdOpDOT( pA, fAVar, pB, fBVar, pR, n, pMask );
+}
+
+SimdOpFallback( CRS )
+inline bool	SimdOpCRS( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar,
+		CqVector3D* pR, TqInt n, const CqBitVector* pMask )
+{
+	simd::cross( simd::CqTripleIn( simd::comps( pA ), fAVar ),
+			simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask );
+	return true;
+}
+
+SimdOpFallback( LSS )
+SimdOpFallback( GRT )
+SimdOpFallback( LE )
+SimdOpFallback( GE )
+SimdOpFallback( EQ )
+SimdOpFallback( NE )
+SimdOpFallback( LAND )
+SimdOpFallback( LOR )
+
+/// Componentwise vector multiplication, as done by OpMULV.
+inline void	SimdOpMULV( const CqVector3D* pA, bool fAVar, const CqVector3D* pB, bool fBVar,
+		CqVector3D* pR, TqInt n, const CqBitVector* pMask )
+{
+	simd::binaryT<simd::SqMulOp>( simd::CqTripleIn( simd::comps( pA ), fAVar ),
+			simd::CqTripleIn( simd::comps( pB ), fBVar ), simd::comps( pR ), n, pMask );
+}
+
+} // namespace Aqsis
+
+#endif	// !SIMDKERNELS_H_INCLUDED
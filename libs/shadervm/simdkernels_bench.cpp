@@ -0,0 +1,402 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Microbenchmark comparing the vectorised shader VM kernels with the scalar loops.
+
+	Each kernel is run over a typical grid with the shading points outside a
+	disc masked out, once with the per-element loops used by the VM before the
+	kernels existed and once with the kernels.  The results of the two are
+	checked against each other before the timings are reported.
+
+	Usage: simdkernels_bench [grid size] [iterations]
+*/
+
+#include	<aqsis/aqsis.h>
+
+#include	<cmath>
+#include	<cstdlib>
+#include	<iomanip>
+#include	<iostream>
+#include	<vector>
+
+#include	<aqsis/util/timer.h>
+
+#include	"simdkernels.h"
+
+using namespace Aqsis;
+
+namespace {
+
+TqInt gridSize = 289;
+TqInt iterations = 100000;
+bool allMatched = true;
+
+TqFloat randf()
+{
+	return std::rand() / static_cast<TqFloat>(RAND_MAX) * 2.0f - 1.0f;
+}
+
+template<typename T>
+std::vector<T> randomTriples(TqInt n)
+{
+	std::vector<T> v(n);
+	for(TqInt i = 0; i < n; ++i)
+		v[i] = T(randf(), randf(), randf());
+	return v;
+}
+
+std::vector<TqFloat> randomFloats(TqInt n, TqFloat offset = 0)
+{
+	std::vector<TqFloat> v(n);
+	for(TqInt i = 0; i < n; ++i)
+		v[i] = randf() + offset;
+	return v;
+}
+
+bool closeTo(TqFloat a, TqFloat b)
+{
+	return std::fabs(a - b) <= 1e-5f * (1 + std::fabs(a));
+}
+
+void check(const TqFloat* a, const TqFloat* b, TqInt n, const char* name)
+{
+	for(TqInt i = 0; i < n; ++i)
+	{
+		if(!closeTo(a[i], b[i]))
+		{
+			std::cout << name << ": mismatch at " << i << " (" << a[i]
+				<< " != " << b[i] << ")\n";
+			allMatched = false;
+			return;
+		}
+	}
+}
+
+/** Time a scalar and a vectorised version of a kernel and compare them.
+ *
+ * \param scalar, vectorised - functors running the kernel once.
+ * \param rs, rv - results of the two versions.
+ */
+template<typename ScalarT, typename SimdT, typename R>
+void bench(const char* name, ScalarT scalar, SimdT vectorised,
+		std::vector<R>& rs, std::vector<R>& rv)
+{
+	// Take the best of a few runs, to keep down the noise from other processes.
+	double ts = 0;
+	double tv = 0;
+	for(TqInt run = 0; run < 5; ++run)
+	{
+		CqTimer scalarTimer;
+		scalarTimer.start();
+		for(TqInt i = 0; i < iterations; ++i)
+			scalar();
+		scalarTimer.stop();
+		CqTimer simdTimer;
+		simdTimer.start();
+		for(TqInt i = 0; i < iterations; ++i)
+			vectorised();
+		simdTimer.stop();
+		if(run == 0 || scalarTimer.totalTime() < ts)
+			ts = scalarTimer.totalTime();
+		if(run == 0 || simdTimer.totalTime() < tv)
+			tv = simdTimer.totalTime();
+	}
+
+	check(reinterpret_cast<const TqFloat*>(&rs[0]),
+			reinterpret_cast<const TqFloat*>(&rv[0]),
+			rs.size()*sizeof(R)/sizeof(TqFloat), name);
+
+	std::cout << std::setw(16) << std::left << name << std::right
+		<< std::setw(10) << std::fixed << std::setprecision(3) << ts
+		<< std::setw(10) << tv
+		<< std::setw(9) << std::setprecision(2) << (tv > 0 ? ts/tv : 0) << "x\n";
+}
+
+// Scalar versions of the kernels, as written in the OpABRS loops and the
+// shadeops, and the corresponding vectorised versions.
+
+#define	SCALAR_LOOP(BODY) \
+	do { \
+		for(TqInt i = 0; i < n; ++i) \
+			if(rs.Value(i)) \
+				BODY; \
+	} while(0)
+
+struct AddFF
+{
+	std::vector<TqFloat>& a; std::vector<TqFloat>& b; std::vector<TqFloat>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = a[i] + b[i]); }
+};
+
+struct AddFFSimd
+{
+	std::vector<TqFloat>& a; std::vector<TqFloat>& b; std::vector<TqFloat>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::binaryF<simd::SqAddOp>(simd::CqFloatIn(&a[0], true),
+				simd::CqFloatIn(&b[0], true), &r[0], n, pMask);
+	}
+};
+
+struct MulFP
+{
+	std::vector<TqFloat>& a; std::vector<CqVector3D>& b; std::vector<CqVector3D>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = a[i] * b[i]); }
+};
+
+struct MulFPSimd
+{
+	std::vector<TqFloat>& a; std::vector<CqVector3D>& b; std::vector<CqVector3D>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const { SimdOpMUL(&a[0], true, &b[0], true, &r[0], n, pMask); }
+};
+
+struct SubCC
+{
+	std::vector<CqColor>& a; CqColor b; std::vector<CqColor>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = a[i] - b); }
+};
+
+struct SubCCSimd
+{
+	std::vector<CqColor>& a; CqColor b; std::vector<CqColor>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const { SimdOpSUB(&a[0], true, &b, false, &r[0], n, pMask); }
+};
+
+struct Dot
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& b; std::vector<TqFloat>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = a[i] * b[i]); }
+};
+
+struct DotSimd
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& b; std::vector<TqFloat>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const { SimdOpMUL(&a[0], true, &b[0], true, &r[0], n, pMask); }
+};
+
+struct Cross
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& b; std::vector<CqVector3D>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = a[i] % b[i]); }
+};
+
+struct CrossSimd
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& b; std::vector<CqVector3D>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const { SimdOpCRS(&a[0], true, &b[0], true, &r[0], n, pMask); }
+};
+
+struct Normalize
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = CqVector3D(a[i]).Unit()); }
+};
+
+struct NormalizeSimd
+{
+	std::vector<CqVector3D>& a; std::vector<CqVector3D>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::normalize(simd::CqTripleIn(simd::comps(&a[0]), true),
+				simd::comps(&r[0]), n, pMask);
+	}
+};
+
+struct Mix
+{
+	std::vector<CqColor>& a; std::vector<CqColor>& b; std::vector<TqFloat>& t;
+	std::vector<CqColor>& r; const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = ( 1.0f - t[i] ) * a[i] + t[i] * b[i]); }
+};
+
+struct MixSimd
+{
+	std::vector<CqColor>& a; std::vector<CqColor>& b; std::vector<TqFloat>& t;
+	std::vector<CqColor>& r; const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::ternaryT<simd::SqMixOp>(simd::CqTripleIn(simd::comps(&a[0]), true),
+				simd::CqTripleIn(simd::comps(&b[0]), true),
+				simd::CqFloatIn(&t[0], true), simd::comps(&r[0]), n, pMask);
+	}
+};
+
+struct Clamp
+{
+	std::vector<TqFloat>& a; TqFloat lo; TqFloat hi; std::vector<TqFloat>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = clamp(a[i], lo, hi)); }
+};
+
+struct ClampSimd
+{
+	std::vector<TqFloat>& a; TqFloat lo; TqFloat hi; std::vector<TqFloat>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::ternaryF<simd::SqClampOp>(simd::CqFloatIn(&a[0], true),
+				simd::CqFloatIn(&lo, false), simd::CqFloatIn(&hi, false),
+				&r[0], n, pMask);
+	}
+};
+
+struct Smoothstep
+{
+	TqFloat lo; TqFloat hi; std::vector<TqFloat>& x; std::vector<TqFloat>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = simd::SqSmoothstepOp::apply(lo, hi, x[i])); }
+};
+
+struct SmoothstepSimd
+{
+	TqFloat lo; TqFloat hi; std::vector<TqFloat>& x; std::vector<TqFloat>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::ternaryF<simd::SqSmoothstepOp>(simd::CqFloatIn(&lo, false),
+				simd::CqFloatIn(&hi, false), simd::CqFloatIn(&x[0], true),
+				&r[0], n, pMask);
+	}
+};
+
+struct Transform
+{
+	const CqMatrix& m; std::vector<CqVector3D>& p; std::vector<CqVector3D>& r;
+	const CqBitVector& rs; TqInt n;
+	void operator()() const { SCALAR_LOOP(r[i] = m * p[i]); }
+};
+
+struct TransformSimd
+{
+	const CqMatrix& m; std::vector<CqVector3D>& p; std::vector<CqVector3D>& r;
+	const CqBitVector* pMask; TqInt n;
+	void operator()() const
+	{
+		simd::transform(m, simd::CqTripleIn(simd::comps(&p[0]), true),
+				simd::comps(&r[0]), n, pMask);
+	}
+};
+
+} // unnamed namespace
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1)
+		gridSize = std::atoi(argv[1]);
+	if(argc > 2)
+		iterations = std::atoi(argv[2]);
+	const TqInt n = gridSize;
+
+	// Mask out the points outside a disc on the grid, much as a conditional
+	// in a shader would.
+	CqBitVector rs(n);
+	TqInt side = static_cast<TqInt>(std::sqrt(static_cast<TqFloat>(n)));
+	for(TqInt i = 0; i < n; ++i)
+	{
+		TqFloat x = (i % side) / static_cast<TqFloat>(side) - 0.5f;
+		TqFloat y = (i / side) / static_cast<TqFloat>(side) - 0.5f;
+		rs.SetValue(i, x*x + y*y < 0.2f);
+	}
+
+	std::srand(42);
+
+	std::vector<TqFloat> fa = randomFloats(n), fb = randomFloats(n, 3.0f),
+		ft = randomFloats(n);
+	std::vector<CqVector3D> pa = randomTriples<CqVector3D>(n),
+		pb = randomTriples<CqVector3D>(n);
+	std::vector<CqColor> ca = randomTriples<CqColor>(n),
+		cb = randomTriples<CqColor>(n);
+	for(TqInt i = 0; i < n; i += 7)
+		pa[i] = CqVector3D(0, 0, 0);
+	CqMatrix mat(0.5f, 0.1f, 0.0f, 0.02f,
+			-0.1f, 0.7f, 0.3f, 0.0f,
+			0.2f, 0.0f, 1.1f, 0.01f,
+			3.0f, -2.0f, 1.0f, 1.0f);
+	const CqBitVector* pMask = &rs;
+
+	std::vector<TqFloat> fs(n), fv(n);
+	std::vector<CqVector3D> ps(n), pv(n);
+	std::vector<CqColor> cs(n), cv(n);
+
+	std::cout << "grid size " << n << ", " << iterations << " iterations\n"
+		<< std::setw(16) << std::left << "kernel" << std::right
+		<< std::setw(10) << "scalar" << std::setw(10) << "simd"
+		<< std::setw(10) << "speedup" << "\n";
+
+	AddFF addFF = { fa, fb, fs, rs, n };
+	AddFFSimd addFFSimd = { fa, fb, fv, pMask, n };
+	bench("add float", addFF, addFFSimd, fs, fv);
+
+	MulFP mulFP = { fa, pb, ps, rs, n };
+	MulFPSimd mulFPSimd = { fa, pb, pv, pMask, n };
+	bench("mul float point", mulFP, mulFPSimd, ps, pv);
+
+	SubCC subCC = { ca, cb[0], cs, rs, n };
+	SubCCSimd subCCSimd = { ca, cb[0], cv, pMask, n };
+	bench("sub color", subCC, subCCSimd, cs, cv);
+
+	Dot dot = { pa, pb, fs, rs, n };
+	DotSimd dotSimd = { pa, pb, fv, pMask, n };
+	bench("dot", dot, dotSimd, fs, fv);
+
+	Cross crs = { pa, pb, ps, rs, n };
+	CrossSimd crsSimd = { pa, pb, pv, pMask, n };
+	bench("cross", crs, crsSimd, ps, pv);
+
+	Normalize nrm = { pa, ps, rs, n };
+	NormalizeSimd nrmSimd = { pa, pv, pMask, n };
+	bench("normalize", nrm, nrmSimd, ps, pv);
+
+	Mix mix = { ca, cb, ft, cs, rs, n };
+	MixSimd mixSimd = { ca, cb, ft, cv, pMask, n };
+	bench("mix color", mix, mixSimd, cs, cv);
+
+	Clamp clmp = { fa, -0.5f, 0.5f, fs, rs, n };
+	ClampSimd clmpSimd = { fa, -0.5f, 0.5f, fv, pMask, n };
+	bench("clamp float", clmp, clmpSimd, fs, fv);
+
+	Smoothstep sstep = { -0.5f, 0.5f, fa, fs, rs, n };
+	SmoothstepSimd sstepSimd = { -0.5f, 0.5f, fa, fv, pMask, n };
+	bench("smoothstep", sstep, sstepSimd, fs, fv);
+
+	Transform xform = { mat, pb, ps, rs, n };
+	TransformSimd xformSimd = { mat, pb, pv, pMask, n };
+	bench("transform", xform, xformSimd, ps, pv);
+
+	if(!allMatched)
+	{
+		std::cout << "vectorised results differ from the scalar versions\n";
+		return 1;
+	}
+	return 0;
+}
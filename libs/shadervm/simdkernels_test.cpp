@@ -0,0 +1,338 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests comparing the vectorised shader VM kernels with the
+ * scalar operators.
+ */
+
+#include "simdkernels.h"
+
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+// Not a multiple of four, so that the scalar tail of each kernel runs too.
+const TqInt n = 23;
+// Marks results at the points which aren't running.
+const TqFloat untouched = -123.0f;
+/** Percentage tolerance for kernels which add products.
+ *
+ * The kernels do the same operations in the same order as the scalar
+ * operators, so their results are normally identical.  The compiler may
+ * however fuse a multiply and add into one instruction in either the kernel
+ * or the scalar code when the target has FMA, which changes the rounding of
+ * dot(), cross(), normalize(), transform(), mix() and smoothstep().  The
+ * other kernels are single operations or selects, and must match exactly.
+ * The tolerance allows for the cancellation in cross products.
+ */
+const TqFloat fusedTolerance = 1e-3f;
+
+/// Running state with a mixture of running and stopped points in each
+/// group of four.
+CqBitVector mixedMask()
+{
+	CqBitVector rs(n);
+	for(TqInt i = 0; i < n; ++i)
+		rs.SetValue(i, i % 3 != 1 && i != 8);
+	return rs;
+}
+
+TqFloat testFloat(TqInt i, TqFloat offset = 0)
+{
+	return 0.37f*i - 3.1f + offset;
+}
+
+CqVector3D testPoint(TqInt i, TqFloat offset = 0)
+{
+	// Include a zero length vector for normalize(), though not among the
+	// divisors.
+	if(i == 5 && offset == 0)
+		return CqVector3D(0, 0, 0);
+	return CqVector3D(testFloat(i, offset), 1.5f - 0.21f*i, 0.05f*i*i + 0.3f + offset);
+}
+
+CqColor testColor(TqInt i, TqFloat offset = 0)
+{
+	return CqColor(0.1f*i + offset, 2.0f - 0.3f*i, 0.5f + offset);
+}
+
+bool running(const CqBitVector* pMask, TqInt i)
+{
+	return !pMask || pMask->Value(i);
+}
+
+void checkFloats(const std::vector<TqFloat>& r, const std::vector<TqFloat>& expected,
+		const CqBitVector* pMask, TqFloat tolerance = 0)
+{
+	for(TqInt i = 0; i < n; ++i)
+	{
+		if(running(pMask, i) && tolerance > 0)
+			BOOST_CHECK_CLOSE(r[i], expected[i], tolerance);
+		else if(running(pMask, i))
+			BOOST_CHECK_EQUAL(r[i], expected[i]);
+		else
+			BOOST_CHECK_EQUAL(r[i], untouched);
+	}
+}
+
+template<typename T>
+void checkTriples(const std::vector<T>& r, const std::vector<T>& expected,
+		const CqBitVector* pMask, TqFloat tolerance = 0)
+{
+	for(TqInt i = 0; i < n; ++i)
+	{
+		for(TqInt k = 0; k < 3; ++k)
+		{
+			if(running(pMask, i) && tolerance > 0)
+				BOOST_CHECK_CLOSE(r[i][k], expected[i][k], tolerance);
+			else if(running(pMask, i))
+				BOOST_CHECK_EQUAL(r[i][k], expected[i][k]);
+			else
+				BOOST_CHECK_EQUAL(r[i][k], untouched);
+		}
+	}
+}
+
+/// Run the checks both with all points running and with a mixed mask.
+template<typename CheckT>
+void checkMasks(CheckT check)
+{
+	CqBitVector rs = mixedMask();
+	check(static_cast<const CqBitVector*>(0));
+	check(&rs);
+}
+
+// Each check runs a kernel on varying and uniform operands and compares it
+// with the scalar operator applied at each point.
+
+struct SqCheckFloatOps
+{
+	void operator()(const CqBitVector* pMask) const
+	{
+		std::vector<TqFloat> a(n), b(n);
+		for(TqInt i = 0; i < n; ++i)
+		{
+			a[i] = testFloat(i);
+			b[i] = testFloat(n - i, 0.25f);
+		}
+		for(TqInt bVar = 0; bVar < 2; ++bVar)
+		{
+			std::vector<TqFloat> add(n), sub(n), mul(n), div(n);
+			for(TqInt i = 0; i < n; ++i)
+			{
+				TqFloat bi = b[bVar ? i : 0];
+				add[i] = a[i] + bi;
+				sub[i] = a[i] - bi;
+				mul[i] = a[i] * bi;
+				div[i] = a[i] / bi;
+			}
+			std::vector<TqFloat> r(n, untouched);
+			BOOST_CHECK(SimdOpADD(&a[0], true, &b[0], bVar != 0, &r[0], n, pMask));
+			checkFloats(r, add, pMask);
+			r.assign(n, untouched);
+			SimdOpSUB(&a[0], true, &b[0], bVar != 0, &r[0], n, pMask);
+			checkFloats(r, sub, pMask);
+			r.assign(n, untouched);
+			SimdOpMUL(&a[0], true, &b[0], bVar != 0, &r[0], n, pMask);
+			checkFloats(r, mul, pMask);
+			r.assign(n, untouched);
+			SimdOpDIV(&a[0], true, &b[0], bVar != 0, &r[0], n, pMask);
+			checkFloats(r, div, pMask);
+		}
+	}
+};
+
+struct SqCheckTripleOps
+{
+	void operator()(const CqBitVector* pMask) const
+	{
+		std::vector<TqFloat> f(n);
+		std::vector<CqVector3D> pa(n), pb(n);
+		std::vector<CqColor> ca(n), cb(n);
+		for(TqInt i = 0; i < n; ++i)
+		{
+			f[i] = testFloat(i, 0.1f);
+			pa[i] = testPoint(i);
+			pb[i] = testPoint(n - i, 0.5f);
+			ca[i] = testColor(i);
+			cb[i] = testColor(n - i, 0.75f);
+		}
+		for(TqInt aVar = 0; aVar < 2; ++aVar)
+		{
+			std::vector<CqVector3D> addP(n), subP(n), divP(n), mulFP(n), crs(n), mulV(n);
+			std::vector<CqColor> addC(n), subC(n), mulC(n), divC(n), divFC(n);
+			std::vector<TqFloat> dot(n);
+			for(TqInt i = 0; i < n; ++i)
+			{
+				TqInt ai = aVar ? i : 0;
+				addP[i] = pa[ai] + pb[i];
+				subP[i] = pa[ai] - pb[i];
+				divP[i] = pa[ai] / pb[i];
+				mulV[i] = CqVector3D(pa[ai].x()*pb[i].x(), pa[ai].y()*pb[i].y(),
+						pa[ai].z()*pb[i].z());
+				mulFP[i] = f[ai] * pb[i];
+				dot[i] = pa[ai] * pb[i];
+				crs[i] = pa[ai] % pb[i];
+				addC[i] = ca[ai] + cb[i];
+				subC[i] = ca[ai] - cb[i];
+				mulC[i] = ca[ai] * cb[i];
+				divC[i] = ca[ai] / cb[i];
+				divFC[i] = f[ai] / cb[i];
+			}
+			bool fAVar = aVar != 0;
+
+			std::vector<CqVector3D> rp(n, CqVector3D(untouched, untouched, untouched));
+			const std::vector<CqVector3D> rp0 = rp;
+			SimdOpADD(&pa[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, addP, pMask);
+			rp = rp0;
+			SimdOpSUB(&pa[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, subP, pMask);
+			rp = rp0;
+			SimdOpDIV(&pa[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, divP, pMask);
+			rp = rp0;
+			SimdOpMULV(&pa[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, mulV, pMask);
+			rp = rp0;
+			SimdOpMUL(&f[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, mulFP, pMask);
+			rp = rp0;
+			SimdOpCRS(&pa[0], fAVar, &pb[0], true, &rp[0], n, pMask);
+			checkTriples(rp, crs, pMask, fusedTolerance);
+
+			std::vector<TqFloat> rf(n, untouched);
+			SimdOpDOT(&pa[0], fAVar, &pb[0], true, &rf[0], n, pMask);
+			checkFloats(rf, dot, pMask, fusedTolerance);
+
+			std::vector<CqColor> rc(n, CqColor(untouched, untouched, untouched));
+			const std::vector<CqColor> rc0 = rc;
+			SimdOpADD(&ca[0], fAVar, &cb[0], true, &rc[0], n, pMask);
+			checkTriples(rc, addC, pMask);
+			rc = rc0;
+			SimdOpSUB(&ca[0], fAVar, &cb[0], true, &rc[0], n, pMask);
+			checkTriples(rc, subC, pMask);
+			rc = rc0;
+			SimdOpMUL(&ca[0], fAVar, &cb[0], true, &rc[0], n, pMask);
+			checkTriples(rc, mulC, pMask);
+			rc = rc0;
+			SimdOpDIV(&ca[0], fAVar, &cb[0], true, &rc[0], n, pMask);
+			checkTriples(rc, divC, pMask);
+			rc = rc0;
+			SimdOpDIV(&f[0], fAVar, &cb[0], true, &rc[0], n, pMask);
+			checkTriples(rc, divFC, pMask);
+		}
+	}
+};
+
+struct SqCheckShadeopKernels
+{
+	void operator()(const CqBitVector* pMask) const
+	{
+		std::vector<TqFloat> x(n), t(n);
+		std::vector<CqVector3D> p(n);
+		std::vector<CqColor> ca(n), cb(n);
+		for(TqInt i = 0; i < n; ++i)
+		{
+			x[i] = 0.1f*i - 1.0f;
+			t[i] = 0.05f*i;
+			p[i] = testPoint(i);
+			ca[i] = testColor(i);
+			cb[i] = testColor(n - i, 0.2f);
+		}
+		const TqFloat lo = -0.5f;
+		const TqFloat hi = 0.75f;
+		CqMatrix m(0.5f, 0.1f, 0.0f, 0.02f,
+				-0.1f, 0.7f, 0.3f, 0.0f,
+				0.2f, 0.0f, 1.1f, 0.01f,
+				3.0f, -2.0f, 1.0f, 1.0f);
+
+		std::vector<TqFloat> clampR(n), smoothR(n);
+		std::vector<CqVector3D> unitR(n), xformR(n);
+		std::vector<CqColor> mixR(n);
+		for(TqInt i = 0; i < n; ++i)
+		{
+			clampR[i] = clamp(x[i], lo, hi);
+			if(x[i] < lo)
+				smoothR[i] = 0;
+			else if(x[i] >= hi)
+				smoothR[i] = 1;
+			else
+			{
+				TqFloat v = (x[i] - lo) / (hi - lo);
+				smoothR[i] = v*v*(3 - 2*v);
+			}
+			unitR[i] = CqVector3D(p[i]).Unit();
+			xformR[i] = m * p[i];
+			mixR[i] = (1 - t[i]) * ca[i] + t[i] * cb[i];
+		}
+
+		std::vector<TqFloat> rf(n, untouched);
+		simd::ternaryF<simd::SqClampOp>(simd::CqFloatIn(&x[0], true),
+				simd::CqFloatIn(&lo, false), simd::CqFloatIn(&hi, false),
+				&rf[0], n, pMask);
+		checkFloats(rf, clampR, pMask);
+		rf.assign(n, untouched);
+		simd::ternaryF<simd::SqSmoothstepOp>(simd::CqFloatIn(&lo, false),
+				simd::CqFloatIn(&hi, false), simd::CqFloatIn(&x[0], true),
+				&rf[0], n, pMask);
+		checkFloats(rf, smoothR, pMask, fusedTolerance);
+
+		std::vector<CqVector3D> rp(n, CqVector3D(untouched, untouched, untouched));
+		const std::vector<CqVector3D> rp0 = rp;
+		simd::normalize(simd::CqTripleIn(simd::comps(&p[0]), true),
+				simd::comps(&rp[0]), n, pMask);
+		checkTriples(rp, unitR, pMask, fusedTolerance);
+		rp = rp0;
+		simd::transform(m, simd::CqTripleIn(simd::comps(&p[0]), true),
+				simd::comps(&rp[0]), n, pMask);
+		checkTriples(rp, xformR, pMask, fusedTolerance);
+
+		std::vector<CqColor> rc(n, CqColor(untouched, untouched, untouched));
+		simd::ternaryT<simd::SqMixOp>(simd::CqTripleIn(simd::comps(&ca[0]), true),
+				simd::CqTripleIn(simd::comps(&cb[0]), true),
+				simd::CqFloatIn(&t[0], true), simd::comps(&rc[0]), n, pMask);
+		checkTriples(rc, mixR, pMask, fusedTolerance);
+	}
+};
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(simdkernels_float_ops_test)
+{
+	checkMasks(SqCheckFloatOps());
+}
+
+BOOST_AUTO_TEST_CASE(simdkernels_triple_ops_test)
+{
+	checkMasks(SqCheckTripleOps());
+}
+
+BOOST_AUTO_TEST_CASE(simdkernels_shadeop_kernels_test)
+{
+	checkMasks(SqCheckShadeopKernels());
+}
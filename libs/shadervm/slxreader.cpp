@@ -0,0 +1,470 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Implements the readers for the tokens of compiled shader programs.
+*/
+
+#include	"slxreader.h"
+
+#include	<cstdio>
+#include	<cstdlib>
+#include	<cstring>
+#include	<iostream>
+#include	<sstream>
+#include	<string>
+#include	<vector>
+
+#include	<aqsis/shadervm/ishader.h>
+#include	<aqsis/slcomp/icodegen.h>
+#include	<aqsis/slcomp/slxbinary.h>
+
+namespace Aqsis {
+
+namespace {
+
+//---------------------------------------------------------------------
+/**
+* Function to determine if not the character is ' '
+*/
+
+bool notspace(char C)
+{
+	bool retval = true;
+
+	if ((C == 0x20) ||
+	        (( C >= 0x09 ) && (C <= 0x0D)))
+		retval = false;
+
+	return retval;
+}
+
+//---------------------------------------------------------------------
+/** \brief Read in and interpret a numeric escape sequence as a character
+ *
+ * \param pFile shader stream
+ * \param s result string
+ * \param c, current character
+ */
+void GetNumericEscapeChar(std::istream* pFile, CqString &s, char c)
+{
+	CqString a("");
+	bool isHexadecimal = (c =='x');
+	unsigned int maxLength;
+
+	if (isHexadecimal)
+	{
+		maxLength = 2;
+	}
+	else
+	{
+		a += c;
+		maxLength = 3;
+	}
+	c = pFile->get();
+
+	while ((( c >= '0' && c <= '9') || ((( c >= 'a' && c <= 'f') || ( c >= 'A' && c <= 'F')) && isHexadecimal)) && (a.length() <maxLength))
+	{
+		a += c;
+		c = pFile->get();
+	}
+
+	int numericalBase;
+
+	if(isHexadecimal)
+		numericalBase = 16;
+	else
+		numericalBase = 8;
+	char result = strtoul(a.c_str(), NULL, numericalBase);
+
+	if (result != 0) s += result;
+	pFile->unget();
+}
+
+//---------------------------------------------------------------------
+/** \brief Get a string from a program file and interpret escaped chars
+ *
+ * Skips the leading quote (") in the input, and reads up until the trailing
+ * quote
+ *
+ * \param pFile shader stream
+ * \return String
+ */
+CqString GetString(std::istream* pFile)
+{
+	( *pFile ) >> std::ws;
+	char c;
+	CqString s( "" );
+	bool escapeChar = false;
+
+	pFile->get();
+	while ( (( c = pFile->get() ) != '"') || escapeChar  )
+	{
+		if(escapeChar)
+		{
+			//Treatment for escape char
+			switch(c)
+			{
+				case 'a'://Bell (alert)
+					s += '\a';
+					escapeChar = false;
+					break;
+				case 'v'://Vertical tab
+					s += '\v';
+					escapeChar = false;
+					break;
+				case '\''://Single quotation mark
+					s += "'";
+					escapeChar = false;
+					break;
+				case '?'://Literal question mark
+					s += '\?';
+					escapeChar = false;
+					break;
+				case 'n'://New line
+					s += '\n';
+					escapeChar = false;
+					break;
+				case 'r'://Carriage return
+					s += '\r';
+					escapeChar = false;
+					break;
+				case 't'://Horizontal tab
+					s += '\t';
+					escapeChar = false;
+					break;
+				case 'b'://Backspace
+					s += '\b';
+					escapeChar = false;
+					break;
+				case 'f'://Formfeed
+					s += '\f';
+					escapeChar = false;
+					break;
+				case '"'://Double quotation mark
+					s += '"';
+					escapeChar = false;
+					break;
+				case '\\'://Backslash
+					s += '\\';
+					escapeChar = false;
+					break;
+				case 'x'://Hexadecimal
+				case '0'://octal
+				case '1':
+				case '2':
+				case '3':
+				case '4':
+				case '5':
+				case '6':
+				case '7':
+				case '8':
+				case '9':
+					GetNumericEscapeChar(pFile, s,  c);
+					escapeChar = false;
+					break;
+				default :
+					escapeChar = false;
+					break;
+			}
+		}
+		else
+			if (c ==  '\\')
+				escapeChar = true;
+			else
+				s += c;
+	}
+	 return s;
+}
+
+
+//----------------------------------------------------------------------
+/** \class CqSlxTextReader
+ * \brief Reader for the text form of a program, read from a stream.
+ */
+class CqSlxTextReader : public CqSlxReader
+{
+	public:
+		CqSlxTextReader( std::istream& in ) : m_in( in )
+		{
+			m_token[ 0 ] = '\0';
+		}
+
+		virtual bool eof()
+		{
+			m_in >> std::ws;
+			return m_in.eof();
+		}
+		virtual const char* readWord( TqUlong& hash )
+		{
+			char c;
+			TqInt i = 0;
+			m_token[ 0 ] = '\0';
+			m_in >> std::ws;
+			c = m_in.get();
+			if ( c == ':' )
+			{
+				// Special case for labels.
+				m_token[ 0 ] = c;
+				m_token[ 1 ] = '\0';
+			}
+			else
+			{
+				while ( notspace( c ) && i < maxTokenLength - 1 )
+				{
+					m_token[ i++ ] = c;
+					m_token[ i ] = '\0';
+					c = m_in.get();
+				}
+			}
+			hash = CqString::hash( m_token );
+			return m_token;
+		}
+		virtual TqFloat readFloat()
+		{
+			TqFloat f = 0;
+			m_in >> std::ws >> f;
+			return f;
+		}
+		virtual TqInt readInt()
+		{
+			TqInt i = 0;
+			m_in >> std::ws >> i;
+			return i;
+		}
+		virtual CqString readString()
+		{
+			return GetString( &m_in );
+		}
+
+	private:
+		static const TqInt maxTokenLength = 255;
+
+		std::istream& m_in;
+		char m_token[ maxTokenLength ];
+};
+
+
+//----------------------------------------------------------------------
+/** \class CqSlxBinaryReader
+ * \brief Reader for the binary form of a program, held in memory.
+ *
+ * The string table is decoded and hashed up front, after which reading
+ * words and numbers is just a matter of stepping through the tokens.
+ */
+class CqSlxBinaryReader : public CqSlxReader
+{
+	public:
+		/** \brief Decode the program in data, which follows the magic number.
+		 *
+		 * \throw XqBadShader if the program is invalid or from an
+		 *   incompatible version of aqsl.
+		 */
+		CqSlxBinaryReader( std::vector<char>& data )
+			: m_strings(),
+			m_hashes(),
+			m_tokens(),
+			m_pos( 0 ),
+			m_numTokens( 0 ),
+			m_tokensRead( 0 ),
+			m_isInteger( false ),
+			m_integer( 0 ),
+			m_float( 0 )
+		{
+			m_tokens.swap( data );
+			if ( read32() != slxBinaryByteOrder )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Binary shader was compiled on a machine of different "
+					"byte order.  Please recompile.");
+			}
+			TqUint32 version = read32();
+			if ( version != AQSIS_SLX_VERSION )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Incompatible compiled shader version " << version
+					<< " found (expected version " << AQSIS_SLX_VERSION
+					<< ").  Please recompile.");
+			}
+			TqUint32 numStrings = read32();
+			m_strings.reserve( numStrings );
+			m_hashes.reserve( numStrings );
+			for ( TqUint32 i = 0; i < numStrings; ++i )
+			{
+				TqUint32 length = read32();
+				need( length );
+				m_strings.push_back( std::string( &m_tokens[ m_pos ], length ) );
+				m_hashes.push_back( CqString::hash( m_strings.back().c_str() ) );
+				m_pos += length;
+			}
+			m_numTokens = read32();
+		}
+
+		virtual bool eof()
+		{
+			return m_tokensRead >= m_numTokens;
+		}
+		virtual const char* readWord( TqUlong& hash )
+		{
+			const std::string* s = readToken();
+			if ( !s )
+			{
+				// Only the version number is read as a word; give it the form
+				// it has in the text.
+				if ( m_isInteger )
+					std::sprintf( m_number, "%d", static_cast<int>( m_integer ) );
+				else
+					std::sprintf( m_number, "%.9g", m_float );
+				hash = CqString::hash( m_number );
+				return m_number;
+			}
+			hash = m_hashes[ s - &m_strings[ 0 ] ];
+			return s->c_str();
+		}
+		virtual TqFloat readFloat()
+		{
+			const std::string* s = readToken();
+			if ( s )
+				return parseText<TqFloat>( *s );
+			return m_isInteger ? static_cast<TqFloat>( m_integer ) : m_float;
+		}
+		virtual TqInt readInt()
+		{
+			const std::string* s = readToken();
+			if ( s )
+				return parseText<TqInt>( *s );
+			return m_isInteger ? m_integer : static_cast<TqInt>( m_float );
+		}
+		virtual CqString readString()
+		{
+			const std::string* s = readToken();
+			if ( !s )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Expected a string in binary shader");
+			}
+			std::istringstream in( *s );
+			return GetString( &in );
+		}
+
+	private:
+		/// Check that there are size more bytes to read.
+		void need( TqUint32 size )
+		{
+			if ( size > m_tokens.size() - m_pos )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Binary shader is truncated");
+			}
+		}
+		TqUint32 read32()
+		{
+			need( sizeof( TqUint32 ) );
+			TqUint32 value;
+			std::memcpy( &value, &m_tokens[ m_pos ], sizeof( value ) );
+			m_pos += sizeof( value );
+			return value;
+		}
+		/** \brief Read the next token.
+		 * \return The string, or null if the token is a number, which is
+		 *   then held in m_integer or m_float.
+		 */
+		const std::string* readToken()
+		{
+			if ( eof() )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Unexpected end of binary shader");
+			}
+			++m_tokensRead;
+			TqUint32 index = read32();
+			if ( index == slxBinaryInteger || index == slxBinaryNumber )
+			{
+				m_isInteger = index == slxBinaryInteger;
+				need( sizeof( TqUint32 ) );
+				if ( m_isInteger )
+					std::memcpy( &m_integer, &m_tokens[ m_pos ], sizeof( m_integer ) );
+				else
+					std::memcpy( &m_float, &m_tokens[ m_pos ], sizeof( m_float ) );
+				m_pos += sizeof( TqUint32 );
+				return 0;
+			}
+			if ( index >= m_strings.size() )
+			{
+				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+					"Invalid string in binary shader");
+			}
+			return &m_strings[ index ];
+		}
+		/// Read a number from a word, as the text reader would.
+		template<typename T>
+		static T parseText( const std::string& word )
+		{
+			T value = 0;
+			std::istringstream in( word );
+			in >> value;
+			return value;
+		}
+
+		std::vector<std::string> m_strings;
+		std::vector<TqUlong> m_hashes;
+		std::vector<char> m_tokens;
+		std::size_t m_pos;
+		TqUint32 m_numTokens;
+		TqUint32 m_tokensRead;
+		/// Whether the last number read was an integer.
+		bool m_isInteger;
+		TqInt32 m_integer;
+		TqFloat m_float;
+		char m_number[ 32 ];
+};
+
+} // unnamed namespace
+
+
+boost::shared_ptr<CqSlxReader> CqSlxReader::create( std::istream& in )
+{
+	char magic[ sizeof( slxBinaryMagic ) ];
+	std::istream::pos_type start = in.tellg();
+	in.read( magic, sizeof( magic ) );
+	if ( in.gcount() == sizeof( magic )
+		&& std::memcmp( magic, slxBinaryMagic, sizeof( magic ) ) == 0 )
+	{
+		// Read the rest of the program in one go.
+		std::istream::pos_type pos = in.tellg();
+		in.seekg( 0, std::ios::end );
+		std::streamoff size = in.tellg() - pos;
+		in.seekg( pos );
+		std::vector<char> data( static_cast<std::size_t>( size ) );
+		if ( size > 0 )
+			in.read( &data[ 0 ], size );
+		if ( in.gcount() != size )
+		{
+			AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+				"Could not read binary shader");
+		}
+		return boost::shared_ptr<CqSlxReader>( new CqSlxBinaryReader( data ) );
+	}
+	in.clear();
+	in.seekg( start );
+	return boost::shared_ptr<CqSlxReader>( new CqSlxTextReader( in ) );
+}
+
+} // namespace Aqsis
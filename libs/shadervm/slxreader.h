@@ -0,0 +1,75 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares the readers for the tokens of compiled shader programs.
+*/
+
+#ifndef SLXREADER_H_INCLUDED
+#define SLXREADER_H_INCLUDED 1
+
+#include	<iosfwd>
+#include	<boost/shared_ptr.hpp>
+
+#include	<aqsis/aqsis.h>
+#include	<aqsis/util/sstring.h>
+
+namespace Aqsis {
+
+//----------------------------------------------------------------------
+/** \class CqSlxReader
+ * \brief Source of the tokens of a compiled shader program.
+ *
+ * Programs are read either from the text form produced by aqsl, or from the
+ * binary form described in slxbinary.h, which holds the same tokens.
+ */
+class CqSlxReader
+{
+	public:
+		virtual ~CqSlxReader() {}
+
+		/** \brief Create a reader for a program.
+		 *
+		 * The form of the program is detected from its first few bytes.  A
+		 * binary program is read into memory at once.
+		 *
+		 * \throw XqBadShader if a binary program is invalid.
+		 */
+		static boost::shared_ptr<CqSlxReader> create( std::istream& in );
+
+		/// Determine whether all the tokens have been read.
+		virtual bool	eof() = 0;
+		/** \brief Read a word: an opcode, keyword, name or label marker.
+		 *
+		 * \param hash - set to the hash of the word, see CqString::hash().
+		 * \return The word, valid until the next token is read.
+		 */
+		virtual const char*	readWord( TqUlong& hash ) = 0;
+		/// Read a number.
+		virtual TqFloat	readFloat() = 0;
+		/// Read an integer.
+		virtual TqInt	readInt() = 0;
+		/// Read a quoted string, interpreting any escaped characters.
+		virtual CqString	readString() = 0;
+};
+
+} // namespace Aqsis
+
+#endif	// SLXREADER_H_INCLUDED
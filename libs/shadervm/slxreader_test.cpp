@@ -0,0 +1,216 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for reading the text and binary forms of compiled
+ * shaders, and for the cache of loaded programs.
+ */
+
+#include "slxreader.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <aqsis/shadervm/ishader.h>
+#include <aqsis/slcomp/slxbinary.h>
+
+using namespace Aqsis;
+
+namespace {
+
+/// How each token of the test program is read.
+struct SqToken
+{
+	const char* text;
+	char kind;		///< w for a word, f for a float, i for an integer, s for a string.
+};
+
+const SqToken tokens[] = {
+	{"surface", 'w'}, {"AQSIS_V", 'w'}, {"2", 'w'},
+	{"USES", 'w'}, {"460803", 'i'}, {"-17", 'i'}, {"+4", 'i'},
+	{"0.1", 'f'}, {"-3", 'f'}, {"1e-3", 'f'}, {".5", 'f'}, {"7.", 'f'},
+	{"2.5E+2", 'f'}, {"12345678901", 'f'},
+	// Halfway between two floats, less a tiny amount; rounding to a double
+	// first would make it round up.
+	{"1.000000178813934326171874999", 'f'},
+	// Not decimal numbers, so kept as words.
+	{"0x10", 'w'}, {"1e", 'w'}, {"-", 'w'}, {".", 'w'}, {"3f", 'w'},
+	{":", 'w'}, {"3", 'i'},
+	{"\"a \\\"quoted\\\" string\\n\"", 's'},
+	{"pushif", 'w'}, {"pushif", 'w'}, {"x", 'w'},
+};
+const TqInt numTokens = sizeof(tokens)/sizeof(tokens[0]);
+
+std::string textProgram()
+{
+	std::string text;
+	for(TqInt i = 0; i < numTokens; ++i)
+	{
+		text += tokens[i].text;
+		text += i % 4 == 3 ? '\n' : '\t';
+	}
+	return text;
+}
+
+std::string binaryProgram(const std::string& text)
+{
+	std::istringstream in(text);
+	std::ostringstream out;
+	slxTextToBinary(in, out);
+	return out.str();
+}
+
+/// A file holding a compiled program, removed when the test is done.
+class CqTempSlxFile
+{
+	public:
+		CqTempSlxFile()
+			: m_fileName("aqsis_slxreader_test.slx")
+		{ }
+		~CqTempSlxFile()
+		{
+			boost::filesystem::remove(m_fileName);
+		}
+		void write(const std::string& contents)
+		{
+			std::ofstream out(m_fileName.c_str(), std::ios::binary);
+			out << contents;
+		}
+		const std::string& name() const
+		{
+			return m_fileName;
+		}
+	private:
+		std::string m_fileName;
+};
+
+/// A light program using the given globals, with text of the same length
+/// for all small uses masks.
+std::string lightProgram(TqInt uses)
+{
+	std::ostringstream program;
+	program << "lightsource\nAQSIS_V 2\n\n\nsegment Data\n\nUSES "
+		<< uses << "\n\n\nsegment Init\n\n\nsegment Code\n"
+		<< "\tpushif 0.25\n\tsetfc\n\tpop Cl\n";
+	return program.str();
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqSlxReader_binary_matches_text_test)
+{
+	std::string text = textProgram();
+	std::istringstream textIn(text);
+	std::istringstream binaryIn(binaryProgram(text));
+	boost::shared_ptr<CqSlxReader> textReader = CqSlxReader::create(textIn);
+	boost::shared_ptr<CqSlxReader> binaryReader = CqSlxReader::create(binaryIn);
+
+	for(TqInt i = 0; i < numTokens; ++i)
+	{
+		BOOST_TEST_CHECKPOINT("token " << tokens[i].text);
+		BOOST_REQUIRE(!textReader->eof());
+		BOOST_REQUIRE(!binaryReader->eof());
+		switch(tokens[i].kind)
+		{
+			case 'w':
+			{
+				TqUlong textHash = 0, binaryHash = 0;
+				std::string textWord = textReader->readWord(textHash);
+				std::string binaryWord = binaryReader->readWord(binaryHash);
+				BOOST_CHECK_EQUAL(textWord, tokens[i].text);
+				BOOST_CHECK_EQUAL(binaryWord, tokens[i].text);
+				BOOST_CHECK_EQUAL(textHash, binaryHash);
+				break;
+			}
+			case 'f':
+			{
+				// Numbers must be bit-for-bit the same.
+				TqFloat textValue = textReader->readFloat();
+				TqFloat binaryValue = binaryReader->readFloat();
+				BOOST_CHECK_EQUAL(textValue, binaryValue);
+				break;
+			}
+			case 'i':
+				BOOST_CHECK_EQUAL(textReader->readInt(), binaryReader->readInt());
+				break;
+			case 's':
+				BOOST_CHECK_EQUAL(textReader->readString(), binaryReader->readString());
+				break;
+		}
+	}
+	BOOST_CHECK(textReader->eof());
+	BOOST_CHECK(binaryReader->eof());
+}
+
+BOOST_AUTO_TEST_CASE(CqSlxReader_binary_number_rounding_test)
+{
+	std::istringstream in(binaryProgram("1.000000178813934326171874999 0x10 460803"));
+	boost::shared_ptr<CqSlxReader> reader = CqSlxReader::create(in);
+	BOOST_CHECK_EQUAL(reader->readFloat(), 1.00000011920928955078125f);
+	TqUlong hash = 0;
+	BOOST_CHECK_EQUAL(std::string(reader->readWord(hash)), "0x10");
+	BOOST_CHECK_EQUAL(reader->readFloat(), 460803.0f);
+	BOOST_CHECK(reader->eof());
+}
+
+BOOST_AUTO_TEST_CASE(CqSlxReader_truncated_binary_test)
+{
+	std::string binary = binaryProgram(textProgram());
+	std::istringstream in(binary.substr(0, binary.size() - 3));
+	boost::shared_ptr<CqSlxReader> reader = CqSlxReader::create(in);
+	BOOST_CHECK_THROW(
+		while(!reader->eof())
+		{
+			TqUlong hash = 0;
+			reader->readWord(hash);
+		},
+		XqBadShader
+	);
+}
+
+BOOST_AUTO_TEST_CASE(createShaderVM_program_cache_test)
+{
+	CqTempSlxFile file;
+	file.write(lightProgram(12));
+	BOOST_CHECK_EQUAL(createShaderVM(0, file.name(), "")->Uses(), 12);
+	BOOST_CHECK_EQUAL(createShaderVM(0, file.name(), "")->Uses(), 12);
+
+	// Recompiling within the same second to a program of the same size must
+	// still be noticed.
+	file.write(lightProgram(24));
+	BOOST_CHECK_EQUAL(createShaderVM(0, file.name(), "")->Uses(), 24);
+
+	// Replacing the text with the binary form gives the same program.
+	file.write(binaryProgram(lightProgram(24)));
+	BOOST_CHECK_EQUAL(createShaderVM(0, file.name(), "")->Uses(), 24);
+	file.write(binaryProgram(lightProgram(48)));
+	BOOST_CHECK_EQUAL(createShaderVM(0, file.name(), "")->Uses(), 48);
+}
+
+BOOST_AUTO_TEST_CASE(createShaderVM_missing_program_test)
+{
+	BOOST_CHECK_THROW(createShaderVM(0, "aqsis_no_such_shader.slx", ""), XqBadShader);
+}
@@ -40,7 +40,7 @@ namespace Aqsis {
 void CqCodeGenVM::OutputTree( IqParseNode* pNode, std::string strOutName )
 {
 	CqCodeGenDataGather DG;
-	CqCodeGenOutput V( &DG, strOutName );
+	CqCodeGenOutput V( &DG, strOutName, m_binary );
 	pNode->Accept( DG );
 	pNode->Accept( V );
 }
@@ -2,6 +2,7 @@ set(backend_srcs
 	codegengraphviz.cpp
 	codegenvm.cpp
 	parsetreeviz.cpp
+	slxbinary.cpp
 	vmdatagather.cpp
 	vmoutput.cpp
 )
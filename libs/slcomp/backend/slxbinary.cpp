@@ -0,0 +1,208 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+ *
+ * \brief Conversion of compiled shaders to the binary form.
+ */
+
+#include	<aqsis/slcomp/slxbinary.h>
+
+#include	<iostream>
+#include	<iterator>
+#include	<map>
+#include	<sstream>
+#include	<string>
+#include	<vector>
+
+#include	<aqsis/slcomp/icodegen.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Whitespace, as the shader VM sees it.
+inline bool isSlxSpace( char c )
+{
+	return c == 0x20 || ( c >= 0x09 && c <= 0x0D );
+}
+
+/// Skip the decimal digits at c, returning whether there were any.
+bool skipDigits( const char*& c )
+{
+	const char* start = c;
+	while ( *c >= '0' && *c <= '9' )
+		++c;
+	return c != start;
+}
+
+/// Kinds of token in a binary program.
+enum EqTokenKind
+{
+	Token_Word,
+	Token_Integer,
+	Token_Number
+};
+
+/** \brief Determine whether a token holds a number.
+ *
+ * Only decimal numbers count; the shader VM would read a hexadecimal token as
+ * zero followed by a word.  A number is parsed as the VM reads it from text,
+ * straight to a float, so that it isn't rounded twice.
+ */
+EqTokenKind parseNumber( const std::string& token, TqInt32& integer, TqFloat& number )
+{
+	const char* c = token.c_str();
+	if ( *c == '-' || *c == '+' )
+		++c;
+	bool intDigits = skipDigits( c );
+	bool isInteger = intDigits && *c == '\0';
+	if ( *c == '.' )
+	{
+		++c;
+		if ( !skipDigits( c ) && !intDigits )
+			return Token_Word;
+	}
+	else if ( !intDigits )
+		return Token_Word;
+	if ( *c == 'e' || *c == 'E' )
+	{
+		++c;
+		if ( *c == '-' || *c == '+' )
+			++c;
+		if ( !skipDigits( c ) )
+			return Token_Word;
+	}
+	if ( *c != '\0' )
+		return Token_Word;
+
+	std::istringstream in( token );
+	if ( isInteger )
+	{
+		in >> integer;
+		if ( !in.fail() )
+			return Token_Integer;
+		in.clear();
+		in.seekg( 0 );
+	}
+	in >> number;
+	return in.fail() ? Token_Word : Token_Number;
+}
+
+template<typename T>
+void append( std::vector<char>& data, const T& value )
+{
+	const char* bytes = reinterpret_cast<const char*>( &value );
+	data.insert( data.end(), bytes, bytes + sizeof( T ) );
+}
+
+template<typename T>
+void write( std::ostream& out, const T& value )
+{
+	out.write( reinterpret_cast<const char*>( &value ), sizeof( T ) );
+}
+
+} // unnamed namespace
+
+void slxTextToBinary( std::istream& slxText, std::ostream& out )
+{
+	std::string text( ( std::istreambuf_iterator<char>( slxText ) ),
+			std::istreambuf_iterator<char>() );
+
+	std::vector<std::string> strings;
+	std::map<std::string, TqUint32> stringIndices;
+	std::vector<char> tokens;
+	TqUint32 numTokens = 0;
+
+	// Split the text the same way the shader VM does: labels are marked by a
+	// colon which is a token by itself, and quoted strings may hold spaces and
+	// escaped quotes.
+	const char* c = text.c_str();
+	const char* end = c + text.size();
+	while ( true )
+	{
+		while ( c < end && isSlxSpace( *c ) )
+			++c;
+		if ( c == end )
+			break;
+		const char* start = c;
+		if ( *c == ':' )
+			++c;
+		else if ( *c == '"' )
+		{
+			++c;
+			while ( c < end && *c != '"' )
+			{
+				if ( *c == '\\' && c + 1 < end )
+					++c;
+				++c;
+			}
+			if ( c < end )
+				++c;
+		}
+		else
+		{
+			while ( c < end && !isSlxSpace( *c ) )
+				++c;
+		}
+		std::string token( start, c );
+		++numTokens;
+
+		TqInt32 integer = 0;
+		TqFloat number = 0;
+		switch ( parseNumber( token, integer, number ) )
+		{
+			case Token_Integer:
+				append( tokens, slxBinaryInteger );
+				append( tokens, integer );
+				continue;
+			case Token_Number:
+				append( tokens, slxBinaryNumber );
+				append( tokens, number );
+				continue;
+			case Token_Word:
+				break;
+		}
+		std::map<std::string, TqUint32>::iterator index = stringIndices.find( token );
+		if ( index == stringIndices.end() )
+		{
+			index = stringIndices.insert( std::make_pair( token,
+					static_cast<TqUint32>( strings.size() ) ) ).first;
+			strings.push_back( token );
+		}
+		append( tokens, index->second );
+	}
+
+	out.write( slxBinaryMagic, sizeof( slxBinaryMagic ) );
+	write( out, slxBinaryByteOrder );
+	write( out, static_cast<TqUint32>( AQSIS_SLX_VERSION ) );
+	write( out, static_cast<TqUint32>( strings.size() ) );
+	for ( std::vector<std::string>::const_iterator s = strings.begin();
+			s != strings.end(); ++s )
+	{
+		write( out, static_cast<TqUint32>( s->size() ) );
+		out.write( s->data(), s->size() );
+	}
+	write( out, numTokens );
+	if ( !tokens.empty() )
+		out.write( &tokens[0], tokens.size() );
+}
+
+} // namespace Aqsis
@@ -37,6 +37,8 @@
 
 #include	"vmoutput.h"
 
+#include	<aqsis/slcomp/slxbinary.h>
+
 #include	"parsenode.h"
 #include	<aqsis/math/math.h>
 #include	<aqsis/util/logging.h>
@@ -76,8 +78,11 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	std::map<std::string, std::string> temp;
 	m_StackVarMap.push_back( temp );
 
-	m_slxFile.open( strOutName().c_str() );
-	if (m_slxFile.fail( ) )
+	if ( m_binary )
+		m_outFile.open( strOutName().c_str(), std::ios::out | std::ios::binary );
+	else
+		m_outFile.open( strOutName().c_str() );
+	if (m_outFile.fail( ) )
 	{
 		std::cout << "Warning: Cannot open file \"" << strOutName().c_str() << "\"" << std::endl;
 		exit( 1 );
@@ -141,7 +146,14 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	/// \note There is another child here, it is the list of arguments, but they don't need to be
 	/// output as part of the code segment.
 
-	m_slxFile.close();
+	if ( m_binary )
+	{
+		std::istringstream slxText( m_slxFile.str() );
+		slxTextToBinary( slxText, m_outFile );
+	}
+	else
+		m_outFile << m_slxFile.str();
+	m_outFile.close();
 }
 
 void CqCodeGenOutput::Visit( IqParseNodeFunctionCall& FC )
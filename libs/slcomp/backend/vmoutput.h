@@ -31,6 +31,7 @@
 #include	<deque>
 #include	<fstream>
 #include	<map>
+#include	<sstream>
 
 #include	<aqsis/aqsis.h>
 
@@ -49,10 +50,11 @@ namespace Aqsis {
 class CqCodeGenOutput : public IqParseNodeVisitor
 {
 	public:
-		CqCodeGenOutput( CqCodeGenDataGather* pDataGather, std::string strOutName ) :
+		CqCodeGenOutput( CqCodeGenDataGather* pDataGather, std::string strOutName, bool binary = false ) :
 		       	m_strOutName( strOutName ),
 		       	m_gcLabels( 0 ),
-		       	m_pDataGather( pDataGather )
+		       	m_pDataGather( pDataGather ),
+		       	m_binary( binary )
 		{}
 
 		virtual	void Visit( IqParseNode& );
@@ -110,7 +112,9 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 		CqString	m_strOutName;
 		TqInt	m_gcLabels;
 		CqCodeGenDataGather*	m_pDataGather;
-		std::ofstream	m_slxFile;
+		bool	m_binary;			///< Write the binary form of the program.
+		std::ofstream	m_outFile;
+		std::ostringstream	m_slxFile;		///< Text of the program, written out when complete.
 
 		std::vector<std::vector<SqVarRefTranslator> > m_saTransTable;
 		std::deque<std::map<std::string, std::string> >	m_StackVarMap;
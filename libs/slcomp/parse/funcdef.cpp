@@ -213,6 +213,7 @@ CqFuncDef	gStandardFuncs[] = {
                                  CqFuncDef( Type_Color, "specular", "specular", "ppf" ),
                                  CqFuncDef( Type_Color, "phong", "phong", "ppf" ),
                                  CqFuncDef( Type_Color, "trace", "trace", "pp" ),
+                                 CqFuncDef( Type_Color, "transmission", "transmission", "pp*" ),
                                  CqFuncDef( Type_Float, "shadow", "shadow2", "spppp*" ),
                                  CqFuncDef( Type_Float, "shadow", "shadow", "sp*" ),
                                  CqFuncDef( Type_Float, "texture", "ftexture3", "sffffffff*" ),
@@ -28,6 +28,7 @@
 #include <aqsis/util/logging.h>
 #include <aqsis/util/exception.h>
 #include "parsenode.h"
+#include "ssa.h"
 #include "vardef.h"
 
 extern int yyparse();
@@ -50,7 +51,7 @@ CqString ParseStreamName = "stdin";
 std::ostream* ParseErrorStream = &Aqsis::log();
 TqInt ParseLineNumber;
 
-bool Parse( std::istream& InputStream, const std::string& StreamName, std::ostream& ErrorStream )
+bool Parse( std::istream& InputStream, const std::string& StreamName, std::ostream& ErrorStream, bool optimise )
 {
 	ParseInputStream = &InputStream;
 	ParseStreamName = StreamName;
@@ -82,10 +83,13 @@ bool Parse( std::istream& InputStream, const std::string& StreamName, std::ostre
 	}
 	Optimise();
 
-	std::vector<CqVarDef>::iterator iv;
-	for ( iv = gLocalVars.begin(); iv != gLocalVars.end(); iv++ )
-		if ( iv->pDefValue() )
-			iv->pDefValue() ->Optimise();
+	// The optimiser works on the type checked tree, and keeps no state
+	// between shaders.
+	if ( optimise )
+	{
+		CqSsaOptimiser optimiser;
+		optimiser.Optimise( ParseTreePointer );
+	}
 
 	return true;
 }
@@ -0,0 +1,264 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests comparing shaders compiled with and without
+ * optimisation.
+ */
+
+#include <aqsis/slcomp/libslparse.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/slcomp/icodegen.h>
+
+using namespace Aqsis;
+
+namespace {
+
+/// Compile a shader, returning the text form of its VM code.
+std::string compile(const char* source, bool optimise)
+{
+	ResetParser();
+	std::istringstream in(source);
+	std::ostringstream errors;
+	BOOST_REQUIRE_MESSAGE(Parse(in, "optimise_test.sl", errors, optimise), errors.str());
+
+	const char* fileName = "aqsis_optimise_test.slx";
+	CqCodeGenVM codeGen;
+	codeGen.OutputTree(GetParseTree(), fileName);
+	std::string slx;
+	{
+		std::ifstream slxFile(fileName);
+		slx.assign(std::istreambuf_iterator<char>(slxFile),
+				std::istreambuf_iterator<char>());
+	}
+	std::remove(fileName);
+	return slx;
+}
+
+/// Get a segment of a compiled shader.
+std::string segment(const std::string& slx, const char* name)
+{
+	std::string::size_type start = slx.find(std::string("segment ") + name);
+	if(start == std::string::npos)
+		return "";
+	std::string::size_type end = slx.find("segment ", start + 1);
+	return slx.substr(start, end == std::string::npos ? end : end - start);
+}
+
+bool contains(const std::string& code, const char* opcode)
+{
+	return code.find(std::string("\t") + opcode + "\n") != std::string::npos;
+}
+
+/// Count the times an instruction appears in some code.
+int count(const std::string& code, const char* opcode)
+{
+	std::string instruction = std::string("\t") + opcode + "\n";
+	int n = 0;
+	for(std::string::size_type i = code.find(instruction); i != std::string::npos;
+			i = code.find(instruction, i + 1))
+		++n;
+	return n;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(Optimise_parameter_defaults_test)
+{
+	const char* source =
+		"surface optimise_test(\n"
+		"	float a = 1 + 2 * 3;\n"
+		"	float b = 2 > 1 ? 4 : 5;\n"
+		"	color c = 1 < 0 ? color(1, 0, 0) : 0.5;\n"
+		")\n"
+		"{\n"
+		"	Ci = c * a * b;\n"
+		"}\n";
+	std::string plain = compile(source, false);
+	std::string optimised = compile(source, true);
+
+	// The parameters are the same either way.
+	BOOST_CHECK_EQUAL(segment(plain, "Data"), segment(optimised, "Data"));
+
+	std::string plainInit = segment(plain, "Init");
+	std::string init = segment(optimised, "Init");
+	BOOST_CHECK(contains(plainInit, "addff"));
+	BOOST_CHECK(contains(plainInit, "gtff"));
+	BOOST_CHECK(!contains(init, "addff"));
+	BOOST_CHECK(!contains(init, "mulff"));
+	BOOST_CHECK(!contains(init, "gtff"));
+	BOOST_CHECK(!contains(init, "lsff"));
+	BOOST_CHECK(init.find("\tpushif 7\n") != std::string::npos);
+	BOOST_CHECK(init.find("\tpushif 4\n") != std::string::npos);
+	// The float branch chosen for the color keeps the cast added by type
+	// checking.
+	BOOST_CHECK(contains(init, "setfc"));
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_dead_branches_test)
+{
+	const char* source =
+		"float pick(float x)\n"
+		"{\n"
+		"	return 1 > 0 ? x : 2;\n"
+		"}\n"
+		"surface optimise_test(float k = 1)\n"
+		"{\n"
+		"	float y = pick(k);\n"
+		"	if(0)\n"
+		"		y = 3;\n"
+		"	else\n"
+		"		y = y + 1 * 2;\n"
+		"	while(1 < 0)\n"
+		"		y += 1;\n"
+		"	Ci = y;\n"
+		"}\n";
+	std::string plain = compile(source, false);
+	std::string optimised = compile(source, true);
+
+	BOOST_CHECK_EQUAL(segment(plain, "Data"), segment(optimised, "Data"));
+
+	std::string plainCode = segment(plain, "Code");
+	std::string code = segment(optimised, "Code");
+	BOOST_CHECK(contains(plainCode, "gtff"));
+	BOOST_CHECK(contains(plainCode, "lsff"));
+	BOOST_CHECK(contains(plainCode, "mulff"));
+	BOOST_CHECK(!contains(code, "gtff"));
+	BOOST_CHECK(!contains(code, "lsff"));
+	BOOST_CHECK(!contains(code, "mulff"));
+	BOOST_CHECK(code.find("\tpushif 3\n") == std::string::npos);
+	BOOST_CHECK_LT(code.size(), plainCode.size());
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_constant_propagation_test)
+{
+	const char* source =
+		"surface optimise_test()\n"
+		"{\n"
+		"	float a = 2;\n"
+		"	float b = a * 3;\n"
+		"	float unused = sqrt(s);\n"
+		"	Ci = b + s;\n"
+		"}\n";
+	std::string plain = compile(source, false);
+	std::string optimised = compile(source, true);
+
+	// The constants are carried through the variables, which are then
+	// never read, so they go too.
+	std::string code = segment(optimised, "Code");
+	BOOST_CHECK(contains(segment(plain, "Code"), "mulff"));
+	BOOST_CHECK(!contains(code, "mulff"));
+	BOOST_CHECK(!contains(code, "sqrt"));
+	BOOST_CHECK(code.find("\tpushif 6\n") != std::string::npos);
+	BOOST_CHECK(segment(optimised, "Data").find("unused") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_conditional_writes_test)
+{
+	const char* source =
+		"surface optimise_test(string name = \"\")\n"
+		"{\n"
+		"	float res = 0;\n"
+		"	textureinfo(name, \"resolution\", res);\n"
+		"	Ci = res;\n"
+		"}\n";
+	// textureinfo leaves the variable alone if it fails, so the value
+	// before is kept.
+	std::string code = segment(compile(source, true), "Code");
+	BOOST_CHECK_EQUAL(count(code, "pop res"), 1);
+	BOOST_CHECK(code.find("\tpushif 0\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_uniform_variables_test)
+{
+	const char* source =
+		"surface optimise_test(float n = 4)\n"
+		"{\n"
+		"	float sum = 0, i;\n"
+		"	for(i = 0; i < n; i += 1)\n"
+		"		sum += i;\n"
+		"	float x = 0;\n"
+		"	if(s > 0.5)\n"
+		"		x = 1;\n"
+		"	float j;\n"
+		"	for(j = 0; j < n; j += 1)\n"
+		"		if(t > 0.5)\n"
+		"			break;\n"
+		"	Ci = color(sum, x, j);\n"
+		"}\n";
+	std::string plainData = segment(compile(source, false), "Data");
+	std::string data = segment(compile(source, true), "Data");
+
+	BOOST_CHECK(plainData.find("varying  float sum") != std::string::npos);
+	BOOST_CHECK(data.find("uniform  float sum") != std::string::npos);
+	BOOST_CHECK(data.find("uniform  float i") != std::string::npos);
+	// Values set under a varying condition stay varying.
+	BOOST_CHECK(data.find("varying  float x") != std::string::npos);
+	BOOST_CHECK(data.find("varying  float j") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_loop_invariants_test)
+{
+	const char* source =
+		"surface optimise_test(float n = 4)\n"
+		"{\n"
+		"	float sum = 0, i;\n"
+		"	for(i = 0; i < n; i += 1)\n"
+		"		sum += normalize(N) . normalize(I) * i;\n"
+		"	Ci = sum;\n"
+		"}\n";
+	std::string plainCode = segment(compile(source, false), "Code");
+	std::string code = segment(compile(source, true), "Code");
+
+	// The dot product is worked out once, before the loop starts.
+	std::string::size_type loop = code.find(":0\n");
+	BOOST_REQUIRE(loop != std::string::npos);
+	BOOST_CHECK_GT(plainCode.find("\tdotpp\n"), plainCode.find(":0\n"));
+	BOOST_CHECK_LT(code.find("\tdotpp\n"), loop);
+	BOOST_CHECK_EQUAL(count(code, "dotpp"), 1);
+	BOOST_CHECK_EQUAL(count(code, "normalize"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(Optimise_common_subexpressions_test)
+{
+	const char* source =
+		"surface optimise_test()\n"
+		"{\n"
+		"	float r = sqrt(s * s + t * t);\n"
+		"	if(u > 0.5)\n"
+		"		r += sqrt(s * s + t * t) * 2;\n"
+		"	Ci = r + sqrt(s * s + t * t);\n"
+		"}\n";
+	std::string plainCode = segment(compile(source, false), "Code");
+	std::string code = segment(compile(source, true), "Code");
+
+	BOOST_CHECK_EQUAL(count(plainCode, "sqrt"), 3);
+	BOOST_CHECK_EQUAL(count(code, "sqrt"), 1);
+	BOOST_CHECK_EQUAL(count(code, "mulff"), 3);
+}
@@ -39,16 +39,24 @@ set(parse_srcs
 	libslparse.cpp
 	optimise.cpp
 	parsenode.cpp
+	ssa.cpp
+	ssaoptimise.cpp
 	typecheck.cpp
 	vardef.cpp
 )
 set(parse_srcs ${parse_srcs} ${_scanner_cpp_name} ${_parser_cpp_name})
 make_absolute(parse_srcs ${parse_SOURCE_DIR})
 
+set(parse_test_srcs
+	optimise_test.cpp
+)
+make_absolute(parse_test_srcs ${parse_SOURCE_DIR})
+
 # Create header list variables
 set(parse_hdrs
 	funcdef.h
 	parsenode.h
+	ssa.h
 	vardef.h
 )
 set(parse_hdrs ${parse_hdrs} ${_parser_hpp_name})
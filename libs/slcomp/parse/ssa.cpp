@@ -0,0 +1,1517 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Construction and analysis of the SSA form of shader code.
+ *
+ * The form is built in one walk over the parse tree, in the order the VM
+ * evaluates it, using the algorithm of Braun et al, "Simple and Efficient
+ * Construction of Static Single Assignment Form".  Loop headers are sealed
+ * once the back edge is known, so phis there start out incomplete.
+ */
+
+#include	"ssa.h"
+
+#include	<algorithm>
+#include	<cctype>
+#include	<cmath>
+#include	<cstring>
+
+#include	"funcdef.h"
+#include	"vardef.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Builtin functions with no side effects, whose result only depends on
+/// their arguments.  The VM computes them once per grid if all the
+/// arguments are uniform.
+const char* gPureFunctions[] =
+    {
+        "operator*", "operator/", "operator+", "operator-", "operatorneg",
+        "operator^", "operator.",
+        "sin", "cos", "tan", "asin", "acos", "atan", "radians", "degrees",
+        "pow", "exp", "sqrt", "inversesqrt", "log", "mod", "abs", "sign",
+        "min", "max", "clamp", "floor", "ceil", "round", "step", "smoothstep",
+        "mix", "xcomp", "ycomp", "zcomp", "comp", "length", "distance",
+        "normalize", "noise", "cellnoise", "determinant",
+        0
+    };
+
+bool IsPureFunction( const CqFuncDef& func )
+{
+	if ( func.fLocal() || func.InternalUsage() != 0 || func.VariableLength() >= 0 )
+		return ( false );
+	for ( const char** pName = gPureFunctions; *pName != 0; ++pName )
+		if ( std::strcmp( func.strName(), *pName ) == 0 )
+			return ( true );
+	return ( false );
+}
+
+/// Whether a function argument is written by the function.
+bool IsOutputArgument( const CqFuncDef& func, TqInt iArg )
+{
+	const char* strParams = func.strParams();
+	for ( TqInt i = 0; strParams[ i ] != 0; ++i )
+	{
+		if ( strParams[ i ] == '*' )
+			return ( true );
+		if ( i == iArg )
+			return ( std::isupper( strParams[ i ] ) != 0 );
+	}
+	return ( true );
+}
+
+/// Whether a node is a variable on its own, which a function can write to.
+bool IsBareVariable( const CqParseNode* pNode )
+{
+	return ( pNode->NodeType() == IqParseNodeVariable::m_ID ||
+	         ( pNode->NodeType() == IqParseNodeArrayVariable::m_ID && pNode->pFirstChild() == 0 ) );
+}
+
+/// Whether a node reads or writes a variable.
+bool IsVariableNode( const CqParseNode* pNode )
+{
+	TqInt type = pNode->NodeType();
+	return ( type == IqParseNodeVariable::m_ID || type == IqParseNodeArrayVariable::m_ID ||
+	         type == IqParseNodeVariableAssign::m_ID || type == IqParseNodeArrayVariableAssign::m_ID );
+}
+
+bool IsLightVariable( const SqVarRef& ref )
+{
+	if ( ref.m_Type != VarTypeStandard )
+		return ( false );
+	const char* strName = CqVarDef::GetVariablePtr( ref )->strName();
+	return ( std::strcmp( strName, "L" ) == 0 || std::strcmp( strName, "Cl" ) == 0 ||
+	         std::strcmp( strName, "Ol" ) == 0 );
+}
+
+} // unnamed namespace
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::CanonicalRef
+/// Follow extern declarations to the variable they refer to.
+
+SqVarRef CqSsaForm::CanonicalRef( SqVarRef ref )
+{
+	while ( ref.m_Type == VarTypeLocal && ref.m_Index < gLocalVars.size() &&
+	        gLocalVars[ ref.m_Index ].fExtern() )
+		ref = gLocalVars[ ref.m_Index ].vrExtern();
+	return ( ref );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::CqSsaForm
+
+CqSsaForm::CqSsaForm( CqParseNode* pBody, bool fFunction, const std::set<std::pair<TqInt, TqInt> >& aShared )
+		: m_fFunction( fFunction ),
+		m_aShared( aShared ),
+		m_CurrentLoop( -1 ),
+		m_Seq( 0 )
+{
+	FindVariables( pBody );
+	m_CurrentBlock = NewBlock( -1 );
+	Statement( pBody );
+	RemoveTrivialPhis();
+
+	// Refer to the values which trivial phis were replaced by directly.
+	std::vector<SqSsaValue>::iterator iValue;
+	for ( iValue = m_aValues.begin(); iValue != m_aValues.end(); ++iValue )
+		for ( std::vector<TqInt>::iterator i = iValue->m_aOperands.begin(); i != iValue->m_aOperands.end(); ++i )
+			*i = Resolve( *i );
+	for ( std::vector<SqSsaBlock>::iterator iBlock = m_aBlocks.begin(); iBlock != m_aBlocks.end(); ++iBlock )
+		for ( std::vector<TqInt>::iterator i = iBlock->m_aControls.begin(); i != iBlock->m_aControls.end(); ++i )
+			*i = Resolve( *i );
+	for ( std::vector<TqInt>::iterator i = m_aUses.begin(); i != m_aUses.end(); ++i )
+		*i = Resolve( *i );
+	std::map<CqParseNode*, TqInt>::iterator iNode;
+	for ( iNode = m_NodeValues.begin(); iNode != m_NodeValues.end(); ++iNode )
+		iNode->second = Resolve( iNode->second );
+	for ( iNode = m_ConditionValues.begin(); iNode != m_ConditionValues.end(); ++iNode )
+		iNode->second = Resolve( iNode->second );
+}
+
+
+TqInt CqSsaForm::NewValue( EqSsaOp op, TqInt type, TqInt iVar )
+{
+	SqSsaValue value;
+	value.m_Op = op;
+	value.m_SubOp = 0;
+	value.m_Type = type & Type_Mask;
+	value.m_Var = iVar;
+	value.m_Block = m_CurrentBlock;
+	value.m_Seq = m_Seq++;
+	value.m_pNode = 0;
+	value.m_Forward = -1;
+	value.m_fConst = false;
+	value.m_Value = 0.0f;
+	value.m_fUniform = false;
+	m_aValues.push_back( value );
+	return ( m_aValues.size() - 1 );
+}
+
+
+TqInt CqSsaForm::NewBlock( TqInt iIdom, bool fSealed )
+{
+	SqSsaBlock block;
+	block.m_Idom = iIdom;
+	block.m_Loop = m_CurrentLoop;
+	block.m_fSealed = fSealed;
+	block.m_fUnreachable = false;
+	m_aBlocks.push_back( block );
+	return ( m_aBlocks.size() - 1 );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::AddPred
+/// Add an edge to the control flow graph.  Code after a break or continue
+/// can never run, so edges from it are left out.
+
+void CqSsaForm::AddPred( TqInt iBlock, TqInt iPred )
+{
+	const SqSsaBlock& pred = m_aBlocks[ iPred ];
+	if ( pred.m_fUnreachable || ( pred.m_fSealed && pred.m_aPreds.empty() && iPred != 0 ) )
+		return ;
+	m_aBlocks[ iBlock ].m_aPreds.push_back( iPred );
+}
+
+
+void CqSsaForm::SealBlock( TqInt iBlock )
+{
+	if ( m_aBlocks[ iBlock ].m_aPreds.empty() && iBlock != 0 )
+		m_aBlocks[ iBlock ].m_fUnreachable = true;
+	std::map<TqInt, TqInt> incomplete;
+	incomplete.swap( m_aBlocks[ iBlock ].m_IncompletePhis );
+	m_aBlocks[ iBlock ].m_fSealed = true;
+	for ( std::map<TqInt, TqInt>::iterator i = incomplete.begin(); i != incomplete.end(); ++i )
+		AddPhiOperands( i->first, i->second );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::VariableIndex
+/// Find the entry for a variable, adding it if it is new.
+
+TqInt CqSsaForm::VariableIndex( SqVarRef ref )
+{
+	ref = CanonicalRef( ref );
+	std::pair<TqInt, TqInt> key( ref.m_Type, ref.m_Index );
+	std::map<std::pair<TqInt, TqInt>, TqInt>::iterator i = m_VariableIndices.find( key );
+	if ( i != m_VariableIndices.end() )
+		return ( i->second );
+
+	CqVarDef* pDef = CqVarDef::GetVariablePtr( ref );
+	TqInt type = pDef ? pDef->Type() : Type_Varying;
+	SqSsaVariable var;
+	var.m_Ref = ref;
+	var.m_fShared = ref.m_Type == VarTypeStandard || m_aShared.count( key ) != 0;
+	var.m_fUniform = ( type & Type_Uniform ) != 0;
+	// In a function a parameter may refer to a varying variable of the
+	// caller, whatever it is declared as.
+	if ( m_fFunction && var.m_fShared && ref.m_Type == VarTypeLocal && ( type & Type_Param ) == 0 )
+		var.m_fUniform = false;
+	var.m_fArray = ( type & Type_Array ) != 0;
+	var.m_fOpaqueDef = false;
+	var.m_Entry = -1;
+	m_aVariables.push_back( var );
+	m_VariableIndices[ key ] = m_aVariables.size() - 1;
+	return ( m_aVariables.size() - 1 );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::FindVariables
+/// Add all the variables the code refers to, so that anything which may
+/// change variables behind the optimiser's back can clobber them all.
+
+void CqSsaForm::FindVariables( CqParseNode* pNode )
+{
+	if ( IsVariableNode( pNode ) )
+		VariableIndex( static_cast<CqParseNodeVariable*>( pNode )->VarRef() );
+	else if ( pNode->NodeType() == IqParseNodeMessagePassingFunction::m_ID )
+		VariableIndex( static_cast<CqParseNodeCommFunction*>( pNode )->VarRef() );
+	for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		FindVariables( pChild );
+}
+
+
+void CqSsaForm::WriteVariable( TqInt iVar, TqInt iBlock, TqInt iValue )
+{
+	m_aBlocks[ iBlock ].m_Defs[ iVar ] = iValue;
+}
+
+
+TqInt CqSsaForm::ReadVariable( TqInt iVar, TqInt iBlock )
+{
+	std::map<TqInt, TqInt>::iterator i = m_aBlocks[ iBlock ].m_Defs.find( iVar );
+	if ( i != m_aBlocks[ iBlock ].m_Defs.end() )
+		return ( Resolve( i->second ) );
+	return ( Resolve( ReadVariableRecursive( iVar, iBlock ) ) );
+}
+
+
+TqInt CqSsaForm::ReadVariableRecursive( TqInt iVar, TqInt iBlock )
+{
+	TqInt type = CqVarDef::GetVariablePtr( m_aVariables[ iVar ].m_Ref )->Type();
+	TqInt iValue;
+	if ( !m_aBlocks[ iBlock ].m_fSealed )
+	{
+		iValue = NewValue( SsaOp_Phi, type, iVar );
+		m_aValues[ iValue ].m_Block = iBlock;
+		m_aBlocks[ iBlock ].m_IncompletePhis[ iVar ] = iValue;
+	}
+	else if ( m_aBlocks[ iBlock ].m_aPreds.empty() )
+	{
+		if ( iBlock == 0 )
+		{
+			// The value the variable has before the code runs, the same
+			// for every read.
+			if ( m_aVariables[ iVar ].m_Entry < 0 )
+			{
+				TqInt iEntry = NewValue( m_aVariables[ iVar ].m_fShared ? SsaOp_Entry : SsaOp_Undef, type, iVar );
+				m_aValues[ iEntry ].m_Block = 0;
+				m_aVariables[ iVar ].m_Entry = iEntry;
+			}
+			iValue = m_aVariables[ iVar ].m_Entry;
+		}
+		else
+		{
+			iValue = NewValue( SsaOp_Undef, type, iVar );
+			m_aValues[ iValue ].m_Block = iBlock;
+		}
+	}
+	else if ( m_aBlocks[ iBlock ].m_aPreds.size() == 1 )
+		iValue = ReadVariable( iVar, m_aBlocks[ iBlock ].m_aPreds[ 0 ] );
+	else
+	{
+		// Write the phi first, to break cycles through loops.
+		iValue = NewValue( SsaOp_Phi, type, iVar );
+		m_aValues[ iValue ].m_Block = iBlock;
+		WriteVariable( iVar, iBlock, iValue );
+		iValue = AddPhiOperands( iVar, iValue );
+	}
+	WriteVariable( iVar, iBlock, iValue );
+	return ( iValue );
+}
+
+
+TqInt CqSsaForm::AddPhiOperands( TqInt iVar, TqInt iPhi )
+{
+	TqInt iBlock = m_aValues[ iPhi ].m_Block;
+	for ( TqUint i = 0; i < m_aBlocks[ iBlock ].m_aPreds.size(); ++i )
+	{
+		TqInt iOperand = ReadVariable( iVar, m_aBlocks[ iBlock ].m_aPreds[ i ] );
+		m_aValues[ iPhi ].m_aOperands.push_back( iOperand );
+	}
+	return ( RemoveTrivialPhi( iPhi ) );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::RemoveTrivialPhi
+/// A phi whose operands are all the same value, or itself, is replaced by
+/// that value.
+
+TqInt CqSsaForm::RemoveTrivialPhi( TqInt iPhi )
+{
+	TqInt same = -1;
+	for ( TqUint i = 0; i < m_aValues[ iPhi ].m_aOperands.size(); ++i )
+	{
+		TqInt iOperand = Resolve( m_aValues[ iPhi ].m_aOperands[ i ] );
+		if ( iOperand == same || iOperand == iPhi )
+			continue;
+		if ( same != -1 )
+			return ( iPhi );
+		same = iOperand;
+	}
+	if ( same == -1 )
+	{
+		// The phi is unreachable or only refers to itself.
+		TqInt iCurrent = m_CurrentBlock;
+		m_CurrentBlock = m_aValues[ iPhi ].m_Block;
+		same = NewValue( SsaOp_Undef, m_aValues[ iPhi ].m_Type, m_aValues[ iPhi ].m_Var );
+		m_CurrentBlock = iCurrent;
+	}
+	m_aValues[ iPhi ].m_Forward = same;
+	return ( same );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::RemoveTrivialPhis
+/// Removing a trivial phi can make phis using it trivial, so repeat until
+/// there are no more.
+
+void CqSsaForm::RemoveTrivialPhis()
+{
+	bool fChanged = true;
+	while ( fChanged )
+	{
+		fChanged = false;
+		for ( TqUint i = 0; i < m_aValues.size(); ++i )
+		{
+			if ( m_aValues[ i ].m_Op == SsaOp_Phi && m_aValues[ i ].m_Forward == -1 &&
+			        RemoveTrivialPhi( i ) != static_cast<TqInt>( i ) )
+				fChanged = true;
+		}
+	}
+}
+
+
+TqInt CqSsaForm::Resolve( TqInt iValue ) const
+{
+	while ( iValue >= 0 && m_aValues[ iValue ].m_Forward != -1 )
+		iValue = m_aValues[ iValue ].m_Forward;
+	return ( iValue );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Read
+/// Read the current value of a variable.
+
+TqInt CqSsaForm::Read( TqInt iVar )
+{
+	TqInt iValue = ReadVariable( iVar, m_CurrentBlock );
+	m_aUses.push_back( iValue );
+	return ( iValue );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Assign
+/// Assign a value to a variable.  In a function, a shared variable may be
+/// another name for any other shared variable, so they are all clobbered.
+
+TqInt CqSsaForm::Assign( TqInt iVar, TqInt iValue )
+{
+	if ( m_fFunction && m_aVariables[ iVar ].m_fShared )
+		ClobberShared();
+	TqInt iCopy = NewValue( SsaOp_Copy, CqVarDef::GetVariablePtr( m_aVariables[ iVar ].m_Ref )->Type(), iVar );
+	m_aValues[ iCopy ].m_aOperands.push_back( iValue );
+	WriteVariable( iVar, m_CurrentBlock, iCopy );
+	return ( iCopy );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Clobber
+/// Give a variable a value which the optimiser knows nothing about.  Such
+/// writes may leave some points alone, as textureinfo does when the
+/// texture can't be found, so the value before is still needed.
+
+void CqSsaForm::Clobber( TqInt iVar )
+{
+	m_aUses.push_back( ReadVariable( iVar, m_CurrentBlock ) );
+	TqInt iValue = NewValue( SsaOp_Opaque, CqVarDef::GetVariablePtr( m_aVariables[ iVar ].m_Ref )->Type(), iVar );
+	m_aVariables[ iVar ].m_fOpaqueDef = true;
+	WriteVariable( iVar, m_CurrentBlock, iValue );
+}
+
+
+void CqSsaForm::ClobberShared()
+{
+	for ( TqUint i = 0; i < m_aVariables.size(); ++i )
+		if ( m_aVariables[ i ].m_fShared )
+			Clobber( i );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::ClobberLight
+/// The light loops set the light direction and colour on each pass.
+
+void CqSsaForm::ClobberLight()
+{
+	for ( TqUint i = 0; i < m_aVariables.size(); ++i )
+		if ( IsLightVariable( m_aVariables[ i ].m_Ref ) )
+			Clobber( i );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Statement
+/// Add a statement to the SSA form.
+
+void CqSsaForm::Statement( CqParseNode* pNode )
+{
+	if ( pNode == 0 )
+		return ;
+
+	TqInt type = pNode->NodeType();
+	if ( type == IqParseNode::m_ID )
+	{
+		for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+			Statement( pChild );
+	}
+	else if ( type == IqParseNodeConditional::m_ID )
+	{
+		CqParseNode* pCond = pNode->pFirstChild();
+		CqParseNode* pTrue = pCond->pNext();
+		Conditional( pCond, pTrue, pTrue->pNext(), pNode );
+	}
+	else if ( type == IqParseNodeWhileConstruct::m_ID )
+		While( pNode );
+	else if ( type == IqParseNodeIlluminanceConstruct::m_ID ||
+	          type == IqParseNodeIlluminateConstruct::m_ID ||
+	          type == IqParseNodeSolarConstruct::m_ID )
+		LightLoop( pNode );
+	else if ( type == IqParseNodeGatherConstruct::m_ID )
+		Gather( pNode );
+	else if ( type == IqParseNodeLoopMod::m_ID )
+		LoopMod( pNode );
+	else
+	{
+		bool fPure;
+		Expression( pNode, false, fPure );
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Expression
+/// Add an expression to the SSA form, returning its value, or -1 if it has
+/// none.  fPure is set if evaluating the expression has no side effects.
+/// The nodes of a frozen expression aren't given values, as the backend
+/// needs them as they are.
+
+TqInt CqSsaForm::Expression( CqParseNode* pNode, bool fFrozen, bool& fPure )
+{
+	fPure = true;
+	TqInt iValue = -1;
+	bool fOperation = false;
+	TqInt type = pNode->NodeType();
+
+	if ( type == IqParseNodeConstantFloat::m_ID )
+	{
+		iValue = NewValue( SsaOp_Const, Type_Float );
+		m_aValues[ iValue ].m_fConst = true;
+		m_aValues[ iValue ].m_Value = static_cast<CqParseNodeFloatConst*>( pNode )->Value();
+	}
+	else if ( type == IqParseNodeConstantString::m_ID )
+	{
+		iValue = NewValue( SsaOp_Const, Type_String );
+		m_aValues[ iValue ].m_fConst = true;
+		m_aValues[ iValue ].m_strValue = static_cast<CqParseNodeStringConst*>( pNode )->strValue();
+	}
+	else if ( type == IqParseNodeVariable::m_ID )
+		iValue = Read( VariableIndex( static_cast<CqParseNodeVariable*>( pNode )->VarRef() ) );
+	else if ( type == IqParseNodeArrayVariable::m_ID )
+	{
+		TqInt iVar = VariableIndex( static_cast<CqParseNodeVariable*>( pNode )->VarRef() );
+		if ( pNode->pFirstChild() != 0 )
+		{
+			bool fIndexPure;
+			TqInt iIndex = Expression( pNode->pFirstChild(), fFrozen, fIndexPure );
+			TqInt iArray = Read( iVar );
+			fPure = fIndexPure;
+			iValue = NewValue( SsaOp_Index, pNode->ResType() );
+			m_aValues[ iValue ].m_aOperands.push_back( iArray );
+			m_aValues[ iValue ].m_aOperands.push_back( iIndex );
+			fOperation = true;
+		}
+		else
+			iValue = Read( iVar );
+	}
+	else if ( type == IqParseNodeVariableAssign::m_ID )
+	{
+		CqParseNodeAssign* pAssign = static_cast<CqParseNodeAssign*>( pNode );
+		bool fRhsPure;
+		TqInt iRhs = Expression( pNode->pFirstChild(), fFrozen, fRhsPure );
+		TqInt iVar = VariableIndex( pAssign->VarRef() );
+		TqInt iCopy = Assign( iVar, iRhs );
+		if ( !fFrozen )
+			m_AssignValues[ pNode ] = iCopy;
+		fPure = false;
+		if ( !pAssign->fDiscardResult() )
+			iValue = iRhs;
+	}
+	else if ( type == IqParseNodeArrayVariableAssign::m_ID )
+	{
+		CqParseNodeAssignArray* pAssign = static_cast<CqParseNodeAssignArray*>( pNode );
+		bool fChildPure;
+		TqInt iRhs = Expression( pNode->pFirstChild(), fFrozen, fChildPure );
+		Expression( pNode->pFirstChild()->pNext(), fFrozen, fChildPure );
+		TqInt iVar = VariableIndex( pAssign->VarRef() );
+		// The rest of the array is kept, so the old value is read.
+		Read( iVar );
+		if ( m_fFunction && m_aVariables[ iVar ].m_fShared )
+			ClobberShared();
+		Clobber( iVar );
+		fPure = false;
+		if ( !pAssign->fDiscardResult() )
+			iValue = iRhs;
+	}
+	else if ( type == IqParseNodeFunctionCall::m_ID || type == IqParseNodeUnresolvedCall::m_ID )
+		return ( Call( pNode, fFrozen, fPure ) );
+	else if ( type == IqParseNodeRelationalOp::m_ID || type == IqParseNodeLogicalOp::m_ID ||
+	          type == IqParseNodeUnaryOp::m_ID )
+	{
+		std::vector<TqInt> aOperands;
+		for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		{
+			bool fChildPure;
+			aOperands.push_back( Expression( pChild, fFrozen, fChildPure ) );
+			fPure = fPure && fChildPure;
+		}
+		EqSsaOp op = type == IqParseNodeRelationalOp::m_ID ? SsaOp_RelOp :
+		             type == IqParseNodeLogicalOp::m_ID ? SsaOp_LogicalOp : SsaOp_UnaryOp;
+		iValue = NewValue( op, pNode->ResType() );
+		m_aValues[ iValue ].m_SubOp = static_cast<CqParseNodeOp*>( pNode )->Operator();
+		m_aValues[ iValue ].m_aOperands = aOperands;
+		fOperation = true;
+	}
+	else if ( type == IqParseNodeTypeCast::m_ID )
+	{
+		TqInt iChild = Expression( pNode->pFirstChild(), fFrozen, fPure );
+		TqInt to = static_cast<CqParseNodeCast*>( pNode )->CastTo() & Type_Mask;
+		if ( ( pNode->pFirstChild()->ResType() & Type_Mask ) == to )
+			iValue = iChild;
+		else
+		{
+			iValue = NewValue( SsaOp_Cast, to );
+			m_aValues[ iValue ].m_SubOp = to;
+			m_aValues[ iValue ].m_aOperands.push_back( iChild );
+			fOperation = true;
+		}
+	}
+	else if ( type == IqParseNodeTriple::m_ID || type == IqParseNodeSixteenTuple::m_ID )
+	{
+		// Triples are pushed last component first.
+		std::vector<CqParseNode*> apChildren;
+		for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+			apChildren.push_back( pChild );
+		if ( type == IqParseNodeTriple::m_ID )
+			std::reverse( apChildren.begin(), apChildren.end() );
+		std::vector<TqInt> aOperands;
+		for ( std::vector<CqParseNode*>::iterator i = apChildren.begin(); i != apChildren.end(); ++i )
+		{
+			bool fChildPure;
+			aOperands.push_back( Expression( *i, fFrozen, fChildPure ) );
+			fPure = fPure && fChildPure;
+		}
+		if ( type == IqParseNodeTriple::m_ID )
+			std::reverse( aOperands.begin(), aOperands.end() );
+		iValue = NewValue( SsaOp_Tuple, pNode->ResType() );
+		m_aValues[ iValue ].m_SubOp = type;
+		m_aValues[ iValue ].m_aOperands = aOperands;
+		fOperation = true;
+	}
+	else if ( type == IqParseNodeConditionalExpression::m_ID )
+	{
+		iValue = QCond( pNode, fFrozen, fPure );
+		fOperation = true;
+	}
+	else if ( type == IqParseNodeMessagePassingFunction::m_ID )
+	{
+		FrozenChildren( pNode );
+		TqInt iVar = VariableIndex( static_cast<CqParseNodeCommFunction*>( pNode )->VarRef() );
+		if ( m_fFunction && m_aVariables[ iVar ].m_fShared )
+			ClobberShared();
+		Clobber( iVar );
+		iValue = NewValue( SsaOp_Opaque, Type_Float );
+		fPure = false;
+	}
+	else
+	{
+		// Anything else, such as a discarded result, is left alone.
+		for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+			Statement( pChild );
+		fPure = false;
+		return ( -1 );
+	}
+
+	if ( !fFrozen && fPure && iValue >= 0 )
+	{
+		m_NodeValues[ pNode ] = iValue;
+		if ( fOperation )
+			m_aValues[ iValue ].m_pNode = pNode;
+	}
+	return ( iValue );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Call
+/// Add a function call.  Builtin functions are pushed last argument first.
+/// The body of a local function is output in place of the call, with
+/// variables passed by reference, so everything it might see is
+/// clobbered.
+
+TqInt CqSsaForm::Call( CqParseNode* pNode, bool fFrozen, bool& fPure )
+{
+	CqFuncDef* pFunc;
+	if ( pNode->NodeType() == IqParseNodeFunctionCall::m_ID )
+		pFunc = static_cast<CqFuncDef*>( static_cast<CqParseNodeFunctionCall*>( pNode )->pFuncDef() );
+	else
+		pFunc = &static_cast<CqParseNodeUnresolvedCall*>( pNode )->pFuncDefInt();
+
+	std::vector<CqParseNode*> apArgs;
+	for ( CqParseNode* pArg = pNode->pFirstChild(); pArg != 0; pArg = pArg->pNext() )
+		apArgs.push_back( pArg );
+	TqInt type = pFunc->Type() & Type_Mask;
+	fPure = false;
+
+	if ( pNode->NodeType() == IqParseNodeFunctionCall::m_ID && pFunc->fLocal() )
+	{
+		std::vector<TqInt> aByReference;
+		for ( std::vector<CqParseNode*>::iterator i = apArgs.begin(); i != apArgs.end(); ++i )
+		{
+			bool fArgPure;
+			if ( ( *i )->IsVariableRef() )
+			{
+				TqInt iVar = VariableIndex( static_cast<CqParseNodeVariable*>( *i )->VarRef() );
+				Read( iVar );
+				aByReference.push_back( iVar );
+			}
+			else
+				Expression( *i, fFrozen, fArgPure );
+		}
+		ClobberShared();
+		for ( std::vector<TqInt>::iterator i = aByReference.begin(); i != aByReference.end(); ++i )
+			Clobber( *i );
+		if ( type == Type_Void || type == Type_Nil )
+			return ( -1 );
+		return ( NewValue( SsaOp_Opaque, type ) );
+	}
+
+	// Variables which the function writes to are left as they are.
+	bool fPureFunction = pNode->NodeType() == IqParseNodeFunctionCall::m_ID &&
+	                     IsPureFunction( *pFunc ) && type != Type_Void && type != Type_Nil;
+	std::vector<TqInt> aOperands( apArgs.size() );
+	bool fArgsPure = true;
+	for ( TqInt i = apArgs.size() - 1; i >= 0; --i )
+	{
+		bool fArgPure;
+		bool fOutput = !fPureFunction && IsBareVariable( apArgs[ i ] ) && IsOutputArgument( *pFunc, i );
+		aOperands[ i ] = Expression( apArgs[ i ], fFrozen || fOutput, fArgPure );
+		fArgsPure = fArgsPure && fArgPure && aOperands[ i ] >= 0;
+	}
+
+	if ( fPureFunction )
+	{
+		TqInt iValue = NewValue( SsaOp_Call, pNode->ResType() );
+		m_aValues[ iValue ].m_strFunc = pFunc->strVMName();
+		m_aValues[ iValue ].m_aOperands = aOperands;
+		fPure = fArgsPure;
+		if ( !fFrozen && fPure )
+		{
+			m_NodeValues[ pNode ] = iValue;
+			m_aValues[ iValue ].m_pNode = pNode;
+		}
+		return ( iValue );
+	}
+
+	for ( TqUint i = 0; i < apArgs.size(); ++i )
+	{
+		if ( IsBareVariable( apArgs[ i ] ) && IsOutputArgument( *pFunc, i ) )
+		{
+			TqInt iVar = VariableIndex( static_cast<CqParseNodeVariable*>( apArgs[ i ] )->VarRef() );
+			if ( m_fFunction && m_aVariables[ iVar ].m_fShared )
+				ClobberShared();
+			Clobber( iVar );
+		}
+	}
+	if ( type == Type_Void || type == Type_Nil )
+		return ( -1 );
+	return ( NewValue( SsaOp_Opaque, type ) );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Conditional
+/// Add an if statement.
+
+void CqSsaForm::Conditional( CqParseNode* pCond, CqParseNode* pTrue, CqParseNode* pFalse, CqParseNode* pNode )
+{
+	bool fPure;
+	TqInt iCond = Expression( pCond, false, fPure );
+	m_ConditionValues[ pNode ] = iCond;
+
+	TqInt iPre = m_CurrentBlock;
+	m_aControls.push_back( iCond );
+	m_CurrentBlock = NewBlock( iPre );
+	AddPred( m_CurrentBlock, iPre );
+	Statement( pTrue );
+	TqInt iTrueEnd = m_CurrentBlock;
+	TqInt iFalseEnd = iPre;
+	if ( pFalse )
+	{
+		m_CurrentBlock = NewBlock( iPre );
+		AddPred( m_CurrentBlock, iPre );
+		Statement( pFalse );
+		iFalseEnd = m_CurrentBlock;
+	}
+	m_aControls.pop_back();
+
+	TqInt iJoin = NewBlock( iPre, false );
+	AddPred( iJoin, iTrueEnd );
+	AddPred( iJoin, iFalseEnd );
+	m_aBlocks[ iJoin ].m_aControls.push_back( iCond );
+	SealBlock( iJoin );
+	m_CurrentBlock = iJoin;
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::QCond
+/// Add a ?: expression.  The VM evaluates both expressions, each with only
+/// the points it is chosen for running, and merges them.
+
+TqInt CqSsaForm::QCond( CqParseNode* pNode, bool fFrozen, bool& fPure )
+{
+	CqParseNode* pCond = pNode->pFirstChild();
+	CqParseNode* pTrue = pCond->pNext();
+	CqParseNode* pFalse = pTrue->pNext();
+
+	bool fCondPure, fTruePure, fFalsePure;
+	TqInt iCond = Expression( pCond, fFrozen, fCondPure );
+	if ( !fFrozen )
+		m_ConditionValues[ pNode ] = iCond;
+
+	TqInt iPre = m_CurrentBlock;
+	m_aControls.push_back( iCond );
+	m_CurrentBlock = NewBlock( iPre );
+	AddPred( m_CurrentBlock, iPre );
+	TqInt iTrue = Expression( pTrue, fFrozen, fTruePure );
+	TqInt iTrueEnd = m_CurrentBlock;
+	m_CurrentBlock = NewBlock( iPre );
+	AddPred( m_CurrentBlock, iPre );
+	TqInt iFalse = Expression( pFalse, fFrozen, fFalsePure );
+	TqInt iFalseEnd = m_CurrentBlock;
+	m_aControls.pop_back();
+
+	TqInt iJoin = NewBlock( iPre, false );
+	AddPred( iJoin, iTrueEnd );
+	AddPred( iJoin, iFalseEnd );
+	m_aBlocks[ iJoin ].m_aControls.push_back( iCond );
+	SealBlock( iJoin );
+	m_CurrentBlock = iJoin;
+
+	fPure = fCondPure && fTruePure && fFalsePure;
+	TqInt iValue = NewValue( SsaOp_Select, pNode->ResType() );
+	m_aValues[ iValue ].m_aOperands.push_back( iCond );
+	m_aValues[ iValue ].m_aOperands.push_back( iTrue );
+	m_aValues[ iValue ].m_aOperands.push_back( iFalse );
+	return ( iValue );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::BeginLoop
+/// Start a loop, with its header block entered from the current block.
+
+TqInt CqSsaForm::BeginLoop( CqParseNode* pNode )
+{
+	SqSsaLoop loop;
+	loop.m_pNode = pNode;
+	loop.m_Parent = m_CurrentLoop;
+	loop.m_ControlDepth = m_aControls.size();
+	loop.m_Latch = -1;
+	loop.m_Exit = -1;
+	m_aLoops.push_back( loop );
+	TqInt iLoop = m_aLoops.size() - 1;
+
+	TqInt iPre = m_CurrentBlock;
+	m_CurrentLoop = iLoop;
+	m_CurrentBlock = NewBlock( iPre, false );
+	AddPred( m_CurrentBlock, iPre );
+	m_aLoops[ iLoop ].m_Header = m_CurrentBlock;
+	return ( iLoop );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::EndLoop
+/// Seal the header and exit of a loop once all the edges into them are
+/// known, and carry on after it.
+
+void CqSsaForm::EndLoop( TqInt iLoop )
+{
+	SqSsaLoop& loop = m_aLoops[ iLoop ];
+	m_aBlocks[ loop.m_Header ].m_aControls = loop.m_aControls;
+	m_aBlocks[ loop.m_Exit ].m_aControls = loop.m_aControls;
+	m_aBlocks[ loop.m_Exit ].m_Loop = loop.m_Parent;
+	SealBlock( loop.m_Header );
+	SealBlock( loop.m_Exit );
+	m_CurrentLoop = loop.m_Parent;
+	m_CurrentBlock = loop.m_Exit;
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::While
+/// Add a while or for loop.  The children are the condition, the body and,
+/// for a for loop, the increment, which continue jumps to.
+
+void CqSsaForm::While( CqParseNode* pNode )
+{
+	CqParseNode* pCond = pNode->pFirstChild();
+	CqParseNode* pStmt = pCond->pNext();
+	CqParseNode* pIncr = pStmt ? pStmt->pNext() : 0;
+
+	TqInt iLoop = BeginLoop( pNode );
+	TqInt iHeader = m_CurrentBlock;
+	bool fPure;
+	TqInt iCond = Expression( pCond, false, fPure );
+	m_ConditionValues[ pNode ] = iCond;
+	m_aLoops[ iLoop ].m_aControls.push_back( iCond );
+	TqInt iBody = NewBlock( iHeader );
+	AddPred( iBody, iHeader );
+	m_aLoops[ iLoop ].m_Latch = NewBlock( iHeader, false );
+	m_aLoops[ iLoop ].m_Exit = NewBlock( iHeader, false );
+	AddPred( m_aLoops[ iLoop ].m_Exit, iHeader );
+
+	m_aControls.push_back( iCond );
+	m_aBreakLoops.push_back( iLoop );
+	m_CurrentBlock = iBody;
+	Statement( pStmt );
+	m_aBreakLoops.pop_back();
+	m_aControls.pop_back();
+
+	TqInt iLatch = m_aLoops[ iLoop ].m_Latch;
+	AddPred( iLatch, m_CurrentBlock );
+	m_aBlocks[ iLatch ].m_aControls = m_aLoops[ iLoop ].m_aControls;
+	SealBlock( iLatch );
+	m_CurrentBlock = iLatch;
+	Statement( pIncr );
+	AddPred( iHeader, m_CurrentBlock );
+	EndLoop( iLoop );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::LightLoop
+/// Add an illuminance, illuminate or solar loop.  The VM decides which
+/// points run the body for each light, so the condition is opaque.  The
+/// arguments are output as they are by the backend.
+
+void CqSsaForm::LightLoop( CqParseNode* pNode )
+{
+	TqInt type = pNode->NodeType();
+	CqParseNode* pArgs = 0;
+	CqParseNode* pStmt = pNode->pFirstChild();
+	if ( type != IqParseNodeSolarConstruct::m_ID ||
+	        static_cast<CqParseNodeSolarConstruct*>( pNode )->fHasAxisAngle() )
+	{
+		pArgs = pStmt;
+		pStmt = pArgs->pNext();
+	}
+
+	TqInt iPre = m_CurrentBlock;
+	if ( type == IqParseNodeIlluminanceConstruct::m_ID )
+	{
+		// The position, and the axis if there is one, start the loop.
+		CqParseNode* pInitArg = pArgs->pFirstChild();
+		while ( pInitArg->pNext() != 0 )
+			pInitArg = pInitArg->pNext();
+		pInitArg = pInitArg->pPrevious();
+		bool fPure;
+		if ( static_cast<CqParseNodeIlluminanceConstruct*>( pNode )->fHasAxisAngle() )
+			Expression( pInitArg->pPrevious(), true, fPure );
+		Expression( pInitArg, true, fPure );
+	}
+
+	TqInt iLoop = BeginLoop( pNode );
+	TqInt iHeader = m_CurrentBlock;
+	if ( pArgs )
+		FrozenChildren( pArgs );
+	ClobberLight();
+	TqInt iCond = NewValue( SsaOp_Opaque, Type_Float );
+	m_aLoops[ iLoop ].m_aControls.push_back( iCond );
+
+	m_CurrentBlock = NewBlock( iHeader );
+	AddPred( m_CurrentBlock, iHeader );
+	m_aControls.push_back( iCond );
+	Statement( pStmt );
+	m_aControls.pop_back();
+
+	if ( type == IqParseNodeIlluminanceConstruct::m_ID )
+	{
+		// Lights which don't reach any point skip the body, and there may
+		// be no lights at all.
+		TqInt iLatch = NewBlock( iHeader, false );
+		AddPred( iLatch, iHeader );
+		AddPred( iLatch, m_CurrentBlock );
+		m_aBlocks[ iLatch ].m_aControls.push_back( iCond );
+		SealBlock( iLatch );
+		m_aLoops[ iLoop ].m_Latch = iLatch;
+		AddPred( iHeader, iLatch );
+		m_aLoops[ iLoop ].m_Exit = NewBlock( iPre, false );
+		AddPred( m_aLoops[ iLoop ].m_Exit, iPre );
+		AddPred( m_aLoops[ iLoop ].m_Exit, iLatch );
+	}
+	else
+	{
+		m_aLoops[ iLoop ].m_Latch = m_CurrentBlock;
+		AddPred( iHeader, m_CurrentBlock );
+		m_aLoops[ iLoop ].m_Exit = NewBlock( iHeader, false );
+		AddPred( m_aLoops[ iLoop ].m_Exit, iHeader );
+	}
+	EndLoop( iLoop );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Gather
+/// Add a gather loop, whose children are the arguments, the statement for
+/// rays which hit and optionally the statement for rays which don't.
+
+void CqSsaForm::Gather( CqParseNode* pNode )
+{
+	CqParseNode* pArgs = pNode->pFirstChild();
+	CqParseNode* pHit = pArgs->pNext();
+	CqParseNode* pNoHit = pHit->pNext();
+
+	// The number of samples starts the loop.
+	CqParseNode* pSamples = pArgs->pFirstChild();
+	for ( TqInt i = 1; i < 5 && pSamples->pNext() != 0; ++i )
+		pSamples = pSamples->pNext();
+	bool fPure;
+	Expression( pSamples, true, fPure );
+
+	TqInt iLoop = BeginLoop( pNode );
+	TqInt iHeader = m_CurrentBlock;
+	FrozenChildren( pArgs );
+	// The values gathered are written to the variables passed.
+	TqInt iArg = 0;
+	for ( CqParseNode* pArg = pArgs->pFirstChild(); pArg != 0; pArg = pArg->pNext(), ++iArg )
+	{
+		if ( iArg >= 5 && IsBareVariable( pArg ) )
+		{
+			TqInt iVar = VariableIndex( static_cast<CqParseNodeVariable*>( pArg )->VarRef() );
+			if ( m_fFunction && m_aVariables[ iVar ].m_fShared )
+				ClobberShared();
+			Clobber( iVar );
+		}
+	}
+	TqInt iCond = NewValue( SsaOp_Opaque, Type_Float );
+	m_aLoops[ iLoop ].m_aControls.push_back( iCond );
+
+	m_aControls.push_back( iCond );
+	m_CurrentBlock = NewBlock( iHeader );
+	AddPred( m_CurrentBlock, iHeader );
+	Statement( pHit );
+	TqInt iHitEnd = m_CurrentBlock;
+	m_CurrentBlock = NewBlock( iHeader );
+	AddPred( m_CurrentBlock, iHeader );
+	Statement( pNoHit );
+	TqInt iNoHitEnd = m_CurrentBlock;
+	m_aControls.pop_back();
+
+	TqInt iLatch = NewBlock( iHeader, false );
+	AddPred( iLatch, iHitEnd );
+	AddPred( iLatch, iNoHitEnd );
+	m_aBlocks[ iLatch ].m_aControls.push_back( iCond );
+	SealBlock( iLatch );
+	m_aLoops[ iLoop ].m_Latch = iLatch;
+	AddPred( iHeader, iLatch );
+	m_aLoops[ iLoop ].m_Exit = NewBlock( iLatch, false );
+	AddPred( m_aLoops[ iLoop ].m_Exit, iLatch );
+	EndLoop( iLoop );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::LoopMod
+/// Add a break or continue.  The conditions it is under decide which points
+/// leave the loop, so they control the phis of the loop.
+
+void CqSsaForm::LoopMod( CqParseNode* pNode )
+{
+	TqUint depth = 1;
+	if ( pNode->pFirstChild() != 0 && pNode->pFirstChild()->NodeType() == IqParseNodeConstantFloat::m_ID )
+		depth = static_cast<TqUint>( static_cast<CqParseNodeFloatConst*>( pNode->pFirstChild() )->Value() );
+	if ( depth < 1 || depth > m_aBreakLoops.size() )
+		return ;
+
+	TqInt iLoop = m_aBreakLoops[ m_aBreakLoops.size() - depth ];
+	SqSsaLoop& loop = m_aLoops[ iLoop ];
+	for ( TqUint i = loop.m_ControlDepth; i < m_aControls.size(); ++i )
+		loop.m_aControls.push_back( m_aControls[ i ] );
+	if ( static_cast<CqParseNodeLoopMod*>( pNode )->modType() == LoopMod_Break )
+		AddPred( loop.m_Exit, m_CurrentBlock );
+	else
+		AddPred( loop.m_Latch, m_CurrentBlock );
+
+	// Nothing after it runs.
+	TqInt iBlock = NewBlock( m_CurrentBlock );
+	m_aBlocks[ iBlock ].m_fUnreachable = true;
+	m_CurrentBlock = iBlock;
+}
+
+
+void CqSsaForm::FrozenChildren( CqParseNode* pNode )
+{
+	for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		bool fPure;
+		Expression( pChild, true, fPure );
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::FoldConstants
+/// Work out which values are constant, repeating until nothing changes so
+/// that constants propagate through variables and phis.
+
+void CqSsaForm::FoldConstants()
+{
+	bool fChanged = true;
+	while ( fChanged )
+	{
+		fChanged = false;
+		for ( TqUint i = 0; i < m_aValues.size(); ++i )
+			if ( !m_aValues[ i ].m_fConst && m_aValues[ i ].m_Forward == -1 && Fold( i ) )
+				fChanged = true;
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Fold
+/// Fold a value if its operands are constant.  Only float arithmetic which
+/// the VM would do exactly the same way is folded.
+
+bool CqSsaForm::Fold( TqInt iValue )
+{
+	SqSsaValue& value = m_aValues[ iValue ];
+	std::vector<TqFloat> a;
+	bool fConst = !value.m_aOperands.empty();
+	for ( std::vector<TqInt>::iterator i = value.m_aOperands.begin(); i != value.m_aOperands.end(); ++i )
+	{
+		if ( *i < 0 || !m_aValues[ *i ].m_fConst )
+			fConst = false;
+		else
+			a.push_back( m_aValues[ *i ].m_Value );
+	}
+
+	switch ( value.m_Op )
+	{
+			case SsaOp_Copy:
+			if ( !fConst || m_aValues[ value.m_aOperands[ 0 ] ].m_Type != value.m_Type )
+				return ( false );
+			value.m_Value = m_aValues[ value.m_aOperands[ 0 ] ].m_Value;
+			value.m_strValue = m_aValues[ value.m_aOperands[ 0 ] ].m_strValue;
+			break;
+
+			case SsaOp_Phi:
+			{
+				if ( !fConst )
+					return ( false );
+				const SqSsaValue& first = m_aValues[ value.m_aOperands[ 0 ] ];
+				for ( std::vector<TqInt>::iterator i = value.m_aOperands.begin(); i != value.m_aOperands.end(); ++i )
+					if ( m_aValues[ *i ].m_Type != first.m_Type || m_aValues[ *i ].m_Value != first.m_Value ||
+					        m_aValues[ *i ].m_strValue != first.m_strValue )
+						return ( false );
+				value.m_Value = first.m_Value;
+				value.m_strValue = first.m_strValue;
+				break;
+			}
+
+			case SsaOp_Select:
+			{
+				TqInt iCond = value.m_aOperands[ 0 ];
+				if ( iCond < 0 || !m_aValues[ iCond ].m_fConst )
+					return ( false );
+				TqInt iChosen = value.m_aOperands[ m_aValues[ iCond ].m_Value != 0.0f ? 1 : 2 ];
+				if ( iChosen < 0 || !m_aValues[ iChosen ].m_fConst || m_aValues[ iChosen ].m_Type != value.m_Type )
+					return ( false );
+				value.m_Value = m_aValues[ iChosen ].m_Value;
+				value.m_strValue = m_aValues[ iChosen ].m_strValue;
+				break;
+			}
+
+			case SsaOp_Call:
+			{
+				if ( !fConst || value.m_Type != Type_Float )
+					return ( false );
+				for ( std::vector<TqInt>::iterator i = value.m_aOperands.begin(); i != value.m_aOperands.end(); ++i )
+					if ( m_aValues[ *i ].m_Type != Type_Float )
+						return ( false );
+				const CqString& name = value.m_strFunc;
+				if ( name == "addff" )
+					value.m_Value = a[ 0 ] + a[ 1 ];
+				else if ( name == "subff" )
+					value.m_Value = a[ 0 ] - a[ 1 ];
+				else if ( name == "mulff" )
+					value.m_Value = a[ 0 ] * a[ 1 ];
+				else if ( name == "divff" && a[ 1 ] != 0.0f )
+					value.m_Value = a[ 0 ] / a[ 1 ];
+				else if ( name == "negf" )
+					value.m_Value = -a[ 0 ];
+				else if ( name == "abs" )
+					value.m_Value = std::fabs( a[ 0 ] );
+				else if ( name == "floor" )
+					value.m_Value = std::floor( a[ 0 ] );
+				else if ( name == "ceil" )
+					value.m_Value = std::ceil( a[ 0 ] );
+				else if ( name == "min" && a.size() == 2 )
+					value.m_Value = std::min( a[ 0 ], a[ 1 ] );
+				else if ( name == "max" && a.size() == 2 )
+					value.m_Value = std::max( a[ 0 ], a[ 1 ] );
+				else if ( name == "clamp" )
+					value.m_Value = std::min( std::max( a[ 0 ], a[ 1 ] ), a[ 2 ] );
+				else
+					return ( false );
+				break;
+			}
+
+			case SsaOp_RelOp:
+			{
+				if ( !fConst || a.size() != 2 || m_aValues[ value.m_aOperands[ 0 ] ].m_Type != Type_Float ||
+				        m_aValues[ value.m_aOperands[ 1 ] ].m_Type != Type_Float )
+					return ( false );
+				// The VM compares the second operand with the first.
+				TqFloat x = a[ 1 ], y = a[ 0 ];
+				bool result;
+				switch ( value.m_SubOp )
+				{
+						case Op_EQ:
+						result = x == y;
+						break;
+						case Op_NE:
+						result = x != y;
+						break;
+						case Op_L:
+						result = x < y;
+						break;
+						case Op_G:
+						result = x > y;
+						break;
+						case Op_GE:
+						result = x >= y;
+						break;
+						case Op_LE:
+						result = x <= y;
+						break;
+						default:
+						return ( false );
+				}
+				value.m_Value = result ? 1.0f : 0.0f;
+				break;
+			}
+
+			case SsaOp_LogicalOp:
+			if ( !fConst || a.size() != 2 )
+				return ( false );
+			if ( value.m_SubOp == Op_LogAnd )
+				value.m_Value = ( a[ 0 ] != 0.0f && a[ 1 ] != 0.0f ) ? 1.0f : 0.0f;
+			else if ( value.m_SubOp == Op_LogOr )
+				value.m_Value = ( a[ 0 ] != 0.0f || a[ 1 ] != 0.0f ) ? 1.0f : 0.0f;
+			else
+				return ( false );
+			break;
+
+			case SsaOp_UnaryOp:
+			if ( !fConst || value.m_Type != Type_Float || m_aValues[ value.m_aOperands[ 0 ] ].m_Type != Type_Float )
+				return ( false );
+			if ( value.m_SubOp == Op_Plus )
+				value.m_Value = a[ 0 ];
+			else if ( value.m_SubOp == Op_Neg )
+				value.m_Value = -a[ 0 ];
+			else if ( value.m_SubOp == Op_LogicalNot )
+				value.m_Value = a[ 0 ] == 0.0f ? 1.0f : 0.0f;
+			else
+				return ( false );
+			break;
+
+			default:
+			return ( false );
+	}
+	value.m_fConst = true;
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::FindUniformValues
+/// Values start out uniform, and are made varying until nothing changes.
+/// A phi is varying if the condition deciding which way control came is
+/// varying, as different points then take different values.
+
+void CqSsaForm::FindUniformValues( const std::set<TqInt>& aDemoted )
+{
+	for ( std::vector<SqSsaValue>::iterator i = m_aValues.begin(); i != m_aValues.end(); ++i )
+		i->m_fUniform = true;
+
+	bool fChanged = true;
+	while ( fChanged )
+	{
+		fChanged = false;
+		for ( TqUint i = 0; i < m_aValues.size(); ++i )
+		{
+			SqSsaValue& value = m_aValues[ i ];
+			if ( !value.m_fUniform || value.m_Forward != -1 )
+				continue;
+
+			bool fUniform = true;
+			switch ( value.m_Op )
+			{
+					case SsaOp_Const:
+					case SsaOp_Undef:
+					break;
+					case SsaOp_Entry:
+					case SsaOp_Opaque:
+					fUniform = value.m_Var >= 0 && m_aVariables[ value.m_Var ].m_fUniform;
+					break;
+					case SsaOp_Select:
+					// The VM always merges into a varying result.
+					fUniform = false;
+					break;
+					case SsaOp_Phi:
+					case SsaOp_Copy:
+					if ( m_aVariables[ value.m_Var ].m_fUniform )
+						break;
+					if ( aDemoted.count( value.m_Var ) == 0 )
+					{
+						fUniform = false;
+						break;
+					}
+					if ( value.m_Op == SsaOp_Phi )
+					{
+						const std::vector<TqInt>& aControls = m_aBlocks[ value.m_Block ].m_aControls;
+						for ( std::vector<TqInt>::const_iterator j = aControls.begin(); j != aControls.end(); ++j )
+							if ( *j >= 0 && !m_aValues[ *j ].m_fUniform )
+								fUniform = false;
+					}
+					// Fall through to check the operands.
+					default:
+					for ( std::vector<TqInt>::iterator j = value.m_aOperands.begin(); j != value.m_aOperands.end(); ++j )
+						if ( *j >= 0 && !m_aValues[ *j ].m_fUniform )
+							fUniform = false;
+					break;
+			}
+			if ( !fUniform )
+			{
+				value.m_fUniform = false;
+				fChanged = true;
+			}
+		}
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::UniformVariables
+/// A private varying variable can be made uniform if every value assigned
+/// to it is uniform, and every merge of its values which is read is
+/// uniform.  Assuming all the candidates are made uniform, drop any which
+/// fail and try again.
+
+std::set<TqInt> CqSsaForm::UniformVariables()
+{
+	std::set<TqInt> aCandidates;
+	for ( TqUint i = 0; i < m_aVariables.size(); ++i )
+	{
+		const SqSsaVariable& var = m_aVariables[ i ];
+		if ( !var.m_fShared && !var.m_fArray && !var.m_fOpaqueDef && !var.m_fUniform )
+			aCandidates.insert( i );
+	}
+
+	while ( !aCandidates.empty() )
+	{
+		FindUniformValues( aCandidates );
+		std::vector<bool> aLive = LiveValues();
+		bool fRemoved = false;
+		for ( TqUint i = 0; i < m_aValues.size(); ++i )
+		{
+			const SqSsaValue& value = m_aValues[ i ];
+			if ( value.m_Forward != -1 || value.m_fUniform || aCandidates.count( value.m_Var ) == 0 )
+				continue;
+			if ( value.m_Op == SsaOp_Copy || ( value.m_Op == SsaOp_Phi && aLive[ i ] ) )
+			{
+				aCandidates.erase( value.m_Var );
+				fRemoved = true;
+			}
+		}
+		if ( !fRemoved )
+			break;
+	}
+	return ( aCandidates );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::LiveValues
+/// A value is live if it is read, or merged into a live phi.
+
+std::vector<bool> CqSsaForm::LiveValues() const
+{
+	std::vector<bool> aLive( m_aValues.size(), false );
+	std::vector<TqInt> aStack( m_aUses );
+	while ( !aStack.empty() )
+	{
+		TqInt iValue = Resolve( aStack.back() );
+		aStack.pop_back();
+		if ( iValue < 0 || aLive[ iValue ] )
+			continue;
+		aLive[ iValue ] = true;
+		if ( m_aValues[ iValue ].m_Op == SsaOp_Phi )
+			aStack.insert( aStack.end(), m_aValues[ iValue ].m_aOperands.begin(), m_aValues[ iValue ].m_aOperands.end() );
+	}
+	return ( aLive );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Dominates
+/// Whether a value is always computed before another.
+
+bool CqSsaForm::Dominates( TqInt iValue, TqInt iOther ) const
+{
+	TqInt iBlock = m_aValues[ iValue ].m_Block;
+	TqInt iOtherBlock = m_aValues[ iOther ].m_Block;
+	if ( iBlock == iOtherBlock )
+		return ( m_aValues[ iValue ].m_Seq < m_aValues[ iOther ].m_Seq );
+	for ( TqInt i = m_aBlocks[ iOtherBlock ].m_Idom; i != -1; i = m_aBlocks[ i ].m_Idom )
+		if ( i == iBlock )
+			return ( true );
+	return ( false );
+}
+
+
+bool CqSsaForm::InLoop( TqInt iBlock, TqInt iLoop ) const
+{
+	for ( TqInt i = m_aBlocks[ iBlock ].m_Loop; i != -1; i = m_aLoops[ i ].m_Parent )
+		if ( i == iLoop )
+			return ( true );
+	return ( false );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::Invariant
+/// A value is invariant in a loop if it is computed outside the loop, or
+/// is an operation whose operands are all invariant.  Variables assigned in
+/// the loop are not, as they would have their old value before it.
+
+bool CqSsaForm::Invariant( TqInt iValue, TqInt iLoop ) const
+{
+	if ( iValue < 0 )
+		return ( false );
+	const SqSsaValue& value = m_aValues[ iValue ];
+	if ( value.m_fConst || !InLoop( value.m_Block, iLoop ) )
+		return ( true );
+	switch ( value.m_Op )
+	{
+			case SsaOp_Call:
+			case SsaOp_Cast:
+			case SsaOp_Tuple:
+			case SsaOp_RelOp:
+			case SsaOp_LogicalOp:
+			case SsaOp_UnaryOp:
+			case SsaOp_Index:
+			case SsaOp_Select:
+			for ( std::vector<TqInt>::const_iterator i = value.m_aOperands.begin(); i != value.m_aOperands.end(); ++i )
+				if ( !Invariant( *i, iLoop ) )
+					return ( false );
+			return ( true );
+			default:
+			return ( false );
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::ValueNumbers
+/// Give values computed the same way from the same operands the same
+/// number.  A copy has the number of the value assigned.
+
+std::vector<TqInt> CqSsaForm::ValueNumbers() const
+{
+	std::map<TqValueKey, TqInt> aNumbers;
+	std::vector<TqInt> aResult( m_aValues.size(), -1 );
+	for ( TqUint i = 0; i < m_aValues.size(); ++i )
+		NumberValue( i, aNumbers, aResult );
+	return ( aResult );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaForm::NumberValue
+/// Number a value, numbering its operands first.  The values of variables
+/// on entry are made when they are first needed, so an operand may come
+/// after the value using it.  Phis aren't numbered through their operands,
+/// so this can't go round a loop.
+
+TqInt CqSsaForm::NumberValue( TqInt iValue, std::map<TqValueKey, TqInt>& aNumbers, std::vector<TqInt>& aResult ) const
+{
+	if ( aResult[ iValue ] >= 0 )
+		return ( aResult[ iValue ] );
+
+	const SqSsaValue& value = m_aValues[ iValue ];
+	if ( value.m_Forward != -1 )
+		return ( aResult[ iValue ] = NumberValue( Resolve( iValue ), aNumbers, aResult ) );
+
+	TqValueKey key;
+	key.second.push_back( value.m_Op );
+	key.second.push_back( value.m_Type );
+	switch ( value.m_Op )
+	{
+			case SsaOp_Const:
+			{
+				TqInt bits;
+				std::memcpy( &bits, &value.m_Value, sizeof( bits ) );
+				key.first = value.m_strValue;
+				key.second.push_back( bits );
+				break;
+			}
+			case SsaOp_Copy:
+			if ( value.m_aOperands[ 0 ] >= 0 )
+				return ( aResult[ iValue ] = NumberValue( value.m_aOperands[ 0 ], aNumbers, aResult ) );
+			// A value with an unknown operand is unique.
+			return ( aResult[ iValue ] = iValue );
+			case SsaOp_Call:
+			case SsaOp_Cast:
+			case SsaOp_Tuple:
+			case SsaOp_RelOp:
+			case SsaOp_LogicalOp:
+			case SsaOp_UnaryOp:
+			case SsaOp_Index:
+			case SsaOp_Select:
+			key.first = value.m_strFunc;
+			key.second.push_back( value.m_SubOp );
+			for ( std::vector<TqInt>::const_iterator i = value.m_aOperands.begin(); i != value.m_aOperands.end(); ++i )
+			{
+				if ( *i < 0 )
+					return ( aResult[ iValue ] = iValue );
+				key.second.push_back( NumberValue( *i, aNumbers, aResult ) );
+			}
+			break;
+			default:
+			return ( aResult[ iValue ] = iValue );
+	}
+
+	// A unique value is numbered by its index, and the others after them.
+	std::map<TqValueKey, TqInt>::iterator iNumber = aNumbers.find( key );
+	if ( iNumber == aNumbers.end() )
+		iNumber = aNumbers.insert( std::make_pair( key, TqInt( aResult.size() + aNumbers.size() ) ) ).first;
+	return ( aResult[ iValue ] = iNumber->second );
+}
+
+//---------------------------------------------------------------------
+
+} // namespace Aqsis
@@ -0,0 +1,336 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Static single assignment form of shader code, and the optimiser
+ * which uses it.
+ *
+ * The SSA form is built from the type checked parse tree of one piece of
+ * code: the body of a shader, the body of a local function, or the default
+ * value of a shader parameter.  Every expression node in the tree which is
+ * evaluated gets a value, and every assignment to a variable a new value, so
+ * that the analyses can follow values instead of variables.  The optimiser
+ * then makes its changes to the parse tree, which the backend outputs as
+ * before, and builds the SSA form again for the next pass.
+ */
+
+#ifndef SSA_H_INCLUDED
+#define SSA_H_INCLUDED 1
+
+#include	<map>
+#include	<set>
+#include	<string>
+#include	<vector>
+
+#include	<aqsis/aqsis.h>
+
+#include	"parsenode.h"
+
+namespace Aqsis {
+
+///----------------------------------------------------------------------
+/// EqSsaOp
+/// The ways in which a value in the SSA form can be defined.
+
+enum EqSsaOp
+{
+    SsaOp_Const,		///< A float or string constant.
+    SsaOp_Undef,		///< A local variable which hasn't been assigned yet.
+    SsaOp_Entry,		///< A variable which is set before the code runs.
+    SsaOp_Opaque,		///< Anything the optimiser doesn't understand, such as a texture lookup.
+    SsaOp_Phi,			///< The values of a variable merging where control flow joins.
+    SsaOp_Copy,			///< An assignment of a value to a variable.
+    SsaOp_Call,			///< A builtin function with no side effects.
+    SsaOp_Cast,			///< A type cast.
+    SsaOp_Tuple,		///< The components of a triple or matrix.
+    SsaOp_RelOp,		///< A comparison.
+    SsaOp_LogicalOp,	///< && or ||.
+    SsaOp_UnaryOp,		///< A unary operator.
+    SsaOp_Select,		///< The result of a ?: expression.
+    SsaOp_Index,		///< An element of an array.
+};
+
+
+///----------------------------------------------------------------------
+/// SqSsaValue
+/// A value in the SSA form.
+
+struct SqSsaValue
+{
+	EqSsaOp	m_Op;
+	/// The operator of an operation, the type cast to, or the VM name of a
+	/// builtin function.
+	TqInt	m_SubOp;
+	CqString	m_strFunc;
+	/// Type of the value, without storage class.
+	TqInt	m_Type;
+	std::vector<TqInt>	m_aOperands;
+	/// The variable defined by an undef, entry, phi, copy or opaque value.
+	TqInt	m_Var;
+	TqInt	m_Block;
+	/// Order in which the values are evaluated by the VM.
+	TqInt	m_Seq;
+	/// The expression node computing the value, if it can be rewritten.
+	CqParseNode*	m_pNode;
+	/// A trivial phi is forwarded to the value which it always has.
+	TqInt	m_Forward;
+	bool	m_fConst;
+	TqFloat	m_Value;
+	CqString	m_strValue;
+	bool	m_fUniform;
+};
+
+
+///----------------------------------------------------------------------
+/// SqSsaBlock
+/// A basic block of the control flow graph.
+
+struct SqSsaBlock
+{
+	std::vector<TqInt>	m_aPreds;
+	/// A block which dominates this one.  This is the immediate dominator
+	/// where the structure of the code makes it obvious, and otherwise a
+	/// dominator further up the tree.
+	TqInt	m_Idom;
+	/// Innermost loop containing the block.
+	TqInt	m_Loop;
+	/// Conditions deciding which predecessor control arrives from.  A phi
+	/// in the block is varying if any of them is.
+	std::vector<TqInt>	m_aControls;
+	bool	m_fSealed;
+	bool	m_fUnreachable;
+	std::map<TqInt, TqInt>	m_Defs;
+	std::map<TqInt, TqInt>	m_IncompletePhis;
+};
+
+
+///----------------------------------------------------------------------
+/// SqSsaLoop
+/// A loop, either a while or for loop, or one of the light and ray
+/// gathering constructs.
+
+struct SqSsaLoop
+{
+	/// The construct node, before which invariant code is hoisted.
+	CqParseNode*	m_pNode;
+	TqInt	m_Parent;
+	TqInt	m_Header;
+	TqInt	m_Latch;
+	TqInt	m_Exit;
+	/// Depth of the control stack outside the loop.
+	TqInt	m_ControlDepth;
+	std::vector<TqInt>	m_aControls;
+};
+
+
+///----------------------------------------------------------------------
+/// SqSsaVariable
+/// A variable referred to by the code.
+
+struct SqSsaVariable
+{
+	SqVarRef	m_Ref;
+	/// Whether the variable may be seen outside the code, or through
+	/// another name.  Assignments to private variables can be removed, and
+	/// their storage changed.
+	bool	m_fShared;
+	bool	m_fUniform;
+	bool	m_fArray;
+	/// Whether the variable is set by anything but an assignment.
+	bool	m_fOpaqueDef;
+	TqInt	m_Entry;
+};
+
+
+///----------------------------------------------------------------------
+/// CqSsaForm
+/// The SSA form of a piece of code.
+
+class CqSsaForm
+{
+	public:
+		/// Build the SSA form of a function or shader body.  fFunction is
+		/// true for the body of a local function, whose parameters may
+		/// refer to the same variable.  aShared holds the variables which
+		/// are seen outside the body.
+		CqSsaForm( CqParseNode* pBody, bool fFunction, const std::set<std::pair<TqInt, TqInt> >& aShared );
+
+		/// Work out which values are constant.
+		void	FoldConstants();
+		/// Work out which values are uniform, given the private variables
+		/// which are going to be made uniform.
+		void	FindUniformValues( const std::set<TqInt>& aDemoted );
+		/// Find the private varying variables which only ever hold uniform
+		/// values, so can be made uniform.
+		std::set<TqInt>	UniformVariables();
+		/// Find the values which may be read.  Assignments of other values
+		/// aren't needed.
+		std::vector<bool>	LiveValues() const;
+
+		/// Follow extern declarations to the variable they refer to.
+		static SqVarRef	CanonicalRef( SqVarRef ref );
+
+		TqInt	Resolve( TqInt iValue ) const;
+		bool	Dominates( TqInt iValue, TqInt iOther ) const;
+		bool	InLoop( TqInt iBlock, TqInt iLoop ) const;
+		/// Whether a value is computed outside a loop, or can be computed
+		/// there.
+		bool	Invariant( TqInt iValue, TqInt iLoop ) const;
+		/// Number the values so that two values with the same number are
+		/// always equal.
+		std::vector<TqInt>	ValueNumbers() const;
+
+		/// Find the value computed by an expression node, -1 if the node
+		/// can't be replaced.
+		TqInt	NodeValue( CqParseNode* pNode ) const
+		{
+			std::map<CqParseNode*, TqInt>::const_iterator i = m_NodeValues.find( pNode );
+			return ( i == m_NodeValues.end() ? -1 : i->second );
+		}
+		/// Find the value assigned by an assignment node, -1 if the
+		/// variable is shared.
+		TqInt	AssignedValue( CqParseNode* pNode ) const
+		{
+			std::map<CqParseNode*, TqInt>::const_iterator i = m_AssignValues.find( pNode );
+			return ( i == m_AssignValues.end() ? -1 : i->second );
+		}
+		const std::map<CqParseNode*, TqInt>&	NodeValues() const
+		{
+			return ( m_NodeValues );
+		}
+		/// Find the value of the condition of a conditional or loop.
+		TqInt	ConditionValue( CqParseNode* pNode ) const
+		{
+			std::map<CqParseNode*, TqInt>::const_iterator i = m_ConditionValues.find( pNode );
+			return ( i == m_ConditionValues.end() ? -1 : i->second );
+		}
+
+		std::vector<SqSsaValue>	m_aValues;
+		std::vector<SqSsaBlock>	m_aBlocks;
+		std::vector<SqSsaLoop>	m_aLoops;
+		std::vector<SqSsaVariable>	m_aVariables;
+
+	private:
+		/// The operation and operand numbers of a value, for numbering it.
+		typedef std::pair<std::string, std::vector<TqInt> > TqValueKey;
+
+		TqInt	NewValue( EqSsaOp op, TqInt type, TqInt iVar = -1 );
+		TqInt	NewBlock( TqInt iIdom, bool fSealed = true );
+		void	AddPred( TqInt iBlock, TqInt iPred );
+		void	SealBlock( TqInt iBlock );
+		TqInt	VariableIndex( SqVarRef ref );
+		void	FindVariables( CqParseNode* pNode );
+
+		void	WriteVariable( TqInt iVar, TqInt iBlock, TqInt iValue );
+		TqInt	ReadVariable( TqInt iVar, TqInt iBlock );
+		TqInt	ReadVariableRecursive( TqInt iVar, TqInt iBlock );
+		TqInt	AddPhiOperands( TqInt iVar, TqInt iPhi );
+		TqInt	RemoveTrivialPhi( TqInt iPhi );
+		void	RemoveTrivialPhis();
+
+		TqInt	Read( TqInt iVar );
+		TqInt	Assign( TqInt iVar, TqInt iValue );
+		void	Clobber( TqInt iVar );
+		void	ClobberShared();
+		void	ClobberLight();
+
+		void	Statement( CqParseNode* pNode );
+		TqInt	Expression( CqParseNode* pNode, bool fFrozen, bool& fPure );
+		TqInt	Call( CqParseNode* pNode, bool fFrozen, bool& fPure );
+		void	Conditional( CqParseNode* pCond, CqParseNode* pTrue, CqParseNode* pFalse, CqParseNode* pNode );
+		TqInt	QCond( CqParseNode* pNode, bool fFrozen, bool& fPure );
+		TqInt	BeginLoop( CqParseNode* pNode );
+		void	EndLoop( TqInt iLoop );
+		void	While( CqParseNode* pNode );
+		void	LightLoop( CqParseNode* pNode );
+		void	Gather( CqParseNode* pNode );
+		void	LoopMod( CqParseNode* pNode );
+		void	FrozenChildren( CqParseNode* pNode );
+		bool	Fold( TqInt iValue );
+		TqInt	NumberValue( TqInt iValue, std::map<TqValueKey, TqInt>& aNumbers, std::vector<TqInt>& aResult ) const;
+
+		bool	m_fFunction;
+		const std::set<std::pair<TqInt, TqInt> >&	m_aShared;
+		std::map<std::pair<TqInt, TqInt>, TqInt>	m_VariableIndices;
+		std::map<CqParseNode*, TqInt>	m_NodeValues;
+		std::map<CqParseNode*, TqInt>	m_AssignValues;
+		std::map<CqParseNode*, TqInt>	m_ConditionValues;
+		/// Values of variables which are read.
+		std::vector<TqInt>	m_aUses;
+		/// Conditions of the enclosing conditionals and loops.
+		std::vector<TqInt>	m_aControls;
+		/// While loops, which break and continue refer to.
+		std::vector<TqInt>	m_aBreakLoops;
+		TqInt	m_CurrentBlock;
+		TqInt	m_CurrentLoop;
+		TqInt	m_Seq;
+};
+
+
+///----------------------------------------------------------------------
+/// CqSsaOptimiser
+/// Optimiser for the parse tree of a shader, working on the SSA form of
+/// each piece of code in it.  Constant expressions are folded, branches
+/// which can't run removed, and assignments which are never read removed.
+/// Local variables which only hold uniform values are made uniform, so that
+/// everything computed from them is done once per grid rather than once per
+/// point, and loop invariant expressions are hoisted out of loops.  Finally
+/// common subexpressions are computed once and kept in a temporary.
+
+class CqSsaOptimiser
+{
+	public:
+		CqSsaOptimiser() : m_cTemporaries( 0 )
+		{}
+
+		/// Optimise the shader in the parse tree, and the local functions
+		/// it calls.
+		void	Optimise( CqParseNode* pTree );
+
+	private:
+		void	FindSharedVariables( CqParseNode* pTree );
+		void	OptimiseBody( CqParseNode* pBody, bool fFunction );
+		void	OptimiseDefault( CqParseNode* pDefault );
+
+		bool	FoldConstants( CqParseNode* pNode, const CqSsaForm& ssa );
+		bool	FoldNode( CqParseNode* pNode, const CqSsaForm& ssa );
+		bool	RemoveDeadAssignments( CqParseNode* pNode, const CqSsaForm& ssa, const std::vector<bool>& aLive );
+		void	DemoteVariables( CqSsaForm& ssa );
+		bool	HoistInvariants( CqSsaForm& ssa );
+		void	HoistFromLoop( CqParseNode* pNode, TqInt iLoop, CqSsaForm& ssa,
+		                       const std::vector<TqInt>& aNumbers, std::map<TqInt, SqVarRef>& aHoisted );
+		bool	EliminateCommonSubexpressions( CqSsaForm& ssa );
+		void	MarkRemoved( CqParseNode* pNode, std::set<CqParseNode*>& apRemoved );
+		bool	Movable( CqParseNode* pNode, const CqSsaForm& ssa ) const;
+
+		SqVarRef	NewTemporary( const SqSsaValue& value );
+		void	Discard( CqParseNode* pNode );
+		void	DeleteDiscarded();
+
+		std::set<std::pair<TqInt, TqInt> >	m_aShared;
+		std::vector<CqParseNode*>	m_apDiscarded;
+		TqInt	m_cTemporaries;
+};
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
+
+#endif	// !SSA_H_INCLUDED
@@ -0,0 +1,676 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief The optimisation passes, which use the SSA form to decide what to
+ * change, and make the changes to the parse tree.
+ */
+
+#include	"ssa.h"
+
+#include	<algorithm>
+#include	<sstream>
+
+#include	"funcdef.h"
+#include	"vardef.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Passes are repeated until nothing changes, up to this many times.
+const TqInt MaxRounds = 16;
+
+/// Put a node in the place of another in the tree.
+void ReplaceNode( CqParseNode* pOld, CqParseNode* pNew )
+{
+	pNew->UnLink();
+	pNew->LinkAfter( pOld );
+	pOld->UnLink();
+}
+
+/// Put a node in the tree just before another.
+void InsertBefore( CqParseNode* pNode, CqParseNode* pNew )
+{
+	pNew->UnLink();
+	if ( pNode->pPrevious() != 0 )
+		pNew->LinkAfter( pNode->pPrevious() );
+	else
+		static_cast<CqParseNode*>( pNode->pParent() )->AddFirstChild( pNew );
+}
+
+void DeleteTree( CqParseNode* pNode )
+{
+	CqParseNode* pChild = pNode->pFirstChild();
+	while ( pChild != 0 )
+	{
+		CqParseNode* pNext = pChild->pNext();
+		DeleteTree( pChild );
+		pChild = pNext;
+	}
+	delete( pNode );
+}
+
+/// An empty statement, to take the place of one which is removed.
+CqParseNode* EmptyNode( const CqParseNode* pFrom )
+{
+	CqParseNode* pEmpty = new CqParseNode();
+	pEmpty->SetPos( pFrom->LineNo(), pFrom->strFileName() );
+	return ( pEmpty );
+}
+
+/// Whether a statement does nothing.
+bool IsEmpty( const CqParseNode* pNode )
+{
+	if ( pNode == 0 )
+		return ( true );
+	if ( pNode->NodeType() != IqParseNode::m_ID )
+		return ( false );
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		if ( !IsEmpty( pChild ) )
+			return ( false );
+	return ( true );
+}
+
+/// Whether values of a type can be kept in a temporary variable.
+bool IsStorable( TqInt type )
+{
+	switch ( type & Type_Mask )
+	{
+			case Type_Float:
+			case Type_Point:
+			case Type_Color:
+			case Type_Vector:
+			case Type_Normal:
+			case Type_Matrix:
+			return ( true );
+			default:
+			return ( false );
+	}
+}
+
+bool IsSpatial( TqInt type )
+{
+	type &= Type_Mask;
+	return ( type == Type_Point || type == Type_Vector || type == Type_Normal );
+}
+
+bool IsLocalCall( const CqParseNode* pNode )
+{
+	return ( pNode != 0 && pNode->NodeType() == IqParseNodeFunctionCall::m_ID &&
+	         static_cast<const CqParseNodeFunctionCall*>( pNode )->pFuncDef()->fLocal() );
+}
+
+/// The number of instructions the backend outputs for an expression.
+TqInt Cost( const CqParseNode* pNode )
+{
+	TqInt cost = 0;
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		cost += Cost( pChild );
+
+	TqInt type = pNode->NodeType();
+	if ( type == IqParseNodeTriple::m_ID || type == IqParseNodeSixteenTuple::m_ID )
+		return ( cost );
+	if ( type == IqParseNodeTypeCast::m_ID )
+	{
+		TqInt from = pNode->pFirstChild()->ResType() & Type_Mask;
+		TqInt to = static_cast<const CqParseNodeCast*>( pNode )->CastTo() & Type_Mask;
+		return ( ( from == to || ( IsSpatial( from ) && IsSpatial( to ) ) ) ? cost : cost + 1 );
+	}
+	if ( type == IqParseNodeConditionalExpression::m_ID )
+		return ( cost + 6 );
+	if ( type == IqParseNodeFunctionCall::m_ID &&
+	        static_cast<const CqParseNodeFunctionCall*>( pNode )->pFuncDef()->VariableLength() >= 0 )
+		return ( cost + 2 );
+	return ( cost + 1 );
+}
+
+/// Add the variables referred to in a tree.
+void FindVariables( CqParseNode* pNode, std::set<std::pair<TqInt, TqInt> >& aVariables )
+{
+	TqInt type = pNode->NodeType();
+	SqVarRef ref;
+	bool fVariable = true;
+	if ( type == IqParseNodeVariable::m_ID || type == IqParseNodeArrayVariable::m_ID ||
+	        type == IqParseNodeVariableAssign::m_ID || type == IqParseNodeArrayVariableAssign::m_ID )
+		ref = static_cast<CqParseNodeVariable*>( pNode )->VarRef();
+	else if ( type == IqParseNodeMessagePassingFunction::m_ID )
+		ref = static_cast<CqParseNodeCommFunction*>( pNode )->VarRef();
+	else
+		fVariable = false;
+	if ( fVariable )
+	{
+		ref = CqSsaForm::CanonicalRef( ref );
+		aVariables.insert( std::make_pair( static_cast<TqInt>( ref.m_Type ), static_cast<TqInt>( ref.m_Index ) ) );
+	}
+	for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		FindVariables( pChild, aVariables );
+}
+
+/// Find the shaders in the parse tree.
+void FindShaders( CqParseNode* pNode, std::vector<CqParseNode*>& apShaders )
+{
+	if ( pNode->NodeType() == IqParseNodeShader::m_ID )
+	{
+		apShaders.push_back( pNode );
+		return ;
+	}
+	for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		FindShaders( pChild, apShaders );
+}
+
+} // unnamed namespace
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::Optimise
+
+void CqSsaOptimiser::Optimise( CqParseNode* pTree )
+{
+	if ( pTree == 0 )
+		return ;
+	FindSharedVariables( pTree );
+
+	for ( TqUint i = 0; i < gLocalFuncs.size(); ++i )
+		if ( gLocalFuncs[ i ].pDefNode() != 0 )
+			OptimiseBody( gLocalFuncs[ i ].pDefNode(), true );
+
+	std::vector<CqParseNode*> apShaders;
+	FindShaders( pTree, apShaders );
+	for ( std::vector<CqParseNode*>::iterator i = apShaders.begin(); i != apShaders.end(); ++i )
+		if ( ( *i )->pFirstChild() != 0 )
+			OptimiseBody( ( *i )->pFirstChild(), false );
+
+	// Temporaries are added as this goes, so the variables are indexed.
+	for ( TqUint i = 0; i < gLocalVars.size(); ++i )
+		if ( ( gLocalVars[ i ].Type() & Type_Param ) && gLocalVars[ i ].pDefValue() != 0 )
+			OptimiseDefault( gLocalVars[ i ].pDefValue() );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::FindSharedVariables
+/// Find the variables which can be seen outside the code using them:
+/// shader parameters, local function parameters, which refer to the
+/// arguments, variables declared extern, and variables used by more than
+/// one piece of code.  Standard variables are always shared.
+
+void CqSsaOptimiser::FindSharedVariables( CqParseNode* pTree )
+{
+	m_aShared.clear();
+	for ( TqUint i = 0; i < gLocalVars.size(); ++i )
+	{
+		if ( gLocalVars[ i ].fExtern() )
+		{
+			SqVarRef ref = CqSsaForm::CanonicalRef( gLocalVars[ i ].vrExtern() );
+			m_aShared.insert( std::make_pair( static_cast<TqInt>( ref.m_Type ), static_cast<TqInt>( ref.m_Index ) ) );
+		}
+		else if ( gLocalVars[ i ].Type() & ( Type_Param | Type_Output ) )
+			m_aShared.insert( std::make_pair( static_cast<TqInt>( VarTypeLocal ), static_cast<TqInt>( i ) ) );
+	}
+
+	std::vector<CqParseNode*> apBodies;
+	for ( TqUint i = 0; i < gLocalFuncs.size(); ++i )
+	{
+		if ( gLocalFuncs[ i ].pArgs() != 0 )
+			FindVariables( gLocalFuncs[ i ].pArgs(), m_aShared );
+		if ( gLocalFuncs[ i ].pDefNode() != 0 )
+			apBodies.push_back( gLocalFuncs[ i ].pDefNode() );
+	}
+	std::vector<CqParseNode*> apShaders;
+	FindShaders( pTree, apShaders );
+	for ( std::vector<CqParseNode*>::iterator i = apShaders.begin(); i != apShaders.end(); ++i )
+		if ( ( *i )->pFirstChild() != 0 )
+			apBodies.push_back( ( *i )->pFirstChild() );
+	for ( TqUint i = 0; i < gLocalVars.size(); ++i )
+		if ( gLocalVars[ i ].pDefValue() != 0 )
+			apBodies.push_back( gLocalVars[ i ].pDefValue() );
+
+	std::map<std::pair<TqInt, TqInt>, TqInt> aCounts;
+	for ( std::vector<CqParseNode*>::iterator i = apBodies.begin(); i != apBodies.end(); ++i )
+	{
+		std::set<std::pair<TqInt, TqInt> > aVariables;
+		FindVariables( *i, aVariables );
+		for ( std::set<std::pair<TqInt, TqInt> >::iterator j = aVariables.begin(); j != aVariables.end(); ++j )
+			if ( ++aCounts[ *j ] > 1 )
+				m_aShared.insert( *j );
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::OptimiseBody
+/// Optimise a shader or function body.  The SSA form is rebuilt after each
+/// change to the tree.
+
+void CqSsaOptimiser::OptimiseBody( CqParseNode* pBody, bool fFunction )
+{
+	// Fold constants and remove dead code until there is no more to do, as
+	// each can expose more of the other.
+	for ( TqInt i = 0; i < MaxRounds; ++i )
+	{
+		CqSsaForm ssa( pBody, fFunction, m_aShared );
+		ssa.FoldConstants();
+		bool fChanged = FoldConstants( pBody, ssa );
+		if ( !fChanged )
+			fChanged = RemoveDeadAssignments( pBody, ssa, ssa.LiveValues() );
+		DeleteDiscarded();
+		if ( !fChanged )
+			break;
+	}
+
+	{
+		CqSsaForm ssa( pBody, fFunction, m_aShared );
+		DemoteVariables( ssa );
+	}
+
+	for ( TqInt i = 0; i < MaxRounds; ++i )
+	{
+		CqSsaForm ssa( pBody, fFunction, m_aShared );
+		ssa.FindUniformValues( std::set<TqInt>() );
+		bool fChanged = HoistInvariants( ssa );
+		DeleteDiscarded();
+		if ( !fChanged )
+			break;
+	}
+
+	CqSsaForm ssa( pBody, fFunction, m_aShared );
+	ssa.FindUniformValues( std::set<TqInt>() );
+	EliminateCommonSubexpressions( ssa );
+	DeleteDiscarded();
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::OptimiseDefault
+/// Optimise the default value of a shader parameter.  This is only run
+/// once, so only constants are folded.
+
+void CqSsaOptimiser::OptimiseDefault( CqParseNode* pDefault )
+{
+	CqSsaForm ssa( pDefault, false, m_aShared );
+	ssa.FoldConstants();
+	FoldConstants( pDefault, ssa );
+	DeleteDiscarded();
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::FoldConstants
+/// Replace the constant expressions under a node by their values, and
+/// conditionals with a constant condition by the branch taken.
+
+bool CqSsaOptimiser::FoldConstants( CqParseNode* pNode, const CqSsaForm& ssa )
+{
+	bool fChanged = false;
+	CqParseNode* pChild = pNode->pFirstChild();
+	while ( pChild != 0 )
+	{
+		CqParseNode* pNext = pChild->pNext();
+		if ( FoldNode( pChild, ssa ) )
+			fChanged = true;
+		pChild = pNext;
+	}
+	return ( fChanged );
+}
+
+
+bool CqSsaOptimiser::FoldNode( CqParseNode* pNode, const CqSsaForm& ssa )
+{
+	TqInt type = pNode->NodeType();
+	TqInt iValue = ssa.NodeValue( pNode );
+	if ( iValue >= 0 && type != IqParseNodeConstantFloat::m_ID )
+	{
+		const SqSsaValue& value = ssa.m_aValues[ iValue ];
+		if ( value.m_fConst && value.m_Type == Type_Float && ( pNode->ResType() & Type_Mask ) == Type_Float )
+		{
+			CqParseNode* pConst = new CqParseNodeFloatConst( value.m_Value );
+			pConst->SetPos( pNode->LineNo(), pNode->strFileName() );
+			ReplaceNode( pNode, pConst );
+			Discard( pNode );
+			return ( true );
+		}
+	}
+
+	// Only a condition with no side effects can be left out.
+	TqInt iCond = ssa.ConditionValue( pNode );
+	bool fConstCond = iCond >= 0 && ssa.m_aValues[ iCond ].m_fConst &&
+	                  ssa.NodeValue( pNode->pFirstChild() ) >= 0;
+	if ( fConstCond && pNode->pParent() != 0 )
+	{
+		bool fTrue = ssa.m_aValues[ iCond ].m_Value != 0.0f;
+		CqParseNode* pChosen = 0;
+		if ( type == IqParseNodeConditional::m_ID || type == IqParseNodeConditionalExpression::m_ID )
+		{
+			CqParseNode* pTrue = pNode->pFirstChild()->pNext();
+			pChosen = fTrue ? pTrue : pTrue->pNext();
+		}
+		else if ( type != IqParseNodeWhileConstruct::m_ID || fTrue )
+			pChosen = pNode;
+		if ( pChosen != pNode )
+		{
+			if ( pChosen == 0 )
+				pChosen = EmptyNode( pNode );
+			ReplaceNode( pNode, pChosen );
+			Discard( pNode );
+			FoldNode( pChosen, ssa );
+			return ( true );
+		}
+	}
+
+	return ( FoldConstants( pNode, ssa ) );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::RemoveDeadAssignments
+/// Remove assignments to private variables which are never read.  The
+/// value assigned is still computed if it has side effects.  An if which
+/// is left with nothing to do goes too.
+
+bool CqSsaOptimiser::RemoveDeadAssignments( CqParseNode* pNode, const CqSsaForm& ssa, const std::vector<bool>& aLive )
+{
+	bool fChanged = false;
+	CqParseNode* pChild = pNode->pFirstChild();
+	while ( pChild != 0 )
+	{
+		CqParseNode* pNext = pChild->pNext();
+		TqInt iCopy = ssa.AssignedValue( pChild );
+		if ( iCopy >= 0 && !aLive[ iCopy ] && pChild->NodeType() == IqParseNodeVariableAssign::m_ID )
+		{
+			const SqSsaVariable& var = ssa.m_aVariables[ ssa.m_aValues[ iCopy ].m_Var ];
+			if ( !var.m_fShared && !var.m_fArray )
+			{
+				CqParseNode* pRhs = pChild->pFirstChild();
+				if ( !static_cast<CqParseNodeAssign*>( pChild )->fDiscardResult() )
+					ReplaceNode( pChild, pRhs );
+				else if ( ssa.NodeValue( pRhs ) >= 0 )
+					ReplaceNode( pChild, EmptyNode( pChild ) );
+				else
+				{
+					CqParseNode* pDrop = new CqParseNodeDrop();
+					pDrop->SetPos( pChild->LineNo(), pChild->strFileName() );
+					ReplaceNode( pChild, pDrop );
+					pDrop->AddLastChild( pRhs );
+				}
+				Discard( pChild );
+				// Anything under it is looked at on the next pass.
+				fChanged = true;
+				pChild = pNext;
+				continue;
+			}
+		}
+		if ( pChild->NodeType() == IqParseNodeConditional::m_ID && ssa.NodeValue( pChild->pFirstChild() ) >= 0 )
+		{
+			CqParseNode* pTrue = pChild->pFirstChild()->pNext();
+			if ( IsEmpty( pTrue ) && IsEmpty( pTrue->pNext() ) )
+			{
+				ReplaceNode( pChild, EmptyNode( pChild ) );
+				Discard( pChild );
+				fChanged = true;
+				pChild = pNext;
+				continue;
+			}
+		}
+		if ( RemoveDeadAssignments( pChild, ssa, aLive ) )
+			fChanged = true;
+		pChild = pNext;
+	}
+	return ( fChanged );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::DemoteVariables
+/// Make private variables which only ever hold uniform values uniform.
+/// The VM then computes everything done with them once per grid.
+
+void CqSsaOptimiser::DemoteVariables( CqSsaForm& ssa )
+{
+	std::set<TqInt> aUniform = ssa.UniformVariables();
+	for ( std::set<TqInt>::iterator i = aUniform.begin(); i != aUniform.end(); ++i )
+	{
+		CqVarDef* pDef = CqVarDef::GetVariablePtr( ssa.m_aVariables[ *i ].m_Ref );
+		pDef->SetType( ( pDef->Type() & ~Type_Varying ) | Type_Uniform );
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::Movable
+/// Whether the expression at a node can be computed elsewhere and kept in a
+/// temporary.  The argument of a local function can't be replaced by a
+/// variable, as it would then be passed by reference.
+
+bool CqSsaOptimiser::Movable( CqParseNode* pNode, const CqSsaForm& ssa ) const
+{
+	TqInt iValue = ssa.NodeValue( pNode );
+	if ( iValue < 0 )
+		return ( false );
+	const SqSsaValue& value = ssa.m_aValues[ iValue ];
+	return ( value.m_pNode == pNode && !value.m_fConst && IsStorable( value.m_Type ) &&
+	         IsStorable( pNode->ResType() ) && Cost( pNode ) >= 2 &&
+	         !IsLocalCall( static_cast<CqParseNode*>( pNode->pParent() ) ) );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::HoistInvariants
+/// Move expressions which have the same value on every pass of a loop out
+/// in front of it.  Outer loops are done first, so that an expression is
+/// moved as far out as it can go.
+
+bool CqSsaOptimiser::HoistInvariants( CqSsaForm& ssa )
+{
+	std::vector<TqInt> aNumbers = ssa.ValueNumbers();
+	bool fChanged = false;
+	for ( TqUint i = 0; i < ssa.m_aLoops.size(); ++i )
+	{
+		// The body of illuminate or solar runs once for each point lit, so
+		// nothing is gained by moving code out of it.
+		CqParseNode* pLoop = ssa.m_aLoops[ i ].m_pNode;
+		if ( pLoop->pParent() == 0 ||
+		        pLoop->NodeType() == IqParseNodeIlluminateConstruct::m_ID ||
+		        pLoop->NodeType() == IqParseNodeSolarConstruct::m_ID )
+			continue;
+		std::map<TqInt, SqVarRef> aHoisted;
+		HoistFromLoop( pLoop, i, ssa, aNumbers, aHoisted );
+		if ( !aHoisted.empty() )
+			fChanged = true;
+	}
+	return ( fChanged );
+}
+
+
+void CqSsaOptimiser::HoistFromLoop( CqParseNode* pNode, TqInt iLoop, CqSsaForm& ssa,
+                                    const std::vector<TqInt>& aNumbers, std::map<TqInt, SqVarRef>& aHoisted )
+{
+	CqParseNode* pChild = pNode->pFirstChild();
+	while ( pChild != 0 )
+	{
+		CqParseNode* pNext = pChild->pNext();
+		TqInt iValue = ssa.NodeValue( pChild );
+		if ( !Movable( pChild, ssa ) || !ssa.Invariant( iValue, iLoop ) )
+		{
+			HoistFromLoop( pChild, iLoop, ssa, aNumbers, aHoisted );
+			pChild = pNext;
+			continue;
+		}
+
+		CqParseNodeVariable* pRead;
+		std::map<TqInt, SqVarRef>::iterator iHoisted = aHoisted.find( aNumbers[ iValue ] );
+		if ( iHoisted != aHoisted.end() )
+		{
+			pRead = new CqParseNodeVariable( iHoisted->second );
+			ReplaceNode( pChild, pRead );
+			Discard( pChild );
+		}
+		else
+		{
+			SqVarRef temp = NewTemporary( ssa.m_aValues[ iValue ] );
+			aHoisted[ aNumbers[ iValue ] ] = temp;
+			pRead = new CqParseNodeVariable( temp );
+			ReplaceNode( pChild, pRead );
+
+			// A loop which is a statement on its own, such as the body of an
+			// if, is put in a block with the code hoisted out of it.
+			CqParseNode* pLoop = ssa.m_aLoops[ iLoop ].m_pNode;
+			CqParseNode* pParent = static_cast<CqParseNode*>( pLoop->pParent() );
+			if ( pParent->NodeType() != IqParseNode::m_ID )
+			{
+				CqParseNode* pBlock = EmptyNode( pLoop );
+				ReplaceNode( pLoop, pBlock );
+				pBlock->AddLastChild( pLoop );
+			}
+			CqParseNodeAssign* pAssign = new CqParseNodeAssign( temp );
+			pAssign->SetPos( pChild->LineNo(), pChild->strFileName() );
+			pAssign->NoDup();
+			pAssign->AddLastChild( pChild );
+			InsertBefore( pLoop, pAssign );
+		}
+		pRead->SetPos( pChild->LineNo(), pChild->strFileName() );
+		pChild = pNext;
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::EliminateCommonSubexpressions
+/// Find expressions with the same value, where one is always computed
+/// before the others.  The first is kept in a temporary as it is computed,
+/// and the others read the temporary.  Bigger expressions are done first,
+/// so that their parts aren't kept needlessly.
+
+bool CqSsaOptimiser::EliminateCommonSubexpressions( CqSsaForm& ssa )
+{
+	std::vector<TqInt> aNumbers = ssa.ValueNumbers();
+	std::map<TqInt, std::vector<CqParseNode*> > aClasses;
+	// Walk the tree in the order the nodes are evaluated.
+	std::vector<std::pair<TqInt, CqParseNode*> > apNodes;
+	for ( std::map<CqParseNode*, TqInt>::const_iterator i = ssa.NodeValues().begin(); i != ssa.NodeValues().end(); ++i )
+		if ( Movable( i->first, ssa ) )
+			apNodes.push_back( std::make_pair( ssa.m_aValues[ i->second ].m_Seq, i->first ) );
+	std::sort( apNodes.begin(), apNodes.end() );
+	for ( std::vector<std::pair<TqInt, CqParseNode*> >::iterator i = apNodes.begin(); i != apNodes.end(); ++i )
+		aClasses[ aNumbers[ ssa.NodeValue( i->second ) ] ].push_back( i->second );
+
+	std::vector<std::pair<TqInt, TqInt> > aOrder;
+	for ( std::map<TqInt, std::vector<CqParseNode*> >::iterator i = aClasses.begin(); i != aClasses.end(); ++i )
+		if ( i->second.size() > 1 )
+			aOrder.push_back( std::make_pair( -Cost( i->second.front() ), i->first ) );
+	std::sort( aOrder.begin(), aOrder.end() );
+
+	std::set<CqParseNode*> apRemoved;
+	bool fChanged = false;
+	for ( std::vector<std::pair<TqInt, TqInt> >::iterator iClass = aOrder.begin(); iClass != aOrder.end(); ++iClass )
+	{
+		// Group the expressions under the first which is computed before
+		// each.
+		std::vector<std::vector<CqParseNode*> > aGroups;
+		const std::vector<CqParseNode*>& apMembers = aClasses[ iClass->second ];
+		for ( std::vector<CqParseNode*>::const_iterator i = apMembers.begin(); i != apMembers.end(); ++i )
+		{
+			if ( apRemoved.count( *i ) )
+				continue;
+			std::vector<std::vector<CqParseNode*> >::iterator iGroup;
+			for ( iGroup = aGroups.begin(); iGroup != aGroups.end(); ++iGroup )
+				if ( ssa.Dominates( ssa.NodeValue( iGroup->front() ), ssa.NodeValue( *i ) ) )
+					break;
+			if ( iGroup != aGroups.end() )
+				iGroup->push_back( *i );
+			else
+				aGroups.push_back( std::vector<CqParseNode*>( 1, *i ) );
+		}
+
+		for ( std::vector<std::vector<CqParseNode*> >::iterator iGroup = aGroups.begin(); iGroup != aGroups.end(); ++iGroup )
+		{
+			// Each expression replaced saves all but the one instruction
+			// reading the temporary, and keeping the first costs two.
+			TqInt saving = ( iGroup->size() - 1 ) * ( -iClass->first - 1 ) - 2;
+			if ( saving <= 0 )
+				continue;
+
+			CqParseNode* pFirst = iGroup->front();
+			SqVarRef temp = NewTemporary( ssa.m_aValues[ ssa.NodeValue( pFirst ) ] );
+			CqParseNodeAssign* pAssign = new CqParseNodeAssign( temp );
+			pAssign->SetPos( pFirst->LineNo(), pFirst->strFileName() );
+			ReplaceNode( pFirst, pAssign );
+			pAssign->AddLastChild( pFirst );
+
+			for ( std::vector<CqParseNode*>::iterator i = iGroup->begin() + 1; i != iGroup->end(); ++i )
+			{
+				CqParseNode* pRead = new CqParseNodeVariable( temp );
+				pRead->SetPos( ( *i )->LineNo(), ( *i )->strFileName() );
+				ReplaceNode( *i, pRead );
+				MarkRemoved( *i, apRemoved );
+				Discard( *i );
+			}
+			fChanged = true;
+		}
+	}
+	return ( fChanged );
+}
+
+
+void CqSsaOptimiser::MarkRemoved( CqParseNode* pNode, std::set<CqParseNode*>& apRemoved )
+{
+	apRemoved.insert( pNode );
+	for ( CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		MarkRemoved( pChild, apRemoved );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::NewTemporary
+/// Add a variable to hold a value, uniform if the value is.
+
+SqVarRef CqSsaOptimiser::NewTemporary( const SqSsaValue& value )
+{
+	std::ostringstream strName;
+	strName << "_opt$" << m_cTemporaries++;
+	CqVarDef def( value.m_Type | ( value.m_fUniform ? Type_Uniform : Type_Varying ), strName.str().c_str() );
+	SqVarRef ref;
+	ref.m_Type = VarTypeLocal;
+	ref.m_Index = CqVarDef::AddVariable( def );
+	return ( ref );
+}
+
+
+///---------------------------------------------------------------------
+/// CqSsaOptimiser::Discard
+/// Nodes taken out of the tree are deleted once the SSA form which refers
+/// to them is finished with.
+
+void CqSsaOptimiser::Discard( CqParseNode* pNode )
+{
+	m_apDiscarded.push_back( pNode );
+}
+
+
+void CqSsaOptimiser::DeleteDiscarded()
+{
+	for ( std::vector<CqParseNode*>::iterator i = m_apDiscarded.begin(); i != m_apDiscarded.end(); ++i )
+		DeleteTree( *i );
+	m_apDiscarded.clear();
+}
+
+//---------------------------------------------------------------------
+
+} // namespace Aqsis
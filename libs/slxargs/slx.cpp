@@ -671,7 +671,7 @@ static RtInt GetCurrentShaderInfo( char * name, char * filePath )
 	int theNArgs;
 	SLX_TYPE theShaderType;
 
-	std::ifstream slxFile(filePath);
+	std::ifstream slxFile(filePath, std::ios::in | std::ios::binary);
 	result = RIE_NOERROR;
 	theNArgs = 0;
 
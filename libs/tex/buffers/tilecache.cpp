@@ -0,0 +1,389 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Texture tile cache implementation.
+ */
+
+#include <aqsis/tex/buffers/tilecache.h>
+
+#include <list>
+#include <map>
+#include <utility>
+
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
+
+namespace Aqsis {
+
+namespace {
+
+/// Number of independently locked stripes in a tile cache.
+const TqInt numStripes = 16;
+
+} // unnamed namespace
+
+#ifdef ENABLE_THREADING
+#	define AQSIS_LOCK_STRIPE(s) boost::mutex::scoped_lock lock((s).mutex)
+#	define AQSIS_LOCK_BUDGET boost::mutex::scoped_lock lock(m_mutex)
+#else
+#	define AQSIS_LOCK_STRIPE(s)
+#	define AQSIS_LOCK_BUDGET
+#endif
+
+//------------------------------------------------------------------------------
+// SqTileCacheStats
+
+SqTileCacheStats::SqTileCacheStats()
+	: hits(0),
+	misses(0),
+	evictions(0),
+	bytes(0)
+{ }
+
+//------------------------------------------------------------------------------
+/** \brief Memory accounting shared by the stripes of a CqTileCache.
+ *
+ * The budget lock is only ever taken last, so it may be taken while holding
+ * a stripe lock.
+ */
+class CqTileCache::CqBudget
+{
+	public:
+		CqBudget()
+			: m_bytes(0),
+			m_maxBytes(0),
+			m_nextStripe(0)
+		{ }
+
+		/// Account for memory added to or removed from a stripe.
+		void add(std::size_t bytes)
+		{
+			AQSIS_LOCK_BUDGET;
+			m_bytes += bytes;
+		}
+		void remove(std::size_t bytes)
+		{
+			AQSIS_LOCK_BUDGET;
+			m_bytes -= bytes;
+		}
+		/// Return true if the cache holds more memory than the limit.
+		bool overLimit()
+		{
+			AQSIS_LOCK_BUDGET;
+			return m_bytes > m_maxBytes;
+		}
+		/// Get the share of the memory limit for one stripe.
+		std::size_t share()
+		{
+			AQSIS_LOCK_BUDGET;
+			return m_maxBytes/numStripes;
+		}
+		std::size_t maxBytes()
+		{
+			AQSIS_LOCK_BUDGET;
+			return m_maxBytes;
+		}
+		void setMaxBytes(std::size_t maxBytes)
+		{
+			AQSIS_LOCK_BUDGET;
+			m_maxBytes = maxBytes;
+		}
+		/// Get the next stripe to look for tiles to evict in, round robin.
+		TqInt nextStripe()
+		{
+			AQSIS_LOCK_BUDGET;
+			TqInt stripe = m_nextStripe;
+			m_nextStripe = (m_nextStripe + 1) % numStripes;
+			return stripe;
+		}
+
+	private:
+#ifdef ENABLE_THREADING
+		boost::mutex m_mutex;
+#endif
+		/// Memory held by tiles in all stripes.
+		std::size_t m_bytes;
+		/// Limit on the memory held by tiles.
+		std::size_t m_maxBytes;
+		/// Stripe to start from when evicting for the cache as a whole.
+		TqInt m_nextStripe;
+};
+
+//------------------------------------------------------------------------------
+/// One stripe of a CqTileCache, holding tiles in least recently used order.
+class CqTileCache::CqStripe
+{
+	public:
+		typedef std::pair<TqUlong, TqInt> TqKey;
+		struct SqEntry
+		{
+			TqKey key;
+			TqTilePtr tile;
+			std::size_t bytes;
+		};
+		typedef std::list<SqEntry> TqEntryList;
+
+		CqStripe()
+			: lru(),
+			entries(),
+			bytes(0),
+			budget(0),
+			stats()
+		{ }
+
+		/// Move an entry to the most recently used end of the list.
+		void touch(TqEntryList::iterator entry)
+		{
+			lru.splice(lru.begin(), lru, entry);
+		}
+		/// Add an entry as the most recently used.
+		void add(const SqEntry& entry)
+		{
+			lru.push_front(entry);
+			entries[entry.key] = lru.begin();
+			bytes += entry.bytes;
+			budget->add(entry.bytes);
+		}
+		/// Remove an entry from the stripe.
+		void remove(TqEntryList::iterator entry)
+		{
+			bytes -= entry->bytes;
+			budget->remove(entry->bytes);
+			entries.erase(entry->key);
+			lru.erase(entry);
+		}
+		/// Remove all entries from the stripe.
+		void removeAll()
+		{
+			budget->remove(bytes);
+			bytes = 0;
+			lru.clear();
+			entries.clear();
+		}
+		/// Evict least recently used entries while the cache is over its
+		/// memory limit and the stripe holds more than its share, always
+		/// keeping the most recent entry.
+		void shrink()
+		{
+			std::size_t share = budget->share();
+			while(bytes > share && lru.size() > 1 && budget->overLimit())
+			{
+				remove(--lru.end());
+				++stats.evictions;
+			}
+		}
+
+#ifdef ENABLE_THREADING
+		boost::mutex mutex;
+		/// Lock for reading from files which hash to this stripe.
+		boost::mutex fileMutex;
+#endif
+		/// Entries, with the most recently used at the front.
+		TqEntryList lru;
+		/// Map from tile keys to their entries in lru.
+		std::map<TqKey, TqEntryList::iterator> entries;
+		/// Memory held by tiles in this stripe.
+		std::size_t bytes;
+		/// Memory accounting for the whole cache.
+		CqBudget* budget;
+		/// Statistics for this stripe.
+		SqTileCacheStats stats;
+};
+
+
+//------------------------------------------------------------------------------
+// CqTileCache
+
+CqTileCache::CqTileCache(std::size_t maxBytes)
+	: m_budget(new CqBudget()),
+	m_nextArrayId(0),
+	m_stripes(new CqStripe[numStripes])
+{
+	for(TqInt i = 0; i < numStripes; ++i)
+		m_stripes[i].budget = m_budget.get();
+	setMaxBytes(maxBytes);
+}
+
+CqTileCache::~CqTileCache()
+{ }
+
+CqTileCache& CqTileCache::globalCache()
+{
+	static CqTileCache cache;
+	return cache;
+}
+
+TqUlong CqTileCache::newArrayId()
+{
+	// Ids are handed out under the lock for the first stripe.
+	AQSIS_LOCK_STRIPE(m_stripes[0]);
+	return m_nextArrayId++;
+}
+
+CqTileCache::TqTilePtr CqTileCache::find(TqUlong arrayId, TqInt index)
+{
+	CqStripe& s = stripe(arrayId, index);
+	AQSIS_LOCK_STRIPE(s);
+	std::map<CqStripe::TqKey, CqStripe::TqEntryList::iterator>::iterator
+		pos = s.entries.find(CqStripe::TqKey(arrayId, index));
+	if(pos == s.entries.end())
+	{
+		++s.stats.misses;
+		return TqTilePtr();
+	}
+	++s.stats.hits;
+	s.touch(pos->second);
+	return pos->second->tile;
+}
+
+CqTileCache::TqTilePtr CqTileCache::insert(TqUlong arrayId, TqInt index,
+		const TqTilePtr& tile, std::size_t bytes)
+{
+	{
+		CqStripe& s = stripe(arrayId, index);
+		AQSIS_LOCK_STRIPE(s);
+		CqStripe::TqKey key(arrayId, index);
+		std::map<CqStripe::TqKey, CqStripe::TqEntryList::iterator>::iterator
+			pos = s.entries.find(key);
+		if(pos != s.entries.end())
+		{
+			// Another thread read the same tile first.
+			s.touch(pos->second);
+			return pos->second->tile;
+		}
+		CqStripe::SqEntry entry;
+		entry.key = key;
+		entry.tile = tile;
+		entry.bytes = bytes;
+		s.add(entry);
+		// Make room in the stripe the tile went to first.
+		s.shrink();
+	}
+	// If that stripe is within its share, make room in the others.
+	shrink();
+	return tile;
+}
+
+void CqTileCache::erase(TqUlong arrayId)
+{
+	for(TqInt i = 0; i < numStripes; ++i)
+	{
+		CqStripe& s = m_stripes[i];
+		AQSIS_LOCK_STRIPE(s);
+		std::map<CqStripe::TqKey, CqStripe::TqEntryList::iterator>::iterator
+			pos = s.entries.lower_bound(CqStripe::TqKey(arrayId, 0));
+		while(pos != s.entries.end() && pos->first.first == arrayId)
+		{
+			CqStripe::TqEntryList::iterator entry = pos->second;
+			++pos;
+			s.remove(entry);
+		}
+	}
+}
+
+void CqTileCache::clear()
+{
+	for(TqInt i = 0; i < numStripes; ++i)
+	{
+		CqStripe& s = m_stripes[i];
+		AQSIS_LOCK_STRIPE(s);
+		s.removeAll();
+		s.stats = SqTileCacheStats();
+	}
+}
+
+void CqTileCache::setMaxBytes(std::size_t maxBytes)
+{
+	m_budget->setMaxBytes(maxBytes);
+	shrink();
+}
+
+std::size_t CqTileCache::maxBytes() const
+{
+	return m_budget->maxBytes();
+}
+
+SqTileCacheStats CqTileCache::stats() const
+{
+	SqTileCacheStats total;
+	for(TqInt i = 0; i < numStripes; ++i)
+	{
+		CqStripe& s = m_stripes[i];
+		AQSIS_LOCK_STRIPE(s);
+		total.hits += s.stats.hits;
+		total.misses += s.stats.misses;
+		total.evictions += s.stats.evictions;
+		total.bytes += s.bytes;
+	}
+	return total;
+}
+
+CqTileCache::CqStripe& CqTileCache::stripe(TqUlong arrayId, TqInt index)
+{
+	// Neighbouring tiles of an array go to different stripes.
+	TqUlong hash = arrayId*2654435761UL + index;
+	return m_stripes[hash % numStripes];
+}
+
+void CqTileCache::shrink()
+{
+	// Visit each stripe at most once, starting where the last visit left off
+	// so that no stripe is always evicted from first.
+	for(TqInt i = 0; i < numStripes && m_budget->overLimit(); ++i)
+	{
+		CqStripe& s = m_stripes[m_budget->nextStripe()];
+		AQSIS_LOCK_STRIPE(s);
+		s.shrink();
+	}
+}
+
+//------------------------------------------------------------------------------
+// CqTileCache::CqFileLock
+
+CqTileCache::CqFileLock::CqFileLock(CqTileCache& cache, const void* file)
+	: m_cache(cache),
+	m_stripe(static_cast<TqInt>((reinterpret_cast<std::size_t>(file) >> 4) % numStripes))
+{
+#ifdef ENABLE_THREADING
+	m_cache.m_stripes[m_stripe].fileMutex.lock();
+#endif
+}
+
+CqTileCache::CqFileLock::~CqFileLock()
+{
+#ifdef ENABLE_THREADING
+	m_cache.m_stripes[m_stripe].fileMutex.unlock();
+#endif
+}
+
+} // namespace Aqsis
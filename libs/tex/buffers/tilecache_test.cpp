@@ -0,0 +1,141 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for the texture tile cache.
+ */
+
+#include <aqsis/tex/buffers/tilecache.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_SUITE(tilecache_tests)
+
+namespace {
+
+// Tiles with indices differing by a multiple of the number of stripes fall in
+// the same stripe, which gets 1/16 of the memory limit as its share.
+const TqInt stripeStep = 16;
+
+CqTileCache::TqTilePtr makeTile(TqInt value)
+{
+	return CqTileCache::TqTilePtr(new TqInt(value));
+}
+
+TqInt tileValue(const CqTileCache::TqTilePtr& tile)
+{
+	return *boost::static_pointer_cast<TqInt>(tile);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqTileCache_find_insert_test)
+{
+	CqTileCache cache;
+	TqUlong id = cache.newArrayId();
+	BOOST_CHECK(!cache.find(id, 3));
+	cache.insert(id, 3, makeTile(42), 10);
+	BOOST_REQUIRE(cache.find(id, 3));
+	BOOST_CHECK_EQUAL(tileValue(cache.find(id, 3)), 42);
+	// Inserting a tile which is already cached keeps the original.
+	BOOST_CHECK_EQUAL(tileValue(cache.insert(id, 3, makeTile(7), 10)), 42);
+
+	SqTileCacheStats stats = cache.stats();
+	BOOST_CHECK_EQUAL(stats.hits, 2U);
+	BOOST_CHECK_EQUAL(stats.misses, 1U);
+	BOOST_CHECK_EQUAL(stats.bytes, 10U);
+
+	// Tiles of other arrays are distinct.
+	BOOST_CHECK(!cache.find(cache.newArrayId(), 3));
+	cache.erase(id);
+	BOOST_CHECK(!cache.find(id, 3));
+	BOOST_CHECK_EQUAL(cache.stats().bytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_lru_eviction_test)
+{
+	CqTileCache cache(130);
+	TqUlong id = cache.newArrayId();
+	cache.insert(id, 0, makeTile(0), 60);
+	cache.insert(id, stripeStep, makeTile(1), 60);
+	// Touch the first tile so that the second is the least recently used.
+	BOOST_CHECK(cache.find(id, 0));
+	cache.insert(id, 2*stripeStep, makeTile(2), 60);
+
+	BOOST_CHECK(cache.find(id, 0));
+	BOOST_CHECK(!cache.find(id, stripeStep));
+	BOOST_CHECK(cache.find(id, 2*stripeStep));
+	BOOST_CHECK_EQUAL(cache.stats().evictions, 1U);
+	BOOST_CHECK_EQUAL(cache.stats().bytes, 120U);
+
+	// Lowering the limit evicts down to the newest tile.
+	cache.setMaxBytes(0);
+	BOOST_CHECK(!cache.find(id, 0));
+	BOOST_CHECK(cache.find(id, 2*stripeStep));
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_shared_limit_test)
+{
+	CqTileCache cache(stripeStep*100);
+	TqUlong id = cache.newArrayId();
+	// A single hot stripe may use more than its share while the cache fits.
+	for(TqInt i = 0; i < 10; ++i)
+		cache.insert(id, i*stripeStep, makeTile(i), 100);
+	BOOST_CHECK_EQUAL(cache.stats().evictions, 0U);
+	BOOST_CHECK_EQUAL(cache.stats().bytes, 1000U);
+
+	// Once the cache is full, tiles are evicted from the stripe holding more
+	// than its share rather than from the stripes being inserted into.
+	for(TqInt i = 1; i <= 7; ++i)
+		cache.insert(id, i, makeTile(100 + i), 100);
+	BOOST_CHECK_EQUAL(cache.stats().evictions, 1U);
+	BOOST_CHECK_EQUAL(cache.stats().bytes, 1600U);
+	BOOST_CHECK(!cache.find(id, 0));
+	BOOST_CHECK(cache.find(id, stripeStep));
+	for(TqInt i = 1; i <= 7; ++i)
+		BOOST_CHECK(cache.find(id, i));
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_evicted_tile_lifetime_test)
+{
+	CqTileCache cache(0);
+	TqUlong id = cache.newArrayId();
+	CqTileCache::TqTilePtr held = cache.insert(id, 0, makeTile(5), 100);
+	cache.insert(id, stripeStep, makeTile(6), 100);
+	// The first tile is gone from the cache, but still usable by its holder.
+	BOOST_CHECK(!cache.find(id, 0));
+	BOOST_CHECK_EQUAL(tileValue(held), 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
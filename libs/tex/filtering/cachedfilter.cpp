@@ -37,8 +37,11 @@
 
 #include "cachedfilter.h"
 
+#include <cmath>
 #include <iostream>
 
+#include <aqsis/math/separable.h>
+
 namespace Aqsis
 {
 
@@ -106,6 +109,15 @@ CqCachedFilter::CqCachedFilter(const SqFilterInfo& filterInfo,
 	}
 }
 
+bool CqCachedFilter::separate(std::vector<TqFloat>& xWeights,
+		std::vector<TqFloat>& yWeights) const
+{
+	// The tolerance allows for the small weights which were set to zero
+	// above.
+	return separateKernel(&m_weights[0], m_width, m_height, xWeights,
+			yWeights, 1e-5f);
+}
+
 std::ostream& operator<<(std::ostream& out, const CqCachedFilter& filter)
 {
 	// print the filter kernel.
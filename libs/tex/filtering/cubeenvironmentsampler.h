@@ -40,6 +40,8 @@
 
 #include <aqsis/aqsis.h>
 
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/math/math.h>
@@ -87,8 +89,18 @@ class AQSIS_TEX_SHARE CqCubeEnvironmentSampler : public IqEnvironmentSampler
 		// from IqEnvironmentSampler
 		virtual void sample(const Sq3DSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSampleQuad* sampleQuads,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSamplePllgram* samplePllgrams,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqTextureSampleOptions& defaultSampleOptions() const;
 	private:
+		/// Construct the EWA filter factory for filtering over a region.
+		CqEwaFilterFactory filterFactory(const Sq3DSamplePllgram& region,
+				const CqTextureSampleOptions& sampleOpts) const;
+
 		// mipmap levels.
 		boost::shared_ptr<LevelCacheT> m_levels;
 		// Scale factor for cube face environment map coordinates = 1/tan(fov/2)
@@ -109,8 +121,43 @@ CqCubeEnvironmentSampler<LevelCacheT>::CqCubeEnvironmentSampler(
 
 template<typename LevelCacheT>
 void CqCubeEnvironmentSampler<LevelCacheT>::sample(
-		const Sq3DSamplePllgram& region,
+		const Sq3DSamplePllgram& samplePllgram,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	m_levels->applyFilter(filterFactory(samplePllgram, sampleOpts), sampleOpts,
+			outSamps);
+}
+
+template<typename LevelCacheT>
+void CqCubeEnvironmentSampler<LevelCacheT>::sampleGrid(
+		const Sq3DSampleQuad* sampleQuads, TqInt numPoints,
+		const CqBitVector* runningState,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	detail::filterGridRegions<Sq3DSamplePllgram>(*m_levels, sampleQuads,
+			numPoints, runningState, sampleOpts,
+			boost::bind(&CqCubeEnvironmentSampler::filterFactory, this, _1,
+				boost::cref(sampleOpts)),
+			outSamps);
+}
+
+template<typename LevelCacheT>
+void CqCubeEnvironmentSampler<LevelCacheT>::sampleGrid(
+		const Sq3DSamplePllgram* samplePllgrams, TqInt numPoints,
+		const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	detail::filterGridRegions<Sq3DSamplePllgram>(*m_levels, samplePllgrams,
+			numPoints, runningState, sampleOpts,
+			boost::bind(&CqCubeEnvironmentSampler::filterFactory, this, _1,
+				boost::cref(sampleOpts)),
+			outSamps);
+}
+
+template<typename LevelCacheT>
+CqEwaFilterFactory CqCubeEnvironmentSampler<LevelCacheT>::filterFactory(
+		const Sq3DSamplePllgram& region,
+		const CqTextureSampleOptions& sampleOpts) const
 {
 	// The tricky task here is to map the 3D sample parallelogram into a
 	// 2D one on the appropriate cube face.  This involves mapping both the
@@ -250,10 +297,8 @@ void CqCubeEnvironmentSampler<LevelCacheT>::sample(
 	}
 
 	// Construct the filter factory
-	CqEwaFilterFactory ewaFactory(region2d, m_levels->width0(),
+	return CqEwaFilterFactory(region2d, m_levels->width0(),
 			m_levels->height0(), blurVariance);
-	// Apply the filter to the mipmap levels
-	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
 }
 
 template<typename LevelCacheT>
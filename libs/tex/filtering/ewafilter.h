@@ -43,8 +43,10 @@
 #include <vector>
 
 #include <aqsis/math/math.h>
+#include <aqsis/util/autobuffer.h>
 #include <aqsis/tex/buffers/filtersupport.h>
 #include <aqsis/math/matrix2d.h>
+#include <aqsis/math/simd.h>
 #include <aqsis/tex/filtering/samplequad.h>
 
 namespace Aqsis {
@@ -93,6 +95,18 @@ class CqEwaFilter
 		 *            don't have to)
 		 */
 		TqFloat operator()(TqFloat x, TqFloat y) const;
+		/** \brief Evaluate the filter along a row of pixels.
+		 *
+		 * The weights are the same as those returned by operator(), up to
+		 * rounding, but are computed four at a time with SSE2 when it's
+		 * available.
+		 *
+		 * \param y - raster y-coordinate of the row
+		 * \param xStart - raster x-coordinate of the first pixel
+		 * \param numX - number of pixels in the row
+		 * \param weights - output array of numX weights
+		 */
+		void evaluateRow(TqInt y, TqInt xStart, TqInt numX, TqFloat* weights) const;
 		/// Get the extent of the filter in integer raster coordinates.
 		SqFilterSupport support() const;
 
@@ -105,6 +119,39 @@ class CqEwaFilter
 		const TqFloat m_logEdgeWeight;
 };
 
+//------------------------------------------------------------------------------
+/** \brief EWA filter weights tabulated over a filter support.
+ *
+ * Evaluating a CqEwaFilter for each pixel inside the filtering loop mixes
+ * the weight computation in with the iteration over the texture tiles.  This
+ * class instead computes the weights for the whole support up front, a row
+ * at a time with CqEwaFilter::evaluateRow(), and may be used in place of the
+ * filter as the weights of a CqSampleAccum.  It may only be evaluated at
+ * pixels inside the support.
+ */
+class CqEwaWeightTable
+{
+	public:
+		/** \brief Tabulate the weights of a filter.
+		 *
+		 * \param filter - filter to evaluate
+		 * \param support - pixels at which the filter will be evaluated.
+		 */
+		CqEwaWeightTable(const CqEwaFilter& filter, const SqFilterSupport& support);
+
+		/// EWA filters are never pre-noramlized; return false.
+		static bool isNormalized() { return false; }
+
+		/// Get the filter weight for the pixel (x,y) inside the support.
+		TqFloat operator()(TqInt x, TqInt y) const;
+
+	private:
+		/// Support which the weights are computed over.
+		SqFilterSupport m_support;
+		/// Weights for the pixels of the support, stored by rows.
+		CqAutoBuffer<TqFloat, 1024> m_weights;
+};
+
 //------------------------------------------------------------------------------
 /** \brief A class encapsulating Elliptically Weighted Average (EWA) filter
  * weight computation.
@@ -233,6 +280,8 @@ class CqEwaFilterFactory
 
 		/// Get the width of the filter along the minor axis of the ellipse
 		TqFloat minorAxisWidth() const;
+		/// Get the filter centre, in raster coordinates of the base texture.
+		const CqVector2D& center() const;
 	private:
 		/** \brief Compute and cache EWA filter coefficients
 		 *
@@ -359,6 +408,11 @@ inline TqFloat CqEwaFilterFactory::minorAxisWidth() const
 	return m_minorAxisWidth;
 }
 
+inline const CqVector2D& CqEwaFilterFactory::center() const
+{
+	return m_filterCenter;
+}
+
 
 //------------------------------------------------------------------------------
 namespace detail {
@@ -410,6 +464,36 @@ class CqNegExpTable
 			TqFloat interp = xRescaled - index;
 			return (1-interp)*m_values[index] + interp*m_values[index+1];
 		}
+
+#		ifdef AQSIS_SIMD_SSE2
+		/** \brief Look up an approximate exp(-x) for four x > 0.
+		 *
+		 * \param x - four values to look up.
+		 * \param inRange - lanes for which a value should be looked up; the
+		 *                  result is 0 in the other lanes.
+		 */
+		__m128 operator()(__m128 x, __m128 inRange) const
+		{
+			inRange = _mm_and_ps(inRange, _mm_cmplt_ps(x, _mm_set1_ps(m_rangeMax)));
+			// Lanes out of range look up index 0, which is always valid.
+			__m128 xRescaled = _mm_mul_ps(_mm_and_ps(inRange, x), _mm_set1_ps(m_invRes));
+			__m128i index = _mm_cvttps_epi32(xRescaled);
+			__m128 interp = _mm_sub_ps(xRescaled, _mm_cvtepi32_ps(index));
+			TqInt i[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(i), index);
+			// Guard against x just below m_rangeMax rounding up to the end
+			// of the table.
+			const TqInt maxIndex = m_values.size() - 2;
+			for(TqInt j = 0; j < 4; ++j)
+				i[j] = min(i[j], maxIndex);
+			__m128 v0 = _mm_setr_ps(m_values[i[0]], m_values[i[1]],
+					m_values[i[2]], m_values[i[3]]);
+			__m128 v1 = _mm_setr_ps(m_values[i[0]+1], m_values[i[1]+1],
+					m_values[i[2]+1], m_values[i[3]+1]);
+			__m128 value = _mm_add_ps(v0, _mm_mul_ps(interp, _mm_sub_ps(v1, v0)));
+			return _mm_and_ps(inRange, value);
+		}
+#		endif
 };
 extern CqNegExpTable negExpTable;
 
@@ -441,6 +525,36 @@ inline TqFloat CqEwaFilter::operator()(TqFloat x, TqFloat y) const
 	return 0;
 }
 
+inline void CqEwaFilter::evaluateRow(TqInt y, TqInt xStart, TqInt numX,
+		TqFloat* weights) const
+{
+	TqFloat yOff = y - m_filterCenter.y();
+	TqInt i = 0;
+#	ifdef AQSIS_SIMD_SSE2
+	// Write the quadratic form as Q = x*(a*x + (b+c)*y) + d*y*y, where only x
+	// varies along the row.
+	const __m128 a = _mm_set1_ps(m_quadForm.a);
+	const __m128 bcy = _mm_set1_ps((m_quadForm.b + m_quadForm.c)*yOff);
+	const __m128 dyy = _mm_set1_ps(m_quadForm.d*yOff*yOff);
+	const __m128 logEdgeWeight = _mm_set1_ps(m_logEdgeWeight);
+	__m128 xOff = _mm_add_ps(_mm_set1_ps(xStart - m_filterCenter.x()),
+			_mm_setr_ps(0, 1, 2, 3));
+	const __m128 four = _mm_set1_ps(4);
+	for(; i + 4 <= numX; i += 4, xOff = _mm_add_ps(xOff, four))
+	{
+		__m128 q = _mm_add_ps(_mm_mul_ps(xOff,
+					_mm_add_ps(_mm_mul_ps(a, xOff), bcy)), dyy);
+		__m128 inside = _mm_cmplt_ps(q, logEdgeWeight);
+		if(_mm_movemask_ps(inside) == 0)
+			_mm_storeu_ps(weights + i, _mm_setzero_ps());
+		else
+			_mm_storeu_ps(weights + i, detail::negExpTable(q, inside));
+	}
+#	endif
+	for(; i < numX; ++i)
+		weights[i] = (*this)(xStart + i, y);
+}
+
 inline SqFilterSupport CqEwaFilter::support() const
 {
 	TqFloat detQ = m_quadForm.det();
@@ -455,6 +569,30 @@ inline SqFilterSupport CqEwaFilter::support() const
 		);
 }
 
+
+//------------------------------------------------------------------------------
+// CqEwaWeightTable implementation
+inline CqEwaWeightTable::CqEwaWeightTable(const CqEwaFilter& filter,
+		const SqFilterSupport& support)
+	: m_support(support),
+	m_weights(support.isEmpty() ? 0 : support.area())
+{
+	if(support.isEmpty())
+		return;
+	TqInt rowLength = support.sx.range();
+	TqFloat* row = m_weights.get();
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y, row += rowLength)
+		filter.evaluateRow(y, support.sx.start, rowLength, row);
+}
+
+inline TqFloat CqEwaWeightTable::operator()(TqInt x, TqInt y) const
+{
+	assert(x >= m_support.sx.start && x < m_support.sx.end);
+	assert(y >= m_support.sy.start && y < m_support.sy.end);
+	return m_weights[(y - m_support.sy.start)*m_support.sx.range()
+		+ x - m_support.sx.start];
+}
+
 } // namespace Aqsis
 
 #endif // EWAFILTER_H_INCLUDED
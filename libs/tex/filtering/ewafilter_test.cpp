@@ -0,0 +1,73 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for the EWA filter.
+ */
+
+#include "ewafilter.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_SUITE(ewafilter_tests)
+
+BOOST_AUTO_TEST_CASE(CqEwaWeightTable_test)
+{
+	// An anisotropic sample region, so that all terms of the quadratic form
+	// are nonzero.
+	SqSamplePllgram pllgram(CqVector2D(0.4f, 0.6f), CqVector2D(0.05f, 0.02f),
+			CqVector2D(-0.01f, 0.03f));
+	CqEwaFilterFactory factory(pllgram, 256, 256, ewaBlurMatrix(0, 0));
+	CqEwaFilter filter = factory.createFilter();
+	SqFilterSupport support = filter.support();
+	BOOST_REQUIRE(!support.isEmpty());
+
+	// The weights computed a row at a time match those computed per point.
+	CqEwaWeightTable weights(filter, support);
+	BOOST_CHECK(!weights.isNormalized());
+	TqInt numNonzero = 0;
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y)
+	{
+		for(TqInt x = support.sx.start; x < support.sx.end; ++x)
+		{
+			BOOST_CHECK_SMALL(weights(x,y) - filter(x,y), 1e-5f);
+			if(filter(x,y) != 0)
+				++numNonzero;
+		}
+	}
+	BOOST_CHECK(numNonzero > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
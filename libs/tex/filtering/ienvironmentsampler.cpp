@@ -36,6 +36,8 @@
  */
 
 #include <aqsis/tex/filtering/ienvironmentsampler.h>
+
+#include <aqsis/util/bitvector.h>
 #include "cubeenvironmentsampler.h"
 #include "dummyenvironmentsampler.h"
 #include "latlongenvironmentsampler.h"
@@ -82,6 +84,30 @@ void IqEnvironmentSampler::sample(const Sq3DSampleQuad& sampleQuad,
 	sample(Sq3DSamplePllgram(sampleQuad), sampleOpts, outSamps);
 }
 
+void IqEnvironmentSampler::sampleGrid(const Sq3DSampleQuad* sampleQuads,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(!runningState || runningState->Value(i))
+			sample(sampleQuads[i], sampleOpts, outSamps + i*numChannels);
+	}
+}
+
+void IqEnvironmentSampler::sampleGrid(const Sq3DSamplePllgram* samplePllgrams,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(!runningState || runningState->Value(i))
+			sample(samplePllgrams[i], sampleOpts, outSamps + i*numChannels);
+	}
+}
+
 const CqTextureSampleOptions& IqEnvironmentSampler::defaultSampleOptions() const
 {
 	static const CqTextureSampleOptions defaultOptions;
@@ -37,6 +37,7 @@
 
 #include <aqsis/tex/filtering/ishadowsampler.h>
 
+#include <aqsis/util/bitvector.h>
 #include "dummyshadowsampler.h"
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include "shadowsampler.h"
@@ -81,4 +82,16 @@ const CqShadowSampleOptions& IqShadowSampler::defaultSampleOptions() const
 	return defaultOptions;
 }
 
+void IqShadowSampler::sampleGrid(const Sq3DSampleQuad* sampleQuads,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(!runningState || runningState->Value(i))
+			sample(sampleQuads[i], sampleOpts, outSamps + i*numChannels);
+	}
+}
+
 } // namespace Aqsis
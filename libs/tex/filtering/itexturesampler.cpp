@@ -41,6 +41,7 @@
 #	include <OpenEXR/half.h>
 #endif
 
+#include <aqsis/util/bitvector.h>
 #include "dummytexturesampler.h"
 #include <aqsis/tex/io/itexinputfile.h>
 #include "texturesampler.h"
@@ -80,6 +81,30 @@ void IqTextureSampler::sample(const SqSampleQuad& sampleQuad,
 	sample(SqSamplePllgram(sampleQuad), sampleOpts, outSamps);
 }
 
+void IqTextureSampler::sampleGrid(const SqSampleQuad* sampleQuads,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(!runningState || runningState->Value(i))
+			sample(sampleQuads[i], sampleOpts, outSamps + i*numChannels);
+	}
+}
+
+void IqTextureSampler::sampleGrid(const SqSamplePllgram* samplePllgrams,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(!runningState || runningState->Value(i))
+			sample(samplePllgrams[i], sampleOpts, outSamps + i*numChannels);
+	}
+}
+
 const CqTextureSampleOptions& IqTextureSampler::defaultSampleOptions() const
 {
 	static const CqTextureSampleOptions defaultOptions;
@@ -40,6 +40,8 @@
 
 #include <aqsis/aqsis.h>
 
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/math/math.h>
@@ -69,8 +71,18 @@ class AQSIS_TEX_SHARE CqLatLongEnvironmentSampler : public IqEnvironmentSampler
 		// from IqEnvironmentSampler
 		virtual void sample(const Sq3DSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSampleQuad* sampleQuads,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSamplePllgram* samplePllgrams,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqTextureSampleOptions& defaultSampleOptions() const;
 	private:
+		/// Construct the EWA filter factory for filtering over a region.
+		CqEwaFilterFactory filterFactory(const Sq3DSamplePllgram& region,
+				const CqTextureSampleOptions& sampleOpts) const;
+
 		// mipmap levels.
 		boost::shared_ptr<LevelCacheT> m_levels;
 };
@@ -169,6 +181,41 @@ template<typename LevelCacheT>
 void CqLatLongEnvironmentSampler<LevelCacheT>::sample(
 		const Sq3DSamplePllgram& samplePllgram,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	m_levels->applyFilter(filterFactory(samplePllgram, sampleOpts), sampleOpts,
+			outSamps);
+}
+
+template<typename LevelCacheT>
+void CqLatLongEnvironmentSampler<LevelCacheT>::sampleGrid(
+		const Sq3DSampleQuad* sampleQuads, TqInt numPoints,
+		const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	detail::filterGridRegions<Sq3DSamplePllgram>(*m_levels, sampleQuads,
+			numPoints, runningState, sampleOpts,
+			boost::bind(&CqLatLongEnvironmentSampler::filterFactory, this, _1,
+				boost::cref(sampleOpts)),
+			outSamps);
+}
+
+template<typename LevelCacheT>
+void CqLatLongEnvironmentSampler<LevelCacheT>::sampleGrid(
+		const Sq3DSamplePllgram* samplePllgrams, TqInt numPoints,
+		const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	detail::filterGridRegions<Sq3DSamplePllgram>(*m_levels, samplePllgrams,
+			numPoints, runningState, sampleOpts,
+			boost::bind(&CqLatLongEnvironmentSampler::filterFactory, this, _1,
+				boost::cref(sampleOpts)),
+			outSamps);
+}
+
+template<typename LevelCacheT>
+CqEwaFilterFactory CqLatLongEnvironmentSampler<LevelCacheT>::filterFactory(
+		const Sq3DSamplePllgram& samplePllgram,
+		const CqTextureSampleOptions& sampleOpts) const
 {
 	TqFloat sBlur = sampleOpts.sBlur();
 	// Map sampling parallelogram into latlong texture coords.
@@ -180,11 +227,8 @@ void CqLatLongEnvironmentSampler<LevelCacheT>::sample(
 	SqMatrix2D blurVariance = ewaBlurMatrix(sBlur, 2*sampleOpts.tBlur());
 
 	// Construct EWA filter factory
-	CqEwaFilterFactory ewaFactory(region2d, m_levels->width0(),
+	return CqEwaFilterFactory(region2d, m_levels->width0(),
 			m_levels->height0(), blurVariance);
-
-	// Apply the filter to the mipmap levels
-	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
 }
 
 template<typename LevelCacheT>
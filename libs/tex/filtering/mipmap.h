@@ -40,12 +40,14 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/util/autobuffer.h>
+#include <aqsis/util/bitvector.h>
 #include <aqsis/util/exception.h>
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
@@ -119,10 +121,68 @@ class CqMipmap
 		void applyFilter(const FilterFactoryT& filterFactory,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps);
 
+		/** \brief Apply a filter for each of a set of texture lookups.
+		 *
+		 * The results are the same as those of applyFilter() for each filter
+		 * in turn.  However, the mipmap levels for all the lookups are chosen
+		 * first, and the lookups are then done in order of level and of the
+		 * texture tile holding the filter centre.  Lookups which are close
+		 * together in the texture then read the same tiles one after the
+		 * other, however the shading points happen to be ordered.
+		 *
+		 * \param filterFactories - array of numFilters filter factories.  As
+		 *            well as the methods required by applyFilter(), these
+		 *            must have the method filterFactory.center() giving the
+		 *            filter centre in raster coordinates of the level 0 image.
+		 * \param numFilters - number of lookups.
+		 * \param sampleOpts - Sample options structure, for all lookups.
+		 * \param outSamps - Output variable - filtered samples for lookup i
+		 *            will be placed at outSamps + i*sampleOpts.numChannels().
+		 */
+		template<typename FilterFactoryT>
+		void applyFilters(const FilterFactoryT* filterFactories,
+				TqInt numFilters, const CqTextureSampleOptions& sampleOpts,
+				TqFloat* outSamps);
+
 	private:
+		/// Mipmap level chosen to filter over.
+		struct SqLevelChoice
+		{
+			/// Level to filter.
+			TqInt level;
+			/// Continuous level, used to interpolate with the next level.
+			TqFloat levelCts;
+			/// Amount of blur relative to the filter width.
+			TqFloat blurRatio;
+		};
+
 		/// Initialize all mipmap levels
 		void initLevels();
 
+		/** \brief Choose the mipmap level to filter over.
+		 *
+		 * \param filterFactory - factory containing parameters for creating
+		 *            filter weights.
+		 * \param sampleOpts - sample options structure
+		 */
+		template<typename FilterFactoryT>
+		SqLevelChoice chooseLevel(const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts) const;
+
+		/** \brief Filter the chosen mipmap level, interpolating with the next
+		 * level if necessary.
+		 *
+		 * \param choice - level chosen by chooseLevel()
+		 * \param filterFactory - factory containing parameters for creating
+		 *            filter weights.
+		 * \param sampleOpts - sample options structure
+		 * \param outSamps - destination array for filtered samples.
+		 */
+		template<typename FilterFactoryT>
+		void filterChosenLevel(const SqLevelChoice& choice,
+				const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		/** \brief Filter the given mipmap level into a sample array.
 		 *
 		 * \param level - mipmap level to filter over.
@@ -152,10 +212,10 @@ class CqMipmap
 		boost::shared_ptr<IqTiledTexInputFile> m_texFile;
 		/** \brief List of samplers for mipmap levels.
 		 *
-		 * The pointers to these may be NULL since they are created only on
-		 * demand.  Mutable so that levels can be added on demand.
+		 * The levels are all created up front, so that several threads can
+		 * filter the mipmap at once.  They read their pixel data on demand.
 		 */
-		mutable std::vector<boost::shared_ptr<TextureBufferT> > m_levels;
+		std::vector<boost::shared_ptr<TextureBufferT> > m_levels;
 		/// Transformation information for each level.
 		std::vector<SqLevelTrans> m_levelTransforms;
 		/// Width of the first mipmap level
@@ -166,6 +226,34 @@ class CqMipmap
 		CqTextureSampleOptions m_defaultSampleOptions;
 };
 
+namespace detail {
+
+/** \brief Filter the regions of the running points of a grid with a mipmap.
+ *
+ * A filter factory is made for each running point from its region, which is
+ * first converted to PllgramT.  The lookups are then done together by
+ * applyFilters(), and the results scattered back to the running points.  The
+ * results are the same as filtering each point in turn.
+ *
+ * \param levels - mipmap to filter.
+ * \param regions - array of numPoints sample regions.
+ * \param numPoints - number of points in the grid.
+ * \param runningState - points to filter, or null for all of them.
+ * \param sampleOpts - Sample options structure, for all points.
+ * \param makeFactory - functor returning the filter factory for a PllgramT,
+ *            with the filter factory type as its result_type.
+ * \param outSamps - Output variable - filtered samples for point i will be
+ *            placed at outSamps + i*sampleOpts.numChannels().
+ */
+template<typename PllgramT, typename LevelCacheT, typename RegionT,
+	typename MakeFactoryT>
+void filterGridRegions(LevelCacheT& levels, const RegionT* regions,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts,
+		const MakeFactoryT& makeFactory, TqFloat* outSamps);
+
+} // namespace detail
+
 
 //==============================================================================
 // Implementation details
@@ -212,6 +300,32 @@ inline SqLevelTrans::SqLevelTrans(TqFloat xScale, TqFloat xOffset,
 { }
 
 
+namespace detail {
+
+/// Position of a texture lookup, used to sort the lookups in applyFilters().
+struct SqMipmapLookup
+{
+	TqInt level;
+	TqInt tileY;
+	TqInt tileX;
+	/// Index of the lookup.
+	TqInt index;
+
+	bool operator<(const SqMipmapLookup& rhs) const
+	{
+		if(level != rhs.level)
+			return level < rhs.level;
+		if(tileY != rhs.tileY)
+			return tileY < rhs.tileY;
+		if(tileX != rhs.tileX)
+			return tileX < rhs.tileX;
+		return index < rhs.index;
+	}
+};
+
+} // namespace detail
+
+
 //------------------------------------------------------------------------------
 // CqMipmap
 template<typename TextureBufferT>
@@ -257,6 +371,86 @@ template<typename TextureBufferT>
 template<typename FilterFactoryT>
 void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	filterChosenLevel(chooseLevel(filterFactory, sampleOpts), filterFactory,
+			sampleOpts, outSamps);
+}
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+void CqMipmap<TextureBufferT>::applyFilters(
+		const FilterFactoryT* filterFactories, TqInt numFilters,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	std::vector<SqLevelChoice> choices(numFilters);
+	std::vector<detail::SqMipmapLookup> lookups(numFilters);
+	for(TqInt i = 0; i < numFilters; ++i)
+	{
+		choices[i] = chooseLevel(filterFactories[i], sampleOpts);
+		// Find the tile holding the filter centre on the chosen level.
+		TqInt level = choices[i].level;
+		const SqLevelTrans& trans = levelTrans(level);
+		const TextureBufferT& buffer = getLevel(level);
+		const CqVector2D& center = filterFactories[i].center();
+		detail::SqMipmapLookup& lookup = lookups[i];
+		lookup.level = level;
+		lookup.tileX = lfloor(trans.xScale*(center.x() + trans.xOffset)
+				/ buffer.tileWidth());
+		lookup.tileY = lfloor(trans.yScale*(center.y() + trans.yOffset)
+				/ buffer.tileHeight());
+		lookup.index = i;
+	}
+	std::sort(lookups.begin(), lookups.end());
+	TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numFilters; ++i)
+	{
+		TqInt index = lookups[i].index;
+		filterChosenLevel(choices[index], filterFactories[index], sampleOpts,
+				outSamps + index*numChannels);
+	}
+}
+
+namespace detail {
+
+template<typename PllgramT, typename LevelCacheT, typename RegionT,
+	typename MakeFactoryT>
+void filterGridRegions(LevelCacheT& levels, const RegionT* regions,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts,
+		const MakeFactoryT& makeFactory, TqFloat* outSamps)
+{
+	std::vector<typename MakeFactoryT::result_type> factories;
+	std::vector<TqInt> points;
+	factories.reserve(numPoints);
+	points.reserve(numPoints);
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(runningState && !runningState->Value(i))
+			continue;
+		factories.push_back(makeFactory(PllgramT(regions[i])));
+		points.push_back(i);
+	}
+	if(points.empty())
+		return;
+
+	// Filter into a packed array, and then scatter the results to the points.
+	TqInt numChannels = sampleOpts.numChannels();
+	std::vector<TqFloat> samples(points.size()*numChannels);
+	levels.applyFilters(&factories[0], factories.size(), sampleOpts, &samples[0]);
+	for(TqInt i = 0, end = points.size(); i < end; ++i)
+	{
+		for(TqInt c = 0; c < numChannels; ++c)
+			outSamps[points[i]*numChannels + c] = samples[i*numChannels + c];
+	}
+}
+
+} // namespace detail
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+typename CqMipmap<TextureBufferT>::SqLevelChoice
+CqMipmap<TextureBufferT>::chooseLevel(const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts) const
 {
 	// Select mipmap level to use.
 	//
@@ -281,8 +475,22 @@ void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 		blurRatio = clamp(2*maxBlur/filterFactory.minorAxisWidth(), 0.0f, 1.0f);
 		minFilterWidth += 2*blurRatio;
 	}
-	TqFloat levelCts = log2(filterFactory.minorAxisWidth()/minFilterWidth);
-	TqInt level = clamp<TqInt>(lfloor(levelCts), 0, numLevels()-1);
+	SqLevelChoice choice;
+	choice.levelCts = log2(filterFactory.minorAxisWidth()/minFilterWidth);
+	choice.level = clamp<TqInt>(lfloor(choice.levelCts), 0, numLevels()-1);
+	choice.blurRatio = blurRatio;
+	return choice;
+}
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+void CqMipmap<TextureBufferT>::filterChosenLevel(const SqLevelChoice& choice,
+		const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	TqInt level = choice.level;
+	TqFloat levelCts = choice.levelCts;
+	TqFloat blurRatio = choice.blurRatio;
 
 	filterLevel(level, filterFactory, sampleOpts, outSamps);
 
@@ -333,15 +541,6 @@ const TextureBufferT& CqMipmap<TextureBufferT>::getLevel(TqInt levelNum) const
 {
 	assert(levelNum < static_cast<TqInt>(m_levels.size()));
 	assert(levelNum >= 0);
-	if(!m_levels[levelNum])
-	{
-		// read in requested level if it's not loaded yet.
-		m_levels[levelNum].reset(new TextureBufferT(m_texFile, levelNum));
-		Aqsis::log() << debug << "initialized subtexture " << levelNum
-			<< " [" << m_levels[levelNum]->width() << "x"
-			<< m_levels[levelNum]->width() << "] " 
-			<< "from texture " << m_texFile->fileName() << "\n";
-	}
 	return *m_levels[levelNum];
 }
 
@@ -415,6 +614,8 @@ void CqMipmap<TextureBufferT>::initLevels()
 			<< "has less than the expected number of mipmap levels. "
 			<< "(smallest level: " << levelWidth << "x" << levelHeight << ")\n";
 	}
+	for(TqInt i = 0, end = m_levels.size(); i < end; ++i)
+		m_levels[i].reset(new TextureBufferT(m_texFile, i));
 }
 
 template<typename TextureBufferT>
@@ -425,19 +626,11 @@ void CqMipmap<TextureBufferT>::filterLevel(
 {
 	// Create filter weights for chosen level.
 	const SqLevelTrans& trans = levelTrans(level);
-	CqEwaFilter weights = filterFactory.createFilter(
+	CqEwaFilter filter = filterFactory.createFilter(
 		trans.xScale, trans.xOffset,
 		trans.yScale, trans.yOffset
 	);
-	// Create an accumulator for the samples.
-	CqSampleAccum<CqEwaFilter> accumulator(
-		weights,
-		sampleOpts.startChannel(),
-		sampleOpts.numChannels(),
-		outSamps,
-		sampleOpts.fill()
-	);
-	SqFilterSupport support = weights.support();
+	SqFilterSupport support = filter.support();
 	if(level == numLevels() - 1)
 	{
 		// Truncate the support to a maximum size of 20x20 if we're on the
@@ -447,6 +640,16 @@ void CqMipmap<TextureBufferT>::filterLevel(
 		TqInt cy = (support.sy.start + support.sy.end)/2;
 		support = intersect(support, SqFilterSupport(cx-10, cx+11, cy-10, cy+11));
 	}
+	// Tabulate the weights over the support.
+	CqEwaWeightTable weights(filter, support);
+	// Create an accumulator for the samples.
+	CqSampleAccum<CqEwaWeightTable> accumulator(
+		weights,
+		sampleOpts.startChannel(),
+		sampleOpts.numChannels(),
+		outSamps,
+		sampleOpts.fill()
+	);
 	// filter the texture
 	filterTexture(
 		accumulator,
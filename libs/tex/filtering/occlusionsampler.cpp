@@ -37,6 +37,8 @@
 
 #include "occlusionsampler.h"
 
+#include <cstring>
+
 #include <aqsis/math/math.h>
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
@@ -257,8 +259,7 @@ CqOcclusionSampler::CqOcclusionSampler(
 		const boost::shared_ptr<IqTiledTexInputFile>& file,
 		const CqMatrix& currToWorld)
 	: m_maps(),
-	m_defaultSampleOptions(),
-	m_random()
+	m_defaultSampleOptions()
 {
 	// Connect the multiple shadow maps to the input file.
 	TqInt numMaps = file->numSubImages();
@@ -289,6 +290,17 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 	// have based on it's relative importance as measured by the map weight.
 	TqFloat totOcc = 0;
 	TqInt totNumSamples = 0;
+	// The importance sampling choices are keyed by the sample position rather
+	// than drawn from a random stream, so that lookups from several threads
+	// give the same results in any order.
+	TqUint randomKey = 0;
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		TqUint bits = 0;
+		TqFloat coord = samplePllgram.c[i];
+		std::memcpy(&bits, &coord, sizeof(bits));
+		randomKey = hashRandom(randomKey ^ bits);
+	}
 	TqFloat maxWeight = 0;
 	TqViewVec::const_iterator maxWeightMap = m_maps.begin();
 	for(TqViewVec::const_iterator map = m_maps.begin(), end = m_maps.end();
@@ -311,8 +323,8 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 			TqFloat numSampFlt = sampNumMult*weight;
 			// This isn't an integer though, so we take the floor,
 			TqInt numSamples = lfloor(numSampFlt);
-			// TODO: Investigate performance impact of using RandomFloat() here.
-			if(m_random.RandomFloat() < numSampFlt - numSamples)
+			randomKey = hashRandom(randomKey);
+			if((randomKey >> 8)*(1.0f/(1 << 24)) < numSampFlt - numSamples)
 			{
 				// And increment with a probability equal to the extra fraction
 				// of samples that the current map should have.
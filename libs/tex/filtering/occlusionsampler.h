@@ -92,8 +92,6 @@ class AQSIS_TEX_SHARE CqOcclusionSampler : public IqOcclusionSampler
 		TqViewVec m_maps;
 		/// Default occlusion sampling options.
 		CqShadowSampleOptions m_defaultSampleOptions;
-		/// Random number stream for importance sampling.
-		mutable CqRandom m_random;
 };
 
 
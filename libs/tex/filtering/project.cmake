@@ -34,6 +34,9 @@ make_absolute(filtering_hdrs ${filtering_SOURCE_DIR})
 include_directories(${filtering_SOURCE_DIR})
 
 set(filtering_test_srcs
+	ewafilter_test.cpp
+	randomtable_test.cpp
 	samplequad_test.cpp
+	texturesampler_test.cpp
 )
 make_absolute(filtering_test_srcs ${filtering_SOURCE_DIR})
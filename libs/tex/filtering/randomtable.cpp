@@ -41,7 +41,7 @@ namespace Aqsis {
 
 namespace detail {
 
-Cq2dQuasiRandomTable g_randTab;
+const Cq2dQuasiRandomTable g_randTab;
 
 }
 
@@ -49,7 +49,6 @@ Cq2dQuasiRandomTable g_randTab;
 // Cq2dQuasiRandomTable implementation
 
 Cq2dQuasiRandomTable::Cq2dQuasiRandomTable()
-	: m_rand()
 {
 	CqLowDiscrepancy rand(2);
 	for(TqUint i = 0; i < m_tableSize; ++i)
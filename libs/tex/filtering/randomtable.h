@@ -57,8 +57,11 @@ namespace Aqsis {
  * Randomized quasi-monte-carlo gets around this problem by somehow
  * "randomizing" the fixed low-discrepency sequence.  One way to do this is to
  * add an offset in the interval [0,1), and map the result back onto the
- * interval [0,1) modulo 1.  Relevant offsets can be obtained by simply using a
- * normal psuedo random number generator.
+ * interval [0,1) modulo 1.
+ *
+ * The table itself is never modified after construction so that it can be
+ * shared between threads; users hold their own offsets, which may be obtained
+ * from a key describing the integration with offset().
  */
 class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 {
@@ -66,13 +69,17 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		/// Initialize the table with quasi random numbers.
 		Cq2dQuasiRandomTable();
 
-		/// "randomize" the low-discrepency sequence by resetting the offset.
-		void randomize();
-
-		/// Get the x sample point at the given index.
-		TqFloat x(TqUint index) const;
-		/// Get the y sample point at the given index.
-		TqFloat y(TqUint index) const;
+		/** \brief Get a pseudo random offset in [0,1) for the given key.
+		 *
+		 * The same key always gives the same offset, so results don't depend
+		 * on the order in which integrations are done.
+		 */
+		static TqFloat offset(TqUint key);
+
+		/// Get the x sample point at the given index, shifted by offsetX.
+		TqFloat x(TqUint index, TqFloat offsetX) const;
+		/// Get the y sample point at the given index, shifted by offsetY.
+		TqFloat y(TqUint index, TqFloat offsetY) const;
 	private:
 		/// Note that this table size
 		static const TqUint m_tableSize = (1 << 10);
@@ -80,12 +87,6 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		TqFloat m_x[m_tableSize];
 		/// Table of y-positions
 		TqFloat m_y[m_tableSize];
-		/// Random numbers for randomizing the offsets
-		CqRandom m_rand;
-		/// Psudo-random x-offset
-		TqFloat m_offsetX;
-		/// Psudo-random y-offset
-		TqFloat m_offsetY;
 };
 
 
@@ -94,31 +95,29 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 //==============================================================================
 namespace detail {
 
-/// \todo Multithreading - This cannot be a singleton.
-//
-// It would be possible to make the table itself a singleton, and have another
-// object holding the randomized QMC offsets.
-extern Cq2dQuasiRandomTable g_randTab;
+/// Table shared by all users; it's read-only once constructed.
+extern const Cq2dQuasiRandomTable g_randTab;
 
 }
 
 // Cq2dQuasiRandomTable
 
-inline void Cq2dQuasiRandomTable::randomize()
+inline TqFloat Cq2dQuasiRandomTable::offset(TqUint key)
 {
-	m_offsetX = m_rand.RandomFloat();
-	m_offsetY = m_rand.RandomFloat();
+	// Use the top 24 bits so that the result is exactly representable and
+	// strictly less than one.
+	return (hashRandom(key) >> 8) * (1.0f/(1 << 24));
 }
 
-inline TqFloat Cq2dQuasiRandomTable::x(TqUint index) const
+inline TqFloat Cq2dQuasiRandomTable::x(TqUint index, TqFloat offsetX) const
 {
-	TqFloat res = m_x[index & (m_tableSize-1)] + m_offsetX;
+	TqFloat res = m_x[index & (m_tableSize-1)] + offsetX;
 	return res - (res >= 1);
 }
 
-inline TqFloat Cq2dQuasiRandomTable::y(TqUint index) const
+inline TqFloat Cq2dQuasiRandomTable::y(TqUint index, TqFloat offsetY) const
 {
-	TqFloat res = m_y[index & (m_tableSize-1)] + m_offsetY;
+	TqFloat res = m_y[index & (m_tableSize-1)] + offsetY;
 	return res - (res >= 1);
 }
 
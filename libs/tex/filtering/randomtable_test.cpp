@@ -0,0 +1,132 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+
+/** \file
+ *
+ * \brief Unit tests for stochastic texture sampling positions.
+ */
+
+#include "randomtable.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/tex/buffers/texturebuffer.h>
+
+using namespace Aqsis;
+
+namespace {
+
+typedef CqTextureBuffer<TqFloat> TqBuffer;
+
+const TqInt numSupports = 500;
+const TqInt numSamples = 16;
+
+SqFilterSupport supportNumber(TqInt i)
+{
+	return SqFilterSupport(i % 37, i % 37 + 3 + i % 11,
+			i % 29, i % 29 + 2 + i % 7);
+}
+
+/// Record the stochastic sample positions for a range of supports.
+void samplePositions(const TqBuffer& buf, TqInt begin, TqInt end,
+		std::vector<TqInt>& positions)
+{
+	for(TqInt i = begin; i < end; ++i)
+	{
+		TqInt n = 0;
+		for(TqBuffer::TqStochasticIterator it
+				= buf.beginStochastic(supportNumber(i), numSamples);
+				it.inSupport(); ++it, ++n)
+		{
+			positions[2*(i*numSamples + n)] = it.x();
+			positions[2*(i*numSamples + n) + 1] = it.y();
+		}
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(randomtable_tests)
+
+BOOST_AUTO_TEST_CASE(Cq2dQuasiRandomTable_offset_test)
+{
+	for(TqUint key = 0; key < 1000; ++key)
+	{
+		TqFloat offset = detail::g_randTab.offset(key);
+		BOOST_CHECK(offset >= 0 && offset < 1);
+		BOOST_CHECK_EQUAL(offset, detail::g_randTab.offset(key));
+		BOOST_CHECK(detail::g_randTab.x(key, offset) < 1);
+		BOOST_CHECK(detail::g_randTab.y(key, offset) < 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqTextureBuffer_stochastic_determinism_test)
+{
+	// Stochastic sample positions depend only on the support and sample
+	// count: they're the same in any order and from any number of threads.
+	TqBuffer buf(64, 64, 1);
+	std::vector<TqInt> forward(2*numSupports*numSamples, -1);
+	samplePositions(buf, 0, numSupports, forward);
+	for(TqInt i = 0; i < numSupports; ++i)
+	{
+		SqFilterSupport support = supportNumber(i);
+		for(TqInt n = 0; n < numSamples; ++n)
+		{
+			TqInt x = forward[2*(i*numSamples + n)];
+			TqInt y = forward[2*(i*numSamples + n) + 1];
+			BOOST_CHECK(x >= support.sx.start && x < support.sx.end);
+			BOOST_CHECK(y >= support.sy.start && y < support.sy.end);
+		}
+	}
+
+	std::vector<TqInt> backward(forward.size(), -1);
+	for(TqInt i = numSupports-1; i >= 0; --i)
+		samplePositions(buf, i, i+1, backward);
+	BOOST_CHECK(forward == backward);
+
+	std::vector<TqInt> threaded(forward.size(), -1);
+	boost::thread_group threads;
+	const TqInt numThreads = 8;
+	for(TqInt t = 0; t < numThreads; ++t)
+	{
+		threads.create_thread(boost::bind(samplePositions, boost::cref(buf),
+					t*numSupports/numThreads, (t+1)*numSupports/numThreads,
+					boost::ref(threaded)));
+	}
+	threads.join_all();
+	BOOST_CHECK(forward == threaded);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
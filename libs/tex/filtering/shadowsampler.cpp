@@ -37,6 +37,9 @@
 
 #include "shadowsampler.h"
 
+#include <algorithm>
+
+#include <aqsis/util/bitvector.h>
 #include <aqsis/tex/io/itexinputfile.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/filtering/filtertexture.h>
@@ -82,6 +85,27 @@ inline void applyPCF(const CqTileArray<TqFloat>& pixelBuf,
 	}
 }
 
+/// Position of a shadow lookup, used to sort the lookups in sampleGrid().
+struct SqShadowLookup
+{
+	TqInt view;
+	TqInt tileY;
+	TqInt tileX;
+	/// Index of the point in the grid.
+	TqInt index;
+
+	bool operator<(const SqShadowLookup& rhs) const
+	{
+		if(view != rhs.view)
+			return view < rhs.view;
+		if(tileY != rhs.tileY)
+			return tileY < rhs.tileY;
+		if(tileX != rhs.tileX)
+			return tileX < rhs.tileX;
+		return index < rhs.index;
+	}
+};
+
 } // anon namespace
 
 /** \brief Class representing a single view out of the shadow map.
@@ -200,11 +224,24 @@ class CqShadowSampler::CqShadowView
 		 *
 		 * \param P - point being shaded in "current" coordinates.
 		 */
-		TqFloat weight(const CqVector3D& P)
+		TqFloat weight(const CqVector3D& P) const
 		{
 			return m_viewDirec*(P-m_lightPos);
 		}
 
+		/** \brief Find the tile of the shadow map which a point falls in.
+		 *
+		 * \param P - point being shaded in "current" coordinates.
+		 * \param tileX
+		 * \param tileY - set to the position of the tile.
+		 */
+		void tilePosition(const CqVector3D& P, TqInt& tileX, TqInt& tileY) const
+		{
+			CqVector3D rasterP = m_currToRaster*P;
+			tileX = lfloor(rasterP.x()/m_pixels.tileWidth());
+			tileY = lfloor(rasterP.y()/m_pixels.tileHeight());
+		}
+
 		/** \brief Compute occlusion from the current view direction to the
 		 * given sample region.
 		 *
@@ -298,31 +335,61 @@ CqShadowSampler::CqShadowSampler(const boost::shared_ptr<IqTiledTexInputFile>& f
 void CqShadowSampler::sample(const Sq3DSampleQuad& sampleQuad,
 		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
 {
-	// Get a suitable shadow map from the multi-map.
-	const CqShadowView* view = m_maps[0].get();
-	if(m_maps.size() > 1)
+	// Sample the shadow map for the view which sees the point best.
+	m_maps[chooseView(sampleQuad.center())]->sample(sampleQuad, sampleOpts,
+			outSamps);
+}
+
+void CqShadowSampler::sampleGrid(const Sq3DSampleQuad* sampleQuads,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	// Choose the view for each running point first, and then do the lookups
+	// in order of view and of the tile holding the centre of the region, so
+	// that lookups which read the same tiles are done together.
+	std::vector<SqShadowLookup> lookups;
+	lookups.reserve(numPoints);
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		if(runningState && !runningState->Value(i))
+			continue;
+		CqVector3D PC = sampleQuads[i].center();
+		SqShadowLookup lookup;
+		lookup.view = chooseView(PC);
+		m_maps[lookup.view]->tilePosition(PC, lookup.tileX, lookup.tileY);
+		lookup.index = i;
+		lookups.push_back(lookup);
+	}
+	std::sort(lookups.begin(), lookups.end());
+	TqInt numChannels = sampleOpts.numChannels();
+	for(std::vector<SqShadowLookup>::const_iterator i = lookups.begin(),
+			end = lookups.end(); i != end; ++i)
 	{
-		// Get the center of the sample region, we'll use
-		// this to determine which is the best view to use.
-		CqVector3D PC = sampleQuad.center();
+		m_maps[i->view]->sample(sampleQuads[i->index], sampleOpts,
+				outSamps + i->index*numChannels);
+	}
+}
 
-		// Choose the shadow view that sees the point most clearly,
-		// the more the point is in the periphery of a view, the
-		// less likely it is to be chosen.
+TqInt CqShadowSampler::chooseView(const CqVector3D& P) const
+{
+	// Choose the shadow view that sees the point most clearly, the more the
+	// point is in the periphery of a view, the less likely it is to be
+	// chosen.
+	TqInt view = 0;
+	if(m_maps.size() > 1)
+	{
 		TqFloat maxWeight = 0.0f;
-		
-		for(TqViewVec::const_iterator i = m_maps.begin(), end = m_maps.end(); i != end; ++i)
+		for(TqInt i = 0, numMaps = m_maps.size(); i < numMaps; ++i)
 		{
-			TqFloat weight = (*i)->weight(PC);
+			TqFloat weight = m_maps[i]->weight(P);
 			if(weight > maxWeight)
 			{
 				maxWeight = weight;
-				view = (*i).get();
+				view = i;
 			}
 		}
 	}
-	// Sample the shadow map for the chosen view.
-	view->sample(sampleQuad, sampleOpts, outSamps);
+	return view;
 }
 
 const CqShadowSampleOptions& CqShadowSampler::defaultSampleOptions() const
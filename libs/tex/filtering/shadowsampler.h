@@ -71,11 +71,21 @@ class AQSIS_TEX_SHARE CqShadowSampler : public IqShadowSampler
 		// inherited
 		virtual void sample(const Sq3DSampleQuad& sampleQuad,
 				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSampleQuad* sampleQuads,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
 	private:
 		class CqShadowView;
 		typedef std::vector<boost::shared_ptr<CqShadowView> > TqViewVec;
 
+		/** \brief Choose the view which sees a point most clearly.
+		 *
+		 * \param P - point being shaded in "current" coordinates.
+		 * \return The index of the view in m_maps.
+		 */
+		TqInt chooseView(const CqVector3D& P) const;
+
 		/// List of map views, used for point shadows, which have 6 subimages.
 		TqViewVec m_maps;
 		/// Default shadow sampling options.
@@ -50,6 +50,12 @@
 
 namespace Aqsis {
 
+#ifdef ENABLE_THREADING
+#	define AQSIS_LOCK_CACHE boost::mutex::scoped_lock lock(m_mutex)
+#else
+#	define AQSIS_LOCK_CACHE
+#endif
+
 //------------------------------------------------------------------------------
 // IqTextureCache creation function.
 
@@ -75,35 +81,52 @@ CqTextureCache::CqTextureCache(TqSearchPathCallback searchPathCallback)
 
 IqTextureSampler& CqTextureCache::findTextureSampler(const char* name)
 {
+	AQSIS_LOCK_CACHE;
 	return findSampler(m_textureCache, name);
 }
 
 IqEnvironmentSampler& CqTextureCache::findEnvironmentSampler(const char* name)
 {
+	AQSIS_LOCK_CACHE;
 	return findSampler(m_environmentCache, name);
 }
 
 IqShadowSampler& CqTextureCache::findShadowSampler(const char* name)
 {
+	AQSIS_LOCK_CACHE;
 	return findSampler(m_shadowCache, name);
 }
 
 IqOcclusionSampler& CqTextureCache::findOcclusionSampler(const char* name)
 {
+	AQSIS_LOCK_CACHE;
 	return findSampler(m_occlusionCache, name);
 }
 
 void CqTextureCache::flush()
 {
+	AQSIS_LOCK_CACHE;
 	m_textureCache.clear();
 	m_environmentCache.clear();
 	m_shadowCache.clear();
 	m_occlusionCache.clear();
 	m_texFileCache.clear();
+	CqTileCache::globalCache().clear();
+}
+
+void CqTextureCache::setTileMemoryLimit(std::size_t maxBytes)
+{
+	CqTileCache::globalCache().setMaxBytes(maxBytes);
+}
+
+SqTileCacheStats CqTextureCache::tileCacheStats() const
+{
+	return CqTileCache::globalCache().stats();
 }
 
 const CqTexFileHeader* CqTextureCache::textureInfo(const char* name)
 {
+	AQSIS_LOCK_CACHE;
 	boost::shared_ptr<IqTiledTexInputFile> file;
 	try
 	{
@@ -43,6 +43,9 @@
 #include <map>
 
 #include <boost/utility.hpp>
+#ifdef ENABLE_THREADING
+#include <boost/thread/mutex.hpp>
+#endif
 
 #include <aqsis/tex/filtering/itexturecache.h>
 #include <aqsis/math/matrix.h>
@@ -57,6 +60,9 @@ class IqTiledTexInputFile;
 class CqTexFileHeader;
 
 /** \brief A cache managing the various types of texture samplers.
+ *
+ * Samplers and files are kept until flush(), but their pixel data lives in
+ * the global CqTileCache, which bounds the memory used by textures.
  */
 #ifdef AQSIS_SYSTEM_WIN32
 class AQSIS_TEX_SHARE boost::noncopyable_::noncopyable;
@@ -77,6 +83,8 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		virtual IqShadowSampler& findShadowSampler(const char* name);
 		virtual IqOcclusionSampler& findOcclusionSampler(const char* name);
 		virtual void flush();
+		virtual void setTileMemoryLimit(std::size_t maxBytes);
+		virtual SqTileCacheStats tileCacheStats() const;
 		virtual const CqTexFileHeader* textureInfo(const char* name);
 		virtual void setCurrToWorldMatrix(const CqMatrix& currToWorld);
 
@@ -122,6 +130,10 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		CqMatrix m_currToWorld;
 		/// Callback function to obtain the current texture search path.
 		TqSearchPathCallback m_searchPathCallback;
+#ifdef ENABLE_THREADING
+		/// Guards the sampler and file maps against concurrent shading threads.
+		boost::mutex m_mutex;
+#endif
 };
 
 
@@ -40,8 +40,11 @@
 
 #include <aqsis/aqsis.h>
 
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <aqsis/util/bitvector.h>
 #include "ewafilter.h"
 #include <aqsis/tex/filtering/itexturesampler.h>
 #include "mipmap.h"
@@ -65,8 +68,28 @@ class AQSIS_TEX_SHARE CqTextureSampler : public IqTextureSampler
 		// from IqTextureSampler
 		virtual void sample(const SqSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const SqSampleQuad* sampleQuads, TqInt numPoints,
+				const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const SqSamplePllgram* samplePllgrams,
+				TqInt numPoints, const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqTextureSampleOptions& defaultSampleOptions() const;
 	private:
+		/// Construct the EWA filter factory for filtering over a region.
+		CqEwaFilterFactory filterFactory(const SqSamplePllgram& samplePllgram,
+				const CqTextureSampleOptions& sampleOpts,
+				const SqMatrix2D& blurVariance) const;
+		/** \brief Filter over the regions of the running points of a grid.
+		 *
+		 * The filter factories for all the running points are set up first,
+		 * and then the lookups are done together by the mipmap.
+		 */
+		template<typename RegionT>
+		void filterGrid(const RegionT* regions, TqInt numPoints,
+				const CqBitVector* runningState,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		boost::shared_ptr<LevelCacheT> m_levels;
 };
 
@@ -84,6 +107,36 @@ CqTextureSampler<LevelCacheT>::CqTextureSampler(
 template<typename LevelCacheT>
 void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	CqEwaFilterFactory ewaFactory = filterFactory(samplePllgram, sampleOpts,
+			ewaBlurMatrix(sampleOpts.sBlur(), sampleOpts.tBlur()));
+
+	// Call through to the mipmap class to do the main filtering work.
+	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
+}
+
+template<typename LevelCacheT>
+void CqTextureSampler<LevelCacheT>::sampleGrid(const SqSampleQuad* sampleQuads,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	filterGrid(sampleQuads, numPoints, runningState, sampleOpts, outSamps);
+}
+
+template<typename LevelCacheT>
+void CqTextureSampler<LevelCacheT>::sampleGrid(
+		const SqSamplePllgram* samplePllgrams, TqInt numPoints,
+		const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	filterGrid(samplePllgrams, numPoints, runningState, sampleOpts, outSamps);
+}
+
+template<typename LevelCacheT>
+CqEwaFilterFactory CqTextureSampler<LevelCacheT>::filterFactory(
+		const SqSamplePllgram& samplePllgram,
+		const CqTextureSampleOptions& sampleOpts,
+		const SqMatrix2D& blurVariance) const
 {
 	// Scale width if necessary
 	SqSamplePllgram pllgram(samplePllgram);
@@ -93,12 +146,23 @@ void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 			sampleOpts.tWrapMode() == WrapMode_Periodic);
 
 	// Construct EWA filter factory
-	CqEwaFilterFactory ewaFactory(pllgram, m_levels->width0(), m_levels->height0(),
-			ewaBlurMatrix(sampleOpts.sBlur(), sampleOpts.tBlur()),
-			-sampleOpts.logTruncAmount());
+	return CqEwaFilterFactory(pllgram, m_levels->width0(), m_levels->height0(),
+			blurVariance, -sampleOpts.logTruncAmount());
+}
 
-	// Call through to the mipmap class to do the main filtering work.
-	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
+template<typename LevelCacheT>
+template<typename RegionT>
+void CqTextureSampler<LevelCacheT>::filterGrid(const RegionT* regions,
+		TqInt numPoints, const CqBitVector* runningState,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	// The blur is the same for all points.
+	SqMatrix2D blurVariance = ewaBlurMatrix(sampleOpts.sBlur(), sampleOpts.tBlur());
+	detail::filterGridRegions<SqSamplePllgram>(*m_levels, regions, numPoints,
+			runningState, sampleOpts,
+			boost::bind(&CqTextureSampler::filterFactory, this, _1,
+				boost::cref(sampleOpts), boost::cref(blurVariance)),
+			outSamps);
 }
 
 template<typename LevelCacheT>
@@ -0,0 +1,218 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for filtering grids of points with the texture sampler.
+ */
+
+#include "texturesampler.h"
+
+#include <cmath>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/tex/buffers/tilearray.h>
+#include <aqsis/tex/io/itiledtexinputfile.h>
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_SUITE(texturesampler_tests)
+
+namespace {
+
+/** \brief A tiled mipmapped float texture held in memory.
+ *
+ * Each level of the mipmap holds two channels with smoothly varying values,
+ * different from one level to the next.
+ */
+class CqMemoryMipmapFile : public IqTiledTexInputFile
+{
+	public:
+		CqMemoryMipmapFile(TqInt width, TqInt height, TqInt tileSize)
+			: m_header(),
+			m_tileInfo(tileSize, tileSize),
+			m_widths(),
+			m_heights()
+		{
+			m_header.setWidth(width);
+			m_header.setHeight(height);
+			m_header.channelList().addChannel(SqChannelInfo("r", Channel_Float32));
+			m_header.channelList().addChannel(SqChannelInfo("g", Channel_Float32));
+			while(true)
+			{
+				m_widths.push_back(width);
+				m_heights.push_back(height);
+				if(width == 1 && height == 1)
+					break;
+				width = (width+1)/2;
+				height = (height+1)/2;
+			}
+		}
+
+		virtual boostfs::path fileName() const { return "memory.tex"; }
+		virtual EqImageFileType fileType() const { return ImageFile_Unknown; }
+		virtual const CqTexFileHeader& header(TqInt index = 0) const
+		{
+			return m_header;
+		}
+		virtual SqTileInfo tileInfo() const { return m_tileInfo; }
+		virtual TqInt numSubImages() const { return m_widths.size(); }
+		virtual TqInt width(TqInt index) const { return m_widths[index]; }
+		virtual TqInt height(TqInt index) const { return m_heights[index]; }
+
+	protected:
+		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
+				TqInt subImageIdx, const SqTileInfo tileSize) const
+		{
+			TqFloat* pixels = reinterpret_cast<TqFloat*>(buffer);
+			for(TqInt j = 0; j < tileSize.height; ++j)
+			{
+				TqInt y = tileY*m_tileInfo.height + j;
+				for(TqInt i = 0; i < tileSize.width; ++i)
+				{
+					TqInt x = tileX*m_tileInfo.width + i;
+					*pixels++ = std::sin(0.3f*x + 0.1f*subImageIdx)*std::cos(0.2f*y);
+					*pixels++ = 0.01f*(x + 2*y) + subImageIdx;
+				}
+			}
+		}
+
+	private:
+		CqTexFileHeader m_header;
+		SqTileInfo m_tileInfo;
+		std::vector<TqInt> m_widths;
+		std::vector<TqInt> m_heights;
+};
+
+typedef CqMipmap<CqTileArray<TqFloat> > TqMemoryMipmap;
+
+boost::shared_ptr<TqMemoryMipmap> makeMipmap()
+{
+	// 128x128 in 16x16 tiles, so the lookups below fall across several
+	// tiles of each level.
+	return boost::shared_ptr<TqMemoryMipmap>(new TqMemoryMipmap(
+		boost::shared_ptr<IqTiledTexInputFile>(
+			new CqMemoryMipmapFile(128, 128, 16))));
+}
+
+/** \brief Make a grid of sample quads spread over the texture.
+ *
+ * The size of the quads cycles through several powers of two so that the
+ * lookups are done on a range of mipmap levels.
+ */
+std::vector<SqSampleQuad> makeQuads(TqInt numPoints)
+{
+	std::vector<SqSampleQuad> quads;
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		TqFloat size = 0.005f*(1 << (i % 6));
+		CqVector2D c(0.05f + 0.9f*(i % 7)/6, 0.05f + 0.9f*(i % 11)/10);
+		CqVector2D skew(0.2f*size, 0);
+		quads.push_back(SqSampleQuad(c, c + CqVector2D(size, 0) + skew,
+				c + CqVector2D(0, size), c + CqVector2D(size, size) + skew));
+	}
+	return quads;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqTextureSampler_sampleGrid_test)
+{
+	boost::shared_ptr<TqMemoryMipmap> mipmap = makeMipmap();
+	CqTextureSampler<TqMemoryMipmap> sampler(mipmap);
+
+	CqTextureSampleOptions opts = sampler.defaultSampleOptions();
+	opts.setNumChannels(2);
+	const TqInt numPoints = 60;
+	const TqInt numChannels = opts.numChannels();
+	std::vector<SqSampleQuad> quads = makeQuads(numPoints);
+
+	// Leave every third point out of the lookup.
+	CqBitVector runningState(numPoints);
+	runningState.SetAll(true);
+	for(TqInt i = 0; i < numPoints; i += 3)
+		runningState.SetValue(i, false);
+
+	for(TqInt lerp = 0; lerp < 2; ++lerp)
+	{
+		// Check both with and without interpolation between levels.
+		opts.setLerp(lerp ? Lerp_Always : Lerp_Never);
+		const TqFloat unset = -100;
+		std::vector<TqFloat> gridSamps(numPoints*numChannels, unset);
+		sampler.sampleGrid(&quads[0], numPoints, &runningState, opts,
+				&gridSamps[0]);
+		std::vector<TqFloat> pllgramSamps(numPoints*numChannels, unset);
+		std::vector<SqSamplePllgram> pllgrams(quads.begin(), quads.end());
+		sampler.sampleGrid(&pllgrams[0], numPoints, &runningState, opts,
+				&pllgramSamps[0]);
+
+		for(TqInt i = 0; i < numPoints; ++i)
+		{
+			TqFloat pointSamps[2] = {unset, unset};
+			if(runningState.Value(i))
+				sampler.sample(SqSamplePllgram(quads[i]), opts, pointSamps);
+			for(TqInt c = 0; c < numChannels; ++c)
+			{
+				BOOST_CHECK_EQUAL(gridSamps[i*numChannels + c], pointSamps[c]);
+				BOOST_CHECK_EQUAL(pllgramSamps[i*numChannels + c], pointSamps[c]);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqMipmap_applyFilters_test)
+{
+	boost::shared_ptr<TqMemoryMipmap> mipmap = makeMipmap();
+	CqTextureSampleOptions opts = mipmap->defaultSampleOptions();
+	opts.setNumChannels(2);
+	const TqInt numPoints = 40;
+	std::vector<SqSampleQuad> quads = makeQuads(numPoints);
+
+	std::vector<CqEwaFilterFactory> factories;
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		factories.push_back(CqEwaFilterFactory(SqSamplePllgram(quads[i]),
+				mipmap->width0(), mipmap->height0(), ewaBlurMatrix(0, 0)));
+	}
+	std::vector<TqFloat> samps(2*numPoints);
+	mipmap->applyFilters(&factories[0], numPoints, opts, &samps[0]);
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		TqFloat pointSamps[2];
+		mipmap->applyFilter(factories[i], opts, pointSamps);
+		BOOST_CHECK_EQUAL(samps[2*i], pointSamps[0]);
+		BOOST_CHECK_EQUAL(samps[2*i+1], pointSamps[1]);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -110,6 +110,21 @@ class CqCachedFilter
 		/// Set the top left point in the filter support
 		void setSupportTopLeft(TqInt x, TqInt y);
 
+		/** \brief Split the filter into horizontal and vertical weights.
+		 *
+		 * Most filters are separable, meaning that the weight at (x,y) is the
+		 * product of a weight depending only on x and one depending only on
+		 * y.  Such filters can be applied with a pass in each direction, which
+		 * is much cheaper than a pass over the full kernel.
+		 *
+		 * \param xWeights - set to the width() horizontal weights.
+		 * \param yWeights - set to the height() vertical weights.
+		 * \return true if the filter is separable; the weights are only set in
+		 *         this case.
+		 */
+		bool separate(std::vector<TqFloat>& xWeights,
+				std::vector<TqFloat>& yWeights) const;
+
 	private:
 		TqInt m_width; ///< number of points in horizontal lattice directon
 		TqInt m_height; ///< number of points in vertical lattice directon
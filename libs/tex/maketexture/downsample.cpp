@@ -0,0 +1,76 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Thread pool for creating mipmaps.
+ */
+
+#include "downsample.h"
+
+#include <boost/scoped_ptr.hpp>
+#ifdef ENABLE_THREADING
+#	include <boost/thread/once.hpp>
+#endif
+
+namespace Aqsis {
+
+namespace detail {
+
+namespace {
+
+boost::scoped_ptr<CqThreadScheduler> g_downsampleScheduler;
+#ifdef ENABLE_THREADING
+boost::once_flag g_downsampleSchedulerOnce = BOOST_ONCE_INIT;
+#endif
+
+void createDownsampleScheduler()
+{
+	g_downsampleScheduler.reset(new CqThreadScheduler(0));
+}
+
+} // unnamed namespace
+
+CqThreadScheduler& downsampleScheduler()
+{
+	// The pool is only started once it's needed, so programs which never
+	// make textures don't pay for the threads.
+#	ifdef ENABLE_THREADING
+	boost::call_once(g_downsampleSchedulerOnce, createDownsampleScheduler);
+#	else
+	if(!g_downsampleScheduler)
+		createDownsampleScheduler();
+#	endif
+	return *g_downsampleScheduler;
+}
+
+} // namespace detail
+
+} // namespace Aqsis
@@ -40,9 +40,17 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
+#ifdef ENABLE_THREADING
+#	include <boost/bind.hpp>
+#	include <boost/ref.hpp>
+#endif
 
 #include <aqsis/math/math.h>
+#include <aqsis/util/threadscheduler.h>
 #include "cachedfilter.h"
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/filtering/filtertexture.h>
@@ -115,6 +123,150 @@ template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
 		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
 
+/** \brief Downsampler for separable filters, fed a strip of rows at a time.
+ *
+ * Each source row is filtered horizontally, and the result is added into the
+ * destination rows which the row contributes to.  Destination rows are
+ * accumulated as floats and stored into the destination image as soon as
+ * their last source row has been added, so only a few rows are held open at
+ * once, plus those at the top which wrap around to the bottom of the source.
+ *
+ * The source image therefore never needs to be resident all at once, which
+ * allows the first level of a mipmap to be streamed from the input file.
+ * Each strip is filtered in parallel over bands of columns when threading is
+ * enabled.
+ */
+template<typename ArrayT>
+class CqSeparableDownsampler
+{
+	public:
+		/** \brief Prepare to downsample an image of the given size.
+		 *
+		 * \param srcWidth
+		 * \param srcHeight - dimensions of the source image.
+		 * \param numChannels - number of channels in the source image.
+		 * \param mipmapRatio - factor to reduce the image dimensions by.
+		 * \param xWeights
+		 * \param yWeights - filter weights from CqCachedFilter::separate().
+		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 */
+		CqSeparableDownsampler(TqInt srcWidth, TqInt srcHeight,
+				TqInt numChannels, TqInt mipmapRatio,
+				const std::vector<TqFloat>& xWeights,
+				const std::vector<TqFloat>& yWeights,
+				const SqWrapModes& wrapModes);
+		/** \brief Add the next few rows of the source image.
+		 *
+		 * Rows must be added in order, starting from the top.
+		 *
+		 * \param buf - buffer holding the rows, with the width of the source.
+		 * \param bufRow - first row of buf to add.
+		 * \param numRows - number of rows to add.
+		 */
+		void addRows(const ArrayT& buf, TqInt bufRow, TqInt numRows);
+		/// Get the downsampled image, complete once all source rows are added.
+		const boost::shared_ptr<ArrayT>& result() const;
+		/** \brief Get the downsampled image while it's being built.
+		 *
+		 * Rows [0, numFinishedRows()) are complete.
+		 */
+		const ArrayT& partialResult() const;
+		/// Number of complete rows at the top of the downsampled image.
+		TqInt numFinishedRows() const;
+
+	private:
+		class CqFilterColumns;
+		/// Weighted contribution of a source row to a destination row.
+		struct SqContribution
+		{
+			TqInt destRow;
+			TqFloat weight;
+		};
+
+		/// Store a finished destination row and release its accumulator.
+		void finishRow(TqInt row);
+
+		TqInt m_srcWidth;
+		TqInt m_srcHeight;
+		TqInt m_numChannels;
+		/// Index of the next source row to be added.
+		TqInt m_nextSrcRow;
+		std::vector<TqFloat> m_xWeights;
+		/// Source column for each destination column and filter tap, or -1
+		/// where the tap contributes nothing.
+		std::vector<TqInt> m_xTaps;
+		/// Contributions of each source row are in
+		/// [m_contribStart[row], m_contribStart[row+1]) of m_contributions.
+		std::vector<TqInt> m_contribStart;
+		std::vector<SqContribution> m_contributions;
+		/// Number of contributions still to be added to each destination row.
+		std::vector<TqInt> m_contribsLeft;
+		/// Accumulators for the open destination rows; empty otherwise.
+		std::vector<std::vector<TqFloat> > m_openRows;
+		/// Number of complete rows at the top of the destination image.
+		TqInt m_numFinishedRows;
+		boost::shared_ptr<ArrayT> m_destBuf;
+};
+
+/** \brief Build all the smaller levels of a mipmap from strips of the first.
+ *
+ * Each level has its own CqSeparableDownsampler.  Strips of the first level
+ * are fed to the downsampler for the second, and the rows of each level are
+ * passed on to the downsampler for the next level as soon as they're
+ * finished.  Every level is therefore built in a single pass over the source,
+ * while the rows of each level are still in cache.  The smaller levels are
+ * held until the source is complete, because mipmap levels are written out in
+ * order; together they take about a third of the memory of the source.
+ */
+template<typename ArrayT>
+class CqMipmapStreamer
+{
+	public:
+		/** \brief Prepare to build the mipmap of an image of the given size.
+		 *
+		 * \param width
+		 * \param height - dimensions of the first mipmap level.
+		 * \param numChannels - number of channels in the image.
+		 * \param filterInfo - information about which filter type and size to use
+		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 */
+		CqMipmapStreamer(TqInt width, TqInt height, TqInt numChannels,
+				const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
+		/** \brief Determine whether the levels can be streamed.
+		 *
+		 * Streaming needs the filter to be separable at every level.  If it
+		 * isn't, there are no levels, and no rows should be added.
+		 */
+		bool isSeparable() const;
+		/** \brief Add the next few rows of the first level.
+		 *
+		 * Rows must be added in order, starting from the top.
+		 *
+		 * \param buf - buffer holding the rows, with the width of the image.
+		 * \param bufRow - first row of buf to add.
+		 * \param numRows - number of rows to add.
+		 */
+		void addRows(const ArrayT& buf, TqInt bufRow, TqInt numRows);
+		/// Get the number of levels after the first.
+		TqInt numLevels() const;
+		/** \brief Get a level of the mipmap.
+		 *
+		 * The levels are complete once all rows of the first level are added.
+		 *
+		 * \param i - level to get, from 1 for the second level to numLevels().
+		 */
+		const boost::shared_ptr<ArrayT>& level(TqInt i) const;
+
+	private:
+		typedef CqSeparableDownsampler<ArrayT> TqDownsampler;
+
+		/// Downsamplers producing levels 1 to numLevels().
+		std::vector<boost::shared_ptr<TqDownsampler> > m_downsamplers;
+		/// Number of rows of each level already passed on to the next.
+		std::vector<TqInt> m_rowsPassedOn;
+		bool m_separable;
+};
+
 
 
 //==============================================================================
@@ -161,16 +313,416 @@ bool CqDownsampleIterator<ArrayT>::operator!=(const CqDownsampleIterator<ArrayT>
 }
 
 
+//------------------------------------------------------------------------------
+// CqSeparableDownsampler implementation
+
+namespace detail {
+
+/** \brief Map a position in a texture back inside it, according to the wrap mode.
+ *
+ * Truncated filters are wrapped periodically, as they are by filterTexture()
+ * with normalized filter weights.
+ *
+ * \return the position inside [0, size), or -1 if the position is black.
+ */
+inline TqInt wrapPosition(TqInt pos, TqInt size, EqWrapMode wrapMode)
+{
+	if(pos >= 0 && pos < size)
+		return pos;
+	switch(wrapMode)
+	{
+		case WrapMode_Black:
+			return -1;
+		case WrapMode_Clamp:
+			return clamp(pos, 0, size-1);
+		default:
+			pos %= size;
+			return pos < 0 ? pos + size : pos;
+	}
+}
+
+/** \brief Get the pool of threads shared by all the parallel filter operations.
+ *
+ * The pool is started on first use, with one thread per core, and lives for
+ * the rest of the program, so strips and mipmap levels don't each pay for
+ * creating threads.
+ */
+AQSIS_TEX_SHARE CqThreadScheduler& downsampleScheduler();
+
+/** \brief Call f(begin, end) for ranges which together cover [0, n).
+ *
+ * When threading is enabled the ranges are processed in parallel on the
+ * downsampleScheduler() pool, with up to one range per thread but no range
+ * shorter than minSize.  This mustn't be called from a work unit of the pool.
+ */
+template<typename FuncT>
+void parallelRanges(TqInt n, TqInt minSize, const FuncT& f)
+{
+#	ifdef ENABLE_THREADING
+	CqThreadScheduler& scheduler = downsampleScheduler();
+	TqInt numRanges = min(scheduler.numThreads(), n/minSize);
+	if(numRanges > 1)
+	{
+		for(TqInt i = 0; i < numRanges; ++i)
+		{
+			scheduler.addWorkUnit(boost::bind<void>(boost::cref(f),
+						n*i/numRanges, n*(i+1)/numRanges));
+		}
+		scheduler.joinAll();
+		return;
+	}
+#	endif
+	f(0, n);
+}
+
+/// Minimum number of pixels in each band of a parallel filter operation.
+const TqInt minParallelBand = 128;
+
+} // namespace detail
+
+/// Filter a strip of source rows into the open destination rows, over a band of columns.
+template<typename ArrayT>
+class CqSeparableDownsampler<ArrayT>::CqFilterColumns
+{
+	public:
+		CqFilterColumns(CqSeparableDownsampler& downsampler, const ArrayT& buf,
+				TqInt bufRow, TqInt numRows)
+			: m_downsampler(downsampler),
+			m_buf(buf),
+			m_bufRow(bufRow),
+			m_numRows(numRows)
+		{ }
+
+		void operator()(TqInt startCol, TqInt endCol) const
+		{
+			const CqSeparableDownsampler& d = m_downsampler;
+			const TqInt numChannels = d.m_numChannels;
+			const TqInt filterWidth = d.m_xWeights.size();
+			const TqInt bandSize = (endCol - startCol)*numChannels;
+			std::vector<TqFloat> filteredRow(bandSize);
+			for(TqInt row = 0; row < m_numRows; ++row)
+			{
+				// Horizontal pass: filter the source row into filteredRow.
+				TqInt bufRow = m_bufRow + row;
+				TqFloat* out = &filteredRow[0];
+				for(TqInt x = startCol; x < endCol; ++x, out += numChannels)
+				{
+					std::fill(out, out + numChannels, 0.0f);
+					const TqInt* taps = &d.m_xTaps[x*filterWidth];
+					for(TqInt i = 0; i < filterWidth; ++i)
+					{
+						if(taps[i] < 0)
+							continue;
+						typename ArrayT::TqSampleVector samples = m_buf(taps[i], bufRow);
+						TqFloat weight = d.m_xWeights[i];
+						for(TqInt c = 0; c < numChannels; ++c)
+							out[c] += weight*samples[c];
+					}
+				}
+				// Vertical pass: add the filtered row into each destination
+				// row it contributes to.  These are plain loops over
+				// contiguous floats, which the compiler vectorizes.
+				TqInt srcRow = d.m_nextSrcRow + row;
+				const TqFloat* in = &filteredRow[0];
+				for(TqInt k = d.m_contribStart[srcRow], kEnd = d.m_contribStart[srcRow+1];
+						k < kEnd; ++k)
+				{
+					const SqContribution& contrib = d.m_contributions[k];
+					TqFloat* acc = &m_downsampler.m_openRows[contrib.destRow][startCol*numChannels];
+					const TqFloat weight = contrib.weight;
+					for(TqInt j = 0; j < bandSize; ++j)
+						acc[j] += weight*in[j];
+				}
+			}
+		}
+
+	private:
+		CqSeparableDownsampler& m_downsampler;
+		const ArrayT& m_buf;
+		TqInt m_bufRow;
+		TqInt m_numRows;
+};
+
+template<typename ArrayT>
+CqSeparableDownsampler<ArrayT>::CqSeparableDownsampler(TqInt srcWidth,
+		TqInt srcHeight, TqInt numChannels, TqInt mipmapRatio,
+		const std::vector<TqFloat>& xWeights,
+		const std::vector<TqFloat>& yWeights,
+		const SqWrapModes& wrapModes)
+	: m_srcWidth(srcWidth),
+	m_srcHeight(srcHeight),
+	m_numChannels(numChannels),
+	m_nextSrcRow(0),
+	m_xWeights(xWeights),
+	m_xTaps(),
+	m_contribStart(srcHeight+1, 0),
+	m_contributions(),
+	m_contribsLeft(),
+	m_openRows(),
+	m_numFinishedRows(0),
+	m_destBuf()
+{
+	TqInt newWidth = lceil(TqFloat(srcWidth)/mipmapRatio);
+	TqInt newHeight = lceil(TqFloat(srcHeight)/mipmapRatio);
+	m_destBuf.reset(new ArrayT(newWidth, newHeight, numChannels));
+	m_contribsLeft.resize(newHeight, 0);
+	m_openRows.resize(newHeight);
+
+	// Tabulate the source columns for each destination column.
+	TqInt filterWidth = xWeights.size();
+	TqInt filterOffsetX = (filterWidth-1) / 2;
+	m_xTaps.resize(newWidth*filterWidth);
+	for(TqInt x = 0; x < newWidth; ++x)
+	{
+		for(TqInt i = 0; i < filterWidth; ++i)
+		{
+			m_xTaps[x*filterWidth + i] = xWeights[i] == 0 ? -1
+				: detail::wrapPosition(mipmapRatio*x - filterOffsetX + i,
+						srcWidth, wrapModes.sWrap);
+		}
+	}
+
+	// Find the contributions of each source row to the destination rows,
+	// ordered by source row.
+	TqInt filterHeight = yWeights.size();
+	TqInt filterOffsetY = (filterHeight-1) / 2;
+	std::vector<TqInt> srcRows(newHeight*filterHeight);
+	for(TqInt y = 0; y < newHeight; ++y)
+	{
+		for(TqInt j = 0; j < filterHeight; ++j)
+		{
+			TqInt srcRow = yWeights[j] == 0 ? -1
+				: detail::wrapPosition(mipmapRatio*y - filterOffsetY + j,
+						srcHeight, wrapModes.tWrap);
+			srcRows[y*filterHeight + j] = srcRow;
+			if(srcRow >= 0)
+			{
+				++m_contribStart[srcRow+1];
+				++m_contribsLeft[y];
+			}
+		}
+	}
+	for(TqInt row = 0; row < srcHeight; ++row)
+		m_contribStart[row+1] += m_contribStart[row];
+	m_contributions.resize(m_contribStart[srcHeight]);
+	std::vector<TqInt> fill(m_contribStart.begin(), m_contribStart.end()-1);
+	for(TqInt y = 0; y < newHeight; ++y)
+	{
+		for(TqInt j = 0; j < filterHeight; ++j)
+		{
+			TqInt srcRow = srcRows[y*filterHeight + j];
+			if(srcRow < 0)
+				continue;
+			SqContribution& contrib = m_contributions[fill[srcRow]++];
+			contrib.destRow = y;
+			contrib.weight = yWeights[j];
+		}
+	}
+	// Rows which no source row contributes to are black.
+	for(TqInt y = 0; y < newHeight; ++y)
+	{
+		if(m_contribsLeft[y] == 0)
+		{
+			m_openRows[y].resize(newWidth*numChannels, 0);
+			finishRow(y);
+		}
+	}
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::addRows(const ArrayT& buf, TqInt bufRow,
+		TqInt numRows)
+{
+	assert(buf.width() == m_srcWidth);
+	assert(m_nextSrcRow + numRows <= m_srcHeight);
+	TqInt rowSize = m_destBuf->width()*m_numChannels;
+	TqInt contribBegin = m_contribStart[m_nextSrcRow];
+	TqInt contribEnd = m_contribStart[m_nextSrcRow + numRows];
+	// Open the destination rows which the new rows contribute to.
+	for(TqInt k = contribBegin; k < contribEnd; ++k)
+	{
+		std::vector<TqFloat>& acc = m_openRows[m_contributions[k].destRow];
+		if(acc.empty())
+			acc.resize(rowSize, 0);
+	}
+	detail::parallelRanges(m_destBuf->width(), detail::minParallelBand,
+			CqFilterColumns(*this, buf, bufRow, numRows));
+	for(TqInt k = contribBegin; k < contribEnd; ++k)
+	{
+		TqInt destRow = m_contributions[k].destRow;
+		if(--m_contribsLeft[destRow] == 0)
+			finishRow(destRow);
+	}
+	m_nextSrcRow += numRows;
+}
+
+template<typename ArrayT>
+const boost::shared_ptr<ArrayT>& CqSeparableDownsampler<ArrayT>::result() const
+{
+	assert(m_nextSrcRow == m_srcHeight);
+	return m_destBuf;
+}
+
+template<typename ArrayT>
+const ArrayT& CqSeparableDownsampler<ArrayT>::partialResult() const
+{
+	return *m_destBuf;
+}
+
+template<typename ArrayT>
+TqInt CqSeparableDownsampler<ArrayT>::numFinishedRows() const
+{
+	return m_numFinishedRows;
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::finishRow(TqInt row)
+{
+	std::vector<TqFloat>& acc = m_openRows[row];
+	for(TqInt x = 0, width = m_destBuf->width(); x < width; ++x)
+		m_destBuf->setPixel(x, row, &acc[x*m_numChannels]);
+	std::vector<TqFloat>().swap(acc);
+	// Rows at the top may wait for the bottom of the source when wrapping
+	// periodically, so rows can finish out of order.
+	TqInt height = m_destBuf->height();
+	while(m_numFinishedRows < height && m_contribsLeft[m_numFinishedRows] == 0)
+		++m_numFinishedRows;
+}
+
+
+//------------------------------------------------------------------------------
+// CqMipmapStreamer implementation
+
+template<typename ArrayT>
+CqMipmapStreamer<ArrayT>::CqMipmapStreamer(TqInt width, TqInt height,
+		TqInt numChannels, const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes)
+	: m_downsamplers(),
+	m_rowsPassedOn(),
+	m_separable(true)
+{
+	// Amount to scale each level by, as in downsample().
+	const TqInt mipmapRatio = 2;
+	while(width > 1 || height > 1)
+	{
+		CqCachedFilter weights(filterInfo, width % 2 != 0, height % 2 != 0,
+				1.0f/mipmapRatio);
+		std::vector<TqFloat> xWeights;
+		std::vector<TqFloat> yWeights;
+		if(!weights.separate(xWeights, yWeights))
+		{
+			m_downsamplers.clear();
+			m_separable = false;
+			return;
+		}
+		m_downsamplers.push_back(boost::shared_ptr<TqDownsampler>(
+				new TqDownsampler(width, height, numChannels, mipmapRatio,
+					xWeights, yWeights, wrapModes)));
+		width = lceil(TqFloat(width)/mipmapRatio);
+		height = lceil(TqFloat(height)/mipmapRatio);
+	}
+	m_rowsPassedOn.resize(m_downsamplers.size(), 0);
+}
+
+template<typename ArrayT>
+bool CqMipmapStreamer<ArrayT>::isSeparable() const
+{
+	return m_separable;
+}
+
+template<typename ArrayT>
+void CqMipmapStreamer<ArrayT>::addRows(const ArrayT& buf, TqInt bufRow,
+		TqInt numRows)
+{
+	if(m_downsamplers.empty())
+		return;
+	m_downsamplers[0]->addRows(buf, bufRow, numRows);
+	// Pass the newly finished rows of each level on to the next.
+	for(TqInt i = 0, numDownsamplers = m_downsamplers.size();
+			i + 1 < numDownsamplers; ++i)
+	{
+		const TqDownsampler& d = *m_downsamplers[i];
+		TqInt numFinished = d.numFinishedRows();
+		if(numFinished == m_rowsPassedOn[i])
+			break;
+		m_downsamplers[i+1]->addRows(d.partialResult(), m_rowsPassedOn[i],
+				numFinished - m_rowsPassedOn[i]);
+		m_rowsPassedOn[i] = numFinished;
+	}
+}
+
+template<typename ArrayT>
+TqInt CqMipmapStreamer<ArrayT>::numLevels() const
+{
+	return m_downsamplers.size();
+}
+
+template<typename ArrayT>
+const boost::shared_ptr<ArrayT>& CqMipmapStreamer<ArrayT>::level(TqInt i) const
+{
+	assert(i >= 1 && i <= numLevels());
+	return m_downsamplers[i-1]->result();
+}
+
+
 //------------------------------------------------------------------------------
 // free functions implementation
 
 namespace detail {
 
+/// Filter a band of rows of the destination image with a nonseparable filter.
+template<typename ArrayT>
+class CqNonseparableRows
+{
+	public:
+		CqNonseparableRows(const ArrayT& srcBuf, ArrayT& destBuf,
+				TqInt mipmapRatio, const CqCachedFilter& filterWeights,
+				const SqWrapModes& wrapModes)
+			: m_srcBuf(srcBuf),
+			m_destBuf(destBuf),
+			m_mipmapRatio(mipmapRatio),
+			m_filterWeights(filterWeights),
+			m_wrapModes(wrapModes)
+		{ }
+
+		void operator()(TqInt startRow, TqInt endRow) const
+		{
+			// Each band positions its own copy of the filter.
+			CqCachedFilter filterWeights = m_filterWeights;
+			TqInt numChannels = m_srcBuf.numChannels();
+			TqInt filterOffsetX = (filterWeights.width()-1) / 2;
+			TqInt filterOffsetY = (filterWeights.height()-1) / 2;
+			std::vector<TqFloat> accumBuf(numChannels);
+			for(TqInt y = startRow; y < endRow; ++y)
+			{
+				for(TqInt x = 0, newWidth = m_destBuf.width(); x < newWidth; ++x)
+				{
+					// Filter the source buffer to get the channels for a
+					// single pixel in the destination buffer.
+					filterWeights.setSupportTopLeft(m_mipmapRatio*x-filterOffsetX,
+							m_mipmapRatio*y-filterOffsetY);
+					CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0,
+							numChannels, &accumBuf[0]);
+					filterTexture(accumulator, m_srcBuf, filterWeights.support(),
+							m_wrapModes);
+					m_destBuf.setPixel(x, y, &accumBuf[0]);
+				}
+			}
+		}
+
+	private:
+		const ArrayT& m_srcBuf;
+		ArrayT& m_destBuf;
+		TqInt m_mipmapRatio;
+		const CqCachedFilter& m_filterWeights;
+		SqWrapModes m_wrapModes;
+};
+
 /** \brief Downsample a buffer for mipmapping via a nonseperable convolution.
  *
  * Nonseperable convolution is the most general way of forming a weighted
- * average during filtering.  A seperable convolution should be faster, but is
- * more complicated to implement.
+ * average during filtering, but is slow for wide filters.  Bands of rows are
+ * filtered in parallel when threading is enabled.
  *
  * \param srcBuf - input texture buffer.
  * \param mipmapRatio - scale factor for the new file (0.5 for normal mipmapping)
@@ -180,32 +732,42 @@ namespace detail {
 template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsampleNonseperable(
 		const ArrayT& srcBuf, TqInt mipmapRatio,
-		CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
+		const CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
 {
 	TqInt newWidth = lceil(TqFloat(srcBuf.width())/mipmapRatio);
 	TqInt newHeight = lceil(TqFloat(srcBuf.height())/mipmapRatio);
-	TqInt numChannels = srcBuf.numChannels();
-	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight, numChannels));
-	TqInt filterOffsetX = (filterWeights.width()-1) / 2;
-	TqInt filterOffsetY = (filterWeights.height()-1) / 2;
-	std::vector<TqFloat> accumBuf(numChannels);
-	// Loop over pixels in the output image.
-	for(TqInt y = 0; y < newHeight; ++y)
-	{
-		for(TqInt x = 0; x < newWidth; ++x)
-		{
-			// Filter the source buffer to get the channels for a single pixel
-			// in the destination buffer.
-			filterWeights.setSupportTopLeft(2*x-filterOffsetX, 2*y-filterOffsetY);
-			CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0, numChannels, &accumBuf[0]);
-			filterTexture(accumulator, srcBuf, filterWeights.support(),
-					SqWrapModes(wrapModes.sWrap, wrapModes.tWrap));
-			destBuf->setPixel(x, y, &accumBuf[0]);
-		}
-	}
+	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight,
+				srcBuf.numChannels()));
+	parallelRanges(newHeight, max(1, minParallelBand/newWidth),
+			CqNonseparableRows<ArrayT>(srcBuf, *destBuf, mipmapRatio,
+				filterWeights, wrapModes));
 	return destBuf;
 }
 
+/** \brief Downsample a buffer for mipmapping with a separable filter.
+ *
+ * \param srcBuf - input texture buffer.
+ * \param mipmapRatio - scale factor for the new file (0.5 for normal mipmapping)
+ * \param xWeights
+ * \param yWeights - filter weights from CqCachedFilter::separate().
+ * \param wrapModes - specify how the texture will be wrapped at the edges.
+ */
+template<typename ArrayT>
+boost::shared_ptr<ArrayT> downsampleSeparable(
+		const ArrayT& srcBuf, TqInt mipmapRatio,
+		const std::vector<TqFloat>& xWeights,
+		const std::vector<TqFloat>& yWeights, const SqWrapModes& wrapModes)
+{
+	CqSeparableDownsampler<ArrayT> downsampler(srcBuf.width(), srcBuf.height(),
+			srcBuf.numChannels(), mipmapRatio, xWeights, yWeights, wrapModes);
+	// Add the rows a strip at a time to keep the number of open destination
+	// rows down.
+	const TqInt stripHeight = 32;
+	for(TqInt row = 0, height = srcBuf.height(); row < height; row += stripHeight)
+		downsampler.addRows(srcBuf, row, min(stripHeight, height - row));
+	return downsampler.result();
+}
+
 } // namespace detail
 
 
@@ -217,15 +779,16 @@ boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
 	TqInt mipmapRatio = 2;
 	TqFloat scale = 1.0f/mipmapRatio;
 
-	/// \todo Optimize for seperable filters.  This should also give some idea
-	/// about how to optimize the analogous filtering operations in the core renderer.
-	//
-	// if(FilterFunctorT::isSeperable()) ...
-
-	// General case: Non-seperable filter.
-
 	CqCachedFilter weights(filterInfo, srcBuf.width() % 2 != 0,
 			srcBuf.height() % 2 != 0, scale);
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	if(weights.separate(xWeights, yWeights))
+	{
+		return detail::downsampleSeparable(srcBuf, mipmapRatio, xWeights,
+				yWeights, wrapModes);
+	}
+	// General case: Non-seperable filter.
 	return detail::downsampleNonseperable(srcBuf, mipmapRatio, weights, wrapModes);
 }
 
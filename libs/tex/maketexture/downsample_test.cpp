@@ -0,0 +1,201 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for mipmap downsampling.
+ */
+
+#include "downsample.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+RtFloat gaussianFilter(RtFloat x, RtFloat y, RtFloat xwidth, RtFloat ywidth)
+{
+	x *= 2.0f/xwidth;
+	y *= 2.0f/ywidth;
+	return std::exp(-2.0f*(x*x + y*y));
+}
+
+RtFloat diskFilter(RtFloat x, RtFloat y, RtFloat xwidth, RtFloat ywidth)
+{
+	x *= 2.0f/xwidth;
+	y *= 2.0f/ywidth;
+	return x*x + y*y <= 1 ? 1 : 0;
+}
+
+boost::shared_ptr<CqTextureBuffer<TqFloat> > randomBuffer(TqInt width,
+		TqInt height, TqInt numChannels)
+{
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf(
+			new CqTextureBuffer<TqFloat>(width, height, numChannels));
+	for(TqInt y = 0; y < height; ++y)
+		for(TqInt x = 0; x < width; ++x)
+			for(TqInt c = 0; c < numChannels; ++c)
+				buf->value(x,y)[c] = std::rand()/TqFloat(RAND_MAX);
+	return buf;
+}
+
+// Check that the separable and nonseparable downsamplers agree.
+void checkSeparableMatches(TqInt width, TqInt height, EqWrapMode wrapMode)
+{
+	const TqInt numChannels = 3;
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > src
+		= randomBuffer(width, height, numChannels);
+	CqCachedFilter weights(SqFilterInfo(gaussianFilter, 4, 4),
+			width % 2 != 0, height % 2 != 0, 0.5f);
+	std::vector<TqFloat> xWeights, yWeights;
+	BOOST_REQUIRE(weights.separate(xWeights, yWeights));
+	SqWrapModes wrapModes(wrapMode, wrapMode);
+
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > sep
+		= detail::downsampleSeparable(*src, 2, xWeights, yWeights, wrapModes);
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > nonsep
+		= detail::downsampleNonseperable(*src, 2, weights, wrapModes);
+
+	BOOST_REQUIRE_EQUAL(sep->width(), nonsep->width());
+	BOOST_REQUIRE_EQUAL(sep->height(), nonsep->height());
+	for(TqInt y = 0; y < sep->height(); ++y)
+		for(TqInt x = 0; x < sep->width(); ++x)
+			for(TqInt c = 0; c < numChannels; ++c)
+				BOOST_CHECK_SMALL(sep->value(x,y)[c] - nonsep->value(x,y)[c], 1e-4f);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(downsample_tests)
+
+BOOST_AUTO_TEST_CASE(CqCachedFilter_separate_test)
+{
+	std::vector<TqFloat> xWeights, yWeights;
+	CqCachedFilter gaussian(SqFilterInfo(gaussianFilter, 3, 5), true, false, 0.5f);
+	BOOST_REQUIRE(gaussian.separate(xWeights, yWeights));
+	BOOST_REQUIRE_EQUAL(TqInt(xWeights.size()), gaussian.width());
+	BOOST_REQUIRE_EQUAL(TqInt(yWeights.size()), gaussian.height());
+	for(TqInt j = 0; j < gaussian.height(); ++j)
+		for(TqInt i = 0; i < gaussian.width(); ++i)
+			BOOST_CHECK_SMALL(gaussian(i,j) - xWeights[i]*yWeights[j], 1e-4f);
+
+	CqCachedFilter disk(SqFilterInfo(diskFilter, 6, 6), true, true, 0.5f);
+	BOOST_CHECK(!disk.separate(xWeights, yWeights));
+}
+
+BOOST_AUTO_TEST_CASE(downsampleSeparable_test)
+{
+	const EqWrapMode wrapModes[] = {WrapMode_Black, WrapMode_Periodic, WrapMode_Clamp};
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		checkSeparableMatches(16, 12, wrapModes[i]);
+		checkSeparableMatches(13, 7, wrapModes[i]);
+		checkSeparableMatches(3, 1, wrapModes[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqSeparableDownsampler_strips_test)
+{
+	// Adding the rows in strips of any height gives the same result.
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > src = randomBuffer(20, 17, 2);
+	std::vector<TqFloat> xWeights(4, 0.25f), yWeights(3, 1.0f/3);
+	SqWrapModes wrapModes(WrapMode_Periodic, WrapMode_Periodic);
+	CqSeparableDownsampler<CqTextureBuffer<TqFloat> > whole(20, 17, 2, 2,
+			xWeights, yWeights, wrapModes);
+	whole.addRows(*src, 0, 17);
+	CqSeparableDownsampler<CqTextureBuffer<TqFloat> > strips(20, 17, 2, 2,
+			xWeights, yWeights, wrapModes);
+	for(TqInt row = 0; row < 17; row += 5)
+		strips.addRows(*src, row, min(5, 17 - row));
+
+	const CqTextureBuffer<TqFloat>& a = *whole.result();
+	const CqTextureBuffer<TqFloat>& b = *strips.result();
+	for(TqInt y = 0; y < a.height(); ++y)
+		for(TqInt x = 0; x < a.width(); ++x)
+			for(TqInt c = 0; c < 2; ++c)
+				BOOST_CHECK_CLOSE(a.value(x,y)[c], b.value(x,y)[c], 1e-4f);
+}
+
+BOOST_AUTO_TEST_CASE(CqMipmapStreamer_test)
+{
+	// Streaming the first level in strips builds the same levels as
+	// downsampling each whole level in turn, including with periodic
+	// wrapping, where the top rows of each level finish last.
+	const EqWrapMode wrapModes[] = {WrapMode_Black, WrapMode_Periodic, WrapMode_Clamp};
+	const TqInt sizes[][2] = {{37, 29}, {16, 16}, {1, 9}};
+	SqFilterInfo filterInfo(gaussianFilter, 3, 3);
+	for(TqInt w = 0; w < 3; ++w)
+	{
+		for(TqInt s = 0; s < 3; ++s)
+		{
+			const TqInt width = sizes[s][0];
+			const TqInt height = sizes[s][1];
+			SqWrapModes modes(wrapModes[w], wrapModes[w]);
+			boost::shared_ptr<CqTextureBuffer<TqFloat> > src
+				= randomBuffer(width, height, 2);
+			CqMipmapStreamer<CqTextureBuffer<TqFloat> > streamer(width, height,
+					2, filterInfo, modes);
+			BOOST_REQUIRE(streamer.isSeparable());
+			for(TqInt row = 0; row < height; row += 5)
+				streamer.addRows(*src, row, min(5, height - row));
+
+			typedef CqDownsampleIterator<CqTextureBuffer<TqFloat> > TqIter;
+			TqInt level = 0;
+			for(TqIter i = ++TqIter(src, filterInfo, modes), end = TqIter();
+					i != end; ++i)
+			{
+				++level;
+				BOOST_REQUIRE(level <= streamer.numLevels());
+				const CqTextureBuffer<TqFloat>& a = **i;
+				const CqTextureBuffer<TqFloat>& b = *streamer.level(level);
+				BOOST_REQUIRE_EQUAL(a.width(), b.width());
+				BOOST_REQUIRE_EQUAL(a.height(), b.height());
+				for(TqInt y = 0; y < a.height(); ++y)
+					for(TqInt x = 0; x < a.width(); ++x)
+						for(TqInt c = 0; c < 2; ++c)
+							BOOST_CHECK_EQUAL(a.value(x,y)[c], b.value(x,y)[c]);
+			}
+			BOOST_CHECK_EQUAL(level, streamer.numLevels());
+		}
+	}
+
+	CqMipmapStreamer<CqTextureBuffer<TqFloat> > disk(16, 16, 1,
+			SqFilterInfo(diskFilter, 6, 6), SqWrapModes());
+	BOOST_CHECK(!disk.isSeparable());
+	BOOST_CHECK_EQUAL(disk.numLevels(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -47,6 +47,7 @@
 #include <aqsis/tex/io/itexoutputfile.h>
 #include <aqsis/util/logging.h>
 #include "magicnumber.h"
+#include "tiffdirhandle.h"
 #include "downsample.h"
 #include <aqsis/tex/buffers/texturebuffer.h>
 #include <aqsis/tex/texexception.h>
@@ -86,6 +87,70 @@ void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
 	}
 }
 
+/** \brief Stream a mipmap from a file.
+ *
+ * The input file is read a strip of scanlines at a time.  Each strip is
+ * written straight to the output file and fed to a CqMipmapStreamer, which
+ * builds all the smaller levels in the same pass, so the full resolution
+ * image is never held in memory.  This only works for separable filters, and
+ * for input files which can read a range of scanlines without decoding the
+ * whole image.
+ *
+ * \param inFile - input file from which the data should be read
+ * \param outFile - output file for the mipmapped data
+ * \param filterInfo - information about which filter type and size to use
+ * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ *
+ * \return false if the mipmap couldn't be streamed, in which case nothing has
+ * been written.
+ */
+template<typename ChannelT>
+bool streamMipmap(const IqTexInputFile& inFile,
+		IqMultiTexOutputFile& outFile, const SqFilterInfo& filterInfo,
+		const SqWrapModes wrapModes)
+{
+	const CqTexFileHeader& header = inFile.header();
+	if(inFile.fileType() != ImageFile_Tiff
+			|| header.find<Attr::TiffUseGenericRGBA>(false))
+		return false;
+	TqInt width = header.width();
+	TqInt height = header.height();
+	if(width <= 1 && height <= 1)
+		return false;
+	typedef CqTextureBuffer<ChannelT> TqBuffer;
+	CqMipmapStreamer<TqBuffer> streamer(width, height,
+			header.channelList().numChannels(), filterInfo, wrapModes);
+	if(!streamer.isSeparable())
+		return false;
+
+	// Strips must be a whole number of output tiles high.
+	TqInt stripHeight = 64;
+	if(const SqTileInfo* tileInfo = outFile.header().findPtr<Attr::TileInfo>())
+		stripHeight = max(1, stripHeight/tileInfo->height)*tileInfo->height;
+	TqBuffer strip;
+	for(TqInt row = 0; row < height; row += stripHeight)
+	{
+		inFile.readPixels(strip, row, min(stripHeight, height - row));
+		outFile.writePixels(strip);
+		streamer.addRows(strip, 0, strip.height());
+	}
+	for(TqInt i = 1; i <= streamer.numLevels(); ++i)
+	{
+		const TqBuffer& level = *streamer.level(i);
+		outFile.newSubImage(level.width(), level.height());
+		outFile.writePixels(level);
+	}
+	return true;
+}
+
+/// Other texture sources are always read whole.
+template<typename ChannelT, typename TexSrcT>
+bool streamMipmap(const TexSrcT&, IqMultiTexOutputFile&,
+		const SqFilterInfo&, const SqWrapModes)
+{
+	return false;
+}
+
 /** \brief Create a mipmap from pixel data in the given input file.
  *
  * ChannelT is the pixel component type.
@@ -99,8 +164,11 @@ template<typename TexSrcT, typename ChannelT>
 void createMipmapTyped(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
 {
+	if(streamMipmap<ChannelT>(texSrc, outFile, filterInfo, wrapModes))
+		return;
 	// Read pixels into the input buffer.
-	boost::shared_ptr<CqTextureBuffer<ChannelT> > buf(new CqTextureBuffer<ChannelT>());
+	boost::shared_ptr<CqTextureBuffer<ChannelT> > buf(
+			new CqTextureBuffer<ChannelT>());
 	texSrc.readPixels(*buf);
 	downsampleToFile(buf, outFile, filterInfo, wrapModes);
 }
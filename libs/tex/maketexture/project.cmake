@@ -1,5 +1,6 @@
 set(maketexture_srcs
 	bake.cpp
+	downsample.cpp
 	maketexture.cpp
 )
 make_absolute(maketexture_srcs ${maketexture_SOURCE_DIR})
@@ -13,3 +14,8 @@ make_absolute(maketexture_hdrs ${maketexture_SOURCE_DIR})
 
 include_directories(${maketexture_SOURCE_DIR})
 
+
+set(maketexture_test_srcs
+	downsample_test.cpp
+)
+make_absolute(maketexture_test_srcs ${maketexture_SOURCE_DIR})
@@ -27,12 +27,14 @@
 
 #include	<sys/types.h>
 #include	<sys/socket.h>
+#include	<sys/uio.h>
 #include	<netinet/in.h>
 #include	<arpa/inet.h>
 #include	<errno.h>
 #include 	<netdb.h>
 #include	<signal.h>
 #include	<cstring>
+#include	<vector>
 
 #include	<aqsis/util/logging.h>
 
@@ -277,5 +279,65 @@ int	CqSocket::recvData(std::stringstream& buffer) const
 	return count;
 }
 
+
+int	CqSocket::sendBuffers(const void* const* buffers, const size_t* lengths, int count) const
+{
+	std::vector<iovec> iov(count);
+	for(int i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = const_cast<void*>(buffers[i]);
+		iov[i].iov_len = lengths[i];
+	}
+	int tot = 0;
+	size_t first = 0;
+	while(first < iov.size())
+	{
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov[first];
+		msg.msg_iovlen = iov.size() - first;
+		ssize_t n = sendmsg(m_socket, &msg, 0);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			Aqsis::log() << error << "Error writing to socket: " << std::strerror(errno) << std::endl;
+			return -1;
+		}
+		tot += n;
+		// Skip past whatever was sent, which may end part way through a
+		// buffer.
+		size_t sent = n;
+		while(first < iov.size() && sent >= iov[first].iov_len)
+		{
+			sent -= iov[first].iov_len;
+			++first;
+		}
+		if(first < iov.size())
+		{
+			iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + sent;
+			iov[first].iov_len -= sent;
+		}
+	}
+	return tot;
+}
+
+
+int	CqSocket::recvBytes(void* data, size_t length) const
+{
+	char* dest = static_cast<char*>(data);
+	size_t total = 0;
+	while(total < length)
+	{
+		ssize_t count = recv(m_socket, dest + total, length - total, 0);
+		if(count < 0 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			break;
+		total += count;
+	}
+	return total;
+}
+
 } // namespace Aqsis
 //---------------------------------------------------------------------
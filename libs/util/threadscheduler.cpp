@@ -0,0 +1,197 @@
+/* Aqsis - threadscheduler.cpp
+ *
+ * Copyright (C) 2007 Manuel A. Fernadez Montecelo <mafm@users.sourceforge.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include	<aqsis/util/threadscheduler.h>
+
+#include	<algorithm>
+
+#include	<boost/bind.hpp>
+
+
+namespace Aqsis {
+
+CqThreadScheduler::CqThreadScheduler(TqInt numThreads) :
+	m_numThreads(numThreads > 0 ? numThreads : hardwareThreads()),
+	m_queues(),
+	m_nextQueue(0),
+	m_queuedUnits(0),
+	m_pendingUnits(0),
+	m_shutdown(false),
+	m_error()
+{
+#ifdef	ENABLE_THREADING
+	for(TqInt i = 0; i < m_numThreads; ++i)
+		m_queues.push_back(boost::shared_ptr<SqWorkQueue>(new SqWorkQueue()));
+	for(TqInt i = 0; i < m_numThreads; ++i)
+		m_threadGroup.create_thread(boost::bind(&CqThreadScheduler::workerLoop, this, i));
+#endif
+}
+
+
+CqThreadScheduler::~CqThreadScheduler()
+{
+#ifdef	ENABLE_THREADING
+	{
+		// Wait for the pending work, dropping any error since a destructor
+		// mustn't throw.
+		boost::mutex::scoped_lock lock(m_stateMutex);
+		while(m_pendingUnits > 0)
+			m_allDone.wait(lock);
+	}
+	{
+		boost::mutex::scoped_lock lock(m_stateMutex);
+		m_shutdown = true;
+	}
+	m_workAvailable.notify_all();
+	m_threadGroup.join_all();
+#endif
+}
+
+
+void CqThreadScheduler::addWorkUnit(const boost::function0<void>& unit)
+{
+#ifdef	ENABLE_THREADING
+	SqWorkQueue& queue = *m_queues[m_nextQueue];
+	m_nextQueue = (m_nextQueue + 1) % m_numThreads;
+	{
+		boost::mutex::scoped_lock lock(queue.mutex);
+		queue.units.push_back(unit);
+	}
+	{
+		boost::mutex::scoped_lock lock(m_stateMutex);
+		++m_queuedUnits;
+		++m_pendingUnits;
+	}
+	m_workAvailable.notify_one();
+#else // ENABLE_THREADING
+	// If not threading, just run the process synchronously.
+	unit();
+#endif
+}
+
+
+void CqThreadScheduler::joinAll()
+{
+#ifdef	ENABLE_THREADING
+	boost::exception_ptr error;
+	{
+		boost::mutex::scoped_lock lock(m_stateMutex);
+		while(m_pendingUnits > 0)
+			m_allDone.wait(lock);
+		std::swap(error, m_error);
+	}
+	if(error)
+		boost::rethrow_exception(error);
+#endif
+}
+
+
+TqInt CqThreadScheduler::numThreads() const
+{
+	return m_numThreads;
+}
+
+
+TqInt CqThreadScheduler::hardwareThreads()
+{
+#ifdef	ENABLE_THREADING
+	TqInt n = boost::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+#else
+	return 1;
+#endif
+}
+
+
+bool CqThreadScheduler::takeWorkUnit(TqInt index, TqWorkUnit& unit)
+{
+#ifdef	ENABLE_THREADING
+	// First try our own queue, oldest work first.
+	{
+		SqWorkQueue& queue = *m_queues[index];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		if(!queue.units.empty())
+		{
+			unit = queue.units.front();
+			queue.units.pop_front();
+			return true;
+		}
+	}
+	// Otherwise steal the most recently added unit from another worker.
+	for(TqInt i = 1; i < m_numThreads; ++i)
+	{
+		SqWorkQueue& queue = *m_queues[(index + i) % m_numThreads];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		if(!queue.units.empty())
+		{
+			unit = queue.units.back();
+			queue.units.pop_back();
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
+
+void CqThreadScheduler::workerLoop(TqInt index)
+{
+#ifdef	ENABLE_THREADING
+	while(true)
+	{
+		{
+			// Reserve one of the queued units.  The reservation guarantees
+			// that takeWorkUnit() will find a unit in one of the queues,
+			// since units are queued before they are counted.
+			boost::mutex::scoped_lock lock(m_stateMutex);
+			while(m_queuedUnits == 0 && !m_shutdown)
+				m_workAvailable.wait(lock);
+			if(m_queuedUnits == 0)
+				return;
+			--m_queuedUnits;
+		}
+		TqWorkUnit unit;
+		bool found = takeWorkUnit(index, unit);
+		assert(found);
+		boost::exception_ptr error;
+		if(found)
+		{
+			try
+			{
+				unit();
+			}
+			catch(...)
+			{
+				error = boost::current_exception();
+			}
+		}
+		{
+			boost::mutex::scoped_lock lock(m_stateMutex);
+			if(error && !m_error)
+				m_error = error;
+			if(--m_pendingUnits == 0)
+				m_allDone.notify_all();
+		}
+	}
+#endif
+}
+
+
+} // namespace Aqsis
@@ -0,0 +1,134 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the thread scheduler
+ */
+
+#include <aqsis/util/threadscheduler.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+
+using namespace Aqsis;
+
+namespace {
+
+void appendIndex(std::vector<TqInt>& indices, TqInt i)
+{
+	indices.push_back(i);
+}
+
+void increment(boost::detail::atomic_count& count)
+{
+	// Spin for a moment so that the units overlap between the workers.
+	volatile TqInt spin = 0;
+	for(TqInt i = 0; i < 10000; ++i)
+		spin = spin + i;
+	++count;
+}
+
+void throwError(boost::detail::atomic_count& count)
+{
+	++count;
+	throw std::runtime_error("work unit failed");
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqThreadScheduler_fifo_order_test)
+{
+	// A single worker runs the units in the order they were added.
+	CqThreadScheduler scheduler(1);
+	std::vector<TqInt> indices;
+	for(TqInt i = 0; i < 100; ++i)
+		scheduler.addWorkUnit(boost::bind(appendIndex, boost::ref(indices), i));
+	scheduler.joinAll();
+	BOOST_REQUIRE_EQUAL(indices.size(), 100U);
+	for(TqInt i = 0; i < 100; ++i)
+		BOOST_CHECK_EQUAL(indices[i], i);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadScheduler_join_test)
+{
+	CqThreadScheduler scheduler(4);
+	boost::detail::atomic_count count(0);
+	for(TqInt i = 0; i < 1000; ++i)
+		scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	scheduler.joinAll();
+	BOOST_CHECK_EQUAL(long(count), 1000);
+	// The workers keep going after joinAll() and take more work.
+	for(TqInt i = 0; i < 500; ++i)
+		scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	scheduler.joinAll();
+	BOOST_CHECK_EQUAL(long(count), 1500);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadScheduler_shutdown_test)
+{
+	// The destructor finishes the pending work before stopping the workers.
+	boost::detail::atomic_count count(0);
+	{
+		CqThreadScheduler scheduler(3);
+		for(TqInt i = 0; i < 1000; ++i)
+			scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	}
+	BOOST_CHECK_EQUAL(long(count), 1000);
+	// An idle pool shuts down too.
+	{
+		CqThreadScheduler scheduler(3);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadScheduler_exception_test)
+{
+	CqThreadScheduler scheduler(2);
+	boost::detail::atomic_count count(0);
+#ifdef ENABLE_THREADING
+	for(TqInt i = 0; i < 100; ++i)
+	{
+		if(i == 10 || i == 50)
+			scheduler.addWorkUnit(boost::bind(throwError, boost::ref(count)));
+		else
+			scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	}
+	// The other units still run, and the error comes out of joinAll().
+	BOOST_CHECK_THROW(scheduler.joinAll(), std::runtime_error);
+	BOOST_CHECK_EQUAL(long(count), 100);
+	// The error is only reported once, and the pool is still usable.
+	scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	scheduler.joinAll();
+	BOOST_CHECK_EQUAL(long(count), 101);
+#else
+	// Without threads, units run at once and errors propagate directly.
+	BOOST_CHECK_THROW(scheduler.addWorkUnit(boost::bind(throwError,
+					boost::ref(count))), std::runtime_error);
+	scheduler.addWorkUnit(boost::bind(increment, boost::ref(count)));
+	scheduler.joinAll();
+	BOOST_CHECK_EQUAL(long(count), 2);
+#endif
+}
@@ -26,6 +26,7 @@
 #include	<aqsis/util/socket.h>
 
 #include	<signal.h>
+#include	<vector>
 
 #include	<aqsis/util/logging.h>
 
@@ -299,5 +300,64 @@ int	CqSocket::recvData(std::stringstream& buffer) const
 	return count;
 }
 
+
+int	CqSocket::sendBuffers(const void* const* buffers, const size_t* lengths, int count) const
+{
+	std::vector<WSABUF> wsaBuffers(count);
+	for(int i = 0; i < count; ++i)
+	{
+		wsaBuffers[i].buf = static_cast<char*>(const_cast<void*>(buffers[i]));
+		wsaBuffers[i].len = static_cast<u_long>(lengths[i]);
+	}
+	int tot = 0;
+	size_t first = 0;
+	while(first < wsaBuffers.size())
+	{
+		DWORD n = 0;
+		if(WSASend(m_socket, &wsaBuffers[first], static_cast<DWORD>(wsaBuffers.size() - first),
+					&n, 0, NULL, NULL) == SOCKET_ERROR)
+		{
+			int err = WSAGetLastError();
+			Aqsis::log() << error << "Error writing to socket " << err << std::endl;
+			return -1;
+		}
+		tot += n;
+		// Skip past whatever was sent, which may end part way through a
+		// buffer.
+		while(first < wsaBuffers.size() && n >= wsaBuffers[first].len)
+		{
+			n -= wsaBuffers[first].len;
+			++first;
+		}
+		if(first < wsaBuffers.size())
+		{
+			wsaBuffers[first].buf += n;
+			wsaBuffers[first].len -= n;
+		}
+	}
+	return tot;
+}
+
+
+int	CqSocket::recvBytes(void* data, size_t length) const
+{
+	char* dest = static_cast<char*>(data);
+	size_t total = 0;
+	while(total < length)
+	{
+		int count = recv(m_socket, dest + total, static_cast<int>(length - total), 0);
+		if(count == SOCKET_ERROR)
+		{
+			int err = WSAGetLastError();
+			Aqsis::log() << error << "Error reading from socket " << err << std::endl;
+			break;
+		}
+		if(count == 0)
+			break;
+		total += count;
+	}
+	return static_cast<int>(total);
+}
+
 } // namespace Aqsis
 //---------------------------------------------------------------------
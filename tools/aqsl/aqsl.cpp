@@ -69,6 +69,8 @@ ArgParse::apstringvec g_undefines; // Filled in with strings to pass to the prep
 ArgParse::apstring g_backendName = "slx"; /// Name for the comipler backend.
 
 bool g_dumpsl = 0;
+bool g_binary = false;
+bool g_noopt = false;
 bool g_cl_no_color = false;
 bool g_cl_syslog = false;
 ArgParse::apint g_cl_verbose = 1;
@@ -96,6 +98,8 @@ int main( int argc, const char** argv )
 	ap.argString( "backend", " %s \aCompiler backend (default %default).  Possibilities include \"slx\" or \"dot\":\a"
 			      "slx - produce a compiled shader (in the aqsis shader VM stack language)\a"
 				  "dot - make a graphviz visualization of the parse tree (useful for debugging only).", &g_backendName );
+	ap.argFlag( "binary", "\aWrite the compiled shader in binary form, which loads faster", &g_binary );
+	ap.argFlag( "noopt", "\aDon't optimise the compiled code", &g_noopt );
 	ap.argFlag( "help", "\aPrint this help and exit", &g_help );
 	ap.alias("help", "h");
 	ap.argFlag( "version", "\aPrint version information and exit", &g_version );
@@ -171,13 +175,13 @@ int main( int argc, const char** argv )
 				ResetParser();
 				// Create a code generator for the requested backend.
 				if(g_backendName == "slx")
-					codeGenerator.reset(new CqCodeGenVM());
+					codeGenerator.reset(new CqCodeGenVM(g_binary));
 				else if(g_backendName == "dot")
 					codeGenerator.reset(new CqCodeGenGraphviz());
 				else
 				{
 					std::cout << "Unknown backend type: \"" << g_backendName << "\", assuming slx.";
-					codeGenerator.reset(new CqCodeGenVM());
+					codeGenerator.reset(new CqCodeGenVM(g_binary));
 				}
 				// current file position is saved for exception handling
 				boost::wave::util::file_position_type current_position;
@@ -271,7 +275,7 @@ int main( int argc, const char** argv )
 					if( dumpfile.is_open() )
 						dumpfile.close();
   
-					if ( Parse( preprocessed, e->c_str(), Aqsis::log() ) )
+					if ( Parse( preprocessed, e->c_str(), Aqsis::log(), !g_noopt ) )
 						codeGenerator->OutputTree( GetParseTree(), g_stroutname );
 					else
 						error = true;
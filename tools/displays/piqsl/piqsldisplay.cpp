@@ -20,7 +20,8 @@
 
 /** \file
 		\brief A display device that communicates with a separate process
-			using sockets and XML based data packets.
+			using sockets, with XML based control messages and binary
+			bucket data.
 		\author Paul C. Gregory (pgregory@aqsis.org)
 */
 
@@ -66,6 +67,8 @@
 #include <aqsis/util/logging_streambufs.h>
 #include <aqsis/math/math.h>
 
+#include "piqslprotocol.h"
+
 using namespace Aqsis;
 
 struct SqPiqslDisplayInstance
@@ -76,6 +79,27 @@ struct SqPiqslDisplayInstance
 	CqSocket		m_socket;
 	// The number of pixels that have already been rendered (used for progress reporting)
 	TqInt		m_pixelsReceived;
+	// Image size and origin, used to place buckets in shared memory.
+	TqInt		m_width;
+	TqInt		m_height;
+	TqInt		m_originX;
+	TqInt		m_originY;
+	// Set when piqsl accepts binary data messages.
+	bool		m_binaryData;
+	// Set while shared memory may be used to pass the data.
+	bool		m_sharedMemory;
+	boost::shared_ptr<CqPiqslSharedImage> m_sharedImage;
+
+	SqPiqslDisplayInstance()
+		: m_port(0),
+		m_pixelsReceived(0),
+		m_width(0),
+		m_height(0),
+		m_originX(0),
+		m_originY(0),
+		m_binaryData(false),
+		m_sharedMemory(false)
+	{ }
 
 	friend std::istream& operator >>(std::istream &is,struct SqPiqslDisplayInstance &obj);
 	friend std::ostream& operator <<(std::ostream &os,const struct SqPiqslDisplayInstance &obj);
@@ -139,6 +163,16 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 		*image = pImage;
 
 		pImage->m_filename = filename;
+		pImage->m_width = width;
+		pImage->m_height = height;
+		int origin[2] = {0, 0};
+		int originCount = 0;
+		if( DspyFindIntsInParamList("origin", &originCount, origin, paramCount, parameters ) == PkDspyErrorNone
+			&& originCount == 2 )
+		{
+			pImage->m_originX = origin[0];
+			pImage->m_originY = origin[1];
+		}
 
 		int scanorder;
 		if( DspyFindIntInParamList("scanlineorder", &scanorder, paramCount, parameters ) == PkDspyErrorNone )
@@ -375,6 +409,16 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 				formatsXML->LinkEndChild(formatv);
 			}
 			openMsgXML->LinkEndChild(formatsXML);
+
+			// Offer to send bucket data as binary messages, through shared
+			// memory if piqsl is on this host.  Older versions of piqsl
+			// ignore this and keep receiving XML.
+			TiXmlElement* transportXML = new TiXmlElement("Transport");
+			transportXML->SetAttribute("binary", 1);
+			if(pImage->m_hostname == "127.0.0.1" || pImage->m_hostname == "localhost")
+				transportXML->SetAttribute("sharedmemory", 1);
+			openMsgXML->LinkEndChild(transportXML);
+
 			displaydoc.LinkEndChild(displaydecl);
 			displaydoc.LinkEndChild(openMsgXML);
 			sendXMLMessage(displaydoc, pImage->m_socket);
@@ -382,6 +426,16 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 			TiXmlElement* child = formats->FirstChildElement("Formats");
 			if(child)
 			{
+				// See which of the transports we offered have been accepted.
+				if(TiXmlElement* transportXML = child->FirstChildElement("Transport"))
+				{
+					int binary = 0;
+					int sharedMemory = 0;
+					transportXML->QueryIntAttribute("binary", &binary);
+					transportXML->QueryIntAttribute("sharedmemory", &sharedMemory);
+					pImage->m_binaryData = binary != 0;
+					pImage->m_sharedMemory = pImage->m_binaryData && sharedMemory != 0;
+				}
 				TiXmlElement* formatNode = child->FirstChildElement("Format");
 				// If we are recieving "rgba" data, ensure that it is in the
 				// correct order.  First copy the XML "formats" document into
@@ -424,6 +478,74 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 }
 
 
+/** Send a bucket as a binary data message.
+ *
+ * If possible the data is written into the shared memory image and only the
+ * header is sent; otherwise the header and data are sent together straight
+ * from the bucket, without being copied.
+ */
+static PtDspyError sendBinaryData(SqPiqslDisplayInstance* pImage, int xmin,
+		int xmaxplus1, int ymin, int ymaxplus1, int entrysize,
+		const unsigned char *data)
+{
+	SqPiqslDataHeader header;
+	header.xmin = xmin;
+	header.xmaxplus1 = xmaxplus1;
+	header.ymin = ymin;
+	header.ymaxplus1 = ymaxplus1;
+	header.elementSize = entrysize;
+	header.dataLength = entrysize * (xmaxplus1 - xmin) * (ymaxplus1 - ymin);
+
+	if(pImage->m_sharedMemory && !pImage->m_sharedImage)
+	{
+		// Create the shared image and tell piqsl where to find it.
+		pImage->m_sharedImage = CqPiqslSharedImage::create(
+				std::size_t(pImage->m_width)*pImage->m_height*entrysize);
+		if(pImage->m_sharedImage)
+		{
+			std::ostringstream size;
+			size << pImage->m_sharedImage->size();
+			TiXmlDocument msg;
+			TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "", "yes");
+			TiXmlElement* sharedXML = new TiXmlElement("SharedMemory");
+			sharedXML->SetAttribute("name", pImage->m_sharedImage->name());
+			sharedXML->SetAttribute("size", size.str());
+			msg.LinkEndChild(decl);
+			msg.LinkEndChild(sharedXML);
+			sendXMLMessage(msg, pImage->m_socket);
+			// piqsl may not be able to open the segment, even on this host,
+			// so wait to hear whether it did.
+			boost::shared_ptr<TiXmlDocument> reply = recvXMLMessage(pImage->m_socket);
+			int accepted = 0;
+			if(TiXmlElement* replyXML = reply->FirstChildElement("SharedMemory"))
+				replyXML->QueryIntAttribute("accepted", &accepted);
+			if(!accepted)
+				pImage->m_sharedImage.reset();
+		}
+		pImage->m_sharedMemory = pImage->m_sharedImage.get() != 0;
+	}
+
+	unsigned char headerBuf[SqPiqslDataHeader::messageSize];
+	const void* buffers[] = {headerBuf, data};
+	std::size_t lengths[] = {sizeof(headerBuf), header.dataLength};
+	int bufferCount = 2;
+	if(pImage->m_sharedImage && pImage->m_sharedImage->bucketOffset(
+				xmin - pImage->m_originX, ymin - pImage->m_originY,
+				xmaxplus1 - xmin, ymaxplus1 - ymin, pImage->m_width,
+				entrysize, header.dataOffset))
+	{
+		std::memcpy(pImage->m_sharedImage->data() + header.dataOffset, data,
+				header.dataLength);
+		header.transport = PiqslTransport_SharedMemory;
+		bufferCount = 1;
+	}
+	header.encodeMessage(headerBuf);
+	if(pImage->m_socket.sendBuffers(buffers, lengths, bufferCount) < 0)
+		return PkDspyErrorUndefined;
+	return PkDspyErrorNone;
+}
+
+
 extern "C" PtDspyError DspyImageData(PtDspyImageHandle image,
                           int xmin,
                           int xmaxplus1,
@@ -435,6 +557,10 @@ extern "C" PtDspyError DspyImageData(PtDspyImageHandle image,
 	SqPiqslDisplayInstance* pImage;
 	pImage = reinterpret_cast<SqPiqslDisplayInstance*>(image);
 
+	if(pImage->m_binaryData)
+		return sendBinaryData(pImage, xmin, xmaxplus1, ymin, ymaxplus1, entrysize, data);
+
+	// Older versions of piqsl only understand base64 encoded XML data.
 	TqInt bucketlinelen = entrysize * (xmaxplus1 - xmin);
 	TqInt bufferlength = bucketlinelen * (ymaxplus1 - ymin);
 	TiXmlDocument msg;
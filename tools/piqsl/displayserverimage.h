@@ -85,8 +85,8 @@ public:
 	void close();
 
 	/** \brief Accept a bucket of data from the piqsl display server.
- 	 * The data will have been delived to piqsl as an XML packet, this function expects the data to
- 	 * have been parsed and converted to plain binary data in machine format.
+ 	 * The data will have been delived to piqsl as an XML packet or a binary data message, this
+ 	 * function expects the data to have been parsed and converted to plain binary data in machine format.
  	 * \param xmin		The minimum x value in image coordinates of the bucket.
  	 * \param xmaxplus1	One past the maximum x value in image coordinates of the bucket.
  	 * \param ymin		The minimum y value in image coordinates of the bucket.
@@ -32,6 +32,9 @@
 
 #include <float.h>
 
+#include <cstring>
+#include <sstream>
+
 #include <QtCore/QStringList>
 #include <QtCore/QFileInfo>
 #include <QtCore/QSocketNotifier>
@@ -49,7 +52,10 @@
 #endif
 
 
+#include <aqsis/util/logging.h>
+
 #include "displayserverimage.h"
+#include "piqslprotocol.h"
 
 
 namespace Aqsis {
@@ -102,7 +108,11 @@ boost::mutex g_XMLMutex;
 class SocketDataHandler
 {
     public:
-        SocketDataHandler(boost::shared_ptr<CqDisplayServerImage> thisClient) : m_client(thisClient), m_done(false)
+        SocketDataHandler(boost::shared_ptr<CqDisplayServerImage> thisClient)
+            : m_client(thisClient),
+            m_done(false),
+            m_sharedImage(),
+            m_binaryData()
         {}
 
         void operator()()
@@ -118,6 +128,18 @@ class SocketDataHandler
             // Read a message
             while(!m_done)
             {
+                // Binary data messages are told apart from XML ones by
+                // their first byte.
+                char first = 0;
+                if(m_client->socket().recvBytes(&first, 1) != 1)
+                    break;
+                if(first == piqslDataMagic[0])
+                {
+                    if(!processBinaryData())
+                        break;
+                    continue;
+                }
+                buffer.put(first);
                 count = m_client->socket().recvData(buffer);
                 if(count <= 0)
                     break;
@@ -136,6 +158,47 @@ class SocketDataHandler
             return( m_client->socket().sendData( message.str() ) );
         }
 
+        /** Read and display a binary data message, after its first byte.
+         *
+         * \return False if the message couldn't be read.
+         */
+        bool processBinaryData()
+        {
+            const CqSocket& sock = m_client->socket();
+            unsigned char headerBuf[SqPiqslDataHeader::messageSize];
+            headerBuf[0] = piqslDataMagic[0];
+            int count = sock.recvBytes(headerBuf + 1, sizeof(headerBuf) - 1);
+            SqPiqslDataHeader header;
+            if(count < 0 || !header.decodeMessage(headerBuf, count + 1))
+            {
+                Aqsis::log() << error << "Bad data message from display driver\n";
+                return false;
+            }
+            const unsigned char* data = 0;
+            if(header.transport == PiqslTransport_SharedMemory)
+            {
+                if(!m_sharedImage || header.dataOffset > m_sharedImage->size()
+                   || header.dataLength > m_sharedImage->size() - header.dataOffset)
+                {
+                    Aqsis::log() << error << "Bucket outside of shared memory image\n";
+                    return false;
+                }
+                data = m_sharedImage->data() + header.dataOffset;
+            }
+            else
+            {
+                m_binaryData.resize(header.dataLength);
+                if(header.dataLength > 0 && sock.recvBytes(&m_binaryData[0], header.dataLength)
+                        != static_cast<int>(header.dataLength))
+                    return false;
+                data = m_binaryData.empty() ? 0 : &m_binaryData[0];
+            }
+            if(data)
+                m_client->acceptData(header.xmin, header.xmaxplus1, header.ymin,
+                                     header.ymaxplus1, header.elementSize, data);
+            return true;
+        }
+
         void processMessage(std::stringstream& msg)
         {
             boost::mutex::scoped_lock lock(g_XMLMutex);
@@ -223,6 +286,19 @@ class SocketDataHandler
                             param = param->NextSiblingElement("FloatsParameter");
                         }
                     }
+                    // Accept the binary transports offered by the display
+                    // driver.
+                    bool binaryData = false;
+                    bool sharedMemory = false;
+                    if(TiXmlElement* transportXML = root->FirstChildElement("Transport"))
+                    {
+                        int binary = 0;
+                        int shared = 0;
+                        transportXML->QueryIntAttribute("binary", &binary);
+                        transportXML->QueryIntAttribute("sharedmemory", &shared);
+                        binaryData = binary != 0;
+                        sharedMemory = binaryData && shared != 0;
+                    }
                     child = root->FirstChildElement("Formats");
                     if(child)
                     {
@@ -255,6 +331,14 @@ class SocketDataHandler
                             formatv->LinkEndChild(formatText);
                             formatsXML->LinkEndChild(formatv);
                         }
+                        if(binaryData)
+                        {
+                            TiXmlElement* transportXML = new TiXmlElement("Transport");
+                            transportXML->SetAttribute("binary", 1);
+                            if(sharedMemory)
+                                transportXML->SetAttribute("sharedmemory", 1);
+                            formatsXML->LinkEndChild(transportXML);
+                        }
                         doc.LinkEndChild(decl);
                         doc.LinkEndChild(formatsXML);
                         sendXMLMessage(doc);
@@ -303,6 +387,27 @@ class SocketDataHandler
                         }
                     }
                 }
+                else if(root->ValueStr().compare("SharedMemory") == 0)
+                {
+                    // The display driver will put the bucket data into this
+                    // shared memory from now on, if we can open it.
+                    const char* name = root->Attribute("name");
+                    const char* size = root->Attribute("size");
+                    std::size_t sizeValue = 0;
+                    if(size)
+                        std::istringstream(size) >> sizeValue;
+                    if(name)
+                        m_sharedImage = CqPiqslSharedImage::open(name, sizeValue);
+                    // Let the driver know whether to fall back to sending the
+                    // data on the socket.
+                    TiXmlDocument doc;
+                    TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "", "yes");
+                    TiXmlElement* sharedXML = new TiXmlElement("SharedMemory");
+                    sharedXML->SetAttribute("accepted", m_sharedImage ? 1 : 0);
+                    doc.LinkEndChild(decl);
+                    doc.LinkEndChild(sharedXML);
+                    sendXMLMessage(doc);
+                }
                 else if(root->ValueStr().compare("Close") == 0)
                 {
                     // Send and acknowledge.
@@ -321,6 +426,10 @@ class SocketDataHandler
     private:
         boost::shared_ptr<CqDisplayServerImage> m_client;
         bool    m_done;
+        /// Shared memory holding the image data, if the driver uses it.
+        boost::shared_ptr<CqPiqslSharedImage> m_sharedImage;
+        /// Buffer for bucket data received on the socket.
+        std::vector<unsigned char> m_binaryData;
 };
 
 
@@ -0,0 +1,255 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Binary bucket data messages shared by piqsl and its display driver.
+ */
+
+#include "piqslprotocol.h"
+
+#include <cstring>
+#include <ctime>
+
+#include <boost/format.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <aqsis/util/logging.h>
+
+namespace Aqsis {
+
+namespace {
+
+void encodeUint32(TqUint32 value, unsigned char*& buf)
+{
+	*buf++ = static_cast<unsigned char>(value >> 24);
+	*buf++ = static_cast<unsigned char>(value >> 16);
+	*buf++ = static_cast<unsigned char>(value >> 8);
+	*buf++ = static_cast<unsigned char>(value);
+}
+
+TqUint32 decodeUint32(const unsigned char*& buf)
+{
+	TqUint32 value = (TqUint32(buf[0]) << 24) | (TqUint32(buf[1]) << 16)
+		| (TqUint32(buf[2]) << 8) | TqUint32(buf[3]);
+	buf += 4;
+	return value;
+}
+
+} // unnamed namespace
+
+//------------------------------------------------------------------------------
+// SqPiqslDataHeader
+
+SqPiqslDataHeader::SqPiqslDataHeader()
+	: transport(PiqslTransport_Socket),
+	xmin(0),
+	xmaxplus1(0),
+	ymin(0),
+	ymaxplus1(0),
+	elementSize(0),
+	dataLength(0),
+	dataOffset(0)
+{ }
+
+void SqPiqslDataHeader::encode(unsigned char* buf) const
+{
+	encodeUint32(transport, buf);
+	encodeUint32(xmin, buf);
+	encodeUint32(xmaxplus1, buf);
+	encodeUint32(ymin, buf);
+	encodeUint32(ymaxplus1, buf);
+	encodeUint32(elementSize, buf);
+	encodeUint32(dataLength, buf);
+	// The offset is sent as two words so that images larger than 4GB work
+	// on 64 bit hosts.
+	TqUint32 offsetHigh = 0;
+	if(sizeof(std::size_t) > 4)
+		offsetHigh = static_cast<TqUint32>((dataOffset >> 16) >> 16);
+	encodeUint32(offsetHigh, buf);
+	encodeUint32(static_cast<TqUint32>(dataOffset & 0xFFFFFFFF), buf);
+}
+
+void SqPiqslDataHeader::decode(const unsigned char* buf)
+{
+	transport = decodeUint32(buf);
+	xmin = decodeUint32(buf);
+	xmaxplus1 = decodeUint32(buf);
+	ymin = decodeUint32(buf);
+	ymaxplus1 = decodeUint32(buf);
+	elementSize = decodeUint32(buf);
+	dataLength = decodeUint32(buf);
+	std::size_t offsetHigh = decodeUint32(buf);
+	dataOffset = ((offsetHigh << 16) << 16) | decodeUint32(buf);
+}
+
+bool SqPiqslDataHeader::isValid() const
+{
+	if(xmaxplus1 < xmin || ymaxplus1 < ymin)
+		return false;
+	// Reject sizes which would overflow, rather than let them wrap around
+	// to the data length.
+	const TqUint32 maxUint32 = 0xFFFFFFFF;
+	TqUint32 width = xmaxplus1 - xmin;
+	TqUint32 height = ymaxplus1 - ymin;
+	if(width != 0 && height > maxUint32/width)
+		return false;
+	TqUint32 numPixels = width*height;
+	if(numPixels != 0 && elementSize > maxUint32/numPixels)
+		return false;
+	return dataLength == numPixels*elementSize;
+}
+
+void SqPiqslDataHeader::encodeMessage(unsigned char* buf) const
+{
+	std::memcpy(buf, piqslDataMagic, sizeof(piqslDataMagic));
+	encode(buf + sizeof(piqslDataMagic));
+}
+
+bool SqPiqslDataHeader::decodeMessage(const unsigned char* buf,
+		std::size_t length)
+{
+	if(length < static_cast<std::size_t>(messageSize)
+			|| std::memcmp(buf, piqslDataMagic, sizeof(piqslDataMagic)) != 0)
+		return false;
+	decode(buf + sizeof(piqslDataMagic));
+	return isValid();
+}
+
+
+//------------------------------------------------------------------------------
+// CqPiqslSharedImage
+
+namespace ipc = boost::interprocess;
+
+CqPiqslSharedImage::CqPiqslSharedImage()
+	: m_name(),
+	m_owner(false),
+	m_object(),
+	m_region()
+{ }
+
+boost::shared_ptr<CqPiqslSharedImage> CqPiqslSharedImage::create(std::size_t size)
+{
+	boost::shared_ptr<CqPiqslSharedImage> image(new CqPiqslSharedImage());
+	// Find an unused name.  The time keeps names from different renders
+	// apart, and the counter those within one.
+	static TqInt counter = 0;
+	for(TqInt attempt = 0; attempt < 100 && !image->m_object; ++attempt)
+	{
+		std::string name = (boost::format("aqsis_piqsl_%d_%d")
+				% std::time(0) % counter++).str();
+		try
+		{
+			image->m_object.reset(new ipc::shared_memory_object(ipc::create_only,
+						name.c_str(), ipc::read_write));
+			image->m_name = name;
+			image->m_owner = true;
+		}
+		catch(ipc::interprocess_exception& e)
+		{
+			if(e.get_error_code() != ipc::already_exists_error)
+			{
+				Aqsis::log() << warning << "Could not create shared memory for piqsl: "
+					<< e.what() << "\n";
+				return boost::shared_ptr<CqPiqslSharedImage>();
+			}
+		}
+	}
+	if(!image->m_object)
+		return boost::shared_ptr<CqPiqslSharedImage>();
+	try
+	{
+		image->m_object->truncate(size);
+		image->m_region.reset(new ipc::mapped_region(*image->m_object, ipc::read_write));
+	}
+	catch(ipc::interprocess_exception& e)
+	{
+		Aqsis::log() << warning << "Could not map shared memory for piqsl: "
+			<< e.what() << "\n";
+		return boost::shared_ptr<CqPiqslSharedImage>();
+	}
+	return image;
+}
+
+boost::shared_ptr<CqPiqslSharedImage> CqPiqslSharedImage::open(
+		const std::string& name, std::size_t size)
+{
+	boost::shared_ptr<CqPiqslSharedImage> image(new CqPiqslSharedImage());
+	try
+	{
+		image->m_object.reset(new ipc::shared_memory_object(ipc::open_only,
+					name.c_str(), ipc::read_only));
+		image->m_region.reset(new ipc::mapped_region(*image->m_object, ipc::read_only));
+	}
+	catch(ipc::interprocess_exception& e)
+	{
+		Aqsis::log() << warning << "Could not open shared memory \"" << name
+			<< "\": " << e.what() << "\n";
+		return boost::shared_ptr<CqPiqslSharedImage>();
+	}
+	if(image->size() < size)
+	{
+		Aqsis::log() << warning << "Shared memory \"" << name
+			<< "\" is smaller than expected\n";
+		return boost::shared_ptr<CqPiqslSharedImage>();
+	}
+	image->m_name = name;
+	return image;
+}
+
+CqPiqslSharedImage::~CqPiqslSharedImage()
+{
+	m_region.reset();
+	m_object.reset();
+	// Other processes keep any mappings they have, so the name can go as
+	// soon as the creator is done with it.
+	if(m_owner)
+		ipc::shared_memory_object::remove(m_name.c_str());
+}
+
+const std::string& CqPiqslSharedImage::name() const
+{
+	return m_name;
+}
+
+std::size_t CqPiqslSharedImage::size() const
+{
+	return m_region ? m_region->get_size() : 0;
+}
+
+unsigned char* CqPiqslSharedImage::data() const
+{
+	return m_region ? static_cast<unsigned char*>(m_region->get_address()) : 0;
+}
+
+bool CqPiqslSharedImage::bucketOffset(TqInt x, TqInt y, TqInt width,
+		TqInt height, TqInt imageWidth, TqInt elementSize,
+		std::size_t& offset) const
+{
+	if(x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > imageWidth)
+		return false;
+	// The rows of the image from y to y+height hold the row of buckets, with
+	// each bucket taking height*width pixels from x*height on.
+	offset = (std::size_t(y)*imageWidth + std::size_t(x)*height)*elementSize;
+	return offset + std::size_t(width)*height*elementSize <= size();
+}
+
+} // namespace Aqsis
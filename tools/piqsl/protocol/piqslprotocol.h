@@ -0,0 +1,182 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Binary bucket data messages shared by piqsl and its display driver.
+ *
+ * Messages between the piqsl display driver and piqsl are XML documents
+ * terminated by a null character.  Pixel data is much better sent raw, so
+ * when both ends support it the driver sends each bucket as a binary data
+ * message instead: the bytes of piqslDataMagic, an encoded
+ * SqPiqslDataHeader, and then the pixel data itself unless it has been
+ * placed in shared memory.  Since XML messages always begin with '<', the
+ * first byte of a message tells the two kinds apart.
+ *
+ * Support is negotiated when the image is opened.  The driver adds a
+ * Transport element to its Open message, such as
+ *
+ *   <Transport binary="1" sharedmemory="1"/>
+ *
+ * and a version of piqsl which understands it returns a Transport element
+ * with the parts it accepts inside its Formats reply.  Older versions of
+ * piqsl ignore the element and reply without one, and older drivers don't
+ * look for it, so either way an old peer just keeps getting XML data.
+ *
+ * For shared memory, the driver announces the segment holding the image with
+ * a SharedMemory message before the first bucket which uses it:
+ *
+ *   <SharedMemory name="..." size="..."/>
+ */
+
+#ifndef PIQSLPROTOCOL_H_INCLUDED
+#define PIQSLPROTOCOL_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace boost { namespace interprocess {
+	class shared_memory_object;
+	class mapped_region;
+} }
+
+namespace Aqsis {
+
+/// Bytes which begin a binary data message.
+const char piqslDataMagic[4] = {'\x01', 'P', 'Q', 'D'};
+
+/// Ways of delivering the pixel data of a binary data message.
+enum EqPiqslTransport
+{
+	PiqslTransport_Socket = 0,		///< Data follows the header on the socket.
+	PiqslTransport_SharedMemory = 1	///< Data is in the shared memory image.
+};
+
+/** \brief Header of a binary data message.
+ *
+ * The header is encoded with each field in network byte order, so it
+ * doesn't depend on the layout of the struct.  The pixel data itself is
+ * sent in the renderer's byte order, as it always has been.
+ */
+struct SqPiqslDataHeader
+{
+	/// Size of the encoded header in bytes.
+	static const int encodedSize = 9*4;
+	/// Size of the start of a data message: the magic bytes and the header.
+	static const int messageSize = sizeof(piqslDataMagic) + encodedSize;
+
+	/// How the data is delivered, an EqPiqslTransport.
+	TqUint32 transport;
+	TqUint32 xmin;
+	TqUint32 xmaxplus1;
+	TqUint32 ymin;
+	TqUint32 ymaxplus1;
+	/// Number of bytes in each pixel.
+	TqUint32 elementSize;
+	/// Number of bytes of pixel data.
+	TqUint32 dataLength;
+	/// Offset of the pixel data in the shared memory image.
+	std::size_t dataOffset;
+
+	SqPiqslDataHeader();
+
+	/// Encode the header into encodedSize bytes at buf.
+	void encode(unsigned char* buf) const;
+	/// Decode the header from encodedSize bytes at buf.
+	void decode(const unsigned char* buf);
+	/// Check that the data length agrees with the bucket dimensions.
+	bool isValid() const;
+
+	/// Encode the magic bytes and the header into messageSize bytes at buf.
+	void encodeMessage(unsigned char* buf) const;
+	/** \brief Decode the magic bytes and the header at the start of a message.
+	 *
+	 * \param buf - start of the message.
+	 * \param length - number of bytes received at buf.
+	 * \return False if the message is shorter than messageSize, doesn't begin
+	 * with the magic bytes, or has an invalid header.
+	 */
+	bool decodeMessage(const unsigned char* buf, std::size_t length);
+};
+
+
+/** \brief A shared memory segment holding the pixels of an image.
+ *
+ * Used when piqsl runs on the same host as the renderer, so that the driver
+ * can hand over each bucket by writing it into the segment and sending just
+ * its header.  Each bucket is written contiguously at an offset found from
+ * its position, with the buckets of each row of buckets laid side by side,
+ * so buckets never overwrite each other.
+ */
+class CqPiqslSharedImage : boost::noncopyable
+{
+	public:
+		/** \brief Create a new segment with a unique name.
+		 *
+		 * The name is removed again when the segment is destroyed.
+		 *
+		 * \return The segment, or null if shared memory isn't available.
+		 */
+		static boost::shared_ptr<CqPiqslSharedImage> create(std::size_t size);
+		/** \brief Open a segment created by another process.
+		 *
+		 * \return The segment, or null if it couldn't be opened.
+		 */
+		static boost::shared_ptr<CqPiqslSharedImage> open(const std::string& name,
+				std::size_t size);
+
+		~CqPiqslSharedImage();
+
+		/// Get the name which identifies the segment to other processes.
+		const std::string& name() const;
+		/// Get the size of the segment in bytes.
+		std::size_t size() const;
+		/// Get the start of the segment.
+		unsigned char* data() const;
+
+		/** \brief Find where a bucket goes in the segment.
+		 *
+		 * \param x, y - position of the bucket relative to the image origin.
+		 * \param width, height - size of the bucket in pixels.
+		 * \param imageWidth - width of the image in pixels.
+		 * \param elementSize - bytes per pixel.
+		 * \param offset - set to the offset of the bucket data.
+		 * \return False if the bucket doesn't fit in the segment.
+		 */
+		bool bucketOffset(TqInt x, TqInt y, TqInt width, TqInt height,
+				TqInt imageWidth, TqInt elementSize, std::size_t& offset) const;
+
+	private:
+		CqPiqslSharedImage();
+
+		std::string m_name;
+		bool m_owner;
+		boost::scoped_ptr<boost::interprocess::shared_memory_object> m_object;
+		boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+};
+
+} // namespace Aqsis
+
+#endif // PIQSLPROTOCOL_H_INCLUDED
@@ -0,0 +1,189 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+ *
+ * \brief Unit tests for the binary piqsl data messages.
+ */
+
+#include "piqslprotocol.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace Aqsis;
+
+namespace {
+
+SqPiqslDataHeader testHeader()
+{
+	SqPiqslDataHeader header;
+	header.transport = PiqslTransport_SharedMemory;
+	header.xmin = 0x01020304;
+	header.xmaxplus1 = 0x01020304 + 3;
+	header.ymin = 17;
+	header.ymaxplus1 = 22;
+	header.elementSize = 12;
+	header.dataLength = 3*5*12;
+	header.dataOffset = 0x0A0B0C0D;
+	return header;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(SqPiqslDataHeader_roundtrip_test)
+{
+	SqPiqslDataHeader header = testHeader();
+	if(sizeof(std::size_t) > 4)
+		header.dataOffset |= (std::size_t(0x05) << 16) << 16;
+	unsigned char buf[SqPiqslDataHeader::messageSize];
+	header.encodeMessage(buf);
+
+	// Fields are big endian, after the magic bytes.
+	BOOST_CHECK(std::equal(piqslDataMagic, piqslDataMagic + 4, buf));
+	const unsigned char transport[] = {0, 0, 0, 1};
+	BOOST_CHECK(std::equal(transport, transport + 4, buf + 4));
+	const unsigned char xmin[] = {1, 2, 3, 4};
+	BOOST_CHECK(std::equal(xmin, xmin + 4, buf + 8));
+	const unsigned char offsetLow[] = {0x0A, 0x0B, 0x0C, 0x0D};
+	BOOST_CHECK(std::equal(offsetLow, offsetLow + 4, buf + 36));
+
+	SqPiqslDataHeader decoded;
+	BOOST_REQUIRE(decoded.decodeMessage(buf, sizeof(buf)));
+	BOOST_CHECK_EQUAL(decoded.transport, header.transport);
+	BOOST_CHECK_EQUAL(decoded.xmin, header.xmin);
+	BOOST_CHECK_EQUAL(decoded.xmaxplus1, header.xmaxplus1);
+	BOOST_CHECK_EQUAL(decoded.ymin, header.ymin);
+	BOOST_CHECK_EQUAL(decoded.ymaxplus1, header.ymaxplus1);
+	BOOST_CHECK_EQUAL(decoded.elementSize, header.elementSize);
+	BOOST_CHECK_EQUAL(decoded.dataLength, header.dataLength);
+	BOOST_CHECK_EQUAL(decoded.dataOffset, header.dataOffset);
+}
+
+BOOST_AUTO_TEST_CASE(SqPiqslDataHeader_truncated_test)
+{
+	unsigned char buf[SqPiqslDataHeader::messageSize];
+	testHeader().encodeMessage(buf);
+	SqPiqslDataHeader decoded;
+	BOOST_CHECK(!decoded.decodeMessage(buf, 0));
+	BOOST_CHECK(!decoded.decodeMessage(buf, sizeof(piqslDataMagic)));
+	BOOST_CHECK(!decoded.decodeMessage(buf, sizeof(buf) - 1));
+	BOOST_CHECK(decoded.decodeMessage(buf, sizeof(buf)));
+}
+
+BOOST_AUTO_TEST_CASE(SqPiqslDataHeader_bad_magic_test)
+{
+	unsigned char buf[SqPiqslDataHeader::messageSize];
+	for(int i = 0; i < 4; ++i)
+	{
+		testHeader().encodeMessage(buf);
+		buf[i] ^= 0x20;
+		SqPiqslDataHeader decoded;
+		BOOST_CHECK(!decoded.decodeMessage(buf, sizeof(buf)));
+	}
+	// XML messages never look like data messages.
+	testHeader().encodeMessage(buf);
+	buf[0] = '<';
+	SqPiqslDataHeader decoded;
+	BOOST_CHECK(!decoded.decodeMessage(buf, sizeof(buf)));
+}
+
+BOOST_AUTO_TEST_CASE(SqPiqslDataHeader_isValid_test)
+{
+	SqPiqslDataHeader header = testHeader();
+	BOOST_CHECK(header.isValid());
+	header.dataLength += 1;
+	BOOST_CHECK(!header.isValid());
+
+	header = testHeader();
+	header.xmaxplus1 = header.xmin - 1;
+	header.dataLength = 0;
+	BOOST_CHECK(!header.isValid());
+
+	// 65536*65536*4 bytes wraps around to zero in 32 bits.
+	header = testHeader();
+	header.xmin = 0;
+	header.xmaxplus1 = 0x10000;
+	header.ymin = 0;
+	header.ymaxplus1 = 0x10000;
+	header.elementSize = 4;
+	header.dataLength = 0;
+	BOOST_CHECK(!header.isValid());
+	header.ymaxplus1 = 0x4000;
+	header.elementSize = 1;
+	header.dataLength = 0x40000000;
+	BOOST_CHECK(header.isValid());
+
+	// Empty buckets are fine.
+	header.ymaxplus1 = 0;
+	header.dataLength = 0;
+	BOOST_CHECK(header.isValid());
+}
+
+BOOST_AUTO_TEST_CASE(CqPiqslSharedImage_bucketOffset_test)
+{
+	// An image which isn't a multiple of the bucket size, so the buckets on
+	// the right and bottom edges are smaller.
+	const TqInt width = 37;
+	const TqInt height = 23;
+	const TqInt bucketSize = 16;
+	const TqInt elementSize = 4;
+	const std::size_t imageSize = std::size_t(width)*height*elementSize;
+	boost::shared_ptr<CqPiqslSharedImage> image
+		= CqPiqslSharedImage::create(imageSize);
+	BOOST_REQUIRE(image);
+	BOOST_REQUIRE(image->size() >= imageSize);
+
+	// The buckets must exactly tile the image memory.
+	std::vector<std::pair<std::size_t, std::size_t> > ranges;
+	for(TqInt y = 0; y < height; y += bucketSize)
+	{
+		for(TqInt x = 0; x < width; x += bucketSize)
+		{
+			TqInt bucketWidth = std::min(bucketSize, width - x);
+			TqInt bucketHeight = std::min(bucketSize, height - y);
+			std::size_t offset = 0;
+			BOOST_REQUIRE(image->bucketOffset(x, y, bucketWidth, bucketHeight,
+					width, elementSize, offset));
+			ranges.push_back(std::make_pair(offset,
+					offset + std::size_t(bucketWidth)*bucketHeight*elementSize));
+		}
+	}
+	std::sort(ranges.begin(), ranges.end());
+	BOOST_CHECK_EQUAL(ranges.front().first, 0U);
+	for(std::size_t i = 1; i < ranges.size(); ++i)
+		BOOST_CHECK_EQUAL(ranges[i-1].second, ranges[i].first);
+	BOOST_CHECK_EQUAL(ranges.back().second, imageSize);
+
+	std::size_t offset = 0;
+	// Buckets hanging off the right of the image, or outside it.
+	BOOST_CHECK(!image->bucketOffset(32, 0, 16, 16, width, elementSize, offset));
+	BOOST_CHECK(!image->bucketOffset(-1, 0, 16, 16, width, elementSize, offset));
+	BOOST_CHECK(!image->bucketOffset(0, -1, 16, 16, width, elementSize, offset));
+	BOOST_CHECK(!image->bucketOffset(0, 0, 0, 16, width, elementSize, offset));
+	// A bucket hanging off the bottom doesn't fit in the segment.
+	BOOST_CHECK(!image->bucketOffset(32, 16, 5, 16, width, elementSize, offset));
+	// Nor does one with more bytes per pixel than the segment was made for.
+	BOOST_CHECK(!image->bucketOffset(32, 16, 5, 7, width, 2*elementSize, offset));
+}
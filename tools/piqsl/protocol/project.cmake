@@ -0,0 +1,26 @@
+set(protocol_srcs
+	piqslprotocol.cpp
+)
+make_absolute(protocol_srcs ${protocol_SOURCE_DIR})
+
+set(protocol_hdrs
+	piqslprotocol.h
+)
+make_absolute(protocol_hdrs ${protocol_SOURCE_DIR})
+
+set(protocol_test_srcs
+	piqslprotocol_test.cpp
+)
+make_absolute(protocol_test_srcs ${protocol_SOURCE_DIR})
+
+include_directories(${protocol_SOURCE_DIR})
+
+# POSIX shared memory lives in librt on older Linux systems.
+set(protocol_libs)
+if(UNIX AND NOT APPLE)
+	find_library(AQSIS_RT_LIBRARY rt)
+	mark_as_advanced(AQSIS_RT_LIBRARY)
+	if(AQSIS_RT_LIBRARY)
+		set(protocol_libs ${AQSIS_RT_LIBRARY})
+	endif()
+endif()
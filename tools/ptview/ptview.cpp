@@ -386,7 +386,7 @@ static void drawDisk(V3f p, V3f n, float r)
 
 
 /// Debug: visualize tree splitting
-static void splitNode(V3f P, float maxSolidAngle, int dataSize,
+static void splitNode(V3f P, float maxSolidAngle, const DiffusePointOctree& tree,
                        const DiffusePointOctree::Node* node)
 {
     // Examine node bound and cull if possible
@@ -409,7 +409,7 @@ static void splitNode(V3f P, float maxSolidAngle, int dataSize,
             // Leaf node: simply render each child point.
             for(int i = 0; i < node->npoints; ++i)
             {
-                const float* data = &node->data[i*dataSize];
+                const float* data = tree.pointData(node) + i*tree.dataSize();
                 V3f p = V3f(data[0], data[1], data[2]);
                 V3f n = V3f(data[3], data[4], data[5]);
                 float r = data[6];
@@ -422,10 +422,10 @@ static void splitNode(V3f P, float maxSolidAngle, int dataSize,
             // Interior node: render each non-null child.
             for(int i = 0; i < 8; ++i)
             {
-                DiffusePointOctree::Node* child = node->children[i];
+                const DiffusePointOctree::Node* child = tree.child(node, i);
                 if(!child)
                     continue;
-                splitNode(P, maxSolidAngle, dataSize, child);
+                splitNode(P, maxSolidAngle, tree, child);
             }
         }
     }
@@ -711,7 +711,7 @@ void PointView::paintGL()
     for(size_t i = 0; i < m_points.size(); ++i)
         drawPoints(*m_points[i], m_visMode, m_lighting);
 //    if(m_pointTree)
-//        splitNode(m_cursorPos, m_probeMaxSolidAngle, m_pointTree->dataSize(),
+//        splitNode(m_cursorPos, m_probeMaxSolidAngle, *m_pointTree,
 //                  m_pointTree->root());
 
 
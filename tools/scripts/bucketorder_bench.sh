@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Benchmark for the bucket orders.
+#
+# Renders a scene with each bucket order, and reports the wall time and peak
+# resident memory of each render.
+
+function print_help
+{
+cat <<EOF
+Usage: bucketorder_bench.sh [options] [file.rib]
+
+Render file.rib (default: the microbe example scene from the source tree) once
+with each bucket order, and print the wall time and the peak resident memory
+of the aqsis process for each.  Peak memory is measured with GNU time.  The
+images go to the displays named in the scene.
+
+Options:
+    -h                   This help
+    -s path              aqsis executable to use (default: aqsis)
+    -t count             Number of threads to render with (default: all cores)
+    -b size              Bucket size in pixels (default: the renderer default)
+    -o orders            Space separated list of orders to render with
+                         (default: all of them)
+EOF
+}
+
+aqsis=aqsis
+threads=
+bucketSize=
+orders="horizontal vertical zigzag spiral hilbert random memory"
+
+while getopts "hs:t:b:o:" opt ; do
+    case $opt in
+        h) print_help ; exit 0 ;;
+        s) aqsis=$OPTARG ;;
+        t) threads=$OPTARG ;;
+        b) bucketSize=$OPTARG ;;
+        o) orders=$OPTARG ;;
+        *) print_help ; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+rib=${1:-$(dirname "$0")/../../examples/scenes/microbe/microbe.rib}
+if [[ ! -x /usr/bin/time ]] ; then
+    echo "GNU time is needed in /usr/bin/time to measure memory use" >&2
+    exit 1
+fi
+
+options=()
+if [[ -n $threads ]] ; then
+    options+=("-option=Option \"limits\" \"integer threads\" [$threads]")
+fi
+if [[ -n $bucketSize ]] ; then
+    options+=("-option=Option \"limits\" \"integer bucketsize\" [$bucketSize $bucketSize]")
+fi
+
+# Render from the directory of the scene, so that relative paths in it work.
+cd "$(dirname "$rib")" || exit 1
+rib=$(basename "$rib")
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+printf "%-12s %10s %14s\n" "order" "time" "peak memory"
+for order in $orders ; do
+    if ! /usr/bin/time -f "%e %M" -o "$log" "$aqsis" "${options[@]}" \
+            "-option=Option \"render\" \"string bucketorder\" [\"$order\"]" \
+            "$rib" > /dev/null 2>&1 ; then
+        echo "$order: render failed" >&2
+        continue
+    fi
+    read -r seconds kbytes < <(tail -n 1 "$log")
+    printf "%-12s %9.2fs %11d kB\n" "$order" "$seconds" "$kbytes"
+done
@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# Benchmark for the optimisations done by aqsl.
+#
+# Compiles each shader with and without optimisation, and reports the number
+# of VM instructions in each version.  Given a RIB file, it also renders the
+# scene with each set of shaders and reports the render times.
+
+function print_help
+{
+cat <<EOF
+Usage: shaderopt_bench.sh [options] [shader_dir]
+
+Compile every .sl file under shader_dir (default: the shaders directory of the
+source tree) with "aqsl" and "aqsl -noopt", and print the number of VM
+instructions in the init and code segments of each compiled shader.
+
+Options:
+    -h                   This help
+    -a path              aqsl executable to use (default: aqsl)
+    -r file.rib          Also time rendering file.rib with each set of shaders
+    -s path              aqsis executable to use with -r (default: aqsis)
+    -n count             Number of renders to time with -r (default: 3)
+EOF
+}
+
+aqsl=aqsl
+aqsis=aqsis
+rib=
+renders=3
+
+while getopts "ha:r:s:n:" opt ; do
+    case $opt in
+        h) print_help ; exit 0 ;;
+        a) aqsl=$OPTARG ;;
+        r) rib=$OPTARG ;;
+        s) aqsis=$OPTARG ;;
+        n) renders=$OPTARG ;;
+        *) print_help ; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+shaderDir=${1:-$(dirname "$0")/../../shaders}
+includeDir=$shaderDir/include
+outDir=$(mktemp -d)
+trap 'rm -rf "$outDir"' EXIT
+mkdir "$outDir/opt" "$outDir/noopt"
+
+# Count the instructions in a compiled shader.  Instructions are the indented
+# lines of the init and code segments; labels and declarations aren't.
+function count_instructions
+{
+    awk '/^segment (Init|Code)/ { code = 1 } /^segment Data/ { code = 0 }
+         code && /^\t/ { n++ } END { print n + 0 }' "$1"
+}
+
+totalOpt=0
+totalNoOpt=0
+printf "%-24s %10s %10s\n" "shader" "-noopt" "optimised"
+for sl in $(find "$shaderDir" -name '*.sl' -not -path "$includeDir/*" | sort) ; do
+    name=$(basename "$sl" .sl)
+    if ! "$aqsl" -noopt -i "$includeDir" -o "$outDir/noopt/$name.slx" "$sl" > /dev/null 2>&1 ||
+       ! "$aqsl" -i "$includeDir" -o "$outDir/opt/$name.slx" "$sl" > /dev/null 2>&1 ; then
+        echo "$name: failed to compile" >&2
+        continue
+    fi
+    noopt=$(count_instructions "$outDir/noopt/$name.slx")
+    opt=$(count_instructions "$outDir/opt/$name.slx")
+    totalNoOpt=$((totalNoOpt + noopt))
+    totalOpt=$((totalOpt + opt))
+    printf "%-24s %10d %10d\n" "$name" "$noopt" "$opt"
+done
+printf "%-24s %10d %10d\n" "total" "$totalNoOpt" "$totalOpt"
+
+if [[ -n $rib ]] ; then
+    echo
+    for version in noopt opt ; do
+        start=$(date +%s.%N)
+        for ((i = 0; i < renders; ++i)) ; do
+            "$aqsis" -shaders="$outDir/$version:&" "$rib" > /dev/null 2>&1
+        done
+        end=$(date +%s.%N)
+        printf "%-24s %10.3fs per render\n" "$version" \
+            "$(echo "($end - $start) / $renders" | bc -l)"
+    done
+fi